@@ -0,0 +1,302 @@
+/*! \file    bwe-bench.c
+ * \copyright GNU General Public License v3
+ * \brief    Bandwidth estimation in an emulated network
+ * \details  Deterministic network emulator to check how the sender side
+ * bandwidth estimator (bwe.c) converges. A sender sends 1200 bytes packets
+ * at the rate the estimator suggests, stamping each of them with a transport
+ * wide sequence number as the core does, through a bottleneck link with
+ * the given capacity, a drop-tail queue, a one-way delay and random loss.
+ * The receiver reports what it got every 100ms, as browsers do: packets
+ * that are still missing are reported again in the next few feedback
+ * messages, and windows overlap when that happens. The feedback gets back
+ * to the sender after the one-way delay, and is passed to the estimator.
+ * The capacity can change over time (one value per phase): for each phase
+ * we print how long the estimate took to settle, the link utilization and
+ * the queueing delay in its last seconds, and the emulator fails if they're
+ * not within the expected bounds. Time is simulated, and the loss pattern
+ * only depends on the seed, so each run gives the same results.
+ *
+ * Usage: bwe-bench [-c kbps[,kbps...]] [-t seconds per phase] [-d delay ms] [-q queue ms] [-l loss %] [-S seed] [-v]
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "bwe.h"
+
+/* No logging, as there's no log thread to print anything */
+int janus_log_level = 0;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+#define BENCH_TICK				1000	/* Simulation step, in microseconds */
+#define BENCH_PACKET			1200	/* Packet size, in bytes */
+#define BENCH_FEEDBACK			100000	/* Feedback interval, in microseconds */
+#define BENCH_REPORTS			3		/* How many times a missing packet is reported */
+#define BENCH_MAX_PHASES		8
+#define BENCH_SLOTS				4096	/* Must be a power of 2 */
+#define BENCH_SETTLED_LOW		0.70	/* Bounds for the utilization in the last seconds of a phase */
+#define BENCH_SETTLED_HIGH		1.05
+#define BENCH_SETTLED_QUEUE		100		/* Maximum average queueing delay, in ms, in the last seconds of a phase */
+#define BENCH_SETTLED_WINDOW	5		/* How many seconds, at the end of a phase, we check */
+
+/* A packet on its way to the receiver */
+typedef struct bench_packet {
+	guint32 seq;
+	gint64 arrival;
+} bench_packet;
+
+/* A feedback message on its way to the sender */
+typedef struct bench_feedback {
+	janus_rtcp_transport_wide_cc_status statuses[JANUS_BWE_MAX_FEEDBACK];
+	int count;
+	gint64 arrival;
+} bench_feedback;
+
+typedef struct bench_receiver {
+	/* Reception times, and how many times each packet was reported as missing */
+	gint64 arrivals[BENCH_SLOTS];
+	guint8 reports[BENCH_SLOTS];
+	/* First packet the next feedback needs to cover, and the one after the highest we received */
+	guint32 base, end;
+	gboolean started;
+} bench_receiver;
+
+/* Build a feedback message: everything from the oldest packet we still
+ * need to report (received, or missing and not reported enough times) */
+static int bench_receiver_feedback(bench_receiver *r, janus_rtcp_transport_wide_cc_status *statuses) {
+	guint32 seq = 0, next_base = 0;
+	int count = 0;
+	if(!r->started || r->base == r->end)
+		return 0;
+	if(r->end - r->base > JANUS_BWE_MAX_FEEDBACK)
+		r->base = r->end - JANUS_BWE_MAX_FEEDBACK;
+	next_base = r->end;
+	for(seq = r->base; seq != r->end; seq++) {
+		int slot = seq & (BENCH_SLOTS-1);
+		statuses[count].seq_num = (guint16)seq;
+		statuses[count].received = r->arrivals[slot] > 0;
+		/* Browsers send times with a 250us granularity */
+		statuses[count].arrival = r->arrivals[slot] - r->arrivals[slot] % 250;
+		count++;
+		if(r->arrivals[slot] == 0) {
+			r->reports[slot]++;
+			/* Report this again next time (and everything after it) */
+			if(r->reports[slot] < BENCH_REPORTS && next_base == r->end)
+				next_base = seq;
+		}
+	}
+	r->base = next_base;
+	return count;
+}
+
+typedef struct bench_phase {
+	guint32 capacity;	/* bps */
+	/* Estimate, bytes sent and received, queueing delay, and packets lost, per second */
+	guint32 *estimate;
+	guint64 *sent, *received, *queue, *lost;
+	int settled;	/* Seconds before the estimate got (and stayed) within bounds, -1 if never */
+} bench_phase;
+
+static int bench_parse_capacities(const char *list, bench_phase *phases) {
+	gchar **kbps = g_strsplit(list, ",", -1);
+	int count = 0, i = 0;
+	for(i=0; kbps[i] != NULL && count < BENCH_MAX_PHASES; i++) {
+		int value = atoi(kbps[i]);
+		if(value <= 0) {
+			count = -1;
+			break;
+		}
+		phases[count++].capacity = (guint32)value*1000;
+	}
+	g_strfreev(kbps);
+	return count;
+}
+
+int main(int argc, char *argv[]) {
+	const char *capacities = "1000,500,1500";
+	int seconds = 30, delay = 50, queue = 300, opt = 0, phases_count = 0, i = 0, s = 0;
+	double loss = 0;
+	guint32 seed = 1;
+	gboolean verbose = FALSE;
+	bench_phase phases[BENCH_MAX_PHASES];
+
+	while((opt = getopt(argc, argv, "c:t:d:q:l:S:vh")) != -1) {
+		switch(opt) {
+			case 'c':
+				capacities = optarg;
+				break;
+			case 't':
+				seconds = atoi(optarg);
+				break;
+			case 'd':
+				delay = atoi(optarg);
+				break;
+			case 'q':
+				queue = atoi(optarg);
+				break;
+			case 'l':
+				loss = atof(optarg);
+				break;
+			case 'S':
+				seed = (guint32)atol(optarg);
+				break;
+			case 'v':
+				verbose = TRUE;
+				break;
+			default:
+				printf("Usage: %s [-c kbps[,kbps...]] [-t seconds per phase] [-d delay ms] [-q queue ms] [-l loss %%] [-S seed] [-v]\n", argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	memset(phases, 0, sizeof(phases));
+	phases_count = bench_parse_capacities(capacities, phases);
+	if(phases_count < 1 || seconds <= BENCH_SETTLED_WINDOW || delay < 0 || queue <= 0 || loss < 0 || loss >= 100) {
+		printf("Invalid arguments\n");
+		return 1;
+	}
+	for(i=0; i<phases_count; i++) {
+		phases[i].estimate = g_malloc0(seconds * sizeof(guint32));
+		phases[i].sent = g_malloc0(seconds * sizeof(guint64));
+		phases[i].received = g_malloc0(seconds * sizeof(guint64));
+		phases[i].queue = g_malloc0(seconds * sizeof(guint64));
+		phases[i].lost = g_malloc0(seconds * sizeof(guint64));
+		phases[i].settled = -1;
+	}
+
+	/* The receiver and the packets in flight are too large for the stack */
+	bench_receiver *receiver = g_malloc0(sizeof(bench_receiver));
+	bench_packet *link = g_malloc0(BENCH_SLOTS * sizeof(bench_packet));
+	int link_head = 0, link_count = 0;
+	GQueue *feedbacks = g_queue_new();
+	GRand *rand = g_rand_new_with_seed(seed);
+	janus_bwe_context *bwe = janus_bwe_context_create(0);
+	guint32 estimate = JANUS_BWE_START_BITRATE, seq = 0;
+	/* The bwe context treats 0 as "never", so don't start the clock from there */
+	gint64 start = G_USEC_PER_SEC, now = start, end = start + (gint64)phases_count*seconds*G_USEC_PER_SEC;
+	gint64 link_free = 0, next_feedback = start + BENCH_FEEDBACK;
+	double budget = 0;
+
+	printf("Capacity %s kbps, %d s each, one-way delay %d ms, queue %d ms, loss %.1f%%, seed %"SCNu32"\n",
+		capacities, seconds, delay, queue, loss, seed);
+	for(now = start; now < end; now += BENCH_TICK) {
+		int phase = (now - start) / (seconds*G_USEC_PER_SEC);
+		int second = ((now - start) / G_USEC_PER_SEC) % seconds;
+		bench_phase *p = &phases[phase];
+		/* Send what the estimate allows us to */
+		budget += (double)estimate * BENCH_TICK / G_USEC_PER_SEC / 8;
+		while(budget >= BENCH_PACKET) {
+			budget -= BENCH_PACKET;
+			janus_bwe_context_add_sent_packet(bwe, (guint16)seq, BENCH_PACKET, now);
+			p->sent[second] += BENCH_PACKET;
+			/* Random loss first, then the bottleneck queue */
+			gint64 departure = MAX(now, link_free) + (gint64)BENCH_PACKET*8*G_USEC_PER_SEC/p->capacity;
+			if((loss > 0 && g_rand_double_range(rand, 0, 100) < loss) ||
+					departure - now > (gint64)queue*1000 || link_count == BENCH_SLOTS) {
+				p->lost[second]++;
+			} else {
+				link_free = departure;
+				p->queue[second] += departure - now;
+				bench_packet *pkt = &link[(link_head + link_count) & (BENCH_SLOTS-1)];
+				pkt->seq = seq;
+				pkt->arrival = departure + (gint64)delay*1000;
+				link_count++;
+			}
+			seq++;
+		}
+		/* Deliver the packets that made it */
+		while(link_count > 0 && link[link_head].arrival <= now) {
+			bench_packet *pkt = &link[link_head];
+			if(!receiver->started) {
+				receiver->started = TRUE;
+				receiver->base = pkt->seq;
+				receiver->end = pkt->seq;
+			}
+			/* Slots we're about to reuse for newer packets start empty */
+			while(receiver->end != pkt->seq + 1) {
+				receiver->arrivals[receiver->end & (BENCH_SLOTS-1)] = 0;
+				receiver->reports[receiver->end & (BENCH_SLOTS-1)] = 0;
+				receiver->end++;
+			}
+			receiver->arrivals[pkt->seq & (BENCH_SLOTS-1)] = pkt->arrival;
+			p->received[second] += BENCH_PACKET;
+			link_head = (link_head + 1) & (BENCH_SLOTS-1);
+			link_count--;
+		}
+		/* Time for some feedback? */
+		if(now >= next_feedback) {
+			bench_feedback *fb = g_malloc(sizeof(bench_feedback));
+			fb->count = bench_receiver_feedback(receiver, fb->statuses);
+			fb->arrival = now + (gint64)delay*1000;
+			if(fb->count > 0)
+				g_queue_push_tail(feedbacks, fb);
+			else
+				g_free(fb);
+			next_feedback += BENCH_FEEDBACK;
+		}
+		/* Pass the feedback that got back to the sender to the estimator */
+		bench_feedback *fb = g_queue_peek_head(feedbacks);
+		while(fb != NULL && fb->arrival <= now) {
+			g_queue_pop_head(feedbacks);
+			estimate = janus_bwe_context_process_feedback(bwe, fb->statuses, fb->count, now);
+			g_free(fb);
+			fb = g_queue_peek_head(feedbacks);
+		}
+		p->estimate[second] = estimate;
+	}
+
+	/* Check how each phase went */
+	int ret = 0;
+	for(i=0; i<phases_count; i++) {
+		bench_phase *p = &phases[i];
+		guint64 received = 0, queued = 0, packets = 0;
+		for(s=0; s<seconds; s++) {
+			double utilization = (double)p->received[s]*8/p->capacity;
+			if(verbose) {
+				guint64 sent = p->sent[s]/BENCH_PACKET;
+				printf("  %4d s: capacity %5"SCNu32" kbps, estimate %5"SCNu32" kbps, sent %5"SCNu64" kbps, received %5"SCNu64" kbps, queue %4"SCNu64" ms, lost %3"SCNu64"\n",
+					i*seconds + s, p->capacity/1000, p->estimate[s]/1000, p->sent[s]*8/1000, p->received[s]*8/1000,
+					sent > p->lost[s] ? p->queue[s]/(sent - p->lost[s])/1000 : 0, p->lost[s]);
+			}
+			/* Settled when the throughput stays within bounds until the end of the phase */
+			if(utilization >= BENCH_SETTLED_LOW && utilization <= BENCH_SETTLED_HIGH) {
+				if(p->settled < 0)
+					p->settled = s;
+			} else {
+				p->settled = -1;
+			}
+			if(s >= seconds - BENCH_SETTLED_WINDOW) {
+				received += p->received[s];
+				queued += p->queue[s];
+				packets += p->sent[s]/BENCH_PACKET - p->lost[s];
+			}
+		}
+		double utilization = (double)received*8/p->capacity/BENCH_SETTLED_WINDOW;
+		guint64 queue_delay = packets > 0 ? queued/packets/1000 : 0;
+		gboolean ok = p->settled >= 0 && utilization >= BENCH_SETTLED_LOW && utilization <= BENCH_SETTLED_HIGH &&
+			queue_delay <= BENCH_SETTLED_QUEUE;
+		printf("Phase %d, %5"SCNu32" kbps: %s, settled after %3d s, utilization %5.1f%%, queueing delay %4"SCNu64" ms\n",
+			i+1, p->capacity/1000, ok ? "ok    " : "FAILED", p->settled, utilization*100, queue_delay);
+		if(!ok)
+			ret = 1;
+		g_free(p->estimate);
+		g_free(p->sent);
+		g_free(p->received);
+		g_free(p->queue);
+		g_free(p->lost);
+	}
+
+	janus_bwe_context_destroy(bwe);
+	g_queue_free_full(feedbacks, g_free);
+	g_rand_free(rand);
+	g_free(link);
+	g_free(receiver);
+	return ret;
+}
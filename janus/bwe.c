@@ -0,0 +1,313 @@
+/*! \file    bwe.c
+ * \copyright GNU General Public License v3
+ * \brief    Sender side bandwidth estimation
+ * \details  Implementation of a simple sender side bandwidth estimator,
+ * loosely based on the Google Congestion Control algorithm and fed by
+ * the transport wide congestion control feedback peers send us.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "bwe.h"
+#include "debug.h"
+
+/* Packets sent within this interval are considered part of the same group */
+#define JANUS_BWE_BURST_TIME			5000
+/* Smoothing factor for the accumulated delay */
+#define JANUS_BWE_SMOOTHING				0.9
+/* Gain to apply to the trendline slope */
+#define JANUS_BWE_TRENDLINE_GAIN		4.0
+/* Boundaries and gains for the adaptive overuse threshold */
+#define JANUS_BWE_THRESHOLD_START		12.5
+#define JANUS_BWE_THRESHOLD_MIN			6.0
+#define JANUS_BWE_THRESHOLD_MAX			600.0
+#define JANUS_BWE_THRESHOLD_K_UP		0.0087
+#define JANUS_BWE_THRESHOLD_K_DOWN		0.039
+/* How long we need to be over the threshold to detect an overuse */
+#define JANUS_BWE_OVERUSE_TIME			10000
+/* Multiplicative decrease factor, and minimum interval between decreases */
+#define JANUS_BWE_DECREASE_FACTOR		0.85
+#define JANUS_BWE_DECREASE_INTERVAL		200000
+/* Multiplicative increase, per second */
+#define JANUS_BWE_INCREASE_FACTOR		1.08
+/* How much higher than the acknowledged throughput the estimate can grow: since
+ * we don't do any probing, we're more permissive than GCC here, or plugins that
+ * are currently sending less than they could (e.g., a lower simulcast substream)
+ * would never see an estimate high enough to go back up */
+#define JANUS_BWE_ACKED_HEADROOM		3.0
+/* Loss fractions that trigger a decrease or allow an increase of the loss based estimate */
+#define JANUS_BWE_LOSS_HIGH				0.10
+#define JANUS_BWE_LOSS_LOW				0.02
+/* How often we update the throughput and the loss based estimate */
+#define JANUS_BWE_ACKED_INTERVAL		250000
+#define JANUS_BWE_LOSS_INTERVAL			G_USEC_PER_SEC
+/* How much the estimate needs to change to be notified, and how often */
+#define JANUS_BWE_NOTIFY_CHANGE			0.1
+#define JANUS_BWE_NOTIFY_INTERVAL		200000
+#define JANUS_BWE_NOTIFY_REFRESH		(2*G_USEC_PER_SEC)
+
+
+janus_bwe_context *janus_bwe_context_create(guint32 start_bitrate) {
+	janus_bwe_context *bwe = g_malloc0(sizeof(janus_bwe_context));
+	bwe->min_bitrate = JANUS_BWE_MIN_BITRATE;
+	bwe->max_bitrate = JANUS_BWE_MAX_BITRATE;
+	if(start_bitrate == 0)
+		start_bitrate = JANUS_BWE_START_BITRATE;
+	bwe->delay_estimate = start_bitrate;
+	bwe->loss_estimate = start_bitrate;
+	bwe->threshold = JANUS_BWE_THRESHOLD_START;
+	janus_mutex_init(&bwe->mutex);
+	return bwe;
+}
+
+void janus_bwe_context_destroy(janus_bwe_context *bwe) {
+	if(bwe == NULL)
+		return;
+	janus_mutex_destroy(&bwe->mutex);
+	g_free(bwe);
+}
+
+void janus_bwe_context_add_sent_packet(janus_bwe_context *bwe, guint16 seq_num, int size, gint64 sent) {
+	if(bwe == NULL)
+		return;
+	janus_mutex_lock(&bwe->mutex);
+	janus_bwe_sent_packet *p = &bwe->history[seq_num & (JANUS_BWE_HISTORY_SIZE-1)];
+	p->seq_num = seq_num;
+	p->size = size > G_MAXUINT16 ? G_MAXUINT16 : size;
+	p->sent = sent ? sent : 1;
+	p->lost = FALSE;
+	janus_mutex_unlock(&bwe->mutex);
+}
+
+/* Delay based controller: overuse detector */
+static void janus_bwe_update_delay(janus_bwe_context *bwe, gint64 send_delta, gint64 arrival_delta, gint64 arrival, gint64 now) {
+	/* How much did the one-way delay change between the two groups? */
+	double delay_delta = (double)(arrival_delta - send_delta)/1000;
+	if(bwe->num_deltas < 60)
+		bwe->num_deltas++;
+	bwe->accumulated_delay += delay_delta;
+	bwe->smoothed_delay = JANUS_BWE_SMOOTHING*bwe->smoothed_delay + (1-JANUS_BWE_SMOOTHING)*bwe->accumulated_delay;
+	if(bwe->first_arrival == 0)
+		bwe->first_arrival = arrival;
+	bwe->trend_x[bwe->trend_index] = (double)(arrival - bwe->first_arrival)/1000;
+	bwe->trend_y[bwe->trend_index] = bwe->smoothed_delay;
+	bwe->trend_index = (bwe->trend_index+1) % JANUS_BWE_TRENDLINE_WINDOW;
+	if(bwe->trend_samples < JANUS_BWE_TRENDLINE_WINDOW) {
+		bwe->trend_samples++;
+		if(bwe->trend_samples < JANUS_BWE_TRENDLINE_WINDOW)
+			return;
+	}
+	/* Compute the slope of the delay trend with a linear regression */
+	double x_avg = 0, y_avg = 0, num = 0, den = 0;
+	int i = 0;
+	for(i=0; i<JANUS_BWE_TRENDLINE_WINDOW; i++) {
+		x_avg += bwe->trend_x[i];
+		y_avg += bwe->trend_y[i];
+	}
+	x_avg /= JANUS_BWE_TRENDLINE_WINDOW;
+	y_avg /= JANUS_BWE_TRENDLINE_WINDOW;
+	for(i=0; i<JANUS_BWE_TRENDLINE_WINDOW; i++) {
+		num += (bwe->trend_x[i] - x_avg) * (bwe->trend_y[i] - y_avg);
+		den += (bwe->trend_x[i] - x_avg) * (bwe->trend_x[i] - x_avg);
+	}
+	double slope = den != 0 ? num/den : 0;
+	double trend = bwe->num_deltas * slope * JANUS_BWE_TRENDLINE_GAIN;
+	/* Compare the trend to the threshold */
+	if(trend > bwe->threshold) {
+		if(bwe->overuse_start == 0)
+			bwe->overuse_start = now;
+		if(now - bwe->overuse_start >= JANUS_BWE_OVERUSE_TIME && trend >= bwe->prev_trend) {
+			if(bwe->usage != janus_bwe_usage_overuse)
+				JANUS_LOG(LOG_HUGE, "Bandwidth overuse detected (trend=%.2f, threshold=%.2f)\n", trend, bwe->threshold);
+			bwe->usage = janus_bwe_usage_overuse;
+		}
+	} else if(trend < -bwe->threshold) {
+		bwe->overuse_start = 0;
+		bwe->usage = janus_bwe_usage_underuse;
+	} else {
+		bwe->overuse_start = 0;
+		bwe->usage = janus_bwe_usage_normal;
+	}
+	bwe->prev_trend = trend;
+	/* Adapt the threshold, unless this was just a spike */
+	double abs_trend = fabs(trend);
+	if(bwe->threshold_updated == 0)
+		bwe->threshold_updated = now;
+	if(abs_trend - bwe->threshold <= 15.0) {
+		double k = abs_trend < bwe->threshold ? JANUS_BWE_THRESHOLD_K_DOWN : JANUS_BWE_THRESHOLD_K_UP;
+		gint64 elapsed = now - bwe->threshold_updated;
+		if(elapsed > 100000)
+			elapsed = 100000;
+		bwe->threshold += k * (abs_trend - bwe->threshold) * ((double)elapsed/1000);
+		if(bwe->threshold < JANUS_BWE_THRESHOLD_MIN)
+			bwe->threshold = JANUS_BWE_THRESHOLD_MIN;
+		else if(bwe->threshold > JANUS_BWE_THRESHOLD_MAX)
+			bwe->threshold = JANUS_BWE_THRESHOLD_MAX;
+	}
+	bwe->threshold_updated = now;
+}
+
+/* Delay based controller: AIMD rate control */
+static void janus_bwe_update_rate(janus_bwe_context *bwe, gint64 now) {
+	if(bwe->delay_updated == 0)
+		bwe->delay_updated = now;
+	double estimate = bwe->delay_estimate;
+	if(bwe->usage == janus_bwe_usage_overuse) {
+		/* Decrease, but not more often than needed for the previous decrease to kick in */
+		if(now - bwe->delay_updated < JANUS_BWE_DECREASE_INTERVAL)
+			return;
+		double target = JANUS_BWE_DECREASE_FACTOR * (bwe->acked_bitrate > 0 ? bwe->acked_bitrate : estimate);
+		if(target < estimate)
+			estimate = target;
+	} else if(bwe->usage == janus_bwe_usage_normal) {
+		/* Increase, proportionally to the time that passed */
+		gint64 elapsed = now - bwe->delay_updated;
+		if(elapsed > G_USEC_PER_SEC)
+			elapsed = G_USEC_PER_SEC;
+		double target = estimate * pow(JANUS_BWE_INCREASE_FACTOR, (double)elapsed/G_USEC_PER_SEC);
+		if(bwe->acked_bitrate > 0) {
+			double cap = JANUS_BWE_ACKED_HEADROOM * bwe->acked_bitrate + 10000;
+			if(target > cap)
+				target = cap > estimate ? cap : estimate;
+		}
+		estimate = target;
+	}
+	/* When underusing, we just hold the rate, and let the queues drain */
+	if(estimate < bwe->min_bitrate)
+		estimate = bwe->min_bitrate;
+	else if(estimate > bwe->max_bitrate)
+		estimate = bwe->max_bitrate;
+	bwe->delay_estimate = (guint32)estimate;
+	bwe->delay_updated = now;
+}
+
+/* Loss based controller */
+static void janus_bwe_update_loss(janus_bwe_context *bwe, gint64 now) {
+	if(bwe->loss_updated == 0)
+		bwe->loss_updated = now;
+	guint32 total = bwe->loss_received + bwe->loss_lost;
+	if(now - bwe->loss_updated < JANUS_BWE_LOSS_INTERVAL || total < 20)
+		return;
+	double fraction = (double)bwe->loss_lost/total;
+	double estimate = MIN(bwe->delay_estimate, bwe->loss_estimate);
+	if(fraction > JANUS_BWE_LOSS_HIGH) {
+		JANUS_LOG(LOG_HUGE, "High loss reported (%.2f%%), decreasing the estimate\n", fraction*100);
+		estimate = estimate * (1 - 0.5*fraction);
+	} else if(fraction < JANUS_BWE_LOSS_LOW) {
+		/* Negligible loss: don't hold back the delay based controller, which
+		 * grows faster (the 5% is only there in case it's not growing at all) */
+		estimate = MAX(estimate * 1.05, bwe->delay_estimate);
+	}
+	if(estimate < bwe->min_bitrate)
+		estimate = bwe->min_bitrate;
+	else if(estimate > bwe->max_bitrate)
+		estimate = bwe->max_bitrate;
+	bwe->loss_estimate = (guint32)estimate;
+	bwe->loss_received = 0;
+	bwe->loss_lost = 0;
+	bwe->loss_updated = now;
+}
+
+guint32 janus_bwe_context_process_feedback(janus_bwe_context *bwe, janus_rtcp_transport_wide_cc_status *statuses, int count, gint64 now) {
+	if(bwe == NULL)
+		return 0;
+	janus_mutex_lock(&bwe->mutex);
+	int i = 0;
+	for(i=0; i<count; i++) {
+		janus_bwe_sent_packet *p = &bwe->history[statuses[i].seq_num & (JANUS_BWE_HISTORY_SIZE-1)];
+		if(p->sent == 0 || p->seq_num != statuses[i].seq_num) {
+			/* We don't know anything about this packet (or we got feedback for it already) */
+			continue;
+		}
+		if(!statuses[i].received) {
+			/* We don't clear the slot, as the packet may still be reported later:
+			 * peers keep reporting it as missing until it arrives, though, so
+			 * we only count it as lost the first time */
+			if(!p->lost) {
+				p->lost = TRUE;
+				bwe->loss_lost++;
+			}
+			continue;
+		}
+		if(p->lost) {
+			/* It was late, not lost */
+			p->lost = FALSE;
+			if(bwe->loss_lost > 0)
+				bwe->loss_lost--;
+		}
+		bwe->loss_received++;
+		bwe->acked_bytes += p->size;
+		gint64 sent = p->sent;
+		gint64 arrival = statuses[i].arrival;
+		p->sent = 0;
+		/* Group packets that were sent in a burst, and compare consecutive groups */
+		if(bwe->group_first_sent == 0) {
+			bwe->group_first_sent = sent;
+			bwe->group_last_sent = sent;
+			bwe->group_last_arrival = arrival;
+			continue;
+		}
+		if(sent < bwe->group_first_sent) {
+			/* Reordered (or retransmitted) packet, ignore it for the delay */
+			continue;
+		}
+		if(sent - bwe->group_first_sent <= JANUS_BWE_BURST_TIME) {
+			if(sent > bwe->group_last_sent)
+				bwe->group_last_sent = sent;
+			if(arrival > bwe->group_last_arrival)
+				bwe->group_last_arrival = arrival;
+			continue;
+		}
+		/* The previous group is complete */
+		if(bwe->prev_group_sent != 0) {
+			janus_bwe_update_delay(bwe, bwe->group_last_sent - bwe->prev_group_sent,
+				bwe->group_last_arrival - bwe->prev_group_arrival, bwe->group_last_arrival, now);
+		}
+		bwe->prev_group_sent = bwe->group_last_sent;
+		bwe->prev_group_arrival = bwe->group_last_arrival;
+		bwe->group_first_sent = sent;
+		bwe->group_last_sent = sent;
+		bwe->group_last_arrival = arrival;
+	}
+	/* Update the acknowledged throughput */
+	if(bwe->acked_updated == 0)
+		bwe->acked_updated = now;
+	if(now - bwe->acked_updated >= JANUS_BWE_ACKED_INTERVAL) {
+		guint32 acked = (guint32)((guint64)bwe->acked_bytes*8*G_USEC_PER_SEC/(now - bwe->acked_updated));
+		bwe->acked_bitrate = bwe->acked_bitrate ? (guint32)(0.5*bwe->acked_bitrate + 0.5*acked) : acked;
+		bwe->acked_bytes = 0;
+		bwe->acked_updated = now;
+	}
+	/* Update both controllers */
+	janus_bwe_update_rate(bwe, now);
+	janus_bwe_update_loss(bwe, now);
+	guint32 estimate = MIN(bwe->delay_estimate, bwe->loss_estimate);
+	janus_mutex_unlock(&bwe->mutex);
+	return estimate;
+}
+
+gboolean janus_bwe_context_should_notify(janus_bwe_context *bwe, gint64 now, guint32 *estimate) {
+	if(bwe == NULL || estimate == NULL)
+		return FALSE;
+	janus_mutex_lock(&bwe->mutex);
+	guint32 current = MIN(bwe->delay_estimate, bwe->loss_estimate);
+	gboolean notify = FALSE;
+	if(bwe->notified == 0) {
+		notify = TRUE;
+	} else if(current != bwe->notified && now - bwe->notified_time >= JANUS_BWE_NOTIFY_INTERVAL) {
+		double change = fabs((double)current - (double)bwe->notified)/bwe->notified;
+		if(change >= JANUS_BWE_NOTIFY_CHANGE || now - bwe->notified_time >= JANUS_BWE_NOTIFY_REFRESH)
+			notify = TRUE;
+	}
+	if(notify) {
+		bwe->notified = current;
+		bwe->notified_time = now;
+		*estimate = current;
+	}
+	janus_mutex_unlock(&bwe->mutex);
+	return notify;
+}
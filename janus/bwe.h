@@ -0,0 +1,151 @@
+/*! \file    bwe.h
+ * \copyright GNU General Public License v3
+ * \brief    Sender side bandwidth estimation (headers)
+ * \details  Implementation of a simple sender side bandwidth estimator,
+ * loosely based on the Google Congestion Control algorithm described in
+ * https://tools.ietf.org/html/draft-ietf-rmcat-gcc-02 and fed by the
+ * transport wide congestion control feedback peers send us. When the
+ * transport-wide CC RTP extension is negotiated for the media Janus
+ * sends to a peer, the core stamps each outgoing packet with a transport
+ * wide sequence number and keeps track of when it was sent: the feedback
+ * the peer sends back tells us when (and if) each of those packets was
+ * received, which is all the estimator needs. Two controllers are involved:
+ *
+ * - a delay based controller, that looks at how the one-way delay
+ * variation evolves (using a trendline filter) in order to detect when
+ * queues start building up along the path, and adapts the rate with an
+ * AIMD approach;
+ * - a loss based controller, that decreases the rate when the loss
+ * fraction reported by the peer is high, and slowly increases it when
+ * it's negligible.
+ *
+ * The estimate is the minimum of the two. It's notified to plugins via
+ * the \c incoming_bwe callback, so that they can adapt what they send
+ * (e.g., by picking a different simulcast substream) accordingly.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_BWE_H
+#define _JANUS_BWE_H
+
+#include <glib.h>
+
+#include <inttypes.h>
+
+#include "mutex.h"
+#include "rtcp.h"
+
+/*! \brief Number of sent packets we keep track of (must be a power of 2) */
+#define JANUS_BWE_HISTORY_SIZE		4096
+/*! \brief Maximum number of packet statuses we parse out of a single RTCP compound packet */
+#define JANUS_BWE_MAX_FEEDBACK		512
+/*! \brief Number of delay samples the trendline filter works with */
+#define JANUS_BWE_TRENDLINE_WINDOW	20
+/*! \brief Default starting estimate, in bits per second */
+#define JANUS_BWE_START_BITRATE		300000
+/*! \brief Default minimum estimate, in bits per second */
+#define JANUS_BWE_MIN_BITRATE		30000
+/*! \brief Default maximum estimate, in bits per second */
+#define JANUS_BWE_MAX_BITRATE		10000000
+
+/*! \brief Info on a packet we sent, indexed by transport wide sequence number */
+typedef struct janus_bwe_sent_packet {
+	/*! \brief Monotonic time the packet was sent at, in microseconds (0 if the slot is empty) */
+	gint64 sent;
+	/*! \brief Size of the packet, in bytes */
+	guint16 size;
+	/*! \brief Transport wide sequence number of the packet */
+	guint16 seq_num;
+	/*! \brief Whether the peer reported this packet as lost already (feedback repeats missing packets) */
+	gboolean lost;
+} janus_bwe_sent_packet;
+
+/*! \brief Possible states of the delay based overuse detector */
+typedef enum janus_bwe_usage {
+	janus_bwe_usage_normal = 0,
+	janus_bwe_usage_underuse,
+	janus_bwe_usage_overuse
+} janus_bwe_usage;
+
+/*! \brief Bandwidth estimation context, one per PeerConnection */
+typedef struct janus_bwe_context {
+	/*! \brief Packets we sent and haven't got feedback for yet */
+	janus_bwe_sent_packet history[JANUS_BWE_HISTORY_SIZE];
+	/*! \brief Send and arrival times of the current group of packets */
+	gint64 group_first_sent, group_last_sent, group_last_arrival;
+	/*! \brief Send and arrival times of the previous group of packets */
+	gint64 prev_group_sent, prev_group_arrival;
+	/*! \brief Accumulated and smoothed one-way delay variation, in milliseconds */
+	double accumulated_delay, smoothed_delay;
+	/*! \brief Samples (arrival time and smoothed delay) for the trendline filter */
+	double trend_x[JANUS_BWE_TRENDLINE_WINDOW], trend_y[JANUS_BWE_TRENDLINE_WINDOW];
+	/*! \brief Number of samples we have, and index of the next one to write */
+	int trend_samples, trend_index;
+	/*! \brief Number of delay deltas processed so far (capped) */
+	int num_deltas;
+	/*! \brief Time of the first packet in the current trendline window */
+	gint64 first_arrival;
+	/*! \brief Adaptive overuse threshold, and when it was last updated */
+	double threshold;
+	gint64 threshold_updated;
+	/*! \brief Modified trend as of the previous sample, and since when we've been overusing */
+	double prev_trend;
+	gint64 overuse_start;
+	/*! \brief Current state of the overuse detector */
+	janus_bwe_usage usage;
+	/*! \brief Throughput acknowledged by the peer, in bits per second */
+	guint32 acked_bitrate;
+	/*! \brief Bytes acknowledged since the last throughput update, and when that happened */
+	guint32 acked_bytes;
+	gint64 acked_updated;
+	/*! \brief Packets reported as received or lost since the last loss update, and when that happened */
+	guint32 loss_received, loss_lost;
+	gint64 loss_updated;
+	/*! \brief Delay based and loss based estimates, in bits per second */
+	guint32 delay_estimate, loss_estimate;
+	/*! \brief When we last changed the delay based estimate */
+	gint64 delay_updated;
+	/*! \brief Limits for the estimate, in bits per second */
+	guint32 min_bitrate, max_bitrate;
+	/*! \brief Latest estimate notified to the plugin, and when */
+	guint32 notified;
+	gint64 notified_time;
+	/*! \brief Mutex to lock this context */
+	janus_mutex mutex;
+} janus_bwe_context;
+
+/*! \brief Method to create a new bandwidth estimation context
+ * @param[in] start_bitrate The bitrate to start from, in bits per second (0 for the default)
+ * @returns A new janus_bwe_context instance, if successful, or NULL otherwise */
+janus_bwe_context *janus_bwe_context_create(guint32 start_bitrate);
+
+/*! \brief Method to destroy a bandwidth estimation context
+ * @param[in] bwe The janus_bwe_context instance to destroy */
+void janus_bwe_context_destroy(janus_bwe_context *bwe);
+
+/*! \brief Method to keep track of a packet we're sending
+ * @param[in] bwe The janus_bwe_context instance to update
+ * @param[in] seq_num The transport wide sequence number of the packet
+ * @param[in] size The size of the packet, in bytes
+ * @param[in] sent The monotonic time the packet is being sent at */
+void janus_bwe_context_add_sent_packet(janus_bwe_context *bwe, guint16 seq_num, int size, gint64 sent);
+
+/*! \brief Method to update the estimate using transport wide feedback from the peer
+ * @param[in] bwe The janus_bwe_context instance to update
+ * @param[in] statuses The packet statuses the peer sent us, as parsed by janus_rtcp_get_transport_wide_cc_feedback
+ * @param[in] count The number of statuses
+ * @param[in] now The current monotonic time
+ * @returns The current estimate, in bits per second */
+guint32 janus_bwe_context_process_feedback(janus_bwe_context *bwe, janus_rtcp_transport_wide_cc_status *statuses, int count, gint64 now);
+
+/*! \brief Method to check whether the estimate changed enough it should be notified to the plugin
+ * \note If this returns TRUE, the estimate is assumed to have been notified
+ * @param[in] bwe The janus_bwe_context instance to check
+ * @param[in] now The current monotonic time
+ * @param[out] estimate The estimate to notify, in bits per second
+ * @returns TRUE if the estimate should be notified, FALSE otherwise */
+gboolean janus_bwe_context_should_notify(janus_bwe_context *bwe, gint64 now, guint32 *estimate);
+
+#endif
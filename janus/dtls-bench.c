@@ -0,0 +1,466 @@
+/*! \file    dtls-bench.c
+ * \copyright GNU General Public License v3
+ * \brief    DTLS handshakes per second with loopback peers
+ * \details  Simple benchmark doing lots of DTLS-SRTP handshakes using the
+ * actual DTLS stack (dtls.c) and DTLS BIO (dtls-bio.c) of Janus as the
+ * "server" side, and plain OpenSSL stacks in the same process as the
+ * "client" side, that plays the browser (which always uses an ECDSA P-256
+ * certificate nowadays). The stack is set up with janus_dtls_srtp_init,
+ * with an autogenerated certificate pool (cert_pool_size) and, optionally,
+ * handshake workers (dtls_handshake_threads): each "loop" thread plays an
+ * ICE event loop, with several handshakes in flight at the same time, that
+ * passes what the clients send to janus_dtls_srtp_incoming_msg, while what
+ * the stack sends through the DTLS BIO gets back to the clients via the
+ * nice_agent_send below. Both RSA-2048 and ECDSA P-256 server keys are
+ * tested (the ecdsa_private_key setting), and for each we print how long
+ * generating a key and certificate takes (which is what each certificate
+ * in the pool costs at startup, and each cert_pool_rotation at runtime),
+ * how much CPU time each handshake spends in the stack on the loop thread
+ * (that is, how long an event loop is blocked for each handshake, which is
+ * what the handshake workers get rid of), and how many handshakes per
+ * second we can do, to see how handshakes scale with more workers.
+ *
+ * Usage: dtls-bench [-k rsa|ecdsa] [-n handshakes] [-t loops] [-c handshakes per loop] [-p pool size] [-w workers]
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <glib.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509.h>
+#include <openssl/ec.h>
+
+#include "ice.h"
+#include "dtls.h"
+#include "dtls-bio.h"
+#include "events.h"
+#include "janus.h"
+#include "mutex.h"
+#include "utils.h"
+#ifdef HAVE_SCTP
+#include "sctp.h"
+#endif
+
+/* No logging, as there's no log thread to print anything */
+int janus_log_level = 0;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+GHashTable *counters = NULL;
+janus_mutex counters_mutex;
+
+#define BENCH_CIPHERS		"HIGH:!aNULL:!MD5:!RC4"	/* Same as DTLS_CIPHERS */
+#define BENCH_MTU			1200	/* Same as the default dtls_mtu */
+#define BENCH_TIMEOUT		10		/* Seconds to wait for a stuck handshake */
+
+/* Fingerprint of the client certificate, which all the streams expect */
+static gchar bench_fingerprint[160];
+
+/* Each handshake has the bits of a handle the DTLS stack and BIO use, and
+ * the client stack: the agent is a plain GObject, as the handshake workers
+ * take a reference on it, and it's how the nice_agent_send below knows who
+ * is sending. The peer is freed when the last reference on the component
+ * goes away, since the workers release the handle, stream and component
+ * references in this order, and so do we */
+typedef struct bench_peer {
+	janus_ice_handle handle;
+	janus_ice_stream stream;
+	janus_ice_component component;
+	SSL *ssl;
+	BIO *read_bio, *write_bio;
+	struct bench_loop *loop;
+	volatile gint done, failed;
+} bench_peer;
+
+/* What the stack sends, or tells us, on its way back to the loop */
+typedef struct bench_event {
+	guint64 handle_id;
+	GBytes *datagram;
+} bench_event;
+
+typedef struct bench_loop {
+	SSL_CTX *client;
+	int handshakes, concurrency, done, failed;
+	guint64 next_id;
+	/* CPU time the loop spent in the Janus DTLS stack */
+	gint64 blocked;
+	GAsyncQueue *events;
+	GThread *thread;
+} bench_loop;
+
+static void bench_peer_unref(const janus_refcount *ref) {
+	/* The handle and stream are part of the peer, see below */
+}
+
+static void bench_peer_free(const janus_refcount *ref) {
+	bench_peer *peer = janus_refcount_containerof(ref, bench_peer, component.ref);
+	g_free(peer);
+}
+
+static void bench_event_push(bench_peer *peer, const gchar *buf, guint len) {
+	bench_event *event = g_malloc(sizeof(bench_event));
+	event->handle_id = peer->handle.handle_id;
+	event->datagram = buf ? g_bytes_new(buf, len) : NULL;
+	g_async_queue_push(peer->loop->events, event);
+}
+
+/* The DTLS BIO sends a datagram, from the loop or a handshake worker */
+gint nice_agent_send(NiceAgent *agent, guint stream_id, guint component_id, guint len, const gchar *buf) {
+	bench_peer *peer = g_object_get_data(G_OBJECT(agent), "bench-peer");
+	bench_event_push(peer, buf, len);
+	return len;
+}
+
+/* The stack completed the handshake and set up SRTP */
+void janus_ice_dtls_handshake_done(janus_ice_handle *handle, janus_ice_component *component) {
+	bench_peer *peer = (bench_peer *)((char *)handle - G_STRUCT_OFFSET(bench_peer, handle));
+	g_atomic_int_set(&peer->done, 1);
+	bench_event_push(peer, NULL, 0);
+}
+
+/* DTLS alert, or the handshake failed */
+void janus_ice_webrtc_hangup(janus_ice_handle *handle, const char *reason) {
+	bench_peer *peer = (bench_peer *)((char *)handle - G_STRUCT_OFFSET(bench_peer, handle));
+	g_atomic_int_set(&peer->failed, 1);
+	bench_event_push(peer, NULL, 0);
+}
+
+/* No event handlers, and we never stop */
+gboolean janus_events_is_enabled(void) {
+	return FALSE;
+}
+
+void janus_events_notify_handlers(int type, guint64 session_id, ...) {
+}
+
+gint janus_is_stopping(void) {
+	return 0;
+}
+
+#ifdef HAVE_SCTP
+/* Data channels are never negotiated here */
+janus_sctp_association *janus_sctp_association_create(struct janus_dtls_srtp *dtls, struct janus_ice_handle *handle, uint16_t udp_port) {
+	return NULL;
+}
+
+void janus_sctp_association_destroy(janus_sctp_association *sctp) {
+}
+
+void janus_sctp_data_from_dtls(janus_sctp_association *sctp, char *buf, int len) {
+}
+
+void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len, gboolean more) {
+}
+
+void janus_ice_incoming_data(janus_ice_handle *handle, char *buffer, int length) {
+}
+#endif
+
+/* CPU time of the calling thread, so that other threads don't inflate it */
+static gint64 bench_thread_cpu(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (gint64)ts.tv_sec*G_USEC_PER_SEC + ts.tv_nsec/1000;
+}
+
+static int bench_verify(int preverify_ok, X509_STORE_CTX *ctx) {
+	/* As janus_dtls_verify_callback, we just want the peer's certificate */
+	return 1;
+}
+
+/* The browser side: an ECDSA P-256 key and a self-signed certificate */
+static SSL_CTX *bench_client_create(void) {
+	EVP_PKEY *private_key = EVP_PKEY_new();
+	X509 *certificate = X509_new();
+	EC_KEY *ecc = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	SSL_CTX *ctx = NULL;
+	unsigned char fingerprint[EVP_MAX_MD_SIZE];
+	unsigned int size = 0, i = 0;
+	if(private_key == NULL || certificate == NULL || ecc == NULL)
+		goto done;
+	EC_KEY_set_asn1_flag(ecc, OPENSSL_EC_NAMED_CURVE);
+	if(!EC_KEY_generate_key(ecc) || !EVP_PKEY_assign_EC_KEY(private_key, ecc))
+		goto done;
+	ecc = NULL;
+	X509_set_version(certificate, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(certificate), (long)g_random_int());
+	X509_gmtime_adj(X509_get_notBefore(certificate), -86400);
+	X509_gmtime_adj(X509_get_notAfter(certificate), 86400);
+	X509_set_pubkey(certificate, private_key);
+	X509_NAME *name = X509_get_subject_name(certificate);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"Browser", -1, -1, 0);
+	X509_set_issuer_name(certificate, name);
+	if(!X509_sign(certificate, private_key, EVP_sha256()) ||
+			!X509_digest(certificate, EVP_sha256(), fingerprint, &size))
+		goto done;
+	/* Same format as the fingerprint the stack computes for the peer */
+	for(i = 0; i < size; i++)
+		g_snprintf(bench_fingerprint + i*3, 4, "%.2X:", fingerprint[i]);
+	bench_fingerprint[size*3 - 1] = '\0';
+	ctx = SSL_CTX_new(DTLS_method());
+	if(ctx == NULL)
+		goto done;
+	if(!SSL_CTX_use_certificate(ctx, certificate) || !SSL_CTX_use_PrivateKey(ctx, private_key)) {
+		SSL_CTX_free(ctx);
+		ctx = NULL;
+		goto done;
+	}
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, bench_verify);
+	SSL_CTX_set_tlsext_use_srtp(ctx, "SRTP_AEAD_AES_256_GCM:SRTP_AEAD_AES_128_GCM:SRTP_AES128_CM_SHA1_80:SRTP_AES128_CM_SHA1_32");
+	SSL_CTX_set_read_ahead(ctx, 1);
+	SSL_CTX_set_cipher_list(ctx, BENCH_CIPHERS);
+
+done:
+	if(ecc != NULL)
+		EC_KEY_free(ecc);
+	if(certificate != NULL)
+		X509_free(certificate);
+	if(private_key != NULL)
+		EVP_PKEY_free(private_key);
+	return ctx;
+}
+
+/* Pass what the client wrote to the stack, as the loop does with what it receives */
+static void bench_peer_flush(bench_peer *peer) {
+	char buffer[4096];
+	int length = 0;
+	gint64 start = 0;
+	while(BIO_ctrl_pending(peer->write_bio) > 0) {
+		length = BIO_read(peer->write_bio, buffer, sizeof(buffer));
+		if(length <= 0)
+			break;
+		start = bench_thread_cpu();
+		janus_dtls_srtp_incoming_msg(peer->component.dtls, buffer, length);
+		peer->loop->blocked += bench_thread_cpu() - start;
+	}
+}
+
+static bench_peer *bench_peer_create(bench_loop *loop) {
+	bench_peer *peer = g_malloc0(sizeof(bench_peer));
+	peer->loop = loop;
+	peer->handle.handle_id = ++loop->next_id;
+	peer->handle.agent = g_object_new(G_TYPE_OBJECT, NULL);
+	g_object_set_data(G_OBJECT(peer->handle.agent), "bench-peer", peer);
+	peer->handle.stream = &peer->stream;
+	janus_refcount_init(&peer->handle.ref, bench_peer_unref);
+	peer->stream.handle = &peer->handle;
+	peer->stream.stream_id = 1;
+	peer->stream.component = &peer->component;
+	peer->stream.remote_fingerprint = bench_fingerprint;
+	janus_refcount_init(&peer->stream.ref, bench_peer_unref);
+	peer->component.stream = &peer->stream;
+	peer->component.stream_id = 1;
+	peer->component.component_id = 1;
+	janus_refcount_init(&peer->component.ref, bench_peer_free);
+	peer->component.dtls = janus_dtls_srtp_create(&peer->component, JANUS_DTLS_ROLE_SERVER);
+	peer->ssl = SSL_new(loop->client);
+	peer->read_bio = BIO_new(BIO_s_mem());
+	peer->write_bio = BIO_new(BIO_s_mem());
+	if(peer->component.dtls == NULL || peer->ssl == NULL || peer->read_bio == NULL || peer->write_bio == NULL) {
+		g_atomic_int_set(&peer->failed, 1);
+		bench_event_push(peer, NULL, 0);
+		return peer;
+	}
+	BIO_set_mem_eof_return(peer->read_bio, -1);
+	SSL_set_bio(peer->ssl, peer->read_bio, peer->write_bio);
+	SSL_set_options(peer->ssl, SSL_OP_NO_QUERY_MTU);
+	SSL_set_mtu(peer->ssl, BENCH_MTU);
+	SSL_set_connect_state(peer->ssl);
+	/* The stack acts as the DTLS server, as when the browser sends an offer */
+	gint64 start = bench_thread_cpu();
+	janus_dtls_srtp_handshake(peer->component.dtls);
+	loop->blocked += bench_thread_cpu() - start;
+	SSL_do_handshake(peer->ssl);
+	bench_peer_flush(peer);
+	return peer;
+}
+
+static void bench_peer_destroy(bench_peer *peer) {
+	if(peer->ssl != NULL)
+		SSL_free(peer->ssl);
+	else if(peer->read_bio != NULL || peer->write_bio != NULL) {
+		BIO_free(peer->read_bio);
+		BIO_free(peer->write_bio);
+	}
+	peer->ssl = NULL;
+	/* A worker may still be busy with this stack: it has its own references */
+	janus_dtls_srtp_destroy(peer->component.dtls);
+	g_object_unref(peer->handle.agent);
+	janus_refcount_decrease(&peer->handle.ref);
+	janus_refcount_decrease(&peer->stream.ref);
+	janus_refcount_decrease(&peer->component.ref);
+}
+
+static void *bench_loop_run(void *data) {
+	bench_loop *loop = (bench_loop *)data;
+	bench_peer **peers = g_malloc0(loop->concurrency * sizeof(bench_peer *));
+	bench_event *event = NULL;
+	int i = 0, started = 0;
+	for(i = 0; i < loop->concurrency && started < loop->handshakes; i++) {
+		peers[i] = bench_peer_create(loop);
+		started++;
+	}
+	while(loop->done + loop->failed < loop->handshakes) {
+		event = g_async_queue_timeout_pop(loop->events, BENCH_TIMEOUT*G_USEC_PER_SEC);
+		if(event == NULL) {
+			/* Something got stuck, give up on what's still in flight */
+			loop->failed = loop->handshakes - loop->done;
+			break;
+		}
+		/* Events for peers we're done with are just dropped */
+		for(i = 0; i < loop->concurrency; i++) {
+			if(peers[i] != NULL && peers[i]->handle.handle_id == event->handle_id)
+				break;
+		}
+		bench_peer *peer = i < loop->concurrency ? peers[i] : NULL;
+		if(peer != NULL && event->datagram != NULL && !g_atomic_int_get(&peer->failed)) {
+			gsize length = 0;
+			const void *datagram = g_bytes_get_data(event->datagram, &length);
+			BIO_write(peer->read_bio, datagram, length);
+			SSL_do_handshake(peer->ssl);
+			bench_peer_flush(peer);
+		}
+		if(event->datagram != NULL)
+			g_bytes_unref(event->datagram);
+		g_free(event);
+		if(peer == NULL)
+			continue;
+		/* A handshake is done when both sides say so */
+		if(g_atomic_int_get(&peer->failed))
+			loop->failed++;
+		else if(g_atomic_int_get(&peer->done) && SSL_is_init_finished(peer->ssl))
+			loop->done++;
+		else
+			continue;
+		bench_peer_destroy(peer);
+		peers[i] = NULL;
+		if(started < loop->handshakes) {
+			peers[i] = bench_peer_create(loop);
+			started++;
+		}
+	}
+	for(i = 0; i < loop->concurrency; i++) {
+		if(peers[i] != NULL)
+			bench_peer_destroy(peers[i]);
+	}
+	g_free(peers);
+	return NULL;
+}
+
+static int bench_run(gboolean ecdsa, SSL_CTX *client, int handshakes, int loops, int concurrency, int pool, int workers) {
+	bench_loop *threads = NULL;
+	bench_event *event = NULL;
+	gint64 start = 0, keygen = 0, elapsed = 0, blocked = 0;
+	int i = 0, done = 0, failed = 0;
+
+	/* Generating the keys for the pool is all janus_dtls_srtp_init does that takes time */
+	janus_dtls_set_certificate_pool(pool, 0);
+	janus_dtls_set_handshake_workers(workers);
+	start = janus_get_monotonic_time();
+	if(janus_dtls_srtp_init(NULL, NULL, NULL, ecdsa, 1000) != 0) {
+		printf("Error initializing the %s DTLS stack\n", ecdsa ? "ECDSA" : "RSA");
+		janus_dtls_srtp_cleanup();
+		return -1;
+	}
+	keygen = (janus_get_monotonic_time() - start) / (pool > 1 ? pool : 1);
+
+	threads = g_malloc0(loops * sizeof(bench_loop));
+	start = janus_get_monotonic_time();
+	for(i = 0; i < loops; i++) {
+		threads[i].client = client;
+		threads[i].handshakes = handshakes / loops + (i < handshakes % loops ? 1 : 0);
+		threads[i].concurrency = concurrency;
+		threads[i].events = g_async_queue_new();
+		threads[i].thread = g_thread_new("dtls bench", bench_loop_run, &threads[i]);
+	}
+	for(i = 0; i < loops; i++) {
+		g_thread_join(threads[i].thread);
+		done += threads[i].done;
+		failed += threads[i].failed;
+		blocked += threads[i].blocked;
+	}
+	elapsed = janus_get_monotonic_time() - start;
+	/* This waits for the workers to be done with what they're still busy with */
+	janus_dtls_srtp_cleanup();
+	for(i = 0; i < loops; i++) {
+		while((event = g_async_queue_try_pop(threads[i].events)) != NULL) {
+			if(event->datagram != NULL)
+				g_bytes_unref(event->datagram);
+			g_free(event);
+		}
+		g_async_queue_unref(threads[i].events);
+	}
+	g_free(threads);
+	if(failed > 0 || done == 0) {
+		printf("Only %d of %d %s handshakes succeeded\n", done, handshakes, ecdsa ? "ECDSA" : "RSA");
+		return -1;
+	}
+	printf("%-5s keygen %8.2f ms, %6d handshakes on %2d loop(s) x %d, %2d worker(s): %8.0f handshakes/s, %7.0f us CPU blocking the loop per handshake\n",
+		ecdsa ? "ECDSA" : "RSA", keygen / 1000.0, done, loops, concurrency, workers,
+		done * (double)G_USEC_PER_SEC / elapsed, blocked / (double)done);
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	const char *key = NULL;
+	int handshakes = 2000, loops = 1, concurrency = 16, pool = 4, workers = 0, opt = 0, ret = 0;
+	SSL_CTX *client = NULL;
+
+	while((opt = getopt(argc, argv, "k:n:t:c:p:w:h")) != -1) {
+		switch(opt) {
+			case 'k':
+				key = optarg;
+				break;
+			case 'n':
+				handshakes = atoi(optarg);
+				break;
+			case 't':
+				loops = atoi(optarg);
+				break;
+			case 'c':
+				concurrency = atoi(optarg);
+				break;
+			case 'p':
+				pool = atoi(optarg);
+				break;
+			case 'w':
+				workers = atoi(optarg);
+				break;
+			default:
+				printf("Usage: %s [-k rsa|ecdsa] [-n handshakes] [-t loops] [-c handshakes per loop] [-p pool size] [-w workers]\n", argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	if(handshakes < 1 || loops < 1 || loops > handshakes || concurrency < 1 || pool < 0 || workers < 0 ||
+			(key && strcasecmp(key, "rsa") && strcasecmp(key, "ecdsa"))) {
+		printf("Invalid arguments\n");
+		return 1;
+	}
+
+	SSL_library_init();
+	SSL_load_error_strings();
+	janus_dtls_bio_agent_set_mtu(BENCH_MTU);
+	/* The browser side always uses an ECDSA certificate */
+	client = bench_client_create();
+	if(client == NULL) {
+		printf("Error creating the client DTLS context\n");
+		return 1;
+	}
+
+	if(key == NULL || !strcasecmp(key, "rsa"))
+		ret |= bench_run(FALSE, client, handshakes, loops, concurrency, pool, workers);
+	if(key == NULL || !strcasecmp(key, "ecdsa"))
+		ret |= bench_run(TRUE, client, handshakes, loops, concurrency, pool, workers);
+
+	SSL_CTX_free(client);
+	return ret ? 1 : 0;
+}
@@ -111,24 +111,8 @@ static int janus_dtls_bio_agent_free(BIO *bio) {
 	return 1;
 }
 	
-static int janus_dtls_bio_agent_write(BIO *bio, const char *in, int inl) {
-	JANUS_LOG(LOG_HUGE, "janus_dtls_bio_agent_write: %p, %d\n", in, inl);
-	/* Forward data to the write BIO */
-	if(inl <= 0) {
-		/* ... unless the size is negative or zero */
-		JANUS_LOG(LOG_WARN, "janus_dtls_bio_agent_write failed: negative size (%d)\n", inl);
-		return inl;
-	}
-	janus_dtls_srtp *dtls;
-#if JANUS_USE_OPENSSL_PRE_1_1_API
-	dtls = (janus_dtls_srtp *)bio->ptr;
-#else
-	dtls = (janus_dtls_srtp *)BIO_get_data(bio);
-#endif
-	if(dtls == NULL) {
-		JANUS_LOG(LOG_ERR, "No DTLS-SRTP stack, no DTLS bridge...\n");
-		return -1;
-	}
+/* Helper to actually send one or more DTLS records as a single datagram */
+static int janus_dtls_bio_agent_send(janus_dtls_srtp *dtls, const char *in, int inl) {
 	janus_ice_component *component = (janus_ice_component *)dtls->component;
 	if(component == NULL) {
 		JANUS_LOG(LOG_ERR, "No component, no DTLS bridge...\n");
@@ -164,6 +148,64 @@ static int janus_dtls_bio_agent_write(BIO *bio, const char *in, int inl) {
 	return bytes;
 }
 
+/* Helper to send the records coalesced so far, if any */
+static void janus_dtls_bio_agent_flush(janus_dtls_srtp *dtls) {
+	if(dtls->cork_buffer != NULL && dtls->cork_length > 0)
+		janus_dtls_bio_agent_send(dtls, dtls->cork_buffer, dtls->cork_length);
+	dtls->cork_length = 0;
+}
+
+static int janus_dtls_bio_agent_write(BIO *bio, const char *in, int inl) {
+	JANUS_LOG(LOG_HUGE, "janus_dtls_bio_agent_write: %p, %d\n", in, inl);
+	/* Forward data to the write BIO */
+	if(inl <= 0) {
+		/* ... unless the size is negative or zero */
+		JANUS_LOG(LOG_WARN, "janus_dtls_bio_agent_write failed: negative size (%d)\n", inl);
+		return inl;
+	}
+	janus_dtls_srtp *dtls;
+#if JANUS_USE_OPENSSL_PRE_1_1_API
+	dtls = (janus_dtls_srtp *)bio->ptr;
+#else
+	dtls = (janus_dtls_srtp *)BIO_get_data(bio);
+#endif
+	if(dtls == NULL) {
+		JANUS_LOG(LOG_ERR, "No DTLS-SRTP stack, no DTLS bridge...\n");
+		return -1;
+	}
+	if(!dtls->corked)
+		return janus_dtls_bio_agent_send(dtls, in, inl);
+	if(inl >= mtu) {
+		/* Too large to be coalesced: send what we buffered so far first,
+		 * or this record would overtake the ones that came before it */
+		janus_dtls_bio_agent_flush(dtls);
+		return janus_dtls_bio_agent_send(dtls, in, inl);
+	}
+	/* We're corked: DTLS allows more records in the same datagram, so
+	 * append this one to the buffer, unless there's no room left for it */
+	if(dtls->cork_length + inl > mtu)
+		janus_dtls_bio_agent_flush(dtls);
+	if(dtls->cork_buffer == NULL)
+		dtls->cork_buffer = g_malloc(mtu);
+	memcpy(dtls->cork_buffer + dtls->cork_length, in, inl);
+	dtls->cork_length += inl;
+	return inl;
+}
+
+void janus_dtls_bio_agent_cork(janus_dtls_srtp *dtls) {
+	if(dtls == NULL || dtls->corked)
+		return;
+	dtls->corked = TRUE;
+	dtls->cork_length = 0;
+}
+
+void janus_dtls_bio_agent_uncork(janus_dtls_srtp *dtls) {
+	if(dtls == NULL || !dtls->corked)
+		return;
+	janus_dtls_bio_agent_flush(dtls);
+	dtls->corked = FALSE;
+}
+
 static long janus_dtls_bio_agent_ctrl(BIO *bio, int cmd, long num, void *ptr) {
 	switch(cmd) {
 		case BIO_CTRL_FLUSH:
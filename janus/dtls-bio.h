@@ -33,6 +33,19 @@ BIO *BIO_janus_dtls_agent_new(struct janus_dtls_srtp *dtls);
  */
 void janus_dtls_bio_agent_set_mtu(int start_mtu);
 
+/*! \brief Start coalescing outgoing DTLS records for this DTLS stack
+ * \details While corked, records written by the DTLS stack are not sent
+ * right away, but packed together in the same datagram (which DTLS allows)
+ * until there's no room left for more according to the MTU: this saves
+ * many syscalls and packets when lots of small records are sent in a
+ * burst, e.g., for DataChannel messages
+ * @param dtls The janus_dtls_srtp instance to cork */
+void janus_dtls_bio_agent_cork(struct janus_dtls_srtp *dtls);
+
+/*! \brief Send any pending coalesced DTLS record and stop coalescing
+ * @param dtls The janus_dtls_srtp instance to uncork */
+void janus_dtls_bio_agent_uncork(struct janus_dtls_srtp *dtls);
+
 #if defined(LIBRESSL_VERSION_NUMBER)
 #define JANUS_USE_OPENSSL_PRE_1_1_API (1)
 #else
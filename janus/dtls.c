@@ -22,6 +22,7 @@
 #include <openssl/bn.h>
 #include <openssl/evp.h>
 #include <openssl/rsa.h>
+#include <openssl/ec.h>
 #include <openssl/asn1.h>
 
 
@@ -119,6 +120,27 @@ gchar *janus_dtls_get_local_fingerprint(void) {
 	return (gchar *)local_fingerprint;
 }
 
+/* Pool of autogenerated certificates, if configured */
+static janus_dtls_certificate **cert_pool = NULL;
+static guint cert_pool_size = 0, cert_pool_rotation = 0, cert_pool_next = 0;
+static gboolean cert_pool_ecdsa = FALSE;
+static janus_mutex cert_pool_mutex = JANUS_MUTEX_INITIALIZER;
+static GThread *cert_pool_thread = NULL;
+static volatile gint cert_pool_stopping = 0;
+void janus_dtls_set_certificate_pool(guint size, guint rotation) {
+	cert_pool_size = size > 1 ? size : 0;
+	cert_pool_rotation = cert_pool_size ? rotation : 0;
+}
+
+/* Handshake workers, if configured */
+static GThreadPool *handshake_workers = NULL;
+static int handshake_workers_num = 0;
+/* How many messages we queue for a single stack waiting for a worker */
+#define JANUS_DTLS_HANDSHAKE_QUEUE	64
+void janus_dtls_set_handshake_workers(int workers) {
+	handshake_workers_num = workers > 0 ? workers : 0;
+}
+
 
 #if JANUS_USE_OPENSSL_PRE_1_1_API
 /*
@@ -170,13 +192,42 @@ static void janus_dtls_cb_openssl_lock(int mode, int type, const char *file, int
 #endif
 
 
-static int janus_dtls_generate_keys(X509 **certificate, EVP_PKEY **private_key) {
+static int janus_dtls_generate_keys(X509 **certificate, EVP_PKEY **private_key, gboolean ecdsa) {
 	static const int num_bits = 2048;
 	BIGNUM *bne = NULL;
 	RSA *rsa_key = NULL;
+	EC_KEY *ecc_key = NULL;
 	X509_NAME *cert_name = NULL;
 
-	JANUS_LOG(LOG_VERB, "Generating DTLS key / cert\n");
+	JANUS_LOG(LOG_VERB, "Generating DTLS key / cert (%s)\n", ecdsa ? "ECDSA" : "RSA");
+
+	if(ecdsa) {
+		/* ECDSA signatures are much cheaper than RSA ones, which is
+		 * what makes the difference when there are many handshakes */
+		ecc_key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+		if(!ecc_key) {
+			JANUS_LOG(LOG_FATAL, "EC_KEY_new_by_curve_name() failed\n");
+			goto error;
+		}
+		/* Make sure the curve is referenced by name in the certificate */
+		EC_KEY_set_asn1_flag(ecc_key, OPENSSL_EC_NAMED_CURVE);
+		if(!EC_KEY_generate_key(ecc_key)) {
+			JANUS_LOG(LOG_FATAL, "EC_KEY_generate_key() failed\n");
+			goto error;
+		}
+		*private_key = EVP_PKEY_new();
+		if(!*private_key) {
+			JANUS_LOG(LOG_FATAL, "EVP_PKEY_new() failed\n");
+			goto error;
+		}
+		if(!EVP_PKEY_assign_EC_KEY(*private_key, ecc_key)) {
+			JANUS_LOG(LOG_FATAL, "EVP_PKEY_assign_EC_KEY() failed\n");
+			goto error;
+		}
+		/* The EC key now belongs to the private key, so don't clean it up separately. */
+		ecc_key = NULL;
+		goto certificate;
+	}
 
 	/* Create a big number object. */
 	bne = BN_new();
@@ -217,6 +268,7 @@ static int janus_dtls_generate_keys(X509 **certificate, EVP_PKEY **private_key)
 	/* The RSA key now belongs to the private key, so don't clean it up separately. */
 	rsa_key = NULL;
 
+certificate:
 	/* Create the X509 certificate. */
 	*certificate = X509_new();
 	if(!*certificate) {
@@ -256,7 +308,7 @@ static int janus_dtls_generate_keys(X509 **certificate, EVP_PKEY **private_key)
 	}
 
 	/* Sign the certificate with the private key. */
-	if(!X509_sign(*certificate, *private_key, EVP_sha1())) {
+	if(!X509_sign(*certificate, *private_key, ecdsa ? EVP_sha256() : EVP_sha1())) {
 		JANUS_LOG(LOG_FATAL, "X509_sign() failed\n");
 		goto error;
 	}
@@ -270,6 +322,8 @@ error:
 		BN_free(bne);
 	if(rsa_key && !*private_key)
 		RSA_free(rsa_key);
+	if(ecc_key)
+		EC_KEY_free(ecc_key);
 	if(*private_key)
 		EVP_PKEY_free(*private_key);  /* This also frees the RSA key. */
 	if(*certificate)
@@ -320,9 +374,148 @@ error:
 	return -1;
 }
 
+/* Helper to write the string representation (SHA-256) of a certificate fingerprint */
+static int janus_dtls_compute_fingerprint(X509 *certificate, gchar *fingerprint) {
+	unsigned int size;
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	if(X509_digest(certificate, EVP_sha256(), (unsigned char *)digest, &size) == 0) {
+		JANUS_LOG(LOG_FATAL, "Error converting X509 structure (%s)\n", ERR_reason_error_string(ERR_get_error()));
+		return -1;
+	}
+	char *lfp = fingerprint;
+	unsigned int i = 0;
+	for(i = 0; i < size; i++) {
+		g_snprintf(lfp, 4, "%.2X:", digest[i]);
+		lfp += 3;
+	}
+	*(lfp-1) = 0;
+	return 0;
+}
+
+
+/* Certificate pool */
+static void janus_dtls_certificate_free(const janus_refcount *cert_ref) {
+	janus_dtls_certificate *certificate = janus_refcount_containerof(cert_ref, janus_dtls_certificate, ref);
+	if(certificate->cert != NULL)
+		X509_free(certificate->cert);
+	if(certificate->key != NULL)
+		EVP_PKEY_free(certificate->key);
+	g_free(certificate);
+}
+
+static janus_dtls_certificate *janus_dtls_certificate_create(gboolean ecdsa) {
+	X509 *cert = NULL;
+	EVP_PKEY *key = NULL;
+	if(janus_dtls_generate_keys(&cert, &key, ecdsa) != 0)
+		return NULL;
+	janus_dtls_certificate *certificate = g_malloc0(sizeof(janus_dtls_certificate));
+	certificate->cert = cert;
+	certificate->key = key;
+	certificate->created = janus_get_monotonic_time();
+	janus_refcount_init(&certificate->ref, janus_dtls_certificate_free);
+	if(janus_dtls_compute_fingerprint(cert, certificate->fingerprint) < 0) {
+		janus_refcount_decrease(&certificate->ref);
+		return NULL;
+	}
+	return certificate;
+}
+
+/* Pick the next certificate in the pool: the caller owns a reference */
+static janus_dtls_certificate *janus_dtls_certificate_pool_pick(void) {
+	janus_dtls_certificate *certificate = NULL;
+	janus_mutex_lock(&cert_pool_mutex);
+	if(cert_pool != NULL) {
+		certificate = cert_pool[cert_pool_next];
+		cert_pool_next = (cert_pool_next + 1) % cert_pool_size;
+		janus_refcount_increase(&certificate->ref);
+	}
+	janus_mutex_unlock(&cert_pool_mutex);
+	return certificate;
+}
+
+/* Thread replacing the oldest certificate in the pool periodically */
+static void *janus_dtls_certificate_pool_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Starting DTLS certificate rotation thread\n");
+	gint64 last = janus_get_monotonic_time();
+	while(!g_atomic_int_get(&cert_pool_stopping)) {
+		g_usleep(100000);
+		gint64 now = janus_get_monotonic_time();
+		if(now - last < (gint64)cert_pool_rotation*G_USEC_PER_SEC)
+			continue;
+		last = now;
+		/* Generating the key takes time, don't do that with the pool locked */
+		janus_dtls_certificate *certificate = janus_dtls_certificate_create(cert_pool_ecdsa);
+		if(certificate == NULL) {
+			JANUS_LOG(LOG_ERR, "Error generating DTLS certificate, keeping the old one for now\n");
+			continue;
+		}
+		janus_mutex_lock(&cert_pool_mutex);
+		guint i = 0, oldest = 0;
+		for(i = 1; i < cert_pool_size; i++) {
+			if(cert_pool[i]->created < cert_pool[oldest]->created)
+				oldest = i;
+		}
+		janus_dtls_certificate *old = cert_pool[oldest];
+		cert_pool[oldest] = certificate;
+		janus_mutex_unlock(&cert_pool_mutex);
+		JANUS_LOG(LOG_VERB, "Rotated DTLS certificate %u of the pool: %s\n", oldest, certificate->fingerprint);
+		/* Stacks still using the old certificate have their own reference */
+		janus_refcount_decrease(&old->ref);
+	}
+	JANUS_LOG(LOG_VERB, "Leaving DTLS certificate rotation thread\n");
+	return NULL;
+}
+
+
+/* Handshake workers */
+typedef struct janus_dtls_handshake_task {
+	janus_dtls_srtp *dtls;
+	janus_ice_component *component;
+	janus_ice_stream *stream;
+	janus_ice_handle *handle;
+	NiceAgent *agent;
+} janus_dtls_handshake_task;
+
+typedef struct janus_dtls_handshake_msg {
+	uint16_t len;
+	char buf[0];
+} janus_dtls_handshake_msg;
+
+static void janus_dtls_srtp_process_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len);
+
+static void janus_dtls_handshake_worker(gpointer data, gpointer user_data) {
+	janus_dtls_handshake_task *task = (janus_dtls_handshake_task *)data;
+	janus_dtls_srtp *dtls = task->dtls;
+	while(TRUE) {
+		janus_mutex_lock(&dtls->mutex);
+		janus_dtls_handshake_msg *msg = g_queue_pop_head(dtls->handshake_queue);
+		if(msg == NULL || g_atomic_int_get(&dtls->destroyed)) {
+			/* Done: from now on, new messages are processed in the loop again, unless
+			 * the handshake is still in progress and the loop schedules us again */
+			dtls->handshake_scheduled = FALSE;
+			while(msg != NULL) {
+				g_free(msg);
+				msg = g_queue_pop_head(dtls->handshake_queue);
+			}
+			janus_mutex_unlock(&dtls->mutex);
+			break;
+		}
+		janus_mutex_unlock(&dtls->mutex);
+		janus_dtls_srtp_process_msg(dtls, msg->buf, msg->len);
+		g_free(msg);
+	}
+	/* The references we took make sure nothing went away while we were working */
+	g_object_unref(task->agent);
+	janus_refcount_decrease(&task->handle->ref);
+	janus_refcount_decrease(&task->stream->ref);
+	janus_refcount_decrease(&task->component->ref);
+	janus_refcount_decrease(&dtls->ref);
+	g_free(task);
+}
+
 
 /* DTLS-SRTP initialization */
-gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password, guint timeout) {
+gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password, gboolean ecdsa_key, guint timeout) {
 	const char *crypto_lib = NULL;
 #if JANUS_USE_OPENSSL_PRE_1_1_API
 #if defined(LIBRESSL_VERSION_NUMBER)
@@ -367,9 +560,25 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 		"SRTP_AES128_CM_SHA1_80:SRTP_AES128_CM_SHA1_32");
 #endif
 
-	if(!server_pem && !server_key) {
+	if(!server_pem && !server_key && cert_pool_size > 0) {
+		JANUS_LOG(LOG_WARN, "No cert/key specified, autogenerating a pool of %u (%s)...\n", cert_pool_size, ecdsa_key ? "ECDSA" : "RSA");
+		cert_pool_ecdsa = ecdsa_key;
+		cert_pool = g_malloc0(cert_pool_size * sizeof(janus_dtls_certificate *));
+		guint i = 0;
+		for(i = 0; i < cert_pool_size; i++) {
+			cert_pool[i] = janus_dtls_certificate_create(ecdsa_key);
+			if(cert_pool[i] == NULL) {
+				JANUS_LOG(LOG_FATAL, "Error generating DTLS key/certificate\n");
+				return -2;
+			}
+			JANUS_LOG(LOG_VERB, "  -- Fingerprint of certificate %u: %s\n", i, cert_pool[i]->fingerprint);
+		}
+		/* The first one is also the default, but it still belongs to the pool */
+		ssl_cert = cert_pool[0]->cert;
+		ssl_key = cert_pool[0]->key;
+	} else if(!server_pem && !server_key) {
 		JANUS_LOG(LOG_WARN, "No cert/key specified, autogenerating some...\n");
-		if(janus_dtls_generate_keys(&ssl_cert, &ssl_key) != 0) {
+		if(janus_dtls_generate_keys(&ssl_cert, &ssl_key, ecdsa_key) != 0) {
 			JANUS_LOG(LOG_FATAL, "Error generating DTLS key/certificate\n");
 			return -2;
 		}
@@ -378,6 +587,15 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 		return -2;
 	} else if(janus_dtls_load_keys(server_pem, server_key, password, &ssl_cert, &ssl_key) != 0) {
 		return -3;
+	} else {
+		/* The key type is the one of the certificate we've been given */
+		if(ecdsa_key)
+			JANUS_LOG(LOG_WARN, "A DTLS certificate was provided, ignoring ecdsa_private_key (only used for autogenerated certificates)\n");
+		if(cert_pool_size > 0) {
+			JANUS_LOG(LOG_WARN, "A DTLS certificate was provided, ignoring the certificate pool (only used for autogenerated certificates)\n");
+			cert_pool_size = 0;
+			cert_pool_rotation = 0;
+		}
 	}
 
 	if(!SSL_CTX_use_certificate(ssl_ctx, ssl_cert)) {
@@ -394,22 +612,33 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 	}
 	SSL_CTX_set_read_ahead(ssl_ctx,1);
 
-	unsigned int size;
-	unsigned char fingerprint[EVP_MAX_MD_SIZE];
-	if(X509_digest(ssl_cert, EVP_sha256(), (unsigned char *)fingerprint, &size) == 0) {
-		JANUS_LOG(LOG_FATAL, "Error converting X509 structure (%s)\n", ERR_reason_error_string(ERR_get_error()));
+	if(janus_dtls_compute_fingerprint(ssl_cert, local_fingerprint) < 0)
 		return -7;
-	}
-	char *lfp = (char *)&local_fingerprint;
-	unsigned int i = 0;
-	for(i = 0; i < size; i++) {
-		g_snprintf(lfp, 4, "%.2X:", fingerprint[i]);
-		lfp += 3;
-	}
-	*(lfp-1) = 0;
 	JANUS_LOG(LOG_INFO, "Fingerprint of our certificate: %s\n", local_fingerprint);
 	SSL_CTX_set_cipher_list(ssl_ctx, DTLS_CIPHERS);
 
+	if(cert_pool != NULL && cert_pool_rotation > 0) {
+		GError *error = NULL;
+		cert_pool_thread = g_thread_try_new("dtls certs", janus_dtls_certificate_pool_thread, NULL, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to launch the DTLS certificate rotation thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			return -2;
+		}
+	}
+	if(handshake_workers_num > 0) {
+		GError *error = NULL;
+		handshake_workers = g_thread_pool_new(janus_dtls_handshake_worker, NULL, handshake_workers_num, FALSE, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to launch the DTLS handshake workers...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			return -2;
+		}
+		JANUS_LOG(LOG_INFO, "DTLS handshakes will be processed by %d worker(s)\n", handshake_workers_num);
+	}
+
 	if(janus_dtls_bio_agent_init() < 0) {
 		JANUS_LOG(LOG_FATAL, "Error initializing BIO agent\n");
 		return -8;
@@ -452,11 +681,40 @@ static void janus_dtls_srtp_free(const janus_refcount *dtls_ref) {
 		}
 		/* FIXME What about dtls->remote_policy and dtls->local_policy? */
 	}
+	if(dtls->certificate != NULL)
+		janus_refcount_decrease(&dtls->certificate->ref);
+	dtls->certificate = NULL;
+	if(dtls->handshake_queue != NULL)
+		g_queue_free_full(dtls->handshake_queue, (GDestroyNotify)g_free);
+	dtls->handshake_queue = NULL;
+	janus_mutex_destroy(&dtls->mutex);
+	g_free(dtls->cork_buffer);
 	g_free(dtls);
 	dtls = NULL;
 }
 
 void janus_dtls_srtp_cleanup(void) {
+	if(handshake_workers != NULL) {
+		g_thread_pool_free(handshake_workers, FALSE, TRUE);
+		handshake_workers = NULL;
+	}
+	if(cert_pool_thread != NULL) {
+		g_atomic_int_set(&cert_pool_stopping, 1);
+		g_thread_join(cert_pool_thread);
+		cert_pool_thread = NULL;
+	}
+	if(cert_pool != NULL) {
+		guint i = 0;
+		for(i = 0; i < cert_pool_size; i++) {
+			if(cert_pool[i] != NULL)
+				janus_refcount_decrease(&cert_pool[i]->ref);
+		}
+		g_free(cert_pool);
+		cert_pool = NULL;
+		/* The default certificate and key belonged to the pool */
+		ssl_cert = NULL;
+		ssl_key = NULL;
+	}
 	if(ssl_cert != NULL) {
 		X509_free(ssl_cert);
 		ssl_cert = NULL;
@@ -493,6 +751,7 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_component, janus_dtls_role rol
 	}
 	janus_dtls_srtp *dtls = g_malloc0(sizeof(janus_dtls_srtp));
 	g_atomic_int_set(&dtls->destroyed, 0);
+	janus_mutex_init(&dtls->mutex);
 	janus_refcount_init(&dtls->ref, janus_dtls_srtp_free);
 	/* Create SSL context, at last */
 	dtls->srtp_valid = 0;
@@ -505,6 +764,15 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_component, janus_dtls_role rol
 	}
 	SSL_set_ex_data(dtls->ssl, 0, dtls);
 	SSL_set_info_callback(dtls->ssl, janus_dtls_callback);
+	/* If there's a certificate pool, use the next certificate rather than the global one */
+	dtls->certificate = janus_dtls_certificate_pool_pick();
+	if(dtls->certificate != NULL && (!SSL_use_certificate(dtls->ssl, dtls->certificate->cert) ||
+			!SSL_use_PrivateKey(dtls->ssl, dtls->certificate->key))) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"]     Error setting DTLS certificate! (%s)\n",
+			handle->handle_id, ERR_reason_error_string(ERR_get_error()));
+		janus_refcount_decrease(&dtls->ref);
+		return NULL;
+	}
 	dtls->read_bio = BIO_new(BIO_s_mem());
 	if(!dtls->read_bio) {
 		JANUS_LOG(LOG_ERR, "[%"SCNu64"]   Error creating read BIO! (%s)\n",
@@ -605,6 +873,68 @@ void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len
 		JANUS_LOG(LOG_ERR, "No DTLS-SRTP stack, no incoming message...\n");
 		return;
 	}
+	if(handshake_workers == NULL || dtls->dtls_started == 0 || g_atomic_int_get(&dtls->destroyed)) {
+		janus_dtls_srtp_process_msg(dtls, buf, len);
+		return;
+	}
+	janus_mutex_lock(&dtls->mutex);
+	if(dtls->ready && !dtls->handshake_scheduled) {
+		/* Handshake done and nothing pending, process the message right away */
+		janus_mutex_unlock(&dtls->mutex);
+		janus_dtls_srtp_process_msg(dtls, buf, len);
+		return;
+	}
+	/* The handshake is still in progress (or a worker is still busy with this
+	 * stack, and we want to preserve the order): let a worker deal with it */
+	if(dtls->handshake_queue == NULL)
+		dtls->handshake_queue = g_queue_new();
+	if(g_queue_get_length(dtls->handshake_queue) >= JANUS_DTLS_HANDSHAKE_QUEUE) {
+		/* DTLS will retransmit anyway */
+		janus_mutex_unlock(&dtls->mutex);
+		JANUS_LOG(LOG_WARN, "Too many DTLS messages waiting for a handshake worker, dropping one\n");
+		return;
+	}
+	janus_dtls_handshake_msg *msg = g_malloc(sizeof(janus_dtls_handshake_msg) + len);
+	msg->len = len;
+	memcpy(msg->buf, buf, len);
+	g_queue_push_tail(dtls->handshake_queue, msg);
+	if(dtls->handshake_scheduled) {
+		/* A worker is already taking care of this stack */
+		janus_mutex_unlock(&dtls->mutex);
+		return;
+	}
+	janus_ice_component *component = (janus_ice_component *)dtls->component;
+	janus_ice_stream *stream = component ? component->stream : NULL;
+	janus_ice_handle *handle = stream ? stream->handle : NULL;
+	if(handle == NULL || handle->agent == NULL) {
+		janus_mutex_unlock(&dtls->mutex);
+		JANUS_LOG(LOG_ERR, "No component/stream/handle/agent, no DTLS...\n");
+		return;
+	}
+	dtls->handshake_scheduled = TRUE;
+	janus_mutex_unlock(&dtls->mutex);
+	/* Make sure nothing goes away while the worker is busy */
+	janus_dtls_handshake_task *task = g_malloc(sizeof(janus_dtls_handshake_task));
+	janus_refcount_increase(&dtls->ref);
+	task->dtls = dtls;
+	janus_refcount_increase(&component->ref);
+	task->component = component;
+	janus_refcount_increase(&stream->ref);
+	task->stream = stream;
+	janus_refcount_increase(&handle->ref);
+	task->handle = handle;
+	task->agent = g_object_ref(handle->agent);
+	g_thread_pool_push(handshake_workers, task, NULL);
+}
+
+const gchar *janus_dtls_srtp_get_local_fingerprint(janus_dtls_srtp *dtls) {
+	if(dtls == NULL || dtls->certificate == NULL)
+		return local_fingerprint;
+	return dtls->certificate->fingerprint;
+}
+
+/* Actual processing of an incoming DTLS message, either in the loop or in a handshake worker */
+static void janus_dtls_srtp_process_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len) {
 	janus_ice_component *component = (janus_ice_component *)dtls->component;
 	if(component == NULL) {
 		JANUS_LOG(LOG_ERR, "No component, no DTLS...\n");
@@ -895,7 +1225,12 @@ void janus_dtls_srtp_send_alert(janus_dtls_srtp *dtls) {
 	/* Send alert */
 	janus_refcount_increase(&dtls->ref);
 	if(dtls != NULL && dtls->ssl != NULL) {
-		SSL_shutdown(dtls->ssl);
+		/* If a handshake worker is still busy with this stack, leave it alone */
+		janus_mutex_lock(&dtls->mutex);
+		gboolean busy = dtls->handshake_scheduled;
+		janus_mutex_unlock(&dtls->mutex);
+		if(!busy)
+			SSL_shutdown(dtls->ssl);
 	}
 	janus_refcount_decrease(&dtls->ref);
 }
@@ -952,10 +1287,10 @@ int janus_dtls_verify_callback(int preverify_ok, X509_STORE_CTX *ctx) {
 }
 
 #ifdef HAVE_SCTP
-void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *buf, int len) {
+void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *buf, int len, gboolean more) {
 	if(dtls == NULL || !dtls->ready || dtls->sctp == NULL || buf == NULL || len < 1)
 		return;
-	janus_sctp_send_data(dtls->sctp, buf, len);
+	janus_sctp_send_data(dtls->sctp, buf, len, more);
 }
 
 int janus_dtls_send_sctp_data(janus_dtls_srtp *dtls, char *buf, int len) {
@@ -1017,6 +1352,13 @@ gboolean janus_dtls_retry(gpointer stack) {
 		janus_ice_webrtc_hangup(handle, "DTLS timeout");
 		goto stoptimer;
 	}
+	janus_mutex_lock(&dtls->mutex);
+	gboolean busy = dtls->handshake_scheduled;
+	janus_mutex_unlock(&dtls->mutex);
+	if(busy) {
+		/* A handshake worker is processing messages on this stack, try again later */
+		return TRUE;
+	}
 	struct timeval timeout = {0};
 	if(DTLSv1_get_timeout(dtls->ssl, &timeout) == 0) {
 		/* failed to get timeout. try again on next iter */
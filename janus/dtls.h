@@ -22,20 +22,59 @@
 #include "rtpsrtp.h"
 #include "sctp.h"
 #include "refcount.h"
+#include "mutex.h"
 #include "dtls-bio.h"
 
+/*! \brief Configure a pool of autogenerated certificates, to be called before janus_dtls_srtp_init
+ * \details New DTLS stacks pick a certificate from the pool in a round robin
+ * fashion, and each advertises the fingerprint of its own. When a rotation
+ * interval is set, the oldest certificate in the pool is replaced by a
+ * freshly generated one every time the interval expires; stacks already
+ * using it keep it until they're destroyed. Only autogenerated certificates
+ * can be pooled: the setting is ignored when cert_pem/cert_key are provided.
+ * @param[in] size Number of certificates in the pool (0 or 1 disables the pool)
+ * @param[in] rotation How often, in seconds, the oldest certificate should be replaced (0 disables rotation) */
+void janus_dtls_set_certificate_pool(guint size, guint rotation);
+/*! \brief Configure the threads that should take care of DTLS handshakes, to be called before janus_dtls_srtp_init
+ * \details By default, incoming DTLS messages are processed in the event
+ * loop of the handle they belong to, handshakes included. When workers are
+ * configured, messages received while a handshake is still in progress are
+ * queued and processed by one of these threads instead, so that the
+ * expensive cryptographic operations don't block the loop (and any other
+ * handle served by the same loop, when static event loops are used).
+ * Messages for the same DTLS stack are always processed in order.
+ * @param[in] workers Number of handshake threads (0 processes handshakes in the event loops) */
+void janus_dtls_set_handshake_workers(int workers);
 /*! \brief DTLS stuff initialization
  * @param[in] server_pem Path to the certificate to use
  * @param[in] server_key Path to the key to use
  * @param[in] password Password needed to use the key, if any
+ * @param[in] ecdsa_key Whether an autogenerated key should be ECDSA (P-256) rather than RSA (ignored if a certificate is provided)
  * @param[in] timeout DTLS timeout base to use for retransmissions (ignored if not using BoringSSL)
  * @returns 0 in case of success, a negative integer on errors */
-gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password, guint timeout);
+gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password, gboolean ecdsa_key, guint timeout);
 /*! \brief Method to cleanup DTLS stuff before exiting */
 void janus_dtls_srtp_cleanup(void);
-/*! \brief Method to return a string representation (SHA-256) of the certificate fingerprint */
+/*! \brief Method to return a string representation (SHA-256) of the certificate fingerprint
+ * \note When a certificate pool is in use, this is the fingerprint of the
+ * first certificate in the pool: use janus_dtls_srtp_get_local_fingerprint
+ * to get the one a specific DTLS stack is actually using */
 gchar *janus_dtls_get_local_fingerprint(void);
 
+/*! \brief Autogenerated DTLS certificate, as shared by the stacks using it */
+typedef struct janus_dtls_certificate {
+	/*! \brief The certificate */
+	X509 *cert;
+	/*! \brief The private key */
+	EVP_PKEY *key;
+	/*! \brief String representation (SHA-256) of the certificate fingerprint */
+	gchar fingerprint[160];
+	/*! \brief Monotonic time of when the certificate was generated */
+	gint64 created;
+	/*! \brief Reference counter for this instance */
+	janus_refcount ref;
+} janus_dtls_certificate;
+
 
 /*! \brief DTLS roles */
 typedef enum janus_dtls_role {
@@ -86,6 +125,20 @@ typedef struct janus_dtls_srtp {
 	int ready;
 	/*! \brief The number of retransmissions that have occurred for this DTLS instance so far */
 	int retransmissions;
+	/*! \brief Whether outgoing DTLS records are currently being coalesced in the same datagram */
+	gboolean corked;
+	/*! \brief Buffer where DTLS records are coalesced while corked */
+	char *cork_buffer;
+	/*! \brief Number of bytes currently in the cork buffer */
+	int cork_length;
+	/*! \brief Certificate from the pool this stack is using, if any (NULL means the global one) */
+	janus_dtls_certificate *certificate;
+	/*! \brief Incoming DTLS messages waiting for a handshake worker, if any */
+	GQueue *handshake_queue;
+	/*! \brief Whether a handshake worker has been scheduled to process the queue */
+	gboolean handshake_scheduled;
+	/*! \brief Mutex to lock the handshake queue */
+	janus_mutex mutex;
 #ifdef HAVE_SCTP
 	/*! \brief SCTP association, if DataChannels are involved */
 	janus_sctp_association *sctp;
@@ -113,10 +166,16 @@ void janus_dtls_srtp_handshake(janus_dtls_srtp *dtls);
  * @returns 0 in case of success, a negative integer otherwise */
 int janus_dtls_srtp_create_sctp(janus_dtls_srtp *dtls);
 /*! \brief Handle an incoming DTLS message
+ * \note If handshake workers are configured and the handshake is still
+ * in progress, the message is copied and processed by a worker later on
  * @param[in] dtls The janus_dtls_srtp instance to start the handshake on
  * @param[in] buf The DTLS message data
  * @param[in] len The DTLS message data lenght */
 void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len);
+/*! \brief Method to return a string representation (SHA-256) of the fingerprint of the certificate a DTLS stack is using
+ * @param[in] dtls The janus_dtls_srtp instance to query (NULL returns the global fingerprint)
+ * @returns The fingerprint */
+const gchar *janus_dtls_srtp_get_local_fingerprint(janus_dtls_srtp *dtls);
 /*! \brief Send an alert on a janus_dtls_srtp instance
  * @param[in] dtls The janus_dtls_srtp instance to send the alert on */
 void janus_dtls_srtp_send_alert(janus_dtls_srtp *dtls);
@@ -140,8 +199,9 @@ int janus_dtls_verify_callback(int preverify_ok, X509_STORE_CTX *ctx);
 /*! \brief Callback (called from the ICE handle) to encapsulate in DTLS outgoing SCTP data (DataChannel)
  * @param[in] dtls The janus_dtls_srtp instance to use
  * @param[in] buf The data buffer to encapsulate
- * @param[in] len The data length */
-void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *buf, int len);
+ * @param[in] len The data length
+ * @param[in] more Whether more messages will immediately follow this one, to coalesce them */
+void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *buf, int len, gboolean more);
 
 /*! \brief Callback (called from the SCTP stack) to encapsulate in DTLS outgoing SCTP data (DataChannel)
  * @param[in] dtls The janus_dtls_srtp instance to use
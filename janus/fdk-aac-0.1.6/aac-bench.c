@@ -0,0 +1,202 @@
+/* ------------------------------------------------------------------
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ * -------------------------------------------------------------------
+ */
+
+/* Encoder benchmark: encodes synthetic audio (a tone sweep plus noise, so
+ * that the output doesn't depend on any input file) and prints the time
+ * spent per frame, together with a checksum of the bitstream. Running it
+ * with FDK_AAC_SIMD=none, sse4.1 and avx2 compares the x86 kernels with
+ * the C ones: the checksums must match, as the kernels are bit-exact. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(_MSC_VER)
+#include <getopt.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "libAACenc/include/aacenc_lib.h"
+
+void usage(const char* name) {
+	fprintf(stderr, "%s [-r bitrate] [-t aot] [-c channels] [-s samplerate] [-n frames] [-o out.aac]\n", name);
+	fprintf(stderr, "Supported AOTs:\n");
+	fprintf(stderr, "\t2\tAAC-LC\n");
+	fprintf(stderr, "\t5\tHE-AAC\n");
+	fprintf(stderr, "\t29\tHE-AAC v2\n");
+	fprintf(stderr, "\t23\tAAC-LD\n");
+	fprintf(stderr, "\t39\tAAC-ELD\n");
+}
+
+static double now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+	int bitrate = 64000;
+	int aot = 2;
+	int channels = 2;
+	int sample_rate = 48000;
+	int frames = 2000;
+	const char *outfile = NULL;
+	FILE *out = NULL;
+	int ch, i;
+	HANDLE_AACENCODER handle;
+	AACENC_InfoStruct info = { 0 };
+	while ((ch = getopt(argc, argv, "r:t:c:s:n:o:")) != -1) {
+		switch (ch) {
+		case 'r':
+			bitrate = atoi(optarg);
+			break;
+		case 't':
+			aot = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 's':
+			sample_rate = atoi(optarg);
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case '?':
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (channels < 1 || channels > 2 || frames < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (aacEncOpen(&handle, 0, channels) != AACENC_OK) {
+		fprintf(stderr, "Unable to open encoder\n");
+		return 1;
+	}
+	if (aacEncoder_SetParam(handle, AACENC_AOT, aot) != AACENC_OK ||
+			aacEncoder_SetParam(handle, AACENC_SAMPLERATE, sample_rate) != AACENC_OK ||
+			aacEncoder_SetParam(handle, AACENC_CHANNELMODE, channels == 1 ? MODE_1 : MODE_2) != AACENC_OK ||
+			aacEncoder_SetParam(handle, AACENC_CHANNELORDER, 1) != AACENC_OK ||
+			aacEncoder_SetParam(handle, AACENC_BITRATE, bitrate) != AACENC_OK ||
+			aacEncoder_SetParam(handle, AACENC_TRANSMUX, 2) != AACENC_OK ||
+			aacEncoder_SetParam(handle, AACENC_AFTERBURNER, 1) != AACENC_OK) {
+		fprintf(stderr, "Unable to configure the encoder\n");
+		return 1;
+	}
+	if (aacEncEncode(handle, NULL, NULL, NULL, NULL) != AACENC_OK) {
+		fprintf(stderr, "Unable to initialize the encoder\n");
+		return 1;
+	}
+	if (aacEncInfo(handle, &info) != AACENC_OK) {
+		fprintf(stderr, "Unable to get the encoder info\n");
+		return 1;
+	}
+	if (outfile) {
+		out = fopen(outfile, "wb");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+
+	/* Generate the whole input first, so that only encoding is timed */
+	int frame_samples = channels*info.frameLength;
+	int16_t *input = (int16_t*) malloc(sizeof(int16_t)*frame_samples*frames);
+	uint32_t seed = 1;
+	double phase = 0.0;
+	for (i = 0; i < info.frameLength*frames; i++) {
+		double freq = 100.0 + 8000.0 * (i % (sample_rate*4)) / (sample_rate*4);
+		phase += 2.0 * M_PI * freq / sample_rate;
+		int c;
+		for (c = 0; c < channels; c++) {
+			seed = seed*1664525 + 1013904223;
+			int noise = (int)(seed >> 20) - 2048;
+			input[i*channels + c] = (int16_t)(12000.0 * sin(phase + c) + noise);
+		}
+	}
+
+	uint32_t checksum = 2166136261u;
+	size_t total = 0;
+	double encoding = 0.0;
+	for (i = 0; i <= frames; i++) {
+		AACENC_BufDesc in_buf = { 0 }, out_buf = { 0 };
+		AACENC_InArgs in_args = { 0 };
+		AACENC_OutArgs out_args = { 0 };
+		int in_identifier = IN_AUDIO_DATA;
+		int in_size, in_elem_size;
+		int out_identifier = OUT_BITSTREAM_DATA;
+		int out_size, out_elem_size;
+		void *in_ptr, *out_ptr;
+		uint8_t outbuf[20480];
+		AACENC_ERROR err;
+		size_t j;
+
+		/* One more round with no input, to flush the encoder */
+		in_ptr = input + (i < frames ? i : 0)*frame_samples;
+		in_size = frame_samples*2;
+		in_elem_size = 2;
+		in_args.numInSamples = i < frames ? frame_samples : -1;
+		in_buf.numBufs = 1;
+		in_buf.bufs = &in_ptr;
+		in_buf.bufferIdentifiers = &in_identifier;
+		in_buf.bufSizes = &in_size;
+		in_buf.bufElSizes = &in_elem_size;
+
+		out_ptr = outbuf;
+		out_size = sizeof(outbuf);
+		out_elem_size = 1;
+		out_buf.numBufs = 1;
+		out_buf.bufs = &out_ptr;
+		out_buf.bufferIdentifiers = &out_identifier;
+		out_buf.bufSizes = &out_size;
+		out_buf.bufElSizes = &out_elem_size;
+
+		double start = now_us();
+		err = aacEncEncode(handle, &in_buf, &out_buf, &in_args, &out_args);
+		encoding += now_us() - start;
+		if (err == AACENC_ENCODE_EOF)
+			break;
+		if (err != AACENC_OK) {
+			fprintf(stderr, "Encoding failed\n");
+			return 1;
+		}
+		for (j = 0; j < (size_t)out_args.numOutBytes; j++)
+			checksum = (checksum ^ outbuf[j]) * 16777619u;
+		total += out_args.numOutBytes;
+		if (out && out_args.numOutBytes > 0)
+			fwrite(outbuf, 1, out_args.numOutBytes, out);
+	}
+	const char *simd = getenv("FDK_AAC_SIMD");
+	printf("aot %d, %d Hz, %d channels, %d bps, SIMD %s\n", aot, sample_rate, channels, bitrate, simd ? simd : "auto");
+	printf("%d frames of %d samples, %zu bytes, checksum %08x\n", frames, info.frameLength, total, checksum);
+	printf("%.2f us per frame (%.1fx realtime)\n", encoding / frames,
+		(1000000.0 * info.frameLength / sample_rate) / (encoding / frames));
+	free(input);
+	if (out)
+		fclose(out);
+	aacEncClose(&handle);
+	return 0;
+}
@@ -745,6 +745,17 @@ LINKSPEC_H void aacDecoder_Close ( HANDLE_AACDECODER self );
  */
 LINKSPEC_H CStreamInfo* aacDecoder_GetStreamInfo( HANDLE_AACDECODER self );
 
+/**
+ * \brief       Get the heap memory held by an AAC decoder instance.
+ *
+ * The channel and SBR memory is only allocated once the stream configuration is known, so the
+ * value grows during the first aacDecoder_ConfigRaw() or aacDecoder_DecodeFrame() calls.
+ *
+ * \param self  AAC decoder handle.
+ * \return      Allocated memory in bytes.
+ */
+LINKSPEC_H UINT aacDecoder_GetMemUsage( HANDLE_AACDECODER self );
+
 /**
  * \brief       Get decoder library info.
  *
@@ -186,6 +186,21 @@ void CAacDecoder_SyncQmfMode(HANDLE_AACDECODER self)
   FDK_ASSERT( ! ( (self->flags & AC_MPS_PRESENT) && self->psPossible ) );
 }
 
+SBR_ERROR CAacDecoder_OpenSbr(HANDLE_AACDECODER self)
+{
+  SBR_ERROR sbrError = SBRDEC_OK;
+
+  if (self->hSbrDecoder == NULL) {
+    sbrError = sbrDecoder_Open(&self->hSbrDecoder);
+    if (sbrError == SBRDEC_OK) {
+      /* The QMF mode may have been synchronised while there was no SBR decoder yet */
+      sbrDecoder_SetParam(self->hSbrDecoder, SBR_QMF_MODE, (self->qmfModeCurr == MODE_LP));
+    }
+  }
+
+  return sbrError;
+}
+
 void CAacDecoder_SignalInterruption(HANDLE_AACDECODER self)
 {
 }
@@ -518,7 +533,9 @@ AAC_DECODER_ERROR CAacDecoder_ExtPayloadParse (HANDLE_AACDECODER self,
 
       CAacDecoder_SyncQmfMode(self);
 
-      sbrError = sbrDecoder_InitElement(
+      sbrError = CAacDecoder_OpenSbr(self);
+      if (sbrError == SBRDEC_OK) {
+        sbrError = sbrDecoder_InitElement(
               self->hSbrDecoder,
               self->streamInfo.aacSampleRate,
               self->streamInfo.extSamplingRate,
@@ -527,6 +544,7 @@ AAC_DECODER_ERROR CAacDecoder_ExtPayloadParse (HANDLE_AACDECODER self,
               previous_element,
               elIndex
               );
+      }
 
       if (sbrError == SBRDEC_OK) {
         sbrError = sbrDecoder_Parse (
@@ -1313,7 +1331,9 @@ LINKSPEC_CPP AAC_DECODER_ERROR CAacDecoder_DecodeFrame(
           {
             SBR_ERROR sbrError;
 
-            sbrError = sbrDecoder_InitElement(
+            sbrError = CAacDecoder_OpenSbr(self);
+            if (sbrError == SBRDEC_OK) {
+              sbrError = sbrDecoder_InitElement(
                     self->hSbrDecoder,
                     self->streamInfo.aacSampleRate,
                     self->streamInfo.extSamplingRate,
@@ -1322,6 +1342,7 @@ LINKSPEC_CPP AAC_DECODER_ERROR CAacDecoder_DecodeFrame(
                     type,
                     previous_element_index
                     );
+            }
             if (sbrError != SBRDEC_OK) {
               /* Do not try to apply SBR because initializing the element failed. */
               self->sbrEnabled = 0;
@@ -226,6 +226,8 @@ struct AAC_DECODER_INSTANCE {
   FIXP_DBL     extGain[1];                           /*!< Gain that must be applied to the output signal. */
   UINT         extGainDelay;                         /*!< Delay that must be accounted for extGain. */
 
+  UINT         memUsage;                             /*!< Heap memory allocated for this instance so far, in bytes. */
+
   INT_PCM      pcmOutputBuffer[(8)*(2048)];
 
 };
@@ -257,6 +259,14 @@ struct AAC_DECODER_INSTANCE {
  */
 void CAacDecoder_SyncQmfMode(HANDLE_AACDECODER self);
 
+/**
+ * \brief Open the SBR decoder, if not done yet. It is only opened once the
+ *        bit stream signals SBR, so plain AAC streams do not carry its memory.
+ * \param self decoder handle
+ * \return SBRDEC_OK on success
+ */
+SBR_ERROR CAacDecoder_OpenSbr(HANDLE_AACDECODER self);
+
 /**
  * \brief Signal a bit stream interruption to the decoder
  * \param self decoder handle
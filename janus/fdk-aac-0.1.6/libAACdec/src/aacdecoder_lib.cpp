@@ -165,6 +165,9 @@ LINKSPEC_CPP AAC_DECODER_ERROR aacDecoder_ConfigRaw (
   TRANSPORTDEC_ERROR   errTp;
   UINT layer, nrOfLayers = self->nrOfLayers;
 
+  /* The config callback allocates the channels */
+  FDKmemMeterStart(&self->memUsage);
+
   for(layer = 0; layer < nrOfLayers; layer++){
     if(length[layer] > 0){
       errTp = transportDec_OutOfBandConfig(self->hInput, conf[layer], length[layer], layer);
@@ -190,11 +193,37 @@ LINKSPEC_CPP AAC_DECODER_ERROR aacDecoder_ConfigRaw (
     }
   }
 
+  FDKmemMeterStop();
+
   return err;
 }
 
 
 
+static INT aacDecoder_SbrCallback(
+        void *                  handle,
+        HANDLE_FDK_BITSTREAM    hBs,
+        const INT sampleRateIn,
+        const INT sampleRateOut,
+        const INT samplesPerFrame,
+        const AUDIO_OBJECT_TYPE coreCodec,
+        const MP4_ELEMENT_ID    elementID,
+        const INT               elementIndex
+        )
+{
+  HANDLE_AACDECODER self = (HANDLE_AACDECODER)handle;
+  INT sbrError;
+
+  /* Explicitly signaled SBR, open the SBR decoder now */
+  sbrError = CAacDecoder_OpenSbr(self);
+  if (sbrError == SBRDEC_OK) {
+    sbrError = sbrDecoder_Header(self->hSbrDecoder, hBs, sampleRateIn, sampleRateOut,
+                                 samplesPerFrame, coreCodec, elementID, elementIndex);
+  }
+
+  return sbrError;
+}
+
 static INT aacDecoder_ConfigCallback(void *handle, const CSAudioSpecificConfig *pAscStruct)
 {
   HANDLE_AACDECODER self = (HANDLE_AACDECODER)handle;
@@ -641,10 +670,14 @@ LINKSPEC_CPP HANDLE_AACDECODER aacDecoder_Open(TRANSPORT_TYPE transportFmt, UINT
   AAC_DECODER_INSTANCE *aacDec = NULL;
   HANDLE_TRANSPORTDEC pIn;
   int err = 0;
+  UINT memUsage = 0;
+
+  FDKmemMeterStart(&memUsage);
 
   /* Allocate transport layer struct. */
   pIn = transportDec_Open(transportFmt, TP_FLAG_MPEG4);
   if (pIn == NULL) {
+    FDKmemMeterStop();
     return NULL;
   }
 
@@ -666,13 +699,9 @@ LINKSPEC_CPP HANDLE_AACDECODER aacDecoder_Open(TRANSPORT_TYPE transportFmt, UINT
   /* Register Config Update callback. */
   transportDec_RegisterAscCallback(pIn, aacDecoder_ConfigCallback, (void*)aacDec);
 
-  /* open SBR decoder */
-  if ( SBRDEC_OK != sbrDecoder_Open ( &aacDec->hSbrDecoder )) {
-    err = -1;
-    goto bail;
-  }
+  /* The SBR decoder is opened by CAacDecoder_OpenSbr() once SBR is found in the stream */
   aacDec->qmfModeUser = NOT_DEFINED;
-  transportDec_RegisterSbrCallback(aacDec->hInput, (cbSbr_t)sbrDecoder_Header, (void*)aacDec->hSbrDecoder);
+  transportDec_RegisterSbrCallback(aacDec->hInput, aacDecoder_SbrCallback, (void*)aacDec);
 
 
   pcmDmx_Open( &aacDec->hPcmUtils );
@@ -698,10 +727,14 @@ LINKSPEC_CPP HANDLE_AACDECODER aacDecoder_Open(TRANSPORT_TYPE transportFmt, UINT
   }
 
 bail:
+  FDKmemMeterStop();
   if (err == -1) {
     aacDecoder_Close(aacDec);
     aacDec = NULL;
   }
+  else if (aacDec != NULL) {
+    aacDec->memUsage = memUsage;
+  }
   return aacDec;
 }
 
@@ -797,6 +830,10 @@ LINKSPEC_CPP AAC_DECODER_ERROR aacDecoder_DecodeFrame(
     if (self == NULL) {
       return AAC_DEC_INVALID_HANDLE;
     }
+
+    /* Channels and SBR are allocated as the stream reveals them */
+    FDKmemMeterStart(&self->memUsage);
+
     INT interleaved = self->outputInterleaved;
     INT_PCM *pTimeData = self->pcmOutputBuffer;
     INT timeDataSize = sizeof(self->pcmOutputBuffer)/sizeof(*self->pcmOutputBuffer);
@@ -1048,6 +1085,7 @@ LINKSPEC_CPP AAC_DECODER_ERROR aacDecoder_DecodeFrame(
     self->streamInfo.flags = self->flags;
 
 bail:
+    FDKmemMeterStop();
 
     /* Update Statistics */
     aacDecoder_UpdateBitStreamCounters(&self->streamInfo, hBs, nBits, ErrorStatus);
@@ -1101,6 +1139,15 @@ LINKSPEC_CPP CStreamInfo* aacDecoder_GetStreamInfo ( HANDLE_AACDECODER self )
   return CAacDecoder_GetStreamInfo(self);
 }
 
+LINKSPEC_CPP UINT aacDecoder_GetMemUsage ( HANDLE_AACDECODER self )
+{
+  if (self == NULL) {
+    return 0;
+  }
+
+  return self->memUsage;
+}
+
 LINKSPEC_CPP INT aacDecoder_GetLibInfo ( LIB_INFO *info )
 {
   int i;
@@ -1055,6 +1055,9 @@ typedef enum
                                                   when a configuration parameter changed or an error occured. This paramerter allows
                                                   overwriting or getting the control status of this process. See ::AACENC_CTRLFLAGS. */
 
+  AACENC_MEM_USAGE                = 0xFF01,  /*!< Heap memory held by the encoder instance in bytes, read only. It depends on the
+                                                  encModules and maxChannels given to aacEncOpen(), not on the configuration. */
+
   AACENC_NONE                     = 0xFFFF   /*!< ------ */
 
 } AACENC_PARAM;
@@ -235,6 +235,7 @@ struct AACENCODER
    UINT                      nMaxSubFrames;
 
    UINT                      encoder_modis;
+   UINT                      memUsage;          /* Heap memory allocated by aacEncOpen(), in bytes */
 
    /* Capability flags */
    UINT                      CAPF_tpEnc;
@@ -1215,12 +1216,16 @@ AACENC_ERROR aacEncOpen(
 {
     AACENC_ERROR err = AACENC_OK;
     HANDLE_AACENCODER  hAacEncoder = NULL;
+    UINT memUsage = 0;
 
     if (phAacEncoder == NULL) {
         err = AACENC_INVALID_HANDLE;
         goto bail;
     }
 
+    /* Everything the instance needs is allocated from here on */
+    FDKmemMeterStart(&memUsage);
+
     /* allocate memory */
     hAacEncoder = Get_AacEncoder();
 
@@ -1344,12 +1349,16 @@ AACENC_ERROR aacEncOpen(
     /* All encoder modules have to be initialized */
     hAacEncoder->InitFlags = AACENC_INIT_ALL;
 
+    FDKmemMeterStop();
+    hAacEncoder->memUsage = memUsage;
+
     /* Return encoder instance */
     *phAacEncoder = hAacEncoder;
 
     return err;
 
 bail:
+    FDKmemMeterStop();
     aacEncClose(&hAacEncoder);
 
     return err;
@@ -2102,6 +2111,9 @@ UINT aacEncoder_GetParam(
           value = (UINT)(fMax((INT)hAacEncoder->extParam.userPeakBitrate, hAacEncoder->aacConfig.bitRate)); /* peak bitrate parameter is in use */
         }
         break;
+    case AACENC_MEM_USAGE:
+        value = hAacEncoder->memUsage;
+        break;
     default:
       //err = MPS_INVALID_PARAMETER;
       break;
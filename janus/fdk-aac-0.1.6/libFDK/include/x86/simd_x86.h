@@ -0,0 +1,223 @@
+
+/* -----------------------------------------------------------------------------------------------------------
+Software License for The Fraunhofer FDK AAC Codec Library for Android
+
+ Copyright  1995 - 2013 Fraunhofer-Gesellschaft zur Frderung der angewandten Forschung e.V.
+  All rights reserved.
+
+ 1.    INTRODUCTION
+The Fraunhofer FDK AAC Codec Library for Android ("FDK AAC Codec") is software that implements
+the MPEG Advanced Audio Coding ("AAC") encoding and decoding scheme for digital audio.
+This FDK AAC Codec software is intended to be used on a wide variety of Android devices.
+
+AAC's HE-AAC and HE-AAC v2 versions are regarded as today's most efficient general perceptual
+audio codecs. AAC-ELD is considered the best-performing full-bandwidth communications codec by
+independent studies and is widely deployed. AAC has been standardized by ISO and IEC as part
+of the MPEG specifications.
+
+Patent licenses for necessary patent claims for the FDK AAC Codec (including those of Fraunhofer)
+may be obtained through Via Licensing (www.vialicensing.com) or through the respective patent owners
+individually for the purpose of encoding or decoding bit streams in products that are compliant with
+the ISO/IEC MPEG audio standards. Please note that most manufacturers of Android devices already license
+these patent claims through Via Licensing or directly from the patent owners, and therefore FDK AAC Codec
+software may already be covered under those patent licenses when it is used for those licensed purposes only.
+
+Commercially-licensed AAC software libraries, including floating-point versions with enhanced sound quality,
+are also available from Fraunhofer. Users are encouraged to check the Fraunhofer website for additional
+applications information and documentation.
+
+2.    COPYRIGHT LICENSE
+
+Redistribution and use in source and binary forms, with or without modification, are permitted without
+payment of copyright license fees provided that you satisfy the following conditions:
+
+You must retain the complete text of this software license in redistributions of the FDK AAC Codec or
+your modifications thereto in source code form.
+
+You must retain the complete text of this software license in the documentation and/or other materials
+provided with redistributions of the FDK AAC Codec or your modifications thereto in binary form.
+You must make available free of charge copies of the complete source code of the FDK AAC Codec and your
+modifications thereto to recipients of copies in binary form.
+
+The name of Fraunhofer may not be used to endorse or promote products derived from this library without
+prior written permission.
+
+You may not charge copyright license fees for anyone to use, copy or distribute the FDK AAC Codec
+software or your modifications thereto.
+
+Your modified versions of the FDK AAC Codec must carry prominent notices stating that you changed the software
+and the date of any change. For modified versions of the FDK AAC Codec, the term
+"Fraunhofer FDK AAC Codec Library for Android" must be replaced by the term
+"Third-Party Modified Version of the Fraunhofer FDK AAC Codec Library for Android."
+
+3.    NO PATENT LICENSE
+
+NO EXPRESS OR IMPLIED LICENSES TO ANY PATENT CLAIMS, including without limitation the patents of Fraunhofer,
+ARE GRANTED BY THIS SOFTWARE LICENSE. Fraunhofer provides no warranty of patent non-infringement with
+respect to this software.
+
+You may use this FDK AAC Codec software or modifications thereto only for purposes that are authorized
+by appropriate patent licenses.
+
+4.    DISCLAIMER
+
+This FDK AAC Codec software is provided by Fraunhofer on behalf of the copyright holders and contributors
+"AS IS" and WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, including but not limited to the implied warranties
+of merchantability and fitness for a particular purpose. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE for any direct, indirect, incidental, special, exemplary, or consequential damages,
+including but not limited to procurement of substitute goods or services; loss of use, data, or profits,
+or business interruption, however caused and on any theory of liability, whether in contract, strict
+liability, or tort (including negligence), arising in any way out of the use of this software, even if
+advised of the possibility of such damage.
+
+5.    CONTACT INFORMATION
+
+Fraunhofer Institute for Integrated Circuits IIS
+Attention: Audio and Multimedia Departments - FDK AAC LL
+Am Wolfsmantel 33
+91058 Erlangen, Germany
+
+www.iis.fraunhofer.de/amm
+amm-info@iis.fraunhofer.de
+----------------------------------------------------------------------------------------------------------- */
+
+/***************************  Fraunhofer IIS FDK Tools  **********************
+
+   Author(s):
+   Description: SSE4.1 and AVX2 helpers for the x86 kernels
+
+******************************************************************************/
+
+#ifndef SIMD_X86_H
+#define SIMD_X86_H
+
+#include "FDK_simd.h"
+
+#if defined(FDK_X86_SIMD)
+
+#include <immintrin.h>
+
+#define FDK_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define FDK_TARGET_AVX2  __attribute__((target("avx2")))
+
+#define SIMD_INLINE static inline __attribute__((always_inline))
+
+/*
+   Complex FIXP_DBL values are kept in their natural layout, one in each 64 bit
+   slot: real part in the low 32 bits, imaginary part in the high ones. The
+   multiplications work on the low 32 bits of each slot, like _mm_mul_epi32()
+   does, and leave their result there: as fMultDiv2() of a 32 and a 16 bit
+   value is the upper half of the 64 bit product of a and b<<16, this is
+   bit-exact with the C code. Twiddles are FIXP_SPK words, again one per slot,
+   and are turned into b<<16 by twRe() and twIm().
+*/
+
+/* SSE4.1: 2 complex values per vector */
+
+SIMD_INLINE FDK_TARGET_SSE41 __m128i mulDiv2_x2(__m128i a, __m128i b)
+{
+  return _mm_srli_epi64(_mm_mul_epi32(a, b), 32);
+}
+
+SIMD_INLINE FDK_TARGET_SSE41 __m128i hi_x2(__m128i a)
+{
+  return _mm_srli_epi64(a, 32);
+}
+
+SIMD_INLINE FDK_TARGET_SSE41 __m128i pack_x2(__m128i re, __m128i im)
+{
+  return _mm_blend_epi16(re, _mm_slli_epi64(im, 32), 0xCC);
+}
+
+SIMD_INLINE FDK_TARGET_SSE41 __m128i neg_x2(__m128i a)
+{
+  return _mm_sub_epi32(_mm_setzero_si128(), a);
+}
+
+/* Swap the two slots */
+SIMD_INLINE FDK_TARGET_SSE41 __m128i rev_x2(__m128i a)
+{
+  return _mm_shuffle_epi32(a, _MM_SHUFFLE(1,0,3,2));
+}
+
+SIMD_INLINE FDK_TARGET_SSE41 __m128i twRe_x2(__m128i w)
+{
+  return _mm_slli_epi64(w, 16);
+}
+
+SIMD_INLINE FDK_TARGET_SSE41 __m128i twIm_x2(__m128i w)
+{
+  return _mm_and_si128(w, _mm_set1_epi64x(0xFFFF0000));
+}
+
+SIMD_INLINE FDK_TARGET_SSE41 __m128i twGather_x2(const FIXP_SPK *w, INT i0, INT i1)
+{
+  return _mm_set_epi64x(w[i1].w, w[i0].w);
+}
+
+SIMD_INLINE FDK_TARGET_SSE41 __m128i load_x2(const FIXP_DBL *p)
+{
+  return _mm_loadu_si128((const __m128i *)p);
+}
+
+SIMD_INLINE FDK_TARGET_SSE41 void store_x2(FIXP_DBL *p, __m128i a)
+{
+  _mm_storeu_si128((__m128i *)p, a);
+}
+
+/* AVX2: 4 complex values per vector */
+
+SIMD_INLINE FDK_TARGET_AVX2 __m256i mulDiv2_x4(__m256i a, __m256i b)
+{
+  return _mm256_srli_epi64(_mm256_mul_epi32(a, b), 32);
+}
+
+SIMD_INLINE FDK_TARGET_AVX2 __m256i hi_x4(__m256i a)
+{
+  return _mm256_srli_epi64(a, 32);
+}
+
+SIMD_INLINE FDK_TARGET_AVX2 __m256i pack_x4(__m256i re, __m256i im)
+{
+  return _mm256_blend_epi32(re, _mm256_slli_epi64(im, 32), 0xAA);
+}
+
+SIMD_INLINE FDK_TARGET_AVX2 __m256i neg_x4(__m256i a)
+{
+  return _mm256_sub_epi32(_mm256_setzero_si256(), a);
+}
+
+/* Reverse the order of the four slots */
+SIMD_INLINE FDK_TARGET_AVX2 __m256i rev_x4(__m256i a)
+{
+  return _mm256_permute4x64_epi64(a, _MM_SHUFFLE(0,1,2,3));
+}
+
+SIMD_INLINE FDK_TARGET_AVX2 __m256i twRe_x4(__m256i w)
+{
+  return _mm256_slli_epi64(w, 16);
+}
+
+SIMD_INLINE FDK_TARGET_AVX2 __m256i twIm_x4(__m256i w)
+{
+  return _mm256_and_si256(w, _mm256_set1_epi64x(0xFFFF0000));
+}
+
+SIMD_INLINE FDK_TARGET_AVX2 __m256i twGather_x4(const FIXP_SPK *w, INT i0, INT i1, INT i2, INT i3)
+{
+  return _mm256_set_epi64x(w[i3].w, w[i2].w, w[i1].w, w[i0].w);
+}
+
+SIMD_INLINE FDK_TARGET_AVX2 __m256i load_x4(const FIXP_DBL *p)
+{
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+
+SIMD_INLINE FDK_TARGET_AVX2 void store_x4(FIXP_DBL *p, __m256i a)
+{
+  _mm256_storeu_si256((__m256i *)p, a);
+}
+
+#endif /* defined(FDK_X86_SIMD) */
+
+#endif /* SIMD_X86_H */
@@ -0,0 +1,318 @@
+
+/* -----------------------------------------------------------------------------------------------------------
+Software License for The Fraunhofer FDK AAC Codec Library for Android
+
+ Copyright  1995 - 2013 Fraunhofer-Gesellschaft zur Frderung der angewandten Forschung e.V.
+  All rights reserved.
+
+ 1.    INTRODUCTION
+The Fraunhofer FDK AAC Codec Library for Android ("FDK AAC Codec") is software that implements
+the MPEG Advanced Audio Coding ("AAC") encoding and decoding scheme for digital audio.
+This FDK AAC Codec software is intended to be used on a wide variety of Android devices.
+
+AAC's HE-AAC and HE-AAC v2 versions are regarded as today's most efficient general perceptual
+audio codecs. AAC-ELD is considered the best-performing full-bandwidth communications codec by
+independent studies and is widely deployed. AAC has been standardized by ISO and IEC as part
+of the MPEG specifications.
+
+Patent licenses for necessary patent claims for the FDK AAC Codec (including those of Fraunhofer)
+may be obtained through Via Licensing (www.vialicensing.com) or through the respective patent owners
+individually for the purpose of encoding or decoding bit streams in products that are compliant with
+the ISO/IEC MPEG audio standards. Please note that most manufacturers of Android devices already license
+these patent claims through Via Licensing or directly from the patent owners, and therefore FDK AAC Codec
+software may already be covered under those patent licenses when it is used for those licensed purposes only.
+
+Commercially-licensed AAC software libraries, including floating-point versions with enhanced sound quality,
+are also available from Fraunhofer. Users are encouraged to check the Fraunhofer website for additional
+applications information and documentation.
+
+2.    COPYRIGHT LICENSE
+
+Redistribution and use in source and binary forms, with or without modification, are permitted without
+payment of copyright license fees provided that you satisfy the following conditions:
+
+You must retain the complete text of this software license in redistributions of the FDK AAC Codec or
+your modifications thereto in source code form.
+
+You must retain the complete text of this software license in the documentation and/or other materials
+provided with redistributions of the FDK AAC Codec or your modifications thereto in binary form.
+You must make available free of charge copies of the complete source code of the FDK AAC Codec and your
+modifications thereto to recipients of copies in binary form.
+
+The name of Fraunhofer may not be used to endorse or promote products derived from this library without
+prior written permission.
+
+You may not charge copyright license fees for anyone to use, copy or distribute the FDK AAC Codec
+software or your modifications thereto.
+
+Your modified versions of the FDK AAC Codec must carry prominent notices stating that you changed the software
+and the date of any change. For modified versions of the FDK AAC Codec, the term
+"Fraunhofer FDK AAC Codec Library for Android" must be replaced by the term
+"Third-Party Modified Version of the Fraunhofer FDK AAC Codec Library for Android."
+
+3.    NO PATENT LICENSE
+
+NO EXPRESS OR IMPLIED LICENSES TO ANY PATENT CLAIMS, including without limitation the patents of Fraunhofer,
+ARE GRANTED BY THIS SOFTWARE LICENSE. Fraunhofer provides no warranty of patent non-infringement with
+respect to this software.
+
+You may use this FDK AAC Codec software or modifications thereto only for purposes that are authorized
+by appropriate patent licenses.
+
+4.    DISCLAIMER
+
+This FDK AAC Codec software is provided by Fraunhofer on behalf of the copyright holders and contributors
+"AS IS" and WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, including but not limited to the implied warranties
+of merchantability and fitness for a particular purpose. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE for any direct, indirect, incidental, special, exemplary, or consequential damages,
+including but not limited to procurement of substitute goods or services; loss of use, data, or profits,
+or business interruption, however caused and on any theory of liability, whether in contract, strict
+liability, or tort (including negligence), arising in any way out of the use of this software, even if
+advised of the possibility of such damage.
+
+5.    CONTACT INFORMATION
+
+Fraunhofer Institute for Integrated Circuits IIS
+Attention: Audio and Multimedia Departments - FDK AAC LL
+Am Wolfsmantel 33
+91058 Erlangen, Germany
+
+www.iis.fraunhofer.de/amm
+amm-info@iis.fraunhofer.de
+----------------------------------------------------------------------------------------------------------- */
+
+/***************************  Fraunhofer IIS FDK Tools  **********************
+
+   Author(s):
+   Description: runtime selection of the x86 SIMD kernels, vector scaling
+
+******************************************************************************/
+
+#include "FDK_simd.h"
+
+#if defined(FDK_X86_SIMD)
+
+#include <stdlib.h>
+
+#include "x86/simd_x86.h"
+#include "fixminmax.h"
+
+/* Detected once, the race between threads doing it at the same time is harmless */
+static INT simdLevel = -1;
+
+FDK_SIMD_LEVEL FDK_getSimdLevel(void)
+{
+  if (simdLevel < 0) {
+    INT level = FDK_SIMD_NONE;
+    const char *env = getenv("FDK_AAC_SIMD");
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      level = FDK_SIMD_AVX2;
+    else if (__builtin_cpu_supports("sse4.1"))
+      level = FDK_SIMD_SSE41;
+
+    if (env != NULL) {
+      if (FDKstrcmp(env, "none") == 0)
+        level = FDK_SIMD_NONE;
+      else if (FDKstrcmp(env, "sse4.1") == 0)
+        level = fixmin_I(level, (INT)FDK_SIMD_SSE41);
+    }
+    simdLevel = level;
+  }
+
+  return (FDK_SIMD_LEVEL)simdLevel;
+}
+
+FDK_TARGET_SSE41
+static void scaleValues_sse41(FIXP_DBL *dst, const FIXP_DBL *src, INT len, INT scalefactor)
+{
+  INT i = 0;
+
+  if (scalefactor > 0) {
+    scalefactor = fixmin_I(scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(scalefactor);
+    for (; i+4 <= len; i+=4)
+      _mm_storeu_si128((__m128i *)&dst[i], _mm_sll_epi32(_mm_loadu_si128((const __m128i *)&src[i]), shift));
+    for (; i<len; i++)
+      dst[i] = src[i] << scalefactor;
+  } else {
+    INT negScalefactor = fixmin_I(-scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(negScalefactor);
+    for (; i+4 <= len; i+=4)
+      _mm_storeu_si128((__m128i *)&dst[i], _mm_sra_epi32(_mm_loadu_si128((const __m128i *)&src[i]), shift));
+    for (; i<len; i++)
+      dst[i] = src[i] >> negScalefactor;
+  }
+}
+
+FDK_TARGET_AVX2
+static void scaleValues_avx2(FIXP_DBL *dst, const FIXP_DBL *src, INT len, INT scalefactor)
+{
+  INT i = 0;
+
+  if (scalefactor > 0) {
+    scalefactor = fixmin_I(scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(scalefactor);
+    for (; i+8 <= len; i+=8)
+      _mm256_storeu_si256((__m256i *)&dst[i], _mm256_sll_epi32(_mm256_loadu_si256((const __m256i *)&src[i]), shift));
+    for (; i<len; i++)
+      dst[i] = src[i] << scalefactor;
+  } else {
+    INT negScalefactor = fixmin_I(-scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(negScalefactor);
+    for (; i+8 <= len; i+=8)
+      _mm256_storeu_si256((__m256i *)&dst[i], _mm256_sra_epi32(_mm256_loadu_si256((const __m256i *)&src[i]), shift));
+    for (; i<len; i++)
+      dst[i] = src[i] >> negScalefactor;
+  }
+}
+
+void FDK_x86_scaleValues(FIXP_DBL *dst, const FIXP_DBL *src, INT len, INT scalefactor)
+{
+  if (FDK_getSimdLevel() == FDK_SIMD_AVX2)
+    scaleValues_avx2(dst, src, len, scalefactor);
+  else
+    scaleValues_sse41(dst, src, len, scalefactor);
+}
+
+/* 16 bit values: shifts by 16 or more give 0 (or the sign), as the C code does
+   once its int result is truncated */
+FDK_TARGET_SSE41
+static void scaleValuesSGL_sse41(FIXP_SGL *vector, INT len, INT scalefactor)
+{
+  INT i = 0;
+
+  if (scalefactor > 0) {
+    scalefactor = fixmin_I(scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(scalefactor);
+    for (; i+8 <= len; i+=8)
+      _mm_storeu_si128((__m128i *)&vector[i], _mm_sll_epi16(_mm_loadu_si128((const __m128i *)&vector[i]), shift));
+    for (; i<len; i++)
+      vector[i] <<= scalefactor;
+  } else {
+    INT negScalefactor = fixmin_I(-scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(negScalefactor);
+    for (; i+8 <= len; i+=8)
+      _mm_storeu_si128((__m128i *)&vector[i], _mm_sra_epi16(_mm_loadu_si128((const __m128i *)&vector[i]), shift));
+    for (; i<len; i++)
+      vector[i] >>= negScalefactor;
+  }
+}
+
+FDK_TARGET_AVX2
+static void scaleValuesSGL_avx2(FIXP_SGL *vector, INT len, INT scalefactor)
+{
+  INT i = 0;
+
+  if (scalefactor > 0) {
+    scalefactor = fixmin_I(scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(scalefactor);
+    for (; i+16 <= len; i+=16)
+      _mm256_storeu_si256((__m256i *)&vector[i], _mm256_sll_epi16(_mm256_loadu_si256((const __m256i *)&vector[i]), shift));
+    for (; i<len; i++)
+      vector[i] <<= scalefactor;
+  } else {
+    INT negScalefactor = fixmin_I(-scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(negScalefactor);
+    for (; i+16 <= len; i+=16)
+      _mm256_storeu_si256((__m256i *)&vector[i], _mm256_sra_epi16(_mm256_loadu_si256((const __m256i *)&vector[i]), shift));
+    for (; i<len; i++)
+      vector[i] >>= negScalefactor;
+  }
+}
+
+void FDK_x86_scaleValues(FIXP_SGL *vector, INT len, INT scalefactor)
+{
+  if (FDK_getSimdLevel() == FDK_SIMD_AVX2)
+    scaleValuesSGL_avx2(vector, len, scalefactor);
+  else
+    scaleValuesSGL_sse41(vector, len, scalefactor);
+}
+
+/* fMultDiv2() of 4 (8) values: upper halves of the 64 bit products of the even
+   and of the odd lanes */
+FDK_TARGET_SSE41
+static inline __m128i fMultDiv2_sse41(__m128i a, __m128i b)
+{
+  __m128i even = _mm_srli_epi64(_mm_mul_epi32(a, b), 32);
+  __m128i odd  = _mm_mul_epi32(_mm_srli_epi64(a, 32), b);
+  return _mm_blend_epi16(even, odd, 0xCC);
+}
+
+FDK_TARGET_AVX2
+static inline __m256i fMultDiv2_avx2(__m256i a, __m256i b)
+{
+  __m256i even = _mm256_srli_epi64(_mm256_mul_epi32(a, b), 32);
+  __m256i odd  = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), b);
+  return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+FDK_TARGET_SSE41
+static void scaleValuesWithFactor_sse41(FIXP_DBL *vector, FIXP_DBL factor, INT len, INT scalefactor)
+{
+  __m128i f = _mm_set1_epi32(factor);
+  INT i = 0;
+
+  /* Compensate fMultDiv2 */
+  scalefactor++;
+
+  if (scalefactor > 0) {
+    scalefactor = fixmin_I(scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(scalefactor);
+    for (; i+4 <= len; i+=4)
+      _mm_storeu_si128((__m128i *)&vector[i], _mm_sll_epi32(fMultDiv2_sse41(_mm_loadu_si128((const __m128i *)&vector[i]), f), shift));
+    for (; i<len; i++)
+      vector[i] = fMultDiv2(vector[i], factor) << scalefactor;
+  } else {
+    INT negScalefactor = fixmin_I(-scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(negScalefactor);
+    for (; i+4 <= len; i+=4)
+      _mm_storeu_si128((__m128i *)&vector[i], _mm_sra_epi32(fMultDiv2_sse41(_mm_loadu_si128((const __m128i *)&vector[i]), f), shift));
+    for (; i<len; i++)
+      vector[i] = fMultDiv2(vector[i], factor) >> negScalefactor;
+  }
+}
+
+FDK_TARGET_AVX2
+static void scaleValuesWithFactor_avx2(FIXP_DBL *vector, FIXP_DBL factor, INT len, INT scalefactor)
+{
+  __m256i f = _mm256_set1_epi32(factor);
+  INT i = 0;
+
+  /* Compensate fMultDiv2 */
+  scalefactor++;
+
+  if (scalefactor > 0) {
+    scalefactor = fixmin_I(scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(scalefactor);
+    for (; i+8 <= len; i+=8)
+      _mm256_storeu_si256((__m256i *)&vector[i], _mm256_sll_epi32(fMultDiv2_avx2(_mm256_loadu_si256((const __m256i *)&vector[i]), f), shift));
+    for (; i<len; i++)
+      vector[i] = fMultDiv2(vector[i], factor) << scalefactor;
+  } else {
+    INT negScalefactor = fixmin_I(-scalefactor, (INT)DFRACT_BITS-1);
+    __m128i shift = _mm_cvtsi32_si128(negScalefactor);
+    for (; i+8 <= len; i+=8)
+      _mm256_storeu_si256((__m256i *)&vector[i], _mm256_sra_epi32(fMultDiv2_avx2(_mm256_loadu_si256((const __m256i *)&vector[i]), f), shift));
+    for (; i<len; i++)
+      vector[i] = fMultDiv2(vector[i], factor) >> negScalefactor;
+  }
+}
+
+void FDK_x86_scaleValuesWithFactor(FIXP_DBL *vector, FIXP_DBL factor, INT len, INT scalefactor)
+{
+  if (FDK_getSimdLevel() == FDK_SIMD_AVX2)
+    scaleValuesWithFactor_avx2(vector, factor, len, scalefactor);
+  else
+    scaleValuesWithFactor_sse41(vector, factor, len, scalefactor);
+}
+
+#else
+
+FDK_SIMD_LEVEL FDK_getSimdLevel(void)
+{
+  return FDK_SIMD_NONE;
+}
+
+#endif /* defined(FDK_X86_SIMD) */
@@ -106,6 +106,8 @@ amm-info@iis.fraunhofer.de
 
 #if defined(__arm__)
 #include "arm/dct_arm.cpp"
+#elif defined(__x86__)
+#include "x86/dct_x86.cpp"
 #endif
 
 
@@ -321,6 +323,11 @@ void dct_IV(FIXP_DBL *pDat,
     dct_IV_func1(M>>2, twiddle,  &pDat[0], &pDat[L-1]);
   } else
 #endif /* FUNCTION_dct_IV_func1 */
+#ifdef FUNCTION_dct_IV_x86_func1
+  if ((M&1) == 0 && FDK_getSimdLevel() != FDK_SIMD_NONE) {
+    dct_IV_x86_func1(pDat, L, twiddle, 0);
+  } else
+#endif /* FUNCTION_dct_IV_x86_func1 */
   {
     FIXP_DBL *RESTRICT pDat_0 = &pDat[0];
     FIXP_DBL *RESTRICT pDat_1 = &pDat[L - 2];
@@ -360,6 +367,11 @@ void dct_IV(FIXP_DBL *pDat,
     dct_IV_func2(M>>2, sin_twiddle, &pDat[0], &pDat[L], sin_step);
   } else
 #endif /* FUNCTION_dct_IV_func2 */
+#ifdef FUNCTION_dct_IV_x86_func2
+  if (M>=4 && (M&1) == 0 && FDK_getSimdLevel() != FDK_SIMD_NONE) {
+    dct_IV_x86_func2(pDat, L, sin_twiddle, sin_step, 0);
+  } else
+#endif /* FUNCTION_dct_IV_x86_func2 */
   {
     FIXP_DBL *RESTRICT pDat_0 = &pDat[0];
     FIXP_DBL *RESTRICT pDat_1 = &pDat[L - 2];
@@ -446,6 +458,11 @@ void dst_IV(FIXP_DBL *pDat,
     dst_IV_func1(M, twiddle, &pDat[0], &pDat[L]);
   } else
 #endif
+#ifdef FUNCTION_dct_IV_x86_func1
+  if ((M&1) == 0 && FDK_getSimdLevel() != FDK_SIMD_NONE) {
+    dct_IV_x86_func1(pDat, L, twiddle, 1);
+  } else
+#endif /* FUNCTION_dct_IV_x86_func1 */
   {
     FIXP_DBL *RESTRICT pDat_0 = &pDat[0];
     FIXP_DBL *RESTRICT pDat_1 = &pDat[L - 2];
@@ -485,6 +502,11 @@ void dst_IV(FIXP_DBL *pDat,
     dst_IV_func2(M>>2, sin_twiddle + sin_step, &pDat[0], &pDat[L - 1], sin_step);
   } else
 #endif /* FUNCTION_dst_IV_func2 */
+#ifdef FUNCTION_dct_IV_x86_func2
+  if (M>=4 && (M&1) == 0 && FDK_getSimdLevel() != FDK_SIMD_NONE) {
+    dct_IV_x86_func2(pDat, L, sin_twiddle, sin_step, 1);
+  } else
+#endif /* FUNCTION_dct_IV_x86_func2 */
   {
     FIXP_DBL *RESTRICT pDat_0;
     FIXP_DBL *RESTRICT pDat_1;
@@ -100,6 +100,9 @@ amm-info@iis.fraunhofer.de
 #elif defined(__GNUC__) && defined(__mips__) && defined(__mips_dsp)	/* cppp replaced: elif */
 #include "mips/fft_rad2_mips.cpp"
 
+#elif defined(__x86__)
+#include "x86/fft_rad2_x86.cpp"
+
 #endif
 
 
@@ -203,7 +206,12 @@ void dit_fft(FIXP_DBL *x, const INT ldn, const FIXP_STP *trigdata, const INT tri
                 x[t2+1] = ui+vi;
             }
         }
-        for(j=1; j<mh/4; ++j)
+        j = 1;
+#ifdef FUNCTION_dit_fft_x86
+        /* Vectorized butterflies first, the loop below does what they left (if anything) */
+        j = dit_fft_x86_stage(x, n, mh, trigdata, trigstep);
+#endif
+        for(; j<mh/4; ++j)
         {
             FIXP_STP cs;
 
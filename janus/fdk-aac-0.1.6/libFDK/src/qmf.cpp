@@ -136,6 +136,9 @@ amm-info@iis.fraunhofer.de
 #if defined(__arm__)
 #include "arm/qmf_arm.cpp"
 
+#elif defined(__x86__)
+#include "x86/qmf_x86.cpp"
+
 #endif
 
 /*!
@@ -327,6 +330,13 @@ void qmfAnaPrototypeFirSlot( FIXP_QMF *analysisBuffer,
     int staStep1 = no_channels<<1;
     int staStep2 = (no_channels<<3) - 1; /* Rewind one less */
 
+#ifdef FUNCTION_qmfAnaPrototypeFirSlot_x86
+    if (FDK_getSimdLevel() != FDK_SIMD_NONE) {
+      qmfAnaPrototypeFirSlot_x86(analysisBuffer, no_channels, p_filter, p_stride, pFilterStates);
+      return;
+    }
+#endif
+
     /* FIR filter 0 */
     accu =   fMultDiv2( p_flt[0], *sta_1);  sta_1 -= staStep1;
     accu +=  fMultDiv2( p_flt[1], *sta_1);  sta_1 -= staStep1;
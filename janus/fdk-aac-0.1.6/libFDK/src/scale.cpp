@@ -105,6 +105,9 @@ amm-info@iis.fraunhofer.de
 #elif defined(__arm__)
 #include "arm/scale_arm.cpp"
 
+#elif defined(__x86__)
+#include "FDK_simd.h"
+
 #endif
 
 #ifndef FUNCTION_scaleValues_SGL
@@ -127,6 +130,13 @@ void scaleValues(FIXP_SGL *vector,  /*!< Vector */
   /* Return if scalefactor is Zero */
   if (scalefactor==0) return;
 
+#ifdef FDK_X86_SIMD
+  if (len >= 16 && FDK_getSimdLevel() != FDK_SIMD_NONE) {
+    FDK_x86_scaleValues(vector, len, scalefactor);
+    return;
+  }
+#endif
+
   if(scalefactor > 0){
     scalefactor = fixmin_I(scalefactor,(INT)(DFRACT_BITS-1));
     for (i = len&3; i--; )
@@ -177,6 +187,13 @@ void scaleValues(FIXP_DBL *vector,    /*!< Vector */
   /* Return if scalefactor is Zero */
   if (scalefactor==0) return;
 
+#ifdef FDK_X86_SIMD
+  if (len >= 16 && FDK_getSimdLevel() != FDK_SIMD_NONE) {
+    FDK_x86_scaleValues(vector, vector, len, scalefactor);
+    return;
+  }
+#endif
+
   if(scalefactor > 0){
     scalefactor = fixmin_I(scalefactor,(INT)DFRACT_BITS-1);
     for (i = len&3; i--; )
@@ -234,6 +251,11 @@ void scaleValues(FIXP_DBL *dst,       /*!< dst Vector */
 	if (dst != src)
       FDKmemmove(dst, src, len*sizeof(FIXP_DBL));
   }
+#ifdef FDK_X86_SIMD
+  else if (len >= 16 && FDK_getSimdLevel() != FDK_SIMD_NONE) {
+    FDK_x86_scaleValues(dst, src, len, scalefactor);
+  }
+#endif
   else {
 
     if(scalefactor > 0){
@@ -286,6 +308,13 @@ void scaleValuesWithFactor(
 {
   INT i;
 
+#ifdef FDK_X86_SIMD
+  if (len >= 16 && FDK_getSimdLevel() != FDK_SIMD_NONE) {
+    FDK_x86_scaleValuesWithFactor(vector, factor, len, scalefactor);
+    return;
+  }
+#endif
+
   /* Compensate fMultDiv2 */
   scalefactor++;
 
@@ -0,0 +1,342 @@
+
+/* -----------------------------------------------------------------------------------------------------------
+Software License for The Fraunhofer FDK AAC Codec Library for Android
+
+ Copyright  1995 - 2013 Fraunhofer-Gesellschaft zur Frderung der angewandten Forschung e.V.
+  All rights reserved.
+
+ 1.    INTRODUCTION
+The Fraunhofer FDK AAC Codec Library for Android ("FDK AAC Codec") is software that implements
+the MPEG Advanced Audio Coding ("AAC") encoding and decoding scheme for digital audio.
+This FDK AAC Codec software is intended to be used on a wide variety of Android devices.
+
+AAC's HE-AAC and HE-AAC v2 versions are regarded as today's most efficient general perceptual
+audio codecs. AAC-ELD is considered the best-performing full-bandwidth communications codec by
+independent studies and is widely deployed. AAC has been standardized by ISO and IEC as part
+of the MPEG specifications.
+
+Patent licenses for necessary patent claims for the FDK AAC Codec (including those of Fraunhofer)
+may be obtained through Via Licensing (www.vialicensing.com) or through the respective patent owners
+individually for the purpose of encoding or decoding bit streams in products that are compliant with
+the ISO/IEC MPEG audio standards. Please note that most manufacturers of Android devices already license
+these patent claims through Via Licensing or directly from the patent owners, and therefore FDK AAC Codec
+software may already be covered under those patent licenses when it is used for those licensed purposes only.
+
+Commercially-licensed AAC software libraries, including floating-point versions with enhanced sound quality,
+are also available from Fraunhofer. Users are encouraged to check the Fraunhofer website for additional
+applications information and documentation.
+
+2.    COPYRIGHT LICENSE
+
+Redistribution and use in source and binary forms, with or without modification, are permitted without
+payment of copyright license fees provided that you satisfy the following conditions:
+
+You must retain the complete text of this software license in redistributions of the FDK AAC Codec or
+your modifications thereto in source code form.
+
+You must retain the complete text of this software license in the documentation and/or other materials
+provided with redistributions of the FDK AAC Codec or your modifications thereto in binary form.
+You must make available free of charge copies of the complete source code of the FDK AAC Codec and your
+modifications thereto to recipients of copies in binary form.
+
+The name of Fraunhofer may not be used to endorse or promote products derived from this library without
+prior written permission.
+
+You may not charge copyright license fees for anyone to use, copy or distribute the FDK AAC Codec
+software or your modifications thereto.
+
+Your modified versions of the FDK AAC Codec must carry prominent notices stating that you changed the software
+and the date of any change. For modified versions of the FDK AAC Codec, the term
+"Fraunhofer FDK AAC Codec Library for Android" must be replaced by the term
+"Third-Party Modified Version of the Fraunhofer FDK AAC Codec Library for Android."
+
+3.    NO PATENT LICENSE
+
+NO EXPRESS OR IMPLIED LICENSES TO ANY PATENT CLAIMS, including without limitation the patents of Fraunhofer,
+ARE GRANTED BY THIS SOFTWARE LICENSE. Fraunhofer provides no warranty of patent non-infringement with
+respect to this software.
+
+You may use this FDK AAC Codec software or modifications thereto only for purposes that are authorized
+by appropriate patent licenses.
+
+4.    DISCLAIMER
+
+This FDK AAC Codec software is provided by Fraunhofer on behalf of the copyright holders and contributors
+"AS IS" and WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, including but not limited to the implied warranties
+of merchantability and fitness for a particular purpose. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE for any direct, indirect, incidental, special, exemplary, or consequential damages,
+including but not limited to procurement of substitute goods or services; loss of use, data, or profits,
+or business interruption, however caused and on any theory of liability, whether in contract, strict
+liability, or tort (including negligence), arising in any way out of the use of this software, even if
+advised of the possibility of such damage.
+
+5.    CONTACT INFORMATION
+
+Fraunhofer Institute for Integrated Circuits IIS
+Attention: Audio and Multimedia Departments - FDK AAC LL
+Am Wolfsmantel 33
+91058 Erlangen, Germany
+
+www.iis.fraunhofer.de/amm
+amm-info@iis.fraunhofer.de
+----------------------------------------------------------------------------------------------------------- */
+
+/***************************  Fraunhofer IIS FDK Tools  **********************
+
+   Author(s):
+   Description: dct_IV/dst_IV SSE4.1/AVX2 twiddling
+
+******************************************************************************/
+
+#include "x86/simd_x86.h"
+
+#if defined(FDK_X86_SIMD) && defined(SINETABLE_16BIT) && defined(WINDOWTABLE_16BIT)
+
+#define FUNCTION_dct_IV_x86_func1
+#define FUNCTION_dct_IV_x86_func2
+
+/*
+   Both twiddling loops of dct_IV() and dst_IV(), for an even M = L/2. Slot k is
+   made of the pair of values at 2k (front) and the one at L-2-2k (back): the pre
+   twiddling reads and writes the two values of the slot only, and so does the post
+   twiddling once its loop is unrolled by half an iteration (the C code carries the
+   back pair to the next iteration instead). Slots are then independent, and the
+   back ones of consecutive slots are contiguous in reverse order.
+*/
+
+static inline void dct_IV_pre_slot(FIXP_DBL *pDat, int L, int k, const FIXP_WTP *twiddle, int dst)
+{
+  FIXP_DBL *pDat_0 = &pDat[2*k];
+  FIXP_DBL *pDat_1 = &pDat[L - 2 - 2*k];
+  FIXP_DBL accu1, accu2, accu3, accu4;
+
+  accu1 = pDat_1[1]; accu2 = dst ? -pDat_0[0] : pDat_0[0];
+  accu3 = pDat_0[1]; accu4 = dst ? -pDat_1[0] : pDat_1[0];
+
+  cplxMultDiv2(&accu1, &accu2, accu1, accu2, twiddle[2*k]);
+  cplxMultDiv2(&accu3, &accu4, accu4, accu3, twiddle[2*k+1]);
+
+  pDat_0[0] = accu2; pDat_0[1] = accu1;
+  pDat_1[0] = accu4; pDat_1[1] = -accu3;
+}
+
+static inline void dct_IV_post_slot(FIXP_DBL *pDat, int L, int k, const FIXP_STP *sin_twiddle, int sin_step, int dst)
+{
+  FIXP_DBL *pDat_0 = &pDat[2*k];
+  FIXP_DBL *pDat_1 = &pDat[L - 2 - 2*k];
+  FIXP_DBL qr, qi, pr, pi;
+
+  cplxMultDiv2(&qr, &qi, pDat_0[1], pDat_0[0], sin_twiddle[k*sin_step]);
+  cplxMultDiv2(&pr, &pi, pDat_1[0], pDat_1[1], sin_twiddle[(k+1)*sin_step]);
+
+  if (dst) {
+    pDat_0[0] = qr;  pDat_0[1] = -pi;
+    pDat_1[0] = -pr; pDat_1[1] = -qi;
+  } else {
+    pDat_0[0] = qi;  pDat_0[1] = pr;
+    pDat_1[0] = pi;  pDat_1[1] = -qr;
+  }
+}
+
+FDK_TARGET_SSE41
+static int dct_IV_pre_sse41(FIXP_DBL *pDat, int L, const FIXP_WTP *twiddle, int dst)
+{
+  int k, K = L>>2;
+
+  for (k=0; k+2 <= K; k+=2)
+  {
+    FIXP_DBL *pDat_0 = &pDat[2*k];
+    FIXP_DBL *pDat_1 = &pDat[L - 2 - 2*(k+1)];
+    __m128i f = load_x2(pDat_0);
+    __m128i b = rev_x2(load_x2(pDat_1));
+    __m128i ta = load_x2((const FIXP_DBL *)&twiddle[2*k]);
+    __m128i tb = hi_x2(ta);
+    __m128i ar = twRe_x2(ta), ai = twIm_x2(ta);
+    __m128i br = twRe_x2(tb), bi = twIm_x2(tb);
+    __m128i f0 = dst ? neg_x2(f) : f, f1 = hi_x2(f);
+    __m128i b0 = dst ? neg_x2(b) : b, b1 = hi_x2(b);
+    __m128i accu1, accu2, accu3, accu4;
+
+    accu1 = _mm_sub_epi32(mulDiv2_x2(b1, ar), mulDiv2_x2(f0, ai));
+    accu2 = _mm_add_epi32(mulDiv2_x2(b1, ai), mulDiv2_x2(f0, ar));
+    accu3 = _mm_sub_epi32(mulDiv2_x2(b0, br), mulDiv2_x2(f1, bi));
+    accu4 = _mm_add_epi32(mulDiv2_x2(b0, bi), mulDiv2_x2(f1, br));
+
+    store_x2(pDat_0, pack_x2(accu2, accu1));
+    store_x2(pDat_1, rev_x2(pack_x2(accu4, neg_x2(accu3))));
+  }
+
+  return k;
+}
+
+FDK_TARGET_AVX2
+static int dct_IV_pre_avx2(FIXP_DBL *pDat, int L, const FIXP_WTP *twiddle, int dst)
+{
+  int k, K = L>>2;
+
+  for (k=0; k+4 <= K; k+=4)
+  {
+    FIXP_DBL *pDat_0 = &pDat[2*k];
+    FIXP_DBL *pDat_1 = &pDat[L - 2 - 2*(k+3)];
+    __m256i f = load_x4(pDat_0);
+    __m256i b = rev_x4(load_x4(pDat_1));
+    __m256i ta = load_x4((const FIXP_DBL *)&twiddle[2*k]);
+    __m256i tb = hi_x4(ta);
+    __m256i ar = twRe_x4(ta), ai = twIm_x4(ta);
+    __m256i br = twRe_x4(tb), bi = twIm_x4(tb);
+    __m256i f0 = dst ? neg_x4(f) : f, f1 = hi_x4(f);
+    __m256i b0 = dst ? neg_x4(b) : b, b1 = hi_x4(b);
+    __m256i accu1, accu2, accu3, accu4;
+
+    accu1 = _mm256_sub_epi32(mulDiv2_x4(b1, ar), mulDiv2_x4(f0, ai));
+    accu2 = _mm256_add_epi32(mulDiv2_x4(b1, ai), mulDiv2_x4(f0, ar));
+    accu3 = _mm256_sub_epi32(mulDiv2_x4(b0, br), mulDiv2_x4(f1, bi));
+    accu4 = _mm256_add_epi32(mulDiv2_x4(b0, bi), mulDiv2_x4(f1, br));
+
+    store_x4(pDat_0, pack_x4(accu2, accu1));
+    store_x4(pDat_1, rev_x4(pack_x4(accu4, neg_x4(accu3))));
+  }
+
+  return k;
+}
+
+/* Slots 1 .. K-2: slot 0 and K-1 have special cases, done in C */
+FDK_TARGET_SSE41
+static int dct_IV_post_sse41(FIXP_DBL *pDat, int L, const FIXP_STP *sin_twiddle, int sin_step, int dst)
+{
+  int k, K = L>>2;
+
+  for (k=1; k+2 <= K-1; k+=2)
+  {
+    FIXP_DBL *pDat_0 = &pDat[2*k];
+    FIXP_DBL *pDat_1 = &pDat[L - 2 - 2*(k+1)];
+    __m128i f = load_x2(pDat_0);
+    __m128i b = rev_x2(load_x2(pDat_1));
+    __m128i t = twGather_x2(sin_twiddle, k*sin_step, (k+1)*sin_step);
+    __m128i u = twGather_x2(sin_twiddle, (k+1)*sin_step, (k+2)*sin_step);
+    __m128i tr = twRe_x2(t), ti = twIm_x2(t);
+    __m128i ur = twRe_x2(u), ui = twIm_x2(u);
+    __m128i f1 = hi_x2(f), b1 = hi_x2(b);
+    __m128i qr, qi, pr, pi;
+
+    qr = _mm_sub_epi32(mulDiv2_x2(f1, tr), mulDiv2_x2(f, ti));
+    qi = _mm_add_epi32(mulDiv2_x2(f1, ti), mulDiv2_x2(f, tr));
+    pr = _mm_sub_epi32(mulDiv2_x2(b, ur), mulDiv2_x2(b1, ui));
+    pi = _mm_add_epi32(mulDiv2_x2(b, ui), mulDiv2_x2(b1, ur));
+
+    if (dst) {
+      store_x2(pDat_0, pack_x2(qr, neg_x2(pi)));
+      store_x2(pDat_1, rev_x2(pack_x2(neg_x2(pr), neg_x2(qi))));
+    } else {
+      store_x2(pDat_0, pack_x2(qi, pr));
+      store_x2(pDat_1, rev_x2(pack_x2(pi, neg_x2(qr))));
+    }
+  }
+
+  return k;
+}
+
+FDK_TARGET_AVX2
+static int dct_IV_post_avx2(FIXP_DBL *pDat, int L, const FIXP_STP *sin_twiddle, int sin_step, int dst)
+{
+  int k, K = L>>2;
+
+  for (k=1; k+4 <= K-1; k+=4)
+  {
+    FIXP_DBL *pDat_0 = &pDat[2*k];
+    FIXP_DBL *pDat_1 = &pDat[L - 2 - 2*(k+3)];
+    __m256i f = load_x4(pDat_0);
+    __m256i b = rev_x4(load_x4(pDat_1));
+    __m256i t = twGather_x4(sin_twiddle, k*sin_step, (k+1)*sin_step, (k+2)*sin_step, (k+3)*sin_step);
+    __m256i u = twGather_x4(sin_twiddle, (k+1)*sin_step, (k+2)*sin_step, (k+3)*sin_step, (k+4)*sin_step);
+    __m256i tr = twRe_x4(t), ti = twIm_x4(t);
+    __m256i ur = twRe_x4(u), ui = twIm_x4(u);
+    __m256i f1 = hi_x4(f), b1 = hi_x4(b);
+    __m256i qr, qi, pr, pi;
+
+    qr = _mm256_sub_epi32(mulDiv2_x4(f1, tr), mulDiv2_x4(f, ti));
+    qi = _mm256_add_epi32(mulDiv2_x4(f1, ti), mulDiv2_x4(f, tr));
+    pr = _mm256_sub_epi32(mulDiv2_x4(b, ur), mulDiv2_x4(b1, ui));
+    pi = _mm256_add_epi32(mulDiv2_x4(b, ui), mulDiv2_x4(b1, ur));
+
+    if (dst) {
+      store_x4(pDat_0, pack_x4(qr, neg_x4(pi)));
+      store_x4(pDat_1, rev_x4(pack_x4(neg_x4(pr), neg_x4(qi))));
+    } else {
+      store_x4(pDat_0, pack_x4(qi, pr));
+      store_x4(pDat_1, rev_x4(pack_x4(pi, neg_x4(qr))));
+    }
+  }
+
+  return k;
+}
+
+/* Twiddling before the FFT, M must be even */
+static void dct_IV_x86_func1(FIXP_DBL *pDat, int L, const FIXP_WTP *twiddle, int dst)
+{
+  int k = 0, K = L>>2;
+
+  switch (FDK_getSimdLevel()) {
+    case FDK_SIMD_AVX2:
+      k = dct_IV_pre_avx2(pDat, L, twiddle, dst);
+      break;
+    case FDK_SIMD_SSE41:
+      k = dct_IV_pre_sse41(pDat, L, twiddle, dst);
+      break;
+    default:
+      break;
+  }
+  for (; k<K; k++)
+    dct_IV_pre_slot(pDat, L, k, twiddle, dst);
+}
+
+/* Twiddling after the FFT, M must be even and at least 4 */
+static void dct_IV_x86_func2(FIXP_DBL *pDat, int L, const FIXP_STP *sin_twiddle, int sin_step, int dst)
+{
+  int k = 1, K = L>>2;
+  FIXP_DBL *pDat_0, *pDat_1;
+  FIXP_DBL accu1, accu2, accu3, accu4;
+
+  /* Slot 0: sin and cos values are 0.0f and 1.0f for the front pair */
+  pDat_0 = &pDat[0];
+  pDat_1 = &pDat[L - 2];
+  cplxMultDiv2(&accu3, &accu4, pDat_1[0], pDat_1[1], sin_twiddle[sin_step]);
+  accu1 = pDat_0[0]>>1;
+  accu2 = pDat_0[1]>>1;
+  if (dst) {
+    pDat_0[0] = accu2;  pDat_0[1] = -accu4;
+    pDat_1[0] = -accu3; pDat_1[1] = -accu1;
+  } else {
+    pDat_0[0] = accu1;  pDat_0[1] = accu3;
+    pDat_1[0] = accu4;  pDat_1[1] = -accu2;
+  }
+
+  switch (FDK_getSimdLevel()) {
+    case FDK_SIMD_AVX2:
+      k = dct_IV_post_avx2(pDat, L, sin_twiddle, sin_step, dst);
+      break;
+    case FDK_SIMD_SSE41:
+      k = dct_IV_post_sse41(pDat, L, sin_twiddle, sin_step, dst);
+      break;
+    default:
+      break;
+  }
+  for (; k<K-1; k++)
+    dct_IV_post_slot(pDat, L, k, sin_twiddle, sin_step, dst);
+
+  /* Slot K-1: last sin and cos value pair are the same for the back pair */
+  pDat_0 = &pDat[2*(K-1)];
+  pDat_1 = &pDat[L - 2*K];
+  cplxMultDiv2(&accu3, &accu4, pDat_0[1], pDat_0[0], sin_twiddle[(K-1)*sin_step]);
+  accu1 = fMultDiv2(pDat_1[0], WTC(0x5a82799a));
+  accu2 = fMultDiv2(pDat_1[1], WTC(0x5a82799a));
+  if (dst) {
+    pDat_0[0] = accu3;  pDat_0[1] = - accu1 - accu2;
+    pDat_1[0] = accu2 - accu1; pDat_1[1] = -accu4;
+  } else {
+    pDat_0[0] = accu4;  pDat_0[1] = accu1 - accu2;
+    pDat_1[0] = accu1 + accu2; pDat_1[1] = -accu3;
+  }
+}
+
+#endif /* defined(FDK_X86_SIMD) && defined(SINETABLE_16BIT) && defined(WINDOWTABLE_16BIT) */
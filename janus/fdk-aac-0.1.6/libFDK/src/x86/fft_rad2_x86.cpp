@@ -0,0 +1,239 @@
+
+/* -----------------------------------------------------------------------------------------------------------
+Software License for The Fraunhofer FDK AAC Codec Library for Android
+
+ Copyright  1995 - 2013 Fraunhofer-Gesellschaft zur Frderung der angewandten Forschung e.V.
+  All rights reserved.
+
+ 1.    INTRODUCTION
+The Fraunhofer FDK AAC Codec Library for Android ("FDK AAC Codec") is software that implements
+the MPEG Advanced Audio Coding ("AAC") encoding and decoding scheme for digital audio.
+This FDK AAC Codec software is intended to be used on a wide variety of Android devices.
+
+AAC's HE-AAC and HE-AAC v2 versions are regarded as today's most efficient general perceptual
+audio codecs. AAC-ELD is considered the best-performing full-bandwidth communications codec by
+independent studies and is widely deployed. AAC has been standardized by ISO and IEC as part
+of the MPEG specifications.
+
+Patent licenses for necessary patent claims for the FDK AAC Codec (including those of Fraunhofer)
+may be obtained through Via Licensing (www.vialicensing.com) or through the respective patent owners
+individually for the purpose of encoding or decoding bit streams in products that are compliant with
+the ISO/IEC MPEG audio standards. Please note that most manufacturers of Android devices already license
+these patent claims through Via Licensing or directly from the patent owners, and therefore FDK AAC Codec
+software may already be covered under those patent licenses when it is used for those licensed purposes only.
+
+Commercially-licensed AAC software libraries, including floating-point versions with enhanced sound quality,
+are also available from Fraunhofer. Users are encouraged to check the Fraunhofer website for additional
+applications information and documentation.
+
+2.    COPYRIGHT LICENSE
+
+Redistribution and use in source and binary forms, with or without modification, are permitted without
+payment of copyright license fees provided that you satisfy the following conditions:
+
+You must retain the complete text of this software license in redistributions of the FDK AAC Codec or
+your modifications thereto in source code form.
+
+You must retain the complete text of this software license in the documentation and/or other materials
+provided with redistributions of the FDK AAC Codec or your modifications thereto in binary form.
+You must make available free of charge copies of the complete source code of the FDK AAC Codec and your
+modifications thereto to recipients of copies in binary form.
+
+The name of Fraunhofer may not be used to endorse or promote products derived from this library without
+prior written permission.
+
+You may not charge copyright license fees for anyone to use, copy or distribute the FDK AAC Codec
+software or your modifications thereto.
+
+Your modified versions of the FDK AAC Codec must carry prominent notices stating that you changed the software
+and the date of any change. For modified versions of the FDK AAC Codec, the term
+"Fraunhofer FDK AAC Codec Library for Android" must be replaced by the term
+"Third-Party Modified Version of the Fraunhofer FDK AAC Codec Library for Android."
+
+3.    NO PATENT LICENSE
+
+NO EXPRESS OR IMPLIED LICENSES TO ANY PATENT CLAIMS, including without limitation the patents of Fraunhofer,
+ARE GRANTED BY THIS SOFTWARE LICENSE. Fraunhofer provides no warranty of patent non-infringement with
+respect to this software.
+
+You may use this FDK AAC Codec software or modifications thereto only for purposes that are authorized
+by appropriate patent licenses.
+
+4.    DISCLAIMER
+
+This FDK AAC Codec software is provided by Fraunhofer on behalf of the copyright holders and contributors
+"AS IS" and WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, including but not limited to the implied warranties
+of merchantability and fitness for a particular purpose. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE for any direct, indirect, incidental, special, exemplary, or consequential damages,
+including but not limited to procurement of substitute goods or services; loss of use, data, or profits,
+or business interruption, however caused and on any theory of liability, whether in contract, strict
+liability, or tort (including negligence), arising in any way out of the use of this software, even if
+advised of the possibility of such damage.
+
+5.    CONTACT INFORMATION
+
+Fraunhofer Institute for Integrated Circuits IIS
+Attention: Audio and Multimedia Departments - FDK AAC LL
+Am Wolfsmantel 33
+91058 Erlangen, Germany
+
+www.iis.fraunhofer.de/amm
+amm-info@iis.fraunhofer.de
+----------------------------------------------------------------------------------------------------------- */
+
+/***************************  Fraunhofer IIS FDK Tools  **********************
+
+   Author(s):
+   Description: dit_fft SSE4.1/AVX2 butterflies
+
+******************************************************************************/
+
+#include "x86/simd_x86.h"
+
+#if defined(FDK_X86_SIMD) && defined(SINETABLE_16BIT)
+
+#define FUNCTION_dit_fft_x86
+
+/*
+   Butterflies of one stage of dit_fft() for j = 1 .. mh/4-1, several j at a time:
+   the four butterflies of each j are independent from the ones of the other j's,
+   and the values of consecutive j's are contiguous (in reverse order for the
+   mirrored ones, which then use the twiddles reversed). Returns the first j
+   that still needs to be done, by the C loop.
+*/
+
+FDK_TARGET_SSE41
+static INT dit_fft_stage_sse41(FIXP_DBL *x, const INT n, const INT mh, const FIXP_STP *trigdata, const INT trigstep)
+{
+  const INT m = mh<<1;
+  INT j, r;
+
+  for (j=1; j+2 <= mh/4; j+=2)
+  {
+    __m128i cs  = twGather_x2(trigdata, j*trigstep, (j+1)*trigstep);
+    __m128i wr  = twRe_x2(cs), wi = twIm_x2(cs);
+    __m128i wrr = rev_x2(wr), wir = rev_x2(wi);
+
+    for (r=0; r<n; r+=m)
+    {
+      FIXP_DBL *x1 = x + ((r+j)<<1);
+      FIXP_DBL *x2 = x1 + (mh<<1);
+      __m128i a, b, u, vr, vi, v;
+
+      /* cplxMultDiv2(&vi, &vr, x[t2+1], x[t2], cs) */
+      a  = load_x2(x2); b = hi_x2(a);
+      vi = _mm_sub_epi32(mulDiv2_x2(b, wr), mulDiv2_x2(a, wi));
+      vr = _mm_add_epi32(mulDiv2_x2(b, wi), mulDiv2_x2(a, wr));
+      u  = _mm_srai_epi32(load_x2(x1), 1);
+      v  = pack_x2(vr, vi);
+      store_x2(x1, _mm_add_epi32(u, v));
+      store_x2(x2, _mm_sub_epi32(u, v));
+
+      /* cplxMultDiv2(&vr, &vi, x[t2+1], x[t2], cs) */
+      x1 += mh; x2 += mh;
+      a  = load_x2(x2); b = hi_x2(a);
+      vr = _mm_sub_epi32(mulDiv2_x2(b, wr), mulDiv2_x2(a, wi));
+      vi = _mm_add_epi32(mulDiv2_x2(b, wi), mulDiv2_x2(a, wr));
+      u  = _mm_srai_epi32(load_x2(x1), 1);
+      v  = pack_x2(vr, neg_x2(vi));
+      store_x2(x1, _mm_add_epi32(u, v));
+      store_x2(x2, _mm_sub_epi32(u, v));
+
+      /* cplxMultDiv2(&vi, &vr, x[t2], x[t2+1], cs), at mh/2-j */
+      x1 = x + ((r+mh/2-j-1)<<1);
+      x2 = x1 + (mh<<1);
+      a  = load_x2(x2); b = hi_x2(a);
+      vi = _mm_sub_epi32(mulDiv2_x2(a, wrr), mulDiv2_x2(b, wir));
+      vr = _mm_add_epi32(mulDiv2_x2(a, wir), mulDiv2_x2(b, wrr));
+      u  = _mm_srai_epi32(load_x2(x1), 1);
+      v  = pack_x2(vr, neg_x2(vi));
+      store_x2(x1, _mm_add_epi32(u, v));
+      store_x2(x2, _mm_sub_epi32(u, v));
+
+      /* cplxMultDiv2(&vr, &vi, x[t2], x[t2+1], cs) */
+      x1 += mh; x2 += mh;
+      a  = load_x2(x2); b = hi_x2(a);
+      vr = _mm_sub_epi32(mulDiv2_x2(a, wrr), mulDiv2_x2(b, wir));
+      vi = _mm_add_epi32(mulDiv2_x2(a, wir), mulDiv2_x2(b, wrr));
+      u  = _mm_srai_epi32(load_x2(x1), 1);
+      v  = pack_x2(vr, vi);
+      store_x2(x1, _mm_sub_epi32(u, v));
+      store_x2(x2, _mm_add_epi32(u, v));
+    }
+  }
+
+  return j;
+}
+
+FDK_TARGET_AVX2
+static INT dit_fft_stage_avx2(FIXP_DBL *x, const INT n, const INT mh, const FIXP_STP *trigdata, const INT trigstep)
+{
+  const INT m = mh<<1;
+  INT j, r;
+
+  for (j=1; j+4 <= mh/4; j+=4)
+  {
+    __m256i cs  = twGather_x4(trigdata, j*trigstep, (j+1)*trigstep, (j+2)*trigstep, (j+3)*trigstep);
+    __m256i wr  = twRe_x4(cs), wi = twIm_x4(cs);
+    __m256i wrr = rev_x4(wr), wir = rev_x4(wi);
+
+    for (r=0; r<n; r+=m)
+    {
+      FIXP_DBL *x1 = x + ((r+j)<<1);
+      FIXP_DBL *x2 = x1 + (mh<<1);
+      __m256i a, b, u, vr, vi, v;
+
+      a  = load_x4(x2); b = hi_x4(a);
+      vi = _mm256_sub_epi32(mulDiv2_x4(b, wr), mulDiv2_x4(a, wi));
+      vr = _mm256_add_epi32(mulDiv2_x4(b, wi), mulDiv2_x4(a, wr));
+      u  = _mm256_srai_epi32(load_x4(x1), 1);
+      v  = pack_x4(vr, vi);
+      store_x4(x1, _mm256_add_epi32(u, v));
+      store_x4(x2, _mm256_sub_epi32(u, v));
+
+      x1 += mh; x2 += mh;
+      a  = load_x4(x2); b = hi_x4(a);
+      vr = _mm256_sub_epi32(mulDiv2_x4(b, wr), mulDiv2_x4(a, wi));
+      vi = _mm256_add_epi32(mulDiv2_x4(b, wi), mulDiv2_x4(a, wr));
+      u  = _mm256_srai_epi32(load_x4(x1), 1);
+      v  = pack_x4(vr, neg_x4(vi));
+      store_x4(x1, _mm256_add_epi32(u, v));
+      store_x4(x2, _mm256_sub_epi32(u, v));
+
+      x1 = x + ((r+mh/2-j-3)<<1);
+      x2 = x1 + (mh<<1);
+      a  = load_x4(x2); b = hi_x4(a);
+      vi = _mm256_sub_epi32(mulDiv2_x4(a, wrr), mulDiv2_x4(b, wir));
+      vr = _mm256_add_epi32(mulDiv2_x4(a, wir), mulDiv2_x4(b, wrr));
+      u  = _mm256_srai_epi32(load_x4(x1), 1);
+      v  = pack_x4(vr, neg_x4(vi));
+      store_x4(x1, _mm256_add_epi32(u, v));
+      store_x4(x2, _mm256_sub_epi32(u, v));
+
+      x1 += mh; x2 += mh;
+      a  = load_x4(x2); b = hi_x4(a);
+      vr = _mm256_sub_epi32(mulDiv2_x4(a, wrr), mulDiv2_x4(b, wir));
+      vi = _mm256_add_epi32(mulDiv2_x4(a, wir), mulDiv2_x4(b, wrr));
+      u  = _mm256_srai_epi32(load_x4(x1), 1);
+      v  = pack_x4(vr, vi);
+      store_x4(x1, _mm256_sub_epi32(u, v));
+      store_x4(x2, _mm256_add_epi32(u, v));
+    }
+  }
+
+  return j;
+}
+
+static INT dit_fft_x86_stage(FIXP_DBL *x, const INT n, const INT mh, const FIXP_STP *trigdata, const INT trigstep)
+{
+  switch (FDK_getSimdLevel()) {
+    case FDK_SIMD_AVX2:
+      return dit_fft_stage_avx2(x, n, mh, trigdata, trigstep);
+    case FDK_SIMD_SSE41:
+      return dit_fft_stage_sse41(x, n, mh, trigdata, trigstep);
+    default:
+      return 1;
+  }
+}
+
+#endif /* defined(FDK_X86_SIMD) && defined(SINETABLE_16BIT) */
@@ -0,0 +1,236 @@
+
+/* -----------------------------------------------------------------------------------------------------------
+Software License for The Fraunhofer FDK AAC Codec Library for Android
+
+ Copyright  1995 - 2013 Fraunhofer-Gesellschaft zur Frderung der angewandten Forschung e.V.
+  All rights reserved.
+
+ 1.    INTRODUCTION
+The Fraunhofer FDK AAC Codec Library for Android ("FDK AAC Codec") is software that implements
+the MPEG Advanced Audio Coding ("AAC") encoding and decoding scheme for digital audio.
+This FDK AAC Codec software is intended to be used on a wide variety of Android devices.
+
+AAC's HE-AAC and HE-AAC v2 versions are regarded as today's most efficient general perceptual
+audio codecs. AAC-ELD is considered the best-performing full-bandwidth communications codec by
+independent studies and is widely deployed. AAC has been standardized by ISO and IEC as part
+of the MPEG specifications.
+
+Patent licenses for necessary patent claims for the FDK AAC Codec (including those of Fraunhofer)
+may be obtained through Via Licensing (www.vialicensing.com) or through the respective patent owners
+individually for the purpose of encoding or decoding bit streams in products that are compliant with
+the ISO/IEC MPEG audio standards. Please note that most manufacturers of Android devices already license
+these patent claims through Via Licensing or directly from the patent owners, and therefore FDK AAC Codec
+software may already be covered under those patent licenses when it is used for those licensed purposes only.
+
+Commercially-licensed AAC software libraries, including floating-point versions with enhanced sound quality,
+are also available from Fraunhofer. Users are encouraged to check the Fraunhofer website for additional
+applications information and documentation.
+
+2.    COPYRIGHT LICENSE
+
+Redistribution and use in source and binary forms, with or without modification, are permitted without
+payment of copyright license fees provided that you satisfy the following conditions:
+
+You must retain the complete text of this software license in redistributions of the FDK AAC Codec or
+your modifications thereto in source code form.
+
+You must retain the complete text of this software license in the documentation and/or other materials
+provided with redistributions of the FDK AAC Codec or your modifications thereto in binary form.
+You must make available free of charge copies of the complete source code of the FDK AAC Codec and your
+modifications thereto to recipients of copies in binary form.
+
+The name of Fraunhofer may not be used to endorse or promote products derived from this library without
+prior written permission.
+
+You may not charge copyright license fees for anyone to use, copy or distribute the FDK AAC Codec
+software or your modifications thereto.
+
+Your modified versions of the FDK AAC Codec must carry prominent notices stating that you changed the software
+and the date of any change. For modified versions of the FDK AAC Codec, the term
+"Fraunhofer FDK AAC Codec Library for Android" must be replaced by the term
+"Third-Party Modified Version of the Fraunhofer FDK AAC Codec Library for Android."
+
+3.    NO PATENT LICENSE
+
+NO EXPRESS OR IMPLIED LICENSES TO ANY PATENT CLAIMS, including without limitation the patents of Fraunhofer,
+ARE GRANTED BY THIS SOFTWARE LICENSE. Fraunhofer provides no warranty of patent non-infringement with
+respect to this software.
+
+You may use this FDK AAC Codec software or modifications thereto only for purposes that are authorized
+by appropriate patent licenses.
+
+4.    DISCLAIMER
+
+This FDK AAC Codec software is provided by Fraunhofer on behalf of the copyright holders and contributors
+"AS IS" and WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES, including but not limited to the implied warranties
+of merchantability and fitness for a particular purpose. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE for any direct, indirect, incidental, special, exemplary, or consequential damages,
+including but not limited to procurement of substitute goods or services; loss of use, data, or profits,
+or business interruption, however caused and on any theory of liability, whether in contract, strict
+liability, or tort (including negligence), arising in any way out of the use of this software, even if
+advised of the possibility of such damage.
+
+5.    CONTACT INFORMATION
+
+Fraunhofer Institute for Integrated Circuits IIS
+Attention: Audio and Multimedia Departments - FDK AAC LL
+Am Wolfsmantel 33
+91058 Erlangen, Germany
+
+www.iis.fraunhofer.de/amm
+amm-info@iis.fraunhofer.de
+----------------------------------------------------------------------------------------------------------- */
+
+/***************************  Fraunhofer IIS FDK Tools  **********************
+
+   Author(s):
+   Description: QMF analysis prototype filter, SSE4.1/AVX2 version
+
+******************************************************************************/
+
+#include "x86/simd_x86.h"
+
+#if defined(FDK_X86_SIMD) && defined(QMF_COEFF_16BIT) && !defined(QMF_DATA_16BIT) && (QAS_BITS == 16)
+
+#define FUNCTION_qmfAnaPrototypeFirSlot_x86
+
+/*
+   Same filtering as qmfAnaPrototypeFirSlot(), several channels at a time: for a
+   given tap, the states of consecutive channels are contiguous (in reverse order
+   for the second half), while the coefficients are QMF_NO_POLY*p_stride apart.
+   Both halves share the coefficients, so these are only fetched once. States and
+   coefficients are 16 bit, so 32 bit products and sums give the same result as
+   fMultDiv2() and the FIXP_DBL accumulator of the C code.
+
+   Channel k (1 .. no_channels-1) writes analysisBuffer[k], filtering from the end
+   of the states backwards, and analysisBuffer[2*no_channels-k], from the start
+   of the states forward. Channels 0 and no_channels only have one of the two, and
+   are done in C, like the ones left over by the vectors.
+*/
+
+/* Which outputs of a channel qmfAnaPrototypeFirSlot_chan() computes */
+#define QMF_ANA_LOW   1   /* analysisBuffer[k] */
+#define QMF_ANA_HIGH  2   /* analysisBuffer[2*no_channels-k] */
+
+static inline void qmfAnaPrototypeFirSlot_chan(FIXP_QMF *analysisBuffer, int no_channels,
+                                               const FIXP_PFT *p_flt, int k, const FIXP_QAS *pFilterStates,
+                                               int which)
+{
+  int staStep1 = no_channels<<1;
+  FIXP_DBL accu;
+  int p;
+
+  if (which & QMF_ANA_LOW) {
+    const FIXP_QAS *sta_1 = pFilterStates + (2*QMF_NO_POLY*no_channels) - 1 - k;
+    accu = fMultDiv2(p_flt[0], sta_1[0]);
+    for (p=1; p<QMF_NO_POLY; p++)
+      accu += fMultDiv2(p_flt[p], sta_1[-p*staStep1]);
+    analysisBuffer[k] = FX_DBL2FX_QMF(accu<<1);
+  }
+  if (which & QMF_ANA_HIGH) {
+    const FIXP_QAS *sta_0 = pFilterStates + k - 1;
+    accu = fMultDiv2(p_flt[0], sta_0[0]);
+    for (p=1; p<QMF_NO_POLY; p++)
+      accu += fMultDiv2(p_flt[p], sta_0[p*staStep1]);
+    analysisBuffer[2*no_channels - k] = FX_DBL2FX_QMF(accu<<1);
+  }
+}
+
+FDK_TARGET_SSE41
+static int qmfAnaPrototypeFirSlot_sse41(FIXP_QMF *analysisBuffer, int no_channels,
+                                        const FIXP_PFT *p_filter, int p_stride,
+                                        const FIXP_QAS *pFilterStates)
+{
+  int pfltStep = QMF_NO_POLY * p_stride;
+  int staStep1 = no_channels<<1;
+  int k, p;
+
+  for (k=1; k+4 <= no_channels; k+=4)
+  {
+    const FIXP_PFT *p_flt = p_filter + k*pfltStep;
+    const FIXP_QAS *sta_0 = pFilterStates + k - 1;
+    const FIXP_QAS *sta_1 = pFilterStates + (2*QMF_NO_POLY*no_channels) - 1 - (k+3);
+    __m128i accu0 = _mm_setzero_si128();
+    __m128i accu1 = _mm_setzero_si128();
+
+    for (p=0; p<QMF_NO_POLY; p++)
+    {
+      __m128i c  = _mm_set_epi32(p_flt[3*pfltStep+p], p_flt[2*pfltStep+p], p_flt[pfltStep+p], p_flt[p]);
+      __m128i s0 = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(sta_0 + p*staStep1)));
+      __m128i s1 = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(sta_1 - p*staStep1)));
+      s1 = _mm_shuffle_epi32(s1, _MM_SHUFFLE(0,1,2,3));
+      accu0 = _mm_add_epi32(accu0, _mm_mullo_epi32(c, s0));
+      accu1 = _mm_add_epi32(accu1, _mm_mullo_epi32(c, s1));
+    }
+    _mm_storeu_si128((__m128i *)&analysisBuffer[k], _mm_slli_epi32(accu1, 1));
+    accu0 = _mm_shuffle_epi32(_mm_slli_epi32(accu0, 1), _MM_SHUFFLE(0,1,2,3));
+    _mm_storeu_si128((__m128i *)&analysisBuffer[2*no_channels - (k+3)], accu0);
+  }
+
+  return k;
+}
+
+FDK_TARGET_AVX2
+static int qmfAnaPrototypeFirSlot_avx2(FIXP_QMF *analysisBuffer, int no_channels,
+                                       const FIXP_PFT *p_filter, int p_stride,
+                                       const FIXP_QAS *pFilterStates)
+{
+  int pfltStep = QMF_NO_POLY * p_stride;
+  int staStep1 = no_channels<<1;
+  const __m256i rev = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  /* Coefficients are gathered as 32 bit words ending with the wanted one (k >= 1,
+     so we never read before p_filter), then shifted down with sign extension */
+  const __m256i idx = _mm256_mullo_epi32(_mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0), _mm256_set1_epi32(pfltStep));
+  int k, p;
+
+  for (k=1; k+8 <= no_channels; k+=8)
+  {
+    const FIXP_PFT *p_flt = p_filter + k*pfltStep;
+    const FIXP_QAS *sta_0 = pFilterStates + k - 1;
+    const FIXP_QAS *sta_1 = pFilterStates + (2*QMF_NO_POLY*no_channels) - 1 - (k+7);
+    __m256i accu0 = _mm256_setzero_si256();
+    __m256i accu1 = _mm256_setzero_si256();
+
+    for (p=0; p<QMF_NO_POLY; p++)
+    {
+      __m256i c  = _mm256_srai_epi32(_mm256_i32gather_epi32((const int *)(p_flt + p - 1), idx, 2), 16);
+      __m256i s0 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(sta_0 + p*staStep1)));
+      __m256i s1 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(sta_1 - p*staStep1)));
+      s1 = _mm256_permutevar8x32_epi32(s1, rev);
+      accu0 = _mm256_add_epi32(accu0, _mm256_mullo_epi32(c, s0));
+      accu1 = _mm256_add_epi32(accu1, _mm256_mullo_epi32(c, s1));
+    }
+    _mm256_storeu_si256((__m256i *)&analysisBuffer[k], _mm256_slli_epi32(accu1, 1));
+    accu0 = _mm256_permutevar8x32_epi32(_mm256_slli_epi32(accu0, 1), rev);
+    _mm256_storeu_si256((__m256i *)&analysisBuffer[2*no_channels - (k+7)], accu0);
+  }
+
+  return k;
+}
+
+static void qmfAnaPrototypeFirSlot_x86(FIXP_QMF *analysisBuffer, int no_channels,
+                                       const FIXP_PFT *p_filter, int p_stride,
+                                       FIXP_QAS *pFilterStates)
+{
+  int pfltStep = QMF_NO_POLY * p_stride;
+  int k = 1;
+
+  switch (FDK_getSimdLevel()) {
+    case FDK_SIMD_AVX2:
+      k = qmfAnaPrototypeFirSlot_avx2(analysisBuffer, no_channels, p_filter, p_stride, pFilterStates);
+      break;
+    case FDK_SIMD_SSE41:
+      k = qmfAnaPrototypeFirSlot_sse41(analysisBuffer, no_channels, p_filter, p_stride, pFilterStates);
+      break;
+    default:
+      break;
+  }
+
+  /* FIR filter 0, the channels the vectors left, and FIR filter no_channels */
+  qmfAnaPrototypeFirSlot_chan(analysisBuffer, no_channels, p_filter, 0, pFilterStates, QMF_ANA_LOW);
+  for (; k<no_channels; k++)
+    qmfAnaPrototypeFirSlot_chan(analysisBuffer, no_channels, p_filter + k*pfltStep, k, pFilterStates, QMF_ANA_LOW|QMF_ANA_HIGH);
+  qmfAnaPrototypeFirSlot_chan(analysisBuffer, no_channels, p_filter + no_channels*pfltStep, no_channels, pFilterStates, QMF_ANA_HIGH);
+}
+
+#endif /* defined(FDK_X86_SIMD) && defined(QMF_COEFF_16BIT) && !defined(QMF_DATA_16BIT) && (QAS_BITS == 16) */
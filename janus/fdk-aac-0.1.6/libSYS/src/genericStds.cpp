@@ -113,12 +113,43 @@ amm-info@iis.fraunhofer.de
   #include <stdio.h>
   #include <string.h>
     #include <stdarg.h>
+#if defined(__GLIBC__)
+  #include <malloc.h>
+#endif
 
 
 /***************************************************************
  * memory allocation monitoring variables
  ***************************************************************/
 
+/* Bytes an allocation holds: with glibc we count what malloc really reserved, which we can
+   also tell when the block is freed, so that instances that reallocate (e.g. the decoder
+   when the stream changes) don't keep growing their counter */
+#if defined(__GLIBC__)
+#define FDK_MEM_SIZE(ptr, size) ((UINT)malloc_usable_size(ptr))
+#else
+#define FDK_MEM_SIZE(ptr, size) (size)
+#endif
+
+/* Counter of the running FDKmemMeterStart(), one per thread */
+#if defined(__GNUC__)
+static __thread UINT *memMeter = NULL;
+#elif defined(_MSC_VER)
+static __declspec(thread) UINT *memMeter = NULL;
+#else
+static UINT *memMeter = NULL;
+#endif
+
+void FDKmemMeterStart (UINT *pBytes)
+{
+  memMeter = pBytes;
+}
+
+void FDKmemMeterStop (void)
+{
+  memMeter = NULL;
+}
+
 
 /* Include OS/System specific implementations. */
 #if defined(__linux__) && !defined(__ANDROID__) /* cppp replaced: elif */
@@ -210,6 +241,9 @@ void *FDKcalloc (const UINT n, const UINT size)
   void* ptr;
 
   ptr = calloc(n, size);
+  if (ptr != NULL && memMeter != NULL) {
+    *memMeter += FDK_MEM_SIZE(ptr, n*size);
+  }
 
   return ptr;
 }
@@ -221,6 +255,9 @@ void *FDKmalloc (const UINT size)
   void* ptr;
 
   ptr = malloc(size);
+  if (ptr != NULL && memMeter != NULL) {
+    *memMeter += FDK_MEM_SIZE(ptr, size);
+  }
 
   return ptr;
 }
@@ -230,6 +267,12 @@ void *FDKmalloc (const UINT size)
 void  FDKfree (void *ptr)
 {
   /* FDKprintf("f, heapSize: %d\n", heapSizeCurr); */
+#if defined(__GLIBC__)
+  if (ptr != NULL && memMeter != NULL) {
+    UINT size = FDK_MEM_SIZE(ptr, 0);
+    *memMeter -= (*memMeter < size) ? *memMeter : size;
+  }
+#endif
   free((INT*)ptr);
 }
 #endif
@@ -0,0 +1,60 @@
+/*! \file    sdp_fuzzer.c
+ * \copyright GNU General Public License v3
+ * \brief    libFuzzer target for the SDP parser and serializer
+ * \details  Feeds whatever libFuzzer comes up with to janus_sdp_parse
+ * and, when it's accepted, writes the parsed SDP back with janus_sdp_write
+ * and parses that again, which must always succeed. The seed corpus is in
+ * fuzzers/corpora/sdp, and sdp-bench -d can go through the same files
+ * (or mutations of them) without libFuzzer. Not built with the rest of
+ * Janus, as it needs clang: from the Janus folder, something like
+ *
+\verbatim
+clang -g -O1 -fsanitize=fuzzer,address,undefined -I. $(pkg-config --cflags glib-2.0) \
+	fuzzers/sdp_fuzzer.c sdp-utils.c utils.c log.c \
+	$(pkg-config --libs glib-2.0 jansson) -lssl -lcrypto -o sdp-fuzzer
+./sdp-fuzzer -max_len=16384 fuzzers/corpora/sdp
+\endverbatim
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../sdp-utils.h"
+#include "../utils.h"
+
+/* No logging, as there's no log thread to print anything */
+int janus_log_level = 0;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	/* Larger inputs don't get us anywhere new, and the parser wants a string */
+	if(size < 2 || size > 16384)
+		return 0;
+	char *sdp = g_malloc(size + 1);
+	memcpy(sdp, data, size);
+	sdp[size] = '\0';
+	char error[512];
+	janus_sdp *parsed = janus_sdp_parse(sdp, error, sizeof(error));
+	g_free(sdp);
+	if(parsed == NULL)
+		return 0;
+	char *written = janus_sdp_write(parsed);
+	janus_sdp_destroy(parsed);
+	if(written == NULL)
+		return 0;
+	/* What we write we must be able to parse */
+	janus_sdp *reparsed = janus_sdp_parse(written, error, sizeof(error));
+	if(reparsed == NULL)
+		abort();
+	janus_sdp_destroy(reparsed);
+	g_free(written);
+	return 0;
+}
@@ -21,6 +21,10 @@
 #include <sys/time.h>
 #include <netdb.h>
 #include <fcntl.h>
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
 #include <stun/usages/bind.h>
 #include <nice/debug.h>
 
@@ -34,6 +38,7 @@
 #include "apierror.h"
 #include "ip-utils.h"
 #include "events.h"
+#include "dtls-bio.h"
 
 /* STUN server/port, if any */
 static char *janus_stun_server = NULL;
@@ -101,10 +106,23 @@ typedef struct janus_ice_static_event_loop {
 	GMainContext *mainctx;
 	GMainLoop *mainloop;
 	GThread *thread;
+	/* Handles currently served by this loop */
+	GList *handles;
+	guint handles_num;
+	/* Whether new handles should avoid this loop, as it's much busier than the idlest one */
+	gboolean closed;
+#ifdef __linux__
+	/* CPUs this loop is pinned to, if affinity was configured */
+	gboolean pinned;
+	cpu_set_t cpus;
+#endif
 } janus_ice_static_event_loop;
 static int static_event_loops = 0;
-static GSList *event_loops = NULL, *current_loop = NULL;
+static GSList *event_loops = NULL;
 static janus_mutex event_loops_mutex = JANUS_MUTEX_INITIALIZER;
+/* Imbalance (percentage of a loop load) that closes it to new handles, 0 disables it */
+static int event_loops_rebalance = 0;
+static GSource *event_loops_rebalance_source = NULL;
 static void *janus_ice_static_event_loop_thread(void *data) {
 	janus_ice_static_event_loop *loop = data;
 	JANUS_LOG(LOG_VERB, "[loop#%d] Event loop thread started\n", loop->id);
@@ -113,6 +131,10 @@ static void *janus_ice_static_event_loop_thread(void *data) {
 		g_thread_unref(g_thread_self());
 		return NULL;
 	}
+#ifdef __linux__
+	if(loop->pinned && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &loop->cpus) != 0)
+		JANUS_LOG(LOG_WARN, "[loop#%d] Couldn't set the CPU affinity of the loop thread\n", loop->id);
+#endif
 	JANUS_LOG(LOG_DBG, "[loop#%d] Looping...\n", loop->id);
 	g_main_loop_run(loop->mainloop);
 	/* When the loop quits, we can unref it */
@@ -121,16 +143,84 @@ static void *janus_ice_static_event_loop_thread(void *data) {
 	JANUS_LOG(LOG_VERB, "[loop#%d] Event loop thread ended!\n", loop->id);
 	return NULL;
 }
+#ifdef __linux__
+/* Helper to parse a CPU list (e.g., "0-3,8"), as in the sysfs NUMA node files */
+static gboolean janus_ice_parse_cpu_list(const char *list, cpu_set_t *cpus) {
+	gboolean found = FALSE;
+	gchar **items = g_strsplit(list, ",", -1);
+	int i = 0;
+	for(i=0; items[i] != NULL; i++) {
+		int first = 0, last = 0;
+		int n = sscanf(items[i], "%d-%d", &first, &last);
+		if(n < 1)
+			continue;
+		if(n == 1)
+			last = first;
+		for(; first >= 0 && first <= last && first < CPU_SETSIZE; first++) {
+			CPU_SET(first, cpus);
+			found = TRUE;
+		}
+	}
+	g_strfreev(items);
+	return found;
+}
+/* Helper to parse the affinity for each loop: every comma separated item is
+ * either a CPU, a range of CPUs (each taken individually) or a NUMA node */
+static GList *janus_ice_parse_loops_affinity(const char *affinity) {
+	GList *list = NULL;
+	gchar **items = g_strsplit(affinity, ",", -1);
+	int i = 0;
+	for(i=0; items[i] != NULL; i++) {
+		char *item = g_strstrip(items[i]);
+		int node = 0, first = 0, last = 0;
+		if(sscanf(item, "node%d", &node) == 1) {
+			/* Pin to all the CPUs of this NUMA node */
+			char path[128], *content = NULL;
+			g_snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+			cpu_set_t *cpus = g_malloc0(sizeof(cpu_set_t));
+			if(!g_file_get_contents(path, &content, NULL, NULL) || !janus_ice_parse_cpu_list(g_strstrip(content), cpus)) {
+				JANUS_LOG(LOG_WARN, "Couldn't get the CPUs of NUMA node %d, ignoring\n", node);
+				g_free(cpus);
+			} else {
+				list = g_list_append(list, cpus);
+			}
+			g_free(content);
+			continue;
+		}
+		int n = sscanf(item, "%d-%d", &first, &last);
+		if(n < 1 || first < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid event loops affinity item '%s', ignoring\n", item);
+			continue;
+		}
+		if(n == 1)
+			last = first;
+		for(; first <= last && first < CPU_SETSIZE; first++) {
+			cpu_set_t *cpus = g_malloc0(sizeof(cpu_set_t));
+			CPU_SET(first, cpus);
+			list = g_list_append(list, cpus);
+		}
+	}
+	g_strfreev(items);
+	return list;
+}
+#endif
 int janus_ice_get_static_event_loops(void) {
 	return static_event_loops;
 }
-void janus_ice_set_static_event_loops(int loops) {
+void janus_ice_set_static_event_loops(int loops, const char *affinity) {
 	if(loops == 0)
 		return;
 	else if(loops < 1) {
 		JANUS_LOG(LOG_WARN, "Invalid number of static event loops (%d), disabling\n", loops);
 		return;
 	}
+#ifdef __linux__
+	GList *cpus = affinity ? janus_ice_parse_loops_affinity(affinity) : NULL;
+	guint cpus_num = g_list_length(cpus);
+#else
+	if(affinity != NULL)
+		JANUS_LOG(LOG_WARN, "Pinning event loops to CPUs is only supported on Linux, ignoring\n");
+#endif
 	/* Create a pool of new event loops */
 	int i = 0;
 	for(i=0; i<loops; i++) {
@@ -138,6 +228,12 @@ void janus_ice_set_static_event_loops(int loops) {
 		loop->id = static_event_loops;
 		loop->mainctx = g_main_context_new();
 		loop->mainloop = g_main_loop_new(loop->mainctx, FALSE);
+#ifdef __linux__
+		if(cpus_num > 0) {
+			loop->pinned = TRUE;
+			loop->cpus = *((cpu_set_t *)g_list_nth_data(cpus, i % cpus_num));
+		}
+#endif
 		/* Now spawn a thread for this loop */
 		GError *error = NULL;
 		char tname[16];
@@ -154,25 +250,36 @@ void janus_ice_set_static_event_loops(int loops) {
 			static_event_loops++;
 		}
 	}
-	current_loop = event_loops;
+#ifdef __linux__
+	g_list_free_full(cpus, (GDestroyNotify)g_free);
+#endif
 	JANUS_LOG(LOG_INFO, "Spawned %d static event loops (handles won't have a dedicated loop)\n", static_event_loops);
 	return;
 }
 void janus_ice_stop_static_event_loops(void) {
 	if(static_event_loops < 1)
 		return;
-	/* Quit all the static loops and wait for the threads to leave */
+	/* Stop rebalancing, quit all the static loops and wait for the threads to
+	 * leave: we don't hold the lock while joining, as the loops may need it */
 	janus_mutex_lock(&event_loops_mutex);
-	GSList *l = event_loops;
+	if(event_loops_rebalance_source != NULL) {
+		g_source_destroy(event_loops_rebalance_source);
+		g_source_unref(event_loops_rebalance_source);
+		event_loops_rebalance_source = NULL;
+	}
+	GSList *loops = event_loops;
+	event_loops = NULL;
+	janus_mutex_unlock(&event_loops_mutex);
+	GSList *l = loops;
 	while(l) {
 		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)l->data;
 		if(loop->mainloop != NULL && g_main_loop_is_running(loop->mainloop))
 			g_main_loop_quit(loop->mainloop);
 		g_thread_join(loop->thread);
+		g_list_free(loop->handles);
 		l = l->next;
 	}
-	g_slist_free_full(event_loops, (GDestroyNotify)g_free);
-	janus_mutex_unlock(&event_loops_mutex);
+	g_slist_free_full(loops, (GDestroyNotify)g_free);
 }
 
 /* libnice debugging */
@@ -309,6 +416,8 @@ typedef struct janus_ice_queued_packet {
 	gboolean control;
 	gboolean retransmission;
 	gboolean encrypted;
+	/* Whether this is a keyframe, if the plugin told us (-1 if we need to check) */
+	gint keyframe;
 	gint64 added;
 } janus_ice_queued_packet;
 /* A few static, fake, messages we use as a trigger: e.g., to start a
@@ -339,6 +448,144 @@ static void janus_ice_plugin_session_free(const janus_refcount *app_handle_ref);
 static void janus_ice_stream_free(const janus_refcount *handle_ref);
 static void janus_ice_component_free(const janus_refcount *handle_ref);
 
+/* Helper to compute the load of a loop, as the sum of the packet rates of its
+ * handles: handles we have no rate for yet are accounted as an average one */
+static guint janus_ice_static_event_loop_load(janus_ice_static_event_loop *loop, guint average) {
+	guint load = 0;
+	GList *l = loop->handles;
+	while(l) {
+		janus_ice_handle *handle = (janus_ice_handle *)l->data;
+		gint pps = g_atomic_int_get(&handle->loop_pps);
+		load += (pps < 0 ? average : (guint)pps);
+		l = l->next;
+	}
+	return load;
+}
+/* Helper to compute the average packet rate of handles across all loops */
+static guint janus_ice_static_event_loops_average(void) {
+	guint total = 0, handles = 0;
+	GSList *sl = event_loops;
+	while(sl) {
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)sl->data;
+		GList *l = loop->handles;
+		while(l) {
+			janus_ice_handle *handle = (janus_ice_handle *)l->data;
+			gint pps = g_atomic_int_get(&handle->loop_pps);
+			if(pps >= 0) {
+				total += pps;
+				handles++;
+			}
+			l = l->next;
+		}
+		sl = sl->next;
+	}
+	return handles ? total/handles : 0;
+}
+/* Pick the least loaded loop for a new handle, among the ones that are
+ * not closed to new handles (event_loops_mutex must be locked) */
+static janus_ice_static_event_loop *janus_ice_static_event_loops_pick(void) {
+	janus_ice_static_event_loop *best = NULL;
+	guint best_load = 0, average = janus_ice_static_event_loops_average();
+	GSList *sl = event_loops;
+	while(sl) {
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)sl->data;
+		guint load = janus_ice_static_event_loop_load(loop, average);
+		if(best != NULL && loop->closed != best->closed) {
+			/* Loops open to new handles always win */
+			if(!loop->closed) {
+				best = loop;
+				best_load = load;
+			}
+		} else if(best == NULL || load < best_load || (load == best_load && loop->handles_num < best->handles_num)) {
+			best = loop;
+			best_load = load;
+		}
+		sl = sl->next;
+	}
+	return best;
+}
+/* Check if the loops are unbalanced: handles never leave the loop they were
+ * added to, as libnice drives their agent from that loop's context, so we
+ * rebalance by closing the loops that are much busier than the idlest one
+ * to new handles, until the idlest ones catch up with them */
+static gboolean janus_ice_static_event_loops_rebalance(gpointer user_data) {
+	janus_mutex_lock(&event_loops_mutex);
+	janus_ice_static_event_loop *idlest = NULL;
+	guint idlest_load = 0, average = janus_ice_static_event_loops_average();
+	GSList *sl = event_loops;
+	while(sl) {
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)sl->data;
+		guint load = janus_ice_static_event_loop_load(loop, average);
+		if(idlest == NULL || load < idlest_load) {
+			idlest = loop;
+			idlest_load = load;
+		}
+		sl = sl->next;
+	}
+	sl = event_loops;
+	while(sl) {
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)sl->data;
+		guint load = janus_ice_static_event_loop_load(loop, average);
+		gboolean closed = (loop != idlest && load > 0 &&
+			(guint64)(load - idlest_load)*100 > (guint64)load*event_loops_rebalance);
+		if(closed != loop->closed) {
+			JANUS_LOG(LOG_VERB, "Static loop #%d (%u pps) %s to new handles (idlest loop #%d, %u pps)\n",
+				loop->id, load, closed ? "closed" : "open again", idlest->id, idlest_load);
+			loop->closed = closed;
+		}
+		sl = sl->next;
+	}
+	janus_mutex_unlock(&event_loops_mutex);
+	return G_SOURCE_CONTINUE;
+}
+void janus_ice_set_event_loops_rebalance(int threshold) {
+	if(threshold < 0 || threshold > 100) {
+		JANUS_LOG(LOG_WARN, "Invalid event loops rebalancing threshold (%d), ignoring\n", threshold);
+		return;
+	}
+	event_loops_rebalance = threshold;
+	if(static_event_loops < 2 || threshold == 0 || event_loops_rebalance_source != NULL)
+		return;
+	/* We check the loops every few seconds from the first loop */
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)event_loops->data;
+	event_loops_rebalance_source = g_timeout_source_new_seconds(5);
+	g_source_set_callback(event_loops_rebalance_source, janus_ice_static_event_loops_rebalance, NULL, NULL);
+	g_source_attach(event_loops_rebalance_source, loop->mainctx);
+	JANUS_LOG(LOG_INFO, "Static event loops will be rebalanced when the imbalance exceeds %d%%\n", threshold);
+}
+json_t *janus_ice_static_event_loops_info(void) {
+	json_t *info = json_object();
+	json_object_set_new(info, "rebalance", json_integer(event_loops_rebalance));
+	json_t *list = json_array();
+	janus_mutex_lock(&event_loops_mutex);
+	guint average = janus_ice_static_event_loops_average();
+	GSList *sl = event_loops;
+	while(sl) {
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)sl->data;
+		json_t *l = json_object();
+		json_object_set_new(l, "id", json_integer(loop->id));
+#ifdef __linux__
+		if(loop->pinned) {
+			json_t *cpus = json_array();
+			int i = 0;
+			for(i=0; i<CPU_SETSIZE; i++) {
+				if(CPU_ISSET(i, &loop->cpus))
+					json_array_append_new(cpus, json_integer(i));
+			}
+			json_object_set_new(l, "cpus", cpus);
+		}
+#endif
+		json_object_set_new(l, "handles", json_integer(loop->handles_num));
+		json_object_set_new(l, "pps", json_integer(janus_ice_static_event_loop_load(loop, average)));
+		json_object_set_new(l, "closed", loop->closed ? json_true() : json_false());
+		json_array_append_new(list, l);
+		sl = sl->next;
+	}
+	janus_mutex_unlock(&event_loops_mutex);
+	json_object_set_new(info, "loops", list);
+	return info;
+}
+
 /* Custom GSource for outgoing traffic */
 typedef struct janus_ice_outgoing_traffic {
 	GSource parent;
@@ -348,12 +595,21 @@ typedef struct janus_ice_outgoing_traffic {
 static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data);
 static gboolean janus_ice_outgoing_stats_handle(gpointer user_data);
 static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janus_ice_queued_packet *pkt);
+#ifdef HAVE_SCTP
+static void janus_ice_send_pending_data(janus_ice_handle *handle);
+#endif
 static gboolean janus_ice_outgoing_traffic_prepare(GSource *source, gint *timeout) {
 	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
+	if(t->handle->pending_data_deadline > 0) {
+		/* We're coalescing DataChannel messages, wake up in time to send them */
+		gint64 left = t->handle->pending_data_deadline - janus_get_monotonic_time();
+		if(left <= 0)
+			return TRUE;
+		*timeout = (left+999)/1000;
+	}
 	return (g_async_queue_length(t->handle->queued_packets) > 0);
 }
-static gboolean janus_ice_outgoing_traffic_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
-	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
+static gboolean janus_ice_outgoing_traffic_drain(janus_ice_outgoing_traffic *t) {
 	int ret = G_SOURCE_CONTINUE;
 	janus_ice_queued_packet *pkt = NULL;
 	while((pkt = g_async_queue_try_pop(t->handle->queued_packets)) != NULL) {
@@ -362,11 +618,37 @@ static gboolean janus_ice_outgoing_traffic_dispatch(GSource *source, GSourceFunc
 	}
 	return ret;
 }
+static gboolean janus_ice_outgoing_traffic_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
+	janus_ice_handle *handle = t->handle;
+	int ret = janus_ice_outgoing_traffic_drain(t);
+#ifdef HAVE_SCTP
+	if(ret == G_SOURCE_CONTINUE && handle->pending_data_deadline > 0 &&
+			janus_get_monotonic_time() >= handle->pending_data_deadline) {
+		/* Time to send the DataChannel messages we've been holding: this
+		 * queues the resulting SCTP packets, so we drain the queue again */
+		janus_ice_send_pending_data(handle);
+		ret = janus_ice_outgoing_traffic_drain(t);
+	}
+	/* Send the DTLS records we may have coalesced while draining the queue */
+	if(ret == G_SOURCE_CONTINUE && handle->stream && handle->stream->component)
+		janus_dtls_bio_agent_uncork(handle->stream->component->dtls);
+#endif
+	return ret;
+}
 static void janus_ice_outgoing_traffic_finalize(GSource *source) {
 	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Finalizing loop source\n", t->handle->handle_id);
 	if(static_event_loops > 0) {
 		/* This handle was sharing an event loop with others */
+		janus_mutex_lock(&event_loops_mutex);
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)t->handle->static_loop;
+		if(loop != NULL) {
+			loop->handles = g_list_remove(loop->handles, t->handle);
+			loop->handles_num--;
+			t->handle->static_loop = NULL;
+		}
+		janus_mutex_unlock(&event_loops_mutex);
 		janus_ice_webrtc_free(t->handle);
 		janus_refcount_decrease(&t->handle->ref);
 	} else if(t->handle->mainloop != NULL && g_main_loop_is_running(t->handle->mainloop)) {
@@ -393,7 +675,6 @@ static GSource *janus_ice_outgoing_traffic_create(janus_ice_handle *handle, GDes
 	t->destroy = destroy;
 	return source;
 }
-
 /* Time, in seconds, that should pass with no media (audio or video) being
  * received before Janus notifies you about this with a receiving=false */
 #define DEFAULT_NO_MEDIA_TIMER	60
@@ -438,6 +719,9 @@ static inline void janus_ice_free_queued_packet(janus_ice_queued_packet *pkt) {
 	g_free(pkt);
 }
 
+/* Maximum number of DataChannel messages to hold when coalescing them */
+#define JANUS_ICE_PENDING_DATA_MAX	64
+
 /* Maximum value, in milliseconds, for the NACK queue/retransmissions (default=500ms) */
 #define DEFAULT_MAX_NACK_QUEUE	500
 /* Maximum ignore count after retransmission (200ms) */
@@ -578,6 +862,16 @@ static void janus_ice_clear_queued_packets(janus_ice_handle *handle) {
 	}
 }
 
+static void janus_ice_clear_pending_data(janus_ice_handle *handle) {
+	if(handle == NULL || handle->pending_data == NULL) {
+		return;
+	}
+	janus_ice_queued_packet *pkt = NULL;
+	while((pkt = g_queue_pop_head(handle->pending_data)) != NULL)
+		janus_ice_free_queued_packet(pkt);
+	handle->pending_data_deadline = 0;
+}
+
 
 static void janus_ice_notify_trickle(janus_ice_handle *handle, char *buffer) {
 	if(handle == NULL)
@@ -1090,6 +1384,7 @@ janus_ice_handle *janus_ice_handle_create(void *core_session, const char *opaque
 	handle->app = NULL;
 	handle->app_handle = NULL;
 	handle->queued_packets = g_async_queue_new();
+	g_atomic_int_set(&handle->loop_pps, -1);
 	janus_mutex_init(&handle->mutex);
 	janus_session_handles_insert(session, handle);
 	return handle;
@@ -1133,15 +1428,15 @@ gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle
 		handle->mainctx = g_main_context_new();
 		handle->mainloop = g_main_loop_new(handle->mainctx, FALSE);
 	} else {
-		/* We're actually using static event loops, pick one from the list */
+		/* We're actually using static event loops, pick the least loaded one */
 		janus_refcount_increase(&handle->ref);
 		janus_mutex_lock(&event_loops_mutex);
-		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)current_loop->data;
+		janus_ice_static_event_loop *loop = janus_ice_static_event_loops_pick();
 		handle->mainctx = loop->mainctx;
 		handle->mainloop = loop->mainloop;
-		current_loop = current_loop->next;
-		if(current_loop == NULL)
-			current_loop = event_loops;
+		handle->static_loop = loop;
+		loop->handles = g_list_prepend(loop->handles, handle);
+		loop->handles_num++;
 		janus_mutex_unlock(&event_loops_mutex);
 	}
 	handle->rtp_source = janus_ice_outgoing_traffic_create(handle, (GDestroyNotify)g_free);
@@ -1218,6 +1513,8 @@ gint janus_ice_handle_destroy(void *core_session, janus_ice_handle *handle) {
 	if(g_atomic_int_compare_and_exchange(&handle->dump_packets, 1, 0)) {
 		janus_text2pcap_close(handle->text2pcap);
 		g_clear_pointer(&handle->text2pcap, janus_text2pcap_free);
+		janus_pcap_close(handle->pcap);
+		g_clear_pointer(&handle->pcap, janus_pcap_free);
 	}
 	/* We only actually destroy the handle later */
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Handle detached, scheduling destruction\n", handle->handle_id);
@@ -1234,6 +1531,11 @@ static void janus_ice_handle_free(const janus_refcount *handle_ref) {
 		janus_ice_clear_queued_packets(handle);
 		g_async_queue_unref(handle->queued_packets);
 	}
+	if(handle->pending_data != NULL) {
+		janus_ice_clear_pending_data(handle);
+		g_queue_free(handle->pending_data);
+		handle->pending_data = NULL;
+	}
 	if(static_event_loops == 0 && handle->mainloop != NULL) {
 		g_main_loop_unref(handle->mainloop);
 		handle->mainloop = NULL;
@@ -1406,8 +1708,10 @@ static void janus_ice_stream_free(const janus_refcount *stream_ref) {
 	if(stream->rtx_nacked[2])
 		g_hash_table_destroy(stream->rtx_nacked[2]);
 	stream->rtx_nacked[2] = NULL;
-	g_slist_free_full(stream->transport_wide_received_seq_nums, (GDestroyNotify)g_free);
-	stream->transport_wide_received_seq_nums = NULL;
+	g_free(stream->transport_wide_cc_ring);
+	stream->transport_wide_cc_ring = NULL;
+	janus_bwe_context_destroy(stream->bwe);
+	stream->bwe = NULL;
 	stream->audio_first_ntp_ts = 0;
 	stream->audio_first_rtp_ts = 0;
 	stream->video_first_ntp_ts[0] = 0;
@@ -2107,6 +2411,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 		return;
 	}
 	janus_session *session = (janus_session *)handle->session;
+	handle->loop_packets++;
 	if(!component->dtls) {	/* Still waiting for the DTLS stack */
 		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Still waiting for the DTLS stack for component %d in stream %d...\n", handle->handle_id, component_id, stream_id);
 		return;
@@ -2236,9 +2541,14 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					}
 				}
 				/* Do we need to dump this packet for debugging? */
-				if(g_atomic_int_get(&handle->dump_packets))
-					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTP, TRUE, buf, buflen,
-						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				if(g_atomic_int_get(&handle->dump_packets)) {
+					if(handle->pcap)
+						janus_pcap_dump(handle->pcap, video ? JANUS_PCAP_VIDEO : JANUS_PCAP_AUDIO, TRUE, buf, buflen,
+							"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+					else
+						janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTP, TRUE, buf, buflen,
+							"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				}
 				/* If this is a retransmission using RFC4588, we have to do something first to get the original packet */
 				janus_rtp_header *header = (janus_rtp_header *)buf;
 				if(rtx) {
@@ -2264,10 +2574,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					/* Get transport wide seq num */
 					if(janus_rtp_header_extension_parse_transport_wide_cc(buf, buflen, stream->transport_wide_cc_ext_id, &transport_seq_num)==0) {
 						/* Get current timestamp */
-						struct timeval now;
-						gettimeofday(&now,0);
-						/* Create <seq num, time> pair */
-						janus_rtcp_transport_wide_cc_stats *stats = g_malloc0(sizeof(janus_rtcp_transport_wide_cc_stats));
+						gint64 now = janus_get_monotonic_time();
 						/* Check if we have a sequence wrap */
 						if(transport_seq_num<0x0FFF && (stream->transport_wide_cc_last_seq_num&0xFFFF)>0xF000) {
 							/* Increase cycles */
@@ -2277,12 +2584,11 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						guint32 transport_ext_seq_num = stream->transport_wide_cc_cycles<<16 | transport_seq_num;
 						/* Store last received transport seq num */
 						stream->transport_wide_cc_last_seq_num = transport_seq_num;
-						/* Set stats values */
-						stats->transport_seq_num = transport_ext_seq_num;
-						stats->timestamp = (((guint64)now.tv_sec)*1E6+now.tv_usec);
-						/* Lock and append to received list */
+						/* Lock and store the arrival time in the ring */
 						janus_mutex_lock(&stream->mutex);
-						stream->transport_wide_received_seq_nums = g_slist_prepend(stream->transport_wide_received_seq_nums, stats);
+						if(stream->transport_wide_cc_ring == NULL)
+							stream->transport_wide_cc_ring = g_malloc0(sizeof(janus_rtcp_transport_wide_cc_ring));
+						janus_rtcp_transport_wide_cc_ring_add(stream->transport_wide_cc_ring, transport_ext_seq_num, now);
 						janus_mutex_unlock(&stream->mutex);
 					}
 				}
@@ -2553,9 +2859,14 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				JANUS_LOG(LOG_ERR, "[%"SCNu64"]     SRTCP unprotect error: %s (len=%d-->%d)\n", handle->handle_id, janus_srtp_error_str(res), len, buflen);
 			} else {
 				/* Do we need to dump this packet for debugging? */
-				if(g_atomic_int_get(&handle->dump_packets))
-					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, TRUE, buf, buflen,
-						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				if(g_atomic_int_get(&handle->dump_packets)) {
+					if(handle->pcap)
+						janus_pcap_dump(handle->pcap, JANUS_PCAP_RTCP, TRUE, buf, buflen,
+							"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+					else
+						janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, TRUE, buf, buflen,
+							"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				}
 				/* Check if there's an RTCP BYE: in case, let's log it */
 				if(janus_rtcp_has_bye(buf, buflen)) {
 					/* Note: we used to use this as a trigger to close the PeerConnection, but not anymore
@@ -2616,6 +2927,25 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				janus_rtcp_parse(rtcp_ctx, buf, buflen);
 				JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Got %s RTCP (%d bytes)\n", handle->handle_id, video ? "video" : "audio", len);
 
+				/* Check if there's transport wide feedback for what we sent */
+				if(stream->bwe != NULL) {
+					janus_rtcp_transport_wide_cc_status statuses[JANUS_BWE_MAX_FEEDBACK];
+					int count = janus_rtcp_get_transport_wide_cc_feedback(buf, buflen, statuses, JANUS_BWE_MAX_FEEDBACK);
+					if(count > 0) {
+						gint64 now = janus_get_monotonic_time();
+						guint32 estimate = janus_bwe_context_process_feedback(stream->bwe, statuses, count, now);
+						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Got transport wide feedback (%d packets), estimate: %"SCNu32"\n",
+							handle->handle_id, count, estimate);
+						if(janus_bwe_context_should_notify(stream->bwe, now, &estimate)) {
+							/* Tell the plugin */
+							janus_plugin *plugin = (janus_plugin *)handle->app;
+							if(plugin && plugin->incoming_bwe && janus_plugin_session_is_alive(handle->app_handle) &&
+									!g_atomic_int_get(&handle->destroyed))
+								plugin->incoming_bwe(handle->app_handle, estimate);
+						}
+					}
+				}
+
 				/* Now let's see if there are any NACKs to handle */
 				gint64 now = janus_get_monotonic_time();
 				GSList *nacks = janus_rtcp_get_nacks(buf, buflen);
@@ -2654,6 +2984,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 							pkt->type = video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
 							pkt->control = FALSE;
 							pkt->retransmission = TRUE;
+							pkt->keyframe = -1;
 							pkt->added = janus_get_monotonic_time();
 							/* What to send and how depends on whether we're doing RFC4588 or not */
 							if(!video || !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
@@ -3318,10 +3649,6 @@ void janus_ice_resend_trickles(janus_ice_handle *handle) {
 	janus_ice_notify_trickle(handle, NULL);
 }
 
-static gint rtcp_transport_wide_cc_stats_comparator(gconstpointer item1, gconstpointer item2) {
-	return ((rtcp_transport_wide_cc_stats*)item1)->transport_seq_num - ((rtcp_transport_wide_cc_stats*)item2)->transport_seq_num;
-}
-
 
 static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 	janus_ice_handle *handle = (janus_ice_handle *)user_data;
@@ -3438,84 +3765,23 @@ static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 			}
 		}
 	}
-	if(stream && stream->do_transport_wide_cc) {
-		/* Create a transport wide feedback message */
+	if(stream && stream->do_transport_wide_cc && stream->transport_wide_cc_ring != NULL) {
+		/* Create transport wide feedback messages for what we received since
+		 * the last time: each message covers up to JANUS_RTCP_TWCC_MAX_STATUSES
+		 * packets, so keep on going until there's nothing left to report */
 		size_t size = 1300;
 		char rtcpbuf[1300];
-		/* Order packet list */
-		stream->transport_wide_received_seq_nums = g_slist_sort(stream->transport_wide_received_seq_nums,
-			rtcp_transport_wide_cc_stats_comparator);
-		/* Create full stats queue */
-		GQueue *packets = g_queue_new();
-		/* For all packets */
-		GSList *it = NULL;
-		for(it = stream->transport_wide_received_seq_nums; it; it = it->next) {
-			/* Get stat */
-			janus_rtcp_transport_wide_cc_stats *stats = (janus_rtcp_transport_wide_cc_stats *)it->data;
-			/* Get transport seq */
-			guint32 transport_seq_num = stats->transport_seq_num;
-			/* Check if it is an out of order  */
-			if(transport_seq_num < stream->transport_wide_cc_last_feedback_seq_num) {
-				/* Skip, it was already reported as lost */
-				g_free(stats);
-				continue;
-			}
-			/* If not first */
-			if(stream->transport_wide_cc_last_feedback_seq_num) {
-				/* For each lost */
-				guint32 i = 0;
-				for(i = stream->transport_wide_cc_last_feedback_seq_num+1; i<transport_seq_num; ++i) {
-					/* Create new stat */
-					janus_rtcp_transport_wide_cc_stats *missing = g_malloc(sizeof(janus_rtcp_transport_wide_cc_stats));
-					/* Add missing packet */
-					missing->transport_seq_num = i;
-					missing->timestamp = 0;
-					/* Add it */
-					g_queue_push_tail(packets, missing);
-				}
-			}
-			/* Store last */
-			stream->transport_wide_cc_last_feedback_seq_num = transport_seq_num;
-			/* Add this one */
-			g_queue_push_tail(packets, stats);
-		}
-		/* Free and reset stats list */
-		g_slist_free(stream->transport_wide_received_seq_nums);
-		stream->transport_wide_received_seq_nums = NULL;
-		/* Create and enqueue RTCP packets */
-		guint packets_len = 0;
-		while((packets_len = g_queue_get_length(packets)) > 0) {
-			GQueue *packets_to_process;
-			/* If we have more than 400 packets to acknowledge, let's send more than one message */
-			if(packets_len > 400) {
-				/* Split the queue into two */
-				GList *new_head = g_queue_peek_nth_link(packets, 400);
-				GList *new_tail = new_head->prev;
-				new_head->prev = NULL;
-				new_tail->next = NULL;
-				packets_to_process = g_queue_new();
-				packets_to_process->head = packets->head;
-				packets_to_process->tail = new_tail;
-				packets_to_process->length = 400;
-				packets->head = new_head;
-				/* packets->tail is unchanged */
-				packets->length = packets_len - 400;
-			} else {
-				packets_to_process = packets;
-			}
-			/* Get feedback packet count and increase it for next one */
-			guint8 feedback_packet_count = stream->transport_wide_cc_feedback_count++;
-			/* Create RTCP packet */
-			int len = janus_rtcp_transport_wide_cc_feedback(rtcpbuf, size,
-				stream->video_ssrc, stream->video_ssrc_peer[0], feedback_packet_count, packets_to_process);
+		int len = 0;
+		janus_mutex_lock(&stream->mutex);
+		while((len = janus_rtcp_transport_wide_cc_feedback(rtcpbuf, size,
+				stream->video_ssrc, stream->video_ssrc_peer[0],
+				stream->transport_wide_cc_feedback_count, stream->transport_wide_cc_ring)) > 0) {
+			/* Increase the feedback packet count for the next one */
+			stream->transport_wide_cc_feedback_count++;
 			/* Enqueue it, we'll send it later */
 			janus_ice_relay_rtcp_internal(handle, 1, rtcpbuf, len, FALSE);
-			if(packets_to_process != packets) {
-				g_queue_free(packets_to_process);
-			}
 		}
-		/* Free mem */
-		g_queue_free(packets);
+		janus_mutex_unlock(&stream->mutex);
 	}
 	return G_SOURCE_CONTINUE;
 }
@@ -3525,6 +3791,9 @@ static gboolean janus_ice_outgoing_stats_handle(gpointer user_data) {
 	/* This callback is for stats and other things we need to do on a regular basis (typically called once per second) */
 	janus_session *session = (janus_session *)handle->session;
 	gint64 now = janus_get_monotonic_time();
+	/* Update the packet rate we balance static event loops on */
+	g_atomic_int_set(&handle->loop_pps, handle->loop_packets);
+	handle->loop_packets = 0;
 	/* Reset the last second counters if too much time passed with no data in or out */
 	janus_ice_stream *stream = handle->stream;
 	if(stream == NULL || stream->component == NULL)
@@ -3705,6 +3974,8 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 			handle->last_event_stats = janus_ice_event_stats_period;
 			(void)janus_ice_outgoing_stats_handle(handle);
 		}
+		/* Drop the DataChannel messages we may have been coalescing */
+		janus_ice_clear_pending_data(handle);
 		janus_ice_webrtc_free(handle);
 		return G_SOURCE_CONTINUE;
 	} else if(pkt == &janus_ice_detach_handle) {
@@ -3749,6 +4020,7 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		janus_ice_free_queued_packet(pkt);
 		return G_SOURCE_CONTINUE;
 	}
+	handle->loop_packets++;
 	gint64 age = (janus_get_monotonic_time() - pkt->added);
 	if(age > G_USEC_PER_SEC) {
 		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Discarding too old outgoing packet (age=%"SCNi64"us)\n", handle->handle_id, age);
@@ -3818,9 +4090,14 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 				g_clear_pointer(&prev_data, g_free);
 			}
 			/* Do we need to dump this packet for debugging? */
-			if(g_atomic_int_get(&handle->dump_packets))
-				janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, FALSE, pkt->data, pkt->length,
-					"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+			if(g_atomic_int_get(&handle->dump_packets)) {
+				if(handle->pcap)
+					janus_pcap_dump(handle->pcap, JANUS_PCAP_RTCP, FALSE, pkt->data, pkt->length,
+						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				else
+					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, FALSE, pkt->data, pkt->length,
+						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+			}
 			/* Encrypt SRTCP */
 			int protected = pkt->length;
 			int res = srtp_protect_rtcp(component->dtls->srtp_out, pkt->data, &protected);
@@ -3903,15 +4180,35 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 							stream->video_is_keyframe = &janus_h264_is_keyframe;
 					}
 				}
+				/* Stamp the transport wide sequence number, if the peer gives us feedback */
+				gboolean twcc_stamped = FALSE;
+				if(stream->transport_wide_cc_out_ext_id > 0) {
+					guint16 transport_seq_num = stream->transport_wide_cc_out_seq_num + 1;
+					if(janus_rtp_header_extension_set_transport_wide_cc(pkt->data, pkt->length,
+							stream->transport_wide_cc_out_ext_id, transport_seq_num) == 0) {
+						stream->transport_wide_cc_out_seq_num = transport_seq_num;
+						twcc_stamped = TRUE;
+					}
+				}
 				/* Do we need to dump this packet for debugging? */
-				if(g_atomic_int_get(&handle->dump_packets))
-					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTP, FALSE, pkt->data, pkt->length,
-						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				if(g_atomic_int_get(&handle->dump_packets)) {
+					if(handle->pcap)
+						janus_pcap_dump(handle->pcap, video ? JANUS_PCAP_VIDEO : JANUS_PCAP_AUDIO, FALSE, pkt->data, pkt->length,
+							"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+					else
+						janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTP, FALSE, pkt->data, pkt->length,
+							"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				}
 				/* If this is video, check if this is a keyframe: if so, we empty our retransmit buffer for incoming NACKs */
-				if(video && stream->video_is_keyframe) {
-					int plen = 0;
-					char *payload = janus_rtp_payload(pkt->data, pkt->length, &plen);
-					if(stream->video_is_keyframe(payload, plen)) {
+				if(video && (pkt->keyframe >= 0 || stream->video_is_keyframe)) {
+					gboolean keyframe = (pkt->keyframe > 0);
+					if(pkt->keyframe < 0) {
+						/* The plugin didn't tell us, check the payload */
+						int plen = 0;
+						char *payload = janus_rtp_payload(pkt->data, pkt->length, &plen);
+						keyframe = stream->video_is_keyframe(payload, plen);
+					}
+					if(keyframe) {
 						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Keyframe sent, cleaning retransmit buffer\n", handle->handle_id);
 						janus_cleanup_nack_buffer(0, stream, FALSE, TRUE);
 					}
@@ -3959,6 +4256,13 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 					}
 					/* Update stats */
 					if(sent > 0) {
+						/* Keep track of the packet for bandwidth estimation purposes */
+						if(twcc_stamped) {
+							if(stream->bwe == NULL)
+								stream->bwe = janus_bwe_context_create(0);
+							janus_bwe_context_add_sent_packet(stream->bwe,
+								stream->transport_wide_cc_out_seq_num, sent, janus_get_monotonic_time());
+						}
 						/* Update the RTCP context as well */
 						janus_rtp_header *header = (janus_rtp_header *)pkt->data;
 						guint32 timestamp = ntohl(header->timestamp);
@@ -4071,7 +4375,19 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 				return G_SOURCE_CONTINUE;
 			}
 			component->noerrorlog = FALSE;
-			janus_dtls_wrap_sctp_data(component->dtls, pkt->data, pkt->length);
+			guint delay = janus_sctp_get_coalesce_delay();
+			if(delay > 0) {
+				/* Hold the message for a bit, so that we can send it along with others */
+				if(handle->pending_data == NULL)
+					handle->pending_data = g_queue_new();
+				g_queue_push_tail(handle->pending_data, pkt);
+				if(handle->pending_data_deadline == 0)
+					handle->pending_data_deadline = pkt->added + (gint64)delay*1000;
+				if(g_queue_get_length(handle->pending_data) >= JANUS_ICE_PENDING_DATA_MAX)
+					janus_ice_send_pending_data(handle);
+				return G_SOURCE_CONTINUE;
+			}
+			janus_dtls_wrap_sctp_data(component->dtls, pkt->data, pkt->length, FALSE);
 #endif
 		} else if(pkt->type == JANUS_ICE_PACKET_SCTP) {
 			/* SCTP data to push */
@@ -4090,6 +4406,8 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 				return G_SOURCE_CONTINUE;
 			}
 			component->noerrorlog = FALSE;
+			/* Coalesce the DTLS records until we're done draining the queue */
+			janus_dtls_bio_agent_cork(component->dtls);
 			janus_dtls_send_sctp_data(component->dtls, pkt->data, pkt->length);
 #endif
 		} else {
@@ -4100,6 +4418,24 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 	return G_SOURCE_CONTINUE;
 }
 
+#ifdef HAVE_SCTP
+static void janus_ice_send_pending_data(janus_ice_handle *handle) {
+	janus_ice_component *component = handle->stream ? handle->stream->component : NULL;
+	if(component == NULL || component->dtls == NULL) {
+		janus_ice_clear_pending_data(handle);
+		return;
+	}
+	/* Tell the SCTP stack more messages are coming, so that it bundles them */
+	janus_ice_queued_packet *pkt = NULL;
+	while((pkt = g_queue_pop_head(handle->pending_data)) != NULL) {
+		janus_dtls_wrap_sctp_data(component->dtls, pkt->data, pkt->length,
+			!g_queue_is_empty(handle->pending_data));
+		janus_ice_free_queued_packet(pkt);
+	}
+	handle->pending_data_deadline = 0;
+}
+#endif
+
 static void janus_ice_queue_packet(janus_ice_handle *handle, janus_ice_queued_packet *pkt) {
 	/* TODO: There is a potential race condition where the "queued_packets"
 	 * could get released between the condition and pushing the packet. */
@@ -4112,6 +4448,10 @@ static void janus_ice_queue_packet(janus_ice_handle *handle, janus_ice_queued_pa
 }
 
 void janus_ice_relay_rtp(janus_ice_handle *handle, int video, char *buf, int len) {
+	janus_ice_relay_rtp_info(handle, video, buf, len, NULL);
+}
+
+void janus_ice_relay_rtp_info(janus_ice_handle *handle, int video, char *buf, int len, const janus_rtp_video_info *info) {
 	if(!handle || handle->queued_packets == NULL || buf == NULL || len < 1)
 		return;
 	if((!video && !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_AUDIO))
@@ -4119,13 +4459,24 @@ void janus_ice_relay_rtp(janus_ice_handle *handle, int video, char *buf, int len
 		return;
 	/* Queue this packet */
 	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
-	pkt->data = g_malloc(len+SRTP_MAX_TAG_LEN);
+	pkt->data = g_malloc(len+SRTP_MAX_TAG_LEN+8);
 	memcpy(pkt->data, buf, len);
 	pkt->length = len;
+	janus_ice_stream *stream = handle->stream;
+	if(stream && stream->transport_wide_cc_out_ext_id > 0) {
+		/* Make sure there's a transport wide cc extension we can stamp before sending */
+		int newlen = janus_rtp_header_extension_add_transport_wide_cc(pkt->data, len,
+			len+SRTP_MAX_TAG_LEN+8, stream->transport_wide_cc_out_ext_id);
+		if(newlen > 0)
+			pkt->length = newlen;
+	}
 	pkt->type = video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
 	pkt->control = FALSE;
 	pkt->encrypted = FALSE;
 	pkt->retransmission = FALSE;
+	pkt->keyframe = -1;
+	if(video && info != NULL && (info->flags & JANUS_RTP_VIDEO_INFO_PARSED))
+		pkt->keyframe = (info->flags & JANUS_RTP_VIDEO_INFO_KEYFRAME) ? 1 : 0;
 	pkt->added = janus_get_monotonic_time();
 	janus_ice_queue_packet(handle, pkt);
 }
@@ -4165,6 +4516,7 @@ void janus_ice_relay_rtcp_internal(janus_ice_handle *handle, int video, char *bu
 	pkt->control = TRUE;
 	pkt->encrypted = FALSE;
 	pkt->retransmission = FALSE;
+	pkt->keyframe = -1;
 	pkt->added = janus_get_monotonic_time();
 	janus_ice_queue_packet(handle, pkt);
 	if(rtcp_buf != buf) {
@@ -4190,6 +4542,7 @@ void janus_ice_relay_data(janus_ice_handle *handle, char *buf, int len) {
 	pkt->control = FALSE;
 	pkt->encrypted = FALSE;
 	pkt->retransmission = FALSE;
+	pkt->keyframe = -1;
 	pkt->added = janus_get_monotonic_time();
 	janus_ice_queue_packet(handle, pkt);
 }
@@ -4208,6 +4561,7 @@ void janus_ice_relay_sctp(janus_ice_handle *handle, char *buffer, int length) {
 	pkt->control = FALSE;
 	pkt->encrypted = FALSE;
 	pkt->retransmission = FALSE;
+	pkt->keyframe = -1;
 	pkt->added = janus_get_monotonic_time();
 	janus_ice_queue_packet(handle, pkt);
 #endif
@@ -24,7 +24,9 @@
 #include "dtls.h"
 #include "sctp.h"
 #include "rtcp.h"
+#include "bwe.h"
 #include "text2pcap.h"
+#include "pcap.h"
 #include "utils.h"
 #include "refcount.h"
 #include "plugins/plugin.h"
@@ -271,6 +273,12 @@ struct janus_ice_handle {
 	GThread *thread;
 	/*! \brief GLib sources for outgoing traffic, recurring RTCP, and stats */
 	GSource *rtp_source, *rtcp_source, *stats_source;
+	/*! \brief Opaque pointer to the static event loop this handle is on, if static loops are enabled */
+	void *static_loop;
+	/*! \brief Packets sent and received by this handle in the current second */
+	guint loop_packets;
+	/*! \brief Packets per second sent and received by this handle in the last second (-1 if unknown) */
+	volatile gint loop_pps;
 	/*! \brief libnice ICE agent */
 	NiceAgent *agent;
 	/*! \brief Monotonic time of when the ICE agent has been created */
@@ -301,16 +309,22 @@ struct janus_ice_handle {
 	GList *pending_trickles;
 	/*! \brief Queue of events in the loop and outgoing packets to send */
 	GAsyncQueue *queued_packets;
+	/*! \brief Outgoing DataChannel messages being held to coalesce them, if enabled */
+	GQueue *pending_data;
+	/*! \brief Monotonic time of when the pending DataChannel messages must be sent at the latest */
+	gint64 pending_data_deadline;
 	/*! \brief Count of the recent SRTP replay errors, in order to avoid spamming the logs */
 	guint srtp_errors_count;
 	/*! \brief Count of the recent SRTP replay errors, in order to avoid spamming the logs */
 	gint last_srtp_error, last_srtp_summary;
 	/*! \brief Count of how many seconds passed since the last stats passed to event handlers */
 	gint last_event_stats;
-	/*! \brief Flag to decide whether or not packets need to be dumped to a text2pcap file */
+	/*! \brief Flag to decide whether or not packets need to be dumped to a text2pcap or pcapng file */
 	volatile gint dump_packets;
 	/*! \brief In case this session must be saved to text2pcap, the instance to dump packets to */
 	janus_text2pcap *text2pcap;
+	/*! \brief In case this session must be captured to pcapng, the instance to dump packets to */
+	janus_pcap *pcap;
 	/*! \brief Mutex to lock/unlock the ICE session */
 	janus_mutex mutex;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
@@ -381,14 +395,18 @@ struct janus_ice_stream {
 	guint transport_wide_cc_ext_id;
 	/*! \brief Last received transport wide seq num */
 	guint32 transport_wide_cc_last_seq_num;
-	/*! \brief Last transport wide seq num sent on feedback */
-	guint32 transport_wide_cc_last_feedback_seq_num;
 	/*! \brief Transport wide cc transport seq num wrap cycles */
 	guint16 transport_wide_cc_cycles;
 	/*! \brief Transport wide cc rtp ext ID */
 	guint transport_wide_cc_feedback_count;
-	/*! \brief GLib list of transport wide cc stats in reverse received order */
-	GSList *transport_wide_received_seq_nums;
+	/*! \brief Ring of transport wide cc reception stats we still have to report */
+	janus_rtcp_transport_wide_cc_ring *transport_wide_cc_ring;
+	/*! \brief Transport wide cc rtp ext ID the peer negotiated for the media we send, if any */
+	guint transport_wide_cc_out_ext_id;
+	/*! \brief Last transport wide seq num we stamped outgoing packets with */
+	guint16 transport_wide_cc_out_seq_num;
+	/*! \brief Bandwidth estimation context, fed by the transport wide cc feedback the peer sends us */
+	janus_bwe_context *bwe;
 	/*! \brief DTLS role of the server for this stream */
 	janus_dtls_role dtls_role;
 	/*! \brief Hashing algorhitm used by the peer for the DTLS certificate (e.g., "SHA-256") */
@@ -554,6 +572,13 @@ void janus_ice_component_destroy(janus_ice_component *component);
  * @param[in] buf The packet data (buffer)
  * @param[in] len The buffer lenght */
 void janus_ice_relay_rtp(janus_ice_handle *handle, int video, char *buf, int len);
+/*! \brief Same as janus_ice_relay_rtp, with the codec info the plugin parsed already
+ * @param[in] handle The Janus ICE handle associated with the peer
+ * @param[in] video Whether this is an audio or a video frame
+ * @param[in] buf The packet data (buffer)
+ * @param[in] len The buffer lenght
+ * @param[in] info The codec info of the packet, if any */
+void janus_ice_relay_rtp_info(janus_ice_handle *handle, int video, char *buf, int len, const janus_rtp_video_info *info);
 /*! \brief Core RTCP callback, called when a plugin has an RTCP message to send to a peer
  * @param[in] handle The Janus ICE handle associated with the peer
  * @param[in] video Whether this is related to an audio or a video stream
@@ -618,8 +643,22 @@ void janus_ice_resend_trickles(janus_ice_handle *handle);
 /*! \brief Method to configure the static event loops mechanism at startup
  * @note Check the \c event_loops property in the \c janus.cfg configuration
  * for an explanation of this feature, and the possible impact on Janus and users
- * @param[in] loops The number of static event loops to start (0 to disable the feature) */
-void janus_ice_set_static_event_loops(int loops);
+ * @param[in] loops The number of static event loops to start (0 to disable the feature)
+ * @param[in] affinity Comma separated list of CPUs, CPU ranges or NUMA nodes (e.g., \c node0)
+ * to pin the loops to in a round robin fashion (Linux only, NULL to disable pinning) */
+void janus_ice_set_static_event_loops(int loops, const char *affinity);
+/*! \brief Method to enable the rebalancing of new handles between static event loops
+ * @note New handles are always added to the least loaded loop, where the
+ * load is the packet rate of the handles it serves: when enabled, Janus also
+ * periodically closes to new handles the loops whose load exceeds the one
+ * of the idlest loop by more than the provided threshold, until it catches
+ * up. Existing handles never move, as their ICE agent lives on their loop
+ * @param[in] threshold Percentage of the load of a loop the imbalance
+ * must exceed to close it to new handles (0 disables rebalancing) */
+void janus_ice_set_event_loops_rebalance(int threshold);
+/*! \brief Method to get information on the static event loops (e.g., for the Admin API)
+ * @returns A JSON object with the load, handles and CPUs of each static loop */
+json_t *janus_ice_static_event_loops_info(void);
 /*! \brief Method to return the number of static event loops, if enabled
  * @returns The number of static event loops, if configured, or 0 if the feature is disabled */
 int janus_ice_get_static_event_loops(void);
@@ -144,6 +144,17 @@ static struct janus_json_parameter text2pcap_parameters[] = {
 	{"filename", JSON_STRING, 0},
 	{"truncate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
+static struct janus_json_parameter pcap_parameters[] = {
+	{"folder", JSON_STRING, 0},
+	{"filename", JSON_STRING, 0},
+	{"truncate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"audio", JANUS_JSON_BOOL, 0},
+	{"video", JANUS_JSON_BOOL, 0},
+	{"rtcp", JANUS_JSON_BOOL, 0},
+	{"sample", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"rotate_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"rotate_time", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
 
 /* Admin/Monitor helpers */
 json_t *janus_admin_stream_summary(janus_ice_stream *stream);
@@ -404,10 +415,67 @@ static janus_transport_callbacks janus_handler_transport =
 		.events_is_enabled = janus_events_is_enabled,
 		.notify_event = janus_transport_notify_event,
 	};
-static GAsyncQueue *requests = NULL;
-static janus_request exit_message;
-static GThreadPool *tasks = NULL;
-void janus_transport_task(gpointer data, gpointer user_data);
+///@}
+
+
+/** @name Request executor
+ * Incoming requests are not handled by a single dispatcher anymore, but
+ * by a pool of workers. Requests addressing the same session are queued
+ * in a per-session lane, which guarantees they're processed one at a time
+ * and in order; lanes are then scheduled on per-worker run queues (picked
+ * according to the session ID), and workers that have nothing to do steal
+ * whole lanes from the busy ones.
+ */
+///@{
+#define JANUS_REQUEST_WORKERS_DEFAULT	4
+/* How many requests of the same lane a worker can serve before yielding */
+#define JANUS_REQUEST_LANE_BATCH		16
+/* Buckets (in microseconds) for the queueing latency histogram */
+#define JANUS_REQUEST_LATENCY_BUCKETS	8
+static const gint64 janus_request_latency_bounds[JANUS_REQUEST_LATENCY_BUCKETS-1] = {
+	1000, 5000, 10000, 50000, 100000, 500000, 1000000
+};
+static const char *janus_request_latency_labels[JANUS_REQUEST_LATENCY_BUCKETS] = {
+	"1ms", "5ms", "10ms", "50ms", "100ms", "500ms", "1s", "more"
+};
+/* Buckets for the queue depth histogram (pending requests when enqueueing) */
+#define JANUS_REQUEST_DEPTH_BUCKETS		6
+static const guint janus_request_depth_bounds[JANUS_REQUEST_DEPTH_BUCKETS-1] = {
+	0, 4, 16, 64, 256
+};
+static const char *janus_request_depth_labels[JANUS_REQUEST_DEPTH_BUCKETS] = {
+	"0", "4", "16", "64", "256", "more"
+};
+/* A lane of requests all addressing the same session (or a single, sessionless, request) */
+typedef struct janus_request_worker janus_request_worker;
+typedef struct janus_request_lane {
+	guint64 session_id;
+	GQueue requests;
+	/* Whether the lane is in a run queue or being served */
+	gboolean scheduled;
+	/* Worker currently owning the lane */
+	janus_request_worker *worker;
+} janus_request_lane;
+struct janus_request_worker {
+	guint id;
+	GThread *thread;
+	/* Lanes ready to be served by this worker */
+	GQueue lanes;
+	/* Requests waiting in the lanes currently assigned to this worker */
+	guint depth;
+	guint64 processed, stolen;
+	guint64 latency[JANUS_REQUEST_LATENCY_BUCKETS];
+	gint64 max_latency;
+};
+static janus_request_worker *request_workers = NULL;
+static guint request_workers_num = 0, request_workers_rr = 0;
+static GHashTable *request_lanes = NULL;
+static guint64 request_depth_histogram[JANUS_REQUEST_DEPTH_BUCKETS];
+static volatile gint request_workers_stop = 0;
+static janus_mutex request_mutex;
+static janus_condition request_cond;
+static void *janus_request_worker_thread(void *data);
+static json_t *janus_request_workers_stats(void);
 ///@}
 
 
@@ -420,6 +488,7 @@ void janus_transport_task(gpointer data, gpointer user_data);
 int janus_plugin_push_event(janus_plugin_session *plugin_session, janus_plugin *plugin, const char *transaction, json_t *message, json_t *jsep);
 json_t *janus_plugin_handle_sdp(janus_plugin_session *plugin_session, janus_plugin *plugin, const char *sdp_type, const char *sdp, gboolean restart);
 void janus_plugin_relay_rtp(janus_plugin_session *plugin_session, int video, char *buf, int len);
+void janus_plugin_relay_rtp_info(janus_plugin_session *plugin_session, int video, char *buf, int len, const janus_rtp_video_info *info);
 void janus_plugin_relay_rtcp(janus_plugin_session *plugin_session, int video, char *buf, int len);
 void janus_plugin_relay_data(janus_plugin_session *plugin_session, char *buf, int len);
 void janus_plugin_close_pc(janus_plugin_session *plugin_session);
@@ -439,6 +508,7 @@ static janus_callbacks janus_handler_plugin =
 		.notify_event = janus_plugin_notify_event,
 		.auth_is_signature_valid = janus_plugin_auth_is_signature_valid,
 		.auth_signature_contains = janus_plugin_auth_signature_contains,
+		.relay_rtp_info = janus_plugin_relay_rtp_info,
 	};
 ///@}
 
@@ -675,11 +745,12 @@ janus_request *janus_request_new(janus_transport *transport, janus_transport_ses
 	request->request_id = request_id;
 	request->admin = admin;
 	request->message = message;
+	request->queued = 0;
 	return request;
 }
 
 void janus_request_destroy(janus_request *request) {
-	if(request == NULL || request == &exit_message)
+	if(request == NULL)
 		return;
 	request->transport = NULL;
 	janus_refcount_decrease(&request->instance->ref);
@@ -1251,6 +1322,10 @@ int janus_process_incoming_request(janus_request *request) {
 						janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_TRICKLE);
 					}
 					janus_request_ice_handle_answer(handle, audio, video, data, jsep_sdp);
+					/* Check if the peer accepted transport wide CC for what we send */
+					int transport_wide_cc_ext_id = janus_rtp_header_extension_get_id(jsep_sdp, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
+					if(handle->stream)
+						handle->stream->transport_wide_cc_out_ext_id = transport_wide_cc_ext_id > 0 ? transport_wide_cc_ext_id : 0;
 				} else {
 					/* Check if transport wide CC is supported */
 					int transport_wide_cc_ext_id = janus_rtp_header_extension_get_id(jsep_sdp, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
@@ -1271,6 +1346,11 @@ int janus_process_incoming_request(janus_request *request) {
 					goto jsondone;
 				}
 				renegotiation = TRUE;
+				if(!offer && handle->stream) {
+					/* The peer may have added or removed transport wide CC for what we send */
+					int transport_wide_cc_ext_id = janus_rtp_header_extension_get_id(jsep_sdp, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
+					handle->stream->transport_wide_cc_out_ext_id = transport_wide_cc_ext_id > 0 ? transport_wide_cc_ext_id : 0;
+				}
 				if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ICE_RESTART)) {
 					JANUS_LOG(LOG_INFO, "[%"SCNu64"] Restarting ICE...\n", handle->handle_id);
 					/* Update remote credentials for ICE */
@@ -1705,10 +1785,29 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			json_object_set_new(status, "libnice_debug", janus_ice_is_ice_debugging_enabled() ? json_true() : json_false());
 			json_object_set_new(status, "max_nack_queue", json_integer(janus_get_max_nack_queue()));
 			json_object_set_new(status, "no_media_timer", json_integer(janus_get_no_media_timer()));
+			json_object_set_new(status, "request_workers", json_integer(request_workers_num));
 			json_object_set_new(reply, "status", status);
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "get_request_stats")) {
+			/* Return the state of the requests workers (queues and latency histograms) */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "requests", janus_request_workers_stats());
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+		} else if(!strcasecmp(message_text, "get_event_loops")) {
+			/* Return the load of the static event loops, if enabled */
+			if(janus_ice_get_static_event_loops() == 0) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN, "Static event loops are disabled");
+				goto jsondone;
+			}
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "event_loops", janus_ice_static_event_loops_info());
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else if(!strcasecmp(message_text, "set_session_timeout")) {
 			/* Change the session timeout value */
 			JANUS_VALIDATE_JSON_OBJECT(root, timeout_parameters,
@@ -2117,7 +2216,7 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			const char *folder = json_string_value(json_object_get(root, "folder"));
 			const char *filename = json_string_value(json_object_get(root, "filename"));
 			int truncate = json_integer_value(json_object_get(root, "truncate"));
-			if(handle->text2pcap != NULL) {
+			if(handle->text2pcap != NULL || handle->pcap != NULL) {
 				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN, "text2pcap already started");
 				goto jsondone;
 			}
@@ -2134,6 +2233,65 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "start_pcap")) {
+			/* Start capturing RTP and RTCP packets to a pcapng file */
+			JANUS_VALIDATE_JSON_OBJECT(root, pcap_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			const char *folder = json_string_value(json_object_get(root, "folder"));
+			const char *filename = json_string_value(json_object_get(root, "filename"));
+			int truncate = json_integer_value(json_object_get(root, "truncate"));
+			json_t *audio = json_object_get(root, "audio");
+			json_t *video = json_object_get(root, "video");
+			json_t *rtcp = json_object_get(root, "rtcp");
+			int filter = JANUS_PCAP_DATA;
+			if(audio == NULL || json_is_true(audio))
+				filter |= JANUS_PCAP_AUDIO;
+			if(video == NULL || json_is_true(video))
+				filter |= JANUS_PCAP_VIDEO;
+			if(rtcp == NULL || json_is_true(rtcp))
+				filter |= JANUS_PCAP_RTCP;
+			guint sample = json_integer_value(json_object_get(root, "sample"));
+			gint64 rotate_size = json_integer_value(json_object_get(root, "rotate_size"));
+			gint rotate_time = json_integer_value(json_object_get(root, "rotate_time"));
+			if(handle->text2pcap != NULL || handle->pcap != NULL) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN, "pcap already started");
+				goto jsondone;
+			}
+			handle->pcap = janus_pcap_create(folder, filename, truncate, filter, sample, rotate_size, rotate_time);
+			if(handle->pcap == NULL) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN, "Error starting pcap capture");
+				goto jsondone;
+			}
+			g_atomic_int_set(&handle->dump_packets, 1);
+			/* Prepare JSON reply */
+			json_t *reply = json_object();
+			json_object_set_new(reply, "janus", json_string("success"));
+			json_object_set_new(reply, "transaction", json_string(transaction_text));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+		} else if(!strcasecmp(message_text, "stop_pcap")) {
+			/* Stop capturing RTP and RTCP packets to a pcapng file */
+			if(handle->pcap == NULL) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN, "pcap not started");
+				goto jsondone;
+			}
+			if(g_atomic_int_compare_and_exchange(&handle->dump_packets, 1, 0)) {
+				janus_pcap_close(handle->pcap);
+				g_clear_pointer(&handle->pcap, janus_pcap_free);
+			}
+			/* Prepare JSON reply */
+			json_t *reply = json_object();
+			json_object_set_new(reply, "janus", json_string("success"));
+			json_object_set_new(reply, "transaction", json_string(transaction_text));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else if(!strcasecmp(message_text, "stop_text2pcap")) {
 			/* Stop dumping RTP and RTCP packets to a text2pcap file */
 			if(handle->text2pcap == NULL) {
@@ -2152,7 +2310,7 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			ret = janus_process_success(request, reply);
 			goto jsondone;
 		}
-		/* If this is not a request to start/stop debugging to text2pcap, it must be a handle_info */
+		/* If this is not a request to start/stop debugging to text2pcap or pcap, it must be a handle_info */
 		if(strcasecmp(message_text, "handle_info")) {
 			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_REQUEST_PATH, "Unhandled request '%s' at this path", message_text);
 			goto jsondone;
@@ -2227,9 +2385,21 @@ int janus_process_incoming_admin_request(janus_request *request) {
 		if(handle->queued_packets)
 			json_object_set_new(info, "queued-packets", json_integer(g_async_queue_length(handle->queued_packets)));
 		if(g_atomic_int_get(&handle->dump_packets)) {
-			json_object_set_new(info, "dump-to-text2pcap", json_true());
-			if(handle->text2pcap && handle->text2pcap->filename)
-			json_object_set_new(info, "text2pcap-file", json_string(handle->text2pcap->filename));
+			if(handle->pcap) {
+				janus_pcap *pcap = handle->pcap;
+				json_object_set_new(info, "dump-to-pcap", json_true());
+				janus_mutex_lock(&pcap->mutex);
+				if(pcap->current)
+					json_object_set_new(info, "pcap-file", json_string(pcap->current));
+				janus_mutex_unlock(&pcap->mutex);
+				json_object_set_new(info, "pcap-packets", json_integer(g_atomic_int_get(&pcap->packets)));
+				json_object_set_new(info, "pcap-dropped", json_integer(g_atomic_int_get(&pcap->dropped)));
+				json_object_set_new(info, "pcap-files", json_integer(g_atomic_int_get(&pcap->files)));
+			} else {
+				json_object_set_new(info, "dump-to-text2pcap", json_true());
+				if(handle->text2pcap && handle->text2pcap->filename)
+				json_object_set_new(info, "text2pcap-file", json_string(handle->text2pcap->filename));
+			}
 		}
 		json_t *streams = json_array();
 		if(handle->stream) {
@@ -2454,7 +2624,7 @@ json_t *janus_admin_component_summary(janus_ice_component *component) {
 	json_t *out_stats = json_object();
 	if(component->dtls) {
 		janus_dtls_srtp *dtls = component->dtls;
-		json_object_set_new(d, "fingerprint", json_string(janus_dtls_get_local_fingerprint()));
+		json_object_set_new(d, "fingerprint", json_string(janus_dtls_srtp_get_local_fingerprint(dtls)));
 		if(component->stream) {
 			if(component->stream->remote_fingerprint)
 				json_object_set_new(d, "remote-fingerprint", json_string(component->stream->remote_fingerprint));
@@ -2548,8 +2718,46 @@ void janus_transport_incoming_request(janus_transport *plugin, janus_transport_s
 	JANUS_LOG(LOG_VERB, "Got %s API request from %s (%p)\n", admin ? "an admin" : "a Janus", plugin->get_package(), transport);
 	/* Create a janus_request instance to handle the request */
 	janus_request *request = janus_request_new(plugin, transport, request_id, admin, message);
-	/* Enqueue the request, the thread will pick it up */
-	g_async_queue_push(requests, request);
+	/* Enqueue the request in the lane of its session, a worker will pick it up */
+	guint64 session_id = 0;
+	json_t *s = json_object_get(message, "session_id");
+	if(s && json_is_integer(s))
+		session_id = json_integer_value(s);
+	request->queued = janus_get_monotonic_time();
+	janus_mutex_lock(&request_mutex);
+	if(g_atomic_int_get(&request_workers_stop)) {
+		janus_mutex_unlock(&request_mutex);
+		janus_request_destroy(request);
+		return;
+	}
+	janus_request_lane *lane = session_id ? g_hash_table_lookup(request_lanes, &session_id) : NULL;
+	if(lane == NULL) {
+		lane = g_malloc0(sizeof(janus_request_lane));
+		lane->session_id = session_id;
+		g_queue_init(&lane->requests);
+		/* Sessionless requests (e.g., create or info) don't need any ordering */
+		if(session_id > 0)
+			g_hash_table_insert(request_lanes, janus_uint64_dup(session_id), lane);
+	}
+	g_queue_push_tail(&lane->requests, request);
+	janus_request_worker *worker = &request_workers[session_id ?
+		(session_id % request_workers_num) : (request_workers_rr++ % request_workers_num)];
+	if(lane->scheduled)
+		worker = lane->worker;
+	guint depth = worker->depth, i = 0;
+	while(i < JANUS_REQUEST_DEPTH_BUCKETS-1 && depth > janus_request_depth_bounds[i])
+		i++;
+	request_depth_histogram[i]++;
+	worker->depth++;
+	if(!lane->scheduled) {
+		/* Schedule the lane on the worker of this session: if the worker
+		 * is busy, another idle one will steal it from the run queue */
+		lane->scheduled = TRUE;
+		lane->worker = worker;
+		g_queue_push_tail(&worker->lanes, lane);
+		janus_condition_broadcast(&request_cond);
+	}
+	janus_mutex_unlock(&request_mutex);
 }
 
 void janus_transport_gone(janus_transport *plugin, janus_transport_session *transport) {
@@ -2614,66 +2822,129 @@ void janus_transport_notify_event(janus_transport *plugin, void *transport, json
 	}
 }
 
-void janus_transport_task(gpointer data, gpointer user_data) {
-	JANUS_LOG(LOG_VERB, "Transport task pool, serving request\n");
-	janus_request *request = (janus_request *)data;
-	if(request == NULL) {
-		JANUS_LOG(LOG_ERR, "Missing request\n");
-		return;
+/* Pick the next lane to serve: our own run queue first, then steal from the others */
+static janus_request_lane *janus_request_worker_next_lane(janus_request_worker *worker) {
+	janus_request_lane *lane = g_queue_pop_head(&worker->lanes);
+	if(lane != NULL)
+		return lane;
+	/* Nothing to do, steal the oldest lane from the busiest worker */
+	janus_request_worker *victim = NULL;
+	guint i = 0;
+	for(i=0; i<request_workers_num; i++) {
+		janus_request_worker *w = &request_workers[i];
+		if(w == worker || g_queue_is_empty(&w->lanes))
+			continue;
+		if(victim == NULL || w->depth > victim->depth)
+			victim = w;
 	}
-	if(!request->admin)
-		janus_process_incoming_request(request);
-	else
-		janus_process_incoming_admin_request(request);
-	/* Done */
-	janus_request_destroy(request);
+	if(victim == NULL)
+		return NULL;
+	lane = g_queue_pop_head(&victim->lanes);
+	guint pending = g_queue_get_length(&lane->requests);
+	victim->depth -= pending;
+	worker->depth += pending;
+	lane->worker = worker;
+	worker->stolen++;
+	return lane;
 }
 
-
-/* Thread to handle incoming requests: may involve an asynchronous task for plugin messaging */
-static void *janus_transport_requests(void *data) {
-	JANUS_LOG(LOG_INFO, "Joining Janus requests handler thread\n");
-	janus_request *request = NULL;
-	gboolean destroy = FALSE;
-	while(!g_atomic_int_get(&stop)) {
-		request = g_async_queue_pop(requests);
-		if(request == &exit_message)
-			break;
-		/* Should we process the request synchronously or with a task from the thread pool? */
-		destroy = TRUE;
-		if(!request->admin) {
-			/* Process the request synchronously only it's not a message for a plugin */
-			json_t *message = json_object_get(request->message, "janus");
-			const gchar *message_text = json_string_value(message);
-			if(message_text && !strcasecmp(message_text, "message")) {
-				/* Spawn a task thread */
-				GError *tperror = NULL;
-				g_thread_pool_push(tasks, request, &tperror);
-				if(tperror != NULL) {
-					/* Something went wrong... */
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to push task in thread pool...\n", tperror->code, tperror->message ? tperror->message : "??");
-					json_t *transaction = json_object_get(message, "transaction");
-					const char *transaction_text = json_is_string(transaction) ? json_string_value(transaction) : NULL;
-					janus_process_error(request, 0, transaction_text, JANUS_ERROR_UNKNOWN, "Thread pool error");
-				} else {
-					/* Don't destroy the request now, the task will take care of that */
-					destroy = FALSE;
-				}
-			} else {
+static void *janus_request_worker_thread(void *data) {
+	janus_request_worker *worker = (janus_request_worker *)data;
+	JANUS_LOG(LOG_INFO, "Joining Janus requests worker #%u\n", worker->id);
+	janus_mutex_lock(&request_mutex);
+	while(!g_atomic_int_get(&request_workers_stop)) {
+		janus_request_lane *lane = janus_request_worker_next_lane(worker);
+		if(lane == NULL) {
+			janus_condition_wait(&request_cond, &request_mutex);
+			continue;
+		}
+		/* Serve the requests in this lane, in order */
+		guint served = 0;
+		janus_request *request = NULL;
+		while(served < JANUS_REQUEST_LANE_BATCH && (request = g_queue_pop_head(&lane->requests)) != NULL) {
+			worker->depth--;
+			gint64 latency = janus_get_monotonic_time() - request->queued;
+			guint i = 0;
+			while(i < JANUS_REQUEST_LATENCY_BUCKETS-1 && latency > janus_request_latency_bounds[i])
+				i++;
+			worker->latency[i]++;
+			if(latency > worker->max_latency)
+				worker->max_latency = latency;
+			janus_mutex_unlock(&request_mutex);
+			if(!request->admin)
 				janus_process_incoming_request(request);
-			}
+			else
+				janus_process_incoming_admin_request(request);
+			janus_request_destroy(request);
+			served++;
+			janus_mutex_lock(&request_mutex);
+			worker->processed++;
+		}
+		if(g_queue_is_empty(&lane->requests)) {
+			/* Lane drained, get rid of it until there's new requests */
+			if(lane->session_id > 0)
+				g_hash_table_remove(request_lanes, &lane->session_id);
+			else
+				g_free(lane);
 		} else {
-			/* Admin requests are always handled synchronously */
-			janus_process_incoming_admin_request(request);
+			/* Let other lanes breathe: anything new for this session goes back in the queue */
+			g_queue_push_tail(&worker->lanes, lane);
+			janus_condition_broadcast(&request_cond);
 		}
-		/* Done */
-		if(destroy)
-			janus_request_destroy(request);
 	}
-	JANUS_LOG(LOG_INFO, "Leaving Janus requests handler thread\n");
+	janus_mutex_unlock(&request_mutex);
+	JANUS_LOG(LOG_INFO, "Leaving Janus requests worker #%u\n", worker->id);
 	return NULL;
 }
 
+static void janus_request_lane_free(janus_request_lane *lane) {
+	if(lane == NULL)
+		return;
+	janus_request *request = NULL;
+	while((request = g_queue_pop_head(&lane->requests)) != NULL)
+		janus_request_destroy(request);
+	g_free(lane);
+}
+
+/* Snapshot of the executor state, for the Admin API */
+static json_t *janus_request_workers_stats(void) {
+	json_t *stats = json_object();
+	json_t *workers = json_array();
+	guint64 latency[JANUS_REQUEST_LATENCY_BUCKETS];
+	memset(latency, 0, sizeof(latency));
+	gint64 max_latency = 0;
+	guint i = 0, j = 0;
+	janus_mutex_lock(&request_mutex);
+	for(i=0; i<request_workers_num; i++) {
+		janus_request_worker *w = &request_workers[i];
+		json_t *worker = json_object();
+		json_object_set_new(worker, "id", json_integer(w->id));
+		json_object_set_new(worker, "lanes", json_integer(g_queue_get_length(&w->lanes)));
+		json_object_set_new(worker, "depth", json_integer(w->depth));
+		json_object_set_new(worker, "processed", json_integer(w->processed));
+		json_object_set_new(worker, "stolen", json_integer(w->stolen));
+		json_object_set_new(worker, "max_latency", json_integer(w->max_latency));
+		json_array_append_new(workers, worker);
+		for(j=0; j<JANUS_REQUEST_LATENCY_BUCKETS; j++)
+			latency[j] += w->latency[j];
+		if(w->max_latency > max_latency)
+			max_latency = w->max_latency;
+	}
+	json_t *depth_h = json_object();
+	for(j=0; j<JANUS_REQUEST_DEPTH_BUCKETS; j++)
+		json_object_set_new(depth_h, janus_request_depth_labels[j], json_integer(request_depth_histogram[j]));
+	json_object_set_new(stats, "sessions", json_integer(g_hash_table_size(request_lanes)));
+	janus_mutex_unlock(&request_mutex);
+	json_t *latency_h = json_object();
+	for(j=0; j<JANUS_REQUEST_LATENCY_BUCKETS; j++)
+		json_object_set_new(latency_h, janus_request_latency_labels[j], json_integer(latency[j]));
+	json_object_set_new(stats, "workers", workers);
+	json_object_set_new(stats, "queue_depth", depth_h);
+	json_object_set_new(stats, "latency", latency_h);
+	json_object_set_new(stats, "max_latency", json_integer(max_latency));
+	return stats;
+}
+
 
 /* Event handlers */
 void janus_eventhandler_close(gpointer key, gpointer value, gpointer user_data) {
@@ -2954,6 +3225,8 @@ json_t *janus_plugin_handle_sdp(janus_plugin_session *plugin_session, janus_plug
 		int transport_wide_cc_ext_id = janus_rtp_header_extension_get_id(sdp, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
 		stream->do_transport_wide_cc = TRUE;
 		stream->transport_wide_cc_ext_id = transport_wide_cc_ext_id;
+		/* The same extension will be used for what we send, if our answer has it */
+		stream->transport_wide_cc_out_ext_id = transport_wide_cc_ext_id > 0 ? transport_wide_cc_ext_id : 0;
 	}
 	if(janus_flags_is_set(&ice_handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX) &&
 			stream->rtx_payload_types == NULL) {
@@ -3043,6 +3316,16 @@ void janus_plugin_relay_rtp(janus_plugin_session *plugin_session, int video, cha
 	janus_ice_relay_rtp(handle, video, buf, len);
 }
 
+void janus_plugin_relay_rtp_info(janus_plugin_session *plugin_session, int video, char *buf, int len, const janus_rtp_video_info *info) {
+	if((plugin_session < (janus_plugin_session *)0x1000) || g_atomic_int_get(&plugin_session->stopped) || buf == NULL || len < 1)
+		return;
+	janus_ice_handle *handle = (janus_ice_handle *)plugin_session->gateway_handle;
+	if(!handle || janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)
+			|| janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT))
+		return;
+	janus_ice_relay_rtp_info(handle, video, buf, len, info);
+}
+
 void janus_plugin_relay_rtcp(janus_plugin_session *plugin_session, int video, char *buf, int len) {
 	if((plugin_session < (janus_plugin_session *)0x1000) || g_atomic_int_get(&plugin_session->stopped) || buf == NULL || len < 1)
 		return;
@@ -3675,6 +3958,9 @@ gint main(int argc, char *argv[])
 	} else {
 		janus_recorder_init(FALSE, NULL);
 	}
+	item = janus_config_get_item_drilldown(config, "general", "recordings_format");
+	if(item && item->value)
+		janus_recorder_set_format(item->value);
 
 	/* Setup ICE stuff (e.g., checking if the provided STUN server is correct) */
 	char *stun_server = NULL, *turn_server = NULL;
@@ -3766,10 +4052,27 @@ gint main(int argc, char *argv[])
 	if(item && item->value)
 		turn_rest_api_method = (char *)item->value;
 #endif
+	/* How many workers should we use to handle incoming requests? */
+	request_workers_num = MAX(JANUS_REQUEST_WORKERS_DEFAULT, g_get_num_processors());
+	item = janus_config_get_item_drilldown(config, "general", "request_workers");
+	if(item && item->value) {
+		int rw = atoi(item->value);
+		if(rw <= 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring request_workers value as it's not a positive integer\n");
+		} else {
+			request_workers_num = rw;
+		}
+	}
 	/* Do we need a limited number of static event loops, or is it ok to have one per handle (the default)? */
 	item = janus_config_get_item_drilldown(config, "general", "event_loops");
-	if(item && item->value)
-		janus_ice_set_static_event_loops(atoi(item->value));
+	if(item && item->value) {
+		janus_config_item *affinity = janus_config_get_item_drilldown(config, "general", "event_loops_affinity");
+		janus_ice_set_static_event_loops(atoi(item->value), (affinity && affinity->value) ? affinity->value : NULL);
+		/* Should handles be moved between loops when the load is unbalanced? */
+		item = janus_config_get_item_drilldown(config, "general", "event_loops_rebalance");
+		if(item && item->value)
+			janus_ice_set_event_loops_rebalance(atoi(item->value));
+	}
 	/* Initialize the ICE stack now */
 	janus_ice_init(ice_lite, ice_tcp, full_trickle, ipv6, rtp_min_port, rtp_max_port);
 	if(janus_ice_set_stun_server(stun_server, stun_port) < 0) {
@@ -3875,6 +4178,24 @@ gint main(int argc, char *argv[])
 	} else {
 		password = item->value;
 	}
+	gboolean ecdsa_key = FALSE;
+	item = janus_config_get_item_drilldown(config, "certificates", "ecdsa_private_key");
+	if(item && item->value)
+		ecdsa_key = janus_is_true(item->value);
+	/* Should we use a pool of autogenerated certificates, and rotate them? */
+	item = janus_config_get_item_drilldown(config, "certificates", "cert_pool_size");
+	if(item && item->value) {
+		int pool_size = atoi(item->value);
+		guint rotation = 0;
+		janus_config_item *rotate = janus_config_get_item_drilldown(config, "certificates", "cert_pool_rotation");
+		if(rotate && rotate->value && atoi(rotate->value) > 0)
+			rotation = atoi(rotate->value);
+		if(pool_size < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring cert_pool_size value as it's not a positive integer\n");
+		} else {
+			janus_dtls_set_certificate_pool(pool_size, rotation);
+		}
+	}
 	JANUS_LOG(LOG_VERB, "Using certificates:\n\t%s\n\t%s\n", server_pem, server_key);
 
 	SSL_library_init();
@@ -3885,7 +4206,17 @@ gint main(int argc, char *argv[])
 	item = janus_config_get_item_drilldown(config, "media", "dtls_timeout");
 	if(item && item->value)
 		dtls_timeout = atoi(item->value);
-	if(janus_dtls_srtp_init(server_pem, server_key, password, dtls_timeout) < 0) {
+	/* Should handshakes be processed by dedicated threads, rather than in the event loops? */
+	item = janus_config_get_item_drilldown(config, "media", "dtls_handshake_threads");
+	if(item && item->value) {
+		int threads = atoi(item->value);
+		if(threads < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring dtls_handshake_threads value as it's not a positive integer\n");
+		} else {
+			janus_dtls_set_handshake_workers(threads);
+		}
+	}
+	if(janus_dtls_srtp_init(server_pem, server_key, password, ecdsa_key, dtls_timeout) < 0) {
 		exit(1);
 	}
 	/* Check if there's any custom value for the starting MTU to use in the BIO filter */
@@ -3898,6 +4229,25 @@ gint main(int argc, char *argv[])
 	if(janus_sctp_init() < 0) {
 		exit(1);
 	}
+	/* Check if we need custom buffer sizes for SCTP associations */
+	int sctp_sndbuf = 0, sctp_rcvbuf = 0;
+	item = janus_config_get_item_drilldown(config, "media", "sctp_sndbuf");
+	if(item && item->value)
+		sctp_sndbuf = atoi(item->value);
+	item = janus_config_get_item_drilldown(config, "media", "sctp_rcvbuf");
+	if(item && item->value)
+		sctp_rcvbuf = atoi(item->value);
+	janus_sctp_set_buffer_sizes(sctp_sndbuf, sctp_rcvbuf);
+	/* Check if outgoing DataChannel messages should be coalesced */
+	item = janus_config_get_item_drilldown(config, "media", "sctp_coalesce_delay");
+	if(item && item->value) {
+		int delay = atoi(item->value);
+		if(delay < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring sctp_coalesce_delay value as it's not a positive integer\n");
+		} else {
+			janus_sctp_set_coalesce_delay(delay);
+		}
+	}
 #else
 	JANUS_LOG(LOG_WARN, "Data Channels support not compiled\n");
 #endif
@@ -3914,23 +4264,27 @@ gint main(int argc, char *argv[])
 		JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to start sessions timeout watchdog...\n", error->code, error->message ? error->message : "??");
 		exit(1);
 	}
-	/* Start the thread that will dispatch incoming requests */
-	requests = g_async_queue_new_full((GDestroyNotify) janus_request_destroy);
-	GThread *requests_thread = g_thread_try_new("sessions requests", &janus_transport_requests, NULL, &error);
-	if(error != NULL) {
-		JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to start requests thread...\n", error->code, error->message ? error->message : "??");
-		exit(1);
-	}
-	/* Create a thread pool to handle asynchronous requests, no matter what the transport */
-	error = NULL;
-	tasks = g_thread_pool_new(janus_transport_task, NULL, -1, FALSE, &error);
-	if(error != NULL) {
-		/* Something went wrong... */
-		JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to launch the request pool task thread...\n", error->code, error->message ? error->message : "??");
-		exit(1);
+	/* Start the workers that will handle incoming requests, no matter what the transport */
+	request_lanes = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+		(GDestroyNotify)g_free, (GDestroyNotify)janus_request_lane_free);
+	janus_mutex_init(&request_mutex);
+	janus_condition_init(&request_cond);
+	request_workers = g_malloc0(request_workers_num * sizeof(janus_request_worker));
+	guint rw = 0;
+	for(rw=0; rw<request_workers_num; rw++) {
+		janus_request_worker *worker = &request_workers[rw];
+		worker->id = rw;
+		g_queue_init(&worker->lanes);
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "requests %u", rw);
+		worker->thread = g_thread_try_new(tname, &janus_request_worker_thread, worker, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to start requests worker #%u...\n",
+				error->code, error->message ? error->message : "??", rw);
+			exit(1);
+		}
 	}
-	/* Wait 120 seconds before stopping idle threads to avoid the creation of too many threads for AddressSanitizer. */
-	g_thread_pool_set_max_idle_time(120 * 1000);
+	JANUS_LOG(LOG_INFO, "Started %u requests workers\n", request_workers_num);
 
 	/* Load event handlers */
 	const char *path = NULL;
@@ -4379,13 +4733,26 @@ gint main(int argc, char *argv[])
 		g_hash_table_foreach(transports_so, janus_transportso_close, NULL);
 		g_hash_table_destroy(transports_so);
 	}
-	/* Get rid of requests tasks and thread too */
-	g_thread_pool_free(tasks, FALSE, FALSE);
-	JANUS_LOG(LOG_INFO, "Ending requests thread...\n");
-	g_async_queue_push(requests, &exit_message);
-	g_thread_join(requests_thread);
-	requests_thread = NULL;
-	g_async_queue_unref(requests);
+	/* Get rid of the requests workers too */
+	JANUS_LOG(LOG_INFO, "Ending requests workers...\n");
+	janus_mutex_lock(&request_mutex);
+	g_atomic_int_set(&request_workers_stop, 1);
+	janus_condition_broadcast(&request_cond);
+	janus_mutex_unlock(&request_mutex);
+	for(rw=0; rw<request_workers_num; rw++) {
+		janus_request_worker *worker = &request_workers[rw];
+		g_thread_join(worker->thread);
+		worker->thread = NULL;
+		/* Sessionless lanes are not tracked in the map, free them here */
+		janus_request_lane *lane = NULL;
+		while((lane = g_queue_pop_head(&worker->lanes)) != NULL) {
+			if(lane->session_id == 0)
+				janus_request_lane_free(lane);
+		}
+	}
+	g_clear_pointer(&request_lanes, g_hash_table_destroy);
+	g_free(request_workers);
+	request_workers = NULL;
 
 	JANUS_LOG(LOG_INFO, "Destroying sessions...\n");
 	g_clear_pointer(&sessions, g_hash_table_destroy);
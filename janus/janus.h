@@ -126,6 +126,8 @@ struct janus_request {
 	gboolean admin;
 	/*! \brief Pointer to the original request, if available */
 	json_t *message;
+	/*! \brief Monotonic time of when the request was queued for processing */
+	gint64 queued;
 };
 /*! \brief Helper to allocate a janus_request instance
  * @param[in] transport Pointer to the transport
@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "log.h"
 
@@ -156,6 +157,53 @@ static void *janus_log_thread(void *ctx) {
 	return NULL;
 }
 
+/* fork() handlers: we make sure the print thread is not holding the lock
+ * or in the middle of a write when the process is duplicated, and that the
+ * child doesn't print (again) what the parent had queued but not printed yet */
+static void janus_log_atfork_prepare(void) {
+	g_mutex_lock(&lock);
+	if(janus_log_console) {
+		flockfile(stdout);
+		fflush(stdout);
+	}
+	if(janus_log_file) {
+		flockfile(janus_log_file);
+		fflush(janus_log_file);
+	}
+}
+
+static void janus_log_atfork_parent(void) {
+	if(janus_log_file)
+		funlockfile(janus_log_file);
+	if(janus_log_console)
+		funlockfile(stdout);
+	g_mutex_unlock(&lock);
+}
+
+static void janus_log_atfork_child(void) {
+	if(janus_log_file)
+		funlockfile(janus_log_file);
+	if(janus_log_console)
+		funlockfile(stdout);
+	/* The buffers queued in the parent are the parent's business */
+	printhead = printtail = NULL;
+	printthread = NULL;
+	g_mutex_unlock(&lock);
+}
+
+int janus_log_forked(void) {
+	if(!g_atomic_int_get(&initialized) || printthread != NULL)
+		return 0;
+	GError *error = NULL;
+	printthread = g_thread_try_new(THREAD_NAME, &janus_log_thread, NULL, &error);
+	if(error != NULL) {
+		g_print("Error starting the logger thread: %s\n", error->message ? error->message : "??");
+		g_error_free(error);
+		return -1;
+	}
+	return 0;
+}
+
 void janus_vprintf(const char *format, ...) {
 	int len;
 	va_list ap, ap2;
@@ -226,6 +274,7 @@ int janus_log_init(gboolean daemon, gboolean console, const char *logfile) {
 		}
 	}
 	printthread = g_thread_new(THREAD_NAME, &janus_log_thread, NULL);
+	pthread_atfork(janus_log_atfork_prepare, janus_log_atfork_parent, janus_log_atfork_child);
 	return 0;
 }
 
@@ -235,5 +284,10 @@ void janus_log_destroy(void) {
 	/* Signal print thread to print any remaining message */
 	g_cond_signal(&cond);
 	g_mutex_unlock(&lock);
+	if(printthread == NULL) {
+		/* Forked, and the logger was never restarted: print what we have here */
+		janus_log_thread(NULL);
+		return;
+	}
 	g_thread_join(printthread);
 }
@@ -33,6 +33,12 @@ void janus_vprintf(const char *format, ...) G_GNUC_PRINTF(1, 2);
 int janus_log_init(gboolean daemon, gboolean console, const char *logfile);
 /*! \brief Log destruction */
 void janus_log_destroy(void);
+/*! \brief Restart the logger in a child process created with fork()
+* \note Only the thread that called fork() survives in the child, so the
+* logger needs a new processing thread there before anything can be printed:
+* messages logged before this is called are kept and printed afterwards.
+* @returns 0 in case of success, a negative integer otherwise */
+int janus_log_forked(void);
 
 /*! \brief Method to check whether stdout logging is enabled
  * @returns TRUE if stdout logging is enabled, FALSE otherwise */
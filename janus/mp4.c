@@ -0,0 +1,722 @@
+/*! \file    mp4.c
+ * \copyright GNU General Public License v3
+ * \brief    Native fragmented MP4 writer
+ * \details  A minimal ISO BMFF muxer that writes H.264 or VP8 video
+ * and/or Opus audio to a fragmented .mp4 file, without going through
+ * FFmpeg. It's used both by the live recorder (see \ref record.h) and by
+ * the post-processor, when converting H.264 recordings.
+ *
+ * The initialization segment (ftyp+moov) is written as soon as the first
+ * keyframe brings what's needed to describe the video (SPS and PPS for
+ * H.264, the frame size for VP8), or with the first packet in audio-only
+ * files. Samples are then buffered in memory and written as a moof+mdat
+ * fragment at each keyframe (every second for audio-only files, or when
+ * a fragment grows too large), with a handful of large writes per
+ * fragment. This means that a file that was not closed properly is still
+ * playable up to its last complete fragment. The avcC record and the
+ * conversion of the Annex-B frames to length prefixed NAL units use the
+ * libflv helpers.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "mpeg4-avc.h"
+
+#include "mp4.h"
+#include "debug.h"
+
+
+/* Fragments are cut at keyframes, or when the video they buffer gets this large */
+#define JANUS_MP4_FRAGMENT_SIZE	(8*1024*1024)
+
+/* trun flags and sample flags we use */
+#define JANUS_MP4_TRUN_DATA_OFFSET	0x000001
+#define JANUS_MP4_TRUN_DURATION		0x000100
+#define JANUS_MP4_TRUN_SIZE			0x000200
+#define JANUS_MP4_TRUN_FLAGS		0x000400
+#define JANUS_MP4_TFHD_BASE_IS_MOOF	0x020000
+#define JANUS_MP4_SAMPLE_SYNC		0x02000000
+#define JANUS_MP4_SAMPLE_NON_SYNC	0x01010000
+
+typedef struct janus_mp4_sample {
+	uint32_t duration;
+	uint32_t size;
+	uint8_t sync;
+} janus_mp4_sample;
+
+typedef struct janus_mp4_track {
+	janus_mp4_codec codec;
+	uint32_t id, timescale;
+	/* Samples of the current fragment, and their mdat payload */
+	GArray *samples;
+	GByteArray *data;
+	/* Decode time of the first sample in the fragment, and of the last sample */
+	uint64_t start, last;
+	gboolean started;
+	/* Duration of the last sample, until the next one tells us */
+	uint32_t duration;
+	/* Where the track duration is in the file, to fix it when closing */
+	long tkhd_duration;
+	uint32_t written;
+} janus_mp4_track;
+
+struct janus_mp4 {
+	FILE *file;
+	int width, height;
+	/* Tracks in the file, video first */
+	janus_mp4_track video, audio;
+	janus_mp4_track *tracks[2];
+	int tracks_num;
+	/* SPS/PPS of the last H.264 frame, for the avcC */
+	struct mpeg4_avc_t avc;
+	/* Whether ftyp+moov were written already */
+	gboolean header;
+	/* Where the movie durations are in the file, to fix them when closing */
+	long mvhd_duration, mehd_duration;
+	uint32_t sequence;
+	uint32_t skipped;
+};
+
+
+/* Box writing helpers */
+static void janus_mp4_put8(GByteArray *b, uint8_t v) {
+	g_byte_array_append(b, &v, 1);
+}
+
+static void janus_mp4_put16(GByteArray *b, uint16_t v) {
+	v = htons(v);
+	g_byte_array_append(b, (uint8_t *)&v, 2);
+}
+
+static void janus_mp4_put32(GByteArray *b, uint32_t v) {
+	v = htonl(v);
+	g_byte_array_append(b, (uint8_t *)&v, 4);
+}
+
+static void janus_mp4_put64(GByteArray *b, uint64_t v) {
+	janus_mp4_put32(b, (uint32_t)(v >> 32));
+	janus_mp4_put32(b, (uint32_t)(v & 0xFFFFFFFF));
+}
+
+static void janus_mp4_put_zeros(GByteArray *b, int n) {
+	while(n-- > 0)
+		janus_mp4_put8(b, 0);
+}
+
+static void janus_mp4_set32(GByteArray *b, guint offset, uint32_t v) {
+	v = htonl(v);
+	memcpy(b->data + offset, &v, 4);
+}
+
+static guint janus_mp4_box(GByteArray *b, const char *type) {
+	guint offset = b->len;
+	janus_mp4_put32(b, 0);
+	g_byte_array_append(b, (const uint8_t *)type, 4);
+	return offset;
+}
+
+static guint janus_mp4_full_box(GByteArray *b, const char *type, uint8_t version, uint32_t flags) {
+	guint offset = janus_mp4_box(b, type);
+	janus_mp4_put32(b, ((uint32_t)version << 24) | (flags & 0xFFFFFF));
+	return offset;
+}
+
+static void janus_mp4_box_end(GByteArray *b, guint offset) {
+	janus_mp4_set32(b, offset, b->len - offset);
+}
+
+static void janus_mp4_put_matrix(GByteArray *b) {
+	uint32_t matrix[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+	int i = 0;
+	for(i=0; i<9; i++)
+		janus_mp4_put32(b, matrix[i]);
+}
+
+
+/* Video size, when we're not told: H.264 SPS (Exp-Golomb, after removing the emulation prevention bytes) */
+typedef struct janus_mp4_bits {
+	uint8_t *data;
+	uint32_t len, offset;
+} janus_mp4_bits;
+
+static uint32_t janus_mp4_bit(janus_mp4_bits *b) {
+	if(b->offset >= b->len*8)
+		return 0;
+	uint32_t bit = (b->data[b->offset >> 3] >> (7 - (b->offset & 0x7))) & 0x1;
+	b->offset++;
+	return bit;
+}
+
+static uint32_t janus_mp4_ue(janus_mp4_bits *b) {
+	uint32_t zeros = 0;
+	while(zeros < 31 && janus_mp4_bit(b) == 0)
+		zeros++;
+	uint32_t res = 0;
+	uint32_t i = 0;
+	for(i=0; i<zeros; i++)
+		res = (res << 1) | janus_mp4_bit(b);
+	return ((1 << zeros) - 1) + res;
+}
+
+static int32_t janus_mp4_se(janus_mp4_bits *b) {
+	uint32_t v = janus_mp4_ue(b);
+	return (v & 0x1) ? (int32_t)((v+1)/2) : -(int32_t)(v/2);
+}
+
+static void janus_mp4_h264_size(const uint8_t *sps, int len, int *width, int *height) {
+	if(len < 5)
+		return;
+	/* Remove the emulation prevention bytes first */
+	uint8_t rbsp[256];
+	janus_mp4_bits b = { .data = rbsp, .len = 0, .offset = 0 };
+	int i = 0, zeros = 0;
+	for(i=1; i<len && b.len<sizeof(rbsp); i++) {
+		if(zeros >= 2 && sps[i] == 0x03) {
+			zeros = 0;
+			continue;
+		}
+		zeros = (sps[i] == 0) ? zeros+1 : 0;
+		rbsp[b.len++] = sps[i];
+	}
+	uint8_t profile_idc = rbsp[0];
+	/* Skip profile_idc, the constraint flags, level_idc and seq_parameter_set_id */
+	b.offset = 24;
+	janus_mp4_ue(&b);
+	uint32_t chroma_format_idc = 1;
+	if(profile_idc == 100 || profile_idc == 110 || profile_idc == 122 || profile_idc == 244 ||
+			profile_idc == 44 || profile_idc == 83 || profile_idc == 86 || profile_idc == 118 ||
+			profile_idc == 128 || profile_idc == 138 || profile_idc == 139 || profile_idc == 134) {
+		chroma_format_idc = janus_mp4_ue(&b);
+		if(chroma_format_idc == 3)
+			janus_mp4_bit(&b);	/* separate_colour_plane_flag */
+		janus_mp4_ue(&b);	/* bit_depth_luma_minus8 */
+		janus_mp4_ue(&b);	/* bit_depth_chroma_minus8 */
+		janus_mp4_bit(&b);	/* qpprime_y_zero_transform_bypass_flag */
+		if(janus_mp4_bit(&b)) {
+			/* seq_scaling_matrix_present_flag: skip the scaling lists */
+			int lists = (chroma_format_idc != 3) ? 8 : 12;
+			for(i=0; i<lists; i++) {
+				if(!janus_mp4_bit(&b))
+					continue;
+				int size = (i < 6) ? 16 : 64, j = 0;
+				int32_t last = 8, next = 8;
+				for(j=0; j<size; j++) {
+					if(next != 0)
+						next = (last + janus_mp4_se(&b) + 256) % 256;
+					last = (next == 0) ? last : next;
+				}
+			}
+		}
+	}
+	janus_mp4_ue(&b);	/* log2_max_frame_num_minus4 */
+	uint32_t pic_order_cnt_type = janus_mp4_ue(&b);
+	if(pic_order_cnt_type == 0) {
+		janus_mp4_ue(&b);	/* log2_max_pic_order_cnt_lsb_minus4 */
+	} else if(pic_order_cnt_type == 1) {
+		janus_mp4_bit(&b);	/* delta_pic_order_always_zero_flag */
+		janus_mp4_se(&b);	/* offset_for_non_ref_pic */
+		janus_mp4_se(&b);	/* offset_for_top_to_bottom_field */
+		uint32_t cycle = janus_mp4_ue(&b), j = 0;
+		for(j=0; j<cycle && j<256; j++)
+			janus_mp4_se(&b);
+	}
+	janus_mp4_ue(&b);	/* max_num_ref_frames */
+	janus_mp4_bit(&b);	/* gaps_in_frame_num_value_allowed_flag */
+	uint32_t width_mbs = janus_mp4_ue(&b) + 1;
+	uint32_t height_map_units = janus_mp4_ue(&b) + 1;
+	uint32_t frame_mbs_only_flag = janus_mp4_bit(&b);
+	if(!frame_mbs_only_flag)
+		janus_mp4_bit(&b);	/* mb_adaptive_frame_field_flag */
+	janus_mp4_bit(&b);	/* direct_8x8_inference_flag */
+	uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+	if(janus_mp4_bit(&b)) {
+		crop_left = janus_mp4_ue(&b);
+		crop_right = janus_mp4_ue(&b);
+		crop_top = janus_mp4_ue(&b);
+		crop_bottom = janus_mp4_ue(&b);
+	}
+	/* Cropping is in chroma samples (4:2:0), and in field pairs for interlaced video */
+	*width = width_mbs*16 - (crop_left + crop_right)*2;
+	*height = (2 - frame_mbs_only_flag)*height_map_units*16 - (crop_top + crop_bottom)*2*(2 - frame_mbs_only_flag);
+}
+
+/* VP8 keyframes have the size right after the start code */
+static void janus_mp4_vp8_size(const uint8_t *frame, int len, int *width, int *height) {
+	if(len < 10 || (frame[0] & 0x01) || frame[3] != 0x9d || frame[4] != 0x01 || frame[5] != 0x2a)
+		return;
+	*width = (frame[6] | (frame[7] << 8)) & 0x3FFF;
+	*height = (frame[8] | (frame[9] << 8)) & 0x3FFF;
+}
+
+
+/* Tracks */
+static void janus_mp4_track_init(janus_mp4 *mp4, janus_mp4_track *track, janus_mp4_codec codec) {
+	track->codec = codec;
+	track->id = mp4->tracks_num + 1;
+	if(codec == JANUS_MP4_OPUS) {
+		/* Until we know better, assume 20ms packets */
+		track->timescale = 48000;
+		track->duration = 960;
+		track->data = g_byte_array_sized_new(64*1024);
+	} else {
+		/* Until we know better, assume 30fps */
+		track->timescale = 90000;
+		track->duration = 3000;
+		track->data = g_byte_array_sized_new(JANUS_MP4_FRAGMENT_SIZE);
+	}
+	track->samples = g_array_new(FALSE, FALSE, sizeof(janus_mp4_sample));
+	mp4->tracks[mp4->tracks_num++] = track;
+}
+
+static void janus_mp4_track_free(janus_mp4_track *track) {
+	if(track->samples != NULL)
+		g_array_free(track->samples, TRUE);
+	track->samples = NULL;
+	if(track->data != NULL)
+		g_byte_array_free(track->data, TRUE);
+	track->data = NULL;
+}
+
+/* A new sample is coming: now we know how long the previous one lasted */
+static void janus_mp4_track_time(janus_mp4_track *track, uint64_t dts) {
+	if(!track->started || dts <= track->last)
+		return;
+	track->duration = (uint32_t)(dts - track->last);
+	if(track->samples->len > 0)
+		g_array_index(track->samples, janus_mp4_sample, track->samples->len-1).duration = track->duration;
+}
+
+static void janus_mp4_track_add(janus_mp4_track *track, uint64_t dts, uint32_t size, gboolean sync) {
+	if(track->started && dts < track->last)
+		dts = track->last;
+	if(track->samples->len == 0)
+		track->start = dts;
+	janus_mp4_sample sample = {
+		.duration = track->duration,
+		.size = size,
+		.sync = sync
+	};
+	g_array_append_val(track->samples, sample);
+	track->last = dts;
+	track->started = TRUE;
+	track->written++;
+}
+
+/* Duration of the track so far, in milliseconds */
+static uint32_t janus_mp4_track_duration(janus_mp4_track *track) {
+	if(!track->started)
+		return 0;
+	return (uint32_t)((track->last + track->duration) * 1000 / track->timescale);
+}
+
+
+/* Initialization segment */
+static void janus_mp4_write_trak(janus_mp4 *mp4, GByteArray *b, janus_mp4_track *track,
+		const uint8_t *avcc, int avcc_len) {
+	gboolean video = (track->codec != JANUS_MP4_OPUS);
+	guint trak = janus_mp4_box(b, "trak");
+	/* Enabled and in the movie */
+	guint box = janus_mp4_full_box(b, "tkhd", 0, 0x000003);
+	janus_mp4_put32(b, 0);	/* creation_time */
+	janus_mp4_put32(b, 0);	/* modification_time */
+	janus_mp4_put32(b, track->id);
+	janus_mp4_put32(b, 0);	/* reserved */
+	track->tkhd_duration = b->len;
+	janus_mp4_put32(b, 0);	/* duration, fixed when closing */
+	janus_mp4_put_zeros(b, 8);	/* reserved */
+	janus_mp4_put16(b, 0);	/* layer */
+	janus_mp4_put16(b, 0);	/* alternate_group */
+	janus_mp4_put16(b, video ? 0 : 0x0100);	/* volume */
+	janus_mp4_put16(b, 0);	/* reserved */
+	janus_mp4_put_matrix(b);
+	janus_mp4_put32(b, video ? (uint32_t)mp4->width << 16 : 0);
+	janus_mp4_put32(b, video ? (uint32_t)mp4->height << 16 : 0);
+	janus_mp4_box_end(b, box);
+	guint mdia = janus_mp4_box(b, "mdia");
+	box = janus_mp4_full_box(b, "mdhd", 0, 0);
+	janus_mp4_put32(b, 0);	/* creation_time */
+	janus_mp4_put32(b, 0);	/* modification_time */
+	janus_mp4_put32(b, track->timescale);
+	janus_mp4_put32(b, 0);	/* duration, in the fragments */
+	janus_mp4_put16(b, 0x55C4);	/* language, 'und' */
+	janus_mp4_put16(b, 0);	/* pre_defined */
+	janus_mp4_box_end(b, box);
+	box = janus_mp4_full_box(b, "hdlr", 0, 0);
+	janus_mp4_put32(b, 0);	/* pre_defined */
+	g_byte_array_append(b, (const uint8_t *)(video ? "vide" : "soun"), 4);
+	janus_mp4_put_zeros(b, 12);	/* reserved */
+	const char *name = video ? "VideoHandler" : "SoundHandler";
+	g_byte_array_append(b, (const uint8_t *)name, strlen(name)+1);
+	janus_mp4_box_end(b, box);
+	guint minf = janus_mp4_box(b, "minf");
+	if(video) {
+		box = janus_mp4_full_box(b, "vmhd", 0, 0x000001);
+		janus_mp4_put_zeros(b, 8);	/* graphicsmode and opcolor */
+	} else {
+		box = janus_mp4_full_box(b, "smhd", 0, 0);
+		janus_mp4_put_zeros(b, 4);	/* balance and reserved */
+	}
+	janus_mp4_box_end(b, box);
+	guint dinf = janus_mp4_box(b, "dinf");
+	guint dref = janus_mp4_full_box(b, "dref", 0, 0);
+	janus_mp4_put32(b, 1);
+	/* The media data is in the same file */
+	box = janus_mp4_full_box(b, "url ", 0, 0x000001);
+	janus_mp4_box_end(b, box);
+	janus_mp4_box_end(b, dref);
+	janus_mp4_box_end(b, dinf);
+	guint stbl = janus_mp4_box(b, "stbl");
+	guint stsd = janus_mp4_full_box(b, "stsd", 0, 0);
+	janus_mp4_put32(b, 1);
+	guint entry = janus_mp4_box(b, track->codec == JANUS_MP4_H264 ? "avc1" :
+		(track->codec == JANUS_MP4_VP8 ? "vp08" : "Opus"));
+	janus_mp4_put_zeros(b, 6);	/* reserved */
+	janus_mp4_put16(b, 1);	/* data_reference_index */
+	if(video) {
+		janus_mp4_put_zeros(b, 16);	/* pre_defined and reserved */
+		janus_mp4_put16(b, mp4->width);
+		janus_mp4_put16(b, mp4->height);
+		janus_mp4_put32(b, 0x00480000);	/* horizresolution, 72 dpi */
+		janus_mp4_put32(b, 0x00480000);	/* vertresolution, 72 dpi */
+		janus_mp4_put32(b, 0);	/* reserved */
+		janus_mp4_put16(b, 1);	/* frame_count */
+		janus_mp4_put_zeros(b, 32);	/* compressorname */
+		janus_mp4_put16(b, 0x0018);	/* depth */
+		janus_mp4_put16(b, 0xFFFF);	/* pre_defined */
+		if(track->codec == JANUS_MP4_H264) {
+			box = janus_mp4_box(b, "avcC");
+			g_byte_array_append(b, avcc, avcc_len);
+		} else {
+			/* VP Codec ISO Media File Format Binding */
+			box = janus_mp4_full_box(b, "vpcC", 1, 0);
+			janus_mp4_put8(b, 0);	/* profile */
+			janus_mp4_put8(b, 10);	/* level */
+			janus_mp4_put8(b, (8 << 4) | (1 << 1));	/* bitDepth, 4:2:0 chroma, no full range */
+			janus_mp4_put8(b, 2);	/* colourPrimaries, unspecified */
+			janus_mp4_put8(b, 2);	/* transferCharacteristics, unspecified */
+			janus_mp4_put8(b, 2);	/* matrixCoefficients, unspecified */
+			janus_mp4_put16(b, 0);	/* codecInitializationDataSize */
+		}
+		janus_mp4_box_end(b, box);
+	} else {
+		/* Same parameters as the OpusHead the post-processor puts in .opus and .webm files */
+		janus_mp4_put_zeros(b, 8);	/* reserved */
+		janus_mp4_put16(b, 2);	/* channelcount */
+		janus_mp4_put16(b, 16);	/* samplesize */
+		janus_mp4_put32(b, 0);	/* pre_defined and reserved */
+		janus_mp4_put32(b, 48000 << 16);	/* samplerate */
+		box = janus_mp4_box(b, "dOps");
+		janus_mp4_put8(b, 0);	/* Version */
+		janus_mp4_put8(b, 2);	/* OutputChannelCount */
+		janus_mp4_put16(b, 0);	/* PreSkip */
+		janus_mp4_put32(b, 48000);	/* InputSampleRate */
+		janus_mp4_put16(b, 0);	/* OutputGain */
+		janus_mp4_put8(b, 0);	/* ChannelMappingFamily */
+		janus_mp4_box_end(b, box);
+	}
+	janus_mp4_box_end(b, entry);
+	janus_mp4_box_end(b, stsd);
+	/* The samples are all in the fragments */
+	const char *tables[] = { "stts", "stsc", "stco" };
+	int i = 0;
+	for(i=0; i<3; i++) {
+		box = janus_mp4_full_box(b, tables[i], 0, 0);
+		janus_mp4_put32(b, 0);
+		janus_mp4_box_end(b, box);
+	}
+	box = janus_mp4_full_box(b, "stsz", 0, 0);
+	janus_mp4_put32(b, 0);	/* sample_size */
+	janus_mp4_put32(b, 0);	/* sample_count */
+	janus_mp4_box_end(b, box);
+	janus_mp4_box_end(b, stbl);
+	janus_mp4_box_end(b, minf);
+	janus_mp4_box_end(b, mdia);
+	janus_mp4_box_end(b, trak);
+}
+
+static int janus_mp4_write_header(janus_mp4 *mp4) {
+	uint8_t avcc[1024];
+	int avcc_len = 0;
+	if(mp4->video.codec == JANUS_MP4_H264) {
+		/* WebRTC only uses 4:2:0, which is what libflv expects us to tell it for the High profiles */
+		mp4->avc.chroma_format_idc = 1;
+		avcc_len = mpeg4_avc_decoder_configuration_record_save(&mp4->avc, avcc, sizeof(avcc));
+		if(avcc_len <= 0) {
+			JANUS_LOG(LOG_ERR, "Error creating the avcC record\n");
+			return -1;
+		}
+	}
+	long start = ftell(mp4->file);
+	GByteArray *b = g_byte_array_sized_new(4096);
+	guint box = janus_mp4_box(b, "ftyp");
+	g_byte_array_append(b, (const uint8_t *)"isom", 4);
+	janus_mp4_put32(b, 0x200);
+	g_byte_array_append(b, (const uint8_t *)"isomiso6mp41", 12);
+	if(mp4->video.codec == JANUS_MP4_H264)
+		g_byte_array_append(b, (const uint8_t *)"avc1", 4);
+	janus_mp4_box_end(b, box);
+	guint moov = janus_mp4_box(b, "moov");
+	box = janus_mp4_full_box(b, "mvhd", 0, 0);
+	janus_mp4_put32(b, 0);	/* creation_time */
+	janus_mp4_put32(b, 0);	/* modification_time */
+	janus_mp4_put32(b, 1000);	/* timescale */
+	mp4->mvhd_duration = start + b->len;
+	janus_mp4_put32(b, 0);	/* duration, fixed when closing */
+	janus_mp4_put32(b, 0x00010000);	/* rate */
+	janus_mp4_put16(b, 0x0100);	/* volume */
+	janus_mp4_put_zeros(b, 10);	/* reserved */
+	janus_mp4_put_matrix(b);
+	janus_mp4_put_zeros(b, 24);	/* pre_defined */
+	janus_mp4_put32(b, mp4->tracks_num+1);	/* next_track_ID */
+	janus_mp4_box_end(b, box);
+	int i = 0;
+	for(i=0; i<mp4->tracks_num; i++) {
+		janus_mp4_write_trak(mp4, b, mp4->tracks[i], avcc, avcc_len);
+		mp4->tracks[i]->tkhd_duration += start;
+	}
+	guint mvex = janus_mp4_box(b, "mvex");
+	box = janus_mp4_full_box(b, "mehd", 0, 0);
+	mp4->mehd_duration = start + b->len;
+	janus_mp4_put32(b, 0);	/* fragment_duration, fixed when closing */
+	janus_mp4_box_end(b, box);
+	for(i=0; i<mp4->tracks_num; i++) {
+		box = janus_mp4_full_box(b, "trex", 0, 0);
+		janus_mp4_put32(b, mp4->tracks[i]->id);
+		janus_mp4_put32(b, 1);	/* default_sample_description_index */
+		janus_mp4_put32(b, 0);	/* default_sample_duration */
+		janus_mp4_put32(b, 0);	/* default_sample_size */
+		janus_mp4_put32(b, 0);	/* default_sample_flags */
+		janus_mp4_box_end(b, box);
+	}
+	janus_mp4_box_end(b, mvex);
+	janus_mp4_box_end(b, moov);
+	size_t written = fwrite(b->data, sizeof(char), b->len, mp4->file);
+	gboolean error = (written != b->len);
+	g_byte_array_free(b, TRUE);
+	if(error) {
+		JANUS_LOG(LOG_ERR, "Error writing the .mp4 header\n");
+		return -1;
+	}
+	mp4->header = TRUE;
+	return 0;
+}
+
+
+/* Fragments */
+static guint janus_mp4_write_traf(GByteArray *b, janus_mp4_track *track) {
+	gboolean video = (track->codec != JANUS_MP4_OPUS);
+	guint traf = janus_mp4_box(b, "traf");
+	guint box = janus_mp4_full_box(b, "tfhd", 0, JANUS_MP4_TFHD_BASE_IS_MOOF);
+	janus_mp4_put32(b, track->id);
+	janus_mp4_box_end(b, box);
+	box = janus_mp4_full_box(b, "tfdt", 1, 0);
+	janus_mp4_put64(b, track->start);
+	janus_mp4_box_end(b, box);
+	uint32_t flags = JANUS_MP4_TRUN_DATA_OFFSET | JANUS_MP4_TRUN_DURATION | JANUS_MP4_TRUN_SIZE;
+	if(video)
+		flags |= JANUS_MP4_TRUN_FLAGS;
+	box = janus_mp4_full_box(b, "trun", 0, flags);
+	janus_mp4_put32(b, track->samples->len);
+	guint data_offset = b->len;
+	janus_mp4_put32(b, 0);	/* data_offset, fixed once we know the size of the moof */
+	guint i = 0;
+	for(i=0; i<track->samples->len; i++) {
+		janus_mp4_sample *sample = &g_array_index(track->samples, janus_mp4_sample, i);
+		janus_mp4_put32(b, sample->duration);
+		janus_mp4_put32(b, sample->size);
+		if(video)
+			janus_mp4_put32(b, sample->sync ? JANUS_MP4_SAMPLE_SYNC : JANUS_MP4_SAMPLE_NON_SYNC);
+	}
+	janus_mp4_box_end(b, box);
+	janus_mp4_box_end(b, traf);
+	return data_offset;
+}
+
+static int janus_mp4_flush(janus_mp4 *mp4) {
+	/* Nothing can be written before the moov */
+	if(!mp4->header)
+		return 0;
+	guint offsets[2] = { 0, 0 }, samples = 0;
+	int i = 0;
+	for(i=0; i<mp4->tracks_num; i++)
+		samples += mp4->tracks[i]->samples->len;
+	if(samples == 0)
+		return 0;
+	GByteArray *b = g_byte_array_sized_new(1024 + 16*samples);
+	guint moof = janus_mp4_box(b, "moof");
+	guint box = janus_mp4_full_box(b, "mfhd", 0, 0);
+	janus_mp4_put32(b, ++mp4->sequence);
+	janus_mp4_box_end(b, box);
+	for(i=0; i<mp4->tracks_num; i++) {
+		if(mp4->tracks[i]->samples->len > 0)
+			offsets[i] = janus_mp4_write_traf(b, mp4->tracks[i]);
+	}
+	janus_mp4_box_end(b, moof);
+	/* The data of the tracks is in the mdat in the same order, video first */
+	guint data = b->len + 8, size = 8;
+	for(i=0; i<mp4->tracks_num; i++) {
+		if(offsets[i] > 0)
+			janus_mp4_set32(b, offsets[i], data);
+		data += mp4->tracks[i]->data->len;
+		size += mp4->tracks[i]->data->len;
+	}
+	janus_mp4_put32(b, size);
+	g_byte_array_append(b, (const uint8_t *)"mdat", 4);
+	gboolean error = (fwrite(b->data, sizeof(char), b->len, mp4->file) != b->len);
+	for(i=0; i<mp4->tracks_num && !error; i++) {
+		GByteArray *payload = mp4->tracks[i]->data;
+		if(payload->len > 0 && fwrite(payload->data, sizeof(char), payload->len, mp4->file) != payload->len)
+			error = TRUE;
+	}
+	g_byte_array_free(b, TRUE);
+	for(i=0; i<mp4->tracks_num; i++) {
+		g_array_set_size(mp4->tracks[i]->samples, 0);
+		g_byte_array_set_size(mp4->tracks[i]->data, 0);
+	}
+	if(error) {
+		JANUS_LOG(LOG_ERR, "Error writing .mp4 fragment %"SCNu32"\n", mp4->sequence);
+		return -1;
+	}
+	return 0;
+}
+
+
+janus_mp4 *janus_mp4_create(const char *destination, janus_mp4_codec video, int width, int height, janus_mp4_codec audio) {
+	if(destination == NULL)
+		return NULL;
+	if((video != JANUS_MP4_NONE && video != JANUS_MP4_H264 && video != JANUS_MP4_VP8) ||
+			(audio != JANUS_MP4_NONE && audio != JANUS_MP4_OPUS) ||
+			(video == JANUS_MP4_NONE && audio == JANUS_MP4_NONE)) {
+		JANUS_LOG(LOG_ERR, "Unsupported .mp4 tracks\n");
+		return NULL;
+	}
+	FILE *file = fopen(destination, "wb");
+	if(file == NULL) {
+		JANUS_LOG(LOG_ERR, "Couldn't open output file %s\n", destination);
+		return NULL;
+	}
+	janus_mp4 *mp4 = g_malloc0(sizeof(janus_mp4));
+	mp4->file = file;
+	mp4->width = width;
+	mp4->height = height;
+	if(video != JANUS_MP4_NONE)
+		janus_mp4_track_init(mp4, &mp4->video, video);
+	if(audio != JANUS_MP4_NONE)
+		janus_mp4_track_init(mp4, &mp4->audio, audio);
+	return mp4;
+}
+
+int janus_mp4_write_video(janus_mp4 *mp4, const uint8_t *frame, int len, uint64_t pts, int keyframe) {
+	if(mp4 == NULL || mp4->video.codec == JANUS_MP4_NONE || frame == NULL || len < 1)
+		return -1;
+	if(!mp4->header && !keyframe) {
+		/* Nothing to decode this with yet */
+		mp4->skipped++;
+		return 1;
+	}
+	janus_mp4_track *track = &mp4->video;
+	janus_mp4_track_time(track, pts);
+	if(track->samples->len > 0 && (keyframe || track->data->len >= JANUS_MP4_FRAGMENT_SIZE)) {
+		if(janus_mp4_flush(mp4) < 0)
+			return -1;
+	}
+	guint offset = track->data->len;
+	size_t size = len;
+	if(track->codec == JANUS_MP4_H264) {
+		/* Start codes become 4 bytes lengths, so a frame can grow by a byte per NAL unit */
+		size_t room = len + len/2 + 16;
+		g_byte_array_set_size(track->data, offset + room);
+		size = mpeg4_annexbtomp4(&mp4->avc, frame, len, track->data->data + offset, room);
+		g_byte_array_set_size(track->data, offset + size);
+		if(size == 0) {
+			JANUS_LOG(LOG_WARN, "Error converting H.264 frame (%d bytes), skipping it\n", len);
+			return 1;
+		}
+	} else {
+		g_byte_array_append(track->data, frame, len);
+	}
+	if(!mp4->header) {
+		if(track->codec == JANUS_MP4_H264 && (mp4->avc.nb_sps == 0 || mp4->avc.nb_pps == 0)) {
+			/* We need SPS and PPS for the avcC */
+			g_byte_array_set_size(track->data, offset);
+			mp4->skipped++;
+			return 1;
+		}
+		if(mp4->width == 0 || mp4->height == 0) {
+			if(track->codec == JANUS_MP4_H264)
+				janus_mp4_h264_size(mp4->avc.sps[0].data, mp4->avc.sps[0].bytes, &mp4->width, &mp4->height);
+			else
+				janus_mp4_vp8_size(frame, len, &mp4->width, &mp4->height);
+			JANUS_LOG(LOG_VERB, "Video size: %dx%d\n", mp4->width, mp4->height);
+		}
+		if(mp4->skipped > 0)
+			JANUS_LOG(LOG_WARN, "Skipped %"SCNu32" video frames before the first keyframe\n", mp4->skipped);
+		if(janus_mp4_write_header(mp4) < 0)
+			return -1;
+	}
+	janus_mp4_track_add(track, pts, size, keyframe);
+	return 0;
+}
+
+int janus_mp4_write_audio(janus_mp4 *mp4, const uint8_t *packet, int len, uint64_t pts) {
+	if(mp4 == NULL || mp4->audio.codec == JANUS_MP4_NONE || packet == NULL || len < 1)
+		return -1;
+	janus_mp4_track *track = &mp4->audio;
+	janus_mp4_track_time(track, pts);
+	if(mp4->video.codec == JANUS_MP4_NONE) {
+		/* Audio-only file: there are no keyframes to wait for, cut a fragment every second */
+		if(!mp4->header && janus_mp4_write_header(mp4) < 0)
+			return -1;
+		if(track->samples->len > 0 && track->last - track->start >= track->timescale) {
+			if(janus_mp4_flush(mp4) < 0)
+				return -1;
+		}
+	}
+	g_byte_array_append(track->data, packet, len);
+	janus_mp4_track_add(track, pts, len, TRUE);
+	return 0;
+}
+
+int janus_mp4_close(janus_mp4 *mp4) {
+	if(mp4 == NULL)
+		return -1;
+	int res = 0;
+	if(!mp4->header) {
+		JANUS_LOG(LOG_ERR, "No keyframe to start from, nothing written to the .mp4 file\n");
+		res = -1;
+	} else {
+		res = janus_mp4_flush(mp4);
+		/* Now we know how long the tracks are */
+		uint32_t duration = 0;
+		int i = 0;
+		for(i=0; i<mp4->tracks_num && res == 0; i++) {
+			uint32_t tduration = janus_mp4_track_duration(mp4->tracks[i]);
+			duration = MAX(duration, tduration);
+			uint32_t value = htonl(tduration);
+			if(fseek(mp4->file, mp4->tracks[i]->tkhd_duration, SEEK_SET) < 0 || fwrite(&value, sizeof(value), 1, mp4->file) != 1)
+				res = -1;
+		}
+		long offsets[] = { mp4->mvhd_duration, mp4->mehd_duration };
+		for(i=0; i<2 && res == 0; i++) {
+			uint32_t value = htonl(duration);
+			if(fseek(mp4->file, offsets[i], SEEK_SET) < 0 || fwrite(&value, sizeof(value), 1, mp4->file) != 1)
+				res = -1;
+		}
+		JANUS_LOG(LOG_INFO, "Wrote %"SCNu32" video and %"SCNu32" audio samples in %"SCNu32" fragments (%"SCNu32" ms)\n",
+			mp4->video.written, mp4->audio.written, mp4->sequence, duration);
+	}
+	if(fclose(mp4->file) != 0)
+		res = -1;
+	janus_mp4_track_free(&mp4->video);
+	janus_mp4_track_free(&mp4->audio);
+	g_free(mp4);
+	return res;
+}
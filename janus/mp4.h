@@ -0,0 +1,68 @@
+/*! \file    mp4.h
+ * \copyright GNU General Public License v3
+ * \brief    Native fragmented MP4 writer (headers)
+ * \details  A minimal ISO BMFF muxer that writes H.264 or VP8 video
+ * and/or Opus audio to a fragmented .mp4 file, without going through
+ * FFmpeg. It's used both by the live recorder (see \ref record.h) and by
+ * the post-processor, when converting H.264 recordings.
+ *
+ * The initialization segment (ftyp+moov) is written as soon as the first
+ * keyframe brings what's needed to describe the video (SPS and PPS for
+ * H.264, the frame size for VP8), or with the first packet in audio-only
+ * files. Samples are then buffered in memory and written as a moof+mdat
+ * fragment at each keyframe (every second for audio-only files, or when
+ * a fragment grows too large), with a handful of large writes per
+ * fragment. This means that a file that was not closed properly is still
+ * playable up to its last complete fragment. The avcC record and the
+ * conversion of the Annex-B frames to length prefixed NAL units use the
+ * libflv helpers.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_MP4_H
+#define _JANUS_MP4_H
+
+#include <inttypes.h>
+
+/*! \brief Codecs the writer supports */
+typedef enum janus_mp4_codec {
+	JANUS_MP4_NONE = 0,
+	JANUS_MP4_H264,
+	JANUS_MP4_VP8,
+	JANUS_MP4_OPUS
+} janus_mp4_codec;
+
+/*! \brief Opaque fragmented MP4 writer */
+typedef struct janus_mp4 janus_mp4;
+
+/*! \brief Create a new .mp4 file
+ * @param[in] destination Path of the file to write
+ * @param[in] video Video codec (JANUS_MP4_H264 or JANUS_MP4_VP8), or JANUS_MP4_NONE for audio-only files
+ * @param[in] width Video width, for the track header (0 to get it from the first keyframe)
+ * @param[in] height Video height, for the track header (0 to get it from the first keyframe)
+ * @param[in] audio Audio codec (JANUS_MP4_OPUS), or JANUS_MP4_NONE for video-only files
+ * @returns A writer instance, or NULL in case of errors */
+janus_mp4 *janus_mp4_create(const char *destination, janus_mp4_codec video, int width, int height, janus_mp4_codec audio);
+/*! \brief Add a video frame
+ * @param[in] mp4 The writer instance
+ * @param[in] frame The frame: NAL units with start codes (Annex-B) for H.264
+ * @param[in] len Length of the frame
+ * @param[in] pts Presentation time (90kHz clock)
+ * @param[in] keyframe Whether this is a keyframe
+ * @returns 0 if the frame was queued, 1 if it was skipped, -1 in case of errors */
+int janus_mp4_write_video(janus_mp4 *mp4, const uint8_t *frame, int len, uint64_t pts, int keyframe);
+/*! \brief Add an audio packet
+ * @param[in] mp4 The writer instance
+ * @param[in] packet The Opus packet
+ * @param[in] len Length of the packet
+ * @param[in] pts Presentation time (48kHz clock)
+ * @returns 0 in case of success, -1 otherwise */
+int janus_mp4_write_audio(janus_mp4 *mp4, const uint8_t *packet, int len, uint64_t pts);
+/*! \brief Write the last fragment, fix the durations and close the file
+ * @param[in] mp4 The writer instance to close and free
+ * @returns 0 in case of success, -1 otherwise */
+int janus_mp4_close(janus_mp4 *mp4);
+
+#endif
@@ -0,0 +1,407 @@
+/*! \file    pcap.c
+ * \copyright GNU General Public License v3
+ * \brief    Dumping of RTP/RTCP packets to pcapng files
+ * \details  Implementation of a helper utility that can be used to dump
+ * incoming and outgoing RTP/RTCP packets to pcapng files, that can be
+ * opened in Wireshark or similar applications right away. Each packet is
+ * wrapped in synthetic IPv4/UDP headers (the PeerConnection is seen as
+ * 10.0.0.2:2000 and Janus as 10.0.0.1:1000, so you'll need a "Decode As..."
+ * RTP for the UDP ports), the direction is saved in the packet flags and
+ * the packet type, session and handle in the packet comment.
+ *
+ * Unlike the \ref text2pcap.h dumper, nothing is formatted or written on
+ * the media path: packets are copied to a lock-free ring buffer owned by
+ * the instance, which a dedicated thread drains to the file. If the ring
+ * is full (e.g., because the disk is too slow) packets are dropped, and
+ * counted as such, rather than slowing the media down. Captures can be
+ * limited to some packet types, or to a sample of the packets, and can be
+ * rotated when they get too large or too old.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "pcap.h"
+#include "debug.h"
+#include "utils.h"
+
+/* pcapng block types and options */
+#define PCAPNG_SHB				0x0A0D0D0A
+#define PCAPNG_IDB				0x00000001
+#define PCAPNG_EPB				0x00000006
+#define PCAPNG_BYTE_ORDER		0x1A2B3C4D
+#define PCAPNG_LINKTYPE_RAW		101
+#define PCAPNG_OPT_END			0
+#define PCAPNG_OPT_COMMENT		1
+#define PCAPNG_OPT_EPB_FLAGS	2
+#define PCAPNG_OPT_SHB_USERAPPL	4
+#define PCAPNG_PAD(len)			(((len) + 3) & ~3)
+
+/* Synthetic addressing: PeerConnection is 10.0.0.2:2000, Janus is 10.0.0.1:1000 */
+#define JANUS_PCAP_IP_JANUS		0x0A000001
+#define JANUS_PCAP_IP_PEER		0x0A000002
+#define JANUS_PCAP_PORT_JANUS	1000
+#define JANUS_PCAP_PORT_PEER	2000
+#define JANUS_PCAP_IPUDP_SIZE	28
+
+/* How long the writer thread sleeps when there's nothing to write */
+#define JANUS_PCAP_IDLE_US		10000
+
+#define CASE_STR(name) case name: return #name
+const char *janus_pcap_packet_string(janus_pcap_packet type) {
+	switch(type) {
+		CASE_STR(JANUS_PCAP_AUDIO);
+		CASE_STR(JANUS_PCAP_VIDEO);
+		CASE_STR(JANUS_PCAP_RTCP);
+		CASE_STR(JANUS_PCAP_DATA);
+		default:
+			break;
+	}
+	return NULL;
+}
+
+/* Helpers to serialize pcapng blocks (in host byte order, as the
+ * byte-order magic in the section header tells readers about it) */
+static size_t janus_pcap_put32(char *buf, size_t offset, uint32_t value) {
+	memcpy(buf+offset, &value, sizeof(value));
+	return offset + sizeof(value);
+}
+
+static size_t janus_pcap_put_option(char *buf, size_t offset, uint16_t code, const char *value, uint16_t len) {
+	memcpy(buf+offset, &code, sizeof(code));
+	memcpy(buf+offset+2, &len, sizeof(len));
+	offset += 4;
+	if(len > 0) {
+		memcpy(buf+offset, value, len);
+		memset(buf+offset+len, 0, PCAPNG_PAD(len)-len);
+		offset += PCAPNG_PAD(len);
+	}
+	return offset;
+}
+
+/* Write a section header and an interface description for a new file */
+static int janus_pcap_write_header(janus_pcap *pcap) {
+	char buf[128];
+	const char *appl = "Janus WebRTC Server";
+	/* Section Header Block */
+	size_t offset = janus_pcap_put32(buf, 0, PCAPNG_SHB);
+	offset += 4;	/* Block length, we'll fill it in later */
+	offset = janus_pcap_put32(buf, offset, PCAPNG_BYTE_ORDER);
+	uint16_t version[2] = { 1, 0 };
+	memcpy(buf+offset, version, sizeof(version));
+	offset += sizeof(version);
+	int64_t section_length = -1;
+	memcpy(buf+offset, &section_length, sizeof(section_length));
+	offset += sizeof(section_length);
+	offset = janus_pcap_put_option(buf, offset, PCAPNG_OPT_SHB_USERAPPL, appl, strlen(appl));
+	offset = janus_pcap_put_option(buf, offset, PCAPNG_OPT_END, NULL, 0);
+	offset = janus_pcap_put32(buf, offset, offset+4);
+	janus_pcap_put32(buf, 4, offset);
+	/* Interface Description Block: raw IP, default (microseconds) resolution */
+	size_t idb = offset;
+	offset = janus_pcap_put32(buf, offset, PCAPNG_IDB);
+	offset += 4;
+	uint16_t linktype[2] = { PCAPNG_LINKTYPE_RAW, 0 };
+	memcpy(buf+offset, linktype, sizeof(linktype));
+	offset += sizeof(linktype);
+	offset = janus_pcap_put32(buf, offset, JANUS_PCAP_IPUDP_SIZE + JANUS_PCAP_SNAPLEN);
+	offset = janus_pcap_put32(buf, offset, offset-idb+4);
+	janus_pcap_put32(buf, idb+4, offset-idb);
+	if(fwrite(buf, sizeof(char), offset, pcap->file) != offset)
+		return -1;
+	pcap->bytes += offset;
+	return 0;
+}
+
+/* Open the next file: the first one gets the name we were given, the next ones a suffix */
+static int janus_pcap_open(janus_pcap *pcap) {
+	int index = g_atomic_int_get(&pcap->files);
+	char *fname = NULL;
+	if(index == 0) {
+		fname = g_strdup(pcap->filename);
+	} else {
+		const char *ext = strrchr(pcap->filename, '.');
+		const char *slash = strrchr(pcap->filename, '/');
+		if(ext == NULL || (slash != NULL && ext < slash))
+			fname = g_strdup_printf("%s-%d", pcap->filename, index);
+		else
+			fname = g_strdup_printf("%.*s-%d%s", (int)(ext-pcap->filename), pcap->filename, index, ext);
+	}
+	FILE *f = fopen(fname, "wb");
+	if(f == NULL) {
+		JANUS_LOG(LOG_ERR, "fopen(%s) error: %d\n", fname, errno);
+		g_free(fname);
+		return -1;
+	}
+	/* We write from a thread of our own, so a larger buffer only means fewer syscalls */
+	setvbuf(f, NULL, _IOFBF, 64*1024);
+	janus_mutex_lock_nodebug(&pcap->mutex);
+	if(pcap->file != NULL)
+		fclose(pcap->file);
+	pcap->file = f;
+	g_free(pcap->current);
+	pcap->current = fname;
+	janus_mutex_unlock_nodebug(&pcap->mutex);
+	pcap->bytes = 0;
+	g_atomic_int_inc(&pcap->files);
+	if(janus_pcap_write_header(pcap) < 0) {
+		JANUS_LOG(LOG_ERR, "Error writing pcapng header to %s\n", fname);
+		return -1;
+	}
+	return 0;
+}
+
+/* Turn a queued packet in an Enhanced Packet Block, with fake IP/UDP headers */
+static int janus_pcap_write_packet(janus_pcap *pcap, janus_pcap_slot *slot) {
+	char buf[128 + JANUS_PCAP_IPUDP_SIZE + JANUS_PCAP_SNAPLEN + JANUS_PCAP_COMMENT_SIZE];
+	size_t offset = janus_pcap_put32(buf, 0, PCAPNG_EPB);
+	offset += 4;
+	offset = janus_pcap_put32(buf, offset, 0);	/* Interface ID */
+	uint64_t when = slot->when;
+	offset = janus_pcap_put32(buf, offset, (uint32_t)(when >> 32));
+	offset = janus_pcap_put32(buf, offset, (uint32_t)(when & 0xFFFFFFFF));
+	offset = janus_pcap_put32(buf, offset, JANUS_PCAP_IPUDP_SIZE + slot->caplen);
+	offset = janus_pcap_put32(buf, offset, JANUS_PCAP_IPUDP_SIZE + slot->length);
+	/* IPv4 header */
+	unsigned char *ip = (unsigned char *)buf+offset;
+	uint16_t total = htons(JANUS_PCAP_IPUDP_SIZE + slot->length);
+	uint32_t src = htonl(slot->incoming ? JANUS_PCAP_IP_PEER : JANUS_PCAP_IP_JANUS);
+	uint32_t dst = htonl(slot->incoming ? JANUS_PCAP_IP_JANUS : JANUS_PCAP_IP_PEER);
+	memset(ip, 0, 20);
+	ip[0] = 0x45;
+	memcpy(ip+2, &total, sizeof(total));
+	ip[6] = 0x40;	/* Don't fragment */
+	ip[8] = 64;		/* TTL */
+	ip[9] = 17;		/* UDP */
+	memcpy(ip+12, &src, sizeof(src));
+	memcpy(ip+16, &dst, sizeof(dst));
+	uint32_t sum = 0;
+	int i = 0;
+	for(i=0; i<20; i+=2)
+		sum += (ip[i] << 8) | ip[i+1];
+	while(sum >> 16)
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	uint16_t checksum = htons(~sum & 0xFFFF);
+	memcpy(ip+10, &checksum, sizeof(checksum));
+	/* UDP header (no checksum, which is fine for IPv4) */
+	unsigned char *udp = ip+20;
+	uint16_t sport = htons(slot->incoming ? JANUS_PCAP_PORT_PEER : JANUS_PCAP_PORT_JANUS);
+	uint16_t dport = htons(slot->incoming ? JANUS_PCAP_PORT_JANUS : JANUS_PCAP_PORT_PEER);
+	uint16_t ulen = htons(8 + slot->length);
+	memcpy(udp, &sport, sizeof(sport));
+	memcpy(udp+2, &dport, sizeof(dport));
+	memcpy(udp+4, &ulen, sizeof(ulen));
+	memset(udp+6, 0, 2);
+	/* Payload, padded to 32 bits */
+	memcpy(udp+8, slot->data, slot->caplen);
+	size_t caplen = JANUS_PCAP_IPUDP_SIZE + slot->caplen;
+	memset(buf+offset+caplen, 0, PCAPNG_PAD(caplen)-caplen);
+	offset += PCAPNG_PAD(caplen);
+	/* Options: direction (1=inbound, 2=outbound) and comment */
+	uint32_t flags = slot->incoming ? 1 : 2;
+	offset = janus_pcap_put_option(buf, offset, PCAPNG_OPT_EPB_FLAGS, (char *)&flags, sizeof(flags));
+	size_t clen = strlen(slot->comment);
+	if(clen > 0)
+		offset = janus_pcap_put_option(buf, offset, PCAPNG_OPT_COMMENT, slot->comment, clen);
+	offset = janus_pcap_put_option(buf, offset, PCAPNG_OPT_END, NULL, 0);
+	offset = janus_pcap_put32(buf, offset, offset+4);
+	janus_pcap_put32(buf, 4, offset);
+	if(fwrite(buf, sizeof(char), offset, pcap->file) != offset)
+		return -1;
+	pcap->bytes += offset;
+	return 0;
+}
+
+/* Thread draining the ring buffer to file */
+static void *janus_pcap_thread(void *data) {
+	janus_pcap *pcap = (janus_pcap *)data;
+	JANUS_LOG(LOG_VERB, "Joining pcapng thread (%s)\n", pcap->filename);
+	gint64 started = janus_get_real_time();
+	gboolean failed = FALSE;
+	while(TRUE) {
+		janus_pcap_slot *slot = &pcap->ring[pcap->head & (JANUS_PCAP_RING_SIZE-1)];
+		if(g_atomic_int_get(&slot->sequence) != (gint)(pcap->head+1)) {
+			/* Nothing to write: if we're done, we can leave */
+			if(!g_atomic_int_get(&pcap->writable))
+				break;
+			if(pcap->file != NULL)
+				fflush(pcap->file);
+			if(pcap->rotate_time > 0 && !failed &&
+					janus_get_real_time() - started >= (gint64)pcap->rotate_time*G_USEC_PER_SEC) {
+				failed = (janus_pcap_open(pcap) < 0);
+				started = janus_get_real_time();
+			}
+			g_usleep(JANUS_PCAP_IDLE_US);
+			continue;
+		}
+		/* Rotate first, if needed, so that the packet goes in the new file */
+		if(!failed && ((pcap->rotate_size > 0 && pcap->bytes >= pcap->rotate_size) ||
+				(pcap->rotate_time > 0 && slot->when - started >= (gint64)pcap->rotate_time*G_USEC_PER_SEC))) {
+			failed = (janus_pcap_open(pcap) < 0);
+			started = slot->when;
+		}
+		if(!failed && janus_pcap_write_packet(pcap, slot) < 0) {
+			JANUS_LOG(LOG_ERR, "Error dumping packet to %s, dropping the rest of the capture\n", pcap->current);
+			failed = TRUE;
+		}
+		if(failed)
+			g_atomic_int_inc(&pcap->dropped);
+		else
+			g_atomic_int_inc(&pcap->packets);
+		/* Give the slot back to producers */
+		g_atomic_int_set(&slot->sequence, (gint)(pcap->head + JANUS_PCAP_RING_SIZE));
+		pcap->head++;
+	}
+	janus_mutex_lock_nodebug(&pcap->mutex);
+	if(pcap->file != NULL)
+		fclose(pcap->file);
+	pcap->file = NULL;
+	janus_mutex_unlock_nodebug(&pcap->mutex);
+	JANUS_LOG(LOG_VERB, "Leaving pcapng thread (%s)\n", pcap->filename);
+	return NULL;
+}
+
+janus_pcap *janus_pcap_create(const char *dir, const char *filename, int truncate,
+		int filter, guint sample, gint64 rotate_size, gint rotate_time) {
+	janus_pcap *pcap;
+	char newname[1024];
+	char *fname;
+
+	if(truncate < 0 || rotate_size < 0 || rotate_time < 0)
+		return NULL;
+
+	/* Copy given filename or generate a random one */
+	if (filename == NULL)
+		g_snprintf(newname, sizeof(newname),
+		    "janus-pcap-%"SCNu32".pcapng", janus_random_uint32());
+	else
+		g_strlcpy(newname, filename, sizeof(newname));
+
+	if(dir != NULL) {
+		/* Create the directory, if needed */
+		if(janus_mkdir(dir, 0755) < 0) {
+			JANUS_LOG(LOG_ERR, "mkdir error: %d\n", errno);
+			return NULL;
+		}
+
+		fname = g_strdup_printf("%s/%s", dir, newname);
+	} else {
+		fname = g_strdup(newname);
+	}
+
+	/* Create the pcapng instance */
+	pcap = g_malloc0(sizeof(janus_pcap));
+	pcap->filename = fname;
+	pcap->truncate = truncate;
+	pcap->filter = filter ? filter : JANUS_PCAP_ALL;
+	pcap->sample = sample ? sample : 1;
+	pcap->rotate_size = rotate_size;
+	pcap->rotate_time = rotate_time;
+	janus_mutex_init(&pcap->mutex);
+	/* Try opening the file now, so that we can fail right away */
+	if(janus_pcap_open(pcap) < 0) {
+		janus_pcap_free(pcap);
+		return NULL;
+	}
+	pcap->ring = g_malloc(JANUS_PCAP_RING_SIZE * sizeof(janus_pcap_slot));
+	int i = 0;
+	for(i=0; i<JANUS_PCAP_RING_SIZE; i++)
+		g_atomic_int_set(&pcap->ring[i].sequence, i);
+	g_atomic_int_set(&pcap->writable, 1);
+	GError *error = NULL;
+	pcap->thread = g_thread_try_new("pcap", janus_pcap_thread, pcap, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the pcapng thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		g_atomic_int_set(&pcap->writable, 0);
+		janus_pcap_free(pcap);
+		return NULL;
+	}
+
+	return pcap;
+}
+
+int janus_pcap_dump(janus_pcap *instance,
+		janus_pcap_packet type, gboolean incoming, char *buf, int len, const char *format, ...) {
+	if(instance == NULL || buf == NULL || len < 1)
+		return -1;
+	if(!g_atomic_int_get(&instance->writable))
+		return -1;
+	if(!(instance->filter & type))
+		return 1;
+	if(instance->sample > 1 && ((guint)g_atomic_int_add(&instance->counter, 1) % instance->sample) != 0)
+		return 1;
+	/* Reserve a slot in the ring: this is a bounded MPSC queue, where the
+	 * sequence of each slot tells whether it's free for this round */
+	janus_pcap_slot *slot = NULL;
+	gint pos = g_atomic_int_get(&instance->tail);
+	while(TRUE) {
+		slot = &instance->ring[(guint)pos & (JANUS_PCAP_RING_SIZE-1)];
+		gint diff = g_atomic_int_get(&slot->sequence) - pos;
+		if(diff == 0) {
+			if(g_atomic_int_compare_and_exchange(&instance->tail, pos, pos+1))
+				break;
+			pos = g_atomic_int_get(&instance->tail);
+		} else if(diff < 0) {
+			/* The writer thread can't keep up, drop the packet */
+			g_atomic_int_inc(&instance->dropped);
+			return -2;
+		} else {
+			pos = g_atomic_int_get(&instance->tail);
+		}
+	}
+	/* Fill in the slot and hand it to the writer thread */
+	slot->when = janus_get_real_time();
+	slot->type = type;
+	slot->incoming = incoming;
+	slot->length = len;
+	int stop = instance->truncate && instance->truncate < len ? instance->truncate : len;
+	slot->caplen = stop > JANUS_PCAP_SNAPLEN ? JANUS_PCAP_SNAPLEN : stop;
+	memcpy(slot->data, buf, slot->caplen);
+	int clen = g_snprintf(slot->comment, sizeof(slot->comment), "%s", janus_pcap_packet_string(type)+strlen("JANUS_PCAP_"));
+	if(format && clen < (int)sizeof(slot->comment)-1) {
+		/* This callback has variable arguments (error string) */
+		va_list ap;
+		va_start(ap, format);
+		slot->comment[clen] = ' ';
+		g_vsnprintf(slot->comment+clen+1, sizeof(slot->comment)-clen-1, format, ap);
+		va_end(ap);
+	}
+	g_atomic_int_set(&slot->sequence, pos+1);
+	return 0;
+}
+
+int janus_pcap_close(janus_pcap *instance) {
+	if(instance == NULL)
+		return -1;
+	janus_mutex_lock_nodebug(&instance->mutex);
+	if(!g_atomic_int_compare_and_exchange(&instance->writable, 1, 0)) {
+		janus_mutex_unlock_nodebug(&instance->mutex);
+		return 0;
+	}
+	janus_mutex_unlock_nodebug(&instance->mutex);
+	/* The thread writes what's left in the ring, and then closes the file */
+	if(instance->thread != NULL) {
+		g_thread_join(instance->thread);
+		instance->thread = NULL;
+	}
+	JANUS_LOG(LOG_VERB, "Closed pcapng capture %s (%d packets, %d dropped, %d files)\n", instance->filename,
+		g_atomic_int_get(&instance->packets), g_atomic_int_get(&instance->dropped), g_atomic_int_get(&instance->files));
+	return 0;
+}
+
+void janus_pcap_free(janus_pcap *instance) {
+	if(instance == NULL)
+		return;
+	janus_pcap_close(instance);
+	if(instance->file != NULL)
+		fclose(instance->file);
+	g_free(instance->ring);
+	g_free(instance->filename);
+	g_free(instance->current);
+	g_free(instance);
+}
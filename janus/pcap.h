@@ -0,0 +1,152 @@
+/*! \file    pcap.h
+ * \copyright GNU General Public License v3
+ * \brief    Dumping of RTP/RTCP packets to pcapng files (headers)
+ * \details  Implementation of a helper utility that can be used to dump
+ * incoming and outgoing RTP/RTCP packets to pcapng files, that can be
+ * opened in Wireshark or similar applications right away. Each packet is
+ * wrapped in synthetic IPv4/UDP headers (the PeerConnection is seen as
+ * 10.0.0.2:2000 and Janus as 10.0.0.1:1000, so you'll need a "Decode As..."
+ * RTP for the UDP ports), the direction is saved in the packet flags and
+ * the packet type, session and handle in the packet comment.
+ *
+ * Unlike the \ref text2pcap.h dumper, nothing is formatted or written on
+ * the media path: packets are copied to a lock-free ring buffer owned by
+ * the instance, which a dedicated thread drains to the file. If the ring
+ * is full (e.g., because the disk is too slow) packets are dropped, and
+ * counted as such, rather than slowing the media down. Captures can be
+ * limited to some packet types, or to a sample of the packets, and can be
+ * rotated when they get too large or too old.
+ *
+ * Enabling and disabling the capture for the media traffic of a specific
+ * handle is done via the \ref admin so check the documentation of that
+ * section for more details. Unlike text2pcap, starting a new capture on
+ * an existing filename will overwrite it, as pcapng sections can't be
+ * appended to.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_PCAP_H
+#define _JANUS_PCAP_H
+
+#include <glib.h>
+
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mutex.h"
+
+/*! \brief Number of packets the ring buffer can hold (must be a power of 2) */
+#define JANUS_PCAP_RING_SIZE		1024
+/*! \brief Max number of bytes we save for each packet, unless truncated further */
+#define JANUS_PCAP_SNAPLEN			1600
+/*! \brief Max size of the comment associated to each packet */
+#define JANUS_PCAP_COMMENT_SIZE		96
+
+/*! \brief Packet types we can dump */
+typedef enum janus_pcap_packet {
+	JANUS_PCAP_AUDIO = (1 << 0),
+	JANUS_PCAP_VIDEO = (1 << 1),
+	JANUS_PCAP_RTCP = (1 << 2),
+	JANUS_PCAP_DATA = (1 << 3)
+} janus_pcap_packet;
+/*! \brief Mask to capture all packet types */
+#define JANUS_PCAP_ALL	(JANUS_PCAP_AUDIO | JANUS_PCAP_VIDEO | JANUS_PCAP_RTCP | JANUS_PCAP_DATA)
+const char *janus_pcap_packet_string(janus_pcap_packet type);
+
+/*! \brief Packet as queued in the ring buffer, waiting to be written */
+typedef struct janus_pcap_slot {
+	/*! \brief Position of the slot in the ring, used to synchronize producers and consumer */
+	volatile gint sequence;
+	/*! \brief When the packet was captured (real time, microseconds) */
+	gint64 when;
+	/*! \brief Type of the packet */
+	janus_pcap_packet type;
+	/*! \brief Whether this is an incoming or outgoing packet */
+	gboolean incoming;
+	/*! \brief Size of the original packet, and of how much we saved */
+	int length, caplen;
+	/*! \brief Comment to add to the packet */
+	char comment[JANUS_PCAP_COMMENT_SIZE];
+	/*! \brief The packet itself */
+	char data[JANUS_PCAP_SNAPLEN];
+} janus_pcap_slot;
+
+/*! \brief Instance of a pcapng recorder */
+typedef struct janus_pcap {
+	/*! \brief Absolute path to where the pcapng file is stored (the first one, when rotating) */
+	char *filename;
+	/*! \brief Absolute path to the pcapng file currently being written */
+	char *current;
+	/*! \brief Pointer to the file handle (only accessed by the writer thread) */
+	FILE *file;
+	/*! \brief Number of bytes to truncate at */
+	int truncate;
+	/*! \brief Mask of the packet types to capture (see janus_pcap_packet) */
+	int filter;
+	/*! \brief Only capture one packet every \c sample (1 means all of them) */
+	guint sample;
+	/*! \brief Size (in bytes) after which a new file must be started, 0 to never rotate on size */
+	gint64 rotate_size;
+	/*! \brief Seconds after which a new file must be started, 0 to never rotate on time */
+	gint rotate_time;
+	/*! \brief Ring buffer of the packets waiting to be written */
+	janus_pcap_slot *ring;
+	/*! \brief Position of the next slot producers will fill */
+	volatile gint tail;
+	/*! \brief Position of the next slot the writer thread will consume */
+	guint head;
+	/*! \brief Counter used for sampling */
+	volatile gint counter;
+	/*! \brief Thread writing the packets to file */
+	GThread *thread;
+	/*! \brief Statistics */
+	volatile gint packets, dropped, files;
+	gint64 bytes;
+	/*! \brief Whether we can write to this file or not */
+	volatile int writable;
+	/*! \brief Mutex to lock/unlock this recorder instance */
+	janus_mutex mutex;
+} janus_pcap;
+
+/*! \brief Create a pcapng recorder
+ * \note If no target directory is provided, the current directory will be used. If no filename
+ * is passed, a random filename will be used. When rotating, subsequent files get a \c -1, \c -2, etc.
+ * suffix before the extension.
+ * @param[in] dir Path of the directory to save the recording into (will try to create it if it doesn't exist)
+ * @param[in] filename Filename to use for the recording
+ * @param[in] truncate Number of bytes to truncate each packet at (0 to not truncate at all)
+ * @param[in] filter Mask of the packet types to capture (0 means all)
+ * @param[in] sample Only capture one packet every \c sample (0 or 1 means all of them)
+ * @param[in] rotate_size Size in bytes after which to start a new file (0 to not rotate on size)
+ * @param[in] rotate_time Seconds after which to start a new file (0 to not rotate on time)
+ * @returns A valid janus_pcap instance in case of success, NULL otherwise */
+janus_pcap *janus_pcap_create(const char *dir, const char *filename, int truncate,
+	int filter, guint sample, gint64 rotate_size, gint rotate_time);
+
+/*! \brief Queue an RTP, RTCP or data packet for dumping
+ * \note This can be called from any thread, and never blocks: if the ring buffer is
+ * full, the packet is dropped
+ * @param[in] instance Instance of the janus_pcap recorder to dump the packet to
+ * @param[in] type Type of the packet we're going to dump
+ * @param[in] incoming Whether this is an incoming or outgoing packet
+ * @param[in] buf Packet data to dump
+ * @param[in] len Size of the packet data to dump
+ * @param[in] format Format for the optional string to add to the packet comment, if any
+ * @returns 0 in case of success, 1 if the packet was filtered out, a negative integer otherwise */
+int janus_pcap_dump(janus_pcap *instance,
+	janus_pcap_packet type, gboolean incoming, char *buf, int len, const char *format, ...) G_GNUC_PRINTF(6, 7);
+
+/*! \brief Close a pcapng recorder, after writing all the packets still in the ring buffer
+ * @param[in] instance Instance of the janus_pcap recorder to close
+ * @returns 0 in case of success, a negative integer otherwise */
+int janus_pcap_close(janus_pcap *instance);
+
+/*! \brief Free a pcapng instance
+ * @param[in] instance Instance of the janus_pcap recorder to free */
+void janus_pcap_free(janus_pcap *instance);
+
+#endif
@@ -88,6 +88,10 @@
  * - \c addRecipient(): specify which user should receive a user's media;
  * - \c removeRecipient(): specify which user should not receive a user's media anymore;
  * - \c setBitrate(): specify the bitrate to force on a user via REMB feedback;
+ * - \c setSimulcastLayer(): specify which simulcast substream and temporal layer a user should receive;
+ * - \c setBitrateCap(): specify the maximum bitrate of the simulcast video a user should receive;
+ * - \c setRecipientGroup(): put a user in one of the fan-out groups (0-31) of the user they receive media from;
+ * - \c muteGroup(): specify whether audio/video of a user should be relayed to one of their fan-out groups;
  * - \c setPliFreq(): specify how often the plugin should send a PLI to this user;
  * - \c sendPli(): send a PLI (keyframe request);
  * - \c startRecording(): start recording audio, video and or data for a user;
@@ -95,6 +99,15 @@
  * - \c pokeScheduler(): notify the C code that there's a coroutine to resume;
  * - \c timeCallback(): trigger the execution of a JavaScript function after X milliseconds.
  *
+ * Notice that the methods that affect media routing (\c configureMedium(),
+ * \c addRecipient(), \c removeRecipient(), \c setSimulcastLayer(),
+ * \c setBitrateCap(), \c setRecipientGroup() and \c muteGroup() ) don't involve the JavaScript script when packets
+ * are actually relayed: they update a routing table the C code consults
+ * for each packet, which means that, unless \c incomingRtp() is implemented,
+ * scripts only control the topology, and never see the media itself.
+ * Simulcast SSRCs and the negotiated video codec are taken from the JSEP
+ * going through the plugin, so no action is needed from the script there.
+ *
  * As anticipated in the previous section, almost all these methods also
  * expect the unique session identifier to address a specific user in the
  * plugin. This is true for all the above methods expect \c eventsIsEnabled
@@ -177,6 +190,39 @@ timeCallback("resumeScheduler", null, 0);
  * Anyway, \c pokeScheduler() and \c resumeScheduler() is much more
  * compact and less verbose, and as such is preferred in cases where
  * timing and opaque arguments are not needed.
+ *
+ * \section duktapevms Multiple Duktape VMs
+ *
+ * By default, the plugin creates a single Duktape heap, which means that
+ * all the callbacks (no matter which session they're for) are serialized.
+ * Using the \c vms property in the plugin configuration, you can ask for
+ * more independent heaps (VMs) to be created instead: all of them evaluate
+ * the same script and get the same \c init() call, and each session is
+ * bound to one of them for its whole lifetime, so that sessions that ended
+ * up in different VMs can be served in parallel. Each VM has its own C
+ * scheduler too, so \c pokeScheduler() and \c timeCallback() only involve
+ * the VM they're called from. To see how many callbacks per second different
+ * numbers of VMs can serve on your machine, check \c script-bench (\c make
+ * \c script-bench in the Janus folder).
+ *
+ * Since VMs share nothing, a script that keeps state across sessions
+ * (e.g., rooms in \c videoroom.js ) will need to share it explicitly.
+ * This can be done with a few additional functions: \c getVmInfo()
+ * returns an object with the \c index of the current VM and the \c count
+ * of VMs; \c getSessionVm() returns the index of the VM a session is
+ * bound to; \c sendMessage() queues a string to the script running in a
+ * specific VM (or in all the others, if the index is -1), which will get
+ * it via an \c incomingMessage() callback the script must implement for
+ * the purpose:
+ *
+ * \verbatim
+// Tell the VM handling session 1234 about something
+sendMessage(getSessionVm(1234), JSON.stringify({ kick: 1234 }));
+// ... which will be notified to the script running there as
+function incomingMessage(fromVm, message) {
+	// Handle the message
+}
+\endverbatim
  *
  * Refer to the \ref jspapi section for more information on how you
  * can register your own C functions.
@@ -258,8 +304,9 @@ janus_callbacks *janus_core = NULL;
 static char *duktape_folder = NULL;
 
 /* Duktape stuff */
-duk_context *duktape_ctx = NULL;
-janus_mutex duktape_mutex = JANUS_MUTEX_INITIALIZER;
+janus_duktape_vm *duktape_vms = NULL;
+guint duktape_vms_num = 0;
+#define JANUS_DUKTAPE_VM_KEY	"janus_duktape_vm"
 static const char *duktape_functions[] = {
 	"init", "destroy", "resumeScheduler",
 	"createSession", "destroySession", "querySession",
@@ -284,15 +331,22 @@ static gboolean has_incoming_rtp = FALSE;
 static gboolean has_incoming_rtcp = FALSE;
 static gboolean has_incoming_data = FALSE;
 static gboolean has_slow_link = FALSE;
-/* JavaScript C scheduler (for coroutines) */
-static GThread *scheduler_thread = NULL;
+static gboolean has_incoming_message = FALSE;
+/* JavaScript C scheduler (for coroutines and messages between VMs), one per VM */
 static void *janus_duktape_scheduler(void *data);
-static GAsyncQueue *events = NULL;
-typedef enum janus_duktape_event {
+typedef enum janus_duktape_event_type {
 	janus_duktape_event_none = 0,
 	janus_duktape_event_resume,		/* Resume one or more pending coroutines */
+	janus_duktape_event_message,	/* Deliver a message another VM sent */
 	janus_duktape_event_exit		/* Break the scheduler loop */
+} janus_duktape_event_type;
+typedef struct janus_duktape_event {
+	janus_duktape_event_type type;	/* What this event is about */
+	guint from;						/* Index of the VM that sent the message, if any */
+	char *message;					/* Content of the message, if any */
 } janus_duktape_event;
+static janus_duktape_event janus_duktape_resume_event = { janus_duktape_event_resume, 0, NULL };
+static janus_duktape_event janus_duktape_exit_event = { janus_duktape_event_exit, 0, NULL };
 /* JavaScript timer loop (for scheduled callbacks) */
 static GMainContext *timer_context = NULL;
 static GMainLoop *timer_loop = NULL;
@@ -300,6 +354,7 @@ static GThread *timer_thread = NULL;
 static void *janus_duktape_timer(void *data);
 static gboolean janus_duktape_timer_cb(void *data);
 typedef struct janus_duktape_callback {
+	janus_duktape_vm *vm;
 	guint id;
 	uint32_t ms;
 	GSource *source;
@@ -313,6 +368,17 @@ static void janus_duktape_stackdump(duk_context *ctx) {
     JANUS_LOG(LOG_HUGE, "Total in Duktape stack: %d\n", top);
 }
 
+/* Helper to find out which VM a Duktape context (or any of its threads) belongs to */
+janus_duktape_vm *janus_duktape_vm_from_context(duk_context *ctx) {
+	if(ctx == NULL)
+		return NULL;
+	duk_push_heap_stash(ctx);
+	duk_get_prop_string(ctx, -1, JANUS_DUKTAPE_VM_KEY);
+	janus_duktape_vm *vm = (janus_duktape_vm *)duk_get_pointer(ctx, -1);
+	duk_pop_2(ctx);
+	return vm;
+}
+
 /* janus_duktape_session is defined in janus_duktape_data.h, but it's managed here */
 GHashTable *duktape_sessions, *duktape_ids;
 janus_mutex duktape_sessions_mutex = JANUS_MUTEX_INITIALIZER;
@@ -335,6 +401,87 @@ static void janus_duktape_session_free(const janus_refcount *session_ref) {
 	g_free(session);
 }
 
+/* Native routing tables are rebuilt out of the recipients list whenever the
+ * script changes the topology, and then swapped: the RTP path only needs to
+ * grab a reference to the current table, rather than walking the list locked */
+static void janus_duktape_routes_free(const janus_refcount *routes_ref) {
+	janus_duktape_routes *routes = janus_refcount_containerof(routes_ref, janus_duktape_routes, ref);
+	guint i = 0;
+	for(i=0; i<routes->count; i++)
+		janus_refcount_decrease(&routes->recipients[i]->ref);
+	g_free(routes->recipients);
+	g_free(routes);
+}
+
+/* Must be called with the recipients mutex of the session locked */
+static void janus_duktape_session_update_routes(janus_duktape_session *session) {
+	janus_duktape_routes *routes = NULL;
+	guint count = g_slist_length(session->recipients);
+	if(count > 0) {
+		routes = g_malloc0(sizeof(janus_duktape_routes));
+		routes->recipients = g_malloc(count * sizeof(janus_duktape_session *));
+		GSList *temp = session->recipients;
+		while(temp) {
+			janus_duktape_session *recipient = (janus_duktape_session *)temp->data;
+			janus_refcount_increase(&recipient->ref);
+			routes->recipients[routes->count] = recipient;
+			routes->count++;
+			temp = temp->next;
+		}
+		janus_refcount_init(&routes->ref, janus_duktape_routes_free);
+	}
+	janus_duktape_routes *old_routes = session->routes;
+	session->routes = routes;
+	if(old_routes != NULL)
+		janus_refcount_decrease(&old_routes->ref);
+}
+
+/* Helper to pick the simulcast layers a recipient should get, taking into
+ * account both what the script asked for and the bitrate cap, if any */
+static void janus_duktape_session_apply_bitrate_cap(janus_duktape_session *session, janus_duktape_session *sender) {
+	/* The script sets the rules atomically from the VM thread, while the targets
+	 * of the simulcast context are only ever changed here, on the RTP path */
+	int layers = g_atomic_int_get(&session->layers_wanted);
+	int substream = layers >> 4, templayer = layers & 0x0F;
+	uint32_t bitrate_cap = (uint32_t)g_atomic_int_get(&session->bitrate_cap);
+	if(g_atomic_int_compare_and_exchange(&session->rules_changed, 1, 0))
+		session->cap_switch = 0;
+	if(bitrate_cap > 0 && sender->substream_bitrate[0] > 0) {
+		/* Pick the highest substream that fits the cap */
+		int i = 0;
+		for(i=substream; i>0; i--) {
+			uint32_t needed = sender->substream_bitrate[i];
+			if(needed == 0)	/* The sender is not sending this substream */
+				continue;
+			/* Be more conservative when going up, to avoid oscillations */
+			if(i > session->sim_context.substream)
+				needed += needed/5;
+			if(needed <= bitrate_cap)
+				break;
+		}
+		substream = i;
+		if(substream == 0 && sender->vcodec == JANUS_VIDEOCODEC_VP8 && sender->substream_bitrate[0] > bitrate_cap) {
+			/* Even the lowest substream doesn't fit, drop temporal layers too: we assume
+			 * the base layer takes roughly 40% of the bitrate, and the first two 60% */
+			if((uint64_t)sender->substream_bitrate[0]*6/10 <= bitrate_cap)
+				templayer = MIN(templayer, 1);
+			else
+				templayer = 0;
+		}
+	}
+	if(substream == session->sim_context.substream_target && templayer == session->sim_context.templayer_target)
+		return;
+	/* Don't switch too often because of the cap, though */
+	gint64 now = janus_get_monotonic_time();
+	if(bitrate_cap > 0 && now - session->cap_switch < G_USEC_PER_SEC)
+		return;
+	JANUS_LOG(LOG_VERB, "Switching session %"SCNu32" to substream %d and temporal layer %d (were %d and %d)\n",
+		session->id, substream, templayer, session->sim_context.substream_target, session->sim_context.templayer_target);
+	session->sim_context.substream_target = substream;
+	session->sim_context.templayer_target = templayer;
+	session->cap_switch = now;
+}
+
 /* Packet data and routing */
 typedef struct janus_duktape_rtp_relay_packet {
 	rtp_header *data;
@@ -342,6 +489,7 @@ typedef struct janus_duktape_rtp_relay_packet {
 	gboolean is_video;
 	uint32_t timestamp;
 	uint16_t seq_number;
+	janus_duktape_session *sender;
 } janus_duktape_rtp_relay_packet;
 static void janus_duktape_relay_rtp_packet(gpointer data, gpointer user_data);
 static void janus_duktape_relay_data_packet(gpointer data, gpointer user_data);
@@ -443,7 +591,8 @@ static duk_ret_t janus_duktape_method_readfile(duk_context *ctx) {
 
 static duk_ret_t janus_duktape_method_pokescheduler(duk_context *ctx) {
 	/* This method allows the JavaScript script to poke the scheduler and have it wake up ASAP */
-	g_async_queue_push(events, GUINT_TO_POINTER(janus_duktape_event_resume));
+	janus_duktape_vm *vm = janus_duktape_vm_from_context(ctx);
+	g_async_queue_push(vm->events, &janus_duktape_resume_event);
 	duk_push_int(ctx, 0);
 	return 1;
 }
@@ -470,6 +619,7 @@ static duk_ret_t janus_duktape_method_timecallback(duk_context *ctx) {
 	uint32_t ms = (uint32_t)duk_get_number(ctx, 2);
 	/* Create a callback instance */
 	janus_duktape_callback *cb = g_malloc0(sizeof(janus_duktape_callback));
+	cb->vm = janus_duktape_vm_from_context(ctx);
 	cb->function = g_strdup(function);
 	if(argument != NULL)
 		cb->argument = g_strdup(argument);
@@ -483,6 +633,75 @@ static duk_ret_t janus_duktape_method_timecallback(duk_context *ctx) {
 	return 1;
 }
 
+static duk_ret_t janus_duktape_method_getvminfo(duk_context *ctx) {
+	/* This method allows the JS script to know which VM it's running in, and how many there are */
+	janus_duktape_vm *vm = janus_duktape_vm_from_context(ctx);
+	duk_idx_t obj_idx = duk_push_object(ctx);
+	duk_push_uint(ctx, vm->index);
+	duk_put_prop_string(ctx, obj_idx, "index");
+	duk_push_uint(ctx, duktape_vms_num);
+	duk_put_prop_string(ctx, obj_idx, "count");
+	return 1;
+}
+
+static duk_ret_t janus_duktape_method_getsessionvm(duk_context *ctx) {
+	/* This method allows the JS script to know which VM is handling a specific session */
+	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 0)));
+		return duk_throw(ctx);
+	}
+	guint32 id = (guint32)duk_get_number(ctx, 0);
+	/* Find the session */
+	janus_mutex_lock(&duktape_sessions_mutex);
+	janus_duktape_session *session = g_hash_table_lookup(duktape_ids, GUINT_TO_POINTER(id));
+	int index = session ? (int)session->vm->index : -1;
+	janus_mutex_unlock(&duktape_sessions_mutex);
+	duk_push_int(ctx, index);
+	return 1;
+}
+
+static duk_ret_t janus_duktape_method_sendmessage(duk_context *ctx) {
+	/* This method allows the JS script to send a message to the script running in another
+	 * VM (or in all of them), which is how state can be shared across VMs if needed */
+	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 0)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 1) != DUK_TYPE_STRING) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_STRING), janus_duktape_type_string(duk_get_type(ctx, 1)));
+		return duk_throw(ctx);
+	}
+	int target = (int)duk_get_number(ctx, 0);
+	const char *message = duk_get_string(ctx, 1);
+	if(target >= (int)duktape_vms_num) {
+		duk_push_error_object(ctx, DUK_ERR_RANGE_ERROR, "Invalid VM %d\n", target);
+		return duk_throw(ctx);
+	}
+	if(!has_incoming_message) {
+		JANUS_LOG(LOG_WARN, "The script doesn't implement incomingMessage(), message will be dropped\n");
+		duk_push_int(ctx, -1);
+		return 1;
+	}
+	janus_duktape_vm *vm = janus_duktape_vm_from_context(ctx);
+	/* Queue the message to the target VM, or to all the others if the target is negative */
+	guint i = 0;
+	for(i=0; i<duktape_vms_num; i++) {
+		if((target >= 0 && i != (guint)target) || (target < 0 && i == vm->index))
+			continue;
+		janus_duktape_event *event = g_malloc(sizeof(janus_duktape_event));
+		event->type = janus_duktape_event_message;
+		event->from = vm->index;
+		event->message = g_strdup(message);
+		g_async_queue_push(duktape_vms[i].events, event);
+	}
+	/* Done */
+	duk_push_int(ctx, 0);
+	return 1;
+}
+
 static duk_ret_t janus_duktape_method_pushevent(duk_context *ctx) {
 	/* Get the arguments from the provided context */
 	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
@@ -540,6 +759,18 @@ static duk_ret_t janus_duktape_method_pushevent(duk_context *ctx) {
 	}
 	janus_refcount_increase(&session->ref);
 	janus_mutex_unlock(&duktape_sessions_mutex);
+	/* If there's an SDP, check which video codec we negotiated, as simulcast needs to know */
+	const char *sdp = jsep ? json_string_value(json_object_get(jsep, "sdp")) : NULL;
+	if(sdp != NULL) {
+		char sdperror[100];
+		janus_sdp *parsed_sdp = janus_sdp_parse(sdp, sdperror, sizeof(sdperror));
+		if(parsed_sdp != NULL) {
+			const char *vcodec = NULL;
+			janus_sdp_find_first_codecs(parsed_sdp, NULL, &vcodec);
+			session->vcodec = janus_videocodec_from_name(vcodec);
+			janus_sdp_destroy(parsed_sdp);
+		}
+	}
 	/* If there's an SDP attached, create a thread to send the event asynchronously:
 	 * sending it here would keep the locked Duktape context busy much longer than intended */
 	if(jsep != NULL) {
@@ -771,6 +1002,7 @@ static duk_ret_t janus_duktape_method_addrecipient(duk_context *ctx) {
 		janus_refcount_increase(&recipient->ref);
 		session->recipients = g_slist_append(session->recipients, recipient);
 		recipient->sender = session;
+		janus_duktape_session_update_routes(session);
 	}
 	janus_mutex_unlock(&session->recipients_mutex);
 	/* Done */
@@ -818,6 +1050,7 @@ static duk_ret_t janus_duktape_method_removerecipient(duk_context *ctx) {
 	if(g_slist_find(session->recipients, recipient) != NULL) {
 		session->recipients = g_slist_remove(session->recipients, recipient);
 		recipient->sender = NULL;
+		janus_duktape_session_update_routes(session);
 		unref = TRUE;
 	}
 	janus_mutex_unlock(&session->recipients_mutex);
@@ -868,6 +1101,175 @@ static duk_ret_t janus_duktape_method_setbitrate(duk_context *ctx) {
 	return 1;
 }
 
+static duk_ret_t janus_duktape_method_setsimulcastlayer(duk_context *ctx) {
+	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 0)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 1) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 1)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 2) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 2)));
+		return duk_throw(ctx);
+	}
+	uint32_t id = (uint32_t)duk_get_number(ctx, 0);
+	int substream = (int)duk_get_number(ctx, 1);
+	int templayer = (int)duk_get_number(ctx, 2);
+	if(substream < 0 || substream > 2 || templayer < 0 || templayer > 2) {
+		duk_push_error_object(ctx, DUK_ERR_RANGE_ERROR, "Invalid simulcast layers (substream %d, temporal layer %d)", substream, templayer);
+		return duk_throw(ctx);
+	}
+	/* Find the session */
+	janus_mutex_lock(&duktape_sessions_mutex);
+	janus_duktape_session *session = g_hash_table_lookup(duktape_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&duktape_sessions_mutex);
+		duk_push_error_object(ctx, DUK_ERR_ERROR, "Session %"SCNu32" doesn't exist", id);
+		return duk_throw(ctx);
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&duktape_sessions_mutex);
+	/* The layers will be enforced when relaying, taking into account the bitrate cap too */
+	g_atomic_int_set(&session->layers_wanted, (substream << 4) | templayer);
+	g_atomic_int_set(&session->rules_changed, 1);
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	duk_push_int(ctx, 0);
+	return 1;
+}
+
+static duk_ret_t janus_duktape_method_setbitratecap(duk_context *ctx) {
+	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 0)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 1) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 1)));
+		return duk_throw(ctx);
+	}
+	uint32_t id = (uint32_t)duk_get_number(ctx, 0);
+	uint32_t bitrate = (uint32_t)duk_get_number(ctx, 1);
+	/* Find the session */
+	janus_mutex_lock(&duktape_sessions_mutex);
+	janus_duktape_session *session = g_hash_table_lookup(duktape_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&duktape_sessions_mutex);
+		duk_push_error_object(ctx, DUK_ERR_ERROR, "Session %"SCNu32" doesn't exist", id);
+		return duk_throw(ctx);
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&duktape_sessions_mutex);
+	/* The cap will be enforced when relaying simulcast video to this session */
+	g_atomic_int_set(&session->bitrate_cap, bitrate);
+	g_atomic_int_set(&session->rules_changed, 1);
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	duk_push_int(ctx, 0);
+	return 1;
+}
+
+static duk_ret_t janus_duktape_method_setrecipientgroup(duk_context *ctx) {
+	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 0)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 1) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 1)));
+		return duk_throw(ctx);
+	}
+	uint32_t id = (uint32_t)duk_get_number(ctx, 0);
+	int group = (int)duk_get_number(ctx, 1);
+	if(group < 0 || group > 31) {
+		duk_push_error_object(ctx, DUK_ERR_RANGE_ERROR, "Invalid fan-out group %d", group);
+		return duk_throw(ctx);
+	}
+	/* Find the session */
+	janus_mutex_lock(&duktape_sessions_mutex);
+	janus_duktape_session *session = g_hash_table_lookup(duktape_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&duktape_sessions_mutex);
+		duk_push_error_object(ctx, DUK_ERR_ERROR, "Session %"SCNu32" doesn't exist", id);
+		return duk_throw(ctx);
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&duktape_sessions_mutex);
+	/* The sender's mute rules for this group will be enforced when relaying */
+	g_atomic_int_set(&session->group, group);
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	duk_push_int(ctx, 0);
+	return 1;
+}
+
+static duk_ret_t janus_duktape_method_mutegroup(duk_context *ctx) {
+	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 0)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 1) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 1)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 2) != DUK_TYPE_BOOLEAN) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_BOOLEAN), janus_duktape_type_string(duk_get_type(ctx, 2)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 3) != DUK_TYPE_BOOLEAN) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_BOOLEAN), janus_duktape_type_string(duk_get_type(ctx, 3)));
+		return duk_throw(ctx);
+	}
+	uint32_t id = (uint32_t)duk_get_number(ctx, 0);
+	int group = (int)duk_get_number(ctx, 1);
+	gboolean audio = duk_get_boolean(ctx, 2);
+	gboolean video = duk_get_boolean(ctx, 3);
+	if(group < 0 || group > 31) {
+		duk_push_error_object(ctx, DUK_ERR_RANGE_ERROR, "Invalid fan-out group %d", group);
+		return duk_throw(ctx);
+	}
+	/* Find the session */
+	janus_mutex_lock(&duktape_sessions_mutex);
+	janus_duktape_session *session = g_hash_table_lookup(duktape_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&duktape_sessions_mutex);
+		duk_push_error_object(ctx, DUK_ERR_ERROR, "Session %"SCNu32" doesn't exist", id);
+		return duk_throw(ctx);
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&duktape_sessions_mutex);
+	/* Update the bitmasks the RTP path checks for each recipient */
+	guint bit = 1U << group;
+	if(audio)
+		g_atomic_int_or((volatile guint *)&session->muted_audio, bit);
+	else
+		g_atomic_int_and((volatile guint *)&session->muted_audio, ~bit);
+	guint was_muted = video ? g_atomic_int_or((volatile guint *)&session->muted_video, bit) :
+		g_atomic_int_and((volatile guint *)&session->muted_video, ~bit);
+	if(!video && (was_muted & bit) && g_atomic_int_get(&session->started)) {
+		/* The group is getting video again: ask the sender for a keyframe */
+		session->pli_latest = janus_get_monotonic_time();
+		char rtcpbuf[12];
+		janus_rtcp_pli((char *)&rtcpbuf, 12);
+		janus_core->relay_rtcp(session->handle, 1, rtcpbuf, 12);
+	}
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	duk_push_int(ctx, 0);
+	return 1;
+}
+
 static duk_ret_t janus_duktape_method_setplifreq(duk_context *ctx) {
 	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
 		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
@@ -1209,54 +1611,20 @@ static duk_ret_t janus_duktape_method_stoprecording(duk_context *ctx) {
 }
 
 
-/* Plugin implementation */
-int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
-	if(g_atomic_int_get(&duktape_stopping)) {
-		/* Still stopping from before */
-		return -1;
-	}
-	if(callback == NULL || config_path == NULL) {
-		/* Invalid arguments */
-		return -1;
-	}
-
-	/* Read configuration */
-	char filename[255];
-	g_snprintf(filename, 255, "%s/%s.cfg", config_path, JANUS_DUKTAPE_PACKAGE);
-	JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
-	janus_config *config = janus_config_parse(filename);
-	if(config == NULL) {
-		/* No config means no JS script */
-		JANUS_LOG(LOG_ERR, "Failed to load configuration file for Duktape plugin...\n");
-		return -1;
-	}
-	janus_config_print(config);
-	janus_config_item *folder = janus_config_get_item_drilldown(config, "general", "path");
-	if(folder && folder->value)
-		duktape_folder = g_strdup(folder->value);
-	janus_config_item *script = janus_config_get_item_drilldown(config, "general", "script");
-	if(script == NULL || script->value == NULL) {
-		JANUS_LOG(LOG_ERR, "Missing script path in Duktape plugin configuration...\n");
-		janus_config_destroy(config);
-		g_free(duktape_folder);
-		return -1;
-	}
-	char *duktape_file = g_strdup(script->value);
-	char *duktape_config = NULL;
-	janus_config_item *conf = janus_config_get_item_drilldown(config, "general", "config");
-	if(conf && conf->value)
-		duktape_config = g_strdup(conf->value);
-	janus_config_destroy(config);
-
-	/* Initialize Duktape */
-	duktape_ctx = duk_create_heap_default();
+/* Helper to create a Duktape heap for a VM, and evaluate the script in it */
+static int janus_duktape_vm_setup(janus_duktape_vm *vm, const char *duktape_file, const char *buf, size_t len) {
+	duk_context *duktape_ctx = duk_create_heap_default();
 	if(duktape_ctx == NULL) {
 		JANUS_LOG(LOG_ERR, "Error creating Duktape heap...\n");
-		g_free(duktape_folder);
 		return -1;
 	}
 	duk_console_init(duktape_ctx, DUK_CONSOLE_PROXY_WRAPPER);
 	duk_module_duktape_init(duktape_ctx);
+	/* Keep track of the VM this heap belongs to (threads share the heap stash) */
+	duk_push_heap_stash(duktape_ctx);
+	duk_push_pointer(duktape_ctx, vm);
+	duk_put_prop_string(duktape_ctx, -2, JANUS_DUKTAPE_VM_KEY);
+	duk_pop(duktape_ctx);
 
 	/* Register our functions */
 	duk_push_c_function(duktape_ctx, janus_duktape_method_getmodulesfolder, 0);
@@ -1267,6 +1635,12 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	duk_put_global_string(duktape_ctx, "pokeScheduler");
 	duk_push_c_function(duktape_ctx, janus_duktape_method_timecallback, 3);
 	duk_put_global_string(duktape_ctx, "timeCallback");
+	duk_push_c_function(duktape_ctx, janus_duktape_method_getvminfo, 0);
+	duk_put_global_string(duktape_ctx, "getVmInfo");
+	duk_push_c_function(duktape_ctx, janus_duktape_method_getsessionvm, 1);
+	duk_put_global_string(duktape_ctx, "getSessionVm");
+	duk_push_c_function(duktape_ctx, janus_duktape_method_sendmessage, 2);
+	duk_put_global_string(duktape_ctx, "sendMessage");
 	duk_push_c_function(duktape_ctx, janus_duktape_method_pushevent, 4);
 	duk_put_global_string(duktape_ctx, "pushEvent");
 	duk_push_c_function(duktape_ctx, janus_duktape_method_notifyevent, 2);
@@ -1285,6 +1659,14 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	duk_put_global_string(duktape_ctx, "removeRecipient");
 	duk_push_c_function(duktape_ctx, janus_duktape_method_setbitrate, 2);
 	duk_put_global_string(duktape_ctx, "setBitrate");
+	duk_push_c_function(duktape_ctx, janus_duktape_method_setsimulcastlayer, 3);
+	duk_put_global_string(duktape_ctx, "setSimulcastLayer");
+	duk_push_c_function(duktape_ctx, janus_duktape_method_setbitratecap, 2);
+	duk_put_global_string(duktape_ctx, "setBitrateCap");
+	duk_push_c_function(duktape_ctx, janus_duktape_method_setrecipientgroup, 2);
+	duk_put_global_string(duktape_ctx, "setRecipientGroup");
+	duk_push_c_function(duktape_ctx, janus_duktape_method_mutegroup, 4);
+	duk_put_global_string(duktape_ctx, "muteGroup");
 	duk_push_c_function(duktape_ctx, janus_duktape_method_setplifreq, 2);
 	duk_put_global_string(duktape_ctx, "setPliFreq");
 	duk_push_c_function(duktape_ctx, janus_duktape_method_sendpli, 1);
@@ -1302,13 +1684,111 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	/* Register all extra functions, if any were added */
 	janus_duktape_register_extra_functions(duktape_ctx);
 
-	/* Now load the script (FIXME badly) */
+	/* Now evaluate the script */
+	duk_push_lstring(duktape_ctx, buf, (duk_size_t)len);
+	if(duk_peval(duktape_ctx) != 0) {
+		JANUS_LOG(LOG_ERR, "Error loading JS script %s: %s\n", duktape_file, duk_safe_to_string(duktape_ctx, -1));
+		duk_destroy_heap(duktape_ctx);
+		return -1;
+	}
+	duk_pop(duktape_ctx);
+	/* Make sure that all the functions we need are there */
+	uint i=0;
+	for(i=0; i<duktape_funcsize; i++) {
+		duk_get_global_string(duktape_ctx, duktape_functions[i]);
+		if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) == 0) {
+			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", duktape_functions[i], duktape_file);
+			duk_destroy_heap(duktape_ctx);
+			return -1;
+		}
+		duk_pop(duktape_ctx);
+	}
+	vm->ctx = duktape_ctx;
+	vm->events = g_async_queue_new();
+	return 0;
+}
+
+/* Helper to get rid of all the VMs, and the pool itself */
+static void janus_duktape_vms_free(void) {
+	uint i=0;
+	for(i=0; i<duktape_vms_num; i++) {
+		janus_duktape_vm *vm = &duktape_vms[i];
+		janus_mutex_lock(&vm->mutex);
+		if(vm->ctx != NULL)
+			duk_destroy_heap(vm->ctx);
+		vm->ctx = NULL;
+		janus_mutex_unlock(&vm->mutex);
+		if(vm->events != NULL) {
+			/* Get rid of the messages nobody will deliver anymore */
+			janus_duktape_event *event = NULL;
+			while((event = g_async_queue_try_pop(vm->events)) != NULL) {
+				if(event->type == janus_duktape_event_message) {
+					g_free(event->message);
+					g_free(event);
+				}
+			}
+			g_async_queue_unref(vm->events);
+		}
+		vm->events = NULL;
+	}
+	g_free(duktape_vms);
+	duktape_vms = NULL;
+	duktape_vms_num = 0;
+}
+
+
+/* Plugin implementation */
+int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
+	if(g_atomic_int_get(&duktape_stopping)) {
+		/* Still stopping from before */
+		return -1;
+	}
+	if(callback == NULL || config_path == NULL) {
+		/* Invalid arguments */
+		return -1;
+	}
+
+	/* Read configuration */
+	char filename[255];
+	g_snprintf(filename, 255, "%s/%s.cfg", config_path, JANUS_DUKTAPE_PACKAGE);
+	JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
+	janus_config *config = janus_config_parse(filename);
+	if(config == NULL) {
+		/* No config means no JS script */
+		JANUS_LOG(LOG_ERR, "Failed to load configuration file for Duktape plugin...\n");
+		return -1;
+	}
+	janus_config_print(config);
+	janus_config_item *folder = janus_config_get_item_drilldown(config, "general", "path");
+	if(folder && folder->value)
+		duktape_folder = g_strdup(folder->value);
+	janus_config_item *script = janus_config_get_item_drilldown(config, "general", "script");
+	if(script == NULL || script->value == NULL) {
+		JANUS_LOG(LOG_ERR, "Missing script path in Duktape plugin configuration...\n");
+		janus_config_destroy(config);
+		g_free(duktape_folder);
+		return -1;
+	}
+	char *duktape_file = g_strdup(script->value);
+	char *duktape_config = NULL;
+	janus_config_item *conf = janus_config_get_item_drilldown(config, "general", "config");
+	if(conf && conf->value)
+		duktape_config = g_strdup(conf->value);
+	janus_config_item *vms = janus_config_get_item_drilldown(config, "general", "vms");
+	int vms_num = (vms && vms->value) ? atoi(vms->value) : 1;
+	if(vms_num < 1) {
+		JANUS_LOG(LOG_WARN, "Invalid number of Duktape VMs (%d), falling back to 1\n", vms_num);
+		vms_num = 1;
+	}
+	janus_config_destroy(config);
+
+	/* Read the script (FIXME badly) */
     FILE *f = fopen(duktape_file, "rb");
     if(f == NULL) {
 		JANUS_LOG(LOG_ERR, "Error loading JS script %s: no such file\n", duktape_file);
-		duk_destroy_heap(duktape_ctx);
 		g_free(duktape_folder);
 		g_free(duktape_file);
+		g_free(duktape_config);
 		return -1;
 	}
 	fseek(f, 0, SEEK_END);
@@ -1316,40 +1796,40 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	if(len < 1) {
 		JANUS_LOG(LOG_ERR, "Error loading JS script %s: empty file\n", duktape_file);
 		fclose(f);
-		duk_destroy_heap(duktape_ctx);
 		g_free(duktape_folder);
 		g_free(duktape_file);
+		g_free(duktape_config);
 		return -1;
 	}
 	char *buf = (char *)g_malloc0(len);
 	fseek(f, 0, SEEK_SET);
 	fread((void *)buf, 1, len, f);
 	fclose(f);
-	duk_push_lstring(duktape_ctx, (const char *)buf, (duk_size_t)len);
-	g_free(buf);
-	if(duk_peval(duktape_ctx) != 0) {
-		JANUS_LOG(LOG_ERR, "Error loading JS script %s: %s\n", duktape_file, duk_safe_to_string(duktape_ctx, -1));
-		duk_destroy_heap(duktape_ctx);
-		g_free(duktape_folder);
-		g_free(duktape_file);
-		return -1;
-	}
-	duk_pop(duktape_ctx);
-	/* Make sure that all the functions we need are there */
+
+	/* Initialize Duktape: we create a pool of independent heaps (VMs), each evaluating the same script */
+	duktape_vms_num = vms_num;
+	duktape_vms = g_malloc0(duktape_vms_num * sizeof(janus_duktape_vm));
 	uint i=0;
-	for(i=0; i<duktape_funcsize; i++) {
-		duk_get_global_string(duktape_ctx, duktape_functions[i]);
-		if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) == 0) {
-			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", duktape_functions[i], duktape_file);
-			duk_destroy_heap(duktape_ctx);
+	for(i=0; i<duktape_vms_num; i++) {
+		janus_duktape_vm *vm = &duktape_vms[i];
+		vm->index = i;
+		janus_mutex_init(&vm->mutex);
+		if(janus_duktape_vm_setup(vm, duktape_file, buf, len) < 0) {
+			janus_duktape_vms_free();
+			g_free(buf);
 			g_free(duktape_folder);
 			g_free(duktape_file);
+			g_free(duktape_config);
 			return -1;
 		}
 	}
+	g_free(buf);
+	JANUS_LOG(LOG_VERB, "Loaded %s in %u Duktape VMs\n", duktape_file, duktape_vms_num);
 	/* Some JS functions are optional (e.g., those to directly handle RTP, RTCP and
 	 * data, as those will typically be kept at a C level, with JavaScript only dictating
-	 * the logic, or those overriding the plugin namespace and versioning information */
+	 * the logic, or those overriding the plugin namespace and versioning information):
+	 * since all VMs evaluate the same script, checking the first one is enough */
+	duk_context *duktape_ctx = duktape_vms[0].ctx;
 	duk_get_global_string(duktape_ctx, "getVersion");
 	if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) != 0)
 		has_get_version = TRUE;
@@ -1380,25 +1860,33 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	duk_get_global_string(duktape_ctx, "slowLink");
 	if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) != 0)
 		has_slow_link = TRUE;
+	duk_get_global_string(duktape_ctx, "incomingMessage");
+	if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) != 0)
+		has_incoming_message = TRUE;
 
 	duktape_sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_duktape_session_destroy);
 	duktape_ids = g_hash_table_new(NULL, NULL);
-	events = g_async_queue_new();
 
 	g_atomic_int_set(&duktape_initialized, 1);
 
-	/* Launch the scheduler thread (which will be responsible for resuming asynchronous coroutines) */
+	/* Launch the scheduler threads (which will be responsible for resuming asynchronous coroutines) */
 	GError *error = NULL;
-	scheduler_thread = g_thread_try_new("duktape scheduler", janus_duktape_scheduler, NULL, &error);
-	if(error != NULL) {
-		g_atomic_int_set(&duktape_initialized, 0);
-		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Duktape scheduler thread...\n",
-			error->code, error->message ? error->message : "??");
-		duk_destroy_heap(duktape_ctx);
-		g_free(duktape_folder);
-		g_free(duktape_file);
-		g_free(duktape_config);
-		return -1;
+	for(i=0; i<duktape_vms_num; i++) {
+		janus_duktape_vm *vm = &duktape_vms[i];
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "duk sched %u", i);
+		vm->scheduler_thread = g_thread_try_new(tname, janus_duktape_scheduler, vm, &error);
+		if(error != NULL) {
+			g_atomic_int_set(&duktape_initialized, 0);
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Duktape scheduler thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_duktape_vms_free();
+			g_free(duktape_folder);
+			g_free(duktape_file);
+			g_free(duktape_config);
+			return -1;
+		}
 	}
 	/* Launch the timer loop thread (which will be responsible for scheduling timed callbacks) */
 	timer_context = g_main_context_new();
@@ -1408,11 +1896,12 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 		g_atomic_int_set(&duktape_initialized, 0);
 		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Duktape timer loop thread...\n",
 			error->code, error->message ? error->message : "??");
+		g_error_free(error);
 		if(timer_loop != NULL)
 			g_main_loop_unref(timer_loop);
 		if(timer_context != NULL)
 			g_main_context_unref(timer_context);
-		duk_destroy_heap(duktape_ctx);
+		janus_duktape_vms_free();
 		g_free(duktape_folder);
 		g_free(duktape_file);
 		g_free(duktape_config);
@@ -1422,23 +1911,29 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	janus_core = callback;
 
-	/* Init the JS script, in case it's needed */
-	duk_get_global_string(duktape_ctx, "init");
-	duk_push_string(duktape_ctx, duktape_config);
-	int res = duk_pcall(duktape_ctx, 1);
-	if(res != DUK_EXEC_SUCCESS) {
-		g_atomic_int_set(&duktape_initialized, 0);
-		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
-		duk_pop(duktape_ctx);
-		if(timer_loop != NULL)
-			g_main_loop_unref(timer_loop);
-		if(timer_context != NULL)
-			g_main_context_unref(timer_context);
-		duk_destroy_heap(duktape_ctx);
-		g_free(duktape_folder);
-		g_free(duktape_file);
-		g_free(duktape_config);
-		return -1;
+	/* Init the JS script in all VMs, in case it's needed: they all get the same configuration */
+	for(i=0; i<duktape_vms_num; i++) {
+		janus_duktape_vm *vm = &duktape_vms[i];
+		janus_mutex_lock(&vm->mutex);
+		duk_get_global_string(vm->ctx, "init");
+		duk_push_string(vm->ctx, duktape_config);
+		int res = duk_pcall(vm->ctx, 1);
+		if(res != DUK_EXEC_SUCCESS) {
+			g_atomic_int_set(&duktape_initialized, 0);
+			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(vm->ctx, -1));
+			duk_pop(vm->ctx);
+			janus_mutex_unlock(&vm->mutex);
+			if(timer_loop != NULL)
+				g_main_loop_unref(timer_loop);
+			if(timer_context != NULL)
+				g_main_context_unref(timer_context);
+			janus_duktape_vms_free();
+			g_free(duktape_folder);
+			g_free(duktape_file);
+			g_free(duktape_config);
+			return -1;
+		}
+		janus_mutex_unlock(&vm->mutex);
 	}
 
 	g_free(duktape_file);
@@ -1453,10 +1948,14 @@ void janus_duktape_destroy(void) {
 		return;
 	g_atomic_int_set(&duktape_stopping, 1);
 
-	g_async_queue_push(events, GUINT_TO_POINTER(janus_duktape_event_exit));
-	if(scheduler_thread != NULL) {
-		g_thread_join(scheduler_thread);
-		scheduler_thread = NULL;
+	uint i=0;
+	for(i=0; i<duktape_vms_num; i++)
+		g_async_queue_push(duktape_vms[i].events, &janus_duktape_exit_event);
+	for(i=0; i<duktape_vms_num; i++) {
+		if(duktape_vms[i].scheduler_thread != NULL) {
+			g_thread_join(duktape_vms[i].scheduler_thread);
+			duktape_vms[i].scheduler_thread = NULL;
+		}
 	}
 	if(timer_loop != NULL)
 		g_main_loop_quit(timer_loop);
@@ -1473,29 +1972,27 @@ void janus_duktape_destroy(void) {
 		timer_context = NULL;
 	}
 
-	/* Deinit the JS script, in case it's needed */
-	janus_mutex_lock(&duktape_mutex);
-	duk_get_global_string(duktape_ctx, "destroy");
-	int res = duk_pcall(duktape_ctx, 0);
-	if(res != DUK_EXEC_SUCCESS) {
-		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
-		duk_pop(duktape_ctx);
+	/* Deinit the JS script in all VMs, in case it's needed */
+	for(i=0; i<duktape_vms_num; i++) {
+		janus_duktape_vm *vm = &duktape_vms[i];
+		janus_mutex_lock(&vm->mutex);
+		duk_get_global_string(vm->ctx, "destroy");
+		int res = duk_pcall(vm->ctx, 0);
+		if(res != DUK_EXEC_SUCCESS) {
+			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(vm->ctx, -1));
+			duk_pop(vm->ctx);
+		}
+		janus_mutex_unlock(&vm->mutex);
 	}
-	janus_mutex_unlock(&duktape_mutex);
 
 	janus_mutex_lock(&duktape_sessions_mutex);
 	g_hash_table_destroy(duktape_sessions);
 	duktape_sessions = NULL;
 	g_hash_table_destroy(duktape_ids);
 	duktape_ids = NULL;
-	g_async_queue_unref(events);
-	events = NULL;
 	janus_mutex_unlock(&duktape_sessions_mutex);
 
-	janus_mutex_lock(&duktape_mutex);
-	duk_destroy_heap(duktape_ctx);
-	duktape_ctx = NULL;
-	janus_mutex_unlock(&duktape_mutex);
+	janus_duktape_vms_free();
 
 	g_free(duktape_script_version_string);
 	g_free(duktape_script_description);
@@ -1523,21 +2020,23 @@ int janus_duktape_get_version(void) {
 			/* Unless we asked already */
 			return duktape_script_version;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_mutex_lock(&duktape_vms[0].mutex);
+		duk_idx_t thr_idx = duk_push_thread(duktape_vms[0].ctx);
+		duk_context *t = duk_get_context(duktape_vms[0].ctx, thr_idx);
 		duk_get_global_string(t, "getVersion");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_vms[0].ctx);
+			janus_mutex_unlock(&duktape_vms[0].mutex);
 			return JANUS_DUKTAPE_VERSION;
 		}
 		duktape_script_version = (int)duk_get_number(t, -1);
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_vms[0].ctx);
+		janus_mutex_unlock(&duktape_vms[0].mutex);
 		return duktape_script_version;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1552,23 +2051,25 @@ const char *janus_duktape_get_version_string(void) {
 			/* Unless we asked already */
 			return duktape_script_version_string;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_mutex_lock(&duktape_vms[0].mutex);
+		duk_idx_t thr_idx = duk_push_thread(duktape_vms[0].ctx);
+		duk_context *t = duk_get_context(duktape_vms[0].ctx, thr_idx);
 		duk_get_global_string(t, "getVersionString");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_vms[0].ctx);
+			janus_mutex_unlock(&duktape_vms[0].mutex);
 			return JANUS_DUKTAPE_VERSION_STRING;
 		}
 		const char *version = duk_get_string(t, -1);
 		if(version != NULL)
 			duktape_script_version_string = g_strdup(version);
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_vms[0].ctx);
+		janus_mutex_unlock(&duktape_vms[0].mutex);
 		return duktape_script_version_string;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1583,23 +2084,25 @@ const char *janus_duktape_get_description(void) {
 			/* Unless we asked already */
 			return duktape_script_description;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_mutex_lock(&duktape_vms[0].mutex);
+		duk_idx_t thr_idx = duk_push_thread(duktape_vms[0].ctx);
+		duk_context *t = duk_get_context(duktape_vms[0].ctx, thr_idx);
 		duk_get_global_string(t, "getDescription");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_vms[0].ctx);
+			janus_mutex_unlock(&duktape_vms[0].mutex);
 			return JANUS_DUKTAPE_DESCRIPTION;
 		}
 		const char *description = duk_get_string(t, -1);
 		if(description != NULL)
 			duktape_script_description = g_strdup(description);
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_vms[0].ctx);
+		janus_mutex_unlock(&duktape_vms[0].mutex);
 		return duktape_script_description;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1614,23 +2117,25 @@ const char *janus_duktape_get_name(void) {
 			/* Unless we asked already */
 			return duktape_script_name;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_mutex_lock(&duktape_vms[0].mutex);
+		duk_idx_t thr_idx = duk_push_thread(duktape_vms[0].ctx);
+		duk_context *t = duk_get_context(duktape_vms[0].ctx, thr_idx);
 		duk_get_global_string(t, "getName");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_vms[0].ctx);
+			janus_mutex_unlock(&duktape_vms[0].mutex);
 			return JANUS_DUKTAPE_NAME;
 		}
 		const char *name = duk_get_string(t, -1);
 		if(name != NULL)
 			duktape_script_name = g_strdup(name);
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_vms[0].ctx);
+		janus_mutex_unlock(&duktape_vms[0].mutex);
 		return duktape_script_name;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1645,23 +2150,25 @@ const char *janus_duktape_get_author(void) {
 			/* Unless we asked already */
 			return duktape_script_author;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_mutex_lock(&duktape_vms[0].mutex);
+		duk_idx_t thr_idx = duk_push_thread(duktape_vms[0].ctx);
+		duk_context *t = duk_get_context(duktape_vms[0].ctx, thr_idx);
 		duk_get_global_string(t, "getAuthor");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_vms[0].ctx);
+			janus_mutex_unlock(&duktape_vms[0].mutex);
 			return JANUS_DUKTAPE_AUTHOR;
 		}
 		const char *author = duk_get_string(t, -1);
 		if(author != NULL)
 			duktape_script_author = g_strdup(author);
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_vms[0].ctx);
+		janus_mutex_unlock(&duktape_vms[0].mutex);
 		return duktape_script_author;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1676,23 +2183,25 @@ const char *janus_duktape_get_package(void) {
 			/* Unless we asked already */
 			return duktape_script_package;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_mutex_lock(&duktape_vms[0].mutex);
+		duk_idx_t thr_idx = duk_push_thread(duktape_vms[0].ctx);
+		duk_context *t = duk_get_context(duktape_vms[0].ctx, thr_idx);
 		duk_get_global_string(t, "getPackage");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_vms[0].ctx);
+			janus_mutex_unlock(&duktape_vms[0].mutex);
 			return JANUS_DUKTAPE_PACKAGE;
 		}
 		const char *package = duk_get_string(t, -1);
 		if(package != NULL)
 			duktape_script_package = g_strdup(package);
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_vms[0].ctx);
+		janus_mutex_unlock(&duktape_vms[0].mutex);
 		return duktape_script_package;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1725,7 +2234,13 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 	janus_duktape_session *session = (janus_duktape_session *)g_malloc0(sizeof(janus_duktape_session));
 	session->handle = handle;
 	session->id = id;
+	/* Bind the session to one of the VMs: session IDs are random, so this spreads them evenly */
+	session->vm = &duktape_vms[id % duktape_vms_num];
 	janus_rtp_switching_context_reset(&session->rtpctx);
+	janus_rtp_simulcasting_context_reset(&session->sim_context);
+	janus_vp8_simulcast_context_reset(&session->vp8_context);
+	g_atomic_int_set(&session->layers_wanted, (2 << 4) | 2);
+	session->sim_context.substream_target = session->sim_context.templayer_target = 2;
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_duktape_session_free);
@@ -1735,9 +2250,10 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&duktape_sessions_mutex);
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+	duk_context *t = duk_get_context(vm->ctx, thr_idx);
 	duk_get_global_string(t, "createSession");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -1746,7 +2262,8 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(vm->ctx);
+	janus_mutex_unlock(&vm->mutex);
 
 	return;
 }
@@ -1770,9 +2287,10 @@ void janus_duktape_destroy_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&duktape_sessions_mutex);
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+	duk_context *t = duk_get_context(vm->ctx, thr_idx);
 	duk_get_global_string(t, "destroySession");
 	duk_push_number(t, id);
 	int res = duk_pcall(t, 1);
@@ -1781,7 +2299,8 @@ void janus_duktape_destroy_session(janus_plugin_session *handle, int *error) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(vm->ctx);
+	janus_mutex_unlock(&vm->mutex);
 
 	/* Get any rid references recipients of this sessions may have */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -1794,6 +2313,7 @@ void janus_duktape_destroy_session(janus_plugin_session *handle, int *error) {
 		}
 		session->recipients = g_slist_remove(session->recipients, recipient);
 	}
+	janus_duktape_session_update_routes(session);
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Finally, remove from the hashtable */
@@ -1819,9 +2339,10 @@ json_t *janus_duktape_query_session(janus_plugin_session *handle) {
 	janus_refcount_increase(&session->ref);
 	janus_mutex_unlock(&duktape_sessions_mutex);
 	/* Ask the JS script for information on this session */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+	duk_context *t = duk_get_context(vm->ctx, thr_idx);
 	duk_get_global_string(t, "querySession");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -1831,16 +2352,19 @@ json_t *janus_duktape_query_session(janus_plugin_session *handle) {
 		json_t *json = json_object();
 		json_object_set_new(json, "error", json_string(duk_safe_to_string(t, -1)));
 		duk_pop(t);
+		duk_pop(vm->ctx);
+		janus_mutex_unlock(&vm->mutex);
 		janus_refcount_decrease(&session->ref);
 		return json;
 	}
 	janus_refcount_decrease(&session->ref);
+	/* We need a Jansson object (the string only lives as long as the thread) */
 	const char *info = duk_get_string(t, -1);
-	duk_pop(t);
-	/* We need a Jansson object */
 	json_error_t error;
 	json_t *json = json_loads(info, 0, &error);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(t);
+	duk_pop(vm->ctx);
+	janus_mutex_unlock(&vm->mutex);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s", error.line, error.text);
 		return NULL;
@@ -1871,12 +2395,21 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		g_free(transaction);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "No session associated with this handle", NULL);
 	}
+	/* If the user is going to simulcast, take note of the SSRCs: we'll need them for routing */
+	json_t *msg_simulcast = jsep ? json_object_get(jsep, "simulcast") : NULL;
+	if(msg_simulcast) {
+		JANUS_LOG(LOG_VERB, "Duktape session %"SCNu32" is going to do simulcasting\n", session->id);
+		session->ssrc[0] = json_integer_value(json_object_get(msg_simulcast, "ssrc-0"));
+		session->ssrc[1] = json_integer_value(json_object_get(msg_simulcast, "ssrc-1"));
+		session->ssrc[2] = json_integer_value(json_object_get(msg_simulcast, "ssrc-2"));
+	}
 	char *jsep_text = jsep ? json_dumps(jsep, JSON_INDENT(0) | JSON_PRESERVE_ORDER) : NULL;
 	json_decref(jsep);
 	/* Invoke the script function */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+	duk_context *t = duk_get_context(vm->ctx, thr_idx);
 	duk_get_global_string(t, "handleMessage");
 	duk_push_number(t, session->id);
 	duk_push_string(t, transaction);
@@ -1887,10 +2420,10 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		/* Something went wrong... */
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(vm->ctx);
+		janus_mutex_unlock(&vm->mutex);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
 	}
-	//~ duk_pop(duktape_ctx);
 	janus_refcount_decrease(&session->ref);
 	if(message_text != NULL)
 		free(message_text);
@@ -1902,7 +2435,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		/* Either an error or an asynchronous response */
 		int res = (int)duk_get_number(t, 0);
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(vm->ctx);
+		janus_mutex_unlock(&vm->mutex);
 		if(res < 0) {
 			/* We got an error */
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
@@ -1915,7 +2449,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		json_error_t error;
 		json_t *json = json_loads(response, 0, &error);
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(vm->ctx);
+		janus_mutex_unlock(&vm->mutex);
 		if(!json) {
 			JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
@@ -1923,6 +2458,9 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		return janus_plugin_result_new(JANUS_PLUGIN_OK, NULL, json);
 	}
 	/* If we got here, we didn't get what we expect */
+	duk_pop(t);
+	duk_pop(vm->ctx);
+	janus_mutex_unlock(&vm->mutex);
 	return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
 }
 
@@ -1948,9 +2486,10 @@ void janus_duktape_setup_media(janus_plugin_session *handle) {
 	session->pli_latest = janus_get_monotonic_time();
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+	duk_context *t = duk_get_context(vm->ctx, thr_idx);
 	duk_get_global_string(t, "setupMedia");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -1959,7 +2498,8 @@ void janus_duktape_setup_media(janus_plugin_session *handle) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(vm->ctx);
+	janus_mutex_unlock(&vm->mutex);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -1976,9 +2516,10 @@ void janus_duktape_incoming_rtp(janus_plugin_session *handle, int video, char *b
 	/* Check if the JS script wants to handle/manipulate RTP packets itself */
 	if(has_incoming_rtp) {
 		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_vm *vm = session->vm;
+		janus_mutex_lock(&vm->mutex);
+		duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+		duk_context *t = duk_get_context(vm->ctx, thr_idx);
 		duk_get_global_string(t, "incomingRtp");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, video);
@@ -1990,7 +2531,8 @@ void janus_duktape_incoming_rtp(janus_plugin_session *handle, int video, char *b
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(vm->ctx);
+		janus_mutex_unlock(&vm->mutex);
 		return;
 	}
 	/* Is this session allowed to send media? */
@@ -2007,10 +2549,38 @@ void janus_duktape_incoming_rtp(janus_plugin_session *handle, int video, char *b
 	/* Backup the actual timestamp and sequence number set by the publisher, in case switching is involved */
 	packet.timestamp = ntohl(packet.data->timestamp);
 	packet.seq_number = ntohs(packet.data->seq_number);
-	/* Relay to all recipients */
+	packet.sender = session;
+	if(video && session->ssrc[0] != 0) {
+		/* Keep track of the bitrate of each substream, in case recipients have bitrate caps */
+		uint32_t ssrc = ntohl(rtp->ssrc);
+		int sc = (ssrc == session->ssrc[0] ? 0 : (ssrc == session->ssrc[1] ? 1 : (ssrc == session->ssrc[2] ? 2 : -1)));
+		if(sc != -1) {
+			gint64 now = janus_get_monotonic_time();
+			if(session->substream_updated == 0)
+				session->substream_updated = now;
+			if(now - session->substream_updated >= G_USEC_PER_SEC) {
+				int i = 0;
+				for(i=0; i<3; i++) {
+					session->substream_bitrate[i] = (uint32_t)((guint64)session->substream_bytes[i]*8*G_USEC_PER_SEC/(now - session->substream_updated));
+					session->substream_bytes[i] = 0;
+				}
+				session->substream_updated = now;
+			}
+			session->substream_bytes[sc] += len;
+		}
+	}
+	/* Relay to all recipients, as per the current routing table */
 	janus_mutex_lock_nodebug(&session->recipients_mutex);
-	g_slist_foreach(session->recipients, janus_duktape_relay_rtp_packet, &packet);
+	janus_duktape_routes *routes = session->routes;
+	if(routes != NULL)
+		janus_refcount_increase_nodebug(&routes->ref);
 	janus_mutex_unlock_nodebug(&session->recipients_mutex);
+	if(routes != NULL) {
+		guint i = 0;
+		for(i=0; i<routes->count; i++)
+			janus_duktape_relay_rtp_packet(routes->recipients[i], &packet);
+		janus_refcount_decrease_nodebug(&routes->ref);
+	}
 
 	/* Check if we need to send any PLI to this media source */
 	if(video && session->pli_freq > 0) {
@@ -2039,9 +2609,10 @@ void janus_duktape_incoming_rtcp(janus_plugin_session *handle, int video, char *
 	/* Check if the JS script wants to handle/manipulate RTCP packets itself */
 	if(has_incoming_rtcp) {
 		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_vm *vm = session->vm;
+		janus_mutex_lock(&vm->mutex);
+		duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+		duk_context *t = duk_get_context(vm->ctx, thr_idx);
 		duk_get_global_string(t, "incomingRtcp");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, video);
@@ -2053,7 +2624,8 @@ void janus_duktape_incoming_rtcp(janus_plugin_session *handle, int video, char *
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(vm->ctx);
+		janus_mutex_unlock(&vm->mutex);
 		return;
 	}
 	/* If a REMB arrived, make sure we cap it to our configuration, and send it as a video RTCP */
@@ -2097,9 +2669,10 @@ void janus_duktape_incoming_data(janus_plugin_session *handle, char *buf, int le
 	/* Check if the JS script wants to handle/manipulate data channel packets itself */
 	if(has_incoming_data) {
 		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_vm *vm = session->vm;
+		janus_mutex_lock(&vm->mutex);
+		duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+		duk_context *t = duk_get_context(vm->ctx, thr_idx);
 		duk_get_global_string(t, "incomingData");
 		duk_push_number(t, session->id);
 		duk_push_lstring(t, buf, len);
@@ -2110,7 +2683,8 @@ void janus_duktape_incoming_data(janus_plugin_session *handle, char *buf, int le
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(vm->ctx);
+		janus_mutex_unlock(&vm->mutex);
 		return;
 	}
 	/* Is this session allowed to send data? */
@@ -2149,9 +2723,10 @@ void janus_duktape_slow_link(janus_plugin_session *handle, int uplink, int video
 	janus_refcount_increase(&session->ref);
 	if(has_slow_link) {
 		/* Notify the JS script */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_vm *vm = session->vm;
+		janus_mutex_lock(&vm->mutex);
+		duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+		duk_context *t = duk_get_context(vm->ctx, thr_idx);
 		duk_get_global_string(t, "slowLink");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, uplink);
@@ -2162,7 +2737,8 @@ void janus_duktape_slow_link(janus_plugin_session *handle, int uplink, int video
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(vm->ctx);
+		janus_mutex_unlock(&vm->mutex);
 	}
 	janus_refcount_decrease(&session->ref);
 }
@@ -2201,6 +2777,19 @@ void janus_duktape_hangup_media(janus_plugin_session *handle) {
 	session->pli_freq = 0;
 	session->pli_latest = 0;
 	janus_rtp_switching_context_reset(&session->rtpctx);
+	memset(session->ssrc, 0, sizeof(session->ssrc));
+	memset(session->substream_bitrate, 0, sizeof(session->substream_bitrate));
+	memset(session->substream_bytes, 0, sizeof(session->substream_bytes));
+	session->substream_updated = 0;
+	janus_rtp_simulcasting_context_reset(&session->sim_context);
+	janus_vp8_simulcast_context_reset(&session->vp8_context);
+	g_atomic_int_set(&session->layers_wanted, (2 << 4) | 2);
+	session->sim_context.substream_target = session->sim_context.templayer_target = 2;
+	g_atomic_int_set(&session->bitrate_cap, 0);
+	g_atomic_int_set(&session->rules_changed, 1);
+	g_atomic_int_set(&session->group, 0);
+	g_atomic_int_set(&session->muted_audio, 0);
+	g_atomic_int_set(&session->muted_video, 0);
 
 	/* Get rid of the recipients */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -2211,12 +2800,14 @@ void janus_duktape_hangup_media(janus_plugin_session *handle) {
 		janus_refcount_decrease(&session->ref);
 		janus_refcount_decrease(&recipient->ref);
 	}
+	janus_duktape_session_update_routes(session);
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+	duk_context *t = duk_get_context(vm->ctx, thr_idx);
 	duk_get_global_string(t, "hangupMedia");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -2225,7 +2816,8 @@ void janus_duktape_hangup_media(janus_plugin_session *handle) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(vm->ctx);
+	janus_mutex_unlock(&vm->mutex);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2246,6 +2838,53 @@ static void janus_duktape_relay_rtp_packet(gpointer data, gpointer user_data) {
 		/* Nope, don't relay */
 		return;
 	}
+	janus_duktape_session *sender = packet->sender;
+	if(sender != NULL && ((packet->is_video ? g_atomic_int_get(&sender->muted_video) :
+			g_atomic_int_get(&sender->muted_audio)) & (1U << g_atomic_int_get(&session->group)))) {
+		/* The script muted the fan-out group this recipient is in */
+		return;
+	}
+	if(packet->is_video && sender != NULL && sender->ssrc[0] != 0) {
+		/* Handle simulcast: make sure we have a payload to work with */
+		int plen = 0;
+		char *payload = janus_rtp_payload((char *)packet->data, packet->length, &plen);
+		if(payload == NULL)
+			return;
+		/* Check if the bitrate cap suggests different layers than the ones the script asked for */
+		janus_duktape_session_apply_bitrate_cap(session, sender);
+		/* Process this packet: don't relay if it's not the SSRC/layer we wanted to handle */
+		gboolean relay = janus_rtp_simulcasting_context_process_rtp(&session->sim_context,
+			(char *)packet->data, packet->length, sender->ssrc, sender->vcodec, &session->rtpctx);
+		if(!relay)
+			return;
+		if(session->sim_context.need_pli) {
+			/* Send a PLI to the sender */
+			JANUS_LOG(LOG_VERB, "We need a PLI for the simulcast context\n");
+			sender->pli_latest = janus_get_monotonic_time();
+			char rtcpbuf[12];
+			janus_rtcp_pli((char *)&rtcpbuf, 12);
+			janus_core->relay_rtcp(sender->handle, 1, rtcpbuf, 12);
+		}
+		/* If we got here, update the RTP header and send the packet */
+		janus_rtp_header_update(packet->data, &session->rtpctx, TRUE, 4500);
+		char vp8pd[6];
+		if(sender->vcodec == JANUS_VIDEOCODEC_VP8) {
+			/* For VP8, we save the original payload descriptor, to restore it after */
+			memcpy(vp8pd, payload, sizeof(vp8pd));
+			janus_vp8_simulcast_descriptor_update(payload, plen, &session->vp8_context,
+				session->sim_context.changed_substream);
+		}
+		if(janus_core != NULL)
+			janus_core->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+		/* Restore the timestamp and sequence number to what the publisher set them to */
+		packet->data->timestamp = htonl(packet->timestamp);
+		packet->data->seq_number = htons(packet->seq_number);
+		if(sender->vcodec == JANUS_VIDEOCODEC_VP8) {
+			/* Restore the original payload descriptor as well, as it will be needed by the next recipient */
+			memcpy(payload, vp8pd, sizeof(vp8pd));
+		}
+		return;
+	}
 	/* Fix sequence number and timestamp (publisher switching may be involved) */
 	janus_rtp_header_update(packet->data, &session->rtpctx, packet->is_video, packet->is_video ? 4500 : 960);
 	/* Send the packet */
@@ -2273,30 +2912,52 @@ static void janus_duktape_relay_data_packet(gpointer data, gpointer user_data) {
 }
 
 /* This is a scheduler thread: if we know there are coroutines to resume in
- * JavaScript (e.g., for asynchronous requests), we do that ourselves here */
+ * JavaScript (e.g., for asynchronous requests), we do that ourselves here;
+ * each VM has its own, which is also where messages other VMs sent via
+ * sendMessage() are delivered to the script via incomingMessage() */
 static void *janus_duktape_scheduler(void *data) {
-	JANUS_LOG(LOG_VERB, "Joining Duktape scheduler thread\n");
+	janus_duktape_vm *vm = (janus_duktape_vm *)data;
+	JANUS_LOG(LOG_VERB, "Joining Duktape scheduler thread (VM %u)\n", vm->index);
 	janus_duktape_event *event = NULL;
 	/* Wait until there are events to process */
 	while(g_atomic_int_get(&duktape_initialized) && !g_atomic_int_get(&duktape_stopping)) {
-		event = g_async_queue_pop(events);
-		if(event == GUINT_TO_POINTER(janus_duktape_event_exit))
+		event = g_async_queue_pop(vm->events);
+		if(event == &janus_duktape_exit_event)
 			break;
-		if(event == GUINT_TO_POINTER(janus_duktape_event_resume)) {
+		if(event == &janus_duktape_resume_event) {
 			/* There are coroutines to resume */
-			janus_mutex_lock(&duktape_mutex);
-			duk_get_global_string(duktape_ctx, "resumeScheduler");
-			int res = duk_pcall(duktape_ctx, 0);
+			janus_mutex_lock(&vm->mutex);
+			duk_get_global_string(vm->ctx, "resumeScheduler");
+			int res = duk_pcall(vm->ctx, 0);
 			if(res != DUK_EXEC_SUCCESS) {
-				JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
-				duk_pop(duktape_ctx);
+				JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(vm->ctx, -1));
 			}
+			duk_pop(vm->ctx);
 			/* Print the count of elements into Duktape stack */
-			janus_duktape_stackdump(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			janus_duktape_stackdump(vm->ctx);
+			janus_mutex_unlock(&vm->mutex);
+		} else if(event->type == janus_duktape_event_message) {
+			/* Another VM sent us a message */
+			if(has_incoming_message) {
+				janus_mutex_lock(&vm->mutex);
+				duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+				duk_context *t = duk_get_context(vm->ctx, thr_idx);
+				duk_get_global_string(t, "incomingMessage");
+				duk_push_uint(t, event->from);
+				duk_push_string(t, event->message);
+				int res = duk_pcall(t, 2);
+				if(res != DUK_EXEC_SUCCESS) {
+					JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
+				}
+				duk_pop(t);
+				duk_pop(vm->ctx);
+				janus_mutex_unlock(&vm->mutex);
+			}
+			g_free(event->message);
+			g_free(event);
 		}
 	}
-	JANUS_LOG(LOG_VERB, "Leaving Duktape scheduler thread\n");
+	JANUS_LOG(LOG_VERB, "Leaving Duktape scheduler thread (VM %u)\n", vm->index);
 	return NULL;
 }
 
@@ -2321,9 +2982,10 @@ static gboolean janus_duktape_timer_cb(void *data) {
 		return FALSE;
 	/* Invoke the callback with the provided argument, if available */
 	JANUS_LOG(LOG_VERB, "Invoking scheduled callback (waited %"SCNu32"ms) with ID %u\n", cb->ms, cb->id);
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_vm *vm = cb->vm;
+	janus_mutex_lock(&vm->mutex);
+	duk_idx_t thr_idx = duk_push_thread(vm->ctx);
+	duk_context *t = duk_get_context(vm->ctx, thr_idx);
 	duk_get_global_string(t, cb->function);
 	if(cb->argument) {
 		duk_push_string(t, cb->argument);
@@ -2333,7 +2995,8 @@ static gboolean janus_duktape_timer_cb(void *data) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(vm->ctx);
+	janus_mutex_unlock(&vm->mutex);
 	/* Done */
 	g_source_destroy(cb->source);
 	g_source_unref(cb->source);
@@ -89,6 +89,10 @@
  * - \c addRecipient(): specify which user should receive a user's media;
  * - \c removeRecipient(): specify which user should not receive a user's media anymore;
  * - \c setBitrate(): specify the bitrate to force on a user via REMB feedback;
+ * - \c setSimulcastLayer(): specify which simulcast substream and temporal layer a user should receive;
+ * - \c setBitrateCap(): specify the maximum bitrate of the simulcast video a user should receive;
+ * - \c setRecipientGroup(): put a user in one of the fan-out groups (0-31) of the user they receive media from;
+ * - \c muteGroup(): specify whether audio/video of a user should be relayed to one of their fan-out groups;
  * - \c setPliFreq(): specify how often the plugin should send a PLI to this user;
  * - \c sendPli(): send a PLI (keyframe request);
  * - \c startRecording(): start recording audio, video and or data for a user;
@@ -96,6 +100,15 @@
  * - \c pokeScheduler(): notify the C code that there's a coroutine to resume;
  * - \c timeCallback(): trigger the execution of a Lua function after X milliseconds.
  *
+ * Notice that the methods that affect media routing (\c configureMedium(),
+ * \c addRecipient(), \c removeRecipient(), \c setSimulcastLayer(),
+ * \c setBitrateCap(), \c setRecipientGroup() and \c muteGroup() ) don't involve the Lua script when packets are
+ * actually relayed: they update a routing table the C code consults for
+ * each packet, which means that, unless \c incomingRtp() is implemented,
+ * scripts only control the topology, and never see the media itself.
+ * Simulcast SSRCs and the negotiated video codec are taken from the JSEP
+ * going through the plugin, so no action is needed from the script there.
+ *
  * As anticipated in the previous section, almost all these methods also
  * expect the unique session identifier to address a specific user in the
  * plugin. This is true for all the above methods expect \c eventsIsEnabled
@@ -178,6 +191,39 @@ timeCallback("resumeScheduler", nil, 0)
  * Anyway, \c pokeScheduler() and \c resumeScheduler() is much more
  * compact and less verbose, and as such is preferred in cases where
  * timing and opaque arguments are not needed.
+ *
+ * \section luavms Multiple Lua VMs
+ *
+ * By default, the plugin creates a single Lua state, which means that
+ * all the callbacks (no matter which session they're for) are serialized.
+ * Using the \c vms property in the plugin configuration, you can ask for
+ * more independent Lua states (VMs) to be created instead: all of them
+ * load the same script and get the same \c init() call, and each session
+ * is bound to one of them for its whole lifetime, so that sessions that
+ * ended up in different VMs can be served in parallel. Each VM has its
+ * own C scheduler too, so \c pokeScheduler() and \c timeCallback() only
+ * involve the VM they're called from. To see how many callbacks per second
+ * different numbers of VMs can serve on your machine, check \c script-bench
+ * (\c make \c script-bench in the Janus folder).
+ *
+ * Since VMs share nothing, a script that keeps state across sessions
+ * (e.g., rooms in \c videoroom.lua ) will need to share it explicitly.
+ * This can be done with a few additional functions: \c getVmInfo()
+ * returns the index of the current VM and how many VMs there are;
+ * \c getSessionVm() returns the index of the VM a session is bound to;
+ * \c sendMessage() queues a string to the script running in a specific
+ * VM (or in all the others, if the index is -1), which will get it via
+ * an \c incomingMessage() callback the script must implement for the
+ * purpose:
+ *
+ * \verbatim
+-- Tell the VM handling session 1234 about something
+sendMessage(getSessionVm(1234), "{\"kick\":1234}")
+-- ... which will be notified to the script running there as
+function incomingMessage(fromVm, message)
+	-- Handle the message
+end
+\endverbatim
  *
  * Refer to the \ref luapapi section for more information on how you
  * can register your own C functions.
@@ -258,8 +304,9 @@ volatile gint lua_initialized = 0, lua_stopping = 0;
 janus_callbacks *janus_core = NULL;
 
 /* Lua stuff */
-lua_State *lua_state = NULL;
-janus_mutex lua_mutex = JANUS_MUTEX_INITIALIZER;
+janus_lua_vm *lua_vms = NULL;
+guint lua_vms_num = 0;
+#define JANUS_LUA_VM_KEY	"janus_lua_vm"
 static const char *lua_functions[] = {
 	"init", "destroy", "resumeScheduler",
 	"createSession", "destroySession", "querySession",
@@ -284,15 +331,22 @@ static gboolean has_incoming_rtp = FALSE;
 static gboolean has_incoming_rtcp = FALSE;
 static gboolean has_incoming_data = FALSE;
 static gboolean has_slow_link = FALSE;
-/* Lua C scheduler (for coroutines) */
-static GThread *scheduler_thread = NULL;
+static gboolean has_incoming_message = FALSE;
+/* Lua C scheduler (for coroutines and messages between VMs), one per VM */
 static void *janus_lua_scheduler(void *data);
-static GAsyncQueue *events = NULL;
-typedef enum janus_lua_event {
+typedef enum janus_lua_event_type {
 	janus_lua_event_none = 0,
 	janus_lua_event_resume,		/* Resume one or more pending coroutines */
+	janus_lua_event_message,	/* Deliver a message another VM sent */
 	janus_lua_event_exit		/* Break the scheduler loop */
+} janus_lua_event_type;
+typedef struct janus_lua_event {
+	janus_lua_event_type type;	/* What this event is about */
+	guint from;					/* Index of the VM that sent the message, if any */
+	char *message;				/* Content of the message, if any */
 } janus_lua_event;
+static janus_lua_event janus_lua_resume_event = { janus_lua_event_resume, 0, NULL };
+static janus_lua_event janus_lua_exit_event = { janus_lua_event_exit, 0, NULL };
 /* Lua timer loop (for scheduled callbacks) */
 static GMainContext *timer_context = NULL;
 static GMainLoop *timer_loop = NULL;
@@ -300,6 +354,7 @@ static GThread *timer_thread = NULL;
 static void *janus_lua_timer(void *data);
 static gboolean janus_lua_timer_cb(void *data);
 typedef struct janus_lua_callback {
+	janus_lua_vm *vm;
 	guint id;
 	uint32_t ms;
 	GSource *source;
@@ -313,6 +368,16 @@ static void janus_lua_stackdump(lua_State* l) {
     JANUS_LOG(LOG_HUGE, "Total in lua stack %d\n", top);
 }
 
+/* Helper to find out which VM a Lua state (or any of its threads) belongs to */
+janus_lua_vm *janus_lua_vm_from_state(lua_State *s) {
+	if(s == NULL)
+		return NULL;
+	lua_getfield(s, LUA_REGISTRYINDEX, JANUS_LUA_VM_KEY);
+	janus_lua_vm *vm = (janus_lua_vm *)lua_touserdata(s, -1);
+	lua_pop(s, 1);
+	return vm;
+}
+
 /* janus_lua_session is defined in janus_lua_data.h, but it's managed here */
 GHashTable *lua_sessions, *lua_ids;
 janus_mutex lua_sessions_mutex = JANUS_MUTEX_INITIALIZER;
@@ -335,6 +400,87 @@ static void janus_lua_session_free(const janus_refcount *session_ref) {
 	g_free(session);
 }
 
+/* Native routing tables are rebuilt out of the recipients list whenever the
+ * script changes the topology, and then swapped: the RTP path only needs to
+ * grab a reference to the current table, rather than walking the list locked */
+static void janus_lua_routes_free(const janus_refcount *routes_ref) {
+	janus_lua_routes *routes = janus_refcount_containerof(routes_ref, janus_lua_routes, ref);
+	guint i = 0;
+	for(i=0; i<routes->count; i++)
+		janus_refcount_decrease(&routes->recipients[i]->ref);
+	g_free(routes->recipients);
+	g_free(routes);
+}
+
+/* Must be called with the recipients mutex of the session locked */
+static void janus_lua_session_update_routes(janus_lua_session *session) {
+	janus_lua_routes *routes = NULL;
+	guint count = g_slist_length(session->recipients);
+	if(count > 0) {
+		routes = g_malloc0(sizeof(janus_lua_routes));
+		routes->recipients = g_malloc(count * sizeof(janus_lua_session *));
+		GSList *temp = session->recipients;
+		while(temp) {
+			janus_lua_session *recipient = (janus_lua_session *)temp->data;
+			janus_refcount_increase(&recipient->ref);
+			routes->recipients[routes->count] = recipient;
+			routes->count++;
+			temp = temp->next;
+		}
+		janus_refcount_init(&routes->ref, janus_lua_routes_free);
+	}
+	janus_lua_routes *old_routes = session->routes;
+	session->routes = routes;
+	if(old_routes != NULL)
+		janus_refcount_decrease(&old_routes->ref);
+}
+
+/* Helper to pick the simulcast layers a recipient should get, taking into
+ * account both what the script asked for and the bitrate cap, if any */
+static void janus_lua_session_apply_bitrate_cap(janus_lua_session *session, janus_lua_session *sender) {
+	/* The script sets the rules atomically from the VM thread, while the targets
+	 * of the simulcast context are only ever changed here, on the RTP path */
+	int layers = g_atomic_int_get(&session->layers_wanted);
+	int substream = layers >> 4, templayer = layers & 0x0F;
+	uint32_t bitrate_cap = (uint32_t)g_atomic_int_get(&session->bitrate_cap);
+	if(g_atomic_int_compare_and_exchange(&session->rules_changed, 1, 0))
+		session->cap_switch = 0;
+	if(bitrate_cap > 0 && sender->substream_bitrate[0] > 0) {
+		/* Pick the highest substream that fits the cap */
+		int i = 0;
+		for(i=substream; i>0; i--) {
+			uint32_t needed = sender->substream_bitrate[i];
+			if(needed == 0)	/* The sender is not sending this substream */
+				continue;
+			/* Be more conservative when going up, to avoid oscillations */
+			if(i > session->sim_context.substream)
+				needed += needed/5;
+			if(needed <= bitrate_cap)
+				break;
+		}
+		substream = i;
+		if(substream == 0 && sender->vcodec == JANUS_VIDEOCODEC_VP8 && sender->substream_bitrate[0] > bitrate_cap) {
+			/* Even the lowest substream doesn't fit, drop temporal layers too: we assume
+			 * the base layer takes roughly 40% of the bitrate, and the first two 60% */
+			if((uint64_t)sender->substream_bitrate[0]*6/10 <= bitrate_cap)
+				templayer = MIN(templayer, 1);
+			else
+				templayer = 0;
+		}
+	}
+	if(substream == session->sim_context.substream_target && templayer == session->sim_context.templayer_target)
+		return;
+	/* Don't switch too often because of the cap, though */
+	gint64 now = janus_get_monotonic_time();
+	if(bitrate_cap > 0 && now - session->cap_switch < G_USEC_PER_SEC)
+		return;
+	JANUS_LOG(LOG_VERB, "Switching session %"SCNu32" to substream %d and temporal layer %d (were %d and %d)\n",
+		session->id, substream, templayer, session->sim_context.substream_target, session->sim_context.templayer_target);
+	session->sim_context.substream_target = substream;
+	session->sim_context.templayer_target = templayer;
+	session->cap_switch = now;
+}
+
 /* Packet data and routing */
 typedef struct janus_lua_rtp_relay_packet {
 	rtp_header *data;
@@ -342,6 +488,7 @@ typedef struct janus_lua_rtp_relay_packet {
 	gboolean is_video;
 	uint32_t timestamp;
 	uint16_t seq_number;
+	janus_lua_session *sender;
 } janus_lua_rtp_relay_packet;
 static void janus_lua_relay_rtp_packet(gpointer data, gpointer user_data);
 static void janus_lua_relay_data_packet(gpointer data, gpointer user_data);
@@ -382,7 +529,8 @@ static void *janus_lua_async_event_helper(void *data) {
 /* Methods that we expose to the Lua script */
 static int janus_lua_method_pokescheduler(lua_State *s) {
 	/* This method allows the Lua script to poke the scheduler and have it wake up ASAP */
-	g_async_queue_push(events, GUINT_TO_POINTER(janus_lua_event_resume));
+	janus_lua_vm *vm = janus_lua_vm_from_state(s);
+	g_async_queue_push(vm->events, &janus_lua_resume_event);
 	lua_pushnumber(s, 0);
 	return 1;
 }
@@ -405,6 +553,7 @@ static int janus_lua_method_timecallback(lua_State *s) {
 	guint32 ms = lua_tonumber(s, 3);
 	/* Create a callback instance */
 	janus_lua_callback *cb = g_malloc0(sizeof(janus_lua_callback));
+	cb->vm = janus_lua_vm_from_state(s);
 	cb->function = g_strdup(function);
 	if(argument != NULL)
 		cb->argument = g_strdup(argument);
@@ -418,6 +567,70 @@ static int janus_lua_method_timecallback(lua_State *s) {
 	return 1;
 }
 
+static int janus_lua_method_getvminfo(lua_State *s) {
+	/* This method allows the Lua script to know which VM it's running in, and how many there are */
+	janus_lua_vm *vm = janus_lua_vm_from_state(s);
+	lua_pushnumber(s, vm->index);
+	lua_pushnumber(s, lua_vms_num);
+	return 2;
+}
+
+static int janus_lua_method_getsessionvm(lua_State *s) {
+	/* This method allows the Lua script to know which VM is handling a specific session */
+	int n = lua_gettop(s);
+	if(n != 1) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 1)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	guint32 id = lua_tonumber(s, 1);
+	/* Find the session */
+	janus_mutex_lock(&lua_sessions_mutex);
+	janus_lua_session *session = g_hash_table_lookup(lua_ids, GUINT_TO_POINTER(id));
+	int index = session ? (int)session->vm->index : -1;
+	janus_mutex_unlock(&lua_sessions_mutex);
+	lua_pushnumber(s, index);
+	return 1;
+}
+
+static int janus_lua_method_sendmessage(lua_State *s) {
+	/* This method allows the Lua script to send a message to the script running in another
+	 * VM (or in all of them), which is how state can be shared across VMs if needed */
+	int n = lua_gettop(s);
+	if(n != 2) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 2)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	int target = lua_tonumber(s, 1);
+	const char *message = lua_tostring(s, 2);
+	if(message == NULL || target >= (int)lua_vms_num) {
+		JANUS_LOG(LOG_ERR, "Invalid arguments (missing message or invalid VM %d)\n", target);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	if(!has_incoming_message) {
+		JANUS_LOG(LOG_WARN, "The script doesn't implement incomingMessage(), message will be dropped\n");
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	janus_lua_vm *vm = janus_lua_vm_from_state(s);
+	/* Queue the message to the target VM, or to all the others if the target is negative */
+	guint i = 0;
+	for(i=0; i<lua_vms_num; i++) {
+		if((target >= 0 && i != (guint)target) || (target < 0 && i == vm->index))
+			continue;
+		janus_lua_event *event = g_malloc(sizeof(janus_lua_event));
+		event->type = janus_lua_event_message;
+		event->from = vm->index;
+		event->message = g_strdup(message);
+		g_async_queue_push(lua_vms[i].events, event);
+	}
+	/* Done */
+	lua_pushnumber(s, 0);
+	return 1;
+}
+
 static int janus_lua_method_pushevent(lua_State *s) {
 	/* Get the arguments from the provided state */
 	int n = lua_gettop(s);
@@ -461,6 +674,18 @@ static int janus_lua_method_pushevent(lua_State *s) {
 	}
 	janus_refcount_increase(&session->ref);
 	janus_mutex_unlock(&lua_sessions_mutex);
+	/* If there's an SDP, check which video codec we negotiated, as simulcast needs to know */
+	const char *sdp = jsep ? json_string_value(json_object_get(jsep, "sdp")) : NULL;
+	if(sdp != NULL) {
+		char sdperror[100];
+		janus_sdp *parsed_sdp = janus_sdp_parse(sdp, sdperror, sizeof(sdperror));
+		if(parsed_sdp != NULL) {
+			const char *vcodec = NULL;
+			janus_sdp_find_first_codecs(parsed_sdp, NULL, &vcodec);
+			session->vcodec = janus_videocodec_from_name(vcodec);
+			janus_sdp_destroy(parsed_sdp);
+		}
+	}
 	/* If there's an SDP attached, create a thread to send the event asynchronously:
 	 * sending it here would keep the locked Lua state busy much longer than intended */
 	if(jsep != NULL) {
@@ -679,6 +904,7 @@ static int janus_lua_method_addrecipient(lua_State *s) {
 		janus_refcount_increase(&recipient->ref);
 		session->recipients = g_slist_append(session->recipients, recipient);
 		recipient->sender = session;
+		janus_lua_session_update_routes(session);
 	}
 	janus_mutex_unlock(&session->recipients_mutex);
 	/* Done */
@@ -723,6 +949,7 @@ static int janus_lua_method_removerecipient(lua_State *s) {
 	if(g_slist_find(session->recipients, recipient) != NULL) {
 		session->recipients = g_slist_remove(session->recipients, recipient);
 		recipient->sender = NULL;
+		janus_lua_session_update_routes(session);
 		unref = TRUE;
 	}
 	janus_mutex_unlock(&session->recipients_mutex);
@@ -770,6 +997,151 @@ static int janus_lua_method_setbitrate(lua_State *s) {
 	return 1;
 }
 
+static int janus_lua_method_setsimulcastlayer(lua_State *s) {
+	/* Get the arguments from the provided state */
+	int n = lua_gettop(s);
+	if(n != 3) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 3)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	guint32 id = lua_tonumber(s, 1);
+	int substream = lua_tonumber(s, 2);
+	int templayer = lua_tonumber(s, 3);
+	if(substream < 0 || substream > 2 || templayer < 0 || templayer > 2) {
+		JANUS_LOG(LOG_ERR, "Invalid simulcast layers (substream %d, temporal layer %d)\n", substream, templayer);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	/* Find the session */
+	janus_mutex_lock(&lua_sessions_mutex);
+	janus_lua_session *session = g_hash_table_lookup(lua_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&lua_sessions_mutex);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&lua_sessions_mutex);
+	/* The layers will be enforced when relaying, taking into account the bitrate cap too */
+	g_atomic_int_set(&session->layers_wanted, (substream << 4) | templayer);
+	g_atomic_int_set(&session->rules_changed, 1);
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	lua_pushnumber(s, 0);
+	return 1;
+}
+
+static int janus_lua_method_setbitratecap(lua_State *s) {
+	/* Get the arguments from the provided state */
+	int n = lua_gettop(s);
+	if(n != 2) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 2)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	guint32 id = lua_tonumber(s, 1);
+	guint32 bitrate = lua_tonumber(s, 2);
+	/* Find the session */
+	janus_mutex_lock(&lua_sessions_mutex);
+	janus_lua_session *session = g_hash_table_lookup(lua_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&lua_sessions_mutex);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&lua_sessions_mutex);
+	/* The cap will be enforced when relaying simulcast video to this session */
+	g_atomic_int_set(&session->bitrate_cap, bitrate);
+	g_atomic_int_set(&session->rules_changed, 1);
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	lua_pushnumber(s, 0);
+	return 1;
+}
+
+static int janus_lua_method_setrecipientgroup(lua_State *s) {
+	/* Get the arguments from the provided state */
+	int n = lua_gettop(s);
+	if(n != 2) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 2)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	guint32 id = lua_tonumber(s, 1);
+	int group = lua_tonumber(s, 2);
+	if(group < 0 || group > 31) {
+		JANUS_LOG(LOG_ERR, "Invalid fan-out group %d\n", group);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	/* Find the session */
+	janus_mutex_lock(&lua_sessions_mutex);
+	janus_lua_session *session = g_hash_table_lookup(lua_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&lua_sessions_mutex);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&lua_sessions_mutex);
+	/* The sender's mute rules for this group will be enforced when relaying */
+	g_atomic_int_set(&session->group, group);
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	lua_pushnumber(s, 0);
+	return 1;
+}
+
+static int janus_lua_method_mutegroup(lua_State *s) {
+	/* Get the arguments from the provided state */
+	int n = lua_gettop(s);
+	if(n != 4) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 4)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	guint32 id = lua_tonumber(s, 1);
+	int group = lua_tonumber(s, 2);
+	int audio = lua_toboolean(s, 3);
+	int video = lua_toboolean(s, 4);
+	if(group < 0 || group > 31) {
+		JANUS_LOG(LOG_ERR, "Invalid fan-out group %d\n", group);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	/* Find the session */
+	janus_mutex_lock(&lua_sessions_mutex);
+	janus_lua_session *session = g_hash_table_lookup(lua_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&lua_sessions_mutex);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&lua_sessions_mutex);
+	/* Update the bitmasks the RTP path checks for each recipient */
+	guint bit = 1U << group;
+	if(audio)
+		g_atomic_int_or((volatile guint *)&session->muted_audio, bit);
+	else
+		g_atomic_int_and((volatile guint *)&session->muted_audio, ~bit);
+	guint was_muted = video ? g_atomic_int_or((volatile guint *)&session->muted_video, bit) :
+		g_atomic_int_and((volatile guint *)&session->muted_video, ~bit);
+	if(!video && (was_muted & bit) && g_atomic_int_get(&session->started)) {
+		/* The group is getting video again: ask the sender for a keyframe */
+		session->pli_latest = janus_get_monotonic_time();
+		char rtcpbuf[12];
+		janus_rtcp_pli((char *)&rtcpbuf, 12);
+		janus_core->relay_rtcp(session->handle, 1, rtcpbuf, 12);
+	}
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	lua_pushnumber(s, 0);
+	return 1;
+}
+
 static int janus_lua_method_setplifreq(lua_State *s) {
 	/* Get the arguments from the provided state */
 	int n = lua_gettop(s);
@@ -1075,48 +1447,9 @@ static int janus_lua_method_stoprecording(lua_State *s) {
 }
 
 
-/* Plugin implementation */
-int janus_lua_init(janus_callbacks *callback, const char *config_path) {
-	if(g_atomic_int_get(&lua_stopping)) {
-		/* Still stopping from before */
-		return -1;
-	}
-	if(callback == NULL || config_path == NULL) {
-		/* Invalid arguments */
-		return -1;
-	}
-
-	/* Read configuration */
-	char filename[255];
-	g_snprintf(filename, 255, "%s/%s.cfg", config_path, JANUS_LUA_PACKAGE);
-	JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
-	janus_config *config = janus_config_parse(filename);
-	if(config == NULL) {
-		/* No config means no Lua script */
-		JANUS_LOG(LOG_ERR, "Failed to load configuration file for Lua plugin...\n");
-		return -1;
-	}
-	janus_config_print(config);
-	char *lua_folder = NULL;
-	janus_config_item *folder = janus_config_get_item_drilldown(config, "general", "path");
-	if(folder && folder->value)
-		lua_folder = g_strdup(folder->value);
-	janus_config_item *script = janus_config_get_item_drilldown(config, "general", "script");
-	if(script == NULL || script->value == NULL) {
-		JANUS_LOG(LOG_ERR, "Missing script path in Lua plugin configuration...\n");
-		janus_config_destroy(config);
-		g_free(lua_folder);
-		return -1;
-	}
-	char *lua_file = g_strdup(script->value);
-	char *lua_config = NULL;
-	janus_config_item *conf = janus_config_get_item_drilldown(config, "general", "config");
-	if(conf && conf->value)
-		lua_config = g_strdup(conf->value);
-	janus_config_destroy(config);
-
-	/* Initialize Lua */
-	lua_state = luaL_newstate();
+/* Helper to create a Lua state for a VM, and load the script in it */
+static int janus_lua_vm_setup(janus_lua_vm *vm, const char *lua_folder, const char *lua_file) {
+	lua_State *lua_state = luaL_newstate();
 	luaL_openlibs(lua_state);
 
 	if(lua_folder != NULL) {
@@ -1132,10 +1465,16 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 		lua_setfield(lua_state, -2, "path");
 		lua_pop(lua_state, 1);
 	}
+	/* Keep track of the VM this state belongs to (threads share the registry) */
+	lua_pushlightuserdata(lua_state, vm);
+	lua_setfield(lua_state, LUA_REGISTRYINDEX, JANUS_LUA_VM_KEY);
 
 	/* Register our functions */
 	lua_register(lua_state, "pokeScheduler", janus_lua_method_pokescheduler);
 	lua_register(lua_state, "timeCallback", janus_lua_method_timecallback);
+	lua_register(lua_state, "getVmInfo", janus_lua_method_getvminfo);
+	lua_register(lua_state, "getSessionVm", janus_lua_method_getsessionvm);
+	lua_register(lua_state, "sendMessage", janus_lua_method_sendmessage);
 	lua_register(lua_state, "pushEvent", janus_lua_method_pushevent);
 	lua_register(lua_state, "notifyEvent", janus_lua_method_notifyevent);
 	lua_register(lua_state, "eventsIsEnabled", janus_lua_method_eventsisenabled);
@@ -1145,6 +1484,10 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	lua_register(lua_state, "addRecipient", janus_lua_method_addrecipient);
 	lua_register(lua_state, "removeRecipient", janus_lua_method_removerecipient);
 	lua_register(lua_state, "setBitrate", janus_lua_method_setbitrate);
+	lua_register(lua_state, "setSimulcastLayer", janus_lua_method_setsimulcastlayer);
+	lua_register(lua_state, "setBitrateCap", janus_lua_method_setbitratecap);
+	lua_register(lua_state, "setRecipientGroup", janus_lua_method_setrecipientgroup);
+	lua_register(lua_state, "muteGroup", janus_lua_method_mutegroup);
 	lua_register(lua_state, "setPliFreq", janus_lua_method_setplifreq);
 	lua_register(lua_state, "sendPli", janus_lua_method_sendpli);
 	lua_register(lua_state, "relayRtp", janus_lua_method_relayrtp);
@@ -1160,8 +1503,6 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	if(err) {
 		JANUS_LOG(LOG_ERR, "Error loading Lua script %s: %s\n", lua_file, lua_tostring(lua_state, -1));
 		lua_close(lua_state);
-		g_free(lua_folder);
-		g_free(lua_file);
 		return -1;
 	}
 	/* Make sure that all the functions we need are there */
@@ -1171,14 +1512,112 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 		if(lua_isfunction(lua_state, lua_gettop(lua_state)) == 0) {
 			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", lua_functions[i], lua_file);
 			lua_close(lua_state);
+			return -1;
+		}
+		lua_pop(lua_state, 1);
+	}
+	vm->state = lua_state;
+	vm->events = g_async_queue_new();
+	return 0;
+}
+
+/* Helper to get rid of all the VMs, and the pool itself */
+static void janus_lua_vms_free(void) {
+	uint i=0;
+	for(i=0; i<lua_vms_num; i++) {
+		janus_lua_vm *vm = &lua_vms[i];
+		janus_mutex_lock(&vm->mutex);
+		if(vm->state != NULL)
+			lua_close(vm->state);
+		vm->state = NULL;
+		janus_mutex_unlock(&vm->mutex);
+		if(vm->events != NULL) {
+			/* Get rid of the messages nobody will deliver anymore */
+			janus_lua_event *event = NULL;
+			while((event = g_async_queue_try_pop(vm->events)) != NULL) {
+				if(event->type == janus_lua_event_message) {
+					g_free(event->message);
+					g_free(event);
+				}
+			}
+			g_async_queue_unref(vm->events);
+		}
+		vm->events = NULL;
+	}
+	g_free(lua_vms);
+	lua_vms = NULL;
+	lua_vms_num = 0;
+}
+
+
+/* Plugin implementation */
+int janus_lua_init(janus_callbacks *callback, const char *config_path) {
+	if(g_atomic_int_get(&lua_stopping)) {
+		/* Still stopping from before */
+		return -1;
+	}
+	if(callback == NULL || config_path == NULL) {
+		/* Invalid arguments */
+		return -1;
+	}
+
+	/* Read configuration */
+	char filename[255];
+	g_snprintf(filename, 255, "%s/%s.cfg", config_path, JANUS_LUA_PACKAGE);
+	JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
+	janus_config *config = janus_config_parse(filename);
+	if(config == NULL) {
+		/* No config means no Lua script */
+		JANUS_LOG(LOG_ERR, "Failed to load configuration file for Lua plugin...\n");
+		return -1;
+	}
+	janus_config_print(config);
+	char *lua_folder = NULL;
+	janus_config_item *folder = janus_config_get_item_drilldown(config, "general", "path");
+	if(folder && folder->value)
+		lua_folder = g_strdup(folder->value);
+	janus_config_item *script = janus_config_get_item_drilldown(config, "general", "script");
+	if(script == NULL || script->value == NULL) {
+		JANUS_LOG(LOG_ERR, "Missing script path in Lua plugin configuration...\n");
+		janus_config_destroy(config);
+		g_free(lua_folder);
+		return -1;
+	}
+	char *lua_file = g_strdup(script->value);
+	char *lua_config = NULL;
+	janus_config_item *conf = janus_config_get_item_drilldown(config, "general", "config");
+	if(conf && conf->value)
+		lua_config = g_strdup(conf->value);
+	janus_config_item *vms = janus_config_get_item_drilldown(config, "general", "vms");
+	int vms_num = (vms && vms->value) ? atoi(vms->value) : 1;
+	if(vms_num < 1) {
+		JANUS_LOG(LOG_WARN, "Invalid number of Lua VMs (%d), falling back to 1\n", vms_num);
+		vms_num = 1;
+	}
+	janus_config_destroy(config);
+
+	/* Initialize Lua: we create a pool of independent states (VMs), each loading the same script */
+	lua_vms_num = vms_num;
+	lua_vms = g_malloc0(lua_vms_num * sizeof(janus_lua_vm));
+	uint i=0;
+	for(i=0; i<lua_vms_num; i++) {
+		janus_lua_vm *vm = &lua_vms[i];
+		vm->index = i;
+		janus_mutex_init(&vm->mutex);
+		if(janus_lua_vm_setup(vm, lua_folder, lua_file) < 0) {
+			janus_lua_vms_free();
 			g_free(lua_folder);
 			g_free(lua_file);
+			g_free(lua_config);
 			return -1;
 		}
 	}
+	JANUS_LOG(LOG_VERB, "Loaded %s in %u Lua VMs\n", lua_file, lua_vms_num);
 	/* Some Lua functions are optional (e.g., those to directly handle RTP, RTCP and
 	 * data, as those will typically be kept at a C level, with Lua only dictating
-	 * the logic, or those overriding the plugin namespace and versioning information */
+	 * the logic, or those overriding the plugin namespace and versioning information):
+	 * since all VMs load the same script, checking the first one is enough */
+	lua_State *lua_state = lua_vms[0].state;
 	lua_getglobal(lua_state, "getVersion");
 	if(lua_isfunction(lua_state, lua_gettop(lua_state)) != 0)
 		has_get_version = TRUE;
@@ -1209,25 +1648,33 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	lua_getglobal(lua_state, "slowLink");
 	if(lua_isfunction(lua_state, lua_gettop(lua_state)) != 0)
 		has_slow_link = TRUE;
+	lua_getglobal(lua_state, "incomingMessage");
+	if(lua_isfunction(lua_state, lua_gettop(lua_state)) != 0)
+		has_incoming_message = TRUE;
 
 	lua_sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_lua_session_destroy);
 	lua_ids = g_hash_table_new(NULL, NULL);
-	events = g_async_queue_new();
 
 	g_atomic_int_set(&lua_initialized, 1);
 
-	/* Launch the scheduler thread (which will be responsible for resuming asynchronous coroutines) */
+	/* Launch the scheduler threads (which will be responsible for resuming asynchronous coroutines) */
 	GError *error = NULL;
-	scheduler_thread = g_thread_try_new("lua scheduler", janus_lua_scheduler, NULL, &error);
-	if(error != NULL) {
-		g_atomic_int_set(&lua_initialized, 0);
-		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Lua scheduler thread...\n",
-			error->code, error->message ? error->message : "??");
-		lua_close(lua_state);
-		g_free(lua_folder);
-		g_free(lua_file);
-		g_free(lua_config);
-		return -1;
+	for(i=0; i<lua_vms_num; i++) {
+		janus_lua_vm *vm = &lua_vms[i];
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "lua sched %u", i);
+		vm->scheduler_thread = g_thread_try_new(tname, janus_lua_scheduler, vm, &error);
+		if(error != NULL) {
+			g_atomic_int_set(&lua_initialized, 0);
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Lua scheduler thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_lua_vms_free();
+			g_free(lua_folder);
+			g_free(lua_file);
+			g_free(lua_config);
+			return -1;
+		}
 	}
 	/* Launch the timer loop thread (which will be responsible for scheduling timed callbacks) */
 	timer_context = g_main_context_new();
@@ -1237,11 +1684,12 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 		g_atomic_int_set(&lua_initialized, 0);
 		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Lua timer loop thread...\n",
 			error->code, error->message ? error->message : "??");
+		g_error_free(error);
 		if(timer_loop != NULL)
 			g_main_loop_unref(timer_loop);
 		if(timer_context != NULL)
 			g_main_context_unref(timer_context);
-		lua_close(lua_state);
+		janus_lua_vms_free();
 		g_free(lua_folder);
 		g_free(lua_file);
 		g_free(lua_config);
@@ -1251,10 +1699,15 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	janus_core = callback;
 
-	/* Init the Lua script, in case it's needed */
-	lua_getglobal(lua_state, "init");
-	lua_pushstring(lua_state, lua_config);
-	lua_call(lua_state, 1, 0);
+	/* Init the Lua script in all VMs, in case it's needed: they all get the same configuration */
+	for(i=0; i<lua_vms_num; i++) {
+		janus_lua_vm *vm = &lua_vms[i];
+		janus_mutex_lock(&vm->mutex);
+		lua_getglobal(vm->state, "init");
+		lua_pushstring(vm->state, lua_config);
+		lua_call(vm->state, 1, 0);
+		janus_mutex_unlock(&vm->mutex);
+	}
 
 	g_free(lua_folder);
 	g_free(lua_file);
@@ -1269,10 +1722,14 @@ void janus_lua_destroy(void) {
 		return;
 	g_atomic_int_set(&lua_stopping, 1);
 
-	g_async_queue_push(events, GUINT_TO_POINTER(janus_lua_event_exit));
-	if(scheduler_thread != NULL) {
-		g_thread_join(scheduler_thread);
-		scheduler_thread = NULL;
+	uint i=0;
+	for(i=0; i<lua_vms_num; i++)
+		g_async_queue_push(lua_vms[i].events, &janus_lua_exit_event);
+	for(i=0; i<lua_vms_num; i++) {
+		if(lua_vms[i].scheduler_thread != NULL) {
+			g_thread_join(lua_vms[i].scheduler_thread);
+			lua_vms[i].scheduler_thread = NULL;
+		}
 	}
 	if(timer_loop != NULL)
 		g_main_loop_quit(timer_loop);
@@ -1289,25 +1746,23 @@ void janus_lua_destroy(void) {
 		timer_context = NULL;
 	}
 
-	/* Deinit the Lua script, in case it's needed */
-	janus_mutex_lock(&lua_mutex);
-	lua_getglobal(lua_state, "destroy");
-	lua_call(lua_state, 0, 0);
-	janus_mutex_unlock(&lua_mutex);
+	/* Deinit the Lua script in all VMs, in case it's needed */
+	for(i=0; i<lua_vms_num; i++) {
+		janus_lua_vm *vm = &lua_vms[i];
+		janus_mutex_lock(&vm->mutex);
+		lua_getglobal(vm->state, "destroy");
+		lua_call(vm->state, 0, 0);
+		janus_mutex_unlock(&vm->mutex);
+	}
 
 	janus_mutex_lock(&lua_sessions_mutex);
 	g_hash_table_destroy(lua_sessions);
 	lua_sessions = NULL;
 	g_hash_table_destroy(lua_ids);
 	lua_ids = NULL;
-	g_async_queue_unref(events);
-	events = NULL;
 	janus_mutex_unlock(&lua_sessions_mutex);
 
-	janus_mutex_lock(&lua_mutex);
-	lua_close(lua_state);
-	lua_state = NULL;
-	janus_mutex_unlock(&lua_mutex);
+	janus_lua_vms_free();
 
 	g_free(lua_script_version_string);
 	g_free(lua_script_description);
@@ -1333,13 +1788,13 @@ int janus_lua_get_version(void) {
 			/* Unless we asked already */
 			return lua_script_version;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_vms[0].mutex);
+		lua_State *t = lua_newthread(lua_vms[0].state);
 		lua_getglobal(t, "getVersion");
 		lua_call(t, 0, 1);
 		lua_script_version = (int)lua_tonumber(t, -1);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_vms[0].mutex);
 		return lua_script_version;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1354,15 +1809,15 @@ const char *janus_lua_get_version_string(void) {
 			/* Unless we asked already */
 			return lua_script_version_string;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_vms[0].mutex);
+		lua_State *t = lua_newthread(lua_vms[0].state);
 		lua_getglobal(t, "getVersionString");
 		lua_call(t, 0, 1);
 		const char *version = lua_tostring(t, -1);
 		if(version != NULL)
 			lua_script_version_string = g_strdup(version);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_vms[0].mutex);
 		return lua_script_version_string;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1377,15 +1832,15 @@ const char *janus_lua_get_description(void) {
 			/* Unless we asked already */
 			return lua_script_description;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_vms[0].mutex);
+		lua_State *t = lua_newthread(lua_vms[0].state);
 		lua_getglobal(t, "getDescription");
 		lua_call(t, 0, 1);
 		const char *description = lua_tostring(t, -1);
 		if(description != NULL)
 			lua_script_description = g_strdup(description);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_vms[0].mutex);
 		return lua_script_description;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1400,15 +1855,15 @@ const char *janus_lua_get_name(void) {
 			/* Unless we asked already */
 			return lua_script_name;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_vms[0].mutex);
+		lua_State *t = lua_newthread(lua_vms[0].state);
 		lua_getglobal(t, "getName");
 		lua_call(t, 0, 1);
 		const char *name = lua_tostring(t, -1);
 		if(name != NULL)
 			lua_script_name = g_strdup(name);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_vms[0].mutex);
 		return lua_script_name;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1423,15 +1878,15 @@ const char *janus_lua_get_author(void) {
 			/* Unless we asked already */
 			return lua_script_author;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_vms[0].mutex);
+		lua_State *t = lua_newthread(lua_vms[0].state);
 		lua_getglobal(t, "getAuthor");
 		lua_call(t, 0, 1);
 		const char *author = lua_tostring(t, -1);
 		if(author != NULL)
 			lua_script_author = g_strdup(author);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_vms[0].mutex);
 		return lua_script_author;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1446,15 +1901,15 @@ const char *janus_lua_get_package(void) {
 			/* Unless we asked already */
 			return lua_script_package;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_vms[0].mutex);
+		lua_State *t = lua_newthread(lua_vms[0].state);
 		lua_getglobal(t, "getPackage");
 		lua_call(t, 0, 1);
 		const char *package = lua_tostring(t, -1);
 		if(package != NULL)
 			lua_script_package = g_strdup(package);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_vms[0].mutex);
 		return lua_script_package;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1487,7 +1942,13 @@ void janus_lua_create_session(janus_plugin_session *handle, int *error) {
 	janus_lua_session *session = (janus_lua_session *)g_malloc0(sizeof(janus_lua_session));
 	session->handle = handle;
 	session->id = id;
+	/* Bind the session to one of the VMs: session IDs are random, so this spreads them evenly */
+	session->vm = &lua_vms[id % lua_vms_num];
 	janus_rtp_switching_context_reset(&session->rtpctx);
+	janus_rtp_simulcasting_context_reset(&session->sim_context);
+	janus_vp8_simulcast_context_reset(&session->vp8_context);
+	g_atomic_int_set(&session->layers_wanted, (2 << 4) | 2);
+	session->sim_context.substream_target = session->sim_context.templayer_target = 2;
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_lua_session_free);
@@ -1497,13 +1958,14 @@ void janus_lua_create_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&lua_sessions_mutex);
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	lua_State *t = lua_newthread(vm->state);
 	lua_getglobal(t, "createSession");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(vm->state, 1);
+	janus_mutex_unlock(&vm->mutex);
 
 	return;
 }
@@ -1527,13 +1989,14 @@ void janus_lua_destroy_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&lua_sessions_mutex);
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	lua_State *t = lua_newthread(vm->state);
 	lua_getglobal(t, "destroySession");
 	lua_pushnumber(t, id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(vm->state, 1);
+	janus_mutex_unlock(&vm->mutex);
 
 	/* Get any rid references recipients of this sessions may have */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -1546,6 +2009,7 @@ void janus_lua_destroy_session(janus_plugin_session *handle, int *error) {
 		}
 		session->recipients = g_slist_remove(session->recipients, recipient);
 	}
+	janus_lua_session_update_routes(session);
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Finally, remove from the hashtable */
@@ -1571,19 +2035,20 @@ json_t *janus_lua_query_session(janus_plugin_session *handle) {
 	janus_refcount_increase(&session->ref);
 	janus_mutex_unlock(&lua_sessions_mutex);
 	/* Ask the Lua script for information on this session */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	lua_State *t = lua_newthread(vm->state);
 	lua_getglobal(t, "querySession");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 1);
-	lua_pop(lua_state, 1);
+	lua_pop(vm->state, 1);
 	janus_refcount_decrease(&session->ref);
 	const char *info = lua_tostring(t, -1);
 	lua_pop(t, 1);
 	/* We need a Jansson object */
 	json_error_t error;
 	json_t *json = json_loads(info, 0, &error);
-	janus_mutex_unlock(&lua_mutex);
+	janus_mutex_unlock(&vm->mutex);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s", error.line, error.text);
 		return NULL;
@@ -1614,18 +2079,27 @@ struct janus_plugin_result *janus_lua_handle_message(janus_plugin_session *handl
 		g_free(transaction);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "No session associated with this handle", NULL);
 	}
+	/* If the user is going to simulcast, take note of the SSRCs: we'll need them for routing */
+	json_t *msg_simulcast = jsep ? json_object_get(jsep, "simulcast") : NULL;
+	if(msg_simulcast) {
+		JANUS_LOG(LOG_VERB, "Lua session %"SCNu32" is going to do simulcasting\n", session->id);
+		session->ssrc[0] = json_integer_value(json_object_get(msg_simulcast, "ssrc-0"));
+		session->ssrc[1] = json_integer_value(json_object_get(msg_simulcast, "ssrc-1"));
+		session->ssrc[2] = json_integer_value(json_object_get(msg_simulcast, "ssrc-2"));
+	}
 	char *jsep_text = jsep ? json_dumps(jsep, JSON_INDENT(0) | JSON_PRESERVE_ORDER) : NULL;
 	json_decref(jsep);
 	/* Invoke the script function */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	lua_State *t = lua_newthread(vm->state);
 	lua_getglobal(t, "handleMessage");
 	lua_pushnumber(t, session->id);
 	lua_pushstring(t, transaction);
 	lua_pushstring(t, message_text);
 	lua_pushstring(t, jsep_text);
 	lua_call(t, 4, 2);
-	lua_pop(lua_state, 1);
+	lua_pop(vm->state, 1);
 	janus_refcount_decrease(&session->ref);
 	if(message_text != NULL)
 		free(message_text);
@@ -1634,7 +2108,7 @@ struct janus_plugin_result *janus_lua_handle_message(janus_plugin_session *handl
 	g_free(transaction);
 	int n = lua_gettop(t);
 	if(n != 2) {
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&vm->mutex);
 		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 2)\n", n);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Lua error", NULL);
 	}
@@ -1644,20 +2118,20 @@ struct janus_plugin_result *janus_lua_handle_message(janus_plugin_session *handl
 	lua_pop(t, 2);
 	if(res < 0) {
 		/* We got an error */
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&vm->mutex);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, response ? response : "Lua error", NULL);
 	} else if(res == 0) {
 		/* Synchronous response: we need a Jansson object */
 		json_error_t error;
 		json_t *json = json_loads(response, 0, &error);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&vm->mutex);
 		if(!json) {
 			JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Lua error", NULL);
 		}
 		return janus_plugin_result_new(JANUS_PLUGIN_OK, NULL, json);
 	}
-	janus_mutex_unlock(&lua_mutex);
+	janus_mutex_unlock(&vm->mutex);
 	/* If we got here, it's an asynchronous response */
 	return janus_plugin_result_new(JANUS_PLUGIN_OK_WAIT, NULL, NULL);
 }
@@ -1684,13 +2158,14 @@ void janus_lua_setup_media(janus_plugin_session *handle) {
 	session->pli_latest = janus_get_monotonic_time();
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	lua_State *t = lua_newthread(vm->state);
 	lua_getglobal(t, "setupMedia");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(vm->state, 1);
+	janus_mutex_unlock(&vm->mutex);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -1707,16 +2182,17 @@ void janus_lua_incoming_rtp(janus_plugin_session *handle, int video, char *buf,
 	/* Check if the Lua script wants to handle/manipulate RTP packets itself */
 	if(has_incoming_rtp) {
 		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_vm *vm = session->vm;
+		janus_mutex_lock(&vm->mutex);
+		lua_State *t = lua_newthread(vm->state);
 		lua_getglobal(t, "incomingRtp");
 		lua_pushnumber(t, session->id);
 		lua_pushboolean(t, video);
 		lua_pushlstring(t, buf, len);
 		lua_pushnumber(t, len);
 		lua_call(t, 4, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(vm->state, 1);
+		janus_mutex_unlock(&vm->mutex);
 		return;
 	}
 	/* Is this session allowed to send media? */
@@ -1733,10 +2209,38 @@ void janus_lua_incoming_rtp(janus_plugin_session *handle, int video, char *buf,
 	/* Backup the actual timestamp and sequence number set by the publisher, in case switching is involved */
 	packet.timestamp = ntohl(packet.data->timestamp);
 	packet.seq_number = ntohs(packet.data->seq_number);
-	/* Relay to all recipients */
+	packet.sender = session;
+	if(video && session->ssrc[0] != 0) {
+		/* Keep track of the bitrate of each substream, in case recipients have bitrate caps */
+		uint32_t ssrc = ntohl(rtp->ssrc);
+		int sc = (ssrc == session->ssrc[0] ? 0 : (ssrc == session->ssrc[1] ? 1 : (ssrc == session->ssrc[2] ? 2 : -1)));
+		if(sc != -1) {
+			gint64 now = janus_get_monotonic_time();
+			if(session->substream_updated == 0)
+				session->substream_updated = now;
+			if(now - session->substream_updated >= G_USEC_PER_SEC) {
+				int i = 0;
+				for(i=0; i<3; i++) {
+					session->substream_bitrate[i] = (uint32_t)((guint64)session->substream_bytes[i]*8*G_USEC_PER_SEC/(now - session->substream_updated));
+					session->substream_bytes[i] = 0;
+				}
+				session->substream_updated = now;
+			}
+			session->substream_bytes[sc] += len;
+		}
+	}
+	/* Relay to all recipients, as per the current routing table */
 	janus_mutex_lock_nodebug(&session->recipients_mutex);
-	g_slist_foreach(session->recipients, janus_lua_relay_rtp_packet, &packet);
+	janus_lua_routes *routes = session->routes;
+	if(routes != NULL)
+		janus_refcount_increase_nodebug(&routes->ref);
 	janus_mutex_unlock_nodebug(&session->recipients_mutex);
+	if(routes != NULL) {
+		guint i = 0;
+		for(i=0; i<routes->count; i++)
+			janus_lua_relay_rtp_packet(routes->recipients[i], &packet);
+		janus_refcount_decrease_nodebug(&routes->ref);
+	}
 
 	/* Check if we need to send any PLI to this media source */
 	if(video && session->pli_freq > 0) {
@@ -1765,16 +2269,17 @@ void janus_lua_incoming_rtcp(janus_plugin_session *handle, int video, char *buf,
 	/* Check if the Lua script wants to handle/manipulate RTCP packets itself */
 	if(has_incoming_rtcp) {
 		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_vm *vm = session->vm;
+		janus_mutex_lock(&vm->mutex);
+		lua_State *t = lua_newthread(vm->state);
 		lua_getglobal(t, "incomingRtcp");
 		lua_pushnumber(t, session->id);
 		lua_pushboolean(t, video);
 		lua_pushlstring(t, buf, len);
 		lua_pushnumber(t, len);
 		lua_call(t, 4, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(vm->state, 1);
+		janus_mutex_unlock(&vm->mutex);
 		return;
 	}
 	/* If a REMB arrived, make sure we cap it to our configuration, and send it as a video RTCP */
@@ -1818,15 +2323,16 @@ void janus_lua_incoming_data(janus_plugin_session *handle, char *buf, int len) {
 	/* Check if the Lua script wants to handle/manipulate data channel packets itself */
 	if(has_incoming_data) {
 		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_vm *vm = session->vm;
+		janus_mutex_lock(&vm->mutex);
+		lua_State *t = lua_newthread(vm->state);
 		lua_getglobal(t, "incomingData");
 		lua_pushnumber(t, session->id);
 		lua_pushlstring(t, buf, len);
 		lua_pushnumber(t, len);
 		lua_call(t, 3, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(vm->state, 1);
+		janus_mutex_unlock(&vm->mutex);
 		return;
 	}
 	/* Is this session allowed to send data? */
@@ -1865,15 +2371,16 @@ void janus_lua_slow_link(janus_plugin_session *handle, int uplink, int video) {
 	janus_refcount_increase(&session->ref);
 	if(has_slow_link) {
 		/* Notify the Lua script */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_vm *vm = session->vm;
+		janus_mutex_lock(&vm->mutex);
+		lua_State *t = lua_newthread(vm->state);
 		lua_getglobal(t, "slowLink");
 		lua_pushnumber(t, session->id);
 		lua_pushboolean(t, uplink);
 		lua_pushboolean(t, video);
 		lua_call(t, 3, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(vm->state, 1);
+		janus_mutex_unlock(&vm->mutex);
 	}
 	janus_refcount_decrease(&session->ref);
 }
@@ -1912,6 +2419,19 @@ void janus_lua_hangup_media(janus_plugin_session *handle) {
 	session->pli_freq = 0;
 	session->pli_latest = 0;
 	janus_rtp_switching_context_reset(&session->rtpctx);
+	memset(session->ssrc, 0, sizeof(session->ssrc));
+	memset(session->substream_bitrate, 0, sizeof(session->substream_bitrate));
+	memset(session->substream_bytes, 0, sizeof(session->substream_bytes));
+	session->substream_updated = 0;
+	janus_rtp_simulcasting_context_reset(&session->sim_context);
+	janus_vp8_simulcast_context_reset(&session->vp8_context);
+	g_atomic_int_set(&session->layers_wanted, (2 << 4) | 2);
+	session->sim_context.substream_target = session->sim_context.templayer_target = 2;
+	g_atomic_int_set(&session->bitrate_cap, 0);
+	g_atomic_int_set(&session->rules_changed, 1);
+	g_atomic_int_set(&session->group, 0);
+	g_atomic_int_set(&session->muted_audio, 0);
+	g_atomic_int_set(&session->muted_video, 0);
 
 	/* Get rid of the recipients */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -1922,16 +2442,18 @@ void janus_lua_hangup_media(janus_plugin_session *handle) {
 		janus_refcount_decrease(&session->ref);
 		janus_refcount_decrease(&recipient->ref);
 	}
+	janus_lua_session_update_routes(session);
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_vm *vm = session->vm;
+	janus_mutex_lock(&vm->mutex);
+	lua_State *t = lua_newthread(vm->state);
 	lua_getglobal(t, "hangupMedia");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(vm->state, 1);
+	janus_mutex_unlock(&vm->mutex);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -1952,6 +2474,53 @@ static void janus_lua_relay_rtp_packet(gpointer data, gpointer user_data) {
 		/* Nope, don't relay */
 		return;
 	}
+	janus_lua_session *sender = packet->sender;
+	if(sender != NULL && ((packet->is_video ? g_atomic_int_get(&sender->muted_video) :
+			g_atomic_int_get(&sender->muted_audio)) & (1U << g_atomic_int_get(&session->group)))) {
+		/* The script muted the fan-out group this recipient is in */
+		return;
+	}
+	if(packet->is_video && sender != NULL && sender->ssrc[0] != 0) {
+		/* Handle simulcast: make sure we have a payload to work with */
+		int plen = 0;
+		char *payload = janus_rtp_payload((char *)packet->data, packet->length, &plen);
+		if(payload == NULL)
+			return;
+		/* Check if the bitrate cap suggests different layers than the ones the script asked for */
+		janus_lua_session_apply_bitrate_cap(session, sender);
+		/* Process this packet: don't relay if it's not the SSRC/layer we wanted to handle */
+		gboolean relay = janus_rtp_simulcasting_context_process_rtp(&session->sim_context,
+			(char *)packet->data, packet->length, sender->ssrc, sender->vcodec, &session->rtpctx);
+		if(!relay)
+			return;
+		if(session->sim_context.need_pli) {
+			/* Send a PLI to the sender */
+			JANUS_LOG(LOG_VERB, "We need a PLI for the simulcast context\n");
+			sender->pli_latest = janus_get_monotonic_time();
+			char rtcpbuf[12];
+			janus_rtcp_pli((char *)&rtcpbuf, 12);
+			janus_core->relay_rtcp(sender->handle, 1, rtcpbuf, 12);
+		}
+		/* If we got here, update the RTP header and send the packet */
+		janus_rtp_header_update(packet->data, &session->rtpctx, TRUE, 4500);
+		char vp8pd[6];
+		if(sender->vcodec == JANUS_VIDEOCODEC_VP8) {
+			/* For VP8, we save the original payload descriptor, to restore it after */
+			memcpy(vp8pd, payload, sizeof(vp8pd));
+			janus_vp8_simulcast_descriptor_update(payload, plen, &session->vp8_context,
+				session->sim_context.changed_substream);
+		}
+		if(janus_core != NULL)
+			janus_core->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+		/* Restore the timestamp and sequence number to what the publisher set them to */
+		packet->data->timestamp = htonl(packet->timestamp);
+		packet->data->seq_number = htons(packet->seq_number);
+		if(sender->vcodec == JANUS_VIDEOCODEC_VP8) {
+			/* Restore the original payload descriptor as well, as it will be needed by the next recipient */
+			memcpy(payload, vp8pd, sizeof(vp8pd));
+		}
+		return;
+	}
 	/* Fix sequence number and timestamp (publisher switching may be involved) */
 	janus_rtp_header_update(packet->data, &session->rtpctx, packet->is_video, packet->is_video ? 4500 : 960);
 	/* Send the packet */
@@ -1979,26 +2548,43 @@ static void janus_lua_relay_data_packet(gpointer data, gpointer user_data) {
 }
 
 /* This is a scheduler thread: if we know there are coroutines to resume
- * in Lua (e.g., for asynchronous requests), we do that ourselves here */
+ * in Lua (e.g., for asynchronous requests), we do that ourselves here;
+ * each VM has its own, which is also where messages other VMs sent via
+ * sendMessage() are delivered to the script via incomingMessage() */
 static void *janus_lua_scheduler(void *data) {
-	JANUS_LOG(LOG_VERB, "Joining Lua scheduler thread\n");
+	janus_lua_vm *vm = (janus_lua_vm *)data;
+	JANUS_LOG(LOG_VERB, "Joining Lua scheduler thread (VM %u)\n", vm->index);
 	janus_lua_event *event = NULL;
 	/* Wait until there are events to process */
 	while(g_atomic_int_get(&lua_initialized) && !g_atomic_int_get(&lua_stopping)) {
-		event = g_async_queue_pop(events);
-		if(event == GUINT_TO_POINTER(janus_lua_event_exit))
+		event = g_async_queue_pop(vm->events);
+		if(event == &janus_lua_exit_event)
 			break;
-		if(event == GUINT_TO_POINTER(janus_lua_event_resume)) {
+		if(event == &janus_lua_resume_event) {
 			/* There are coroutines to resume */
-			janus_mutex_lock(&lua_mutex);
-			lua_getglobal(lua_state, "resumeScheduler");
-			lua_call(lua_state, 0, 0);
+			janus_mutex_lock(&vm->mutex);
+			lua_getglobal(vm->state, "resumeScheduler");
+			lua_call(vm->state, 0, 0);
 			/* Print the count of elements into Lua stack */
-			janus_lua_stackdump(lua_state);
-			janus_mutex_unlock(&lua_mutex);
+			janus_lua_stackdump(vm->state);
+			janus_mutex_unlock(&vm->mutex);
+		} else if(event->type == janus_lua_event_message) {
+			/* Another VM sent us a message */
+			if(has_incoming_message) {
+				janus_mutex_lock(&vm->mutex);
+				lua_State *t = lua_newthread(vm->state);
+				lua_getglobal(t, "incomingMessage");
+				lua_pushnumber(t, event->from);
+				lua_pushstring(t, event->message);
+				lua_call(t, 2, 0);
+				lua_pop(vm->state, 1);
+				janus_mutex_unlock(&vm->mutex);
+			}
+			g_free(event->message);
+			g_free(event);
 		}
 	}
-	JANUS_LOG(LOG_VERB, "Leaving Lua scheduler thread\n");
+	JANUS_LOG(LOG_VERB, "Leaving Lua scheduler thread (VM %u)\n", vm->index);
 	return NULL;
 }
 
@@ -2023,8 +2609,9 @@ static gboolean janus_lua_timer_cb(void *data) {
 		return FALSE;
 	/* Invoke the callback with the provided argument, if available */
 	JANUS_LOG(LOG_VERB, "Invoking scheduled callback (waited %"SCNu32"ms) with ID %u\n", cb->ms, cb->id);
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_vm *vm = cb->vm;
+	janus_mutex_lock(&vm->mutex);
+	lua_State *t = lua_newthread(vm->state);
 	lua_getglobal(t, cb->function);
 	if(cb->argument == NULL) {
 		lua_call(t, 0, 0);
@@ -2032,8 +2619,8 @@ static gboolean janus_lua_timer_cb(void *data) {
 		lua_pushstring(t, cb->argument);
 		lua_call(t, 1, 0);
 	}
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(vm->state, 1);
+	janus_mutex_unlock(&vm->mutex);
 	/* Done */
 	g_source_destroy(cb->source);
 	g_source_unref(cb->source);
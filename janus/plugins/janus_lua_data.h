@@ -43,14 +43,36 @@
 extern volatile gint lua_initialized, lua_stopping;
 extern janus_callbacks *janus_core;
 
-/* Lua state: we define state and mutex as extern */
-extern lua_State *lua_state;
-extern janus_mutex lua_mutex;
+/* Lua VMs: rather than a single Lua state behind a global mutex, we
+ * have a pool of independent states, each with its own mutex and
+ * scheduler thread, all loading the same script; each session is bound
+ * to one of them, which means sessions in different VMs can be served
+ * in parallel. We define the pool as extern */
+typedef struct janus_lua_vm {
+	guint index;						/* Index of this VM in the pool */
+	lua_State *state;					/* The Lua state of this VM */
+	janus_mutex mutex;					/* Mutex to lock the Lua state */
+	GThread *scheduler_thread;			/* Scheduler thread (for coroutines and messages) */
+	GAsyncQueue *events;				/* Events for the scheduler thread */
+} janus_lua_vm;
+extern janus_lua_vm *lua_vms;
+extern guint lua_vms_num;
+janus_lua_vm *janus_lua_vm_from_state(lua_State *s);
+
+/* Native routing table: an immutable snapshot of the recipients of a session,
+ * rebuilt whenever the script changes the topology, so that the RTP path can
+ * walk a plain array without keeping the recipients list locked while relaying */
+typedef struct janus_lua_routes {
+	guint count;								/* Number of recipients */
+	struct janus_lua_session **recipients;		/* Recipients (the table holds a reference to each of them) */
+	janus_refcount ref;							/* Reference counter for this table */
+} janus_lua_routes;
 
 /* Lua session: we keep only the barebone stuff here, the rest will be in the Lua script */
 typedef struct janus_lua_session {
 	janus_plugin_session *handle;		/* Pointer to the core-plugin session */
 	uint32_t id;						/* Unique session ID (will be used to correlate with the Lua script) */
+	janus_lua_vm *vm;					/* The Lua VM this session is bound to */
 	/* The following are only needed for media manipulation, feedback and routing, and may not all be used */
 	gboolean accept_audio;				/* Whether incoming audio can be accepted or must be dropped */
 	gboolean accept_video;				/* Whether incoming video can be accepted or must be dropped */
@@ -63,8 +85,25 @@ typedef struct janus_lua_session {
 	uint16_t pli_freq;					/* Regular PLI frequency (0=disabled) */
 	gint64 pli_latest;					/* Time of latest sent PLI (to avoid flooding) */
 	GSList *recipients;					/* Sessions that should receive media from this session */
+	janus_lua_routes *routes;			/* Routing table built out of the recipients list, used on the RTP path */
 	struct janus_lua_session *sender;	/* Other session this session is receiving media from */
 	janus_mutex recipients_mutex;		/* Mutex to lock the recipients list */
+	/* Simulcast info on the media this session sends, taken from the JSEP we see */
+	uint32_t ssrc[3];					/* Simulcast SSRCs, if this session is simulcasting */
+	janus_videocodec vcodec;			/* Negotiated video codec (needed to switch substreams) */
+	uint32_t substream_bitrate[3];		/* Bitrate of each simulcast substream, as measured in the last second */
+	uint32_t substream_bytes[3];		/* Bytes received on each simulcast substream since the last measurement */
+	gint64 substream_updated;			/* When we last measured the bitrate of the simulcast substreams */
+	/* Routing rules the script set for this session as a recipient, enforced natively */
+	janus_rtp_simulcasting_context sim_context;	/* Simulcast substream/temporal layer to receive */
+	janus_vp8_simulcast_context vp8_context;	/* Needed to rewrite VP8 payload descriptors when switching */
+	volatile gint layers_wanted;		/* Layers the script asked for (substream << 4 | temporal layer) */
+	volatile gint bitrate_cap;			/* Maximum bitrate of the video to relay (0=no cap) */
+	volatile gint rules_changed;		/* Whether the script changed the above since the RTP path last looked */
+	gint64 cap_switch;					/* When the bitrate cap last made us switch layers (RTP path only) */
+	volatile gint group;				/* Fan-out group (0-31) of the sender this session is in */
+	volatile gint muted_audio;			/* Fan-out groups of our recipients we don't relay audio to (bitmask) */
+	volatile gint muted_video;			/* Fan-out groups of our recipients we don't relay video to (bitmask) */
 	janus_recorder *arc;				/* The Janus recorder instance for audio, if enabled */
 	janus_recorder *vrc;				/* The Janus recorder instance for video, if enabled */
 	janus_recorder *drc;				/* The Janus recorder instance for data, if enabled */
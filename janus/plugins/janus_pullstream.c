@@ -122,6 +122,29 @@ rtsp_pwd = RTSP authorization password, if needed
 rtsp_failcheck = whether an error should be returned if connecting to the RTSP server fails (default=yes)
 rtspiface = network interface IP address or device name to listen on when receiving RTSP streams
 \endverbatim
+ *
+ * Besides pulling from RTMP servers, the plugin can also act as an RTMP
+ * server itself, so that encoders like OBS or FFmpeg can push to it
+ * directly: this is enabled with \c rtmp_ingest in the \c general
+ * section. Publishers are authenticated by their stream key (the stream
+ * name in the RTMP URL, e.g., rtmp://host/live/<key>), which must be
+ * listed in \c rtmp_ingest_keys, optionally with the ID the mountpoint
+ * should get (e.g., "mykey:1234,otherkey"). A live mountpoint is created
+ * as soon as the key is accepted, and is destroyed (kicking its viewers)
+ * when the publisher goes away: viewers \c watch it by ID as usual.
+ *
+ * RTMP mountpoints (pulled or pushed) also cache the video since the
+ * latest keyframe, which is replayed to new viewers with squeezed
+ * timestamps (paced at one frame per millisecond, and at most 20mbps)
+ * right before they switch to the live feed: this way they don't need
+ * to wait for the next keyframe to see something. The cache
+ * can be disabled with \c gop_cache and is bounded by \c gop_cache_max_bytes
+ * and \c gop_cache_max_duration (GOPs exceeding either are not cached);
+ * its size, and the time new viewers needed to get their first frame,
+ * are returned in \c gop_cache by the \c info request. When the right
+ * secret is provided, \c info also returns in \c aac_decoder_bytes the
+ * memory held by the AAC decoder of the mountpoint: it only includes the
+ * channels and SBR state once the stream actually uses them.
  *
  * \section streamapi pullstream API
  *
@@ -674,6 +697,7 @@ rtspiface = network interface IP address or device name to listen on when receiv
 #include "../utils.h"
 #include "../ip-utils.h"
 #include "../rtp_rtmp/rtmp_client_live_play.h"
+#include "../rtp_rtmp/rtmp_ingest_server.h"
 #include "../rtp_rtmp/flv_demuxer.h"
 #include "../rtp_rtmp/aac_decoder.h"
 #include "../rtp_rtmp/opus_encoder.h"
@@ -717,6 +741,9 @@ static void flv_demuxer_video_audio_callback(void* param, int codec, const unsig
 static void aac_decoder_callback(void* param, const unsigned char* pdata, int bytes, uint32_t timestamp);
 static void opus_encoder_callback(void* param, const unsigned char* pdata, int bytes, uint32_t timestamp);
 static void rtp_muxer_packet_callback (void* param, const void *packet, int bytes, RTP_TYPE type);
+static int janus_pullstream_rtmp_ingest_publish(void *cbdata, struct rtmp_ingest_conn_t *conn, const char *app, const char *stream);
+static int janus_pullstream_rtmp_ingest_data(void *cbdata, struct rtmp_ingest_conn_t *conn, const unsigned char *data, size_t bytes, uint32_t timestamp, int type);
+static void janus_pullstream_rtmp_ingest_close(void *cbdata, struct rtmp_ingest_conn_t *conn);
 
 
 /* Plugin setup */
@@ -911,6 +938,34 @@ static janus_callbacks *gateway = NULL;
 static GThread *handler_thread;
 static void *janus_pullstream_handler(void *data);
 
+/* Embedded RTMP server, turning publishers into live mountpoints */
+static struct rtmp_ingest_server_t *rtmp_ingest = NULL;
+static GHashTable *rtmp_ingest_keys = NULL;	/* Stream key -> mountpoint ID (0 means random) */
+/* FLV tags queued for the worker of an RTMP publisher: past this, we drop media until the next keyframe */
+#define JANUS_PULLSTREAM_RTMP_INGEST_MAX_QUEUED	(4 * 1024 * 1024)
+typedef struct janus_pullstream_rtmp_ingest_tag {
+	int type;
+	uint32_t timestamp;
+	size_t bytes;
+	unsigned char data[0];
+} janus_pullstream_rtmp_ingest_tag;
+static janus_pullstream_rtmp_ingest_tag exit_tag;
+static void janus_pullstream_rtmp_ingest_tag_free(janus_pullstream_rtmp_ingest_tag *tag) {
+	if(tag == NULL || tag == &exit_tag)
+		return;
+	g_free(tag);
+}
+static void *janus_pullstream_rtmp_ingest_thread(void *data);
+
+/* GOP cache for RTMP mountpoints, so that new viewers don't have to wait for the next keyframe */
+#define JANUS_PULLSTREAM_GOP_CACHE_BYTES		(4 * 1024 * 1024)
+#define JANUS_PULLSTREAM_GOP_CACHE_DURATION	10000	/* ms */
+#define JANUS_PULLSTREAM_GOP_REPLAY_STEP		90		/* RTP ticks between replayed frames (1ms at 90kHz) */
+#define JANUS_PULLSTREAM_GOP_REPLAY_RATE		20000	/* kbps, the most we replay a GOP at */
+static gboolean gop_cache_enabled = TRUE;
+static size_t gop_cache_max_bytes = JANUS_PULLSTREAM_GOP_CACHE_BYTES;
+static guint32 gop_cache_max_duration = JANUS_PULLSTREAM_GOP_CACHE_DURATION;
+
 static void *janus_pullstream_ondemand_thread(void *data);
 static void *janus_pullstream_filesource_thread(void *data);
 static void janus_pullstream_relay_rtp_packet(gpointer data, gpointer user_data);
@@ -953,6 +1008,8 @@ typedef struct janus_pullstream_rtp_relay_packet {
 	int substream;
 	uint32_t timestamp;
 	uint16_t seq_number;
+	gboolean starts_gop;	/* Keyframe a new viewer can start from (RTMP mountpoints) */
+	gboolean replayed;		/* Sent by a GOP replay thread, so not to be held back */
 	/* The following are only relevant for VP9 SVC*/
 	gboolean svc;
 	int spatial_layer;
@@ -968,6 +1025,27 @@ static void janus_pullstream_rtp_relay_packet_free(janus_pullstream_rtp_relay_pa
 
 }
 
+/* The already packetized video since the latest keyframe, replayed to new
+ * viewers (with squeezed timestamps) before switching them to the live feed.
+ * Protected by the mountpoint mutex, as it's filled while relaying, except
+ * for the time to first frame stats, which are updated by whoever sends it */
+typedef struct janus_pullstream_gop_cache {
+	gboolean enabled;
+	GQueue *packets;		/* janus_pullstream_rtp_relay_packet copies, oldest first */
+	size_t bytes;
+	guint32 first_ts;		/* RTP timestamp of the keyframe the cache starts from */
+	guint32 last_ts;		/* RTP timestamp of the latest frame we cached */
+	gboolean ready;			/* Whether the packets start from a keyframe, i.e., can be replayed */
+	size_t max_bytes;
+	guint32 max_duration;	/* ms */
+	/* Statistics */
+	guint32 replays;
+	janus_mutex stats_mutex;
+	gint64 ttff_last;		/* Time to first frame for the latest viewer (us) */
+	gint64 ttff_total;
+	guint32 ttff_count;
+} janus_pullstream_gop_cache;
+
 #ifdef HAVE_LIBCURL
 typedef struct janus_pullstream_buffer {
 	char *buffer;
@@ -1095,6 +1173,12 @@ typedef struct janus_pullstream_rtmp_source {
 	char *srtpcrypto;
 	srtp_t srtp_ctx;
 	srtp_policy_t srtp_policy;
+	janus_pullstream_gop_cache gop_cache;
+	/* RTMP publishers: the ingest thread queues their tags, and a worker of their own transcodes them */
+	GAsyncQueue *ingest_tags;
+	GThread *ingest_thread;
+	volatile gint ingest_queued;	/* Bytes waiting for the worker */
+	gboolean ingest_dropping;		/* Whether we're waiting for a keyframe after falling behind (ingest thread only) */
 } janus_pullstream_rtmp_source;
 
 
@@ -1217,10 +1301,26 @@ typedef struct janus_pullstream_session {
 	int spatial_layer, target_spatial_layer;
 	int temporal_layer, target_temporal_layer;
 	gboolean stopping;
+	gint64 ttff_start;		/* When we started waiting for the first frame, either replayed or live */
+	/* GOP replay: the cached frames are paced out by a thread of their own, while
+	 * the live video that arrives in the meanwhile is held back and sent after them */
+	GQueue *replay;
+	guint replay_paced;		/* How many of the queued packets come from the cache */
+	guint16 replay_last_seq;	/* Latest cached packet, live ones up to it are duplicates */
+	volatile gint replaying;
+	janus_mutex replay_mutex;
 	volatile gint hangingup;
 	volatile gint destroyed;
 	janus_refcount ref;
 } janus_pullstream_session;
+static void janus_pullstream_gop_cache_init(janus_pullstream_gop_cache *cache);
+static void janus_pullstream_gop_cache_clear(janus_pullstream_gop_cache *cache);
+static void janus_pullstream_gop_cache_add(janus_pullstream_gop_cache *cache, janus_pullstream_rtp_relay_packet *packet, gboolean keyframe);
+static guint janus_pullstream_gop_cache_snapshot(janus_pullstream_gop_cache *cache, GQueue *queue);
+static void janus_pullstream_gop_cache_ttff(janus_pullstream_gop_cache *cache, gint64 ttff);
+static void *janus_pullstream_gop_replay_thread(void *data);
+static gboolean janus_pullstream_gop_replay_hold(janus_pullstream_session *session, janus_pullstream_rtp_relay_packet *packet);
+static void janus_pullstream_gop_replay_first_frame(janus_pullstream_session *session);
 static GHashTable *sessions;
 static janus_mutex sessions_mutex = JANUS_MUTEX_INITIALIZER;
 
@@ -1240,6 +1340,9 @@ static void janus_pullstream_session_free(const janus_refcount *session_ref) {
 	/* Remove the reference to the core plugin session */
 	janus_refcount_decrease(&session->handle->ref);
 	/* This session can be destroyed, free all the resources */
+	if(session->replay != NULL)
+		g_queue_free_full(session->replay, (GDestroyNotify)janus_pullstream_rtp_relay_packet_free);
+	janus_mutex_destroy(&session->replay_mutex);
 	g_free(session);
 }
 
@@ -1459,6 +1562,17 @@ int janus_pullstream_init(janus_callbacks *callback, const char *config_path) {
 		if(!notify_events && callback->events_is_enabled()) {
 			JANUS_LOG(LOG_WARN, "Notification of events to handlers disabled for %s\n", JANUS_PULLSTREAM_NAME);
 		}
+		janus_config_item *gop = janus_config_get_item_drilldown(config, "general", "gop_cache");
+		if(gop != NULL && gop->value != NULL)
+			gop_cache_enabled = janus_is_true(gop->value);
+		janus_config_item *gop_bytes = janus_config_get_item_drilldown(config, "general", "gop_cache_max_bytes");
+		if(gop_bytes != NULL && gop_bytes->value != NULL && atoi(gop_bytes->value) > 0)
+			gop_cache_max_bytes = atoi(gop_bytes->value);
+		janus_config_item *gop_duration = janus_config_get_item_drilldown(config, "general", "gop_cache_max_duration");
+		if(gop_duration != NULL && gop_duration->value != NULL && atoi(gop_duration->value) > 0)
+			gop_cache_max_duration = atoi(gop_duration->value);
+		JANUS_LOG(LOG_VERB, "GOP cache for RTMP mountpoints %s (max %zu bytes, %"SCNu32"ms)\n",
+			gop_cache_enabled ? "enabled" : "disabled", gop_cache_max_bytes, gop_cache_max_duration);
 		/* Iterate on all mountpoints */
 		GList *cl = janus_config_get_categories(config);
 		while(cl != NULL) {
@@ -2019,6 +2133,41 @@ int janus_pullstream_init(janus_callbacks *callback, const char *config_path) {
 		janus_config_destroy(config);
 		return -1;
 	}
+	/* Should we accept RTMP publishers too? */
+	janus_config_item *ingest = config ? janus_config_get_item_drilldown(config, "general", "rtmp_ingest") : NULL;
+	if(ingest != NULL && ingest->value != NULL && janus_is_true(ingest->value)) {
+		rtmp_ingest_keys = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
+		janus_config_item *keys = janus_config_get_item_drilldown(config, "general", "rtmp_ingest_keys");
+		if(keys != NULL && keys->value != NULL) {
+			gchar **list = g_strsplit(keys->value, ",", -1);
+			int i = 0;
+			for(i=0; list[i] != NULL; i++) {
+				char *key = g_strstrip(list[i]);
+				if(*key == '\0')
+					continue;
+				guint64 mpid = 0;
+				char *colon = strchr(key, ':');
+				if(colon != NULL) {
+					*colon = '\0';
+					mpid = g_ascii_strtoull(colon+1, NULL, 10);
+				}
+				g_hash_table_insert(rtmp_ingest_keys, g_strdup(key), janus_uint64_dup(mpid));
+			}
+			g_strfreev(list);
+		}
+		if(g_hash_table_size(rtmp_ingest_keys) == 0)
+			JANUS_LOG(LOG_WARN, "No rtmp_ingest_keys configured, all RTMP publishers will be rejected\n");
+		janus_config_item *port = janus_config_get_item_drilldown(config, "general", "rtmp_ingest_port");
+		janus_config_item *ip = janus_config_get_item_drilldown(config, "general", "rtmp_ingest_ip");
+		janus_config_item *max = janus_config_get_item_drilldown(config, "general", "rtmp_ingest_max_publishers");
+		rtmp_ingest = rtmp_ingest_server_init((ip && ip->value) ? ip->value : NULL,
+			(port && port->value) ? atoi(port->value) : RTMP_INGEST_PORT,
+			(max && max->value) ? atoi(max->value) : RTMP_INGEST_MAX_CONNS,
+			janus_pullstream_rtmp_ingest_publish, janus_pullstream_rtmp_ingest_data,
+			janus_pullstream_rtmp_ingest_close, NULL);
+		if(rtmp_ingest == NULL)
+			JANUS_LOG(LOG_ERR, "Couldn't start the RTMP ingest server, RTMP publishers won't be accepted\n");
+	}
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_PULLSTREAM_NAME);
 	return 0;
 }
@@ -2034,6 +2183,16 @@ void janus_pullstream_destroy(void) {
 		handler_thread = NULL;
 	}
 
+	/* Stop accepting RTMP publishers: this gets rid of their mountpoints too */
+	if(rtmp_ingest != NULL) {
+		rtmp_ingest_server_destory(rtmp_ingest);
+		rtmp_ingest = NULL;
+	}
+	if(rtmp_ingest_keys != NULL) {
+		g_hash_table_destroy(rtmp_ingest_keys);
+		rtmp_ingest_keys = NULL;
+	}
+
 	/* Remove all mountpoints */
 	janus_mutex_lock(&mountpoints_mutex);
 	g_hash_table_destroy(mountpoints);
@@ -2101,6 +2260,8 @@ void janus_pullstream_create_session(janus_plugin_session *handle, int *error) {
 	session->mountpoint = NULL;	/* This will happen later */
 	session->started = FALSE;	/* This will happen later */
 	session->paused = FALSE;
+	session->replay = g_queue_new();
+	janus_mutex_init(&session->replay_mutex);
 	g_atomic_int_set(&session->destroyed, 0);
 	g_atomic_int_set(&session->hangingup, 0);
 	handle->plugin_handle = session;
@@ -2483,6 +2644,26 @@ struct janus_plugin_result *janus_pullstream_handle_message(janus_plugin_session
 				json_object_set_new(ml, "collision", json_integer(source->rtp_collision));
 			if (mp->helper_threads > 0)
 				json_object_set_new(ml, "threads", json_integer(mp->helper_threads));
+			janus_mutex_lock(&mp->mutex);
+			if (source->gop_cache.enabled || source->gop_cache.ttff_count > 0) {
+				janus_pullstream_gop_cache *cache = &source->gop_cache;
+				json_t *gop = json_object();
+				json_object_set_new(gop, "enabled", cache->enabled ? json_true() : json_false());
+				json_object_set_new(gop, "packets", json_integer(cache->ready ? g_queue_get_length(cache->packets) : 0));
+				json_object_set_new(gop, "bytes", json_integer(cache->ready ? cache->bytes : 0));
+				json_object_set_new(gop, "duration_ms", json_integer(cache->ready ? (guint32)(cache->last_ts - cache->first_ts) / 90 : 0));
+				json_object_set_new(gop, "replays", json_integer(cache->replays));
+				janus_mutex_lock(&cache->stats_mutex);
+				if (cache->ttff_count > 0) {
+					json_object_set_new(gop, "ttff_last_ms", json_integer(cache->ttff_last / 1000));
+					json_object_set_new(gop, "ttff_avg_ms", json_integer(cache->ttff_total / cache->ttff_count / 1000));
+				}
+				janus_mutex_unlock(&cache->stats_mutex);
+				json_object_set_new(ml, "gop_cache", gop);
+			}
+			if(admin && mp->aac_decoder != NULL)
+				json_object_set_new(ml, "aac_decoder_bytes", json_integer(aac_decoder_mem_usage(mp->aac_decoder)));
+			janus_mutex_unlock(&mp->mutex);
 			if (admin) {
 				if (mp->audio) {
 					json_object_set_new(ml, "audioport", json_integer(source->audio_port));
@@ -4063,6 +4244,44 @@ void janus_pullstream_setup_media(janus_plugin_session *handle) {
 	}
 	if (mountpoint->pullstream_source == janus_pullstream_source_rtmp) {
 		janus_pullstream_rtmp_source *source = mountpoint->source;
+		/* Replay the cached GOP, if any, so that the viewer can start right away: we only
+		 * copy it here, the replay thread paces it out without holding the mountpoint
+		 * mutex, and the live video will be held back until it's done */
+		janus_mutex_lock(&mountpoint->mutex);
+		session->started = TRUE;
+		session->ttff_start = 0;
+		if (session->video && mountpoint->video)
+			session->ttff_start = janus_get_monotonic_time();
+		if (session->video && source->gop_cache.ready && !g_queue_is_empty(source->gop_cache.packets) &&
+				!g_atomic_int_get(&session->replaying)) {
+			janus_mutex_lock(&session->replay_mutex);
+			session->replay_paced = janus_pullstream_gop_cache_snapshot(&source->gop_cache, session->replay);
+			session->replay_last_seq = ((janus_pullstream_rtp_relay_packet *)g_queue_peek_tail(session->replay))->seq_number;
+			g_atomic_int_set(&session->replaying, 1);
+			janus_mutex_unlock(&session->replay_mutex);
+			source->gop_cache.replays++;
+			janus_refcount_increase(&session->ref);
+			GError *error = NULL;
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "gop %"SCNu64, mountpoint->id);
+			GThread *thread = g_thread_try_new(tname, &janus_pullstream_gop_replay_thread, session, &error);
+			if (error != NULL) {
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the GOP replay thread...\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				/* Start from the next live keyframe instead */
+				janus_mutex_lock(&session->replay_mutex);
+				janus_pullstream_rtp_relay_packet *pkt = NULL;
+				while ((pkt = g_queue_pop_head(session->replay)) != NULL)
+					janus_pullstream_rtp_relay_packet_free(pkt);
+				g_atomic_int_set(&session->replaying, 0);
+				janus_mutex_unlock(&session->replay_mutex);
+				janus_refcount_decrease(&session->ref);
+			} else {
+				g_thread_unref(thread);
+			}
+		}
+		janus_mutex_unlock(&mountpoint->mutex);
 		if (source->keyframe.enabled) {
 			JANUS_LOG(LOG_HUGE, "Any keyframe to send?\n");
 			janus_mutex_lock(&source->keyframe.mutex);
@@ -4309,7 +4528,12 @@ static void *janus_pullstream_handler(void *data) {
 				g_snprintf(error_cause, 512, "No such mountpoint/stream %"SCNu64"", id_value);
 				goto error;*/
 			//}
-			if (id_value == 0) {
+			/* RTMP publishers already have a live mountpoint: just watch that one */
+			guint64 ingest_id = id ? json_integer_value(id) : 0;
+			janus_pullstream_mountpoint *mp = ingest_id ? g_hash_table_lookup(mountpoints, &ingest_id) : NULL;
+			if (mp != NULL)
+				id_value = ingest_id;
+			if (mp == NULL && id_value == 0) {
 				JANUS_LOG(LOG_VERB, "Missing id, will generate a random one...\n");
 				while (id_value == 0) {
 					static testid = 10;
@@ -4322,8 +4546,9 @@ static void *janus_pullstream_handler(void *data) {
 				}
 			}
 			JANUS_LOG(LOG_ERR, " id_value %"PRIu64"\n", id_value);
-			janus_pullstream_mountpoint *mp = janus_pullstream_create_rtmp_source(id_value, "rtmp://pull-meet.yflive.net",
-				id ? id : "rtmp test 1", "rtmp://127.0.0.1", TRUE, "", "", TRUE, "", "", "", FALSE);
+			if (mp == NULL)
+				mp = janus_pullstream_create_rtmp_source(id_value, "rtmp://pull-meet.yflive.net",
+					"rtmp test 1", "rtmp://127.0.0.1", TRUE, "", "", TRUE, "", "", "", FALSE);
 
 			janus_refcount_increase(&mp->ref);
 			/* A secret may be required for this action */
@@ -5262,7 +5487,7 @@ static void janus_pullstream_rtp_source_free(janus_pullstream_rtp_source *source
 	g_free(source);
 }
 
-static void janus_pullstream_rtmp_source_free(janus_pullstream_rtp_source *source) {
+static void janus_pullstream_rtmp_source_free(janus_pullstream_rtmp_source *source) {
 	if (source->audio_fd > -1) {
 		close(source->audio_fd);
 	}
@@ -5300,6 +5525,13 @@ static void janus_pullstream_rtmp_source_free(janus_pullstream_rtp_source *sourc
 		janus_pullstream_rtp_relay_packet_free((janus_pullstream_rtp_relay_packet *)source->last_msg);
 	source->last_msg = NULL;
 	janus_mutex_unlock(&source->buffermsg_mutex);
+	janus_pullstream_gop_cache_clear(&source->gop_cache);
+	if (source->gop_cache.packets != NULL)
+		g_queue_free(source->gop_cache.packets);
+	source->gop_cache.packets = NULL;
+	if (source->ingest_tags != NULL)
+		g_async_queue_unref(source->ingest_tags);
+	source->ingest_tags = NULL;
 	if (source->is_srtp) {
 		g_free(source->srtpcrypto);
 		srtp_dealloc(source->srtp_ctx);
@@ -6150,32 +6382,66 @@ static int janus_pullstream_rtsp_connect_to_server(janus_pullstream_mountpoint *
 	return 0;
 }
 
-static int janus_pullstream_rtmp_connect_to_server(janus_pullstream_mountpoint *mp) {
-	if (mp == NULL)
+/* Prepare the FLV demuxer -> (AAC decoder -> Opus encoder) -> RTP muxer chain,
+ * shared by mountpoints pulling from an RTMP server and RTMP publishers */
+static int janus_pullstream_rtmp_setup_chain(janus_pullstream_mountpoint *mp) {
+	if (mp == NULL || mp->source == NULL)
 		return -1;
-	janus_pullstream_rtp_source *source = (janus_pullstream_rtp_source *)mp->source;
-	if (source == NULL)
-		return -1;
-	static time = 0;
-	char *name = mp->name;
-	gboolean doaudio = mp->audio;
-	gboolean dovideo = mp->video;
+	/* These are freed with the mountpoint, so they must be ours */
+	g_free(mp->codecs.audio_fmtp);
+	g_free(mp->codecs.audio_rtpmap);
+	g_free(mp->codecs.video_fmtp);
+	g_free(mp->codecs.video_rtpmap);
 #ifdef USE_PCM
 	mp->codecs.audio_pt = 8;
-	mp->codecs.audio_fmtp = "8";
-	mp->codecs.audio_rtpmap = "PCMA/8000";
+	mp->codecs.audio_fmtp = g_strdup("8");
+	mp->codecs.audio_rtpmap = g_strdup("PCMA/8000");
 #else
 	mp->codecs.audio_pt = 109;
-	mp->codecs.audio_fmtp = "109";
-	mp->codecs.audio_rtpmap = "OPUS/48000/2";
+	mp->codecs.audio_fmtp = g_strdup("109");
+	mp->codecs.audio_rtpmap = g_strdup("OPUS/48000/2");
 #endif
 	mp->codecs.video_pt = 126;
-	mp->codecs.video_fmtp = "126";
-	mp->codecs.video_rtpmap = "H264/90000";
+	mp->codecs.video_fmtp = g_strdup("126");
+	mp->codecs.video_rtpmap = g_strdup("H264/90000");
 	mp->rtp_muxer = rtp_muxer_init(mp->codecs.video_pt, "h264", rtp_muxer_packet_callback, mp, mp->codecs.audio_pt, "opus", rtp_muxer_packet_callback, mp);
 	mp->opus_encoder = pcm_to_opus_encode_init(48000, 2, 0, opus_encoder_callback, mp);
 	mp->aac_decoder = aac_decoder_init(2, 48000, mp, aac_decoder_callback);
 	mp->flv_demuxer = flv_demuxer_video_audio_init(mp, flv_demuxer_video_audio_callback);
+	if (mp->rtp_muxer == NULL || mp->opus_encoder == NULL || mp->aac_decoder == NULL || mp->flv_demuxer == NULL)
+		return -1;
+	return 0;
+}
+
+/* Only safe once nothing feeds the chain anymore */
+static void janus_pullstream_rtmp_teardown_chain(janus_pullstream_mountpoint *mp) {
+	if (mp->flv_demuxer != NULL) {
+		flv_demuxer_video_audio_destory(mp->flv_demuxer);
+		mp->flv_demuxer = NULL;
+	}
+	if (mp->aac_decoder != NULL) {
+		/* The info request may be looking at it */
+		janus_mutex_lock(&mp->mutex);
+		aac_decoder_destroy(mp->aac_decoder);
+		mp->aac_decoder = NULL;
+		janus_mutex_unlock(&mp->mutex);
+	}
+	if (mp->opus_encoder != NULL) {
+		pcm_to_opus_encode_destory(mp->opus_encoder);
+		mp->opus_encoder = NULL;
+	}
+	if (mp->rtp_muxer != NULL) {
+		rtp_muxer_destory(mp->rtp_muxer);
+		mp->rtp_muxer = NULL;
+	}
+}
+
+static int janus_pullstream_rtmp_connect_to_server(janus_pullstream_mountpoint *mp) {
+	if (janus_pullstream_rtmp_setup_chain(mp) < 0) {
+		JANUS_LOG(LOG_ERR, "Couldn't prepare the media chain for mountpoint %"SCNu64"\n", mp->id);
+		janus_pullstream_rtmp_teardown_chain(mp);
+		return -1;
+	}
 	mp->rtmp_client = rtmp_client_live_play_init("192.168.1.244", "pull-meet.yflive.net/h5live", "/aaa", 1935, 2000, mp, rtmp_client_live_play_callback);
 	return 0;
 }
@@ -6483,6 +6749,7 @@ janus_pullstream_mountpoint *janus_pullstream_create_rtmp_source(uint64_t id, ch
 	pipe(live_rtsp_source->pipefd);
 	live_rtsp_source->data_iface = nil;
 	live_rtsp_source->reconnect_timer = 0;
+	janus_pullstream_gop_cache_init(&live_rtsp_source->gop_cache);
 
 	janus_mutex_init(&live_rtsp_source->rtsp_mutex);
 	live_rtsp->source = live_rtsp_source;
@@ -6520,6 +6787,246 @@ janus_pullstream_mountpoint *janus_pullstream_create_rtmp_source(uint64_t id, ch
 	return live_rtsp;
 }
 
+/* Mountpoint fed by a publisher pushing to our RTMP server: the RTMP ingest thread
+ * only queues the publisher's tags, which a worker of the mountpoint transcodes */
+static janus_pullstream_mountpoint *janus_pullstream_create_rtmp_ingest_source(uint64_t id, const char *app) {
+	janus_network_address nil;
+	janus_network_address_nullify(&nil);
+
+	janus_pullstream_mountpoint *live_rtmp = g_malloc0(sizeof(janus_pullstream_mountpoint));
+	live_rtmp->id = id;
+	live_rtmp->name = g_strdup_printf("%s-%"SCNu64, app, id);
+	live_rtmp->description = g_strdup_printf("RTMP publisher on '%s'", app);
+	live_rtmp->enabled = TRUE;
+	live_rtmp->active = TRUE;
+	live_rtmp->audio = TRUE;
+	live_rtmp->video = TRUE;
+	live_rtmp->data = FALSE;
+	live_rtmp->pullstream_type = janus_pullstream_type_live;
+	live_rtmp->pullstream_source = janus_pullstream_source_rtmp;
+	janus_pullstream_rtmp_source *live_rtmp_source = g_malloc0(sizeof(janus_pullstream_rtmp_source));
+	live_rtmp_source->rtsp = FALSE;
+	/* Don't leak the stream key in the mountpoint info */
+	live_rtmp_source->rtsp_url = g_strdup_printf("rtmp://ingest/%s", app);
+	live_rtmp_source->audio_fd = -1;
+	live_rtmp_source->audio_rtcp_fd = -1;
+	live_rtmp_source->audio_iface = nil;
+	live_rtmp_source->video_fd[0] = -1;
+	live_rtmp_source->video_fd[1] = -1;
+	live_rtmp_source->video_fd[2] = -1;
+	live_rtmp_source->video_rtcp_fd = -1;
+	live_rtmp_source->video_iface = nil;
+	live_rtmp_source->data_fd = -1;
+	live_rtmp_source->pipefd[0] = -1;
+	live_rtmp_source->pipefd[1] = -1;
+	live_rtmp_source->data_iface = nil;
+	janus_pullstream_gop_cache_init(&live_rtmp_source->gop_cache);
+	janus_mutex_init(&live_rtmp_source->rtsp_mutex);
+	live_rtmp->source = live_rtmp_source;
+	live_rtmp->source_destroy = (GDestroyNotify)janus_pullstream_rtmp_source_free;
+	live_rtmp->viewers = NULL;
+	g_atomic_int_set(&live_rtmp->destroyed, 0);
+	janus_refcount_init(&live_rtmp->ref, janus_pullstream_mountpoint_free);
+	janus_mutex_init(&live_rtmp->mutex);
+	if (janus_pullstream_rtmp_setup_chain(live_rtmp) < 0) {
+		JANUS_LOG(LOG_ERR, "Couldn't prepare the media chain for RTMP publisher on '%s'\n", app);
+		janus_pullstream_rtmp_teardown_chain(live_rtmp);
+		janus_refcount_decrease(&live_rtmp->ref);
+		return NULL;
+	}
+	live_rtmp_source->ingest_tags = g_async_queue_new_full((GDestroyNotify)janus_pullstream_rtmp_ingest_tag_free);
+	GError *error = NULL;
+	char tname[16];
+	g_snprintf(tname, sizeof(tname), "rtmp %"SCNu64, id);
+	janus_refcount_increase(&live_rtmp->ref);
+	live_rtmp_source->ingest_thread = g_thread_try_new(tname, &janus_pullstream_rtmp_ingest_thread, live_rtmp, &error);
+	if (error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTMP publisher thread...\n", error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		live_rtmp_source->ingest_thread = NULL;
+		janus_pullstream_rtmp_teardown_chain(live_rtmp);
+		janus_refcount_decrease(&live_rtmp->ref);	/* This is for the failed thread */
+		janus_refcount_decrease(&live_rtmp->ref);
+		return NULL;
+	}
+	return live_rtmp;
+}
+
+/* Transcodes what an RTMP publisher sends, so that a busy publisher doesn't hold up the others */
+static void *janus_pullstream_rtmp_ingest_thread(void *data) {
+	janus_pullstream_mountpoint *mp = (janus_pullstream_mountpoint *)data;
+	janus_pullstream_rtmp_source *source = mp->source;
+	janus_pullstream_rtmp_ingest_tag *tag = NULL;
+	while((tag = g_async_queue_pop(source->ingest_tags)) != &exit_tag) {
+		g_atomic_int_add(&source->ingest_queued, -(gint)tag->bytes);
+		/* When shutting down, what's left is just dropped */
+		if (!g_atomic_int_get(&stopping))
+			flv_demuxer_video_audio_input(mp->flv_demuxer, tag->type, tag->data, tag->bytes, tag->timestamp);
+		g_free(tag);
+	}
+	/* The publisher is gone and we were the only ones feeding the chain */
+	janus_pullstream_rtmp_teardown_chain(mp);
+	janus_refcount_decrease(&mp->ref);
+	return NULL;
+}
+
+/* Tell the worker of an RTMP publisher we're done: it drains what's queued and tears the
+ * chain down on its own, as the ingest thread serving all publishers can't wait for that */
+static void janus_pullstream_rtmp_ingest_stop(janus_pullstream_mountpoint *mp) {
+	janus_pullstream_rtmp_source *source = mp->source;
+	if (source->ingest_thread == NULL)
+		return;
+	g_async_queue_push(source->ingest_tags, &exit_tag);
+	if (g_atomic_int_get(&stopping)) {
+		/* The plugin is going away, so we do wait (nothing is transcoded anymore) */
+		g_thread_join(source->ingest_thread);
+	} else {
+		g_thread_unref(source->ingest_thread);
+	}
+	source->ingest_thread = NULL;
+}
+
+/* Metadata and sequence headers are needed by whatever comes next, so we never drop them */
+static gboolean janus_pullstream_rtmp_ingest_droppable(int type, const unsigned char *data, size_t bytes) {
+	if (type == FLV_TYPE_SCRIPT || bytes < 2)
+		return FALSE;
+	if ((type == FLV_TYPE_VIDEO && (data[0] & FLV_VIDEO_EX_HEADER)) || (type == FLV_TYPE_AUDIO && (data[0] & 0xF0) == FLV_AUDIO_EX_HEADER))
+		return (data[0] & 0x0F) != FLV_PACKET_SEQUENCE_START;
+	/* AVC/HEVC and AAC sequence headers */
+	return data[1] != 0;
+}
+
+static int janus_pullstream_rtmp_ingest_publish(void *cbdata, struct rtmp_ingest_conn_t *conn, const char *app, const char *stream) {
+	if (g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
+		return -1;
+	/* The stream name is the key, query parameters (if any) are ignored */
+	char key[256];
+	g_snprintf(key, sizeof(key), "%s", stream ? stream : "");
+	char *query = strchr(key, '?');
+	if (query != NULL)
+		*query = '\0';
+	guint64 *mpid = rtmp_ingest_keys ? g_hash_table_lookup(rtmp_ingest_keys, key) : NULL;
+	if (mpid == NULL) {
+		JANUS_LOG(LOG_WARN, "RTMP publisher %s used an unknown stream key, rejecting it\n", conn->addr);
+		return -1;
+	}
+	guint64 id = *mpid;
+	janus_mutex_lock(&mountpoints_mutex);
+	if (id == 0) {
+		JANUS_LOG(LOG_VERB, "Missing id, will generate a random one...\n");
+		while (id == 0) {
+			id = janus_random_uint64();
+			if (g_hash_table_lookup(mountpoints, &id) != NULL) {
+				/* ID already in use, try another one */
+				id = 0;
+			}
+		}
+	} else if (g_hash_table_lookup(mountpoints, &id) != NULL) {
+		janus_mutex_unlock(&mountpoints_mutex);
+		JANUS_LOG(LOG_WARN, "Mountpoint %"SCNu64" already exists (publisher already live?), rejecting RTMP publisher %s\n", id, conn->addr);
+		return -1;
+	}
+	janus_mutex_unlock(&mountpoints_mutex);
+	/* Setting up the chain takes a while: don't keep all the other requests waiting */
+	janus_pullstream_mountpoint *mp = janus_pullstream_create_rtmp_ingest_source(id, app ? app : "live");
+	if (mp == NULL)
+		return -1;
+	janus_mutex_lock(&mountpoints_mutex);
+	if (g_hash_table_lookup(mountpoints, &id) != NULL) {
+		/* A "create" took the ID in the meanwhile (publishers are only served by the ingest thread) */
+		janus_mutex_unlock(&mountpoints_mutex);
+		JANUS_LOG(LOG_WARN, "Mountpoint %"SCNu64" was just created, rejecting RTMP publisher %s\n", id, conn->addr);
+		janus_pullstream_rtmp_ingest_stop(mp);
+		janus_refcount_decrease(&mp->ref);
+		return -1;
+	}
+	/* The connection keeps its own reference, so that a "destroy" can't pull the mountpoint from under it */
+	janus_refcount_increase(&mp->ref);
+	g_hash_table_insert(mountpoints, janus_uint64_dup(mp->id), mp);
+	janus_mutex_unlock(&mountpoints_mutex);
+	conn->param = mp;
+	JANUS_LOG(LOG_INFO, "RTMP publisher %s is now live on mountpoint %"SCNu64" (%s)\n", conn->addr, mp->id, mp->name);
+	/* Also notify event handlers */
+	if (notify_events && gateway->events_is_enabled()) {
+		json_t *info = json_object();
+		json_object_set_new(info, "event", json_string("created"));
+		json_object_set_new(info, "id", json_integer(mp->id));
+		json_object_set_new(info, "source", json_string("rtmp"));
+		gateway->notify_event(&janus_pullstream_plugin, NULL, info);
+	}
+	return 0;
+}
+
+static int janus_pullstream_rtmp_ingest_data(void *cbdata, struct rtmp_ingest_conn_t *conn, const unsigned char *data, size_t bytes, uint32_t timestamp, int type) {
+	janus_pullstream_mountpoint *mp = (janus_pullstream_mountpoint *)conn->param;
+	if (mp == NULL || mp->flv_demuxer == NULL)
+		return -1;
+	janus_pullstream_rtmp_source *source = mp->source;
+	/* We're on the ingest thread, serving all publishers: just queue the tag for the worker */
+	gboolean keyframe = (type == FLV_TYPE_VIDEO && ((data[0] >> 4) & 0x07) == 1);	/* FrameType 1: keyframe */
+	if ((size_t)g_atomic_int_get(&source->ingest_queued) + bytes > JANUS_PULLSTREAM_RTMP_INGEST_MAX_QUEUED) {
+		if (!source->ingest_dropping)
+			JANUS_LOG(LOG_WARN, "Transcoding can't keep up with RTMP publisher %s, dropping media until the next keyframe\n", conn->addr);
+		source->ingest_dropping = TRUE;
+	} else if (source->ingest_dropping && keyframe) {
+		source->ingest_dropping = FALSE;
+	}
+	if (source->ingest_dropping && janus_pullstream_rtmp_ingest_droppable(type, data, bytes))
+		return 0;
+	janus_pullstream_rtmp_ingest_tag *tag = g_malloc(sizeof(janus_pullstream_rtmp_ingest_tag) + bytes);
+	tag->type = type;
+	tag->timestamp = timestamp;
+	tag->bytes = bytes;
+	memcpy(tag->data, data, bytes);
+	g_atomic_int_add(&source->ingest_queued, (gint)bytes);
+	g_async_queue_push(source->ingest_tags, tag);
+	return 0;
+}
+
+static void janus_pullstream_rtmp_ingest_close(void *cbdata, struct rtmp_ingest_conn_t *conn) {
+	janus_pullstream_mountpoint *mp = (janus_pullstream_mountpoint *)conn->param;
+	if (mp == NULL)
+		return;
+	conn->param = NULL;
+	JANUS_LOG(LOG_INFO, "RTMP publisher %s left, removing mountpoint %"SCNu64"\n", conn->addr, mp->id);
+	guint64 id = mp->id;
+	janus_mutex_lock(&mountpoints_mutex);
+	/* It may have been destroyed via the API already */
+	if (mountpoints != NULL && g_hash_table_lookup(mountpoints, &id) == mp)
+		g_hash_table_remove(mountpoints, &id);
+	janus_mutex_unlock(&mountpoints_mutex);
+	if (!g_atomic_int_get(&stopping)) {
+		/* Kick the viewers: hangup_media will take care of the rest */
+		janus_mutex_lock(&mp->mutex);
+		json_t *event = json_object();
+		json_object_set_new(event, "streaming", json_string("event"));
+		json_t *result = json_object();
+		json_object_set_new(result, "status", json_string("stopped"));
+		json_object_set_new(event, "result", result);
+		GList *viewer = mp->viewers;
+		while (viewer) {
+			janus_pullstream_session *session = (janus_pullstream_session *)viewer->data;
+			if (session != NULL) {
+				gateway->push_event(session->handle, &janus_pullstream_plugin, NULL, event, NULL);
+				gateway->close_pc(session->handle);
+			}
+			viewer = viewer->next;
+		}
+		json_decref(event);
+		janus_mutex_unlock(&mp->mutex);
+		/* Also notify event handlers */
+		if (notify_events && gateway->events_is_enabled()) {
+			json_t *info = json_object();
+			json_object_set_new(info, "event", json_string("destroyed"));
+			json_object_set_new(info, "id", json_integer(id));
+			gateway->notify_event(&janus_pullstream_plugin, NULL, info);
+		}
+	}
+	/* The worker drains what's queued and tears the chain down, we don't wait for it */
+	janus_pullstream_rtmp_ingest_stop(mp);
+	janus_refcount_decrease(&mp->ref);
+}
+
 /* FIXME Thread to send RTP packets from a file (on demand) */
 static void *janus_pullstream_ondemand_thread(void *data) {
 	JANUS_LOG(LOG_VERB, "Filesource (on demand) RTP thread starting...\n");
@@ -7470,6 +7977,9 @@ static void janus_pullstream_relay_rtp_packet(gpointer data, gpointer user_data)
 			{
 				return;
 			}
+			/* Live video waits for the GOP replay, if there's one in progress */
+			if(!packet->replayed && g_atomic_int_get(&session->replaying) && janus_pullstream_gop_replay_hold(session, packet))
+				return;
 			/* Check if there's any SVC info to take into account */
 			if(packet->svc) {
 				/* There is: check if this is a layer that can be dropped for this viewer
@@ -7699,6 +8209,8 @@ static void janus_pullstream_relay_rtp_packet(gpointer data, gpointer user_data)
 					gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
 				packet->data->timestamp = htonl(packet->timestamp);
 				packet->data->seq_number = htons(packet->seq_number);
+				if(packet->starts_gop && session->ttff_start > 0)
+					janus_pullstream_gop_replay_first_frame(session);
 			}
 		} 
 		else {
@@ -7770,6 +8282,7 @@ static void janus_pullstream_helper_rtprtcp_packet(gpointer data, gpointer user_
 	copy->substream = packet->substream;
 	copy->timestamp = packet->timestamp;
 	copy->seq_number = packet->seq_number;
+	copy->starts_gop = packet->starts_gop;
 	g_async_queue_push(helper->queued_packets, copy);
 }
 
@@ -7880,7 +8393,7 @@ void rtp_muxer_packet_callback(void* param, const void *packet, int bytes, RTP_T
 static void rtp_send(janus_pullstream_mountpoint* mountpoint, const unsigned char* pdata, int bytes, RTP_TYPE type)
 {
 	janus_pullstream_rtp_relay_packet packet;
-	janus_pullstream_rtp_source*  source = mountpoint->source;
+	janus_pullstream_rtmp_source*  source = mountpoint->source;
 	janus_rtp_header *rtp = (janus_rtp_header *)pdata;
 	uint32_t ssrc = ntohl(rtp->ssrc);
 	packet.data = pdata;
@@ -7916,10 +8429,210 @@ static void rtp_send(janus_pullstream_mountpoint* mountpoint, const unsigned cha
 		janus_rtp_header_update(packet.data, &source->context[1], TRUE, 0);
 		packet.timestamp = ntohl(packet.data->timestamp);
 		packet.seq_number = ntohs(packet.data->seq_number);
+		int plen = 0;
+		char *payload = janus_rtp_payload((char *)packet.data, bytes, &plen);
+		gboolean kf = payload ? janus_h264_is_keyframe(payload, plen) : FALSE;
+		packet.starts_gop = kf;
 		janus_mutex_lock(&mountpoint->mutex);
+		if (source->gop_cache.enabled)
+			janus_pullstream_gop_cache_add(&source->gop_cache, &packet, kf);
 		g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
 			mountpoint->helper_threads == 0 ? janus_pullstream_relay_rtp_packet : janus_pullstream_helper_rtprtcp_packet,
 			&packet);
 		janus_mutex_unlock(&mountpoint->mutex);
 	}
 }
+
+static void janus_pullstream_gop_cache_init(janus_pullstream_gop_cache *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->enabled = gop_cache_enabled;
+	cache->max_bytes = gop_cache_max_bytes;
+	cache->max_duration = gop_cache_max_duration;
+	cache->packets = g_queue_new();
+	janus_mutex_init(&cache->stats_mutex);
+}
+
+static void janus_pullstream_gop_cache_clear(janus_pullstream_gop_cache *cache)
+{
+	if (cache->packets == NULL)
+		return;
+	janus_pullstream_rtp_relay_packet *pkt = NULL;
+	while ((pkt = g_queue_pop_head(cache->packets)) != NULL)
+		janus_pullstream_rtp_relay_packet_free(pkt);
+	cache->bytes = 0;
+}
+
+/* Called with the mountpoint mutex locked, for each video packet we relay */
+static void janus_pullstream_gop_cache_add(janus_pullstream_gop_cache *cache, janus_pullstream_rtp_relay_packet *packet, gboolean keyframe)
+{
+	if (keyframe && (!cache->ready || packet->timestamp != cache->first_ts)) {
+		/* New GOP: the parameter sets may have been sent as separate packets
+		 * right before this one, so only keep what has the same timestamp */
+		GQueue *keep = g_queue_new();
+		janus_pullstream_rtp_relay_packet *pkt = NULL;
+		while ((pkt = g_queue_pop_tail(cache->packets)) != NULL && pkt->timestamp == packet->timestamp)
+			g_queue_push_head(keep, pkt);
+		if (pkt != NULL)
+			janus_pullstream_rtp_relay_packet_free(pkt);
+		janus_pullstream_gop_cache_clear(cache);
+		g_queue_free(cache->packets);
+		cache->packets = keep;
+		GList *temp = keep->head;
+		while (temp) {
+			cache->bytes += ((janus_pullstream_rtp_relay_packet *)temp->data)->length;
+			temp = temp->next;
+		}
+		cache->first_ts = packet->timestamp;
+		cache->ready = TRUE;
+	}
+	else if (cache->ready && (cache->bytes + packet->length > cache->max_bytes ||
+			(guint32)(packet->timestamp - cache->first_ts) / 90 > cache->max_duration)) {
+		JANUS_LOG(LOG_VERB, "GOP too large to cache (%zu bytes, %"SCNu32"ms), waiting for the next keyframe\n",
+			cache->bytes, (guint32)(packet->timestamp - cache->first_ts) / 90);
+		janus_pullstream_gop_cache_clear(cache);
+		cache->ready = FALSE;
+	}
+	else if (!cache->ready && packet->timestamp != cache->last_ts) {
+		/* Still waiting for a keyframe: we only keep the current frame, as
+		 * the parameter sets come in packets of their own before the IDR */
+		janus_pullstream_gop_cache_clear(cache);
+	}
+	janus_pullstream_rtp_relay_packet *pkt = g_malloc(sizeof(janus_pullstream_rtp_relay_packet));
+	*pkt = *packet;
+	pkt->data = g_malloc(packet->length);
+	memcpy(pkt->data, packet->data, packet->length);
+	pkt->is_keyframe = FALSE;
+	g_queue_push_tail(cache->packets, pkt);
+	cache->bytes += packet->length;
+	cache->last_ts = packet->timestamp;
+}
+
+/* Called with the mountpoint mutex locked: copies the cached packets, with squeezed
+ * timestamps, to the queue the replay thread paces them out from. The session switching
+ * context makes the replay and the live feed contiguous, as the latest frame keeps its
+ * original timestamp. Returns how many packets were queued */
+static guint janus_pullstream_gop_cache_snapshot(janus_pullstream_gop_cache *cache, GQueue *queue)
+{
+	/* Count the frames, so that we know how to squeeze them */
+	guint32 frames = 0, ts = 0;
+	GList *temp = cache->packets->head;
+	while (temp) {
+		janus_pullstream_rtp_relay_packet *pkt = (janus_pullstream_rtp_relay_packet *)temp->data;
+		if (temp == cache->packets->head || pkt->timestamp != ts)
+			frames++;
+		ts = pkt->timestamp;
+		temp = temp->next;
+	}
+	JANUS_LOG(LOG_HUGE, "Replaying GOP to new viewer: %u packets, %"SCNu32" frames\n", cache->packets->length, frames);
+	guint32 frame = 0;
+	temp = cache->packets->head;
+	while (temp) {
+		janus_pullstream_rtp_relay_packet *pkt = (janus_pullstream_rtp_relay_packet *)temp->data;
+		if (temp != cache->packets->head && pkt->timestamp != ts)
+			frame++;
+		ts = pkt->timestamp;
+		janus_pullstream_rtp_relay_packet *replayed = g_malloc(sizeof(janus_pullstream_rtp_relay_packet));
+		*replayed = *pkt;
+		replayed->data = g_malloc(pkt->length);
+		memcpy(replayed->data, pkt->data, pkt->length);
+		replayed->timestamp = cache->last_ts - (frames - 1 - frame) * JANUS_PULLSTREAM_GOP_REPLAY_STEP;
+		replayed->data->timestamp = htonl(replayed->timestamp);
+		replayed->starts_gop = (temp == cache->packets->head);
+		replayed->replayed = TRUE;
+		g_queue_push_tail(queue, replayed);
+		temp = temp->next;
+	}
+	return cache->packets->length;
+}
+
+static void janus_pullstream_gop_cache_ttff(janus_pullstream_gop_cache *cache, gint64 ttff)
+{
+	janus_mutex_lock(&cache->stats_mutex);
+	cache->ttff_last = ttff;
+	cache->ttff_total += ttff;
+	cache->ttff_count++;
+	janus_mutex_unlock(&cache->stats_mutex);
+}
+
+/* Sends the GOP snapshot at one frame per replay step, and no faster than
+ * JANUS_PULLSTREAM_GOP_REPLAY_RATE, and then the live video that was held
+ * back in the meanwhile, so that the viewer never gets the two interleaved */
+static void *janus_pullstream_gop_replay_thread(void *data)
+{
+	janus_pullstream_session *session = (janus_pullstream_session *)data;
+	gint64 start = janus_get_monotonic_time(), due = 0, now = 0;
+	guint paced = session->replay_paced, sent = 0;
+	guint32 frame = 0, ts = 0;
+	size_t bytes = 0;
+	janus_pullstream_rtp_relay_packet *pkt = NULL;
+	while (TRUE) {
+		janus_mutex_lock(&session->replay_mutex);
+		pkt = g_queue_pop_head(session->replay);
+		if (pkt == NULL || g_atomic_int_get(&session->hangingup) || g_atomic_int_get(&session->destroyed)) {
+			/* We're done, live video can go straight to the viewer again */
+			g_atomic_int_set(&session->replaying, 0);
+			janus_mutex_unlock(&session->replay_mutex);
+			break;
+		}
+		janus_mutex_unlock(&session->replay_mutex);
+		if (sent < paced) {
+			if (sent > 0 && pkt->timestamp != ts)
+				frame++;
+			ts = pkt->timestamp;
+			due = start + MAX((gint64)frame * JANUS_PULLSTREAM_GOP_REPLAY_STEP * 1000 / 90,
+				(gint64)bytes * 8000 / JANUS_PULLSTREAM_GOP_REPLAY_RATE);
+			now = janus_get_monotonic_time();
+			if (due > now)
+				g_usleep(due - now);
+			sent++;
+			bytes += pkt->length;
+		}
+		janus_pullstream_relay_rtp_packet(session, pkt);
+		janus_pullstream_rtp_relay_packet_free(pkt);
+	}
+	if (pkt != NULL)
+		janus_pullstream_rtp_relay_packet_free(pkt);
+	/* Nothing can be held back anymore, get rid of what's left, if anything */
+	janus_mutex_lock(&session->replay_mutex);
+	while ((pkt = g_queue_pop_head(session->replay)) != NULL)
+		janus_pullstream_rtp_relay_packet_free(pkt);
+	janus_mutex_unlock(&session->replay_mutex);
+	janus_refcount_decrease(&session->ref);
+	return NULL;
+}
+
+/* Called when relaying live video to a viewer we're replaying a GOP to: returns
+ * FALSE if the replay is over in the meanwhile, and the packet can be sent */
+static gboolean janus_pullstream_gop_replay_hold(janus_pullstream_session *session, janus_pullstream_rtp_relay_packet *packet)
+{
+	janus_mutex_lock(&session->replay_mutex);
+	if (!g_atomic_int_get(&session->replaying)) {
+		janus_mutex_unlock(&session->replay_mutex);
+		return FALSE;
+	}
+	/* With helper threads, live packets that were already cached when we took the
+	 * snapshot may still be on their way: the replay has them already */
+	if ((gint16)(packet->seq_number - session->replay_last_seq) > 0) {
+		janus_pullstream_rtp_relay_packet *held = g_malloc(sizeof(janus_pullstream_rtp_relay_packet));
+		*held = *packet;
+		held->data = g_malloc(packet->length);
+		memcpy(held->data, packet->data, packet->length);
+		held->replayed = TRUE;
+		g_queue_push_tail(session->replay, held);
+	}
+	janus_mutex_unlock(&session->replay_mutex);
+	return TRUE;
+}
+
+/* The first frame since the viewer started just went out */
+static void janus_pullstream_gop_replay_first_frame(janus_pullstream_session *session)
+{
+	gint64 ttff = janus_get_monotonic_time() - session->ttff_start;
+	session->ttff_start = 0;
+	janus_pullstream_mountpoint *mountpoint = session->mountpoint;
+	if (mountpoint == NULL || mountpoint->pullstream_source != janus_pullstream_source_rtmp)
+		return;
+	janus_pullstream_rtmp_source *source = mountpoint->source;
+	janus_pullstream_gop_cache_ttff(&source->gop_cache, ttff);
+}
@@ -269,12 +269,16 @@
 #include "../rtp.h"
 #include "../rtcp.h"
 #include "../utils.h"
-#include "../rtp_rtmp/rtp_to_opus.h"
+#include "../rtp_rtmp/opus_jitter_buffer.h"
 #include "../rtp_rtmp/rtp_to_video.h"
 #include "../rtp_rtmp/opus_to_pcm.h"
 #include "../rtp_rtmp/aac_encode.h"
 #include "../rtp_rtmp/flv_muxer_video_audio.h"
 #include "../rtp_rtmp/rtmp_publish.h"
+#include "../rtp_rtmp/http_flv_server.h"
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+#include "../rtp_rtmp/video_transcode.h"
+#endif
 
 /* Plugin information */
 #define JANUS_PUSHSTREAM_VERSION			4
@@ -306,7 +310,11 @@ void janus_pushstream_hangup_media(janus_plugin_session *handle);
 void janus_pushstream_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_pushstream_query_session(janus_plugin_session *handle);
 static void rtp_video_packet_decode_cb(void* param, const void *packet, int bytes, uint32_t timestamp, int flags);
-static void rtp_audio_packet_decode_cb(void* param, const void *packet, int bytes, uint32_t timestamp, int flags);
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+static void rtp_video_transcode_cb(void* param, const void *packet, int bytes, uint32_t timestamp, int flags);
+static void video_transcode_callback(void* param, const unsigned char* pdata, int len, uint32_t timestamp, int keyframe);
+#endif
+static void opus_jitter_frame_callback(void* param, const unsigned char* packet, int len, int samples, int fec, uint32_t timestamp);
 static void opus_to_pcm_callback(void* parame, unsigned char* pdata, int len, uint32_t timestamp);
 static void aac_encode_callback(void* parame, unsigned char* pdata, int len, uint32_t timestamp);
 static void flv_muxer_callback(void* flv, int type, const void* data, size_t bytes, uint32_t timestamp);
@@ -355,7 +363,10 @@ static struct janus_json_parameter record_parameters[] = {
 	{"name", JSON_STRING, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_NONEMPTY},
 	{"id", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"filename", JSON_STRING, 0},
-	{"update", JANUS_JSON_BOOL, 0}
+	{"update", JANUS_JSON_BOOL, 0},
+	{"preset", JSON_STRING, 0},
+	{"bitrate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"enhanced", JANUS_JSON_BOOL, 0}
 };
 static struct janus_json_parameter play_parameters[] = {
 	{"id", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
@@ -365,6 +376,22 @@ static struct janus_json_parameter play_parameters[] = {
 /* Useful stuff */
 static volatile gint initialized = 0, stopping = 0;
 static gboolean notify_events = TRUE;
+static int audio_jitter_min_delay = OPUS_JITTER_MIN_DELAY, audio_jitter_max_delay = OPUS_JITTER_MAX_DELAY;
+/* Origins that understand enhanced RTMP get Opus (and HEVC) as they are */
+static gboolean enhanced_rtmp = FALSE;
+#define JANUS_PUSHSTREAM_FOURCC_LIST	"hvc1,Opus"
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+/* VP8/VP9 publishers are transcoded to H.264, if enabled */
+static gboolean transcode_enabled = FALSE;
+static char *transcode_preset = NULL;
+static int transcode_bitrate = VIDEO_TRANSCODE_BITRATE, transcode_threads = 2;
+#endif
+/* Legacy RTMP pushes can have their audio encoded to AAC in batches by a shared pool */
+static gboolean aac_batch = FALSE;
+static int aac_batch_threads = AAC_ENCODE_BATCH_THREADS, aac_batch_window = AAC_ENCODE_BATCH_WINDOW;
+static char *aac_batch_cpus = NULL;
+/* Pushes can be watched as HTTP-FLV straight from here, with or without an RTMP origin */
+static struct http_flv_server_t *http_flv = NULL;
 static janus_callbacks *gateway = NULL;
 static GThread *handler_thread;
 static void *janus_pushstream_handler(void *data);
@@ -440,12 +467,18 @@ typedef struct janus_pushstream_session {
 	janus_vp8_simulcast_context vp8_context;
 	volatile gint hangingup;
 	volatile gint destroyed;
+	gboolean enhanced;		/* Whether we're pushing with enhanced RTMP (no AAC transcoding) */
 	struct rtp_video_context_t* video_ctx;
-	struct rtp_opus_context_t* audio_ctx;
+	struct opus_jitter_context_t* audio_jitter;
 	struct opus_to_pcm_context_t * opus_to_pcm_ctx;
 	struct aac_encode_context_t*  aac_encode_ctx;
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+	struct video_transcode_context_t* transcoder;
+#endif
 	struct flv_muxer_context_t* flv_muxer_ctx;
+	janus_mutex flv_mutex;		/* Audio and (transcoded) video may be muxed from different threads */
 	struct rtmp_client_publish_context_t* rtmp_client_ctx;
+	struct http_flv_channel_t* http_flv;	/* HTTP-FLV viewers of this push, if enabled */
 	janus_refcount ref;
 } janus_pushstream_session;
 static GHashTable *sessions;
@@ -694,6 +727,8 @@ static void janus_pushstream_message_free(janus_pushstream_message *msg) {
 #define JANUS_PUSHSTREAM_ERROR_CREATE_OPUS_DECODER_FAILED 503
 #define JANUS_PUSHSTREAM_ERROR_CREATE_RTP_VIDOE_DECODER_FAILED 504
 #define JANUS_PUSHSTREAM_ERROR_CREATE_RTP_AUDIO_DECODER_FAILED 505
+#define JANUS_PUSHSTREAM_ERROR_CREATE_VIDEO_TRANSCODER_FAILED 506
+#define JANUS_PUSHSTREAM_ERROR_CREATE_HTTP_FLV_FAILED 507
 
 
 
@@ -727,6 +762,63 @@ int janus_pushstream_init(janus_callbacks *callback, const char *config_path) {
 		if(!notify_events && callback->events_is_enabled()) {
 			JANUS_LOG(LOG_WARN, "Notification of events to handlers disabled for %s\n", JANUS_PUSHSTREAM_NAME);
 		}
+		janus_config_item *jitter = janus_config_get_item_drilldown(config, "general", "jitter_min_delay");
+		if(jitter != NULL && jitter->value != NULL)
+			audio_jitter_min_delay = atoi(jitter->value);
+		jitter = janus_config_get_item_drilldown(config, "general", "jitter_max_delay");
+		if(jitter != NULL && jitter->value != NULL)
+			audio_jitter_max_delay = atoi(jitter->value);
+		if(audio_jitter_min_delay <= 0) {
+			JANUS_LOG(LOG_WARN, "Invalid jitter_min_delay, using %d ms\n", OPUS_JITTER_MIN_DELAY);
+			audio_jitter_min_delay = OPUS_JITTER_MIN_DELAY;
+		}
+		if(audio_jitter_max_delay < audio_jitter_min_delay) {
+			JANUS_LOG(LOG_WARN, "jitter_max_delay lower than jitter_min_delay, using %d ms\n", audio_jitter_min_delay);
+			audio_jitter_max_delay = audio_jitter_min_delay;
+		}
+		JANUS_LOG(LOG_VERB, "Opus jitter buffer delay: %d-%d ms\n", audio_jitter_min_delay, audio_jitter_max_delay);
+		janus_config_item *enhanced = janus_config_get_item_drilldown(config, "general", "enhanced_rtmp");
+		if(enhanced != NULL && enhanced->value != NULL)
+			enhanced_rtmp = janus_is_true(enhanced->value);
+		janus_config_item *flv = janus_config_get_item_drilldown(config, "general", "http_flv");
+		if(flv != NULL && flv->value != NULL && janus_is_true(flv->value)) {
+			janus_config_item *ip = janus_config_get_item_drilldown(config, "general", "http_flv_ip");
+			janus_config_item *port = janus_config_get_item_drilldown(config, "general", "http_flv_port");
+			janus_config_item *viewers = janus_config_get_item_drilldown(config, "general", "http_flv_max_viewers");
+			janus_config_item *ring = janus_config_get_item_drilldown(config, "general", "http_flv_ring");
+			http_flv = http_flv_server_init((ip && ip->value) ? ip->value : NULL,
+				(port && port->value) ? atoi(port->value) : HTTP_FLV_PORT,
+				(viewers && viewers->value) ? atoi(viewers->value) : HTTP_FLV_MAX_CLIENTS,
+				(ring && ring->value) ? atoi(ring->value) : HTTP_FLV_RING_SIZE);
+			if(http_flv == NULL)
+				JANUS_LOG(LOG_ERR, "Couldn't start the HTTP-FLV server, pushes won't be available as HTTP-FLV\n");
+		}
+		janus_config_item *batch = janus_config_get_item_drilldown(config, "general", "aac_batch");
+		if(batch != NULL && batch->value != NULL)
+			aac_batch = janus_is_true(batch->value);
+		batch = janus_config_get_item_drilldown(config, "general", "aac_batch_threads");
+		if(batch != NULL && batch->value != NULL && atoi(batch->value) > 0)
+			aac_batch_threads = atoi(batch->value);
+		batch = janus_config_get_item_drilldown(config, "general", "aac_batch_cpus");
+		if(batch != NULL && batch->value != NULL)
+			aac_batch_cpus = g_strdup(batch->value);
+		batch = janus_config_get_item_drilldown(config, "general", "aac_batch_window");
+		if(batch != NULL && batch->value != NULL && atoi(batch->value) >= 0)
+			aac_batch_window = atoi(batch->value);
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+		janus_config_item *transcode = janus_config_get_item_drilldown(config, "general", "transcode");
+		if(transcode != NULL && transcode->value != NULL)
+			transcode_enabled = janus_is_true(transcode->value);
+		transcode = janus_config_get_item_drilldown(config, "general", "transcode_threads");
+		if(transcode != NULL && transcode->value != NULL && atoi(transcode->value) > 0)
+			transcode_threads = atoi(transcode->value);
+		transcode = janus_config_get_item_drilldown(config, "general", "transcode_preset");
+		if(transcode != NULL && transcode->value != NULL)
+			transcode_preset = g_strdup(transcode->value);
+		transcode = janus_config_get_item_drilldown(config, "general", "transcode_bitrate");
+		if(transcode != NULL && transcode->value != NULL && atoi(transcode->value) > 0)
+			transcode_bitrate = atoi(transcode->value);
+#endif
 		/* Done */
 		janus_config_destroy(config);
 		config = NULL;
@@ -745,6 +837,21 @@ int janus_pushstream_init(janus_callbacks *callback, const char *config_path) {
 			return -1;	/* No point going on... */
 		}
 	}
+	if(aac_batch && aac_encode_batch_init(aac_batch_threads, aac_batch_cpus, aac_batch_window) < 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't create the AAC batch encoder, encoding audio in the sessions threads\n");
+		aac_batch = FALSE;
+	}
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+	if(transcode_enabled) {
+		if(video_transcode_pool_init(transcode_threads) < 0) {
+			JANUS_LOG(LOG_WARN, "Couldn't create the transcoding pool, VP8/VP9 publishers won't be supported\n");
+			transcode_enabled = FALSE;
+		} else {
+			JANUS_LOG(LOG_INFO, "VP8/VP9 to H.264 transcoding enabled (%d threads, preset %s, up to %d kbps)\n",
+				transcode_threads, transcode_preset ? transcode_preset : VIDEO_TRANSCODE_PRESET, transcode_bitrate);
+		}
+	}
+#endif
 	recordings = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, (GDestroyNotify)janus_pushstream_recording_destroy);
 
 	sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_pushstream_session_destroy);
@@ -776,6 +883,10 @@ void janus_pushstream_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+	if(http_flv != NULL) {
+		http_flv_server_destory(http_flv);
+		http_flv = NULL;
+	}
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -785,6 +896,14 @@ void janus_pushstream_destroy(void) {
 	janus_mutex_unlock(&sessions_mutex);
 	g_async_queue_unref(messages);
 	messages = NULL;
+	aac_encode_batch_deinit();
+	g_free(aac_batch_cpus);
+	aac_batch_cpus = NULL;
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+	video_transcode_pool_deinit();
+	g_free(transcode_preset);
+	transcode_preset = NULL;
+#endif
 	g_atomic_int_set(&initialized, 0);
 	g_atomic_int_set(&stopping, 0);
 	JANUS_LOG(LOG_INFO, "%s destroyed!\n", JANUS_PUSHSTREAM_NAME);
@@ -840,6 +959,7 @@ void janus_pushstream_create_session(janus_plugin_session *handle, int *error) {
 	session->arc = NULL;
 	session->vrc = NULL;
 	janus_mutex_init(&session->rec_mutex);
+	janus_mutex_init(&session->flv_mutex);
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
 	session->video_remb_startup = 4;
@@ -881,10 +1001,17 @@ void janus_pushstream_destroy_session(janus_plugin_session *handle, int *error)
 		rtp_Video_decode_destory(session->video_ctx);
 		session->video_ctx = NULL;
 	}
-	if (session->audio_ctx!=NULL)
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+	if (session->transcoder!=NULL)
 	{
-		rtp_opus_decode_destory(session->audio_ctx);
-		session->audio_ctx = NULL;
+		video_transcode_destory(session->transcoder);
+		session->transcoder = NULL;
+	}
+#endif
+	if (session->audio_jitter!=NULL)
+	{
+		opus_jitter_destory(session->audio_jitter);
+		session->audio_jitter = NULL;
 	}
 	if (session->opus_to_pcm_ctx!=NULL)
 	{
@@ -901,6 +1028,11 @@ void janus_pushstream_destroy_session(janus_plugin_session *handle, int *error)
 		flv_muxer_video_audio_destory(session->flv_muxer_ctx);
 		session->flv_muxer_ctx = NULL;
 	}
+	if (session->http_flv !=NULL)
+	{
+		http_flv_channel_destory(session->http_flv);
+		session->http_flv = NULL;
+	}
 	if (session->rtmp_client_ctx !=NULL)
 	{
 		rtmp_client_context_destroy(session->rtmp_client_ctx);
@@ -933,6 +1065,59 @@ json_t *janus_pushstream_query_session(janus_plugin_session *handle) {
 		json_object_set_new(info, "recording_name", json_string(session->recording->name));
 		janus_refcount_decrease(&session->recording->ref);
 	}
+	if(session->audio_jitter) {
+		/* The RTP thread updates these as we read them: get a consistent copy */
+		struct opus_jitter_stats_t jb;
+		opus_jitter_get_stats(session->audio_jitter, &jb);
+		json_t *jitter = json_object();
+		json_object_set_new(jitter, "delay", json_integer(jb.delay));
+		json_object_set_new(jitter, "jitter", json_real(jb.jitter));
+		json_object_set_new(jitter, "received", json_integer(jb.received));
+		json_object_set_new(jitter, "late", json_integer(jb.late));
+		json_object_set_new(jitter, "lost", json_integer(jb.lost));
+		json_object_set_new(jitter, "fec", json_integer(jb.fec));
+		json_object_set_new(jitter, "plc", json_integer(jb.plc));
+		json_object_set_new(info, "audio_jitter", jitter);
+	}
+	if(session->aac_encode_ctx) {
+		json_t *aac = json_object();
+		json_object_set_new(aac, "aot", json_integer(session->aac_encode_ctx->aot));
+		json_object_set_new(aac, "channels", json_integer(session->aac_encode_ctx->channels));
+		json_object_set_new(aac, "bytes", json_integer(aac_encode_mem_usage(session->aac_encode_ctx)));
+		if(aac_batch)
+			json_object_set_new(aac, "dropped", json_integer(session->aac_encode_ctx->frames_dropped));
+		json_object_set_new(info, "aac_encoder", aac);
+	}
+	if(session->recorder)
+		json_object_set_new(info, "enhanced_rtmp", session->enhanced ? json_true() : json_false());
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+	if(session->transcoder) {
+		uint32_t frames_in = 0, frames_out = 0, frames_dropped = 0;
+		uint64_t cpu_time = 0;
+		video_transcode_get_stats(session->transcoder, &frames_in, &frames_out, &frames_dropped, &cpu_time);
+		json_t *transcoding = json_object();
+		json_object_set_new(transcoding, "codec", json_string(session->recording ? janus_videocodec_name(session->recording->vcodec) : "none"));
+		json_object_set_new(transcoding, "preset", json_string(session->transcoder->preset));
+		json_object_set_new(transcoding, "bitrate", json_integer(session->transcoder->bitrate));
+		json_object_set_new(transcoding, "frames_in", json_integer(frames_in));
+		json_object_set_new(transcoding, "frames_out", json_integer(frames_out));
+		json_object_set_new(transcoding, "frames_dropped", json_integer(frames_dropped));
+		json_object_set_new(transcoding, "cpu_time", json_integer(cpu_time));
+		json_object_set_new(info, "transcoding", transcoding);
+	}
+#endif
+	if(session->http_flv) {
+		uint32_t viewers = 0, resyncs = 0;
+		uint64_t tags = 0, bytes = 0;
+		http_flv_channel_get_stats(session->http_flv, &viewers, &tags, &bytes, &resyncs);
+		json_t *flv = json_object();
+		json_object_set_new(flv, "name", json_string(session->http_flv->name));
+		json_object_set_new(flv, "viewers", json_integer(viewers));
+		json_object_set_new(flv, "tags", json_integer(tags));
+		json_object_set_new(flv, "bytes", json_integer(bytes));
+		json_object_set_new(flv, "resyncs", json_integer(resyncs));
+		json_object_set_new(info, "http_flv", flv);
+	}
 	json_object_set_new(info, "hangingup", json_integer(g_atomic_int_get(&session->hangingup)));
 	json_object_set_new(info, "destroyed", json_integer(g_atomic_int_get(&session->destroyed)));
 	janus_refcount_decrease(&session->ref);
@@ -1187,9 +1372,19 @@ void janus_pushstream_incoming_rtp(janus_plugin_session *handle, int video, char
 		}
 		else
 		{
-			rtp_opus_decode_input(session->audio_ctx, buf, len);
+			opus_jitter_input(session->audio_jitter, (const unsigned char *)buf, len);
 		}
 	}
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+	if(video && session->transcoder && video_transcode_need_keyframe(session->transcoder)) {
+		/* The transcoder dropped frames, or couldn't decode them: we need a keyframe to resume */
+		JANUS_LOG(LOG_VERB, "We need a PLI for the transcoder\n");
+		char rtcpbuf[12];
+		memset(rtcpbuf, 0, 12);
+		janus_rtcp_pli((char *)&rtcpbuf, 12);
+		gateway->relay_rtcp(handle, 1, rtcpbuf, 12);
+	}
+#endif
 
 	janus_pushstream_send_rtcp_feedback(handle, video, buf, len);
 }
@@ -1381,13 +1576,14 @@ static void *janus_pushstream_handler(void *data) {
 			if(do_update && !sdp_update) {
 				JANUS_LOG(LOG_WARN, "Got a 'update' request, but no SDP update? Ignoring...\n");
 			}
+			/* With HTTP-FLV enabled, the RTMP origin is optional */
 			json_t *rtmp_pusblisher = json_object_get(root, "rtmp");
-			if (NULL == rtmp_pusblisher){
+			if (NULL == rtmp_pusblisher && NULL == http_flv){
 				goto error;
 			}
 		
-			const char *rtmp_pusblisher_text = json_string_value(rtmp_pusblisher);
-			if (NULL == strstr(rtmp_pusblisher_text, "rtmp://") || strlen(rtmp_pusblisher_text) <= strlen("rtmp://push-meet.yflive.net/*")) {
+			const char *rtmp_pusblisher_text = rtmp_pusblisher ? json_string_value(rtmp_pusblisher) : NULL;
+			if (rtmp_pusblisher && (NULL == rtmp_pusblisher_text || NULL == strstr(rtmp_pusblisher_text, "rtmp://") || strlen(rtmp_pusblisher_text) <= strlen("rtmp://push-meet.yflive.net/*"))) {
 				goto error;
 			}
 		
@@ -1443,7 +1639,7 @@ static void *janus_pushstream_handler(void *data) {
 			rec = g_malloc0(sizeof(janus_pushstream_recording));
 			rec->id = id;
 			rec->name = g_strdup(name_text);
-			rec->publisher = g_strdup(rtmp_pusblisher_text + strlen("rtmp://"));
+			rec->publisher = g_strdup(rtmp_pusblisher_text ? rtmp_pusblisher_text + strlen("rtmp://") : "http-flv");
 			rec->viewers = NULL;
 			rec->offer = NULL;
 			rec->acodec = JANUS_AUDIOCODEC_NONE;
@@ -1461,6 +1657,26 @@ static void *janus_pushstream_handler(void *data) {
 			rec->vcodec = janus_videocodec_from_name("H264");
 			rec->audio_pt = janus_sdp_get_codec_pt(offer, "opus");
 			rec->video_pt = janus_sdp_get_codec_pt(offer, "H264");
+			json_t *enhanced = json_object_get(root, "enhanced");
+			session->enhanced = enhanced ? json_is_true(enhanced) : enhanced_rtmp;
+			if(session->enhanced && janus_sdp_get_codec_pt(offer, "h265") >= 0) {
+				/* Enhanced RTMP can carry HEVC too: no need to ask for H.264 then */
+				rec->vcodec = JANUS_VIDEOCODEC_H265;
+				rec->video_pt = janus_sdp_get_codec_pt(offer, "h265");
+			}
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+			if(rec->video_pt < 0 && transcode_enabled) {
+				/* No H.264, but we can transcode VP8 or VP9 */
+				rec->vcodec = JANUS_VIDEOCODEC_VP8;
+				rec->video_pt = janus_sdp_get_codec_pt(offer, "vp8");
+				if(rec->video_pt < 0) {
+					rec->vcodec = JANUS_VIDEOCODEC_VP9;
+					rec->video_pt = janus_sdp_get_codec_pt(offer, "vp9");
+				}
+			}
+#endif
+			if(rec->video_pt < 0)
+				rec->vcodec = JANUS_VIDEOCODEC_NONE;
 			//ËµÃ÷ ÕâÁ½¸öÖµ¿ÉÒÔÍ¨¹ý janus_sdp_get_codec_rtpmapº¯Êý²éÑ¯ µ«ÊÇÀïÃæÒ²ÊÇÐ´ËÀµÄ
 			rec->audio_channel = 2;
 			rec->audio_sample = 48000;
@@ -1478,16 +1694,48 @@ static void *janus_pushstream_handler(void *data) {
 				rec->vcodec = JANUS_VIDEOCODEC_NONE;
 			video = (rec->vcodec != JANUS_VIDEOCODEC_NONE);
 			if(video) {
-				JANUS_LOG(LOG_VERB, "Video codec: %s\n", janus_videocodec_name(JANUS_VIDEOCODEC_H264));
+				JANUS_LOG(LOG_VERB, "Video codec: %s\n", janus_videocodec_name(rec->vcodec));
 			}
 
-			session->rtmp_client_ctx = rtmp_client_init("192.168.1.244", rec->publisher, rec->name, 1935, 2000);
-			JANUS_LOG(LOG_INFO, "stream publish to rtmp://192.168.1.244/%s%s\n", rec->publisher, rec->name);
-			if (session->rtmp_client_ctx ==NULL)
+			if (rtmp_pusblisher_text != NULL)
 			{
-				error_code = JANUS_PUSHSTREAM_ERROR_CREATE_RTMP_CLIETN_FAILED;
-				g_snprintf(error_cause, 512, "create rtmp client failed.");
-				goto error;
+				session->rtmp_client_ctx = rtmp_client_init("192.168.1.244", rec->publisher, rec->name, 1935, 2000,
+					session->enhanced ? JANUS_PUSHSTREAM_FOURCC_LIST : NULL);
+				JANUS_LOG(LOG_INFO, "stream publish to rtmp://192.168.1.244/%s%s\n", rec->publisher, rec->name);
+				if (session->rtmp_client_ctx ==NULL)
+				{
+					error_code = JANUS_PUSHSTREAM_ERROR_CREATE_RTMP_CLIETN_FAILED;
+					g_snprintf(error_cause, 512, "create rtmp client failed.");
+					goto error;
+				}
+				if(session->enhanced) {
+					/* The server tells us in the connect response which codecs it accepts: a legacy
+					 * server doesn't send a fourCcList at all, so we fall back to AAC and H.264 */
+					if(audio && !rtmp_client_publish_supports(session->rtmp_client_ctx, "Opus")) {
+						JANUS_LOG(LOG_WARN, "RTMP server doesn't accept Opus, transcoding to AAC\n");
+						session->enhanced = FALSE;
+					}
+					if(rec->vcodec == JANUS_VIDEOCODEC_H265 && !rtmp_client_publish_supports(session->rtmp_client_ctx, "hvc1")) {
+						JANUS_LOG(LOG_WARN, "RTMP server doesn't accept HEVC, negotiating H.264 instead\n");
+						rec->vcodec = JANUS_VIDEOCODEC_H264;
+						rec->video_pt = janus_sdp_get_codec_pt(offer, "H264");
+						if(rec->video_pt < 0)
+							rec->vcodec = JANUS_VIDEOCODEC_NONE;
+						video = (rec->vcodec != JANUS_VIDEOCODEC_NONE);
+					}
+				}
+			}
+			if (http_flv != NULL)
+			{
+				/* Viewers GET http://host:port/<whatever>/<name>.flv */
+				session->http_flv = http_flv_channel_create(http_flv, rec->name);
+				if (session->http_flv == NULL && session->rtmp_client_ctx == NULL)
+				{
+					error_code = JANUS_PUSHSTREAM_ERROR_CREATE_HTTP_FLV_FAILED;
+					g_snprintf(error_cause, 512, "create http-flv channel failed (name in use?).");
+					goto error;
+				}
+				JANUS_LOG(LOG_INFO, "stream available as HTTP-FLV %s.flv\n", rec->name);
 			}
 			session->flv_muxer_ctx = flv_muxer_video_audio_init(session, flv_muxer_callback);
 			if (session->flv_muxer_ctx == NULL)
@@ -1496,13 +1744,15 @@ static void *janus_pushstream_handler(void *data) {
 				g_snprintf(error_cause, 512, "create flv muxer failed.");
 				goto error;
 			}
+			flv_muxer_video_audio_set_enhanced(session->flv_muxer_ctx, rec->vcodec == JANUS_VIDEOCODEC_H265);
 			/* Create a date string */
 			time_t t = time(NULL);
 			struct tm *tmv = localtime(&t);
 			char outstr[200];
 			strftime(outstr, sizeof(outstr), "%Y-%m-%d %H:%M:%S", tmv);
 			rec->date = g_strdup(outstr);
-			if(audio) {
+			if(audio && !session->enhanced) {
+				/* Legacy RTMP: Opus needs to be transcoded to AAC */
 				session->aac_encode_ctx = aac_encoder_init(rec->audio_channel, rec->audio_sample, 1, 2, 1, aac_encode_callback, session);
 				if (session->aac_encode_ctx == NULL)
 				{
@@ -1517,17 +1767,21 @@ static void *janus_pushstream_handler(void *data) {
 					g_snprintf(error_cause, 512, "create aac encoder failed.");
 					goto error;
 				}
-				session->audio_ctx = rtp_opus_decode_init(rec->audio_pt, "opus", rtp_audio_packet_decode_cb, session, rec->audio_sample, rec->audio_channel);
-				if (session->audio_ctx == NULL)
+			}
+			if(audio) {
+				session->audio_jitter = opus_jitter_init(rec->audio_pt, rec->audio_sample,
+					audio_jitter_min_delay, audio_jitter_max_delay, opus_jitter_frame_callback, session);
+				if (session->audio_jitter == NULL)
 				{
 					error_code = JANUS_PUSHSTREAM_ERROR_CREATE_RTP_AUDIO_DECODER_FAILED;
 					g_snprintf(error_cause, 512, "create rtp audio decoder failed.");
 					goto error;
 				}
 			}
-			if(video) {
+			if(video && (rec->vcodec == JANUS_VIDEOCODEC_H264 || rec->vcodec == JANUS_VIDEOCODEC_H265)) {
 
-				session->video_ctx = rtp_video_decode_init(rec->video_pt, "H264", rtp_video_packet_decode_cb, session);
+				session->video_ctx = rtp_video_decode_init(rec->video_pt, rec->vcodec == JANUS_VIDEOCODEC_H265 ? "H265" : "H264",
+					rtp_video_packet_decode_cb, session);
 				if (session->video_ctx == NULL)
 				{
 					error_code = JANUS_PUSHSTREAM_ERROR_CREATE_RTP_AUDIO_DECODER_FAILED;
@@ -1535,6 +1789,32 @@ static void *janus_pushstream_handler(void *data) {
 					goto error;
 				}
 			}
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+			else if(video) {
+				/* VP8 or VP9: we depacketize full frames and hand them to the transcoder */
+				json_t *preset = json_object_get(root, "preset");
+				json_t *bitrate = json_object_get(root, "bitrate");
+				int kbps = bitrate ? json_integer_value(bitrate) : transcode_bitrate;
+				if(kbps > transcode_bitrate)
+					kbps = transcode_bitrate;
+				session->transcoder = video_transcode_init(janus_videocodec_name(rec->vcodec),
+					preset ? json_string_value(preset) : transcode_preset, kbps, video_transcode_callback, session);
+				if (session->transcoder == NULL)
+				{
+					error_code = JANUS_PUSHSTREAM_ERROR_CREATE_VIDEO_TRANSCODER_FAILED;
+					g_snprintf(error_cause, 512, "create video transcoder failed.");
+					goto error;
+				}
+				session->video_ctx = rtp_video_decode_init(rec->video_pt, rec->vcodec == JANUS_VIDEOCODEC_VP9 ? "VP9" : "VP8",
+					rtp_video_transcode_cb, session);
+				if (session->video_ctx == NULL)
+				{
+					error_code = JANUS_PUSHSTREAM_ERROR_CREATE_RTP_VIDOE_DECODER_FAILED;
+					g_snprintf(error_cause, 512, "create rtp video decoder failed.");
+					goto error;
+				}
+			}
+#endif
 			session->recorder = TRUE;
 			session->recording = rec;
 			session->sdp_version = 1;	/* This needs to be increased when it changes */
@@ -1707,39 +1987,79 @@ static void rtp_video_packet_decode_cb(void* param, const void *packet, int byte
 	memcpy(session->video_ctx->pData + session->video_ctx->used_len, packet, bytes);
 	session->video_ctx->used_len += bytes;
 
-	uint8_t nalutype = 0x1F & ptr[0];
-	if (nalutype == 7 || nalutype == 8)
+	/* H.264: 7 SPS, 8 PPS, 5 IDR; H.265: 32 VPS, 33 SPS, 34 PPS, 16-23 IRAP */
+	int hevc = session->recording->vcodec == JANUS_VIDEOCODEC_H265;
+	uint8_t nalutype = hevc ? ((ptr[0] >> 1) & 0x3F) : (0x1F & ptr[0]);
+	if (hevc ? (nalutype >= 32 && nalutype <= 34) : (nalutype == 7 || nalutype == 8))
 	{
 		//不发送  和I帧一起发送
 	}
 	else
 	{
-		if (5 == nalutype) {
+		if (hevc ? (nalutype >= 16 && nalutype <= 23) : 5 == nalutype) {
 			JANUS_LOG(LOG_VERB, "%s %s  got a keyframe \n", session->recording->publisher, session->recording->name);
 		}
-		flv_muxer_video_audio_input(session->flv_muxer_ctx, 27, timestamp, timestamp, session->video_ctx->pData, session->video_ctx->used_len);
+		janus_mutex_lock(&session->flv_mutex);
+		flv_muxer_video_audio_input(session->flv_muxer_ctx, hevc ? PSI_STREAM_H265 : 27, timestamp, timestamp, session->video_ctx->pData, session->video_ctx->used_len);
+		janus_mutex_unlock(&session->flv_mutex);
 		session->video_ctx->used_len = 0;
 	}
 
 }
 
-//param对应的是 struct rtp_opus_context_t* 因为在初始化时，session的 audio_ctx还没有被赋值，如果返回session，那么session->audio_ctx为NULL
-static void rtp_audio_packet_decode_cb(void* param, const void *packet, int bytes, uint32_t timestamp, int flags)
+#ifdef HAVE_PUSHSTREAM_TRANSCODE
+/* Whole VP8/VP9 frames out of the depacketizer: the transcoder will decode them on one of its workers */
+static void rtp_video_transcode_cb(void* param, const void *packet, int bytes, uint32_t timestamp, int flags)
 {
-	struct rtp_opus_context_t* ctx = (struct rtp_opus_context_t*)param;
-	janus_pushstream_session *session = (janus_pushstream_session *)ctx->cbdata;
-	opus_to_pcm_decode(session->opus_to_pcm_ctx, packet, bytes, timestamp, flags);
+	janus_pushstream_session *session = (janus_pushstream_session *)param;
+	video_transcode_input(session->transcoder, (const unsigned char *)packet, bytes, timestamp);
+}
 
-#ifdef TEST_DEBUG
-	fwrite(packet, bytes, 1, ctx->fp);
-#endif // TEST_DEBUG
+/* H.264 access units out of the transcoder (called on a worker thread) */
+static void video_transcode_callback(void* param, const unsigned char* pdata, int len, uint32_t timestamp, int keyframe)
+{
+	janus_pushstream_session *session = (janus_pushstream_session *)param;
+	if (keyframe) {
+		JANUS_LOG(LOG_VERB, "%s %s  transcoded a keyframe \n", session->recording->publisher, session->recording->name);
+	}
+	janus_mutex_lock(&session->flv_mutex);
+	flv_muxer_video_audio_input(session->flv_muxer_ctx, 27, timestamp, timestamp, pdata, len);
+	janus_mutex_unlock(&session->flv_mutex);
+}
+#endif
 
+/* Frames come out of the jitter buffer in order and with monotonic timestamps: lost ones are concealed */
+static void opus_jitter_frame_callback(void* param, const unsigned char* packet, int len, int samples, int fec, uint32_t timestamp)
+{
+	janus_pushstream_session *session = (janus_pushstream_session *)param;
+	if (session->enhanced)
+	{
+		/* Enhanced RTMP: Opus goes in FLV as it is, the player conceals what's missing from the timestamp gaps */
+		if (packet != NULL && !fec)
+		{
+			janus_mutex_lock(&session->flv_mutex);
+			flv_muxer_video_audio_input(session->flv_muxer_ctx, PSI_STREAM_AUDIO_OPUS, timestamp, timestamp, packet, len);
+			janus_mutex_unlock(&session->flv_mutex);
+		}
+		return;
+	}
+	if (packet != NULL && !fec)
+	{
+		opus_to_pcm_decode(session->opus_to_pcm_ctx, (unsigned char *)packet, len, timestamp, 0);
+	}
+	else
+	{
+		opus_to_pcm_conceal(session->opus_to_pcm_ctx, packet, len, samples, timestamp);
+	}
 }
 
 static void opus_to_pcm_callback(void* param, unsigned char* pdata, int len, uint32_t timestamp)
 {
 	janus_pushstream_session *session = (janus_pushstream_session *)param;
-	aac_encode_input(session->aac_encode_ctx, pdata, len, timestamp);
+	if(aac_batch)
+		aac_encode_batch_input(session->aac_encode_ctx, pdata, len, timestamp);
+	else
+		aac_encode_input(session->aac_encode_ctx, pdata, len, timestamp);
 
 #ifdef TEST_DEBUG
 	fwrite(pdata, len, 1, session->opus_to_pcm_ctx->fd);
@@ -1755,7 +2075,9 @@ static void aac_encode_callback(void* parame, unsigned char* pdata, int len, uin
 	fwrite(pdata, len, 1, session->aac_encode_ctx->fd);
 #endif 
 
+	janus_mutex_lock(&session->flv_mutex);
 	flv_muxer_video_audio_input(session->flv_muxer_ctx,15,timestamp,timestamp,pdata,len);
+	janus_mutex_unlock(&session->flv_mutex);
 }
 
 static void flv_muxer_callback(void* parame, int type, const void* pdata, size_t len, uint32_t timestamp)
@@ -1770,7 +2092,10 @@ static void flv_muxer_callback(void* parame, int type, const void* pdata, size_t
 	fwrite(pdata, len, 1, session->flv_muxer_ctx->fd);
 #endif 	
 
-	rtmp_client_input_flv(session->rtmp_client_ctx, pdata, len, type, timestamp);
+	if (session->rtmp_client_ctx != NULL)
+		rtmp_client_input_flv(session->rtmp_client_ctx, pdata, len, type, timestamp);
+	if (session->http_flv != NULL)
+		http_flv_channel_input(session->http_flv, type, pdata, len, timestamp);
 
 #ifdef TEST_DEBUG
 	be_write_uint32(tag, (uint32_t)len + 11);
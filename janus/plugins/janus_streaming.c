@@ -21,9 +21,12 @@
  *
  * For what concerns types 1. and 2., considering the proof of concept
  * nature of the implementation the only pre-recorded media files
- * that the plugins supports right now are raw mu-Law and a-Law files:
- * support is of course planned for other additional widespread formats
- * as well.
+ * that the plugins supports right now are raw mu-Law and a-Law files,
+ * and Ogg Opus files (\c .opus or \c .ogg): support is of course planned
+ * for other additional widespread formats as well. Files are mapped in
+ * memory once and shared by all the mountpoints that use them, and all
+ * the file based streams, live or on-demand, are paced by a single
+ * playout thread rather than by a thread each.
  *
  * For what concerns type 3., instead, the plugin is configured
  * to listen on a couple of ports for RTP: this means that the plugin
@@ -652,10 +655,17 @@ rtspiface = network interface IP address or device name to listen on when receiv
 #include "plugin.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
 
 #include <jansson.h>
 
@@ -896,8 +906,8 @@ static janus_callbacks *gateway = NULL;
 static GThread *handler_thread;
 static void *janus_streaming_handler(void *data);
 
-static void *janus_streaming_ondemand_thread(void *data);
-static void *janus_streaming_filesource_thread(void *data);
+static GThread *playout_thread;
+static void *janus_streaming_playout_thread(void *data);
 static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data);
 static void janus_streaming_relay_rtcp_packet(gpointer data, gpointer user_data);
 static void *janus_streaming_relay_thread(void *data);
@@ -936,6 +946,8 @@ typedef struct janus_streaming_rtp_relay_packet {
 	int substream;
 	uint32_t timestamp;
 	uint16_t seq_number;
+	/* Codec info, parsed once for all viewers (video only) */
+	janus_rtp_video_info info;
 	/* The following are only relevant for VP9 SVC*/
 	gboolean svc;
 	int spatial_layer;
@@ -1019,8 +1031,55 @@ typedef struct janus_streaming_rtp_source {
 	srtp_policy_t srtp_policy;
 } janus_streaming_rtp_source;
 
+/* Pre-recorded files we can stream: raw a-Law and mu-Law (20ms of audio
+ * every 160 bytes), or Opus in an Ogg container */
+typedef enum janus_streaming_file_format {
+	janus_streaming_file_none = 0,
+	janus_streaming_file_alaw,
+	janus_streaming_file_mulaw,
+	janus_streaming_file_opus,
+} janus_streaming_file_format;
+
+static janus_streaming_file_format janus_streaming_file_format_get(const char *filename) {
+	if(filename == NULL)
+		return janus_streaming_file_none;
+	if(strstr(filename, ".alaw"))
+		return janus_streaming_file_alaw;
+	if(strstr(filename, ".mulaw"))
+		return janus_streaming_file_mulaw;
+	if(strstr(filename, ".opus") || strstr(filename, ".ogg"))
+		return janus_streaming_file_opus;
+	return janus_streaming_file_none;
+}
+
+/* Largest Opus packet we'll stream (RFC 6716 allows 1275 bytes per frame, and up to 120ms per packet) */
+#define JANUS_STREAMING_FILE_MAX_PACKET	1500
+
+typedef struct janus_streaming_file_packet {
+	const uint8_t *data;
+	uint16_t length;
+	uint16_t samples;	/* Duration of the packet, at 48kHz */
+} janus_streaming_file_packet;
+
+/* Files are mapped in memory once, and shared by all the mountpoints (and
+ * so all the listeners) streaming them: for Opus files, we index the
+ * packets in the Ogg pages when opening them, so that the playout only
+ * has to pick them up (the few spanning more than a page are copied) */
+typedef struct janus_streaming_file {
+	char *filename;
+	janus_streaming_file_format format;
+	uint8_t *data;
+	size_t size;
+	GArray *packets;
+	GSList *copies;
+	guint refs;
+} janus_streaming_file;
+static GHashTable *files = NULL;
+static janus_mutex files_mutex = JANUS_MUTEX_INITIALIZER;
+
 typedef struct janus_streaming_file_source {
 	char *filename;
+	janus_streaming_file *file;
 } janus_streaming_file_source;
 
 /* used for audio/video fd and RTCP fd */
@@ -1130,6 +1189,7 @@ typedef struct janus_streaming_session {
 	int spatial_layer, target_spatial_layer;
 	int temporal_layer, target_temporal_layer;
 	gboolean stopping;
+	volatile gint playout;	/* Bumped at each watch of an on-demand mountpoint, so that a previous playout knows it's over */
 	volatile gint hangingup;
 	volatile gint destroyed;
 	janus_refcount ref;
@@ -1137,6 +1197,41 @@ typedef struct janus_streaming_session {
 static GHashTable *sessions;
 static janus_mutex sessions_mutex = JANUS_MUTEX_INITIALIZER;
 
+/* Playout of file sources: rather than a thread per live mountpoint and
+ * per on-demand listener, a single thread is woken up by a timer every
+ * JANUS_STREAMING_PLAYOUT_TICK microseconds, and plays whatever is due.
+ * Playouts are kept in a timing wheel, in the slot of the tick their
+ * next packet is due at (those due more than a turn of the wheel later
+ * just stay there until their turn comes) */
+#define JANUS_STREAMING_PLAYOUT_TICK	2000
+#define JANUS_STREAMING_PLAYOUT_SLOTS	256
+/* How many late packets a playout can send at once to catch up, before giving up and starting over */
+#define JANUS_STREAMING_PLAYOUT_BURST	5
+
+typedef struct janus_streaming_playout {
+	janus_streaming_mountpoint *mountpoint;
+	/* For on-demand mountpoints, the listener and the watch this is for */
+	janus_streaming_session *session;
+	gint session_playout;
+	/* Where we are in the file: the byte for raw files, the packet for Opus ones */
+	size_t position;
+	uint32_t clock;
+	uint16_t seq;
+	uint32_t ts;
+	gboolean marker;
+	/* When we started, and how much we played since then (in clock units), to avoid drifting */
+	gint64 start;
+	uint64_t played;
+	gint64 due;
+	struct janus_streaming_playout *next;
+} janus_streaming_playout;
+static janus_streaming_playout *playout_wheel[JANUS_STREAMING_PLAYOUT_SLOTS];
+static guint playout_count = 0;
+static gint64 playout_tick = 0;
+static janus_mutex playout_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_condition playout_cond;
+static int janus_streaming_playout_add(janus_streaming_mountpoint *mountpoint, janus_streaming_session *session);
+
 static void janus_streaming_session_destroy(janus_streaming_session *session) {
 	if(session && g_atomic_int_compare_and_exchange(&session->destroyed, 0, 1))
 		janus_refcount_decrease(&session->ref);
@@ -1331,6 +1426,8 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 		janus_config_print(config);
 
 	mountpoints = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, (GDestroyNotify)janus_streaming_mountpoint_destroy);
+	/* Live file sources in the configuration will be scheduled right away */
+	janus_condition_init(&playout_cond);
 
 	/* Threads will expect this to be set */
 	g_atomic_int_set(&initialized, 1);
@@ -1580,14 +1677,13 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 				gboolean is_private = priv && priv->value && janus_is_true(priv->value);
 				gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
 				gboolean dovideo = video && video->value && janus_is_true(video->value);
-				/* TODO We should support something more than raw a-Law and mu-Law streams... */
 				if(!doaudio || dovideo) {
 					JANUS_LOG(LOG_ERR, "Can't add 'live' stream '%s', we only support audio file streaming right now...\n", cat->name);
 					cl = cl->next;
 					continue;
 				}
-				if(!strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
-					JANUS_LOG(LOG_ERR, "Can't add 'live' stream '%s', unsupported format (we only support raw mu-Law and a-Law files right now)\n", cat->name);
+				if(janus_streaming_file_format_get(file->value) == janus_streaming_file_none) {
+					JANUS_LOG(LOG_ERR, "Can't add 'live' stream '%s', unsupported format (we only support raw mu-Law and a-Law, and Ogg Opus files right now)\n", cat->name);
 					cl = cl->next;
 					continue;
 				}
@@ -1645,14 +1741,13 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 				gboolean is_private = priv && priv->value && janus_is_true(priv->value);
 				gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
 				gboolean dovideo = video && video->value && janus_is_true(video->value);
-				/* TODO We should support something more than raw a-Law and mu-Law streams... */
 				if(!doaudio || dovideo) {
 					JANUS_LOG(LOG_ERR, "Can't add 'ondemand' stream '%s', we only support audio file streaming right now...\n", cat->name);
 					cl = cl->next;
 					continue;
 				}
-				if(!strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
-					JANUS_LOG(LOG_ERR, "Can't add 'ondemand' stream '%s', unsupported format (we only support raw mu-Law and a-Law files right now)\n", cat->name);
+				if(janus_streaming_file_format_get(file->value) == janus_streaming_file_none) {
+					JANUS_LOG(LOG_ERR, "Can't add 'ondemand' stream '%s', unsupported format (we only support raw mu-Law and a-Law, and Ogg Opus files right now)\n", cat->name);
 					cl = cl->next;
 					continue;
 				}
@@ -1819,6 +1914,14 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 		janus_config_destroy(config);
 		return -1;
 	}
+	/* Launch the thread that will play the file sources */
+	playout_thread = g_thread_try_new("streaming playout", janus_streaming_playout_thread, NULL, &error);
+	if(error != NULL) {
+		g_atomic_int_set(&initialized, 0);
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Streaming playout thread...\n", error->code, error->message ? error->message : "??");
+		janus_config_destroy(config);
+		return -1;
+	}
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_STREAMING_NAME);
 	return 0;
 }
@@ -1833,6 +1936,13 @@ void janus_streaming_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+	if(playout_thread != NULL) {
+		janus_mutex_lock(&playout_mutex);
+		janus_condition_signal(&playout_cond);
+		janus_mutex_unlock(&playout_mutex);
+		g_thread_join(playout_thread);
+		playout_thread = NULL;
+	}
 
 	/* Remove all mountpoints */
 	janus_mutex_lock(&mountpoints_mutex);
@@ -2468,7 +2578,6 @@ struct janus_plugin_result *janus_streaming_handle_message(janus_plugin_session
 			json_t *video = json_object_get(root, "video");
 			gboolean doaudio = audio ? json_is_true(audio) : FALSE;
 			gboolean dovideo = video ? json_is_true(video) : FALSE;
-			/* TODO We should support something more than raw a-Law and mu-Law streams... */
 			if(!doaudio || dovideo) {
 				JANUS_LOG(LOG_ERR, "Can't add 'live' stream, we only support audio file streaming right now...\n");
 				error_code = JANUS_STREAMING_ERROR_CANT_CREATE;
@@ -2476,10 +2585,10 @@ struct janus_plugin_result *janus_streaming_handle_message(janus_plugin_session
 				goto plugin_response;
 			}
 			char *filename = (char *)json_string_value(file);
-			if(!strstr(filename, ".alaw") && !strstr(filename, ".mulaw")) {
-				JANUS_LOG(LOG_ERR, "Can't add 'live' stream, unsupported format (we only support raw mu-Law and a-Law files right now)\n");
+			if(janus_streaming_file_format_get(filename) == janus_streaming_file_none) {
+				JANUS_LOG(LOG_ERR, "Can't add 'live' stream, unsupported format (we only support raw mu-Law and a-Law, and Ogg Opus files right now)\n");
 				error_code = JANUS_STREAMING_ERROR_CANT_CREATE;
-				g_snprintf(error_cause, 512, "Can't add 'live' stream, unsupported format (we only support raw mu-Law and a-Law files right now)");
+				g_snprintf(error_cause, 512, "Can't add 'live' stream, unsupported format (we only support raw mu-Law and a-Law, and Ogg Opus files right now)");
 				goto plugin_response;
 			}
 			FILE *audiofile = fopen(filename, "rb");
@@ -2533,7 +2642,6 @@ struct janus_plugin_result *janus_streaming_handle_message(janus_plugin_session
 			json_t *video = json_object_get(root, "video");
 			gboolean doaudio = audio ? json_is_true(audio) : FALSE;
 			gboolean dovideo = video ? json_is_true(video) : FALSE;
-			/* TODO We should support something more than raw a-Law and mu-Law streams... */
 			if(!doaudio || dovideo) {
 				JANUS_LOG(LOG_ERR, "Can't add 'ondemand' stream, we only support audio file streaming right now...\n");
 				error_code = JANUS_STREAMING_ERROR_CANT_CREATE;
@@ -2541,10 +2649,10 @@ struct janus_plugin_result *janus_streaming_handle_message(janus_plugin_session
 				goto plugin_response;
 			}
 			char *filename = (char *)json_string_value(file);
-			if(!strstr(filename, ".alaw") && !strstr(filename, ".mulaw")) {
-				JANUS_LOG(LOG_ERR, "Can't add 'ondemand' stream, unsupported format (we only support raw mu-Law and a-Law files right now)\n");
+			if(janus_streaming_file_format_get(filename) == janus_streaming_file_none) {
+				JANUS_LOG(LOG_ERR, "Can't add 'ondemand' stream, unsupported format (we only support raw mu-Law and a-Law, and Ogg Opus files right now)\n");
 				error_code = JANUS_STREAMING_ERROR_CANT_CREATE;
-				g_snprintf(error_cause, 512, "Can't add 'ondemand' stream, unsupported format (we only support raw mu-Law and a-Law files right now)");
+				g_snprintf(error_cause, 512, "Can't add 'ondemand' stream, unsupported format (we only support raw mu-Law and a-Law, and Ogg Opus files right now)");
 				goto plugin_response;
 			}
 			FILE *audiofile = fopen(filename, "rb");
@@ -3833,24 +3941,8 @@ static void *janus_streaming_handler(void *data) {
 				goto error;
 			}
 			if(mp->streaming_type == janus_streaming_type_on_demand) {
-				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "mp %"SCNu64, id_value);
-				janus_refcount_increase(&session->ref);
-				janus_refcount_increase(&mp->ref);
-				GThread* mpid_thread = NULL;
-				mpid_thread = g_thread_try_new(tname, &janus_streaming_ondemand_thread, session, &error);
-				if(error != NULL) {
-					session->mountpoint = NULL;
-					janus_mutex_unlock(&mp->mutex);
-					janus_refcount_decrease(&session->ref);	/* This is for the failed thread */
-					janus_refcount_decrease(&mp->ref);		/* This is for the failed thread */
-					janus_refcount_decrease(&mp->ref);
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the on-demand thread...\n", error->code, error->message ? error->message : "??");
-					error_code = JANUS_STREAMING_ERROR_UNKNOWN_ERROR;
-					g_snprintf(error_cause, 512, "Got error %d (%s) trying to launch the on-demand thread", error->code, error->message ? error->message : "??");
-					goto error;
-				}
+				/* Each listener gets its own playout of the file */
+				janus_streaming_playout_add(mp, session);
 			} else if(mp->streaming_source == janus_streaming_source_rtp) {
 				janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
 				if(source && source->simulcast) {
@@ -4500,7 +4592,206 @@ static void janus_streaming_rtp_source_free(janus_streaming_rtp_source *source)
 	g_free(source);
 }
 
+/* Duration of an Opus packet at 48kHz, out of its TOC byte (RFC 6716, 3.1) */
+static uint32_t janus_streaming_opus_samples(const uint8_t *packet, size_t length) {
+	if(length < 1)
+		return 0;
+	uint8_t config = packet[0] >> 3;
+	uint32_t frame = 0;
+	if(config < 12) {
+		/* SILK: 10, 20, 40 or 60ms */
+		frame = (config & 0x3) == 3 ? 2880 : (480 << (config & 0x3));
+	} else if(config < 16) {
+		/* Hybrid: 10 or 20ms */
+		frame = (config & 0x1) ? 960 : 480;
+	} else {
+		/* CELT: 2.5, 5, 10 or 20ms */
+		frame = 120 << (config & 0x3);
+	}
+	uint32_t frames = 1;
+	if((packet[0] & 0x3) == 1 || (packet[0] & 0x3) == 2) {
+		frames = 2;
+	} else if((packet[0] & 0x3) == 3) {
+		if(length < 2)
+			return 0;
+		frames = packet[1] & 0x3F;
+	}
+	uint32_t samples = frames * frame;
+	/* Packets can't be longer than 120ms */
+	return samples <= 5760 ? samples : 0;
+}
+
+static void janus_streaming_file_add_packet(janus_streaming_file *file, const uint8_t *data, size_t length, gboolean *head) {
+	if(!*head) {
+		/* The first packet must be the Opus header */
+		if(length < 8 || memcmp(data, "OpusHead", 8))
+			return;
+		*head = TRUE;
+		return;
+	}
+	if(length >= 8 && !memcmp(data, "OpusTags", 8))
+		return;
+	uint32_t samples = janus_streaming_opus_samples(data, length);
+	if(samples == 0 || length > JANUS_STREAMING_FILE_MAX_PACKET) {
+		JANUS_LOG(LOG_WARN, "Skipping invalid Opus packet (%zu bytes) in '%s'\n", length, file->filename);
+		return;
+	}
+	janus_streaming_file_packet packet = {
+		.data = data,
+		.length = length,
+		.samples = samples
+	};
+	g_array_append_val(file->packets, packet);
+}
+
+/* Index the Opus packets of the first logical stream in an Ogg file */
+static int janus_streaming_file_parse_ogg(janus_streaming_file *file) {
+	file->packets = g_array_new(FALSE, FALSE, sizeof(janus_streaming_file_packet));
+	const uint8_t *start = NULL;
+	size_t length = 0;
+	GByteArray *partial = NULL;
+	gboolean head = FALSE;
+	uint32_t serial = 0;
+	size_t offset = 0;
+	while(offset + 27 <= file->size) {
+		const uint8_t *page = file->data + offset;
+		if(memcmp(page, "OggS", 4) || page[4] != 0) {
+			JANUS_LOG(LOG_ERR, "Invalid Ogg page at offset %zu in '%s'\n", offset, file->filename);
+			break;
+		}
+		uint32_t page_serial = page[14] | (page[15] << 8) | (page[16] << 16) | ((uint32_t)page[17] << 24);
+		int segments = page[26], i = 0;
+		size_t header = 27 + segments, body = 0;
+		if(offset + header > file->size)
+			break;
+		for(i=0; i<segments; i++)
+			body += page[27+i];
+		if(offset + header + body > file->size) {
+			JANUS_LOG(LOG_WARN, "Truncated Ogg page at offset %zu in '%s'\n", offset, file->filename);
+			break;
+		}
+		if(offset == 0)
+			serial = page_serial;
+		if(page_serial != serial) {
+			/* Not the stream we're interested in */
+			offset += header + body;
+			continue;
+		}
+		const uint8_t *data = page + header;
+		for(i=0; i<segments; i++) {
+			uint8_t lacing = page[27+i];
+			if(partial != NULL) {
+				g_byte_array_append(partial, data, lacing);
+			} else {
+				if(start == NULL)
+					start = data;
+				length += lacing;
+			}
+			data += lacing;
+			if(lacing == 255)
+				continue;
+			/* The packet is complete */
+			if(partial != NULL) {
+				length = partial->len;
+				uint8_t *copy = g_byte_array_free(partial, FALSE);
+				file->copies = g_slist_prepend(file->copies, copy);
+				janus_streaming_file_add_packet(file, copy, length, &head);
+				partial = NULL;
+			} else {
+				janus_streaming_file_add_packet(file, start, length, &head);
+			}
+			start = NULL;
+			length = 0;
+		}
+		if(start != NULL) {
+			/* The packet continues in the next page, so it isn't contiguous in the file */
+			partial = g_byte_array_sized_new(2*length);
+			g_byte_array_append(partial, start, length);
+			start = NULL;
+			length = 0;
+		}
+		offset += header + body;
+	}
+	if(partial != NULL)
+		g_byte_array_free(partial, TRUE);
+	if(!head || file->packets->len == 0) {
+		JANUS_LOG(LOG_ERR, "No Opus stream in '%s'\n", file->filename);
+		return -1;
+	}
+	return 0;
+}
+
+static void janus_streaming_file_free(janus_streaming_file *file) {
+	if(file->data != NULL)
+		munmap(file->data, file->size);
+	if(file->packets != NULL)
+		g_array_free(file->packets, TRUE);
+	g_slist_free_full(file->copies, (GDestroyNotify)g_free);
+	g_free(file->filename);
+	g_free(file);
+}
+
+static janus_streaming_file *janus_streaming_file_open(const char *filename) {
+	janus_mutex_lock(&files_mutex);
+	if(files == NULL)
+		files = g_hash_table_new(g_str_hash, g_str_equal);
+	janus_streaming_file *file = g_hash_table_lookup(files, filename);
+	if(file != NULL) {
+		/* Already mapped for another mountpoint */
+		file->refs++;
+		janus_mutex_unlock(&files_mutex);
+		return file;
+	}
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) {
+		JANUS_LOG(LOG_ERR, "Can't open '%s': %d (%s)\n", filename, errno, strerror(errno));
+		janus_mutex_unlock(&files_mutex);
+		return NULL;
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size < 160) {
+		JANUS_LOG(LOG_ERR, "Can't stream '%s', empty or too short\n", filename);
+		close(fd);
+		janus_mutex_unlock(&files_mutex);
+		return NULL;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		JANUS_LOG(LOG_ERR, "Can't map '%s': %d (%s)\n", filename, errno, strerror(errno));
+		janus_mutex_unlock(&files_mutex);
+		return NULL;
+	}
+	file = g_malloc0(sizeof(janus_streaming_file));
+	file->filename = g_strdup(filename);
+	file->format = janus_streaming_file_format_get(filename);
+	file->data = data;
+	file->size = st.st_size;
+	file->refs = 1;
+	if(file->format == janus_streaming_file_opus && janus_streaming_file_parse_ogg(file) < 0) {
+		janus_streaming_file_free(file);
+		janus_mutex_unlock(&files_mutex);
+		return NULL;
+	}
+	g_hash_table_insert(files, file->filename, file);
+	janus_mutex_unlock(&files_mutex);
+	return file;
+}
+
+static void janus_streaming_file_close(janus_streaming_file *file) {
+	if(file == NULL)
+		return;
+	janus_mutex_lock(&files_mutex);
+	file->refs--;
+	if(file->refs == 0) {
+		g_hash_table_remove(files, file->filename);
+		janus_streaming_file_free(file);
+	}
+	janus_mutex_unlock(&files_mutex);
+}
+
 static void janus_streaming_file_source_free(janus_streaming_file_source *source) {
+	janus_streaming_file_close(source->file);
 	g_free(source->filename);
 	g_free(source);
 }
@@ -4910,9 +5201,15 @@ janus_streaming_mountpoint *janus_streaming_create_file_source(
 		janus_mutex_unlock(&mountpoints_mutex);
 		return NULL;
 	}
-	/* TODO We should support something more than raw a-Law and mu-Law streams... */
-	if(!strstr(filename, ".alaw") && !strstr(filename, ".mulaw")) {
-		JANUS_LOG(LOG_ERR, "Can't add 'file' stream, unsupported format (we only support raw mu-Law and a-Law files right now)\n");
+	janus_streaming_file_format format = janus_streaming_file_format_get(filename);
+	if(format == janus_streaming_file_none) {
+		JANUS_LOG(LOG_ERR, "Can't add 'file' stream, unsupported format (we only support raw mu-Law and a-Law, and Ogg Opus files right now)\n");
+		janus_mutex_unlock(&mountpoints_mutex);
+		return NULL;
+	}
+	janus_streaming_file *file = janus_streaming_file_open(filename);
+	if(file == NULL) {
+		JANUS_LOG(LOG_ERR, "Can't add 'file' stream, error opening '%s'\n", filename);
 		janus_mutex_unlock(&mountpoints_mutex);
 		return NULL;
 	}
@@ -4939,10 +5236,16 @@ janus_streaming_mountpoint *janus_streaming_create_file_source(
 	file_source->streaming_source = janus_streaming_source_file;
 	janus_streaming_file_source *file_source_source = g_malloc0(sizeof(janus_streaming_file_source));
 	file_source_source->filename = g_strdup(filename);
+	file_source_source->file = file;
 	file_source->source = file_source_source;
 	file_source->source_destroy = (GDestroyNotify) janus_streaming_file_source_free;
-	file_source->codecs.audio_pt = strstr(filename, ".alaw") ? 8 : 0;
-	file_source->codecs.audio_rtpmap = g_strdup(strstr(filename, ".alaw") ? "PCMA/8000" : "PCMU/8000");
+	if(format == janus_streaming_file_opus) {
+		file_source->codecs.audio_pt = 111;
+		file_source->codecs.audio_rtpmap = g_strdup("opus/48000/2");
+	} else {
+		file_source->codecs.audio_pt = (format == janus_streaming_file_alaw) ? 8 : 0;
+		file_source->codecs.audio_rtpmap = g_strdup(format == janus_streaming_file_alaw ? "PCMA/8000" : "PCMU/8000");
+	}
 	file_source->codecs.video_pt = -1;	/* FIXME We don't support video for this type yet */
 	file_source->codecs.video_rtpmap = NULL;
 	file_source->viewers = NULL;
@@ -4952,17 +5255,8 @@ janus_streaming_mountpoint *janus_streaming_create_file_source(
 	g_hash_table_insert(mountpoints, janus_uint64_dup(file_source->id), file_source);
 	janus_mutex_unlock(&mountpoints_mutex);
 	if(live) {
-		GError *error = NULL;
-		char tname[16];
-		g_snprintf(tname, sizeof(tname), "mp %"SCNu64, file_source->id);
-		janus_refcount_increase(&file_source->ref);
-		file_source->thread = g_thread_try_new(tname, &janus_streaming_filesource_thread, file_source, &error);
-		if(error != NULL) {
-			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the live filesource thread...\n", error->code, error->message ? error->message : "??");
-			janus_refcount_decrease(&file_source->ref);		/* This is for the failed thread */
-			janus_refcount_decrease(&file_source->ref);
-			return NULL;
-		}
+		/* Live file sources start playing right away, for all the viewers */
+		janus_streaming_playout_add(file_source, NULL);
 	}
 	return file_source;
 }
@@ -5547,259 +5841,257 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 }
 #endif
 
-/* FIXME Thread to send RTP packets from a file (on demand) */
-static void *janus_streaming_ondemand_thread(void *data) {
-	JANUS_LOG(LOG_VERB, "Filesource (on demand) RTP thread starting...\n");
-	janus_streaming_session *session = (janus_streaming_session *)data;
-	if(!session) {
-		JANUS_LOG(LOG_ERR, "Invalid session!\n");
-		g_thread_unref(g_thread_self());
-		return NULL;
-	}
-	janus_streaming_mountpoint *mountpoint = session->mountpoint;
-	if(!mountpoint) {
-		JANUS_LOG(LOG_ERR, "Invalid mountpoint!\n");
-		janus_refcount_decrease(&session->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
-	}
-	if(mountpoint->streaming_source != janus_streaming_source_file) {
-		JANUS_LOG(LOG_ERR, "[%s] Not an file source mountpoint!\n", mountpoint->name);
-		janus_refcount_decrease(&session->ref);
-		janus_refcount_decrease(&mountpoint->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
-	}
-	if(mountpoint->streaming_type != janus_streaming_type_on_demand) {
-		JANUS_LOG(LOG_ERR, "[%s] Not an on-demand file source mountpoint!\n", mountpoint->name);
-		janus_refcount_decrease(&session->ref);
-		janus_refcount_decrease(&mountpoint->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
-	}
+/* Playout of file sources */
+static void janus_streaming_playout_schedule(janus_streaming_playout *playout) {
+	/* Called with the playout mutex locked: never schedule in the past, or we'd wait a whole turn */
+	gint64 tick = playout->due / JANUS_STREAMING_PLAYOUT_TICK;
+	if(tick <= playout_tick)
+		tick = playout_tick + 1;
+	guint slot = tick % JANUS_STREAMING_PLAYOUT_SLOTS;
+	playout->next = playout_wheel[slot];
+	playout_wheel[slot] = playout;
+}
+
+static int janus_streaming_playout_add(janus_streaming_mountpoint *mountpoint, janus_streaming_session *session) {
 	janus_streaming_file_source *source = mountpoint->source;
-	if(source == NULL || source->filename == NULL) {
-		JANUS_LOG(LOG_ERR, "[%s] Invalid file source mountpoint!\n", mountpoint->name);
-		janus_refcount_decrease(&session->ref);
-		janus_refcount_decrease(&mountpoint->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
-	}
-	JANUS_LOG(LOG_VERB, "[%s] Opening file source %s...\n", mountpoint->name, source->filename);
-	FILE *audio = fopen(source->filename, "rb");
-	if(!audio) {
-		JANUS_LOG(LOG_ERR, "[%s] Ooops, audio file missing!\n", mountpoint->name);
-		janus_refcount_decrease(&session->ref);
-		janus_refcount_decrease(&mountpoint->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
+	janus_streaming_playout *playout = g_malloc0(sizeof(janus_streaming_playout));
+	janus_refcount_increase(&mountpoint->ref);
+	playout->mountpoint = mountpoint;
+	if(session != NULL) {
+		janus_refcount_increase(&session->ref);
+		playout->session = session;
+		playout->session_playout = g_atomic_int_add(&session->playout, 1) + 1;
 	}
+	playout->clock = (source->file->format == janus_streaming_file_opus) ? 48000 : 8000;
+	playout->seq = 1;
+	playout->ts = 0;
+	playout->marker = TRUE;
+	playout->start = janus_get_monotonic_time();
+	playout->due = playout->start;
 	JANUS_LOG(LOG_VERB, "[%s] Streaming audio file: %s\n", mountpoint->name, source->filename);
-	/* Buffer */
-	char *buf = g_malloc0(1024);
-	char *name = g_strdup(mountpoint->name ? mountpoint->name : "??");
-	/* Set up RTP */
-	gint16 seq = 1;
-	gint32 ts = 0;
+	janus_mutex_lock(&playout_mutex);
+	janus_streaming_playout_schedule(playout);
+	playout_count++;
+	janus_condition_signal(&playout_cond);
+	janus_mutex_unlock(&playout_mutex);
+	return 0;
+}
+
+static void janus_streaming_playout_free(janus_streaming_playout *playout) {
+	JANUS_LOG(LOG_VERB, "[%s] Leaving filesource (%s) playout\n", playout->mountpoint->name,
+		playout->session ? "ondemand" : "live");
+	if(playout->session != NULL)
+		janus_refcount_decrease(&playout->session->ref);
+	janus_refcount_decrease(&playout->mountpoint->ref);
+	g_free(playout);
+}
+
+/* Send what's due for a playout: returns -1 if the playout is over */
+static int janus_streaming_playout_run(janus_streaming_playout *playout, char *buf, gint64 now) {
+	janus_streaming_mountpoint *mountpoint = playout->mountpoint;
+	janus_streaming_session *session = playout->session;
+	if(g_atomic_int_get(&stopping) || g_atomic_int_get(&mountpoint->destroyed))
+		return -1;
+	if(session != NULL && (session->stopping || g_atomic_int_get(&session->destroyed) ||
+			g_atomic_int_get(&session->playout) != playout->session_playout))
+		return -1;
+	janus_streaming_file *file = ((janus_streaming_file_source *)mountpoint->source)->file;
 	janus_rtp_header *header = (janus_rtp_header *)buf;
-	header->version = 2;
-	header->markerbit = 1;
-	header->type = mountpoint->codecs.audio_pt;
-	header->seq_number = htons(seq);
-	header->timestamp = htonl(ts);
-	header->ssrc = htonl(1);	/* The gateway will fix this anyway */
-	/* Timer */
-	struct timeval now, before;
-	gettimeofday(&before, NULL);
-	now.tv_sec = before.tv_sec;
-	now.tv_usec = before.tv_usec;
-	time_t passed, d_s, d_us;
-	/* Loop */
-	gint read = 0;
 	janus_streaming_rtp_relay_packet packet;
-	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed) && !session->stopping && !g_atomic_int_get(&session->destroyed)) {
-		/* See if it's time to prepare a frame */
-		gettimeofday(&now, NULL);
-		d_s = now.tv_sec - before.tv_sec;
-		d_us = now.tv_usec - before.tv_usec;
-		if(d_us < 0) {
-			d_us += 1000000;
-			--d_s;
-		}
-		passed = d_s*1000000 + d_us;
-		if(passed < 18000) {	/* Let's wait about 18ms */
-			g_usleep(5000);
-			continue;
-		}
-		/* Update the reference time */
-		before.tv_usec += 20000;
-		if(before.tv_usec > 1000000) {
-			before.tv_sec++;
-			before.tv_usec -= 1000000;
+	int sent = 0;
+	while(playout->due <= now && sent < JANUS_STREAMING_PLAYOUT_BURST) {
+		sent++;
+		const uint8_t *payload = NULL;
+		int length = 0;
+		uint32_t duration = 0;
+		if(file->format == janus_streaming_file_opus) {
+			janus_streaming_file_packet *fp = &g_array_index(file->packets, janus_streaming_file_packet, playout->position);
+			payload = fp->data;
+			length = fp->length;
+			duration = fp->samples;
+		} else {
+			if(playout->position + 160 > file->size) {
+				/* FIXME We're doing this forever... should this be configurable? */
+				JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", mountpoint->name, file->filename);
+				playout->position = 0;
+			}
+			payload = file->data + playout->position;
+			length = 160;
+			duration = 160;
 		}
+		/* Time goes on even if we don't send anything */
+		playout->played += duration;
+		playout->due = playout->start + playout->played*G_USEC_PER_SEC/playout->clock;
 		/* If not started or paused, wait some more */
-		if(!session->started || session->paused || !mountpoint->enabled)
-			continue;
-		/* Read frame from file... */
-		read = fread(buf + RTP_HEADER_SIZE, sizeof(char), 160, audio);
-		if(feof(audio)) {
-			/* FIXME We're doing this forever... should this be configurable? */
-			JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", name, source->filename);
-			fseek(audio, 0, SEEK_SET);
+		if((session != NULL && (!session->started || session->paused)) || !mountpoint->enabled)
 			continue;
+		if(file->format == janus_streaming_file_opus) {
+			playout->position++;
+			if(playout->position == file->packets->len) {
+				/* FIXME We're doing this forever... should this be configurable? */
+				JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", mountpoint->name, file->filename);
+				playout->position = 0;
+			}
+		} else {
+			playout->position += length;
 		}
-		if(read < 0)
-			break;
 		if(mountpoint->active == FALSE)
 			mountpoint->active = TRUE;
-		//~ JANUS_LOG(LOG_VERB, " ... Preparing RTP packet (pt=%u, seq=%u, ts=%u)...\n",
-			//~ header->type, ntohs(header->seq_number), ntohl(header->timestamp));
-		//~ JANUS_LOG(LOG_VERB, " ... Read %d bytes from the audio file...\n", read);
-		/* Relay on all sessions */
+		/* Prepare the RTP packet */
+		header->version = 2;
+		header->markerbit = playout->marker;
+		header->type = mountpoint->codecs.audio_pt;
+		header->seq_number = htons(playout->seq);
+		header->timestamp = htonl(playout->ts);
+		header->ssrc = htonl(1);	/* The Janus core will fix this anyway */
+		memcpy(buf + RTP_HEADER_SIZE, payload, length);
+		memset(&packet, 0, sizeof(packet));
 		packet.data = header;
-		packet.length = RTP_HEADER_SIZE + read;
+		packet.length = RTP_HEADER_SIZE + length;
 		packet.is_rtp = TRUE;
 		packet.is_video = FALSE;
 		packet.is_keyframe = FALSE;
 		/* Backup the actual timestamp and sequence number */
-		packet.timestamp = ntohl(packet.data->timestamp);
-		packet.seq_number = ntohs(packet.data->seq_number);
+		packet.timestamp = playout->ts;
+		packet.seq_number = playout->seq;
 		/* Go! */
-		janus_streaming_relay_rtp_packet(session, &packet);
-		/* Update header */
-		seq++;
-		header->seq_number = htons(seq);
-		ts += 160;
-		header->timestamp = htonl(ts);
-		header->markerbit = 0;
-	}
-	JANUS_LOG(LOG_VERB, "[%s] Leaving filesource (ondemand) thread\n", name);
-	g_free(name);
-	g_free(buf);
-	fclose(audio);
-	janus_refcount_decrease(&session->ref);
-	janus_refcount_decrease(&mountpoint->ref);
-	g_thread_unref(g_thread_self());
-	return NULL;
-}
-
-/* FIXME Thread to send RTP packets from a file (live) */
-static void *janus_streaming_filesource_thread(void *data) {
-	JANUS_LOG(LOG_VERB, "Filesource (live) thread starting...\n");
-	janus_streaming_mountpoint *mountpoint = (janus_streaming_mountpoint *)data;
-	if(!mountpoint) {
-		JANUS_LOG(LOG_ERR, "Invalid mountpoint!\n");
-		return NULL;
-	}
-	if(mountpoint->streaming_source != janus_streaming_source_file) {
-		JANUS_LOG(LOG_ERR, "[%s] Not an file source mountpoint!\n", mountpoint->name);
-		janus_refcount_decrease(&mountpoint->ref);
-		return NULL;
-	}
-	if(mountpoint->streaming_type != janus_streaming_type_live) {
-		JANUS_LOG(LOG_ERR, "[%s] Not a live file source mountpoint!\n", mountpoint->name);
-		janus_refcount_decrease(&mountpoint->ref);
-		return NULL;
+		if(session != NULL) {
+			janus_streaming_relay_rtp_packet(session, &packet);
+		} else {
+			janus_mutex_lock_nodebug(&mountpoint->mutex);
+			g_list_foreach(mountpoint->viewers, janus_streaming_relay_rtp_packet, &packet);
+			janus_mutex_unlock_nodebug(&mountpoint->mutex);
+		}
+		playout->seq++;
+		playout->ts += duration;
+		playout->marker = FALSE;
 	}
-	janus_streaming_file_source *source = mountpoint->source;
-	if(source == NULL || source->filename == NULL) {
-		JANUS_LOG(LOG_ERR, "[%s] Invalid file source mountpoint!\n", mountpoint->name);
-		janus_refcount_decrease(&mountpoint->ref);
-		return NULL;
+	if(playout->due <= now) {
+		/* We're too late to catch up, start over from here */
+		playout->start = now;
+		playout->played = 0;
+		playout->due = now;
 	}
-	JANUS_LOG(LOG_VERB, "[%s] Opening file source %s...\n", mountpoint->name, source->filename);
-	FILE *audio = fopen(source->filename, "rb");
-	if(!audio) {
-		JANUS_LOG(LOG_ERR, "[%s] Ooops, audio file missing!\n", mountpoint->name);
-		janus_refcount_decrease(&mountpoint->ref);
-		return NULL;
+	return 0;
+}
+
+/* Thread to send RTP packets from files, for all the live and on-demand file sources */
+static void *janus_streaming_playout_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Filesource playout thread starting...\n");
+	char *buf = g_malloc0(RTP_HEADER_SIZE + JANUS_STREAMING_FILE_MAX_PACKET);
+	int timer = -1;
+#ifdef __linux__
+	timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	struct itimerspec interval = {
+		.it_interval = { 0, JANUS_STREAMING_PLAYOUT_TICK*1000 },
+		.it_value = { 0, JANUS_STREAMING_PLAYOUT_TICK*1000 }
+	};
+	if(timer > -1 && timerfd_settime(timer, 0, &interval, NULL) < 0) {
+		close(timer);
+		timer = -1;
 	}
-	JANUS_LOG(LOG_VERB, "[%s] Streaming audio file: %s\n", mountpoint->name, source->filename);
-	/* Buffer */
-	char *buf = g_malloc0(1024);
-	char *name = g_strdup(mountpoint->name ? mountpoint->name : "??");
-	/* Set up RTP */
-	gint16 seq = 1;
-	gint32 ts = 0;
-	janus_rtp_header *header = (janus_rtp_header *)buf;
-	header->version = 2;
-	header->markerbit = 1;
-	header->type = mountpoint->codecs.audio_pt;
-	header->seq_number = htons(seq);
-	header->timestamp = htonl(ts);
-	header->ssrc = htonl(1);	/* The Janus core will fix this anyway */
-	/* Timer */
-	struct timeval now, before;
-	gettimeofday(&before, NULL);
-	now.tv_sec = before.tv_sec;
-	now.tv_usec = before.tv_usec;
-	time_t passed, d_s, d_us;
-	/* Loop */
-	gint read = 0;
-	janus_streaming_rtp_relay_packet packet;
-	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed)) {
-		/* See if it's time to prepare a frame */
-		gettimeofday(&now, NULL);
-		d_s = now.tv_sec - before.tv_sec;
-		d_us = now.tv_usec - before.tv_usec;
-		if(d_us < 0) {
-			d_us += 1000000;
-			--d_s;
+	if(timer < 0)
+		JANUS_LOG(LOG_WARN, "Error creating the playout timer (%d, %s), sleeping instead\n", errno, strerror(errno));
+#endif
+	janus_streaming_playout *due = NULL, *again = NULL, *over = NULL, *playout = NULL, *next = NULL;
+	while(!g_atomic_int_get(&stopping)) {
+		janus_mutex_lock(&playout_mutex);
+		if(playout_count == 0) {
+			/* Nothing to play: wait for something to do */
+			while(playout_count == 0 && !g_atomic_int_get(&stopping)) {
+				janus_condition_wait(&playout_cond, &playout_mutex);
+			}
+			playout_tick = janus_get_monotonic_time()/JANUS_STREAMING_PLAYOUT_TICK - 1;
 		}
-		passed = d_s*1000000 + d_us;
-		if(passed < 18000) {	/* Let's wait about 18ms */
-			g_usleep(5000);
-			continue;
+		janus_mutex_unlock(&playout_mutex);
+		/* Wait for the next tick */
+		if(timer > -1) {
+			uint64_t expirations = 0;
+			if(read(timer, &expirations, sizeof(expirations)) < 0 && errno != EINTR && errno != EAGAIN) {
+				JANUS_LOG(LOG_WARN, "Error reading the playout timer (%d, %s), sleeping instead\n", errno, strerror(errno));
+				close(timer);
+				timer = -1;
+			}
+		} else {
+			g_usleep(JANUS_STREAMING_PLAYOUT_TICK);
 		}
-		/* Update the reference time */
-		before.tv_usec += 20000;
-		if(before.tv_usec > 1000000) {
-			before.tv_sec++;
-			before.tv_usec -= 1000000;
+		/* Collect the playouts that are due, for all the ticks since the last time */
+		gint64 now = janus_get_monotonic_time();
+		gint64 tick = now/JANUS_STREAMING_PLAYOUT_TICK;
+		due = NULL;
+		janus_mutex_lock(&playout_mutex);
+		if(tick - playout_tick > JANUS_STREAMING_PLAYOUT_SLOTS) {
+			/* We've been stuck for more than a turn of the wheel: just check all the slots once */
+			playout_tick = tick - JANUS_STREAMING_PLAYOUT_SLOTS;
 		}
-		/* If paused, wait some more */
-		if(!mountpoint->enabled)
-			continue;
-		/* Read frame from file... */
-		read = fread(buf + RTP_HEADER_SIZE, sizeof(char), 160, audio);
-		if(feof(audio)) {
-			/* FIXME We're doing this forever... should this be configurable? */
-			JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", name, source->filename);
-			fseek(audio, 0, SEEK_SET);
+		while(playout_tick < tick) {
+			playout_tick++;
+			guint slot = playout_tick % JANUS_STREAMING_PLAYOUT_SLOTS;
+			playout = playout_wheel[slot];
+			playout_wheel[slot] = NULL;
+			for(; playout != NULL; playout = next) {
+				next = playout->next;
+				if(playout->due/JANUS_STREAMING_PLAYOUT_TICK > playout_tick) {
+					/* Not this turn */
+					janus_streaming_playout_schedule(playout);
+				} else {
+					playout->next = due;
+					due = playout;
+				}
+			}
+		}
+		janus_mutex_unlock(&playout_mutex);
+		if(due == NULL)
 			continue;
+		/* Play them without holding the lock, as relaying may take a while */
+		again = NULL;
+		over = NULL;
+		guint ended = 0;
+		for(playout = due; playout != NULL; playout = next) {
+			next = playout->next;
+			if(janus_streaming_playout_run(playout, buf, now) < 0) {
+				playout->next = over;
+				over = playout;
+				ended++;
+			} else {
+				playout->next = again;
+				again = playout;
+			}
 		}
-		if(read < 0)
-			break;
-		if(mountpoint->active == FALSE)
-			mountpoint->active = TRUE;
-		// JANUS_LOG(LOG_VERB, " ... Preparing RTP packet (pt=%u, seq=%u, ts=%u)...\n",
-			// header->type, ntohs(header->seq_number), ntohl(header->timestamp));
-		// JANUS_LOG(LOG_VERB, " ... Read %d bytes from the audio file...\n", read);
-		/* Relay on all sessions */
-		packet.data = header;
-		packet.length = RTP_HEADER_SIZE + read;
-		packet.is_rtp = TRUE;
-		packet.is_video = FALSE;
-		packet.is_keyframe = FALSE;
-		/* Backup the actual timestamp and sequence number */
-		packet.timestamp = ntohl(packet.data->timestamp);
-		packet.seq_number = ntohs(packet.data->seq_number);
-		/* Go! */
-		janus_mutex_lock_nodebug(&mountpoint->mutex);
-		g_list_foreach(mountpoint->viewers, janus_streaming_relay_rtp_packet, &packet);
-		janus_mutex_unlock_nodebug(&mountpoint->mutex);
-		/* Update header */
-		seq++;
-		header->seq_number = htons(seq);
-		ts += 160;
-		header->timestamp = htonl(ts);
-		header->markerbit = 0;
-	}
-	JANUS_LOG(LOG_VERB, "[%s] Leaving filesource (live) thread\n", name);
-	g_free(name);
+		janus_mutex_lock(&playout_mutex);
+		for(playout = again; playout != NULL; playout = next) {
+			next = playout->next;
+			janus_streaming_playout_schedule(playout);
+		}
+		playout_count -= ended;
+		janus_mutex_unlock(&playout_mutex);
+		for(playout = over; playout != NULL; playout = next) {
+			next = playout->next;
+			janus_streaming_playout_free(playout);
+		}
+	}
+	/* We're done, get rid of all the playouts */
+	over = NULL;
+	janus_mutex_lock(&playout_mutex);
+	guint slot = 0;
+	for(slot=0; slot<JANUS_STREAMING_PLAYOUT_SLOTS; slot++) {
+		for(playout = playout_wheel[slot]; playout != NULL; playout = next) {
+			next = playout->next;
+			playout->next = over;
+			over = playout;
+		}
+		playout_wheel[slot] = NULL;
+	}
+	playout_count = 0;
+	janus_mutex_unlock(&playout_mutex);
+	for(playout = over; playout != NULL; playout = next) {
+		next = playout->next;
+		janus_streaming_playout_free(playout);
+	}
+	if(timer > -1)
+		close(timer);
 	g_free(buf);
-	fclose(audio);
-	janus_refcount_decrease(&mountpoint->ref);
+	JANUS_LOG(LOG_VERB, "Leaving filesource playout thread\n");
 	return NULL;
 }
 
@@ -6174,6 +6466,8 @@ static void *janus_streaming_relay_thread(void *data) {
 						}
 						bytes = buflen;
 					}
+					/* Parse the codec info once, rather than for each viewer */
+					janus_rtp_video_info_parse(&packet.info, mountpoint->codecs.video_codec, buffer, bytes);
 					/* First of all, let's check if this is (part of) a keyframe that we may need to save it for future reference */
 					if(source->keyframe.enabled) {
 						if(source->keyframe.temp_ts > 0 && ntohl(rtp->timestamp) != source->keyframe.temp_ts) {
@@ -6205,30 +6499,14 @@ static void *janus_streaming_relay_thread(void *data) {
 							source->keyframe.temp_keyframe = g_list_append(source->keyframe.temp_keyframe, pkt);
 							janus_mutex_unlock(&source->keyframe.mutex);
 						} else {
-							gboolean kf = FALSE;
 							/* Parse RTP header first */
 							janus_rtp_header *header = (janus_rtp_header *)buffer;
 							guint32 timestamp = ntohl(header->timestamp);
 							guint16 seq = ntohs(header->seq_number);
 							JANUS_LOG(LOG_HUGE, "Checking if packet (size=%d, seq=%"SCNu16", ts=%"SCNu32") is a key frame...\n",
 								bytes, seq, timestamp);
-							int plen = 0;
-							char *payload = janus_rtp_payload(buffer, bytes, &plen);
-							if(payload) {
-								switch(mountpoint->codecs.video_codec) {
-									case JANUS_VIDEOCODEC_VP8:
-										kf = janus_vp8_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_VP9:
-										kf = janus_vp9_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_H264:
-										kf = janus_h264_is_keyframe(payload, plen);
-										break;
-									default:
-										break;
-								}
-								if(kf) {
+							if(packet.info.flags & JANUS_RTP_VIDEO_INFO_PARSED) {
+								if(packet.info.flags & JANUS_RTP_VIDEO_INFO_KEYFRAME) {
 									/* New keyframe, start saving it */
 									source->keyframe.temp_ts = ntohl(rtp->timestamp);
 									JANUS_LOG(LOG_HUGE, "[%s] New keyframe received! ts=%"SCNu32"\n", name, source->keyframe.temp_ts);
@@ -6567,7 +6845,7 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 					packet->data->markerbit = 1;
 				}
 				if(gateway != NULL)
-					gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+					gateway->relay_rtp_info(session->handle, packet->is_video, (char *)packet->data, packet->length, &packet->info);
 				if(override_mark_bit && !has_marker_bit) {
 					packet->data->markerbit = 0;
 				}
@@ -6585,7 +6863,7 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 					/* There has been a change: let's wait for a keyframe on the target */
 					int step = (session->substream < 1 && session->substream_target == 2);
 					if(packet->substream == session->substream_target || (step && packet->substream == step)) {
-						if(janus_vp8_is_keyframe(payload, plen)) {
+						if(packet->info.flags & JANUS_RTP_VIDEO_INFO_KEYFRAME) {
 							JANUS_LOG(LOG_VERB, "Received keyframe on substream %d, switching (was %d)\n",
 								packet->substream, session->substream);
 							session->substream = packet->substream;
@@ -6639,13 +6917,8 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 				char vp8pd[6];
 				if(packet->codec == JANUS_VIDEOCODEC_VP8) {
 					/* Check if there's any temporal scalability to take into account */
-					uint16_t picid = 0;
-					uint8_t tlzi = 0;
-					uint8_t tid = 0;
-					uint8_t ybit = 0;
-					uint8_t keyidx = 0;
-					if(janus_vp8_parse_descriptor(payload, plen, &picid, &tlzi, &tid, &ybit, &keyidx) == 0) {
-						//~ JANUS_LOG(LOG_WARN, "%"SCNu16", %u, %u, %u, %u\n", picid, tlzi, tid, ybit, keyidx);
+					if(packet->info.flags & JANUS_RTP_VIDEO_INFO_VP8) {
+						uint8_t tid = packet->info.tid;
 						if(session->templayer != session->templayer_target) {
 							/* FIXME We should be smarter in deciding when to switch */
 							session->templayer = session->templayer_target;
@@ -6669,11 +6942,12 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 					/* If we got here, update the RTP header and send the packet */
 					janus_rtp_header_update(packet->data, &session->context, TRUE, 0);
 					memcpy(vp8pd, payload, sizeof(vp8pd));
-					janus_vp8_simulcast_descriptor_update(payload, plen, &session->simulcast_context, switched);
+					janus_vp8_simulcast_descriptor_update_ids(payload, plen, &session->simulcast_context, switched,
+						packet->info.picid, packet->info.tl0picidx);
 				}
 				/* Send the packet */
 				if(gateway != NULL)
-					gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+					gateway->relay_rtp_info(session->handle, packet->is_video, (char *)packet->data, packet->length, &packet->info);
 				/* Restore the timestamp and sequence number to what the video source set them to */
 				packet->data->timestamp = htonl(packet->timestamp);
 				packet->data->seq_number = htons(packet->seq_number);
@@ -6685,7 +6959,7 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 				/* Fix sequence number and timestamp (switching may be involved) */
 				janus_rtp_header_update(packet->data, &session->context, TRUE, 0);
 				if(gateway != NULL)
-					gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+					gateway->relay_rtp_info(session->handle, packet->is_video, (char *)packet->data, packet->length, &packet->info);
 				/* Restore the timestamp and sequence number to what the video source set them to */
 				packet->data->timestamp = htonl(packet->timestamp);
 				packet->data->seq_number = htons(packet->seq_number);
@@ -6760,6 +7034,7 @@ static void janus_streaming_helper_rtprtcp_packet(gpointer data, gpointer user_d
 	copy->substream = packet->substream;
 	copy->timestamp = packet->timestamp;
 	copy->seq_number = packet->seq_number;
+	copy->info = packet->info;
 	g_async_queue_push(helper->queued_packets, copy);
 }
 
@@ -75,7 +75,10 @@ videoorient_ext = yes|no (whether the video-orientation RTP extension must be
 playoutdelay_ext = yes|no (whether the playout-delay RTP extension must be
 	negotiated/used or not for new publishers, default=yes)
 transport_wide_cc_ext = yes|no (whether the transport wide CC RTP extension must be
-	negotiated/used or not for new publishers, default=no)
+	negotiated/used or not for new publishers, default=no; when enabled, it's
+	offered to subscribers too, so that the core can estimate the bandwidth
+	available to them and the plugin can automatically pick the simulcast
+	substream and temporal layer that fit)
 record = true|false (whether this room should be recorded, default=false)
 rec_dir = <folder where recordings should be stored, when enabled>
 notify_joining = true|false (optional, whether to notify all participants when a new
@@ -937,6 +940,10 @@ notify_joining = true|false (optional, whether to notify all participants when a
  * when the mountpoint is configured with video simulcasting support, and
  * as such the viewer is interested in receiving a specific substream
  * or temporal layer, rather than any other of the available ones.
+ * When the room has \c transport_wide_cc_ext enabled and the subscriber
+ * negotiated it, these act as an upper bound instead: the plugin will
+ * automatically relay the highest substream and temporal layer that fit
+ * the bandwidth the core estimates to be available to the subscriber.
  * The \c spatial_layer and \c temporal_layer have exactly the same meaning,
  * but within the context of VP9-SVC publishers, and will have no effect
  * on subscriptions associated to regular publishers.
@@ -1046,6 +1053,7 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len);
 void janus_videoroom_incoming_data(janus_plugin_session *handle, char *buf, int len);
 void janus_videoroom_slow_link(janus_plugin_session *handle, int uplink, int video);
+void janus_videoroom_incoming_bwe(janus_plugin_session *handle, uint32_t estimate);
 void janus_videoroom_hangup_media(janus_plugin_session *handle);
 void janus_videoroom_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_videoroom_query_session(janus_plugin_session *handle);
@@ -1074,6 +1082,7 @@ static janus_plugin janus_videoroom_plugin =
 		.hangup_media = janus_videoroom_hangup_media,
 		.destroy_session = janus_videoroom_destroy_session,
 		.query_session = janus_videoroom_query_session,
+		.incoming_bwe = janus_videoroom_incoming_bwe,
 	);
 
 /* Plugin creator */
@@ -1397,6 +1406,9 @@ typedef struct janus_videoroom_publisher {
 	guint32 audio_ssrc;		/* Audio SSRC of this publisher */
 	guint32 video_ssrc;		/* Video SSRC of this publisher */
 	uint32_t ssrc[3];		/* Only needed in case VP8 (or H.264) simulcasting is involved */
+	uint32_t substream_bitrate[3];	/* Bitrate of each simulcast substream, as measured in the last second */
+	uint32_t substream_bytes[3];	/* Bytes received on each simulcast substream since the last measurement */
+	gint64 substream_updated;		/* When we last measured the bitrate of the simulcast substreams */
 	int rtpmapid_extmap_id;	/* Only needed for debugging in case Firefox's RID-based simulcasting is involved */
 	char *rid[3];			/* Only needed for debugging in case Firefox's RID-based simulcasting is involved */
 	guint8 audio_level_extmap_id;		/* Audio level extmap ID */
@@ -1451,6 +1463,10 @@ typedef struct janus_videoroom_subscriber {
 	janus_rtp_switching_context context;	/* Needed in case there are publisher switches on this subscriber */
 	janus_rtp_simulcasting_context sim_context;
 	janus_vp8_simulcast_context vp8_context;
+	int substream_max, templayer_max;	/* Highest simulcast substream/temporal layer the subscriber asked for */
+	volatile gint bwe;		/* Bandwidth available to this subscriber, as estimated by the core (0 if unknown) */
+	volatile gint bwe_pending;	/* Whether the relay path should check the estimate again */
+	gint64 bwe_checked;		/* When we last asked the relay path to do that */
 	gboolean audio, video, data;		/* Whether audio, video and/or data must be sent to this subscriber */
 	/* As above, but can't change dynamically (says whether something was negotiated at all in SDP) */
 	gboolean audio_offered, video_offered, data_offered;
@@ -1471,6 +1487,8 @@ typedef struct janus_videoroom_rtp_relay_packet {
 	uint32_t ssrc[3];
 	uint32_t timestamp;
 	uint16_t seq_number;
+	/* Codec info, parsed once for all subscribers (video only) */
+	janus_rtp_video_info info;
 	/* The following are only relevant if we're doing VP9 SVC*/
 	gboolean svc;
 	int spatial_layer;
@@ -2454,6 +2472,9 @@ json_t *janus_videoroom_query_session(janus_plugin_session *handle) {
 					json_object_set_new(simulcast, "substream-target", json_integer(participant->sim_context.substream_target));
 					json_object_set_new(simulcast, "temporal-layer", json_integer(participant->sim_context.templayer));
 					json_object_set_new(simulcast, "temporal-layer-target", json_integer(participant->sim_context.templayer_target));
+					uint32_t bwe = g_atomic_int_get(&participant->bwe);
+					if(bwe > 0)
+						json_object_set_new(simulcast, "bandwidth-estimate", json_integer(bwe));
 					json_object_set_new(info, "simulcast", simulcast);
 				}
 				if(participant->room && participant->room->do_svc) {
@@ -3984,7 +4005,24 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 				sc = 1;
 			else if(ssrc == participant->ssrc[2])
 				sc = 2;
+			/* Keep track of the bitrate of each substream, as subscribers may need it to pick one */
+			gint64 now = janus_get_monotonic_time();
+			if(participant->substream_updated == 0)
+				participant->substream_updated = now;
+			if(now - participant->substream_updated >= G_USEC_PER_SEC) {
+				int i = 0;
+				for(i=0; i<3; i++) {
+					participant->substream_bitrate[i] = (uint32_t)((guint64)participant->substream_bytes[i]*8*G_USEC_PER_SEC/(now - participant->substream_updated));
+					participant->substream_bytes[i] = 0;
+				}
+				participant->substream_updated = now;
+			}
+			participant->substream_bytes[sc] += len;
 		}
+		/* Parse the codec info once: forwarders, recorder and subscribers will all need it */
+		janus_rtp_video_info info = { 0 };
+		if(video)
+			janus_rtp_video_info_parse(&info, participant->vcodec, buf, len);
 		/* Forward RTP to the appropriate port for the rtp_forwarders associated with this publisher, if there are any */
 		janus_mutex_lock(&participant->rtp_forwarders_mutex);
 		if(participant->srtp_contexts && g_hash_table_size(participant->srtp_contexts) > 0) {
@@ -4013,8 +4051,8 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 				continue;
 			} else if(video && rtp_forward->simulcast) {
 				/* This is video and we're simulcasting, check if we need to forward this frame */
-				if(!janus_rtp_simulcasting_context_process_rtp(&rtp_forward->sim_context,
-						buf, len, participant->ssrc, participant->vcodec, &rtp_forward->context))
+				if(!janus_rtp_simulcasting_context_process_rtp_info(&rtp_forward->sim_context,
+						buf, len, participant->ssrc, participant->vcodec, &rtp_forward->context, &info))
 					continue;
 				janus_rtp_header_update(rtp, &rtp_forward->context, TRUE, 4500);
 				/* By default we use the main SSRC (it may be overwritten later) */
@@ -4067,8 +4105,8 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 			janus_recorder_save_frame(video ? participant->vrc : participant->arc, buf, len);
 		} else {
 			/* We're simulcasting, save the best video quality */
-			gboolean save = janus_rtp_simulcasting_context_process_rtp(&participant->rec_simctx,
-				buf, len, participant->ssrc, participant->vcodec, &participant->rec_ctx);
+			gboolean save = janus_rtp_simulcasting_context_process_rtp_info(&participant->rec_simctx,
+				buf, len, participant->ssrc, participant->vcodec, &participant->rec_ctx, &info);
 			if(save) {
 				uint32_t seq_number = ntohs(rtp->seq_number);
 				uint32_t timestamp = ntohl(rtp->timestamp);
@@ -4088,6 +4126,7 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 		packet.data = rtp;
 		packet.length = len;
 		packet.is_video = video;
+		packet.info = info;
 		packet.svc = FALSE;
 		if(video && videoroom->do_svc) {
 			/* We're doing SVC: let's parse this packet to see which layers are there */
@@ -4152,20 +4191,10 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 				/* We generate RTCP every tot seconds/frames */
 				gint64 now = janus_get_monotonic_time();
 				/* First check if this is a keyframe, though: if so, we reset the timer */
-				int plen = 0;
-				char *payload = janus_rtp_payload(buf, len, &plen);
-				if(payload == NULL)
+				if(!(info.flags & JANUS_RTP_VIDEO_INFO_PARSED))
 					return;
-				if(participant->vcodec == JANUS_VIDEOCODEC_VP8) {
-					if(janus_vp8_is_keyframe(payload, plen))
-						participant->fir_latest = now;
-				} else if(participant->vcodec == JANUS_VIDEOCODEC_VP9) {
-					if(janus_vp9_is_keyframe(payload, plen))
-						participant->fir_latest = now;
-				} else if(participant->vcodec == JANUS_VIDEOCODEC_H264) {
-					if(janus_h264_is_keyframe(payload, plen))
-						participant->fir_latest = now;
-				}
+				if(info.flags & JANUS_RTP_VIDEO_INFO_KEYFRAME)
+					participant->fir_latest = now;
 				if((now-participant->fir_latest) >= ((gint64)videoroom->fir_freq*G_USEC_PER_SEC)) {
 					/* FIXME We send a FIR every tot seconds */
 					janus_videoroom_reqfir(participant, "Regular keyframe request");
@@ -4328,6 +4357,33 @@ void janus_videoroom_slow_link(janus_plugin_session *handle, int uplink, int vid
 	janus_refcount_decrease(&session->ref);
 }
 
+void janus_videoroom_incoming_bwe(janus_plugin_session *handle, uint32_t estimate) {
+	/* The core is telling us how much bandwidth is available to this peer */
+	if(handle == NULL || g_atomic_int_get(&handle->stopped) || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized) || !gateway)
+		return;
+	janus_mutex_lock(&sessions_mutex);
+	janus_videoroom_session *session = janus_videoroom_lookup_session(handle);
+	if(!session || g_atomic_int_get(&session->destroyed) || !session->participant ||
+			session->participant_type != janus_videoroom_p_type_subscriber) {
+		janus_mutex_unlock(&sessions_mutex);
+		return;
+	}
+	janus_videoroom_subscriber *subscriber = (janus_videoroom_subscriber *)session->participant;
+	if(subscriber != NULL && !g_atomic_int_get(&subscriber->destroyed)) {
+		/* We only take note of the estimate here: the substream and temporal
+		 * layer will be updated accordingly when relaying the next packet, if
+		 * we didn't ask for that too recently (we don't want to switch too often) */
+		JANUS_LOG(LOG_HUGE, "Bandwidth estimate for subscriber: %"SCNu32"\n", estimate);
+		g_atomic_int_set(&subscriber->bwe, estimate);
+		gint64 now = janus_get_monotonic_time();
+		if(now - subscriber->bwe_checked >= G_USEC_PER_SEC) {
+			subscriber->bwe_checked = now;
+			g_atomic_int_set(&subscriber->bwe_pending, 1);
+		}
+	}
+	janus_mutex_unlock(&sessions_mutex);
+}
+
 static void janus_videoroom_recorder_create(janus_videoroom_publisher *participant, gboolean audio, gboolean video, gboolean data) {
 	char filename[255];
 	gint64 now = janus_get_real_time();
@@ -4909,6 +4965,8 @@ static void *janus_videoroom_handler(void *data) {
 					janus_rtp_simulcasting_context_reset(&subscriber->sim_context);
 					subscriber->sim_context.substream_target = 2;
 					subscriber->sim_context.templayer_target = 2;
+					subscriber->substream_max = 2;
+					subscriber->templayer_max = 2;
 					janus_vp8_simulcast_context_reset(&subscriber->vp8_context);
 					if(subscriber->room->do_svc) {
 						/* This subscriber belongs to a room where VP9 SVC has been enabled,
@@ -5348,6 +5406,7 @@ static void *janus_videoroom_handler(void *data) {
 					/* Check if a simulcasting-related request is involved */
 					if(sc_substream && publisher->ssrc[0] != 0) {
 						subscriber->sim_context.substream_target = json_integer_value(sc_substream);
+						subscriber->substream_max = subscriber->sim_context.substream_target;
 						JANUS_LOG(LOG_VERB, "Setting video SSRC to let through (simulcast): %"SCNu32" (index %d, was %d)\n",
 							publisher->ssrc[subscriber->sim_context.substream],
 							subscriber->sim_context.substream_target,
@@ -5368,6 +5427,7 @@ static void *janus_videoroom_handler(void *data) {
 					if(subscriber->feed && subscriber->feed->vcodec == JANUS_VIDEOCODEC_VP8 &&
 							sc_temporal && publisher->ssrc[0] != 0) {
 						subscriber->sim_context.templayer_target = json_integer_value(sc_temporal);
+						subscriber->templayer_max = subscriber->sim_context.templayer_target;
 						JANUS_LOG(LOG_VERB, "Setting video temporal layer to let through (simulcast): %d (was %d)\n",
 							subscriber->sim_context.templayer_target, subscriber->sim_context.templayer);
 						if(subscriber->sim_context.templayer_target == subscriber->sim_context.templayer) {
@@ -5972,6 +6032,22 @@ static void *janus_videoroom_handler(void *data) {
 						janus_sdp_attribute_add_to_mline(m, a);
 					}
 				}
+				if(transport_wide_cc_extmap) {
+					/* The core will stamp what we relay with its own transport wide sequence
+					 * numbers, and use the feedback subscribers send to estimate their bandwidth */
+					janus_sdp_mline *m = janus_sdp_mline_find(offer, JANUS_SDP_AUDIO);
+					if(m != NULL) {
+						janus_sdp_attribute *a = janus_sdp_attribute_create("extmap",
+							"%d %s\r\n", participant->transport_wide_cc_extmap_id, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
+						janus_sdp_attribute_add_to_mline(m, a);
+					}
+					m = janus_sdp_mline_find(offer, JANUS_SDP_VIDEO);
+					if(m != NULL) {
+						janus_sdp_attribute *a = janus_sdp_attribute_create("extmap",
+							"%d %s\r\n", participant->transport_wide_cc_extmap_id, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
+						janus_sdp_attribute_add_to_mline(m, a);
+					}
+				}
 				/* Is this room recorded, or are we recording this publisher already? */
 				janus_mutex_lock(&participant->rec_mutex);
 				if(videoroom->record || participant->recording_active) {
@@ -6068,6 +6144,51 @@ error:
 	return NULL;
 }
 
+/* Helper to pick the simulcast substream and temporal layer that fit the bandwidth available to a subscriber */
+static void janus_videoroom_subscriber_apply_bwe(janus_videoroom_subscriber *subscriber) {
+	/* Only do this when a new estimate came in (at most once per second, see janus_videoroom_incoming_bwe) */
+	if(!g_atomic_int_get(&subscriber->bwe_pending) || !g_atomic_int_compare_and_exchange(&subscriber->bwe_pending, 1, 0))
+		return;
+	uint32_t bwe = g_atomic_int_get(&subscriber->bwe);
+	janus_videoroom_publisher *feed = subscriber->feed;
+	if(bwe == 0 || feed == NULL || feed->substream_bitrate[0] == 0)
+		return;
+	/* Leave some room for audio */
+	uint32_t available = bwe;
+	if(subscriber->audio)
+		available = bwe > 64000 ? bwe - 64000 : 0;
+	int substream = 0, i = 0;
+	for(i=subscriber->substream_max; i>0; i--) {
+		uint32_t needed = feed->substream_bitrate[i];
+		if(needed == 0)	/* The publisher is not sending this substream */
+			continue;
+		/* Be more conservative when going up, to avoid oscillations */
+		if(i > subscriber->sim_context.substream)
+			needed += needed/5;
+		if(needed <= available) {
+			substream = i;
+			break;
+		}
+	}
+	int templayer = subscriber->templayer_max;
+	if(substream == 0 && feed->vcodec == JANUS_VIDEOCODEC_VP8 && feed->substream_bitrate[0] > available) {
+		/* Even the lowest substream doesn't fit, drop temporal layers too: we assume
+		 * the base layer takes roughly 40% of the bitrate, and the first two 60% */
+		if((uint64_t)feed->substream_bitrate[0]*6/10 <= available)
+			templayer = MIN(templayer, 1);
+		else
+			templayer = 0;
+	}
+	if(substream == subscriber->sim_context.substream_target && templayer == subscriber->sim_context.templayer_target)
+		return;
+	JANUS_LOG(LOG_VERB, "Bandwidth estimate is %"SCNu32", switching to substream %d and temporal layer %d (were %d and %d)\n",
+		bwe, substream, templayer, subscriber->sim_context.substream_target, subscriber->sim_context.templayer_target);
+	if(substream != subscriber->sim_context.substream_target)
+		janus_videoroom_reqfir(feed, "Bandwidth estimation substream change");
+	subscriber->sim_context.substream_target = substream;
+	subscriber->sim_context.templayer_target = templayer;
+}
+
 /* Helper to quickly relay RTP packets from publishers to subscribers */
 static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data) {
 	janus_videoroom_rtp_relay_packet *packet = (janus_videoroom_rtp_relay_packet *)user_data;
@@ -6198,7 +6319,7 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 				packet->data->markerbit = 1;
 			}
 			if(gateway != NULL)
-				gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+				gateway->relay_rtp_info(session->handle, packet->is_video, (char *)packet->data, packet->length, &packet->info);
 			if(override_mark_bit && !has_marker_bit) {
 				packet->data->markerbit = 0;
 			}
@@ -6211,9 +6332,11 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			char *payload = janus_rtp_payload((char *)packet->data, packet->length, &plen);
 			if(payload == NULL)
 				return;
+			/* Check if the bandwidth estimate suggests a different substream/temporal layer */
+			janus_videoroom_subscriber_apply_bwe(subscriber);
 			/* Process this packet: don't relay if it's not the SSRC/layer we wanted to handle */
-			gboolean relay = janus_rtp_simulcasting_context_process_rtp(&subscriber->sim_context,
-				(char *)packet->data, packet->length, packet->ssrc, subscriber->feed->vcodec, &subscriber->context);
+			gboolean relay = janus_rtp_simulcasting_context_process_rtp_info(&subscriber->sim_context,
+				(char *)packet->data, packet->length, packet->ssrc, subscriber->feed->vcodec, &subscriber->context, &packet->info);
 			/* Do we need to drop this? */
 			if(!relay)
 				return;
@@ -6251,12 +6374,12 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			if(subscriber->feed && subscriber->feed->vcodec == JANUS_VIDEOCODEC_VP8) {
 				/* For VP8, we save the original payload descriptor, to restore it after */
 				memcpy(vp8pd, payload, sizeof(vp8pd));
-				janus_vp8_simulcast_descriptor_update(payload, plen, &subscriber->vp8_context,
-					subscriber->sim_context.changed_substream);
+				janus_vp8_simulcast_descriptor_update_ids(payload, plen, &subscriber->vp8_context,
+					subscriber->sim_context.changed_substream, packet->info.picid, packet->info.tl0picidx);
 			}
 			/* Send the packet */
 			if(gateway != NULL)
-				gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+				gateway->relay_rtp_info(session->handle, packet->is_video, (char *)packet->data, packet->length, &packet->info);
 			/* Restore the timestamp and sequence number to what the publisher set them to */
 			packet->data->timestamp = htonl(packet->timestamp);
 			packet->data->seq_number = htons(packet->seq_number);
@@ -6269,7 +6392,7 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			janus_rtp_header_update(packet->data, &subscriber->context, TRUE, 4500);
 			/* Send the packet */
 			if(gateway != NULL)
-				gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+				gateway->relay_rtp_info(session->handle, packet->is_video, (char *)packet->data, packet->length, &packet->info);
 			/* Restore the timestamp and sequence number to what the publisher set them to */
 			packet->data->timestamp = htonl(packet->timestamp);
 			packet->data->seq_number = htons(packet->seq_number);
@@ -19,6 +19,7 @@
  * important thing is that it MUST be a JSON object, as it will be included
  * as such within the Janus session/handle protocol;
  * - \c relay_rtp(): to send/relay the peer an RTP packet;
+ * - \c relay_rtp_info(): as above, with the codec info the plugin parsed already;
  * - \c relay_rtcp(): to send/relay the peer an RTCP message.
  * - \c relay_data(): to send/relay the peer a SCTP DataChannel message.
  *
@@ -65,12 +66,13 @@ janus_plugin *create(void) {
  * - \c incoming_rtcp(): a callback to notify you a peer has sent you a RTCP message;
  * - \c incoming_data(): a callback to notify you a peer has sent you a message on a SCTP DataChannel;
  * - \c slow_link(): a callback to notify you a peer has sent a lot of NACKs recently, and the media path may be slow;
+ * - \c incoming_bwe(): a callback to notify you the core has a new estimate of the bandwidth available towards a peer;
  * - \c hangup_media(): a callback to notify you the peer PeerConnection has been closed (e.g., after a DTLS alert);
  * - \c query_session(): this method is called by the core to get plugin-specific info on a session between you and a peer;
  * - \c destroy_session(): this method is called by the core to destroy a session between you and a peer.
  *
  * All the above methods and callbacks, except for \c incoming_rtp ,
- * \c incoming_rtcp , \c incoming_data and \c slow_link , are mandatory:
+ * \c incoming_rtcp , \c incoming_data , \c slow_link and \c incoming_bwe , are mandatory:
  * the Janus core will reject a plugin that doesn't implement any of the
  * mandatory callbacks. The previously mentioned ones, instead, are
  * optional, so you're free to implement only those you care about. If
@@ -78,9 +80,9 @@ janus_plugin *create(void) {
  * sense to not implement the \c incoming_data callback at all. At the
  * same time, if your plugin is ONLY going to use data channels and
  * can't care less about RTP or RTCP, \c incoming_rtp and \c incoming_rtcp
- * can be left out. Finally, \c slow_link is just there as a helper, some
- * additional information you may be interested about, but you're not
- * forced to receive it if you don't care.
+ * can be left out. Finally, \c slow_link and \c incoming_bwe are just
+ * there as helpers, some additional information you may be interested
+ * about, but you're not forced to receive it if you don't care.
  *
  * The Janus core \c janus_callbacks interface is provided to a plugin, together
  * with the path to the configurations files folder, in the \c init() method.
@@ -159,6 +161,8 @@ janus_plugin *create(void) {
 
 #include "refcount.h"
 
+/* Codec info of RTP packets, defined in rtp.h */
+struct janus_rtp_video_info;
 
 /*! \brief Version of the API, to match the one plugins were compiled against
  *
@@ -169,7 +173,7 @@ janus_plugin *create(void) {
  * Janus instance or it will crash.
  *
  */
-#define JANUS_PLUGIN_API_VERSION	10
+#define JANUS_PLUGIN_API_VERSION	11
 
 /*! \brief Initialization of all plugin properties to NULL
  *
@@ -207,6 +211,7 @@ static janus_plugin janus_echotest_plugin =
 		.hangup_media = NULL,			\
 		.destroy_session = NULL,		\
 		.query_session = NULL, 			\
+		.incoming_bwe = NULL,			\
 		## __VA_ARGS__ }
 
 
@@ -331,6 +336,18 @@ struct janus_plugin {
 	 * @returns A json_t object with the requested info */
 	json_t *(* const query_session)(janus_plugin_session *handle);
 
+	/*! \brief Method to be notified by the core about the bandwidth that is
+	 * currently estimated to be available towards a peer
+	 * \note The estimate is computed by the core out of the transport-wide
+	 * congestion control feedback the peer sends, and so is only available
+	 * when the transport-wide CC RTP extension has been negotiated for
+	 * the media Janus sends. It is notified whenever it changes significantly,
+	 * and never more than a few times per second: plugins can use it, for
+	 * instance, to pick the simulcast substream or temporal layer to relay.
+	 * @param[in] handle The plugin/gateway session used for this peer
+	 * @param[in] estimate The estimated available bandwidth, in bits per second */
+	void (* const incoming_bwe)(janus_plugin_session *handle, uint32_t estimate);
+
 };
 
 /*! \brief Callbacks to contact the Janus core */
@@ -396,6 +413,19 @@ struct janus_callbacks {
 	 * @param[in] desc The descriptor to search for
 	 * @returns TRUE if the token is valid, not expired and contains the descriptor, FALSE otherwise */
 	gboolean (* const auth_signature_contains)(janus_plugin *plugin, const char *token, const char *descriptor);
+
+	/*! \brief Callback to relay RTP packets to a peer, along with the codec info parsed when the plugin received them
+	 * \note Plugins relaying the same packet to many peers (e.g., the VideoRoom) can parse it once,
+	 * using janus_rtp_video_info_parse, and pass the result here: the core will then use the
+	 * flags instead of checking the payload for keyframes again for each peer
+	 * @param[in] handle The plugin/gateway session used for this peer
+	 * @param[in] video Whether this is an audio or a video frame
+	 * @param[in] buf The packet data (buffer)
+	 * @param[in] len The buffer lenght
+	 * @param[in] info The codec info of the packet (a janus_rtp_video_info instance), if any
+	 * \note Added after all the other callbacks, so that plugins built before it was
+	 * there still find the ones they use where they expect them */
+	void (* const relay_rtp_info)(janus_plugin_session *handle, int video, char *buf, int len, const struct janus_rtp_video_info *info);
 };
 
 /*! \brief The hook that plugins need to implement to be created from the Janus core */
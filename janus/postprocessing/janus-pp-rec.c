@@ -39,12 +39,58 @@
 ./janus-pp-rec --header /path/to/source.mjr
 ./janus-pp-rec --parse /path/to/source.mjr
 \endverbatim
+ *
+ * The audio and video recordings of the same media session can be muxed
+ * in a single file in one pass, as long as the audio is Opus: VP8 and VP9
+ * video will result in a .webm file, and H.264 video in an .mp4 file. The
+ * two recordings are synchronized using the time their first frame was
+ * written, so this only works with recordings that have a JSON header.
+ * Notice that .mp4 files are written as fragmented MP4 by the tool itself,
+ * rather than through FFmpeg, and start at the first keyframe that comes
+ * with SPS and PPS:
+ *
+\verbatim
+./janus-pp-rec --merge /path/to/video.mjr /path/to/audio.mjr /path/to/destination.[webm|mp4]
+\endverbatim
+ *
+ * Finally, the tool can run as a service that processes many recordings
+ * in parallel, which is much cheaper than starting it once per file when
+ * there's a lot of them (e.g., at the end of a big conference):
+ *
+\verbatim
+./janus-pp-rec --daemon /path/to/janus-pp-rec.sock [workers]
+./janus-pp-rec --daemon /path/to/spool/folder [workers]
+\endverbatim
+ *
+ * Jobs are JSON objects, either with a \c source and a \c destination,
+ * or with a \c video, an \c audio and a \c destination to merge two
+ * recordings, plus an optional \c id that is returned in the result:
+ *
+\verbatim
+{"id": "rec1234", "source": "/path/to/source.mjr", "destination": "/path/to/destination.opus"}
+{"id": "rec5678", "video": "/path/to/video.mjr", "audio": "/path/to/audio.mjr", "destination": "/path/to/destination.webm"}
+\endverbatim
+ *
+ * When the argument is a UNIX socket path, jobs are sent over the socket,
+ * one per line, and the result of each job is sent back on the same
+ * connection as a line of JSON when it's done, including how long it
+ * was queued, how long it took and how much CPU it used. Sending a
+ * \c {"request":"stats"} line returns the throughput so far instead.
+ * When the argument is an existing folder, each \c .job file it contains
+ * is a job: the file is renamed to \c .working while it's processed,
+ * and the result is then saved to a \c .done or \c .failed file with the
+ * same name. The number of jobs processed at the same time (by default the
+ * number of CPUs) can also be set with the \c JANUS_PPREC_WORKERS environment
+ * variable. Each job is processed in a process of its own, so that a broken
+ * recording cannot affect the others: the first SIGINT stops accepting new
+ * jobs and waits for the ones in progress to complete, a second one aborts
+ * them too.
  *
  * \note This utility does not do any form of transcoding. It just
  * depacketizes the RTP frames in order to get the payload, and saves
  * the frames in a valid container. Any further post-processing (e.g.,
- * muxing audio and video belonging to the same media session in a single
- * .webm file) is up to third-party applications.
+ * mixing, or muxing audio formats other than Opus with the video) is up
+ * to third-party applications.
  *
  * \ingroup postprocessing
  * \ref postprocessing
@@ -60,10 +106,23 @@
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <jansson.h>
 
+#include <libavformat/avformat.h>
+
 #include "../debug.h"
 #include "../version.h"
 #include "pp-rtp.h"
@@ -82,7 +141,6 @@ int janus_log_level = 4;
 gboolean janus_log_timestamps = FALSE;
 gboolean janus_log_colors = TRUE;
 
-static janus_pp_frame_packet *list = NULL, *last = NULL;
 static int working = 0;
 
 static int post_reset_trigger = 200;
@@ -102,6 +160,35 @@ static int video_orient_extmap_id = -1;
 static int janus_pp_rtp_header_extension_parse_video_orientation(char *buf, int len, int id, int *rotation);
 
 
+/* A recording we're processing */
+typedef struct janus_pp_recording {
+	/* The .mjr file, and its size */
+	FILE *file;
+	long fsize;
+	/* What's in there, as it results from the header */
+	int video, data;
+	int opus, g711, g722, vp8, vp9, h264;
+	/* When the recording was created, and when the first frame was written */
+	gint64 c_time, w_time;
+	/* The frames, once parsed and re-ordered */
+	janus_pp_frame_packet *list, *last;
+} janus_pp_recording;
+static int janus_pp_rec_open(janus_pp_recording *rec, const char *source, gboolean quiet);
+static int janus_pp_rec_parse_header(janus_pp_recording *rec, const char *extension, gboolean jsonheader_only, gboolean header_only);
+static int janus_pp_rec_parse_frames(janus_pp_recording *rec);
+static void janus_pp_rec_close(janus_pp_recording *rec);
+static long janus_pp_rec_file_size(const char *path);
+
+/* Processing of a single recording, and muxing of an audio and a video recording */
+static int janus_pp_rec_process(const char *source, const char *destination,
+	gboolean jsonheader_only, gboolean header_only, gboolean parse_only);
+static int janus_pp_rec_merge(const char *vsource, const char *asource, const char *destination);
+
+/* Service mode, with jobs coming from a UNIX socket or a spool folder */
+static int janus_pp_rec_daemon(const char *path, int workers);
+static gboolean daemon_debug = FALSE;
+
+
 /* Main Code */
 int main(int argc, char *argv[])
 {
@@ -124,6 +211,7 @@ int main(int argc, char *argv[])
 		int val = atoi(g_getenv("JANUS_PPREC_DEBUG"));
 		if(val >= LOG_NONE && val <= LOG_MAX)
 			janus_log_level = val;
+		daemon_debug = TRUE;
 		JANUS_LOG(LOG_INFO, "Logging level: %d\n", janus_log_level);
 	}
 	if(g_getenv("JANUS_PPREC_POSTRESETTRIGGER") != NULL) {
@@ -152,78 +240,84 @@ int main(int argc, char *argv[])
 	}
 
 	/* Evaluate arguments */
+	if(argc >= 3 && argc <= 4 && !strcmp(argv[1], "--daemon")) {
+		/* Long running service, processing many recordings in parallel */
+		int workers = 0;
+		if(argc == 4)
+			workers = atoi(argv[3]);
+		else if(g_getenv("JANUS_PPREC_WORKERS") != NULL)
+			workers = atoi(g_getenv("JANUS_PPREC_WORKERS"));
+		if(workers < 1)
+			workers = g_get_num_processors();
+		return janus_pp_rec_daemon(argv[2], workers);
+	}
+	/* Handle SIGINT */
+	working = 1;
+	signal(SIGINT, janus_pp_handle_signal);
+	if(argc == 5 && !strcmp(argv[1], "--merge")) {
+		/* Mux an audio and a video recording */
+		return janus_pp_rec_merge(argv[2], argv[3], argv[4]);
+	}
 	if(argc != 3) {
 		JANUS_LOG(LOG_INFO, "Usage: %s source.mjr destination.[opus|wav|webm|mp4|srt]\n", argv[0]);
 		JANUS_LOG(LOG_INFO, "       %s --json source.mjr (only print JSON header)\n", argv[0]);
 		JANUS_LOG(LOG_INFO, "       %s --header source.mjr (only parse header)\n", argv[0]);
 		JANUS_LOG(LOG_INFO, "       %s --parse source.mjr (only parse and re-order packets)\n", argv[0]);
+		JANUS_LOG(LOG_INFO, "       %s --merge video.mjr audio.mjr destination.[webm|mp4] (mux video and Opus audio)\n", argv[0]);
+		JANUS_LOG(LOG_INFO, "       %s --daemon socket|folder [workers] (process jobs from a UNIX socket or a spool folder)\n", argv[0]);
 		return -1;
 	}
-	char *source = NULL, *destination = NULL, *extension = NULL;
 	gboolean header_only = !strcmp(argv[1], "--header");
 	gboolean parse_only = !strcmp(argv[1], "--parse");
 	if(jsonheader_only || header_only || parse_only) {
 		/* Only parse the .mjr header and/or re-order the packets, no processing */
-		source = argv[2];
-	} else {
-		/* Post-process the .mjr recording */
-		source = argv[1];
-		destination = argv[2];
-		JANUS_LOG(LOG_INFO, "%s --> %s\n", source, destination);
-		/* Check the extension */
-		extension = strrchr(destination, '.');
-		if(extension == NULL) {
-			/* No extension? */
-			JANUS_LOG(LOG_ERR, "No extension? Unsupported target file\n");
-			exit(1);
-		}
-		if(strcasecmp(extension, ".opus") && strcasecmp(extension, ".wav") &&
-				strcasecmp(extension, ".webm") && strcasecmp(extension, ".mp4") &&
-				strcasecmp(extension, ".srt")) {
-			/* Unsupported extension? */
-			JANUS_LOG(LOG_ERR, "Unsupported extension '%s'\n", extension);
-			exit(1);
-		}
+		return janus_pp_rec_process(argv[2], NULL, jsonheader_only, header_only, parse_only);
 	}
-	FILE *file = fopen(source, "rb");
-	if(file == NULL) {
+	/* Post-process the .mjr recording */
+	return janus_pp_rec_process(argv[1], argv[2], FALSE, FALSE, FALSE);
+}
+
+
+/* Recordings */
+static int janus_pp_rec_open(janus_pp_recording *rec, const char *source, gboolean quiet) {
+	memset(rec, 0, sizeof(*rec));
+	rec->file = fopen(source, "rb");
+	if(rec->file == NULL) {
 		JANUS_LOG(LOG_ERR, "Could not open file %s\n", source);
 		return -1;
 	}
-	fseek(file, 0L, SEEK_END);
-	long fsize = ftell(file);
-	fseek(file, 0L, SEEK_SET);
-	if(!jsonheader_only)
-		JANUS_LOG(LOG_INFO, "File is %zu bytes\n", fsize);
-
-	/* Handle SIGINT */
-	working = 1;
-	signal(SIGINT, janus_pp_handle_signal);
+	fseek(rec->file, 0L, SEEK_END);
+	rec->fsize = ftell(rec->file);
+	fseek(rec->file, 0L, SEEK_SET);
+	if(!quiet)
+		JANUS_LOG(LOG_INFO, "File is %zu bytes\n", rec->fsize);
+	return 0;
+}
 
+/* Returns 0 if we can go on with the frames, 1 if there's nothing else
+ * to do (e.g., we were only asked for the header) and -1 on errors */
+static int janus_pp_rec_parse_header(janus_pp_recording *rec, const char *extension, gboolean jsonheader_only, gboolean header_only) {
 	/* Pre-parse */
 	if(!jsonheader_only)
 		JANUS_LOG(LOG_INFO, "Pre-parsing file to generate ordered index...\n");
+	FILE *file = rec->file;
+	long fsize = rec->fsize;
 	gboolean parsed_header = FALSE;
 	int video = 0, data = 0;
 	int opus = 0, g711 = 0, g722 = 0, vp8 = 0, vp9 = 0, h264 = 0;
 	gint64 c_time = 0, w_time = 0;
-	int bytes = 0, skip = 0;
+	int bytes = 0;
 	long offset = 0;
 	uint16_t len = 0;
-	uint32_t count = 0;
-	uint32_t ssrc = 0;
 	char prebuffer[1500];
 	memset(prebuffer, 0, 1500);
-	char prebuffer2[1500];
-	memset(prebuffer2, 0, 1500);
 	/* Let's look for timestamp resets first */
 	while(working && offset < fsize) {
 		if(header_only && parsed_header) {
 			/* We only needed to parse the header */
-			exit(0);
+			return 1;
 		}
 		/* Read frame header */
-		skip = 0;
 		fseek(file, offset, SEEK_SET);
 		bytes = fread(prebuffer, sizeof(char), 8, file);
 		if(bytes != 8 || prebuffer[0] != 'M') {
@@ -242,7 +336,7 @@ int main(int argc, char *argv[])
 				parsed_header = TRUE;
 				JANUS_LOG(LOG_WARN, "Old .mjr header format\n");
 				if(jsonheader_only)	/* No JSON header to print */
-					exit(1);
+					return -1;
 				bytes = fread(prebuffer, sizeof(char), 5, file);
 				if(prebuffer[0] == 'v') {
 					JANUS_LOG(LOG_INFO, "This is a video recording, assuming VP8\n");
@@ -251,7 +345,7 @@ int main(int argc, char *argv[])
 					vp8 = 1;
 					if(extension && strcasecmp(extension, ".webm")) {
 						JANUS_LOG(LOG_ERR, "VP8 RTP packets can only be converted to a .webm file\n");
-						exit(1);
+						return -1;
 					}
 				} else if(prebuffer[0] == 'a') {
 					JANUS_LOG(LOG_INFO, "This is an audio recording, assuming Opus\n");
@@ -260,7 +354,7 @@ int main(int argc, char *argv[])
 					opus = 1;
 					if(extension && strcasecmp(extension, ".opus")) {
 						JANUS_LOG(LOG_ERR, "Opus RTP packets can only be converted to an .opus file\n");
-						exit(1);
+						return -1;
 					}
 				} else if(prebuffer[0] == 'd') {
 					JANUS_LOG(LOG_INFO, "This is a text data recording, assuming SRT\n");
@@ -268,11 +362,11 @@ int main(int argc, char *argv[])
 					data = 1;
 					if(extension && strcasecmp(extension, ".srt")) {
 						JANUS_LOG(LOG_ERR, "Data channel packets can only be converted to a .srt file\n");
-						exit(1);
+						return -1;
 					}
 				} else {
 					JANUS_LOG(LOG_WARN, "Unsupported recording media type...\n");
-					exit(1);
+					return -1;
 				}
 				offset += len;
 				continue;
@@ -299,20 +393,20 @@ int main(int argc, char *argv[])
 				if(jsonheader_only) {
 					/* Print the header as it is and exit */
 					JANUS_PRINT("%s\n", prebuffer);
-					exit(0);
+					return 1;
 				}
 				json_error_t error;
 				json_t *info = json_loads(prebuffer, 0, &error);
 				if(!info) {
 					JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 					JANUS_LOG(LOG_WARN, "Error parsing info header...\n");
-					exit(1);
+					return -1;
 				}
 				/* Is it audio or video? */
 				json_t *type = json_object_get(info, "t");
 				if(!type || !json_is_string(type)) {
 					JANUS_LOG(LOG_WARN, "Missing/invalid recording type in info header...\n");
-					exit(1);
+					return -1;
 				}
 				const char *t = json_string_value(type);
 				if(!strcasecmp(t, "v")) {
@@ -326,13 +420,13 @@ int main(int argc, char *argv[])
 					data = 1;
 				} else {
 					JANUS_LOG(LOG_WARN, "Unsupported recording type '%s' in info header...\n", t);
-					exit(1);
+					return -1;
 				}
 				/* What codec was used? */
 				json_t *codec = json_object_get(info, "c");
 				if(!codec || !json_is_string(codec)) {
 					JANUS_LOG(LOG_WARN, "Missing recording codec in info header...\n");
-					exit(1);
+					return -1;
 				}
 				const char *c = json_string_value(codec);
 				if(video) {
@@ -340,69 +434,69 @@ int main(int argc, char *argv[])
 						vp8 = 1;
 						if(extension && strcasecmp(extension, ".webm")) {
 							JANUS_LOG(LOG_ERR, "VP8 RTP packets can only be converted to a .webm file\n");
-							exit(1);
+							return -1;
 						}
 					} else if(!strcasecmp(c, "vp9")) {
 						vp9 = 1;
 						if(extension && strcasecmp(extension, ".webm")) {
 							JANUS_LOG(LOG_ERR, "VP9 RTP packets can only be converted to a .webm file\n");
-							exit(1);
+							return -1;
 						}
 					} else if(!strcasecmp(c, "h264")) {
 						h264 = 1;
 						if(extension && strcasecmp(extension, ".mp4")) {
 							JANUS_LOG(LOG_ERR, "H.264 RTP packets can only be converted to a .mp4 file\n");
-							exit(1);
+							return -1;
 						}
 					} else {
 						JANUS_LOG(LOG_WARN, "The post-processor only supports VP8, VP9 and H.264 video for now (was '%s')...\n", c);
-						exit(1);
+						return -1;
 					}
 				} else if(!video && !data) {
 					if(!strcasecmp(c, "opus")) {
 						opus = 1;
 						if(extension && strcasecmp(extension, ".opus")) {
 							JANUS_LOG(LOG_ERR, "Opus RTP packets can only be converted to a .opus file\n");
-							exit(1);
+							return -1;
 						}
 					} else if(!strcasecmp(c, "g711") || !strcasecmp(c, "pcmu") || !strcasecmp(c, "pcma")) {
 						g711 = 1;
 						if(extension && strcasecmp(extension, ".wav")) {
 							JANUS_LOG(LOG_ERR, "G.711 RTP packets can only be converted to a .wav file\n");
-							exit(1);
+							return -1;
 						}
 					} else if(!strcasecmp(c, "g722")) {
 						g722 = 1;
 						if(extension && strcasecmp(extension, ".wav")) {
 							JANUS_LOG(LOG_ERR, "G.722 RTP packets can only be converted to a .wav file\n");
-							exit(1);
+							return -1;
 						}
 					} else {
 						JANUS_LOG(LOG_WARN, "The post-processor only supports Opus and G.711 audio for now (was '%s')...\n", c);
-						exit(1);
+						return -1;
 					}
 				} else if(data) {
 					if(strcasecmp(c, "text")) {
 						JANUS_LOG(LOG_WARN, "The post-processor only supports text data for now (was '%s')...\n", c);
-						exit(1);
+						return -1;
 					}
 					if(extension && strcasecmp(extension, ".srt")) {
 						JANUS_LOG(LOG_ERR, "Data channel packets can only be converted to a .srt file\n");
-						exit(1);
+						return -1;
 					}
 				}
 				/* When was the file created? */
 				json_t *created = json_object_get(info, "s");
 				if(!created || !json_is_integer(created)) {
 					JANUS_LOG(LOG_WARN, "Missing recording created time in info header...\n");
-					exit(1);
+					return -1;
 				}
 				c_time = json_integer_value(created);
 				/* When was the first frame written? */
 				json_t *written = json_object_get(info, "u");
 				if(!written || !json_is_integer(written)) {
 					JANUS_LOG(LOG_WARN, "Missing recording written time in info header...\n");
-					exit(1);
+					return -1;
 				}
 				w_time = json_integer_value(written);
 				/* Summary */
@@ -413,13 +507,40 @@ int main(int argc, char *argv[])
 			}
 		} else {
 			JANUS_LOG(LOG_ERR, "Invalid header...\n");
-			exit(1);
+			return -1;
 		}
 		/* Skip data for now */
 		offset += len;
 	}
-	if(!working || jsonheader_only)
-		exit(0);
+	rec->video = video;
+	rec->data = data;
+	rec->opus = opus;
+	rec->g711 = g711;
+	rec->g722 = g722;
+	rec->vp8 = vp8;
+	rec->vp9 = vp9;
+	rec->h264 = h264;
+	rec->c_time = c_time;
+	rec->w_time = w_time;
+	return 0;
+}
+
+/* Returns 0 when done, and 1 if we were interrupted */
+static int janus_pp_rec_parse_frames(janus_pp_recording *rec) {
+	FILE *file = rec->file;
+	long fsize = rec->fsize;
+	int data = rec->data;
+	gint64 c_time = rec->c_time;
+	janus_pp_frame_packet *list = NULL, *last = NULL;
+	int bytes = 0, skip = 0;
+	long offset = 0;
+	uint16_t len = 0;
+	uint32_t count = 0;
+	uint32_t ssrc = 0;
+	char prebuffer[1500];
+	memset(prebuffer, 0, 1500);
+	char prebuffer2[1500];
+	memset(prebuffer2, 0, 1500);
 	/* Now let's parse the frames and order them */
 	uint32_t last_ts = 0, reset = 0;
 	int times_resetted = 0;
@@ -687,7 +808,7 @@ int main(int argc, char *argv[])
 		count++;
 	}
 	if(!working)
-		exit(0);
+		return 1;
 
 	JANUS_LOG(LOG_INFO, "Counted %"SCNu32" RTP packets\n", count);
 	janus_pp_frame_packet *tmp = list;
@@ -708,18 +829,83 @@ int main(int argc, char *argv[])
 			JANUS_LOG(LOG_INFO, "The video changed orientation %d times\n", rotated);
 		}
 	}
+	rec->list = list;
+	rec->last = last;
+	return 0;
+}
+
+static void janus_pp_rec_close(janus_pp_recording *rec) {
+	if(rec->file != NULL)
+		fclose(rec->file);
+	rec->file = NULL;
+	janus_pp_frame_packet *temp = rec->list, *next = NULL;
+	while(temp) {
+		next = temp->next;
+		g_free(temp);
+		temp = next;
+	}
+	rec->list = rec->last = NULL;
+}
+
+static long janus_pp_rec_file_size(const char *path) {
+	struct stat st;
+	if(path == NULL || stat(path, &st) < 0)
+		return -1;
+	return st.st_size;
+}
+
+static int janus_pp_rec_process(const char *source, const char *destination,
+		gboolean jsonheader_only, gboolean header_only, gboolean parse_only) {
+	const char *extension = NULL;
+	if(destination != NULL) {
+		JANUS_LOG(LOG_INFO, "%s --> %s\n", source, destination);
+		/* Check the extension */
+		extension = strrchr(destination, '.');
+		if(extension == NULL) {
+			/* No extension? */
+			JANUS_LOG(LOG_ERR, "No extension? Unsupported target file\n");
+			return 1;
+		}
+		if(strcasecmp(extension, ".opus") && strcasecmp(extension, ".wav") &&
+				strcasecmp(extension, ".webm") && strcasecmp(extension, ".mp4") &&
+				strcasecmp(extension, ".srt")) {
+			/* Unsupported extension? */
+			JANUS_LOG(LOG_ERR, "Unsupported extension '%s'\n", extension);
+			return 1;
+		}
+	}
+	janus_pp_recording rec;
+	if(janus_pp_rec_open(&rec, source, jsonheader_only) < 0)
+		return -1;
+	int res = janus_pp_rec_parse_header(&rec, extension, jsonheader_only, header_only);
+	if(res != 0) {
+		janus_pp_rec_close(&rec);
+		return res < 0 ? 1 : 0;
+	}
+	if(!working || jsonheader_only) {
+		janus_pp_rec_close(&rec);
+		return 0;
+	}
+	if(janus_pp_rec_parse_frames(&rec) > 0) {
+		janus_pp_rec_close(&rec);
+		return 0;
+	}
+	FILE *file = rec.file;
+	janus_pp_frame_packet *list = rec.list;
 
-	if(video) {
+	if(rec.video) {
 		/* Look for maximum width and height, if possible, and for the average framerate */
-		if(vp8 || vp9) {
-			if(janus_pp_webm_preprocess(file, list, vp8) < 0) {
-				JANUS_LOG(LOG_ERR, "Error pre-processing %s RTP frames...\n", vp8 ? "VP8" : "VP9");
-				exit(1);
+		if(rec.vp8 || rec.vp9) {
+			if(janus_pp_webm_preprocess(file, list, rec.vp8) < 0) {
+				JANUS_LOG(LOG_ERR, "Error pre-processing %s RTP frames...\n", rec.vp8 ? "VP8" : "VP9");
+				janus_pp_rec_close(&rec);
+				return 1;
 			}
-		} else if(h264) {
+		} else if(rec.h264) {
 			if(janus_pp_h264_preprocess(file, list) < 0) {
 				JANUS_LOG(LOG_ERR, "Error pre-processing H.264 RTP frames...\n");
-				exit(1);
+				janus_pp_rec_close(&rec);
+				return 1;
 			}
 		}
 	}
@@ -727,68 +913,75 @@ int main(int argc, char *argv[])
 	if(parse_only) {
 		/* We only needed to parse and re-order the packets, we're done here */
 		JANUS_LOG(LOG_INFO, "Parsing and reordering completed, bye!\n");
-		exit(0);
+		janus_pp_rec_close(&rec);
+		return 0;
 	}
 
-	if(!video && !data) {
-		if(opus) {
-			if(janus_pp_opus_create(destination) < 0) {
+	char *target = (char *)destination;
+	res = 0;
+	if(!rec.video && !rec.data) {
+		if(rec.opus) {
+			if(janus_pp_opus_create(target) < 0) {
 				JANUS_LOG(LOG_ERR, "Error creating .opus file...\n");
-				exit(1);
+				res = -1;
 			}
-		} else if(g711) {
-			if(janus_pp_g711_create(destination) < 0) {
+		} else if(rec.g711) {
+			if(janus_pp_g711_create(target) < 0) {
 				JANUS_LOG(LOG_ERR, "Error creating .wav file...\n");
-				exit(1);
+				res = -1;
 			}
-		} else if(g722) {
-			if(janus_pp_g722_create(destination) < 0) {
+		} else if(rec.g722) {
+			if(janus_pp_g722_create(target) < 0) {
 				JANUS_LOG(LOG_ERR, "Error creating .wav file...\n");
-				exit(1);
+				res = -1;
 			}
 		}
-	} else if(data) {
-		if(janus_pp_srt_create(destination) < 0) {
+	} else if(rec.data) {
+		if(janus_pp_srt_create(target) < 0) {
 			JANUS_LOG(LOG_ERR, "Error creating .srt file...\n");
-			exit(1);
+			res = -1;
 		}
 	} else {
-		if(vp8 || vp9) {
-			if(janus_pp_webm_create(destination, vp8) < 0) {
+		if(rec.vp8 || rec.vp9) {
+			if(janus_pp_webm_create(target, rec.vp8, NULL) < 0) {
 				JANUS_LOG(LOG_ERR, "Error creating .webm file...\n");
-				exit(1);
+				res = -1;
 			}
-		} else if(h264) {
-			if(janus_pp_h264_create(destination) < 0) {
+		} else if(rec.h264) {
+			if(janus_pp_h264_create(target, NULL) < 0) {
 				JANUS_LOG(LOG_ERR, "Error creating .mp4 file...\n");
-				exit(1);
+				res = -1;
 			}
 		}
 	}
+	if(res < 0) {
+		janus_pp_rec_close(&rec);
+		return 1;
+	}
 
 	/* Loop */
-	if(!video && !data) {
-		if(opus) {
+	if(!rec.video && !rec.data) {
+		if(rec.opus) {
 			if(janus_pp_opus_process(file, list, &working) < 0) {
 				JANUS_LOG(LOG_ERR, "Error processing Opus RTP frames...\n");
 			}
-		} else if(g711) {
+		} else if(rec.g711) {
 			if(janus_pp_g711_process(file, list, &working) < 0) {
 				JANUS_LOG(LOG_ERR, "Error processing G.711 RTP frames...\n");
 			}
-		} else if(g722) {
+		} else if(rec.g722) {
 			if(janus_pp_g722_process(file, list, &working) < 0) {
 				JANUS_LOG(LOG_ERR, "Error processing G.722 RTP frames...\n");
 			}
 		}
-	} else if(data) {
+	} else if(rec.data) {
 		if(janus_pp_srt_process(file, list, &working) < 0) {
 			JANUS_LOG(LOG_ERR, "Error processing text data frames...\n");
 		}
 	} else {
-		if(vp8 || vp9) {
-			if(janus_pp_webm_process(file, list, vp8, &working) < 0) {
-				JANUS_LOG(LOG_ERR, "Error processing %s RTP frames...\n", vp8 ? "VP8" : "VP9");
+		if(rec.vp8 || rec.vp9) {
+			if(janus_pp_webm_process(file, list, rec.vp8, &working) < 0) {
+				JANUS_LOG(LOG_ERR, "Error processing %s RTP frames...\n", rec.vp8 ? "VP8" : "VP9");
 			}
 		} else {
 			if(janus_pp_h264_process(file, list, &working) < 0) {
@@ -798,42 +991,742 @@ int main(int argc, char *argv[])
 	}
 
 	/* Clean up */
-	if(video) {
-		if(vp8 || vp9) {
+	if(rec.video) {
+		if(rec.vp8 || rec.vp9) {
 			janus_pp_webm_close();
 		} else {
 			janus_pp_h264_close();
 		}
-	} else if(data) {
+	} else if(rec.data) {
 		janus_pp_srt_close();
 	} else {
-		if(opus) {
+		if(rec.opus) {
 			janus_pp_opus_close();
-		} else if(g711) {
+		} else if(rec.g711) {
 			janus_pp_g711_close();
-		} else if(g722) {
+		} else if(rec.g722) {
 			janus_pp_g722_close();
 		}
 	}
-	fclose(file);
+	janus_pp_rec_close(&rec);
 
-	file = fopen(destination, "rb");
-	if(file == NULL) {
+	long size = janus_pp_rec_file_size(destination);
+	if(size < 0) {
 		JANUS_LOG(LOG_INFO, "No destination file %s??\n", destination);
 	} else {
-		fseek(file, 0L, SEEK_END);
-		fsize = ftell(file);
-		fseek(file, 0L, SEEK_SET);
-		JANUS_LOG(LOG_INFO, "%s is %zu bytes\n", destination, fsize);
-		fclose(file);
+		JANUS_LOG(LOG_INFO, "%s is %zu bytes\n", destination, size);
 	}
-	janus_pp_frame_packet *temp = list, *next = NULL;
-	while(temp) {
-		next = temp->next;
-		g_free(temp);
-		temp = next;
+
+	JANUS_LOG(LOG_INFO, "Bye!\n");
+	return 0;
+}
+
+static int janus_pp_rec_merge(const char *vsource, const char *asource, const char *destination) {
+	JANUS_LOG(LOG_INFO, "%s + %s --> %s\n", vsource, asource, destination);
+	/* Check the extension: only containers that can have both audio and video */
+	const char *extension = strrchr(destination, '.');
+	if(extension == NULL || (strcasecmp(extension, ".webm") && strcasecmp(extension, ".mp4"))) {
+		JANUS_LOG(LOG_ERR, "Unsupported target file, muxing needs a .webm or a .mp4 file\n");
+		return 1;
+	}
+	janus_pp_recording video, audio;
+	if(janus_pp_rec_open(&video, vsource, FALSE) < 0)
+		return -1;
+	if(janus_pp_rec_open(&audio, asource, FALSE) < 0) {
+		janus_pp_rec_close(&video);
+		return -1;
 	}
+	/* The extensions do the validation for us: only video can go in the
+	 * target container, and the only audio we mux is what could go in .opus */
+	int res = janus_pp_rec_parse_header(&video, extension, FALSE, FALSE);
+	if(res == 0)
+		res = janus_pp_rec_parse_header(&audio, ".opus", FALSE, FALSE);
+	if(res == 0 && (!video.video || !audio.opus)) {
+		JANUS_LOG(LOG_ERR, "Muxing needs a video recording and an Opus recording\n");
+		res = -1;
+	}
+	if(res == 0 && working && janus_pp_rec_parse_frames(&video) == 0 && janus_pp_rec_parse_frames(&audio) == 0) {
+		if(video.list == NULL || audio.list == NULL) {
+			JANUS_LOG(LOG_ERR, "No frames to mux...\n");
+			res = -1;
+		} else if(video.vp8 || video.vp9) {
+			res = janus_pp_webm_preprocess(video.file, video.list, video.vp8);
+		} else {
+			res = janus_pp_h264_preprocess(video.file, video.list);
+		}
+	}
+	if(res != 0 || !working) {
+		if(res != 0)
+			JANUS_LOG(LOG_ERR, "Error pre-processing the recordings...\n");
+		janus_pp_rec_close(&video);
+		janus_pp_rec_close(&audio);
+		return res != 0 ? 1 : 0;
+	}
+	/* Both recordings have their first frame at timestamp 0: use the time
+	 * it was written at to know where the audio starts, within the video */
+	janus_pp_opus_track track = {
+		.file = audio.file,
+		.list = audio.list
+	};
+	if(video.w_time > 0 && audio.w_time > 0)
+		track.offset = (audio.w_time - video.w_time)/1000;
+	else
+		JANUS_LOG(LOG_WARN, "No written time in the headers, assuming the recordings started together\n");
+	JANUS_LOG(LOG_INFO, "Audio starts %"SCNi64" ms after the video\n", track.offset);
+	char *target = (char *)destination;
+	if(video.vp8 || video.vp9) {
+		if(janus_pp_webm_create(target, video.vp8, &track) < 0) {
+			JANUS_LOG(LOG_ERR, "Error creating .webm file...\n");
+			res = 1;
+		} else {
+			if(janus_pp_webm_process(video.file, video.list, video.vp8, &working) < 0)
+				JANUS_LOG(LOG_ERR, "Error processing %s RTP frames...\n", video.vp8 ? "VP8" : "VP9");
+			janus_pp_webm_close();
+		}
+	} else {
+		if(janus_pp_h264_create(target, &track) < 0) {
+			JANUS_LOG(LOG_ERR, "Error creating .mp4 file...\n");
+			res = 1;
+		} else {
+			if(janus_pp_h264_process(video.file, video.list, &working) < 0)
+				JANUS_LOG(LOG_ERR, "Error processing H.264 RTP frames...\n");
+			janus_pp_h264_close();
+		}
+	}
+	janus_pp_rec_close(&video);
+	janus_pp_rec_close(&audio);
+	if(res != 0)
+		return res;
+
+	long size = janus_pp_rec_file_size(destination);
+	if(size < 0) {
+		JANUS_LOG(LOG_INFO, "No destination file %s??\n", destination);
+	} else {
+		JANUS_LOG(LOG_INFO, "%s is %zu bytes\n", destination, size);
+	}
+
+	JANUS_LOG(LOG_INFO, "Bye!\n");
+	return 0;
+}
+
+/* Service mode */
+typedef struct janus_pp_rec_job {
+	/* Identifier, either as provided in the request or the name of the spool file */
+	char *id;
+	/* Recording(s) to process, and the file to create */
+	char *source, *audio, *destination;
+	/* Connection the job came from, if any, to send the result to */
+	int client;
+	/* Job file (now .working) in the spool folder, if that's where it came from */
+	char *spool;
+	/* Process taking care of the job */
+	pid_t pid;
+	/* When the job was queued and started, and how big the recordings are */
+	gint64 queued, started;
+	long in_bytes;
+} janus_pp_rec_job;
+
+typedef struct janus_pp_rec_client {
+	int fd;
+	GString *buffer;
+} janus_pp_rec_client;
+
+/* Jobs waiting for a worker, and the ones being processed (indexed by pid) */
+static GQueue *jobs = NULL;
+static GHashTable *running = NULL;
+/* Where jobs come from: a UNIX socket (and its clients), or a spool folder */
+static int listener = -1;
+static GList *clients = NULL;
+static char *spool = NULL;
+/* Signals are turned in events on this pipe, to handle them in the loop */
+static int signals[2] = { -1, -1 };
+/* Throughput */
+static gint64 daemon_started = 0;
+static guint32 jobs_done = 0, jobs_failed = 0;
+static guint64 total_in_bytes = 0, total_out_bytes = 0;
+static gint64 total_queued = 0, total_elapsed = 0, total_cpu = 0;
+
+static void janus_pp_rec_daemon_signal(int signum) {
+	int errsv = errno;
+	char c = (char)signum;
+	if(write(signals[1], &c, 1) < 0) {
+		/* Nothing we can do here, the pipe is full and we'll get to it anyway */
+	}
+	errno = errsv;
+}
+
+static void janus_pp_rec_job_free(janus_pp_rec_job *job) {
+	if(job == NULL)
+		return;
+	g_free(job->id);
+	g_free(job->source);
+	g_free(job->audio);
+	g_free(job->destination);
+	g_free(job->spool);
+	g_free(job);
+}
+
+/* Send a line of JSON to a client */
+static void janus_pp_rec_daemon_reply(int fd, json_t *reply) {
+	if(fd < 0)
+		return;
+	char *text = json_dumps(reply, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	if(text == NULL)
+		return;
+	GString *line = g_string_new(text);
+	g_string_append_c(line, '\n');
+	free(text);
+	if(send(fd, line->str, line->len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)line->len) {
+		JANUS_LOG(LOG_WARN, "Couldn't send the whole reply to client %d (%s)\n", fd, g_strerror(errno));
+	}
+	g_string_free(line, TRUE);
+}
+
+static void janus_pp_rec_daemon_spool_result(const char *working_file, gboolean success, json_t *result) {
+	/* name.working --> name.done or name.failed */
+	char *base = g_strndup(working_file, strlen(working_file) - strlen(".working"));
+	char *target = g_strdup_printf("%s.%s", base, success ? "done" : "failed");
+	if(json_dump_file(result, target, JSON_INDENT(2) | JSON_PRESERVE_ORDER) < 0)
+		JANUS_LOG(LOG_ERR, "Couldn't save the result to %s\n", target);
+	if(g_unlink(working_file) < 0)
+		JANUS_LOG(LOG_WARN, "Couldn't remove %s (%s)\n", working_file, g_strerror(errno));
+	g_free(target);
+	g_free(base);
+}
+
+static json_t *janus_pp_rec_daemon_stats(void) {
+	gint64 uptime = g_get_monotonic_time() - daemon_started;
+	double secs = (double)uptime/G_USEC_PER_SEC;
+	guint32 completed = jobs_done + jobs_failed;
+	json_t *stats = json_object();
+	json_object_set_new(stats, "uptime", json_integer(uptime/G_USEC_PER_SEC));
+	json_object_set_new(stats, "workers", json_integer(g_hash_table_size(running)));
+	json_object_set_new(stats, "queued", json_integer(g_queue_get_length(jobs)));
+	json_object_set_new(stats, "done", json_integer(jobs_done));
+	json_object_set_new(stats, "failed", json_integer(jobs_failed));
+	json_object_set_new(stats, "jobs_per_sec", json_real(secs > 0 ? completed/secs : 0));
+	json_object_set_new(stats, "in_mbytes_per_sec", json_real(secs > 0 ? total_in_bytes/secs/(1024*1024) : 0));
+	json_object_set_new(stats, "out_mbytes_per_sec", json_real(secs > 0 ? total_out_bytes/secs/(1024*1024) : 0));
+	json_object_set_new(stats, "avg_queued_ms", json_integer(completed ? total_queued/completed/1000 : 0));
+	json_object_set_new(stats, "avg_elapsed_ms", json_integer(completed ? total_elapsed/completed/1000 : 0));
+	json_object_set_new(stats, "avg_cpu_ms", json_integer(completed ? total_cpu/completed/1000 : 0));
+	return stats;
+}
+
+static void janus_pp_rec_daemon_summary(void) {
+	gint64 uptime = g_get_monotonic_time() - daemon_started;
+	double secs = (double)uptime/G_USEC_PER_SEC;
+	guint32 completed = jobs_done + jobs_failed;
+	JANUS_LOG(LOG_INFO, "%"SCNu32" jobs (%"SCNu32" failed) in %.1fs: %.2f jobs/s, %.2f MB/s in, %.2f MB/s out, "
+		"%"SCNi64" ms per job (%"SCNi64" ms CPU, %"SCNi64" ms queued), %u running, %u queued\n",
+		completed, jobs_failed, secs,
+		secs > 0 ? completed/secs : 0,
+		secs > 0 ? total_in_bytes/secs/(1024*1024) : 0,
+		secs > 0 ? total_out_bytes/secs/(1024*1024) : 0,
+		completed ? total_elapsed/completed/1000 : 0,
+		completed ? total_cpu/completed/1000 : 0,
+		completed ? total_queued/completed/1000 : 0,
+		g_hash_table_size(running), g_queue_get_length(jobs));
+}
 
+/* Parse a job request: returns NULL and an error if it's not valid */
+static janus_pp_rec_job *janus_pp_rec_job_parse(json_t *root, const char **error) {
+	json_t *id = json_object_get(root, "id");
+	json_t *source = json_object_get(root, "source");
+	json_t *video = json_object_get(root, "video");
+	json_t *audio = json_object_get(root, "audio");
+	json_t *destination = json_object_get(root, "destination");
+	if(!destination || !json_is_string(destination)) {
+		*error = "Missing or invalid destination";
+		return NULL;
+	}
+	if(source && !json_is_string(source)) {
+		*error = "Invalid source";
+		return NULL;
+	}
+	if((video && !json_is_string(video)) || (audio && !json_is_string(audio))) {
+		*error = "Invalid video or audio";
+		return NULL;
+	}
+	if(!source && (!video || !audio)) {
+		*error = "Missing source (or video and audio)";
+		return NULL;
+	}
+	if(source && (video || audio)) {
+		*error = "Either a source or a video and an audio must be provided";
+		return NULL;
+	}
+	janus_pp_rec_job *job = g_malloc0(sizeof(janus_pp_rec_job));
+	if(id && json_is_string(id))
+		job->id = g_strdup(json_string_value(id));
+	else if(id && json_is_integer(id))
+		job->id = g_strdup_printf("%"JSON_INTEGER_FORMAT, json_integer_value(id));
+	job->source = g_strdup(json_string_value(source ? source : video));
+	if(audio)
+		job->audio = g_strdup(json_string_value(audio));
+	job->destination = g_strdup(json_string_value(destination));
+	job->client = -1;
+	/* Check the recordings are there now, rather than in the worker */
+	long size = janus_pp_rec_file_size(job->source);
+	long asize = job->audio ? janus_pp_rec_file_size(job->audio) : 0;
+	if(size < 0 || asize < 0) {
+		*error = "No such recording";
+		janus_pp_rec_job_free(job);
+		return NULL;
+	}
+	job->in_bytes = size + asize;
+	job->queued = g_get_monotonic_time();
+	return job;
+}
+
+static void janus_pp_rec_job_queue(janus_pp_rec_job *job) {
+	if(job->id == NULL)
+		job->id = g_strdup(job->destination);
+	JANUS_LOG(LOG_VERB, "[%s] Queued (%s%s%s --> %s)\n", job->id, job->source,
+		job->audio ? " + " : "", job->audio ? job->audio : "", job->destination);
+	g_queue_push_tail(jobs, job);
+}
+
+static void janus_pp_rec_job_start(janus_pp_rec_job *job) {
+	job->started = g_get_monotonic_time();
+	pid_t pid = fork();
+	if(pid < 0) {
+		JANUS_LOG(LOG_ERR, "[%s] Couldn't fork a worker (%s), trying again later\n", job->id, g_strerror(errno));
+		g_queue_push_head(jobs, job);
+		return;
+	}
+	if(pid == 0) {
+		/* Worker: stopping is up to the parent, which will send a SIGTERM if needed */
+		signal(SIGINT, SIG_IGN);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		close(signals[0]);
+		close(signals[1]);
+		if(listener > -1)
+			close(listener);
+		GList *l = clients;
+		while(l) {
+			janus_pp_rec_client *c = (janus_pp_rec_client *)l->data;
+			close(c->fd);
+			l = l->next;
+		}
+		janus_log_forked();
+		/* Unless we were asked otherwise, only warnings and errors from the workers */
+		if(!daemon_debug && janus_log_level > LOG_WARN)
+			janus_log_level = LOG_WARN;
+		working = 1;
+		int res = 0;
+		if(job->audio)
+			res = janus_pp_rec_merge(job->source, job->audio, job->destination);
+		else
+			res = janus_pp_rec_process(job->source, job->destination, FALSE, FALSE, FALSE);
+		janus_log_destroy();
+		/* No atexit handlers, those belong to the parent */
+		_exit(res == 0 ? 0 : 1);
+	}
+	job->pid = pid;
+	JANUS_LOG(LOG_VERB, "[%s] Started (pid %d)\n", job->id, (int)pid);
+	g_hash_table_insert(running, GINT_TO_POINTER(pid), job);
+}
+
+static void janus_pp_rec_job_done(janus_pp_rec_job *job, int status, struct rusage *usage) {
+	gint64 now = g_get_monotonic_time();
+	gboolean success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	long out_bytes = success ? janus_pp_rec_file_size(job->destination) : -1;
+	if(out_bytes < 0) {
+		success = FALSE;
+		out_bytes = 0;
+	}
+	gint64 queued = job->started - job->queued;
+	gint64 elapsed = now - job->started;
+	gint64 cpu = (gint64)usage->ru_utime.tv_sec*G_USEC_PER_SEC + usage->ru_utime.tv_usec +
+		(gint64)usage->ru_stime.tv_sec*G_USEC_PER_SEC + usage->ru_stime.tv_usec;
+	if(success)
+		jobs_done++;
+	else
+		jobs_failed++;
+	total_in_bytes += job->in_bytes;
+	total_out_bytes += out_bytes;
+	total_queued += queued;
+	total_elapsed += elapsed;
+	total_cpu += cpu;
+	if(success) {
+		JANUS_LOG(LOG_INFO, "[%s] Done in %"SCNi64" ms (%"SCNi64" ms CPU, %"SCNi64" ms queued), %ld --> %ld bytes\n",
+			job->id, elapsed/1000, cpu/1000, queued/1000, job->in_bytes, out_bytes);
+	} else if(WIFSIGNALED(status)) {
+		JANUS_LOG(LOG_ERR, "[%s] Worker killed by signal %d after %"SCNi64" ms\n", job->id, WTERMSIG(status), elapsed/1000);
+	} else {
+		JANUS_LOG(LOG_ERR, "[%s] Failed after %"SCNi64" ms (exit code %d)\n", job->id, elapsed/1000,
+			WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+	}
+	/* Let whoever asked know */
+	json_t *result = json_object();
+	json_object_set_new(result, "id", json_string(job->id));
+	json_object_set_new(result, "result", json_string(success ? "ok" : "error"));
+	if(WIFSIGNALED(status))
+		json_object_set_new(result, "signal", json_integer(WTERMSIG(status)));
+	else if(!success)
+		json_object_set_new(result, "exit", json_integer(WIFEXITED(status) ? WEXITSTATUS(status) : -1));
+	json_object_set_new(result, "destination", json_string(job->destination));
+	json_object_set_new(result, "queued_ms", json_integer(queued/1000));
+	json_object_set_new(result, "elapsed_ms", json_integer(elapsed/1000));
+	json_object_set_new(result, "cpu_ms", json_integer(cpu/1000));
+	json_object_set_new(result, "in_bytes", json_integer(job->in_bytes));
+	json_object_set_new(result, "out_bytes", json_integer(out_bytes));
+	if(job->client > -1)
+		janus_pp_rec_daemon_reply(job->client, result);
+	if(job->spool != NULL)
+		janus_pp_rec_daemon_spool_result(job->spool, success, result);
+	json_decref(result);
+	janus_pp_rec_job_free(job);
+}
+
+/* A line from a client: either a job, or a request for the stats */
+static void janus_pp_rec_daemon_request(janus_pp_rec_client *client, const char *line) {
+	json_error_t error;
+	json_t *root = json_loads(line, 0, &error);
+	json_t *reply = NULL;
+	if(!root || !json_is_object(root)) {
+		reply = json_object();
+		json_object_set_new(reply, "result", json_string("error"));
+		json_object_set_new(reply, "error", json_string(root ? "Not an object" : error.text));
+	} else {
+		json_t *request = json_object_get(root, "request");
+		if(request && json_is_string(request) && !strcasecmp(json_string_value(request), "stats")) {
+			reply = janus_pp_rec_daemon_stats();
+		} else {
+			const char *reason = NULL;
+			janus_pp_rec_job *job = janus_pp_rec_job_parse(root, &reason);
+			if(job == NULL) {
+				json_t *id = json_object_get(root, "id");
+				reply = json_object();
+				if(id)
+					json_object_set(reply, "id", id);
+				json_object_set_new(reply, "result", json_string("error"));
+				json_object_set_new(reply, "error", json_string(reason));
+			} else {
+				job->client = client->fd;
+				janus_pp_rec_job_queue(job);
+			}
+		}
+	}
+	if(root)
+		json_decref(root);
+	if(reply) {
+		janus_pp_rec_daemon_reply(client->fd, reply);
+		json_decref(reply);
+	}
+}
+
+static void janus_pp_rec_daemon_client_gone(janus_pp_rec_client *client) {
+	/* Nobody to send the results to anymore */
+	GList *l = jobs->head;
+	while(l) {
+		janus_pp_rec_job *job = (janus_pp_rec_job *)l->data;
+		if(job->client == client->fd)
+			job->client = -1;
+		l = l->next;
+	}
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, running);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_pp_rec_job *job = (janus_pp_rec_job *)value;
+		if(job->client == client->fd)
+			job->client = -1;
+	}
+	clients = g_list_remove(clients, client);
+	close(client->fd);
+	g_string_free(client->buffer, TRUE);
+	g_free(client);
+}
+
+/* Returns FALSE if the client went away */
+static gboolean janus_pp_rec_daemon_client_read(janus_pp_rec_client *client) {
+	char buffer[4096];
+	ssize_t res = recv(client->fd, buffer, sizeof(buffer), 0);
+	if(res < 0 && (errno == EAGAIN || errno == EINTR))
+		return TRUE;
+	if(res <= 0)
+		return FALSE;
+	g_string_append_len(client->buffer, buffer, res);
+	char *nl = NULL;
+	while((nl = memchr(client->buffer->str, '\n', client->buffer->len)) != NULL) {
+		*nl = '\0';
+		if(strlen(g_strstrip(client->buffer->str)) > 0)
+			janus_pp_rec_daemon_request(client, client->buffer->str);
+		g_string_erase(client->buffer, 0, nl - client->buffer->str + 1);
+	}
+	if(client->buffer->len > 64*1024) {
+		JANUS_LOG(LOG_WARN, "Client %d sent a too long line, closing\n", client->fd);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Look for new jobs in the spool folder: we rename the ones we take, so
+ * that many instances can share the same folder */
+static void janus_pp_rec_daemon_spool_scan(guint max) {
+	GDir *dir = g_dir_open(spool, 0, NULL);
+	if(dir == NULL)
+		return;
+	const char *name = NULL;
+	while(g_queue_get_length(jobs) < max && (name = g_dir_read_name(dir)) != NULL) {
+		if(!g_str_has_suffix(name, ".job"))
+			continue;
+		char *path = g_build_filename(spool, name, NULL);
+		char *working_file = g_strdup_printf("%.*s.working", (int)(strlen(path) - strlen(".job")), path);
+		if(g_rename(path, working_file) < 0) {
+			/* Somebody else took it */
+			g_free(working_file);
+			g_free(path);
+			continue;
+		}
+		g_free(path);
+		json_error_t error;
+		json_t *root = json_load_file(working_file, 0, &error);
+		const char *reason = NULL;
+		janus_pp_rec_job *job = NULL;
+		if(!root || !json_is_object(root))
+			reason = root ? "Not an object" : error.text;
+		else
+			job = janus_pp_rec_job_parse(root, &reason);
+		if(job == NULL) {
+			JANUS_LOG(LOG_ERR, "Invalid job %s: %s\n", name, reason);
+			json_t *result = json_object();
+			json_object_set_new(result, "result", json_string("error"));
+			json_object_set_new(result, "error", json_string(reason));
+			janus_pp_rec_daemon_spool_result(working_file, FALSE, result);
+			json_decref(result);
+			g_free(working_file);
+		} else {
+			if(job->id == NULL)
+				job->id = g_strndup(name, strlen(name) - strlen(".job"));
+			job->spool = working_file;
+			janus_pp_rec_job_queue(job);
+		}
+		if(root)
+			json_decref(root);
+	}
+	g_dir_close(dir);
+}
+
+/* Put jobs we took but didn't process back where they were */
+static void janus_pp_rec_daemon_spool_restore(void) {
+	GDir *dir = g_dir_open(spool, 0, NULL);
+	if(dir == NULL)
+		return;
+	const char *name = NULL;
+	while((name = g_dir_read_name(dir)) != NULL) {
+		if(!g_str_has_suffix(name, ".working"))
+			continue;
+		char *path = g_build_filename(spool, name, NULL);
+		char *job_file = g_strdup_printf("%.*s.job", (int)(strlen(path) - strlen(".working")), path);
+		if(g_rename(path, job_file) < 0)
+			JANUS_LOG(LOG_WARN, "Couldn't rename %s back to %s\n", path, job_file);
+		g_free(job_file);
+		g_free(path);
+	}
+	g_dir_close(dir);
+}
+
+static int janus_pp_rec_daemon(const char *path, int workers) {
+	jobs = g_queue_new();
+	running = g_hash_table_new(NULL, NULL);
+	if(g_file_test(path, G_FILE_TEST_IS_DIR)) {
+		/* Spool folder: jobs left in .working by a previous instance go back in the queue */
+		spool = g_strdup(path);
+		janus_pp_rec_daemon_spool_restore();
+		JANUS_LOG(LOG_INFO, "Processing jobs from spool folder %s with %d workers\n", spool, workers);
+	} else {
+		/* UNIX socket */
+		struct sockaddr_un address;
+		if(strlen(path) >= sizeof(address.sun_path)) {
+			JANUS_LOG(LOG_FATAL, "Socket path too long: %s\n", path);
+			return 1;
+		}
+		struct stat st;
+		if(stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+			unlink(path);
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		g_snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+		if(listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+				listen(listener, 64) < 0) {
+			JANUS_LOG(LOG_FATAL, "Couldn't listen on %s: %s\n", path, g_strerror(errno));
+			if(listener > -1)
+				close(listener);
+			return 1;
+		}
+		fcntl(listener, F_SETFL, O_NONBLOCK);
+		JANUS_LOG(LOG_INFO, "Processing jobs from UNIX socket %s with %d workers\n", path, workers);
+	}
+	if(pipe(signals) < 0) {
+		JANUS_LOG(LOG_FATAL, "Couldn't create the signals pipe: %s\n", g_strerror(errno));
+		return 1;
+	}
+	fcntl(signals[0], F_SETFL, O_NONBLOCK);
+	fcntl(signals[1], F_SETFL, O_NONBLOCK);
+	signal(SIGCHLD, janus_pp_rec_daemon_signal);
+	signal(SIGINT, janus_pp_rec_daemon_signal);
+	signal(SIGTERM, janus_pp_rec_daemon_signal);
+	signal(SIGPIPE, SIG_IGN);
+	/* FFmpeg is set up here once, the workers inherit it as it is */
+	av_register_all();
+
+	daemon_started = g_get_monotonic_time();
+	gint64 last_summary = daemon_started;
+	guint32 last_completed = 0;
+	int stopping = 0;
+	while(TRUE) {
+		/* Start as many jobs as we can */
+		while(!stopping && g_hash_table_size(running) < (guint)workers && !g_queue_is_empty(jobs)) {
+			janus_pp_rec_job *job = (janus_pp_rec_job *)g_queue_pop_head(jobs);
+			janus_pp_rec_job_start(job);
+			if(job->pid == 0)
+				break;
+		}
+		if(stopping && g_hash_table_size(running) == 0)
+			break;
+		/* Wait for something to happen */
+		int nfds = 1 + (listener > -1 ? 1 : 0) + g_list_length(clients);
+		struct pollfd *fds = g_malloc0(nfds * sizeof(struct pollfd));
+		fds[0].fd = signals[0];
+		fds[0].events = POLLIN;
+		int i = 1;
+		if(listener > -1) {
+			fds[i].fd = listener;
+			fds[i].events = POLLIN;
+			i++;
+		}
+		GList *l = clients;
+		while(l) {
+			janus_pp_rec_client *c = (janus_pp_rec_client *)l->data;
+			fds[i].fd = c->fd;
+			fds[i].events = POLLIN;
+			i++;
+			l = l->next;
+		}
+		int res = poll(fds, nfds, 1000);
+		if(res < 0 && errno != EINTR) {
+			JANUS_LOG(LOG_FATAL, "Error polling: %s\n", g_strerror(errno));
+			g_free(fds);
+			break;
+		}
+		if(res > 0 && (fds[0].revents & POLLIN)) {
+			char sigs[64];
+			ssize_t n = 0, j = 0;
+			gboolean reap = FALSE;
+			while((n = read(signals[0], sigs, sizeof(sigs))) > 0) {
+				for(j=0; j<n; j++) {
+					if(sigs[j] == SIGCHLD) {
+						reap = TRUE;
+					} else if(!stopping) {
+						/* Stop accepting jobs, and wait for the running ones */
+						stopping = 1;
+						if(listener > -1) {
+							close(listener);
+							listener = -1;
+							unlink(path);
+						}
+						JANUS_LOG(LOG_INFO, "Stopping, waiting for %u running jobs (send the signal again to abort them)\n",
+							g_hash_table_size(running));
+					} else if(stopping == 1) {
+						/* Abort the running jobs too */
+						stopping = 2;
+						JANUS_LOG(LOG_WARN, "Aborting %u running jobs\n", g_hash_table_size(running));
+						GHashTableIter iter;
+						gpointer value;
+						g_hash_table_iter_init(&iter, running);
+						while(g_hash_table_iter_next(&iter, NULL, &value))
+							kill(((janus_pp_rec_job *)value)->pid, SIGTERM);
+					}
+				}
+			}
+			if(reap) {
+				int status = 0;
+				struct rusage usage;
+				pid_t pid = 0;
+				while((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+					janus_pp_rec_job *job = g_hash_table_lookup(running, GINT_TO_POINTER(pid));
+					if(job == NULL)
+						continue;
+					g_hash_table_remove(running, GINT_TO_POINTER(pid));
+					janus_pp_rec_job_done(job, status, &usage);
+				}
+			}
+		}
+		if(res > 0 && listener > -1 && (fds[1].revents & POLLIN) && !stopping) {
+			int fd = -1;
+			while((fd = accept(listener, NULL, NULL)) > -1) {
+				fcntl(fd, F_SETFL, O_NONBLOCK);
+				janus_pp_rec_client *client = g_malloc0(sizeof(janus_pp_rec_client));
+				client->fd = fd;
+				client->buffer = g_string_new(NULL);
+				clients = g_list_append(clients, client);
+				JANUS_LOG(LOG_VERB, "New client (%d)\n", fd);
+			}
+		}
+		if(res > 0) {
+			/* Clients, in the same order we added them to the poll */
+			i = 1 + (listener > -1 ? 1 : 0);
+			GList *gone = NULL;
+			l = clients;
+			while(l && i < nfds) {
+				janus_pp_rec_client *c = (janus_pp_rec_client *)l->data;
+				if(fds[i].fd == c->fd && fds[i].revents) {
+					if(!janus_pp_rec_daemon_client_read(c))
+						gone = g_list_prepend(gone, c);
+				}
+				i++;
+				l = l->next;
+			}
+			for(l = gone; l; l = l->next) {
+				JANUS_LOG(LOG_VERB, "Client %d gone\n", ((janus_pp_rec_client *)l->data)->fd);
+				janus_pp_rec_daemon_client_gone((janus_pp_rec_client *)l->data);
+			}
+			g_list_free(gone);
+		}
+		g_free(fds);
+		if(spool != NULL && !stopping && g_queue_get_length(jobs) < (guint)(2*workers))
+			janus_pp_rec_daemon_spool_scan(2*workers);
+		/* Every now and then, the throughput so far */
+		gint64 now = g_get_monotonic_time();
+		if(now - last_summary >= 10*G_USEC_PER_SEC && jobs_done + jobs_failed != last_completed) {
+			janus_pp_rec_daemon_summary();
+			last_summary = now;
+			last_completed = jobs_done + jobs_failed;
+		}
+	}
+
+	/* Jobs we didn't get to */
+	janus_pp_rec_job *job = NULL;
+	while((job = (janus_pp_rec_job *)g_queue_pop_head(jobs)) != NULL) {
+		if(job->client > -1) {
+			json_t *reply = json_object();
+			json_object_set_new(reply, "id", json_string(job->id));
+			json_object_set_new(reply, "result", json_string("error"));
+			json_object_set_new(reply, "error", json_string("Shutting down"));
+			janus_pp_rec_daemon_reply(job->client, reply);
+			json_decref(reply);
+		}
+		janus_pp_rec_job_free(job);
+	}
+	if(spool != NULL)
+		janus_pp_rec_daemon_spool_restore();
+	janus_pp_rec_daemon_summary();
+	while(clients != NULL)
+		janus_pp_rec_daemon_client_gone((janus_pp_rec_client *)clients->data);
+	if(listener > -1) {
+		close(listener);
+		unlink(path);
+	}
+	close(signals[0]);
+	close(signals[1]);
+	g_hash_table_destroy(running);
+	g_queue_free(jobs);
+	g_free(spool);
 	JANUS_LOG(LOG_INFO, "Bye!\n");
 	return 0;
 }
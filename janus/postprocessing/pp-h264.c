@@ -2,8 +2,10 @@
  * \author   Lorenzo Miniero <lorenzo@meetecho.com>
  * \copyright GNU General Public License v3
  * \brief    Post-processing to generate .mp4 files
- * \details  Implementation of the post-processing code (based on FFmpeg)
- * needed to generate .mp4 files out of H.264 RTP frames.
+ * \details  Implementation of the post-processing code needed to generate
+ * .mp4 files out of H.264 RTP frames, optionally muxed with the Opus RTP
+ * frames of a separate audio recording. The frames are depacketized here,
+ * and written by the native fragmented MP4 writer in \ref mp4.h.
  *
  * \ingroup postprocessing
  * \ref postprocessing
@@ -19,128 +21,51 @@
 #include <string.h>
 #include <stdlib.h>
 
-#include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
-
 #include "pp-h264.h"
+#include "../mp4.h"
 #include "../debug.h"
 
 
-#define LIBAVCODEC_VER_AT_LEAST(major, minor) \
-	(LIBAVCODEC_VERSION_MAJOR > major || \
-	 (LIBAVCODEC_VERSION_MAJOR == major && \
-	  LIBAVCODEC_VERSION_MINOR >= minor))
-
-#if LIBAVCODEC_VER_AT_LEAST(51, 42)
-#define PIX_FMT_YUV420P AV_PIX_FMT_YUV420P
-#endif
-
-#if LIBAVCODEC_VER_AT_LEAST(56, 56)
-#ifndef CODEC_FLAG_GLOBAL_HEADER
-#define CODEC_FLAG_GLOBAL_HEADER AV_CODEC_FLAG_GLOBAL_HEADER
-#endif
-#ifndef FF_INPUT_BUFFER_PADDING_SIZE
-#define FF_INPUT_BUFFER_PADDING_SIZE AV_INPUT_BUFFER_PADDING_SIZE
-#endif
-#endif
-
-#if LIBAVCODEC_VER_AT_LEAST(57, 14)
-#define USE_CODECPAR
-#endif
-
-
 /* MP4 output */
-static AVFormatContext *fctx;
-static AVStream *vStream;
-#ifdef USE_CODECPAR
-static AVCodecContext *vEncoder;
-#endif
+static janus_mp4 *mp4 = NULL;
 static int max_width = 0, max_height = 0, fps = 0;
+/* Audio to mux, if any */
+static janus_pp_opus_track *aTrack = NULL;
 
 
-int janus_pp_h264_create(char *destination) {
+int janus_pp_h264_create(char *destination, janus_pp_opus_track *audio) {
 	if(destination == NULL)
 		return -1;
-	/* Setup FFmpeg */
-	av_register_all();
-	/* Adjust logging to match the postprocessor's */
-	av_log_set_level(janus_log_level <= LOG_NONE ? AV_LOG_QUIET :
-		(janus_log_level == LOG_FATAL ? AV_LOG_FATAL :
-			(janus_log_level == LOG_ERR ? AV_LOG_ERROR :
-				(janus_log_level == LOG_WARN ? AV_LOG_WARNING :
-					(janus_log_level == LOG_INFO ? AV_LOG_INFO :
-						(janus_log_level == LOG_VERB ? AV_LOG_VERBOSE : AV_LOG_DEBUG))))));
-	/* MP4 output */
-	fctx = avformat_alloc_context();
-	if(fctx == NULL) {
-		JANUS_LOG(LOG_ERR, "Error allocating context\n");
-		return -1;
-	}
-	fctx->oformat = av_guess_format("mp4", NULL, NULL);
-	if(fctx->oformat == NULL) {
-		JANUS_LOG(LOG_ERR, "Error guessing format\n");
-		return -1;
-	}
-	snprintf(fctx->filename, sizeof(fctx->filename), "%s", destination);
-#ifdef USE_CODECPAR
-	AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
-	if(!codec) {
-		/* Error opening video codec */
-		JANUS_LOG(LOG_ERR, "Encoder not available\n");
-		return -1;
-	}
-	fctx->video_codec = codec;
-	fctx->oformat->video_codec = codec->id;
-	vStream = avformat_new_stream(fctx, codec);
-	vStream->id = fctx->nb_streams-1;
-	vEncoder = avcodec_alloc_context3(codec);
-	vEncoder->width = max_width;
-	vEncoder->height = max_height;
-	vEncoder->time_base = (AVRational){ 1, fps };
-	vEncoder->pix_fmt = AV_PIX_FMT_YUV420P;
-	vEncoder->flags |= CODEC_FLAG_GLOBAL_HEADER;
-	if(avcodec_open2(vEncoder, codec, NULL) < 0) {
-		/* Error opening video codec */
-		JANUS_LOG(LOG_ERR, "Encoder error\n");
-		return -1;
-	}
-	avcodec_parameters_from_context(vStream->codecpar, vEncoder);
-#else
-	vStream = avformat_new_stream(fctx, 0);
-	if(vStream == NULL) {
-		JANUS_LOG(LOG_ERR, "Error adding stream\n");
-		return -1;
-	}
-#if LIBAVCODEC_VER_AT_LEAST(53, 21)
-	avcodec_get_context_defaults3(vStream->codec, AVMEDIA_TYPE_VIDEO);
-#else
-	avcodec_get_context_defaults2(vStream->codec, AVMEDIA_TYPE_VIDEO);
-#endif
-#if LIBAVCODEC_VER_AT_LEAST(54, 25)
-	vStream->codec->codec_id = AV_CODEC_ID_H264;
-#else
-	vStream->codec->codec_id = CODEC_ID_H264;
-#endif
-	vStream->codec->codec_type = AVMEDIA_TYPE_VIDEO;
-	vStream->codec->time_base = (AVRational){1, fps};
-	vStream->time_base = (AVRational){1, 90000};
-	vStream->codec->width = max_width;
-	vStream->codec->height = max_height;
-	vStream->codec->pix_fmt = PIX_FMT_YUV420P;
-	//~ if (fctx->flags & AVFMT_GLOBALHEADER)
-		vStream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
-#endif
-	if(avio_open(&fctx->pb, fctx->filename, AVIO_FLAG_WRITE) < 0) {
-		JANUS_LOG(LOG_ERR, "Error opening file for output\n");
-		return -1;
+	if(audio != NULL) {
+		if(janus_pp_opus_track_start(audio) < 0) {
+			JANUS_LOG(LOG_ERR, "Error adding audio track\n");
+			return -1;
+		}
+		aTrack = audio;
 	}
-	if(avformat_write_header(fctx, NULL) < 0) {
-		JANUS_LOG(LOG_ERR, "Error writing header\n");
+	/* MP4 output, written natively rather than through FFmpeg */
+	mp4 = janus_mp4_create(destination, JANUS_MP4_H264, max_width, max_height, audio ? JANUS_MP4_OPUS : JANUS_MP4_NONE);
+	if(mp4 == NULL) {
+		JANUS_LOG(LOG_ERR, "Error creating .mp4 file\n");
 		return -1;
 	}
 	return 0;
 }
 
+/* Write the audio that comes before the specified time (in ms), or all of it */
+static void janus_pp_h264_write_audio(int64_t until) {
+	uint8_t buffer[1500];
+	int len = 0;
+	int64_t when = 0;
+	while((len = janus_pp_opus_track_read(aTrack, until, buffer, sizeof(buffer), &when)) > 0) {
+		if(janus_mp4_write_audio(mp4, buffer, len, when*48) < 0) {
+			JANUS_LOG(LOG_ERR, "Error writing audio frame to file...\n");
+			continue;
+		}
+		aTrack->written++;
+	}
+}
+
 /* Helpers to decode Exp-Golomb */
 static uint32_t janus_pp_h264_eg_getbit(uint8_t *base, uint32_t offset) {
 	return ((*(base + (offset >> 0x3))) >> (0x7 - (offset & 0x7))) & 0x1;
@@ -463,30 +388,25 @@ int janus_pp_h264_process(FILE *file, janus_pp_frame_packet *list, int *working)
 		}
 		if(frameLen > 0) {
 			/* Save the frame */
-			memset(received_frame + frameLen, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-
-			AVPacket packet;
-			av_init_packet(&packet);
-			packet.stream_index = 0;
-			packet.data = received_frame;
-			packet.size = frameLen;
-			if(keyFrame)
-				packet.flags |= AV_PKT_FLAG_KEY;
-
-			/* First we save to the file... */
-			packet.dts = tmp->ts-list->ts;
-			packet.pts = tmp->ts-list->ts;
+			uint64_t pts = tmp->ts-list->ts;
 			JANUS_LOG(LOG_HUGE, "%"SCNu64" - %"SCNu64" --> %"SCNu64"\n",
-				tmp->ts, list->ts, packet.pts);
-			if(fctx) {
-				int res = av_write_frame(fctx, &packet);
-				if(res < 0) {
-					JANUS_LOG(LOG_ERR, "Error writing video frame to file... (error %d)\n", res);
-				}
+				tmp->ts, list->ts, pts);
+			/* First the audio that comes before this frame, if we're muxing... */
+			if(aTrack)
+				janus_pp_h264_write_audio(pts/90);
+			/* ... then the frame itself */
+			if(mp4 && janus_mp4_write_video(mp4, received_frame, frameLen, pts, keyFrame) < 0) {
+				JANUS_LOG(LOG_ERR, "Error writing video frame to file...\n");
 			}
 		}
 		tmp = tmp->next;
 	}
+	if(aTrack) {
+		/* Write the audio left, if any */
+		if(*working)
+			janus_pp_h264_write_audio(-1);
+		JANUS_LOG(LOG_INFO, "Muxed %"SCNu32" audio packets (%"SCNu32" dropped)\n", aTrack->written, aTrack->dropped);
+	}
 	g_free(received_frame);
 	g_free(start);
 	return 0;
@@ -494,23 +414,8 @@ int janus_pp_h264_process(FILE *file, janus_pp_frame_packet *list, int *working)
 
 /* Close MP4 file */
 void janus_pp_h264_close(void) {
-	if(fctx != NULL)
-		av_write_trailer(fctx);
-#ifdef USE_CODECPAR
-	if(vEncoder != NULL)
-		avcodec_close(vEncoder);
-#else
-	if(vStream != NULL && vStream->codec != NULL)
-		avcodec_close(vStream->codec);
-#endif
-	if(fctx != NULL && fctx->streams[0] != NULL) {
-#ifndef USE_CODECPAR
-		av_free(fctx->streams[0]->codec);
-#endif
-		av_free(fctx->streams[0]);
-	}
-	if(fctx != NULL) {
-		avio_close(fctx->pb);
-		av_free(fctx);
-	}
+	if(mp4 != NULL && janus_mp4_close(mp4) < 0)
+		JANUS_LOG(LOG_ERR, "Error finalizing .mp4 file\n");
+	mp4 = NULL;
+	aTrack = NULL;
 }
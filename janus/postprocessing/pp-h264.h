@@ -2,8 +2,10 @@
  * \author   Lorenzo Miniero <lorenzo@meetecho.com>
  * \copyright GNU General Public License v3
  * \brief    Post-processing to generate .mp4 files (headers)
- * \details  Implementation of the post-processing code (based on FFmpeg)
- * needed to generate .mp4 files out of H.264 RTP frames.
+ * \details  Implementation of the post-processing code needed to generate
+ * .mp4 files out of H.264 RTP frames, optionally muxed with the Opus RTP
+ * frames of a separate audio recording. The frames are depacketized here,
+ * and written by the native fragmented MP4 writer in \ref mp4.h.
  * 
  * \ingroup postprocessing
  * \ref postprocessing
@@ -15,9 +17,10 @@
 #include <stdio.h>
 
 #include "pp-rtp.h"
+#include "pp-opus.h"
 
 /* H.264 stuff */
-int janus_pp_h264_create(char *destination);
+int janus_pp_h264_create(char *destination, janus_pp_opus_track *audio);
 int janus_pp_h264_preprocess(FILE *file, janus_pp_frame_packet *list);
 int janus_pp_h264_process(FILE *file, janus_pp_frame_packet *list, int *working);
 void janus_pp_h264_close(void);
@@ -20,12 +20,32 @@
 #include <stdlib.h>
 
 #include <ogg/ogg.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
 
 #include "pp-opus.h"
 #include "pp-opus-silence.h"
 #include "../debug.h"
 
 
+#define LIBAVCODEC_VER_AT_LEAST(major, minor) \
+	(LIBAVCODEC_VERSION_MAJOR > major || \
+	 (LIBAVCODEC_VERSION_MAJOR == major && \
+	  LIBAVCODEC_VERSION_MINOR >= minor))
+
+#if LIBAVCODEC_VER_AT_LEAST(56, 56)
+#ifndef CODEC_FLAG_GLOBAL_HEADER
+#define CODEC_FLAG_GLOBAL_HEADER AV_CODEC_FLAG_GLOBAL_HEADER
+#endif
+#ifndef FF_INPUT_BUFFER_PADDING_SIZE
+#define FF_INPUT_BUFFER_PADDING_SIZE AV_INPUT_BUFFER_PADDING_SIZE
+#endif
+#endif
+
+#if LIBAVCODEC_VER_AT_LEAST(57, 14)
+#define USE_CODECPAR
+#endif
+
 /* OGG/Opus helpers */
 FILE *ogg_file = NULL;
 ogg_stream_state *stream = NULL;
@@ -148,6 +168,113 @@ void janus_pp_opus_close(void) {
 }
 
 
+/* Opus track in a .webm/.mp4 file: the stream must be added before the header is written */
+int janus_pp_opus_track_add(janus_pp_opus_track *track, AVFormatContext *fctx) {
+	if(!track || !track->file || !track->list || !fctx)
+		return -1;
+	AVStream *aStream = avformat_new_stream(fctx, NULL);
+	if(aStream == NULL) {
+		JANUS_LOG(LOG_ERR, "Error adding audio stream\n");
+		return -1;
+	}
+	aStream->id = fctx->nb_streams-1;
+	/* The decoders expect the OpusHead as extradata, the same we put in .opus files */
+	ogg_packet *op = op_opushead();
+	uint8_t *extradata = av_mallocz(op->bytes + FF_INPUT_BUFFER_PADDING_SIZE);
+	memcpy(extradata, op->packet, op->bytes);
+#ifdef USE_CODECPAR
+	aStream->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+	aStream->codecpar->codec_id = AV_CODEC_ID_OPUS;
+	aStream->codecpar->sample_rate = 48000;
+	aStream->codecpar->channels = 2;
+	aStream->codecpar->channel_layout = AV_CH_LAYOUT_STEREO;
+	aStream->codecpar->extradata = extradata;
+	aStream->codecpar->extradata_size = op->bytes;
+#else
+	aStream->codec->codec_type = AVMEDIA_TYPE_AUDIO;
+	aStream->codec->codec_id = AV_CODEC_ID_OPUS;
+	aStream->codec->sample_rate = 48000;
+	aStream->codec->channels = 2;
+	aStream->codec->channel_layout = AV_CH_LAYOUT_STEREO;
+	aStream->codec->time_base = (AVRational){1, 48000};
+	aStream->codec->extradata = extradata;
+	aStream->codec->extradata_size = op->bytes;
+	if(fctx->oformat->flags & AVFMT_GLOBALHEADER)
+		aStream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+#endif
+	aStream->time_base = (AVRational){1, 48000};
+	op_free(op);
+	track->stream = aStream;
+	return janus_pp_opus_track_start(track);
+}
+
+int janus_pp_opus_track_start(janus_pp_opus_track *track) {
+	if(!track || !track->file || !track->list)
+		return -1;
+	track->next = track->list;
+	track->written = 0;
+	track->dropped = 0;
+	return 0;
+}
+
+/* Read the next audio packet, if it comes before the specified time (in ms,
+ * relative to the start of the video, or anything if until is negative) */
+int janus_pp_opus_track_read(janus_pp_opus_track *track, int64_t until, uint8_t *buffer, int size, int64_t *when) {
+	if(!track || !buffer || !when)
+		return -1;
+	int bytes = 0, len = 0;
+	while(track->next != NULL) {
+		janus_pp_frame_packet *tmp = track->next;
+		*when = (int64_t)((tmp->ts - track->list->ts)/48) + track->offset;
+		if(until >= 0 && *when > until)
+			break;
+		track->next = tmp->next;
+		if(tmp->drop || *when < 0) {
+			/* Either marked as one to drop before, or older than the first video frame */
+			track->dropped++;
+			continue;
+		}
+		fseek(track->file, tmp->offset+12+tmp->skip, SEEK_SET);
+		len = tmp->len-12-tmp->skip;
+		if(len < 1 || len > size)
+			continue;
+		bytes = fread(buffer, sizeof(char), len, track->file);
+		if(bytes != len) {
+			JANUS_LOG(LOG_WARN, "Didn't manage to read all the bytes we needed (%d < %d)...\n", bytes, len);
+			continue;
+		}
+		return len;
+	}
+	return 0;
+}
+
+/* Write the audio packets up to the specified time (in ms, relative to the
+ * start of the video), or all of the remaining ones if until is negative */
+int janus_pp_opus_track_write(janus_pp_opus_track *track, AVFormatContext *fctx, int64_t until) {
+	if(!track || !track->stream || !fctx)
+		return -1;
+	uint8_t buffer[1500];
+	int len = 0;
+	int64_t when = 0;
+	while((len = janus_pp_opus_track_read(track, until, buffer, sizeof(buffer), &when)) > 0) {
+		AVPacket packet;
+		av_init_packet(&packet);
+		packet.stream_index = track->stream->index;
+		packet.data = buffer;
+		packet.size = len;
+		packet.flags |= AV_PKT_FLAG_KEY;
+		packet.dts = av_rescale_q(when, (AVRational){1, 1000}, track->stream->time_base);
+		packet.pts = packet.dts;
+		if(av_write_frame(fctx, &packet) < 0) {
+			JANUS_LOG(LOG_ERR, "Error writing audio frame to file...\n");
+			continue;
+		}
+		track->written++;
+	}
+	return 0;
+}
+
+
 /* OGG/Opus helpers */
 /* Write a little-endian 32 bit int to memory */
 void le32(unsigned char *p, int v) {
@@ -20,4 +20,25 @@ int janus_pp_opus_create(char *destination);
 int janus_pp_opus_process(FILE *file, janus_pp_frame_packet *list, int *working);
 void janus_pp_opus_close(void);
 
+/* Opus as the audio track of a .webm or .mp4 file, when merging recordings */
+struct AVFormatContext;
+struct AVStream;
+typedef struct janus_pp_opus_track {
+	/* Recording the packets come from, and its ordered list */
+	FILE *file;
+	janus_pp_frame_packet *list;
+	/* Next packet to write */
+	janus_pp_frame_packet *next;
+	/* Milliseconds between the start of the video and the start of the audio */
+	int64_t offset;
+	/* Packets written and dropped so far */
+	uint32_t written, dropped;
+	struct AVStream *stream;
+} janus_pp_opus_track;
+int janus_pp_opus_track_add(janus_pp_opus_track *track, struct AVFormatContext *fctx);
+int janus_pp_opus_track_write(janus_pp_opus_track *track, struct AVFormatContext *fctx, int64_t until);
+/* Lower level access to the packets, for muxers that don't use FFmpeg */
+int janus_pp_opus_track_start(janus_pp_opus_track *track);
+int janus_pp_opus_track_read(janus_pp_opus_track *track, int64_t until, uint8_t *buffer, int size, int64_t *when);
+
 #endif
@@ -3,7 +3,8 @@
  * \copyright GNU General Public License v3
  * \brief    Post-processing to generate .webm files
  * \details  Implementation of the post-processing code (based on FFmpeg)
- * needed to generate .webm files out of VP8/VP9 RTP frames.
+ * needed to generate .webm files out of VP8/VP9 RTP frames, optionally
+ * muxed with the Opus RTP frames of a separate audio recording.
  *
  * \ingroup postprocessing
  * \ref postprocessing
@@ -65,8 +66,10 @@ static AVStream *vStream;
 static AVCodecContext *vEncoder;
 #endif
 static int max_width = 0, max_height = 0, fps = 0;
+/* Audio to mux, if any */
+static janus_pp_opus_track *aTrack = NULL;
 
-int janus_pp_webm_create(char *destination, int vp8) {
+int janus_pp_webm_create(char *destination, int vp8, janus_pp_opus_track *audio) {
 	if(destination == NULL)
 		return -1;
 #if LIBAVCODEC_VERSION_MAJOR < 55
@@ -151,6 +154,14 @@ int janus_pp_webm_create(char *destination, int vp8) {
 	if (fctx->flags & AVFMT_GLOBALHEADER)
 		vStream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
 #endif
+	if(audio != NULL) {
+		/* Opus is fine in WebM, we mux the audio recording too */
+		if(janus_pp_opus_track_add(audio, fctx) < 0) {
+			JANUS_LOG(LOG_ERR, "Error adding audio track\n");
+			return -1;
+		}
+		aTrack = audio;
+	}
 	//~ fctx->timestamp = 0;
 	//~ if(url_fopen(&fctx->pb, fctx->filename, URL_WRONLY) < 0) {
 	if(avio_open(&fctx->pb, fctx->filename, AVIO_FLAG_WRITE) < 0) {
@@ -620,6 +631,9 @@ int janus_pp_webm_process(FILE *file, janus_pp_frame_packet *list, int vp8, int
 			//~ packet.pts = AV_NOPTS_VALUE;
 			packet.dts = (tmp->ts-list->ts)/90;
 			packet.pts = (tmp->ts-list->ts)/90;
+			/* ... after the audio that comes before this frame, if we're muxing */
+			if(aTrack)
+				janus_pp_opus_track_write(aTrack, fctx, packet.pts);
 			if(fctx) {
 				if(av_write_frame(fctx, &packet) < 0) {
 					JANUS_LOG(LOG_ERR, "Error writing video frame to file...\n");
@@ -628,6 +642,12 @@ int janus_pp_webm_process(FILE *file, janus_pp_frame_packet *list, int vp8, int
 		}
 		tmp = tmp->next;
 	}
+	if(aTrack) {
+		/* Write the audio left, if any */
+		if(*working)
+			janus_pp_opus_track_write(aTrack, fctx, -1);
+		JANUS_LOG(LOG_INFO, "Muxed %"SCNu32" audio packets (%"SCNu32" dropped)\n", aTrack->written, aTrack->dropped);
+	}
 	g_free(received_frame);
 	g_free(start);
 	return 0;
@@ -644,11 +664,16 @@ void janus_pp_webm_close(void) {
 	if(vStream != NULL && vStream->codec != NULL)
 		avcodec_close(vStream->codec);
 #endif
-	if(fctx != NULL && fctx->streams[0] != NULL) {
+	if(fctx != NULL) {
+		unsigned int i = 0;
+		for(i=0; i<fctx->nb_streams; i++) {
+			if(fctx->streams[i] == NULL)
+				continue;
 #ifndef USE_CODECPAR
-		av_free(fctx->streams[0]->codec);
+			av_free(fctx->streams[i]->codec);
 #endif
-		av_free(fctx->streams[0]);
+			av_free(fctx->streams[i]);
+		}
 	}
 	if(fctx != NULL) {
 		//~ url_fclose(fctx->pb);
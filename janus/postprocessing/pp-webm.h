@@ -3,7 +3,8 @@
  * \copyright GNU General Public License v3
  * \brief    Post-processing to generate .webm files (headers)
  * \details  Implementation of the post-processing code (based on FFmpeg)
- * needed to generate .webm files out of VP8/VP9 RTP frames.
+ * needed to generate .webm files out of VP8/VP9 RTP frames, optionally
+ * muxed with the Opus RTP frames of a separate audio recording.
  * 
  * \ingroup postprocessing
  * \ref postprocessing
@@ -15,9 +16,10 @@
 #include <stdio.h>
 
 #include "pp-rtp.h"
+#include "pp-opus.h"
 
 /* WebM stuff */
-int janus_pp_webm_create(char *destination, int vp8);
+int janus_pp_webm_create(char *destination, int vp8, janus_pp_opus_track *audio);
 int janus_pp_webm_preprocess(FILE *file, janus_pp_frame_packet *list, int vp8);
 int janus_pp_webm_process(FILE *file, janus_pp_frame_packet *list, int vp8, int *working);
 void janus_pp_webm_close(void);
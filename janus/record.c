@@ -7,7 +7,13 @@
  * file just saves RTP frames in a structured way, so that they can be
  * post-processed later on to get a valid container file (e.g., a .opus
  * file for Opus audio or a .webm file for VP8 video) and keep things
- * simpler on the plugin and core side.
+ * simpler on the plugin and core side. Alternatively, the core can be
+ * configured to record H.264, VP8 and Opus to fragmented .mp4 files
+ * right away (see \ref janus_recorder_set_format): in that case frames
+ * are only queued here, and a thread per recorder reorders the packets
+ * in a small window, depacketizes them and writes fragments as it goes,
+ * so that the recording is playable as soon as it's closed, with no
+ * post-processing needed. Other codecs are still saved to .mjr files.
  * \note If you want to record both audio and video, you'll have to use
  * two different recorders. Any muxing in the same container will have
  * to be done in the post-processing phase.
@@ -25,9 +31,13 @@
 #include <jansson.h>
 
 #include "record.h"
+#include "mp4.h"
+#include "rtp.h"
 #include "debug.h"
 #include "utils.h"
 
+#include "rtp-payload.h"
+
 #define htonll(x) ((1==htonl(1)) ? (x) : ((gint64)htonl((x) & 0xFFFFFFFF) << 32) | htonl((x) >> 32))
 #define ntohll(x) ((1==ntohl(1)) ? (x) : ((gint64)ntohl((x) & 0xFFFFFFFF) << 32) | ntohl((x) >> 32))
 
@@ -41,6 +51,8 @@ static const char *frame_header = "MEETECHO";
 static gboolean rec_tempname = FALSE;
 /* Extension to add in case tempnames is true (default="tmp" --> ".tmp") */
 static char *rec_tempext = NULL;
+/* Format to record to, when the codec allows it (default=.mjr) */
+static janus_recorder_format rec_format = JANUS_RECORDER_MJR;
 
 void janus_recorder_init(gboolean tempnames, const char *extension) {
 	JANUS_LOG(LOG_INFO, "Initializing recorder code\n");
@@ -59,6 +71,322 @@ void janus_recorder_init(gboolean tempnames, const char *extension) {
 void janus_recorder_deinit(void) {
 	rec_tempname = FALSE;
 	g_free(rec_tempext);
+	rec_format = JANUS_RECORDER_MJR;
+}
+
+int janus_recorder_set_format(const char *format) {
+	if(format == NULL || !strcasecmp(format, "mjr")) {
+		rec_format = JANUS_RECORDER_MJR;
+	} else if(!strcasecmp(format, "mp4")) {
+		rec_format = JANUS_RECORDER_MP4;
+		JANUS_LOG(LOG_INFO, "  -- Recording H.264, VP8 and Opus to .mp4 files\n");
+	} else {
+		JANUS_LOG(LOG_ERR, "Unsupported recording format '%s'\n", format);
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Live MP4 recording: packets are queued by the media path, and a thread
+ * per recorder puts them back in order, depacketizes them (librtp) and
+ * writes the .mp4 file. Packets wait in the reorder window until the gap
+ * before them is filled, or for at most JANUS_RECORDER_MP4_DELAY, and the
+ * window never holds more than JANUS_RECORDER_MP4_WINDOW packets */
+#define JANUS_RECORDER_MP4_WINDOW	32
+#define JANUS_RECORDER_MP4_DELAY	100000
+/* If the thread can't keep up, we drop what goes beyond this */
+#define JANUS_RECORDER_MP4_QUEUE	2048
+
+typedef struct janus_recorder_packet {
+	/* When we got it (monotonic) */
+	gint64 received;
+	/* Extended sequence number, set by the thread */
+	uint32_t seq;
+	int length;
+	char data[];
+} janus_recorder_packet;
+static janus_recorder_packet exit_packet;
+
+typedef struct janus_recorder_mp4 janus_recorder_mp4;
+struct janus_recorder_mp4 {
+	/* The file we're writing, and what we're writing there */
+	janus_mp4 *mp4;
+	janus_mp4_codec codec;
+	char *name;
+	/* Packets to write, and the thread writing them */
+	GAsyncQueue *packets;
+	GThread *thread;
+	/* Reorder window, sorted by extended sequence number */
+	GQueue *window;
+	gboolean seq_started;
+	uint32_t seq_max, seq_next;
+	/* Depacketizer */
+	void *decoder;
+	/* H.264 frame being put together from the NAL units */
+	GByteArray *frame;
+	uint32_t frame_ts;
+	gboolean frame_key;
+	/* RTP timestamps, extended and relative to the first packet */
+	gboolean ts_started;
+	uint32_t ts_last;
+	uint64_t ts_ext;
+	/* Statistics */
+	uint32_t dropped, late, lost;
+	gboolean failed;
+};
+
+/* Only let librtp see packets it won't choke on */
+static gboolean janus_recorder_mp4_check(janus_recorder_mp4 *rm, char *buffer, uint length) {
+	if(length < 12)
+		return FALSE;
+	janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+	int hlen = 12 + rtp->csrccount*4;
+	if(rtp->version != 2 || (int)length < hlen + (rtp->extension ? 4 : 0) + (rtp->padding ? 1 : 0))
+		return FALSE;
+	int plen = length - hlen;
+	if(rtp->extension) {
+		janus_rtp_header_extension *ext = (janus_rtp_header_extension *)(buffer+hlen);
+		int extlen = ntohs(ext->length)*4;
+		if(extlen + 4 > plen)
+			return FALSE;
+		hlen += extlen + 4;
+		plen -= extlen + 4;
+	}
+	if(rtp->padding)
+		plen -= (uint8_t)buffer[length-1];
+	if(plen < 1)
+		return FALSE;
+	/* The H.264 depacketizer doesn't like reserved NAL types either */
+	if(rm->codec == JANUS_MP4_H264 && ((buffer[hlen] & 0x1F) == 0 || (buffer[hlen] & 0x1F) == 31))
+		return FALSE;
+	return TRUE;
+}
+
+static uint64_t janus_recorder_mp4_time(janus_recorder_mp4 *rm, uint32_t timestamp) {
+	if(!rm->ts_started) {
+		rm->ts_started = TRUE;
+		rm->ts_last = timestamp;
+		rm->ts_ext = 0;
+		return 0;
+	}
+	int32_t diff = (int32_t)(timestamp - rm->ts_last);
+	rm->ts_last = timestamp;
+	if(diff < 0 && (uint64_t)(-(int64_t)diff) > rm->ts_ext)
+		rm->ts_ext = 0;
+	else
+		rm->ts_ext += diff;
+	return rm->ts_ext;
+}
+
+static void janus_recorder_mp4_write(janus_recorder_mp4 *rm, const uint8_t *data, int len, uint32_t timestamp, int keyframe) {
+	if(rm->failed)
+		return;
+	uint64_t pts = janus_recorder_mp4_time(rm, timestamp);
+	int res = (rm->codec == JANUS_MP4_OPUS) ?
+		janus_mp4_write_audio(rm->mp4, data, len, pts) :
+		janus_mp4_write_video(rm->mp4, data, len, pts, keyframe);
+	if(res < 0) {
+		JANUS_LOG(LOG_ERR, "Error writing to %s, nothing more will be recorded\n", rm->name);
+		rm->failed = TRUE;
+	}
+}
+
+static void janus_recorder_mp4_frame(janus_recorder_mp4 *rm) {
+	if(rm->frame->len == 0)
+		return;
+	janus_recorder_mp4_write(rm, rm->frame->data, rm->frame->len, rm->frame_ts, rm->frame_key);
+	g_byte_array_set_size(rm->frame, 0);
+	rm->frame_key = FALSE;
+}
+
+/* librtp callbacks */
+static void *janus_recorder_mp4_alloc(void *param, int bytes) {
+	return g_malloc(bytes);
+}
+
+static void janus_recorder_mp4_free(void *param, void *packet) {
+	g_free(packet);
+}
+
+static void janus_recorder_mp4_packet(void *param, const void *packet, int bytes, uint32_t timestamp, int flags) {
+	janus_recorder_mp4 *rm = (janus_recorder_mp4 *)param;
+	const uint8_t *data = (const uint8_t *)packet;
+	if(flags & RTP_PAYLOAD_FLAG_PACKET_LOST)
+		rm->lost++;
+	if(bytes < 1)
+		return;
+	if(rm->codec == JANUS_MP4_H264) {
+		/* We get NAL units one by one: a new timestamp means a new frame */
+		if(timestamp != rm->frame_ts)
+			janus_recorder_mp4_frame(rm);
+		static const uint8_t start_code[] = { 0x00, 0x00, 0x00, 0x01 };
+		g_byte_array_append(rm->frame, start_code, sizeof(start_code));
+		g_byte_array_append(rm->frame, data, bytes);
+		rm->frame_ts = timestamp;
+		if((data[0] & 0x1F) == 5)
+			rm->frame_key = TRUE;
+	} else {
+		/* VP8 frames and Opus packets are complete already */
+		janus_recorder_mp4_write(rm, data, bytes, timestamp, !(data[0] & 0x01));
+	}
+}
+
+static uint32_t janus_recorder_mp4_seq(janus_recorder_mp4 *rm, uint16_t seq) {
+	if(!rm->seq_started) {
+		/* Leave some room for packets that were sent before this one */
+		rm->seq_started = TRUE;
+		rm->seq_max = 0x10000 + seq;
+		rm->seq_next = rm->seq_max;
+		return rm->seq_max;
+	}
+	uint32_t ext = rm->seq_max + (int16_t)(seq - (uint16_t)rm->seq_max);
+	if(ext > rm->seq_max)
+		rm->seq_max = ext;
+	return ext;
+}
+
+static void janus_recorder_mp4_insert(janus_recorder_mp4 *rm, janus_recorder_packet *pkt) {
+	janus_rtp_header *rtp = (janus_rtp_header *)pkt->data;
+	pkt->seq = janus_recorder_mp4_seq(rm, ntohs(rtp->seq_number));
+	if(pkt->seq < rm->seq_next) {
+		/* Too late, we moved on already */
+		rm->late++;
+		g_free(pkt);
+		return;
+	}
+	/* Most of the times the packet goes at the end */
+	GList *l = rm->window->tail;
+	while(l != NULL && ((janus_recorder_packet *)l->data)->seq > pkt->seq)
+		l = l->prev;
+	if(l != NULL && ((janus_recorder_packet *)l->data)->seq == pkt->seq) {
+		/* Duplicate */
+		g_free(pkt);
+		return;
+	}
+	if(l == NULL)
+		g_queue_push_head(rm->window, pkt);
+	else
+		g_queue_insert_after(rm->window, l, pkt);
+}
+
+static void janus_recorder_mp4_release(janus_recorder_mp4 *rm, gboolean all) {
+	gint64 now = janus_get_monotonic_time();
+	janus_recorder_packet *pkt = NULL;
+	while((pkt = g_queue_peek_head(rm->window)) != NULL) {
+		if(!all && pkt->seq != rm->seq_next && g_queue_get_length(rm->window) <= JANUS_RECORDER_MP4_WINDOW &&
+				now - pkt->received < JANUS_RECORDER_MP4_DELAY) {
+			/* Give the missing packets some more time */
+			break;
+		}
+		g_queue_pop_head(rm->window);
+		rm->seq_next = pkt->seq + 1;
+		rtp_payload_decode_input(rm->decoder, pkt->data, pkt->length);
+		g_free(pkt);
+	}
+}
+
+static void *janus_recorder_mp4_thread(void *data) {
+	janus_recorder_mp4 *rm = (janus_recorder_mp4 *)data;
+	JANUS_LOG(LOG_VERB, "Joining live MP4 recorder thread (%s)\n", rm->name);
+	janus_recorder_packet *pkt = NULL;
+	while(TRUE) {
+		pkt = g_async_queue_timeout_pop(rm->packets, JANUS_RECORDER_MP4_DELAY/5);
+		if(pkt == &exit_packet)
+			break;
+		if(pkt != NULL)
+			janus_recorder_mp4_insert(rm, pkt);
+		janus_recorder_mp4_release(rm, FALSE);
+	}
+	/* Write what's left, including the last H.264 frame */
+	janus_recorder_mp4_release(rm, TRUE);
+	if(rm->codec == JANUS_MP4_H264)
+		janus_recorder_mp4_frame(rm);
+	JANUS_LOG(LOG_VERB, "Leaving live MP4 recorder thread (%s)\n", rm->name);
+	return NULL;
+}
+
+static janus_recorder_mp4 *janus_recorder_mp4_create(const char *path, janus_mp4_codec codec) {
+	janus_mp4 *mp4 = (codec == JANUS_MP4_OPUS) ?
+		janus_mp4_create(path, JANUS_MP4_NONE, 0, 0, JANUS_MP4_OPUS) :
+		janus_mp4_create(path, codec, 0, 0, JANUS_MP4_NONE);
+	if(mp4 == NULL)
+		return NULL;
+	janus_recorder_mp4 *rm = g_malloc0(sizeof(janus_recorder_mp4));
+	rm->mp4 = mp4;
+	rm->codec = codec;
+	rm->name = g_strdup(path);
+	static struct rtp_payload_t handler = {
+		janus_recorder_mp4_alloc,
+		janus_recorder_mp4_free,
+		janus_recorder_mp4_packet
+	};
+	/* The payload type doesn't matter, as long as it's a dynamic one */
+	rm->decoder = rtp_payload_decode_create(96,
+		codec == JANUS_MP4_H264 ? "H264" : (codec == JANUS_MP4_VP8 ? "VP8" : "opus"), &handler, rm);
+	if(rm->decoder == NULL) {
+		JANUS_LOG(LOG_ERR, "Error creating the RTP depacketizer\n");
+		janus_mp4_close(mp4);
+		g_free(rm->name);
+		g_free(rm);
+		return NULL;
+	}
+	rm->window = g_queue_new();
+	rm->frame = g_byte_array_new();
+	rm->packets = g_async_queue_new();
+	GError *error = NULL;
+	rm->thread = g_thread_try_new("mp4 recorder", &janus_recorder_mp4_thread, rm, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the live MP4 recorder thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		rtp_payload_decode_destroy(rm->decoder);
+		janus_mp4_close(mp4);
+		g_async_queue_unref(rm->packets);
+		g_queue_free(rm->window);
+		g_byte_array_free(rm->frame, TRUE);
+		g_free(rm->name);
+		g_free(rm);
+		return NULL;
+	}
+	return rm;
+}
+
+/* Called with the recorder mutex locked */
+static int janus_recorder_mp4_queue(janus_recorder_mp4 *rm, char *buffer, uint length) {
+	if(!janus_recorder_mp4_check(rm, buffer, length))
+		return -2;
+	if(g_async_queue_length(rm->packets) >= JANUS_RECORDER_MP4_QUEUE) {
+		if(rm->dropped++ == 0)
+			JANUS_LOG(LOG_WARN, "Can't keep up with the packets to record to %s, dropping\n", rm->name);
+		return -5;
+	}
+	janus_recorder_packet *pkt = g_malloc(sizeof(janus_recorder_packet) + length);
+	pkt->received = janus_get_monotonic_time();
+	pkt->seq = 0;
+	pkt->length = length;
+	memcpy(pkt->data, buffer, length);
+	g_async_queue_push(rm->packets, pkt);
+	return 0;
+}
+
+static int janus_recorder_mp4_close(janus_recorder_mp4 *rm) {
+	g_async_queue_push(rm->packets, &exit_packet);
+	g_thread_join(rm->thread);
+	rm->thread = NULL;
+	int res = janus_mp4_close(rm->mp4);
+	rm->mp4 = NULL;
+	if(rm->dropped > 0 || rm->late > 0 || rm->lost > 0) {
+		JANUS_LOG(LOG_WARN, "Recording %s: %"SCNu32" packets dropped, %"SCNu32" too late, %"SCNu32" gaps\n",
+			rm->name, rm->dropped, rm->late, rm->lost);
+	}
+	rtp_payload_decode_destroy(rm->decoder);
+	g_async_queue_unref(rm->packets);
+	g_queue_free_full(rm->window, (GDestroyNotify)g_free);
+	g_byte_array_free(rm->frame, TRUE);
+	g_free(rm->name);
+	g_free(rm);
+	return res;
 }
 
 static void janus_recorder_free(const janus_refcount *recorder_ref) {
@@ -69,7 +397,8 @@ static void janus_recorder_free(const janus_refcount *recorder_ref) {
 	recorder->dir = NULL;
 	g_free(recorder->filename);
 	recorder->filename = NULL;
-	fclose(recorder->file);
+	if(recorder->file)
+		fclose(recorder->file);
 	recorder->file = NULL;
 	g_free(recorder->codec);
 	recorder->codec = NULL;
@@ -96,6 +425,20 @@ janus_recorder *janus_recorder_create(const char *dir, const char *codec, const
 		JANUS_LOG(LOG_ERR, "Unsupported codec '%s'\n", codec);
 		return NULL;
 	}
+	/* Check if we can record to .mp4, if we were asked to */
+	janus_mp4_codec mp4_codec = JANUS_MP4_NONE;
+	if(rec_format == JANUS_RECORDER_MP4) {
+		if(!strcasecmp(codec, "h264")) {
+			mp4_codec = JANUS_MP4_H264;
+		} else if(!strcasecmp(codec, "vp8")) {
+			mp4_codec = JANUS_MP4_VP8;
+		} else if(!strcasecmp(codec, "opus")) {
+			mp4_codec = JANUS_MP4_OPUS;
+		} else {
+			JANUS_LOG(LOG_WARN, "Can't record '%s' to .mp4, using .mjr instead\n", codec);
+		}
+	}
+	const char *extension = (mp4_codec != JANUS_MP4_NONE) ? "mp4" : "mjr";
 	/* Create the recorder */
 	janus_recorder *rc = g_malloc0(sizeof(janus_recorder));
 	rc->dir = NULL;
@@ -160,41 +503,51 @@ janus_recorder *janus_recorder_create(const char *dir, const char *codec, const
 	if(rec_file == NULL) {
 		/* Choose a random username */
 		if(!rec_tempname) {
-			/* Use .mjr as an extension right away */
-			g_snprintf(newname, 1024, "janus-recording-%"SCNu32".mjr", janus_random_uint32());
+			/* Use .mjr (or .mp4) as an extension right away */
+			g_snprintf(newname, 1024, "janus-recording-%"SCNu32".%s", janus_random_uint32(), extension);
 		} else {
-			/* Append the temporary extension to .mjr, we'll rename when closing */
-			g_snprintf(newname, 1024, "janus-recording-%"SCNu32".mjr.%s", janus_random_uint32(), rec_tempext);
+			/* Append the temporary extension to .mjr (or .mp4), we'll rename when closing */
+			g_snprintf(newname, 1024, "janus-recording-%"SCNu32".%s.%s", janus_random_uint32(), extension, rec_tempext);
 		}
 	} else {
 		/* Just append the extension */
 		if(!rec_tempname) {
-			/* Use .mjr as an extension right away */
-			g_snprintf(newname, 1024, "%s.mjr", rec_file);
+			/* Use .mjr (or .mp4) as an extension right away */
+			g_snprintf(newname, 1024, "%s.%s", rec_file, extension);
 		} else {
-			/* Append the temporary extension to .mjr, we'll rename when closing */
-			g_snprintf(newname, 1024, "%s.mjr.%s", rec_file, rec_tempext);
+			/* Append the temporary extension to .mjr (or .mp4), we'll rename when closing */
+			g_snprintf(newname, 1024, "%s.%s.%s", rec_file, extension, rec_tempext);
 		}
 	}
 	/* Try opening the file now */
-	if(rec_dir == NULL) {
-		rc->file = fopen(newname, "wb");
-	} else {
-		char path[1024];
-		memset(path, 0, 1024);
+	char path[1024];
+	memset(path, 0, 1024);
+	if(rec_dir == NULL)
+		g_snprintf(path, 1024, "%s", newname);
+	else
 		g_snprintf(path, 1024, "%s/%s", rec_dir, newname);
+	if(mp4_codec != JANUS_MP4_NONE) {
+		rc->format = JANUS_RECORDER_MP4;
+		rc->mp4 = janus_recorder_mp4_create(path, mp4_codec);
+		if(rc->mp4 == NULL) {
+			JANUS_LOG(LOG_ERR, "Error creating the .mp4 recording\n");
+			return NULL;
+		}
+	} else {
+		rc->format = JANUS_RECORDER_MJR;
 		rc->file = fopen(path, "wb");
-	}
-	if(rc->file == NULL) {
-		JANUS_LOG(LOG_ERR, "fopen error: %d\n", errno);
-		return NULL;
+		if(rc->file == NULL) {
+			JANUS_LOG(LOG_ERR, "fopen error: %d\n", errno);
+			return NULL;
+		}
 	}
 	if(rec_dir)
 		rc->dir = g_strdup(rec_dir);
 	rc->filename = g_strdup(newname);
 	rc->type = type;
 	/* Write the first part of the header */
-	fwrite(header, sizeof(char), strlen(header), rc->file);
+	if(rc->file)
+		fwrite(header, sizeof(char), strlen(header), rc->file);
 	g_atomic_int_set(&rc->writable, 1);
 	/* We still need to also write the info header first */
 	g_atomic_int_set(&rc->header, 0);
@@ -215,7 +568,7 @@ int janus_recorder_save_frame(janus_recorder *recorder, char *buffer, uint lengt
 		janus_mutex_unlock_nodebug(&recorder->mutex);
 		return -2;
 	}
-	if(!recorder->file) {
+	if(!recorder->file && !recorder->mp4) {
 		janus_mutex_unlock_nodebug(&recorder->mutex);
 		return -3;
 	}
@@ -223,6 +576,12 @@ int janus_recorder_save_frame(janus_recorder *recorder, char *buffer, uint lengt
 		janus_mutex_unlock_nodebug(&recorder->mutex);
 		return -4;
 	}
+	if(recorder->mp4) {
+		/* The recorder thread will take care of this */
+		int res = janus_recorder_mp4_queue(recorder->mp4, buffer, length);
+		janus_mutex_unlock_nodebug(&recorder->mutex);
+		return res;
+	}
 	if(!g_atomic_int_get(&recorder->header)) {
 		/* Write info header as a JSON formatted info */
 		json_t *info = json_object();
@@ -276,6 +635,16 @@ int janus_recorder_close(janus_recorder *recorder) {
 	if(!recorder || !g_atomic_int_compare_and_exchange(&recorder->writable, 1, 0))
 		return -1;
 	janus_mutex_lock_nodebug(&recorder->mutex);
+	janus_recorder_mp4 *mp4 = recorder->mp4;
+	recorder->mp4 = NULL;
+	janus_mutex_unlock_nodebug(&recorder->mutex);
+	if(mp4 != NULL) {
+		/* Wait for the thread to write what's left: we do it unlocked, so that
+		 * whoever is still trying to save frames doesn't block on us meanwhile */
+		if(janus_recorder_mp4_close(mp4) < 0)
+			JANUS_LOG(LOG_ERR, "Error finalizing %s\n", recorder->filename);
+	}
+	janus_mutex_lock_nodebug(&recorder->mutex);
 	if(recorder->file) {
 		fseek(recorder->file, 0L, SEEK_END);
 		size_t fsize = ftell(recorder->file);
@@ -7,7 +7,13 @@
  * file just saves RTP frames in a structured way, so that they can be
  * post-processed later on to get a valid container file (e.g., a .opus
  * file for Opus audio or a .webm file for VP8 video) and keep things
- * simpler on the plugin and core side.
+ * simpler on the plugin and core side. Alternatively, the core can be
+ * configured to record H.264, VP8 and Opus to fragmented .mp4 files
+ * right away (see \ref janus_recorder_set_format): in that case frames
+ * are only queued here, and a thread per recorder reorders the packets
+ * in a small window, depacketizes them and writes fragments as it goes,
+ * so that the recording is playable as soon as it's closed, with no
+ * post-processing needed. Other codecs are still saved to .mjr files.
  * \note If you want to record both audio and video, you'll have to use
  * two different recorders. Any muxing in the same container will have
  * to be done in the post-processing phase.
@@ -35,14 +41,29 @@ typedef enum janus_recorder_medium {
 	JANUS_RECORDER_DATA
 } janus_recorder_medium;
 
+/*! \brief Formats we can record to */
+typedef enum janus_recorder_format {
+	/*! \brief Janus structured recording (.mjr), to post-process */
+	JANUS_RECORDER_MJR,
+	/*! \brief Fragmented MP4 (.mp4), for H.264, VP8 and Opus */
+	JANUS_RECORDER_MP4
+} janus_recorder_format;
+
+/*! \brief Live MP4 writer of a recorder (opaque) */
+struct janus_recorder_mp4;
+
 /*! \brief Structure that represents a recorder */
 typedef struct janus_recorder {
 	/*! \brief Absolute path to the directory where the recorder file is stored */ 
 	char *dir;
 	/*! \brief Filename of this recorder file */ 
 	char *filename;
-	/*! \brief Recording file */
+	/*! \brief Recording file (NULL when recording to .mp4) */
 	FILE *file;
+	/*! \brief Format this instance is recording to */
+	janus_recorder_format format;
+	/*! \brief Live MP4 writer, when recording to .mp4 */
+	struct janus_recorder_mp4 *mp4;
 	/*! \brief Codec the packets to record are encoded in ("vp8", "vp9", "h264", "opus", "pcma", "pcmu", "g722") */
 	char *codec;
 	/*! \brief When the recording file has been created */
@@ -67,6 +88,11 @@ typedef struct janus_recorder {
 void janus_recorder_init(gboolean tempnames, const char *extension);
 /*! \brief De-initialize the recorder code */
 void janus_recorder_deinit(void);
+/*! \brief Set the format new recorders will record to
+ * \note Recorders for codecs .mp4 files can't contain will keep on using .mjr
+ * @param[in] format The format to use ("mjr" or "mp4")
+ * @returns 0 in case of success, a negative integer otherwise */
+int janus_recorder_set_format(const char *format);
 
 /*! \brief Create a new recorder
  * \note If no target directory is provided, the current directory will be used. If no filename
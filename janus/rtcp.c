@@ -1168,8 +1168,49 @@ typedef enum janus_rtp_packet_status {
 	janus_rtp_packet_status_reserved = 3
 } janus_rtp_packet_status;
 
-int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssrc, guint32 media, guint8 feedback_packet_count, GQueue *transport_wide_cc_stats) {
-	if(packet == NULL || size < sizeof(janus_rtcp_header) || transport_wide_cc_stats == NULL || g_queue_is_empty(transport_wide_cc_stats))
+void janus_rtcp_transport_wide_cc_ring_add(janus_rtcp_transport_wide_cc_ring *ring, guint32 transport_seq_num, guint64 timestamp) {
+	if(ring == NULL)
+		return;
+	if(!ring->started) {
+		/* First packet, start from here */
+		ring->started = TRUE;
+		ring->base_seq_num = transport_seq_num;
+		ring->end_seq_num = transport_seq_num;
+	}
+	if((gint32)(transport_seq_num - ring->base_seq_num) < 0) {
+		/* Too late, we already reported this packet as lost */
+		return;
+	}
+	if(transport_seq_num - ring->base_seq_num >= JANUS_RTCP_TWCC_RING_SIZE) {
+		/* No room left, give up on the oldest packets we didn't report yet:
+		 * all the slots outside of [base, end) are always empty, so we
+		 * only need to clear the ones we're about to reuse */
+		guint32 base = transport_seq_num - JANUS_RTCP_TWCC_RING_SIZE + 1;
+		while(ring->base_seq_num != base && ring->base_seq_num != ring->end_seq_num) {
+			ring->timestamps[ring->base_seq_num & (JANUS_RTCP_TWCC_RING_SIZE-1)] = 0;
+			ring->base_seq_num++;
+		}
+		ring->base_seq_num = base;
+		if((gint32)(ring->end_seq_num - base) < 0)
+			ring->end_seq_num = base;
+	}
+	/* A zero timestamp means "not received", so make sure we never store that */
+	ring->timestamps[transport_seq_num & (JANUS_RTCP_TWCC_RING_SIZE-1)] = timestamp ? timestamp : 1;
+	if((gint32)(transport_seq_num - ring->end_seq_num) >= 0)
+		ring->end_seq_num = transport_seq_num + 1;
+}
+
+int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssrc, guint32 media, guint8 feedback_packet_count, janus_rtcp_transport_wide_cc_ring *ring) {
+	if(packet == NULL || size < sizeof(janus_rtcp_header) || ring == NULL)
+		return -1;
+	if(!ring->started || ring->end_seq_num == ring->base_seq_num)
+		return 0;
+	/* How many packets are we going to report? */
+	guint32 count = ring->end_seq_num - ring->base_seq_num;
+	if(count > JANUS_RTCP_TWCC_MAX_STATUSES)
+		count = JANUS_RTCP_TWCC_MAX_STATUSES;
+	/* Worst case: a chunk every 7 statuses, two bytes per delta, and padding */
+	if(size < sizeof(janus_rtcp_header) + 16 + 2*((count+6)/7) + 2*count + 3)
 		return -1;
 
 	memset(packet, 0, size);
@@ -1183,14 +1224,6 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 	rtcpfb->ssrc = htonl(ssrc);
 	rtcpfb->media = htonl(media);
 
-	/* Get first packet */
-	janus_rtcp_transport_wide_cc_stats *stat = (janus_rtcp_transport_wide_cc_stats *) g_queue_pop_head (transport_wide_cc_stats);
-	/* Calculate temporal info */
-	guint16 base_seq_num = stat->transport_seq_num;
-	gboolean first_received	= FALSE;
-	guint64 reference_time = 0;
-	guint packet_status_count = g_queue_get_length(transport_wide_cc_stats) + 1;
-
 	/*
 		0                   1                   2                   3
 		0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
@@ -1207,8 +1240,8 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 	size_t len = sizeof(janus_rtcp_header) + 8;
 
 	/* Set header data */
-	janus_set2(data, len, base_seq_num);
-	janus_set2(data, len+2, packet_status_count);
+	janus_set2(data, len, (guint16)ring->base_seq_num);
+	janus_set2(data, len+2, count);
 	/* Set3 referenceTime when first received */
 	size_t reference_time_pos = len + 4;
 	janus_set1(data, len+7, feedback_packet_count);
@@ -1216,102 +1249,71 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 	/* Next byte */
 	len += 8;
 
-	/* Initial time in us */
+	/* First of all, go through the packets to report, and compute statuses
+	 * and deltas: we empty the slots of the ring as we go */
+	guint8 statuses[JANUS_RTCP_TWCC_MAX_STATUSES];
+	gint32 deltas[JANUS_RTCP_TWCC_MAX_STATUSES];
+	gboolean first_received = FALSE;
 	guint64 timestamp = 0;
-
-	/* Store delta array */
-	GQueue *deltas = g_queue_new();
-	GQueue *statuses = g_queue_new();
-	janus_rtp_packet_status last_status = janus_rtp_packet_status_reserved;
-	janus_rtp_packet_status max_status = janus_rtp_packet_status_notreceived;
-	gboolean all_same = TRUE;
-
-	/* For each packet  */
-	while (stat != NULL) {
-		janus_rtp_packet_status status = janus_rtp_packet_status_notreceived;
-
-		/* If got packet */
-		if (stat->timestamp) {
-			int delta = 0;
-			/* If first received */
-			if (!first_received) {
-				/* Got it  */
-				first_received = TRUE;
-				/* Set it */
-				reference_time = (stat->timestamp/64000);
-				/* Get initial time */
-				timestamp = reference_time * 64000;
-				/* also in bufffer */
-				janus_set3(data, reference_time_pos, reference_time);
-			}
-
-			/* Get delta */
-			if (stat->timestamp>timestamp)
-				delta = (stat->timestamp-timestamp)/250;
-			else
-				delta = -(int)((timestamp-stat->timestamp)/250);
-			/* If it is negative or too big */
-			if (delta<0 || delta> 127) {
-				/* Big one */
-				status = janus_rtp_packet_status_largeornegativedelta;
-			} else {
-				/* Small */
-				status = janus_rtp_packet_status_smalldelta;
-			}
-			/* Store delta */
-			g_queue_push_tail(deltas, GINT_TO_POINTER(delta));
-			/* Set last time */
-			timestamp = stat->timestamp;
+	guint32 i = 0, j = 0;
+	for(i=0; i<count; i++) {
+		guint32 slot = (ring->base_seq_num + i) & (JANUS_RTCP_TWCC_RING_SIZE-1);
+		guint64 received = ring->timestamps[slot];
+		ring->timestamps[slot] = 0;
+		if(received == 0) {
+			statuses[i] = janus_rtp_packet_status_notreceived;
+			continue;
 		}
-
-		/* Check if all previoues ones were equal and this one the firt different */
-		if (all_same && last_status!=janus_rtp_packet_status_reserved && status!=last_status) {
-			/* How big was the same run */
-			if (g_queue_get_length(statuses)>7) {
-				guint32 word = 0;
-				/* Write run! */
-				/*
-					0                   1
-					0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5
-				       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-				       |T| S |       Run Length        |
-				       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-					T = 0
-				 */
-				word = janus_push_bits(word, 1, 0);
-				word = janus_push_bits(word, 2, last_status);
-				word = janus_push_bits(word, 13, g_queue_get_length(statuses));
-				/* Write word */
-				janus_set2(data, len, word);
-				len += 2;
-				/* Remove all statuses */
-				g_queue_clear(statuses);
-				/* Reset status */
-				last_status = janus_rtp_packet_status_reserved;
-				max_status = janus_rtp_packet_status_notreceived;
-				all_same = TRUE;
-			} else {
-				/* Not same */
-				all_same = FALSE;
-			}
-		}
-
-		/* Push back statuses, it will be handled later */
-		g_queue_push_tail(statuses, GUINT_TO_POINTER(status));
-
-		/* If it is bigger */
-		if (status>max_status) {
-			/* Store it */
-			max_status = status;
+		if(!first_received) {
+			/* The reference time is in multiples of 64ms */
+			first_received = TRUE;
+			guint64 reference_time = received/64000;
+			timestamp = reference_time*64000;
+			janus_set3(data, reference_time_pos, reference_time);
 		}
-		/* Store las status */
-		last_status = status;
-
-		/* Check if we can still be enquing for a run */
-		if (!all_same) {
-			/* Check  */
-			if (!all_same && max_status==janus_rtp_packet_status_largeornegativedelta && g_queue_get_length(statuses)>6) {
-				guint32 word = 0;
+		/* Deltas are in multiples of 250us, relative to the previous received packet */
+		gint64 delta = ((gint64)received - (gint64)timestamp)/250;
+		if(delta < G_MININT16)
+			delta = G_MININT16;
+		else if(delta > G_MAXINT16)
+			delta = G_MAXINT16;
+		statuses[i] = (delta >= 0 && delta <= 255) ?
+			janus_rtp_packet_status_smalldelta : janus_rtp_packet_status_largeornegativedelta;
+		deltas[i] = delta;
+		/* Keep track of the time as the peer will compute it, to avoid drifting */
+		timestamp += delta*250;
+	}
+	ring->base_seq_num += count;
+
+	/* Now encode the statuses, using run length chunks whenever we can */
+	i = 0;
+	while(i < count) {
+		guint32 word = 0, run = 1;
+		while(i+run < count && run < 8191 && statuses[i+run] == statuses[i])
+			run++;
+		if(run >= 7 || i+run == count) {
+			/*
+				0                   1
+				0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5
+			       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+			       |T| S |       Run Length        |
+			       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+				T = 0
+			 */
+			word = janus_push_bits(word, 1, 0);
+			word = janus_push_bits(word, 2, statuses[i]);
+			word = janus_push_bits(word, 13, run);
+			i += run;
+		} else {
+			/* Check if any of the next symbols needs two bits */
+			gboolean large = FALSE;
+			for(j=i; j<i+14 && j<count; j++) {
+				if(statuses[j] == janus_rtp_packet_status_largeornegativedelta) {
+					large = TRUE;
+					break;
+				}
+			}
+			if(large) {
 				/*
 					0                   1
 					0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5
@@ -1323,41 +1325,10 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 				 */
 				word = janus_push_bits(word, 1, 1);
 				word = janus_push_bits(word, 1, 1);
-				/* Set next 7 */
-				size_t i = 0;
-				for (i=0;i<7;++i) {
-					/* Get status */
-					janus_rtp_packet_status status = (janus_rtp_packet_status) GPOINTER_TO_UINT(g_queue_pop_head (statuses));
-					/* Write */
-					word = janus_push_bits(word, 2, (guint8)status);
-				}
-				/* Write word */
-				janus_set2(data, len, word);
-				len += 2;
-				/* Reset */
-				last_status = janus_rtp_packet_status_reserved;
-				max_status = janus_rtp_packet_status_notreceived;
-				all_same = TRUE;
-
-				/* We need to restore the values, as there may be more elements on the buffer */
-				for (i=0; i<g_queue_get_length(statuses); ++i) {
-					/* Get status */
-					status = (janus_rtp_packet_status) GPOINTER_TO_UINT(g_queue_peek_nth(statuses, i));
-					/* If it is bigger */
-					if (status>max_status) {
-						/* Store it */
-						max_status = status;
-					}
-					//Check if it is the same */
-					if (all_same && last_status!=janus_rtp_packet_status_reserved && status!=last_status) {
-						/* Not the same */
-						all_same = FALSE;
-					}
-					/* Store las status */
-					last_status = status;
-				}
-			} else if (!all_same && g_queue_get_length(statuses)>13) {
-				guint32 word = 0;
+				for(j=i; j<i+7; j++)
+					word = janus_push_bits(word, 2, j < count ? statuses[j] : janus_rtp_packet_status_notreceived);
+				i += 7;
+			} else {
 				/*
 					0                   1
 					0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5
@@ -1369,108 +1340,30 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 				 */
 				word = janus_push_bits(word, 1, 1);
 				word = janus_push_bits(word, 1, 0);
-				/* Set next 7 */
-				guint32 i = 0;
-				for (i=0;i<14;++i) {
-					/* Get status */
-					janus_rtp_packet_status status = (janus_rtp_packet_status) GPOINTER_TO_UINT(g_queue_pop_head (statuses));
-					/* Write */
-					word = janus_push_bits(word, 1, (guint8)status);
-				}
-				/* Write word */
-				janus_set2(data, len, word);
-				len += 2;
-				/* Reset */
-				last_status = janus_rtp_packet_status_reserved;
-				max_status = janus_rtp_packet_status_notreceived;
-				all_same = TRUE;
-			}
-		}
-		/* Free mem */
-		g_free(stat);
-
-		/* Get next packet stat */
-		stat = (janus_rtcp_transport_wide_cc_stats *) g_queue_pop_head (transport_wide_cc_stats);
-	}
-
-	/* Get status len */
-	size_t statuses_len = g_queue_get_length(statuses);
-
-	/* If not finished yet */
-	if (statuses_len>0) {
-		/* How big was the same run */
-		if (all_same) {
-			guint32 word = 0;
-			/* Write run! */
-			word = janus_push_bits(word, 1, 0);
-			word = janus_push_bits(word, 2, last_status);
-			word = janus_push_bits(word, 13, statuses_len);
-			/* Write word */
-			janus_set2(data, len, word);
-			len += 2;
-		} else if (max_status == janus_rtp_packet_status_largeornegativedelta) {
-			guint32 word = 0;
-			/* Write chunk */
-			word = janus_push_bits(word, 1, 1);
-			word = janus_push_bits(word, 1, 1);
-			/* Write all the statuses */
-			unsigned int i = 0;
-			for (i=0;i<statuses_len;i++) {
-				/* Get each status */
-				janus_rtp_packet_status status = (janus_rtp_packet_status) GPOINTER_TO_UINT(g_queue_pop_head (statuses));
-				/* Write */
-				word = janus_push_bits(word, 2, (guint8)status);
-			}
-			/* Write pending */
-			word = janus_push_bits(word, 14-statuses_len*2, 0);
-			/* Write word */
-			janus_set2(data , len, word);
-			len += 2;
-		} else {
-			guint32 word = 0;
-			/* Write chunck */
-			word = janus_push_bits(word, 1, 1);
-			word = janus_push_bits(word, 1, 0);
-			/* Write all the statuses */
-			unsigned int i = 0;
-			for (i=0;i<statuses_len;i++) {
-				/* Get each status */
-				janus_rtp_packet_status status = (janus_rtp_packet_status) GPOINTER_TO_UINT(g_queue_pop_head (statuses));
-				/* Write */
-				word = janus_push_bits(word, 1, (guint8)status);
+				for(j=i; j<i+14; j++)
+					word = janus_push_bits(word, 1, j < count ? statuses[j] : janus_rtp_packet_status_notreceived);
+				i += 14;
 			}
-			/* Write pending */
-			word = janus_push_bits(word, 14-statuses_len, 0);
-			/* Write word */
-			janus_set2(data, len, word);
-			len += 2;
 		}
+		janus_set2(data, len, word);
+		len += 2;
 	}
 
 	/* Write now the deltas */
-	while (!g_queue_is_empty(deltas)) {
-		/* Get next delta */
-		gint delta = GPOINTER_TO_INT(g_queue_pop_head (deltas));
-		/* Check size */
-		if (delta<0 || delta>127) {
+	for(i=0; i<count; i++) {
+		if(statuses[i] == janus_rtp_packet_status_smalldelta) {
+			/* 1 byte */
+			janus_set1(data, len, (guint8)deltas[i]);
+			len++;
+		} else if(statuses[i] == janus_rtp_packet_status_largeornegativedelta) {
 			/* 2 bytes */
-			janus_set2(data, len, (short)delta);
-			/* Inc */
+			janus_set2(data, len, (guint16)(gint16)deltas[i]);
 			len += 2;
-		} else {
-			/* 1 byte */
-			janus_set1(data, len, (guint8)delta);
-			/* Inc */
-			len ++;
 		}
 	}
 
-	/* Clean mem */
-	g_queue_free(statuses);
-	g_queue_free(deltas);
-
 	/* Add zero padding */
-	while (len%4) {
+	while(len%4) {
 		/* Add padding */
 		janus_set1(data, len++, 0);
 	}
@@ -1481,3 +1374,103 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 	/* Done */
 	return len;
 }
+
+/* Parse a transport wide feedback message sent by a peer */
+static int janus_rtcp_parse_transport_wide_cc_fci(guint8 *data, int len, janus_rtcp_transport_wide_cc_status *statuses, int max) {
+	if(len < 8)
+		return -1;
+	guint16 base_seq_num = (data[0] << 8) | data[1];
+	guint16 status_count = (data[2] << 8) | data[3];
+	/* The reference time is a signed 24 bits integer, in multiples of 64ms */
+	gint32 reference_time = (data[4] << 16) | (data[5] << 8) | data[6];
+	if(reference_time & 0x800000)
+		reference_time -= 0x1000000;
+	if(status_count > max)
+		return -1;
+	int pos = 8;
+	/* Read the packet status chunks first: until we get to the deltas, we
+	 * use the received property of each status to store its symbol */
+	int count = 0;
+	while(count < status_count) {
+		if(pos+2 > len)
+			return -1;
+		guint16 chunk = (data[pos] << 8) | data[pos+1];
+		pos += 2;
+		if(!(chunk & 0x8000)) {
+			/* Run length chunk */
+			guint8 symbol = (chunk >> 13) & 0x03;
+			int run = chunk & 0x1FFF;
+			while(run > 0 && count < status_count) {
+				statuses[count++].received = symbol;
+				run--;
+			}
+		} else if(!(chunk & 0x4000)) {
+			/* Status vector chunk, 14 one bit symbols */
+			int i = 0;
+			for(i=13; i>=0 && count < status_count; i--)
+				statuses[count++].received = (chunk >> i) & 0x01;
+		} else {
+			/* Status vector chunk, 7 two bits symbols */
+			int i = 0;
+			for(i=6; i>=0 && count < status_count; i--)
+				statuses[count++].received = (chunk >> (2*i)) & 0x03;
+		}
+	}
+	/* Now read the receive deltas, and compute the arrival times */
+	gint64 arrival = (gint64)reference_time*64000;
+	int i = 0;
+	for(i=0; i<status_count; i++) {
+		int symbol = statuses[i].received;
+		statuses[i].seq_num = base_seq_num + i;
+		statuses[i].received = FALSE;
+		statuses[i].arrival = 0;
+		if(symbol == janus_rtp_packet_status_smalldelta) {
+			if(pos+1 > len)
+				return -1;
+			arrival += (gint64)data[pos]*250;
+			pos++;
+		} else if(symbol == janus_rtp_packet_status_largeornegativedelta) {
+			if(pos+2 > len)
+				return -1;
+			gint16 delta = (gint16)((data[pos] << 8) | data[pos+1]);
+			arrival += (gint64)delta*250;
+			pos += 2;
+		} else {
+			continue;
+		}
+		statuses[i].received = TRUE;
+		statuses[i].arrival = arrival;
+	}
+	return status_count;
+}
+
+int janus_rtcp_get_transport_wide_cc_feedback(char *packet, int len, janus_rtcp_transport_wide_cc_status *statuses, int max) {
+	if(packet == NULL || len == 0 || statuses == NULL || max < 1)
+		return -1;
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	if(rtcp->version != 2)
+		return -1;
+	int total = len, parsed = 0;
+	while(rtcp) {
+		int length = ntohs(rtcp->length);
+		if(rtcp->type == RTCP_RTPFB && rtcp->rc == 15 && length*4+4 <= total) {
+			/* Skip the header and the two SSRCs */
+			int fci_len = length*4 - 8;
+			int res = janus_rtcp_parse_transport_wide_cc_fci((guint8 *)rtcp + 12, fci_len,
+				statuses + parsed, max - parsed);
+			if(res < 0) {
+				JANUS_LOG(LOG_HUGE, "Invalid transport wide feedback, skipping\n");
+			} else {
+				parsed += res;
+			}
+		}
+		/* Is this a compound packet? */
+		if(length == 0)
+			break;
+		total -= length*4+4;
+		if(total <= 0)
+			break;
+		rtcp = (janus_rtcp_header *)((uint32_t*)rtcp + length + 1);
+	}
+	return parsed;
+}
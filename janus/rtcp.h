@@ -280,15 +280,35 @@ typedef struct rtcp_context
 } rtcp_context;
 typedef rtcp_context janus_rtcp_context;
 
-/*! \brief Stores transport wide packet reception statistics */
-typedef struct rtcp_transport_wide_cc_stats
+/*! \brief Number of transport wide sequence numbers we can keep track of before reporting them (must be a power of 2) */
+#define JANUS_RTCP_TWCC_RING_SIZE	4096
+/*! \brief Maximum number of packet statuses to report in a single transport wide feedback message */
+#define JANUS_RTCP_TWCC_MAX_STATUSES	400
+/*! \brief Stores transport wide packet reception statistics, indexed by extended transport sequence number */
+typedef struct rtcp_transport_wide_cc_ring
 {
-	/*! \brief Transwport wide sequence number */
-	guint32 transport_seq_num;
-	/*! \brief Reception time */
-	guint64 timestamp;
-} rtcp_transport_wide_cc_stats;
-typedef rtcp_transport_wide_cc_stats janus_rtcp_transport_wide_cc_stats;
+	/*! \brief Reception times, in microseconds (0 if the packet has not been received) */
+	guint64 timestamps[JANUS_RTCP_TWCC_RING_SIZE];
+	/*! \brief First extended transport sequence number we haven't reported yet */
+	guint32 base_seq_num;
+	/*! \brief Extended transport sequence number following the highest we received */
+	guint32 end_seq_num;
+	/*! \brief Whether we received any packet yet */
+	gboolean started;
+} rtcp_transport_wide_cc_ring;
+typedef rtcp_transport_wide_cc_ring janus_rtcp_transport_wide_cc_ring;
+
+/*! \brief Status of a single packet, as reported by a peer in transport wide feedback */
+typedef struct rtcp_transport_wide_cc_status
+{
+	/*! \brief Transport wide sequence number of the packet */
+	guint16 seq_num;
+	/*! \brief Whether the peer received the packet */
+	gboolean received;
+	/*! \brief Reception time as reported by the peer, in microseconds (only meaningful relative to other packets) */
+	gint64 arrival;
+} rtcp_transport_wide_cc_status;
+typedef rtcp_transport_wide_cc_status janus_rtcp_transport_wide_cc_status;
 
 /*! \brief Method to retrieve the estimated round-trip time from an existing RTCP context
  * @param[in] ctx The RTCP context to query
@@ -477,14 +497,34 @@ int janus_rtcp_pli(char *packet, int len);
  * @returns The message data length in bytes, if successful, -1 on errors */
 int janus_rtcp_nacks(char *packet, int len, GSList *nacks);
 
+/*! \brief Method to track the reception of a packet for transport wide feedback
+ * \note Packets older than the last one we reported are ignored, while packets
+ * that would overflow the ring force the oldest unreported ones out (as lost)
+ * @param[in] ring The ring of reception stats to update
+ * @param[in] transport_seq_num The extended transport wide sequence number of the packet
+ * @param[in] timestamp The reception time of the packet, in microseconds */
+void janus_rtcp_transport_wide_cc_ring_add(janus_rtcp_transport_wide_cc_ring *ring, guint32 transport_seq_num, guint64 timestamp);
+
 /*! \brief Method to generate a new RTCP transport wide message to report reception stats
+ * \note This consumes up to \ref JANUS_RTCP_TWCC_MAX_STATUSES packets from the ring,
+ * so it should be called repeatedly until it returns 0
  * @param[in] packet The buffer data (MUST be at least 16 chars)
  * @param[in] len The message data length in bytes
  * @param[in] ssrc SSRC of the origin stream
  * @param[in] media SSRC of the destination stream
  * @param[in] feedback_packet_count Feedback paccket count
- * @param[in] transport_wide_cc_stats List of rtp packet reception stats
- * @returns The message data length in bytes, if successful, -1 on errors */
-int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t len, guint32 ssrc, guint32 media, guint8 feedback_packet_count, GQueue *transport_wide_cc_stats);
+ * @param[in] ring Ring of rtp packet reception stats
+ * @returns The message data length in bytes, if successful, 0 if there's nothing to report, -1 on errors */
+int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t len, guint32 ssrc, guint32 media, guint8 feedback_packet_count, janus_rtcp_transport_wide_cc_ring *ring);
+
+/*! \brief Method to parse the transport wide feedback messages a peer sent us, if any
+ * \note All the feedback messages in a compound packet are parsed, and
+ * the statuses they contain are appended to the provided array in order
+ * @param[in] packet The message data
+ * @param[in] len The message data length in bytes
+ * @param[out] statuses The array to fill with the statuses of the reported packets
+ * @param[in] max The size of the statuses array
+ * @returns The number of packet statuses that were parsed, 0 if there was no feedback, -1 on errors */
+int janus_rtcp_get_transport_wide_cc_feedback(char *packet, int len, janus_rtcp_transport_wide_cc_status *statuses, int max);
 
 #endif
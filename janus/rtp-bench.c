@@ -0,0 +1,345 @@
+/*! \file    rtp-bench.c
+ * \copyright GNU General Public License v3
+ * \brief    Per-packet CPU cost of relaying video to many subscribers
+ * \details  Simple benchmark comparing the two ways a plugin can handle a
+ * publisher video packet it relays to many subscribers: checking the
+ * payload again for each of them (keyframe, VP8 payload descriptor), in
+ * the plugin and then in the core when sending, as the code did before
+ * janus_rtp_video_info was introduced (a copy of the simulcast processing
+ * of that time is included here, since the current one parses the packet
+ * with janus_rtp_video_info_parse too), or parsing it once with
+ * janus_rtp_video_info_parse and having all of them look at the flags.
+ * For each subscriber we do what the VideoRoom relay path does with a
+ * simulcast publisher: simulcast processing, VP8 Picture ID and TL0PICIDX
+ * rewriting (restoring the descriptor after), and the keyframe check of
+ * the ICE send loop. The packets are synthetic VP8 or H.264 frames, sent
+ * on three simulcast SSRCs, with a keyframe every 100 frames. Both ways
+ * must take the same decisions for each subscriber (packets relayed and
+ * keyframes seen), or the bench fails.
+ *
+ * Usage: rtp-bench [-c vp8|h264] [-s subscribers] [-p packets]
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "rtp.h"
+#include "utils.h"
+
+/* No logging, as there's no log thread to print anything */
+int janus_log_level = 0;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+#define BENCH_FRAMES		300		/* Frames per substream */
+#define BENCH_FRAME_PACKETS	3		/* Packets per frame */
+#define BENCH_KEYFRAME		100		/* Keyframe interval, in frames */
+#define BENCH_PAYLOAD		1100	/* Payload size */
+
+typedef struct bench_packet {
+	char data[RTP_HEADER_SIZE + BENCH_PAYLOAD];
+	int length;
+} bench_packet;
+
+typedef struct bench_subscriber {
+	janus_rtp_switching_context context;
+	janus_rtp_simulcasting_context sim_context;
+	janus_vp8_simulcast_context vp8_context;
+	int relayed, keyframes;
+} bench_subscriber;
+
+static uint32_t ssrcs[3] = { 1111, 2222, 3333 };
+
+/* A VP8 packet, with all the optional descriptor fields browsers send when simulcasting */
+static int bench_vp8_packet(char *payload, int frame, int part, gboolean keyframe) {
+	static const uint8_t tids[4] = { 0, 2, 1, 2 };
+	uint16_t picid = frame & 0x7FFF;
+	payload[0] = 0x80 | (part == 0 ? 0x10 : 0x00);	/* X, S (start of partition) */
+	payload[1] = 0xE0;	/* I, L, T */
+	payload[2] = 0x80 | (picid >> 8);	/* M: 15-bit Picture ID */
+	payload[3] = picid & 0xFF;
+	payload[4] = frame / 4;	/* TL0PICIDX */
+	payload[5] = (tids[frame % 4] << 6) | (tids[frame % 4] == 0 ? 0 : 0x20);
+	if(part == 0) {
+		/* VP8 payload header: P bit not set for keyframes, which also need the start code */
+		payload[6] = keyframe ? 0x10 : 0x11;
+		payload[7] = 0x02;
+		payload[8] = 0x00;
+		payload[9] = 0x9d;
+		payload[10] = 0x01;
+		payload[11] = 0x2a;
+	}
+	return BENCH_PAYLOAD;
+}
+
+/* An H.264 packet: SPS and PPS in a STAP-A for keyframes, followed by the frame in FU-A fragments */
+static int bench_h264_packet(char *payload, int frame, int part, gboolean keyframe) {
+	if(keyframe && part == 0) {
+		static const uint8_t stap[] = {
+			0x18,
+			0x00, 0x0a, 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe8, 0x40,
+			0x00, 0x04, 0x68, 0xce, 0x3c, 0x80
+		};
+		memcpy(payload, stap, sizeof(stap));
+		return sizeof(stap);
+	}
+	uint8_t nal = keyframe ? 5 : 1;
+	payload[0] = 0x60 | 28;
+	payload[1] = nal | (part == (keyframe ? 1 : 0) ? 0x80 : 0x00) | (part == BENCH_FRAME_PACKETS-1 ? 0x40 : 0x00);
+	return BENCH_PAYLOAD;
+}
+
+static bench_packet *bench_packets_create(janus_videocodec vcodec, int *count) {
+	int total = 3 * BENCH_FRAMES * BENCH_FRAME_PACKETS;
+	bench_packet *packets = g_malloc0(total * sizeof(bench_packet));
+	uint16_t seq[3] = { 0, 0, 0 };
+	int frame = 0, part = 0, substream = 0, n = 0;
+	/* Interleave the substreams, as they'd be received */
+	for(frame=0; frame<BENCH_FRAMES; frame++) {
+		for(substream=0; substream<3; substream++) {
+			for(part=0; part<BENCH_FRAME_PACKETS; part++) {
+				bench_packet *p = &packets[n++];
+				janus_rtp_header *header = (janus_rtp_header *)p->data;
+				header->version = 2;
+				header->type = 96;
+				header->markerbit = (part == BENCH_FRAME_PACKETS-1);
+				header->seq_number = htons(seq[substream]++);
+				header->timestamp = htonl(frame * 3000);
+				header->ssrc = htonl(ssrcs[substream]);
+				char *payload = p->data + RTP_HEADER_SIZE;
+				memset(payload, 0x55, BENCH_PAYLOAD);
+				gboolean keyframe = (frame % BENCH_KEYFRAME) == 0;
+				int plen = (vcodec == JANUS_VIDEOCODEC_VP8) ?
+					bench_vp8_packet(payload, frame, part, keyframe) :
+					bench_h264_packet(payload, frame, part, keyframe);
+				p->length = RTP_HEADER_SIZE + plen;
+			}
+		}
+	}
+	*count = n;
+	return packets;
+}
+
+static bench_subscriber *bench_subscribers_create(int count) {
+	bench_subscriber *subscribers = g_malloc0(count * sizeof(bench_subscriber));
+	int i = 0;
+	for(i=0; i<count; i++) {
+		janus_rtp_switching_context_reset(&subscribers[i].context);
+		janus_rtp_simulcasting_context_reset(&subscribers[i].sim_context);
+		janus_vp8_simulcast_context_reset(&subscribers[i].vp8_context);
+		/* Spread the subscribers on all substreams and temporal layers */
+		subscribers[i].sim_context.substream_target = i % 3;
+		subscribers[i].sim_context.templayer_target = (i / 3) % 3;
+	}
+	return subscribers;
+}
+
+/* janus_rtp_simulcasting_context_process_rtp as it was before janus_rtp_video_info
+ * existed (minus the logging), checking the payload itself for each subscriber */
+static gboolean bench_baseline_process_rtp(janus_rtp_simulcasting_context *context,
+		char *buf, int len, uint32_t *ssrcs, janus_videocodec vcodec, janus_rtp_switching_context *sc) {
+	if(!context || !buf || len < 1)
+		return FALSE;
+	janus_rtp_header *header = (janus_rtp_header *)buf;
+	uint32_t ssrc = ntohl(header->ssrc);
+	/* Reset the flags */
+	context->changed_substream = FALSE;
+	context->changed_temporal = FALSE;
+	context->need_pli = FALSE;
+	/* Access the packet payload */
+	int plen = 0;
+	char *payload = janus_rtp_payload(buf, len, &plen);
+	if(payload == NULL)
+		return FALSE;
+	if(context->substream != context->substream_target) {
+		/* There has been a change: let's wait for a keyframe on the target */
+		int step = (context->substream < 1 && context->substream_target == 2);
+		if((ssrc == *(ssrcs + context->substream_target)) || (step && ssrc == *(ssrcs + step))) {
+			if((vcodec == JANUS_VIDEOCODEC_VP8 && janus_vp8_is_keyframe(payload, plen)) ||
+					(vcodec == JANUS_VIDEOCODEC_H264 && janus_h264_is_keyframe(payload, plen))) {
+				context->substream = (ssrc == *(ssrcs + context->substream_target) ? context->substream_target : step);
+				/* Notify the caller that the substream changed */
+				context->changed_substream = TRUE;
+			}
+		}
+	}
+	/* If we haven't received our desired substream yet, let's drop temporarily */
+	if(context->last_relayed == 0) {
+		/* Let's start slow */
+		context->last_relayed = janus_get_monotonic_time();
+	} else {
+		/* Check if 250ms went by with no packet relayed */
+		gint64 now = janus_get_monotonic_time();
+		if(now-context->last_relayed >= 250000) {
+			context->last_relayed = now;
+			int substream = context->substream-1;
+			if(substream < 0)
+				substream = 0;
+			if(context->substream != substream) {
+				context->substream = substream;
+				/* Notify the caller that we need a PLI */
+				context->need_pli = TRUE;
+				/* Notify the caller that the substream changed as well */
+				context->changed_substream = TRUE;
+			}
+		}
+	}
+	/* Do we need to drop this? */
+	if(ssrc != *(ssrcs + context->substream))
+		return FALSE;
+	context->last_relayed = janus_get_monotonic_time();
+	/* Temporal layers are only available for VP8, so don't do anything else for other codecs */
+	if(vcodec == JANUS_VIDEOCODEC_VP8) {
+		/* Check if there's any temporal scalability to take into account */
+		uint16_t picid = 0;
+		uint8_t tlzi = 0;
+		uint8_t tid = 0;
+		uint8_t ybit = 0;
+		uint8_t keyidx = 0;
+		if(janus_vp8_parse_descriptor(payload, plen, &picid, &tlzi, &tid, &ybit, &keyidx) == 0) {
+			if(context->templayer != context->templayer_target && tid == context->templayer_target) {
+				context->templayer = context->templayer_target;
+				/* Notify the caller that the temporal layer changed */
+				context->changed_temporal = TRUE;
+			}
+			if(tid > context->templayer) {
+				/* We increase the base sequence number, or there will be gaps when delivering later */
+				if(sc)
+					sc->v_base_seq++;
+				return FALSE;
+			}
+		}
+	}
+	/* If we got here, the packet can be relayed */
+	return TRUE;
+}
+
+/* What each subscriber gets, when checking the payload each time */
+static void bench_relay(bench_subscriber *s, char *buf, int len, janus_videocodec vcodec,
+		gboolean (*is_keyframe)(const char *buffer, int len)) {
+	int plen = 0;
+	char *payload = janus_rtp_payload(buf, len, &plen);
+	if(!bench_baseline_process_rtp(&s->sim_context, buf, len, ssrcs, vcodec, &s->context))
+		return;
+	char vp8pd[6];
+	if(vcodec == JANUS_VIDEOCODEC_VP8) {
+		memcpy(vp8pd, payload, sizeof(vp8pd));
+		janus_vp8_simulcast_descriptor_update(payload, plen, &s->vp8_context, s->sim_context.changed_substream);
+	}
+	s->relayed++;
+	/* The ICE send loop */
+	if(is_keyframe(payload, plen))
+		s->keyframes++;
+	if(vcodec == JANUS_VIDEOCODEC_VP8)
+		memcpy(payload, vp8pd, sizeof(vp8pd));
+}
+
+/* What each subscriber gets, with the info parsed once */
+static void bench_relay_info(bench_subscriber *s, char *buf, int len, janus_videocodec vcodec,
+		const janus_rtp_video_info *info) {
+	int plen = 0;
+	char *payload = janus_rtp_payload(buf, len, &plen);
+	if(!janus_rtp_simulcasting_context_process_rtp_info(&s->sim_context, buf, len, ssrcs, vcodec, &s->context, info))
+		return;
+	char vp8pd[6];
+	if(vcodec == JANUS_VIDEOCODEC_VP8) {
+		memcpy(vp8pd, payload, sizeof(vp8pd));
+		janus_vp8_simulcast_descriptor_update_ids(payload, plen, &s->vp8_context, s->sim_context.changed_substream,
+			info->picid, info->tl0picidx);
+	}
+	s->relayed++;
+	/* The ICE send loop */
+	if(info->flags & JANUS_RTP_VIDEO_INFO_KEYFRAME)
+		s->keyframes++;
+	if(vcodec == JANUS_VIDEOCODEC_VP8)
+		memcpy(payload, vp8pd, sizeof(vp8pd));
+}
+
+static double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Relay the packets to all subscribers, and return them to check what they got */
+static bench_subscriber *bench_run(janus_videocodec vcodec, bench_packet *packets, int count, int subs, int total, gboolean once) {
+	gboolean (*is_keyframe)(const char *buffer, int len) =
+		(vcodec == JANUS_VIDEOCODEC_VP8) ? janus_vp8_is_keyframe : janus_h264_is_keyframe;
+	bench_subscriber *subscribers = bench_subscribers_create(subs);
+	int i = 0, j = 0;
+	double start = bench_now();
+	for(i=0; i<total; i++) {
+		bench_packet *p = &packets[i % count];
+		if(once) {
+			janus_rtp_video_info info;
+			janus_rtp_video_info_parse(&info, vcodec, p->data, p->length);
+			for(j=0; j<subs; j++)
+				bench_relay_info(&subscribers[j], p->data, p->length, vcodec, &info);
+		} else {
+			for(j=0; j<subs; j++)
+				bench_relay(&subscribers[j], p->data, p->length, vcodec, is_keyframe);
+		}
+	}
+	double elapsed = bench_now() - start;
+	int relayed = 0, keyframes = 0;
+	for(j=0; j<subs; j++) {
+		relayed += subscribers[j].relayed;
+		keyframes += subscribers[j].keyframes;
+	}
+	printf("%-10s %10.1f ns/packet %8.2f ns/subscriber   (relayed %d, keyframes %d)\n",
+		once ? "parse once" : "baseline", elapsed/total, elapsed/total/subs, relayed, keyframes);
+	return subscribers;
+}
+
+int main(int argc, char *argv[]) {
+	janus_videocodec vcodec = JANUS_VIDEOCODEC_VP8;
+	int subs = 100, total = 200000, opt = 0;
+	while((opt = getopt(argc, argv, "c:s:p:")) != -1) {
+		switch(opt) {
+			case 'c':
+				vcodec = janus_videocodec_from_name(optarg);
+				break;
+			case 's':
+				subs = atoi(optarg);
+				break;
+			case 'p':
+				total = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-c vp8|h264] [-s subscribers] [-p packets]\n", argv[0]);
+				return 1;
+		}
+	}
+	if((vcodec != JANUS_VIDEOCODEC_VP8 && vcodec != JANUS_VIDEOCODEC_H264) || subs < 1 || total < 1) {
+		fprintf(stderr, "Usage: %s [-c vp8|h264] [-s subscribers] [-p packets]\n", argv[0]);
+		return 1;
+	}
+	int count = 0;
+	bench_packet *packets = bench_packets_create(vcodec, &count);
+	printf("%s, %d subscribers, %d packets\n", janus_videocodec_name(vcodec), subs, total);
+	/* Warm up, then measure both */
+	g_free(bench_run(vcodec, packets, count, subs, total/10, FALSE));
+	bench_subscriber *baseline = bench_run(vcodec, packets, count, subs, total, FALSE);
+	bench_subscriber *once = bench_run(vcodec, packets, count, subs, total, TRUE);
+	/* Both ways must take the same decisions */
+	int ret = 0, j = 0;
+	for(j=0; j<subs; j++) {
+		if(baseline[j].relayed != once[j].relayed || baseline[j].keyframes != once[j].keyframes) {
+			printf("Subscriber %d: relayed %d (%d keyframes) with the baseline, but %d (%d keyframes) parsing once\n",
+				j, baseline[j].relayed, baseline[j].keyframes, once[j].relayed, once[j].keyframes);
+			ret = 1;
+		}
+	}
+	g_free(baseline);
+	g_free(once);
+	g_free(packets);
+	return ret;
+}
@@ -236,6 +236,63 @@ int janus_rtp_header_extension_parse_transport_wide_cc(char *buf, int len, int i
 	return 0;
 }
 
+int janus_rtp_header_extension_set_transport_wide_cc(char *buf, int len, int id, uint16_t transSeqNum) {
+	char *ref = NULL;
+	if(janus_rtp_header_extension_find(buf, len, id, NULL, NULL, &ref) < 0)
+		return -1;
+	/* Make sure there's room for the two bytes of the sequence number */
+	if((*ref & 0x0F) != 1)
+		return -1;
+	ref[1] = (transSeqNum >> 8) & 0xFF;
+	ref[2] = transSeqNum & 0xFF;
+	return 0;
+}
+
+int janus_rtp_header_extension_add_transport_wide_cc(char *buf, int len, int size, int id) {
+	if(!buf || len < 12 || size < len+8 || id < 1 || id > 14)
+		return -1;
+	if(janus_rtp_header_extension_find(buf, len, id, NULL, NULL, NULL) == 0) {
+		/* Already there */
+		return len;
+	}
+	janus_rtp_header *rtp = (janus_rtp_header *)buf;
+	int hlen = 12;
+	if(rtp->csrccount)	/* Skip CSRC if needed */
+		hlen += rtp->csrccount*4;
+	if(len < hlen)
+		return -1;
+	if(rtp->extension) {
+		/* Append a new element to the existing extension, if it's 1-Byte */
+		if(len < hlen+4)
+			return -1;
+		janus_rtp_header_extension *ext = (janus_rtp_header_extension *)(buf+hlen);
+		if(ntohs(ext->type) != 0xBEDE)
+			return -1;
+		int extlen = ntohs(ext->length)*4;
+		int offset = hlen + 4 + extlen;
+		if(len < offset)
+			return -1;
+		memmove(buf+offset+4, buf+offset, len-offset);
+		buf[offset] = (id << 4) | 0x01;
+		buf[offset+1] = 0;
+		buf[offset+2] = 0;
+		buf[offset+3] = 0;
+		ext->length = htons(ntohs(ext->length)+1);
+		return len+4;
+	}
+	/* No extension at all, add a 1-Byte one */
+	memmove(buf+hlen+8, buf+hlen, len-hlen);
+	janus_rtp_header_extension *ext = (janus_rtp_header_extension *)(buf+hlen);
+	ext->type = htons(0xBEDE);
+	ext->length = htons(1);
+	buf[hlen+4] = (id << 4) | 0x01;
+	buf[hlen+5] = 0;
+	buf[hlen+6] = 0;
+	buf[hlen+7] = 0;
+	rtp->extension = 1;
+	return len+8;
+}
+
 /* RTP context related methods */
 void janus_rtp_switching_context_reset(janus_rtp_switching_context *context) {
 	if(context == NULL)
@@ -656,6 +713,7 @@ const char *janus_srtp_error_str(int error) {
 #define VP8_PT		96
 #define VP9_PT		101
 #define H264_PT		107
+#define H265_PT		108
 const char *janus_audiocodec_name(janus_audiocodec acodec) {
 	switch(acodec) {
 		case JANUS_AUDIOCODEC_NONE:
@@ -727,6 +785,8 @@ const char *janus_videocodec_name(janus_videocodec vcodec) {
 			return "vp9";
 		case JANUS_VIDEOCODEC_H264:
 			return "h264";
+		case JANUS_VIDEOCODEC_H265:
+			return "h265";
 		default:
 			/* Shouldn't happen */
 			return "vp8";
@@ -741,6 +801,8 @@ janus_videocodec janus_videocodec_from_name(const char *name) {
 		return JANUS_VIDEOCODEC_VP9;
 	else if(!strcasecmp(name, "h264"))
 		return JANUS_VIDEOCODEC_H264;
+	else if(!strcasecmp(name, "h265"))
+		return JANUS_VIDEOCODEC_H265;
 	JANUS_LOG(LOG_WARN, "Unsupported video codec '%s'\n", name);
 	return JANUS_VIDEOCODEC_NONE;
 }
@@ -754,12 +816,119 @@ int janus_videocodec_pt(janus_videocodec vcodec) {
 			return VP9_PT;
 		case JANUS_VIDEOCODEC_H264:
 			return H264_PT;
+		case JANUS_VIDEOCODEC_H265:
+			return H265_PT;
 		default:
 			/* Shouldn't happen */
 			return VP8_PT;
 	}
 }
 
+/* What H.264 NAL unit types mean for keyframe detection */
+#define JANUS_H264_NAL_KEY		(1 << 0)	/* Keyframe when sent as a single NAL unit (IDR) */
+#define JANUS_H264_NAL_FU_KEY	(1 << 1)	/* Keyframe when starting a fragmentation unit (IDR, SPS) */
+#define JANUS_H264_NAL_STAP_KEY	(1 << 2)	/* Keyframe when aggregated in a STAP-A (SPS) */
+#define JANUS_H264_NAL_FU		(1 << 3)	/* FU-A/FU-B: check the fragmented NAL unit */
+#define JANUS_H264_NAL_STAP		(1 << 4)	/* STAP-A: check the aggregated NAL units */
+static const uint8_t janus_h264_nal_types[32] = {
+	[5] = JANUS_H264_NAL_KEY | JANUS_H264_NAL_FU_KEY,
+	[7] = JANUS_H264_NAL_FU_KEY | JANUS_H264_NAL_STAP_KEY,
+	[24] = JANUS_H264_NAL_STAP,
+	[28] = JANUS_H264_NAL_FU,
+	[29] = JANUS_H264_NAL_FU
+};
+
+static gboolean janus_rtp_h264_is_keyframe(const uint8_t *payload, int plen) {
+	uint8_t type = janus_h264_nal_types[payload[0] & 0x1F];
+	if(type & JANUS_H264_NAL_STAP) {
+		/* May we find an SPS in this STAP-A? */
+		int offset = 1;
+		while(offset + 3 <= plen) {
+			if(janus_h264_nal_types[payload[offset+2] & 0x1F] & JANUS_H264_NAL_STAP_KEY)
+				return TRUE;
+			offset += 2 + ((payload[offset] << 8) | payload[offset+1]);
+		}
+		return FALSE;
+	}
+	/* Either a single NAL unit, or the start of a fragmented one */
+	uint8_t fu = (plen > 1 && (type & JANUS_H264_NAL_FU) && (payload[1] & 0x80)) ?
+		janus_h264_nal_types[payload[1] & 0x1F] : 0;
+	return ((type & JANUS_H264_NAL_KEY) | (fu & JANUS_H264_NAL_FU_KEY)) != 0;
+}
+
+/* Size of the optional fields of a VP8 payload descriptor (PictureID, TL0PICIDX
+ * and TID/Y/KEYIDX), indexed by the I, L, T and K bits of the extended control
+ * bits octet, not counting the second byte of 15-bit Picture IDs */
+static const uint8_t janus_vp8_ext_size[16] = {
+	0, 1, 1, 1, 1, 2, 2, 2, 1, 2, 2, 2, 2, 3, 3, 3
+};
+
+static void janus_rtp_vp8_parse(janus_rtp_video_info *info, const uint8_t *payload, int plen) {
+	if(!(payload[0] & 0x80)) {
+		/* No extended control bits, so nothing to parse (and, as in
+		 * janus_vp8_is_keyframe, we don't look for keyframes either) */
+		info->flags |= JANUS_RTP_VIDEO_INFO_VP8;
+		return;
+	}
+	if(plen < 2)
+		return;
+	uint8_t ext = payload[1];
+	uint8_t mbit = (ext & 0x80) && plen > 2 && (payload[2] & 0x80);
+	int offset = 2 + janus_vp8_ext_size[ext >> 4] + mbit;
+	if(offset > plen)
+		return;
+	const uint8_t *field = payload + 2;
+	if(ext & 0x80) {
+		/* Picture ID */
+		if(mbit)
+			info->picid = ((field[0] << 8) | field[1]) & 0x7FFF;
+		field += 1 + mbit;
+	}
+	if(ext & 0x40) {
+		/* TL0PICIDX */
+		info->tl0picidx = *field;
+		field++;
+	}
+	if(ext & 0x30) {
+		/* TID/Y/KEYIDX */
+		info->tid = (*field & 0xC0) >> 6;
+		info->ybit = (*field & 0x20) >> 5;
+	}
+	info->flags |= JANUS_RTP_VIDEO_INFO_VP8;
+	/* Keyframe: start of a partition, P bit not set, and the start code */
+	if((payload[0] & 0x10) && offset + 6 <= plen && !(payload[offset] & 0x01) &&
+			payload[offset+3] == 0x9d && payload[offset+4] == 0x01 && payload[offset+5] == 0x2a)
+		info->flags |= JANUS_RTP_VIDEO_INFO_KEYFRAME;
+}
+
+void janus_rtp_video_info_parse(janus_rtp_video_info *info, janus_videocodec vcodec, char *buf, int len) {
+	if(info == NULL)
+		return;
+	memset(info, 0, sizeof(*info));
+	int plen = 0;
+	char *payload = janus_rtp_payload(buf, len, &plen);
+	if(payload == NULL)
+		return;
+	info->flags = JANUS_RTP_VIDEO_INFO_PARSED;
+	if(plen < 1)
+		return;
+	switch(vcodec) {
+		case JANUS_VIDEOCODEC_VP8:
+			janus_rtp_vp8_parse(info, (const uint8_t *)payload, plen);
+			break;
+		case JANUS_VIDEOCODEC_VP9:
+			if(janus_vp9_is_keyframe(payload, plen))
+				info->flags |= JANUS_RTP_VIDEO_INFO_KEYFRAME;
+			break;
+		case JANUS_VIDEOCODEC_H264:
+			if(janus_rtp_h264_is_keyframe((const uint8_t *)payload, plen))
+				info->flags |= JANUS_RTP_VIDEO_INFO_KEYFRAME;
+			break;
+		default:
+			break;
+	}
+}
+
 void janus_rtp_simulcasting_context_reset(janus_rtp_simulcasting_context *context) {
 	if(context == NULL)
 		return;
@@ -773,23 +942,31 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 		char *buf, int len, uint32_t *ssrcs, janus_videocodec vcodec, janus_rtp_switching_context *sc) {
 	if(!context || !buf || len < 1)
 		return FALSE;
+	janus_rtp_video_info info;
+	janus_rtp_video_info_parse(&info, vcodec, buf, len);
+	return janus_rtp_simulcasting_context_process_rtp_info(context, buf, len, ssrcs, vcodec, sc, &info);
+}
+
+gboolean janus_rtp_simulcasting_context_process_rtp_info(janus_rtp_simulcasting_context *context,
+		char *buf, int len, uint32_t *ssrcs, janus_videocodec vcodec, janus_rtp_switching_context *sc,
+		const janus_rtp_video_info *info) {
+	if(!context || !buf || len < 1 || !info)
+		return FALSE;
+	/* No payload to work with */
+	if(!(info->flags & JANUS_RTP_VIDEO_INFO_PARSED))
+		return FALSE;
 	janus_rtp_header *header = (janus_rtp_header *)buf;
 	uint32_t ssrc = ntohl(header->ssrc);
 	/* Reset the flags */
 	context->changed_substream = FALSE;
 	context->changed_temporal = FALSE;
 	context->need_pli = FALSE;
-	/* Access the packet payload */
-	int plen = 0;
-	char *payload = janus_rtp_payload(buf, len, &plen);
-	if(payload == NULL)
-		return FALSE;
 	if(context->substream != context->substream_target) {
 		/* There has been a change: let's wait for a keyframe on the target */
 		int step = (context->substream < 1 && context->substream_target == 2);
 		if((ssrc == *(ssrcs + context->substream_target)) || (step && ssrc == *(ssrcs + step))) {
-			if((vcodec == JANUS_VIDEOCODEC_VP8 && janus_vp8_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_H264 && janus_h264_is_keyframe(payload, plen))) {
+			if((vcodec == JANUS_VIDEOCODEC_VP8 || vcodec == JANUS_VIDEOCODEC_H264) &&
+					(info->flags & JANUS_RTP_VIDEO_INFO_KEYFRAME)) {
 				uint32_t ssrc_old = 0;
 				if(context->substream != -1)
 					ssrc_old = *(ssrcs + context->substream);
@@ -803,12 +980,12 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 		}
 	}
 	/* If we haven't received our desired substream yet, let's drop temporarily */
+	gint64 now = janus_get_monotonic_time();
 	if(context->last_relayed == 0) {
 		/* Let's start slow */
-		context->last_relayed = janus_get_monotonic_time();
+		context->last_relayed = now;
 	} else {
 		/* Check if 250ms went by with no packet relayed */
-		gint64 now = janus_get_monotonic_time();
 		if(now-context->last_relayed >= 250000) {
 			context->last_relayed = now;
 			int substream = context->substream-1;
@@ -831,17 +1008,12 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 			ssrc, *(ssrcs + context->substream));
 		return FALSE;
 	}
-	context->last_relayed = janus_get_monotonic_time();
+	context->last_relayed = now;
 	/* Temporal layers are only available for VP8, so don't do anything else for other codecs */
 	if(vcodec == JANUS_VIDEOCODEC_VP8) {
 		/* Check if there's any temporal scalability to take into account */
-		uint16_t picid = 0;
-		uint8_t tlzi = 0;
-		uint8_t tid = 0;
-		uint8_t ybit = 0;
-		uint8_t keyidx = 0;
-		if(janus_vp8_parse_descriptor(payload, plen, &picid, &tlzi, &tid, &ybit, &keyidx) == 0) {
-			//~ JANUS_LOG(LOG_WARN, "%"SCNu16", %u, %u, %u, %u\n", picid, tlzi, tid, ybit, keyidx);
+		if(info->flags & JANUS_RTP_VIDEO_INFO_VP8) {
+			uint8_t tid = info->tid;
 			if(context->templayer != context->templayer_target && tid == context->templayer_target) {
 				/* FIXME We should be smarter in deciding when to switch */
 				context->templayer = context->templayer_target;
@@ -151,6 +151,26 @@ int janus_rtp_header_extension_parse_rtp_stream_id(char *buf, int len, int id,
 int janus_rtp_header_extension_parse_transport_wide_cc(char *buf, int len, int id,
 	uint16_t *transSeqNum);
 
+/*! \brief Helper to overwrite the sequence number of an existing transport-wide-cc RTP extension
+ * @param[in] buf The packet data
+ * @param[in] len The packet data length in bytes
+ * @param[in] id The extension ID to look for
+ * @param[in] transSeqNum The transport wide sequence number to set
+ * @returns 0 if found, -1 otherwise */
+int janus_rtp_header_extension_set_transport_wide_cc(char *buf, int len, int id,
+	uint16_t transSeqNum);
+
+/*! \brief Helper to add an (empty) transport-wide-cc RTP extension to a packet that doesn't have one
+ * \note The packet is rewritten in place, so the buffer MUST be large enough to
+ * accommodate up to 8 more bytes. Packets that already have an extension in
+ * the two-byte header format are left untouched
+ * @param[in] buf The packet data
+ * @param[in] len The packet data length in bytes
+ * @param[in] size The size of the buffer
+ * @param[in] id The extension ID to add
+ * @returns The new packet length in bytes, if successful, -1 otherwise */
+int janus_rtp_header_extension_add_transport_wide_cc(char *buf, int len, int size, int id);
+
 /*! \brief RTP context, in order to make sure SSRC changes result in coherent seq/ts increases */
 typedef struct janus_rtp_switching_context {
 	uint32_t a_last_ssrc, a_last_ts, a_base_ts, a_base_ts_prev, a_prev_ts, a_target_ts, a_start_ts,
@@ -212,12 +232,50 @@ typedef enum janus_videocodec {
 	JANUS_VIDEOCODEC_NONE,
 	JANUS_VIDEOCODEC_VP8,
 	JANUS_VIDEOCODEC_VP9,
-	JANUS_VIDEOCODEC_H264
+	JANUS_VIDEOCODEC_H264,
+	JANUS_VIDEOCODEC_H265
 } janus_videocodec;
 const char *janus_videocodec_name(janus_videocodec vcodec);
 janus_videocodec janus_videocodec_from_name(const char *name);
 int janus_videocodec_pt(janus_videocodec vcodec);
 
+/*! \brief Codec specific info of a video RTP packet
+ * \details Parsing the payload to know whether a packet is a keyframe, or
+ * which temporal layer it belongs to, is something plugins and the core
+ * would otherwise do for each of the peers the same packet is relayed to.
+ * Filling this struct once, when the packet is received, allows all of
+ * them to just check the flags instead. */
+typedef struct janus_rtp_video_info {
+	/*! \brief Flags (JANUS_RTP_VIDEO_INFO_*) */
+	uint8_t flags;
+	/*! \brief VP8 temporal layer index */
+	uint8_t tid;
+	/*! \brief VP8 temporal level zero index */
+	uint8_t tl0picidx;
+	/*! \brief VP8 layer sync bit */
+	uint8_t ybit;
+	/*! \brief VP8 Picture ID (only if it's 15 bits) */
+	uint16_t picid;
+} janus_rtp_video_info;
+/*! \brief The info was parsed (if not set, recipients need to check the payload themselves) */
+#define JANUS_RTP_VIDEO_INFO_PARSED		(1 << 0)
+/*! \brief The packet is (the beginning of) a keyframe */
+#define JANUS_RTP_VIDEO_INFO_KEYFRAME	(1 << 1)
+/*! \brief The VP8 payload descriptor was parsed, and the VP8 fields are valid */
+#define JANUS_RTP_VIDEO_INFO_VP8		(1 << 2)
+
+/*! \brief Parse the codec specific info of a video RTP packet
+ * \note The result is the same as the one of janus_vp8_is_keyframe,
+ * janus_vp9_is_keyframe, janus_h264_is_keyframe and janus_vp8_parse_descriptor
+ * on the packet payload, except that malformed VP8 and H.264 payloads are
+ * never read past their end. Codecs we don't know about just get the parsed
+ * flag set, while malformed RTP packets don't even get that.
+ * @param[out] info The info to fill
+ * @param[in] vcodec Video codec of the RTP payload
+ * @param[in] buf The RTP packet to process
+ * @param[in] len The length of the RTP packet (header, extension and payload) */
+void janus_rtp_video_info_parse(janus_rtp_video_info *info, janus_videocodec vcodec, char *buf, int len);
+
 
 /*! \brief Helper struct for processing and tracking simulcast streams */
 typedef struct janus_rtp_simulcasting_context {
@@ -256,4 +314,19 @@ void janus_rtp_simulcasting_context_reset(janus_rtp_simulcasting_context *contex
 gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_context *context,
 	char *buf, int len, uint32_t *ssrcs, janus_videocodec vcodec, janus_rtp_switching_context *sc);
 
+/*! \brief Same as janus_rtp_simulcasting_context_process_rtp, but using the info parsed
+ * already with janus_rtp_video_info_parse, rather than looking at the payload again
+ * \note Meant for plugins relaying the same packet to many peers, each with its own context
+ * @param[in] context The simulcasting context to use
+ * @param[in] buf The RTP packet to process
+ * @param[in] len The length of the RTP packet (header, extension and payload)
+ * @param[in] ssrcs The simulcast SSRCs to refer to
+ * @param[in] vcodec Video codec of the RTP payload
+ * @param[in] sc RTP switching context to refer to, if any (only needed for VP8 and dropping temporal layers)
+ * @param[in] info The info parsed from the packet
+ * @returns TRUE if the packet should be relayed, FALSE if it should be dropped instead */
+gboolean janus_rtp_simulcasting_context_process_rtp_info(janus_rtp_simulcasting_context *context,
+	char *buf, int len, uint32_t *ssrcs, janus_videocodec vcodec, janus_rtp_switching_context *sc,
+	const janus_rtp_video_info *info);
+
 #endif
@@ -96,6 +96,7 @@ struct aac_decoder_context_t* aac_decoder_init(int channle, int sample, void* pa
 	if (!flag)
 	{
 		aac_decoder_destroy(pcontext);
+		pcontext = NULL;
 	}
 	return pcontext;
 }
@@ -123,7 +124,7 @@ int aac_decoder_input(struct aac_decoder_context_t* pcontext, const char* pdata,
 	}
 
 	int validSize = 0;
-	ret = aacdec_decode_frame(pcontext,pcontext->pcm_buf, DECODE_PCM_BUF_LEN, &validSize);
+	ret = aacdec_decode_frame(pcontext,pcontext->pcm_buf, pcontext->pcm_buf_len / sizeof(INT_PCM), &validSize);
 	if (ret == AAC_DEC_NOT_ENOUGH_BITS) {
 		return -1;
 	}
@@ -134,9 +135,17 @@ int aac_decoder_input(struct aac_decoder_context_t* pcontext, const char* pdata,
 	pcontext->cbfun(pcontext, pcontext->pcm_buf, validSize, timestamp);
 }
 
+unsigned int aac_decoder_mem_usage(struct aac_decoder_context_t* pcontext)
+{
+	if (pcontext == NULL || pcontext->dec == NULL)
+		return 0;
+	// fdk-aac only allocates the channels and SBR once the stream shows them
+	return sizeof(*pcontext) + pcontext->pcm_buf_len + aacDecoder_GetMemUsage(pcontext->dec);
+}
+
 void aac_decoder_destroy(struct aac_decoder_context_t* pcontext)
 {
-	if (!pcontext)
+	if (pcontext)
 	{
 		if (pcontext->dec != NULL)
 		{
@@ -147,6 +156,10 @@ void aac_decoder_destroy(struct aac_decoder_context_t* pcontext)
 		{
 			free(pcontext->pcm_buf);
 		}
+		if (pcontext->pcm_fd != NULL)
+		{
+			fclose(pcontext->pcm_fd);
+		}
 		free(pcontext);
 		pcontext = NULL;
 		JANUS_LOG(LOG_INFO, "aac decoder destroy context success.\n");
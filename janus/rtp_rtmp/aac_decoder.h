@@ -6,7 +6,8 @@
 #include "debug.h"
 
 
-#define  DECODE_PCM_BUF_LEN 50*1024
+// one decoded frame at most: 8 channels of 2048 samples (HE-AAC)
+#define  DECODE_PCM_BUF_LEN (8*2048*sizeof(INT_PCM))
 
 typedef void(*aac_decoder_cb)(void* param, const unsigned char* pdata, int bytes, uint32_t timestamp);
 
@@ -59,6 +60,8 @@ struct aac_decoder_context_t
 struct aac_decoder_context_t* aac_decoder_init(int channle, int sample, void* param, aac_decoder_cb cb);
 int aac_decoder_input(struct aac_decoder_context_t* pcontext, const char* pdata, int bytes,int timestamp);
 void aac_decoder_destroy(struct aac_decoder_context_t* pcontext);
+// heap memory held by the decoder instance, in bytes
+unsigned int aac_decoder_mem_usage(struct aac_decoder_context_t* pcontext);
 
 #endif // !__AAC_DECODER_H__
 
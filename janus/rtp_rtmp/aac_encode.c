@@ -1,4 +1,58 @@
 ﻿#include "aac_encode.h"
+#include <string.h>
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+//a whole PCM frame, waiting for a batch worker
+struct aac_encode_frame_t
+{
+	uint32_t       timestamp;
+	unsigned char  data[0];
+};
+
+//batch worker: encoders with frames are queued in ready, and the encoding scratch buffers
+//are shared by all the encoders of the worker, so they stay in its cache
+struct aac_encode_worker_t
+{
+	int            id;
+	GThread*       thread;
+	GQueue*        ready;
+	janus_mutex    mutex;
+	janus_condition cond;
+#ifdef __linux__
+	int            cpu;
+#endif
+	int16_t*       convert_buf;
+	int            convert_size;
+	uint8_t*       outbuf;
+	int            outbuf_size;
+};
+
+static struct aac_encode_worker_t* batch_workers = NULL;
+static int batch_threads = 0;
+static int batch_window = AAC_ENCODE_BATCH_WINDOW;
+static volatile gint batch_next = 0, batch_stopping = 0;
+
+static void aac_encode_free(const janus_refcount* ref)
+{
+	struct aac_encode_context_t* pcontext = janus_refcount_containerof(ref, struct aac_encode_context_t, ref);
+	if (pcontext->handle != NULL)
+		aacEncClose(&pcontext->handle);
+	if (pcontext->input_buf != NULL)
+		free(pcontext->input_buf);
+	if (pcontext->convert_buf != NULL)
+		free(pcontext->convert_buf);
+	if (pcontext->frames != NULL)
+		g_queue_free_full(pcontext->frames, g_free);
+#ifdef TEST_DEBUG
+	if (pcontext->fd != NULL)
+		fclose(pcontext->fd);
+#endif // TEST_DEBUG
+	JANUS_LOG(LOG_INFO, "AAC encoder context destroy (dropped %u)\n", pcontext->frames_dropped);
+	free(pcontext);
+}
 
 
 /*
@@ -13,6 +67,7 @@ struct  aac_encode_context_t* aac_encoder_init(int channle, int sample_rate, int
 {
 	struct aac_encode_context_t* pcontext = NULL;
 	int flag = 0;
+	int modules = 0;
 	do
 	{
 		pcontext = (struct aac_encode_context_t*)calloc(1, sizeof(struct aac_encode_context_t));
@@ -21,6 +76,10 @@ struct  aac_encode_context_t* aac_encoder_init(int channle, int sample_rate, int
 			JANUS_LOG(LOG_ERR, "AAC encoder calloc aac_encode_context_t failed, err = %d\n", errno);
 			break;
 		}
+		janus_mutex_init(&pcontext->mutex);
+		janus_mutex_init(&pcontext->process_mutex);
+		janus_refcount_init(&pcontext->ref, aac_encode_free);
+		pcontext->worker = -1;
 		pcontext->afterburner = 1;
 		pcontext->aot = aot;
 		pcontext->bitrate = 64000;
@@ -50,11 +109,24 @@ struct  aac_encode_context_t* aac_encoder_init(int channle, int sample_rate, int
 			JANUS_LOG(LOG_ERR, "Unsupported WAV channels %d\n", pcontext->channels);
 			break;
 		}
-		if (aacEncOpen(&pcontext->handle, 0, pcontext->channels) != AACENC_OK) {
+		// only the modules this AOT needs, for the channels we encode: aacEncOpen(0, ...) also
+		// allocates SBR, PS and metadata state that AAC-LC never touches
+		switch (aot) {
+		case 5:  modules = 0x03; break;	// AAC + SBR
+		case 29: modules = 0x07; break;	// AAC + SBR + PS
+		case 39: modules = pcontext->eld_sbr ? 0x03 : 0x01; break;
+		default: modules = 0x01; break;	// AAC-LC, AAC-LD
+		}
+		if (aacEncOpen(&pcontext->handle, modules, pcontext->channels) != AACENC_OK) {
 			JANUS_LOG(LOG_ERR, "Unable to open encoder\n");
 			break;
 		}
 
+		if (aacEncoder_SetParam(pcontext->handle, AACENC_AOT, aot) != AACENC_OK) {
+			JANUS_LOG(LOG_ERR, "Unable to set the AOT\n");
+			break;
+		}
+
 		/*if (aot == 39 && eld_sbr) {
 			if (aacEncoder_SetParam(pcontext->handle, AACENC_SBR_MODE, 1) != AACENC_OK) {
 				fprintf(stderr, "Unable to set SBR mode for ELD\n");
@@ -62,7 +134,7 @@ struct  aac_encode_context_t* aac_encoder_init(int channle, int sample_rate, int
 			}
 		}*/
 		if (aacEncoder_SetParam(pcontext->handle, AACENC_SAMPLERATE, sample_rate) != AACENC_OK) {
-			JANUS_LOG(LOG_ERR, "Unable to set the AOT\n");
+			JANUS_LOG(LOG_ERR, "Unable to set the sample rate\n");
 			break;
 		}
 
@@ -129,33 +201,21 @@ struct  aac_encode_context_t* aac_encoder_init(int channle, int sample_rate, int
 		pcontext->fd = fopen("/tmp/out.aac", "wb");
 #endif // TEST_DEBUG
 
-		JANUS_LOG(LOG_INFO, "Init aac encoder success \n");
+		JANUS_LOG(LOG_INFO, "Init aac encoder success, aot %d, %u bytes\n", aot, aac_encode_mem_usage(pcontext));
 		flag = 1;
 	} while (0);
 
 	if (!flag)
 	{
 		aac_encode_destory(pcontext);
+		pcontext = NULL;
 	}
 	return pcontext;
 }
 
-int aac_encode_input(struct aac_encode_context_t* pcontext, const unsigned char* pdata, int len, uint32_t timestamp)
+//encodes the PCM frame in pcm (input_size bytes, little endian), scratch buffers are the caller's
+static int aac_encode_frame(struct aac_encode_context_t* pcontext, const uint8_t* pcm, int16_t* convert_buf, uint8_t* outbuf, int outbuf_size, uint32_t timestamp)
 {
-	int emptylen = pcontext->input_size - pcontext->usedlen;
-	if (emptylen > len)
-	{
-		memcpy(pcontext->input_buf + pcontext->usedlen, pdata, len);
-		pcontext->usedlen += len;
-		pcontext->timestamp = timestamp;
-		return 1;
-	}
-	else
-	{
-		memcpy(pcontext->input_buf + pcontext->usedlen, pdata, emptylen);
-		pcontext->usedlen += emptylen;
-	}
-
 	AACENC_BufDesc in_buf = { 0 }, out_buf = { 0 };
 	AACENC_InArgs in_args = { 0 };
 	AACENC_OutArgs out_args = { 0 };
@@ -165,14 +225,13 @@ int aac_encode_input(struct aac_encode_context_t* pcontext, const unsigned char*
 	int out_size, out_elem_size;
 	int  i;
 	void *in_ptr, *out_ptr;
-	uint8_t outbuf[20480];
 	AACENC_ERROR err;
 
 	for (i = 0; i < pcontext->input_size / 2; i++)
 	{
-		pcontext->convert_buf[i] = pcontext->input_buf[2*i] | (pcontext->input_buf[2*i+1] << 8);
+		convert_buf[i] = pcm[2*i] | (pcm[2*i+1] << 8);
 	}
-	in_ptr = pcontext->convert_buf;
+	in_ptr = convert_buf;
 	in_size = pcontext->input_size;
 	in_elem_size = 2;
 
@@ -184,7 +243,7 @@ int aac_encode_input(struct aac_encode_context_t* pcontext, const unsigned char*
 	in_buf.bufElSizes = &in_elem_size;
 
 	out_ptr = outbuf;
-	out_size = sizeof(outbuf);
+	out_size = outbuf_size;
 	out_elem_size = 1;
 	out_buf.numBufs = 1;
 	out_buf.bufs = &out_ptr;
@@ -204,42 +263,285 @@ int aac_encode_input(struct aac_encode_context_t* pcontext, const unsigned char*
 		JANUS_LOG(LOG_ERR, "AAC encoding failed, out_args.numOutBytes is %d\n", out_args.numOutBytes);
 		return 1;
 	}
-	pcontext->cbfun(pcontext->cbdata, (unsigned char*)outbuf, out_args.numOutBytes, (pcontext->timestamp+timestamp)/2);
-	pcontext->usedlen = 0;
-	pcontext->timestamp = timestamp;
-	
-	if (len - emptylen > 0)
+	pcontext->cbfun(pcontext->cbdata, (unsigned char*)outbuf, out_args.numOutBytes, timestamp);
+	return 0;
+}
+
+static void aac_encode_batch_queue(struct aac_encode_context_t* pcontext, uint32_t timestamp);
+
+//collects PCM into whole frames: each one is encoded right away, or queued for the batch worker
+static int aac_encode_collect(struct aac_encode_context_t* pcontext, const unsigned char* pdata, int len, uint32_t timestamp, int batch)
+{
+	while (len > 0)
 	{
-		memcpy(pcontext->input_buf, pdata + emptylen, len - emptylen);
+		int emptylen = pcontext->input_size - pcontext->usedlen;
+		if (emptylen > len)
+		{
+			memcpy(pcontext->input_buf + pcontext->usedlen, pdata, len);
+			pcontext->usedlen += len;
+			pcontext->timestamp = timestamp;
+			break;
+		}
+		memcpy(pcontext->input_buf + pcontext->usedlen, pdata, emptylen);
+		pdata += emptylen;
+		len -= emptylen;
+		if (batch)
+		{
+			aac_encode_batch_queue(pcontext, (pcontext->timestamp+timestamp)/2);
+		}
+		else
+		{
+			uint8_t outbuf[20480];
+			aac_encode_frame(pcontext, pcontext->input_buf, pcontext->convert_buf, outbuf, sizeof(outbuf), (pcontext->timestamp+timestamp)/2);
+		}
+		pcontext->usedlen = 0;
 		pcontext->timestamp = timestamp;
-		pcontext->usedlen += len - emptylen;
 	}
+	return 1;
+}
+
+int aac_encode_input(struct aac_encode_context_t* pcontext, const unsigned char* pdata, int len, uint32_t timestamp)
+{
+	return aac_encode_collect(pcontext, pdata, len, timestamp, 0);
+}
+
+unsigned int aac_encode_mem_usage(struct aac_encode_context_t* pcontext)
+{
+	if (pcontext == NULL || pcontext->handle == NULL)
+		return 0;
+	// context, input_buf and convert_buf, and what fdk-aac allocated for the instance
+	return sizeof(*pcontext) + 2 * pcontext->input_size + aacEncoder_GetParam(pcontext->handle, AACENC_MEM_USAGE);
 }
 
 void aac_encode_destory(struct aac_encode_context_t* pcontext)
 {
-	if (pcontext!=NULL)
+	if (pcontext == NULL || !g_atomic_int_compare_and_exchange(&pcontext->destroyed, 0, 1))
+		return;
+	//wait for the frames being encoded by a batch worker, if any
+	janus_mutex_lock(&pcontext->process_mutex);
+	janus_mutex_unlock(&pcontext->process_mutex);
+	janus_refcount_decrease(&pcontext->ref);
+}
+
+static void aac_encode_batch_queue(struct aac_encode_context_t* pcontext, uint32_t timestamp)
+{
+	janus_mutex_lock(&pcontext->mutex);
+	if ((int)g_queue_get_length(pcontext->frames) >= AAC_ENCODE_BATCH_MAX_PENDING)
+	{
+		if (pcontext->frames_dropped++ == 0)
+			JANUS_LOG(LOG_WARN, "AAC batch encoder can't keep up, dropping frames\n");
+		janus_mutex_unlock(&pcontext->mutex);
+		return;
+	}
+	struct aac_encode_frame_t* frame = g_malloc(sizeof(struct aac_encode_frame_t) + pcontext->input_size);
+	frame->timestamp = timestamp;
+	memcpy(frame->data, pcontext->input_buf, pcontext->input_size);
+	g_queue_push_tail(pcontext->frames, frame);
+	if (!pcontext->scheduled)
+	{
+		//frames of the same encoder are always encoded in order, by the worker it's bound to
+		struct aac_encode_worker_t* worker = &batch_workers[pcontext->worker];
+		pcontext->scheduled = 1;
+		janus_refcount_increase(&pcontext->ref);
+		janus_mutex_lock(&worker->mutex);
+		g_queue_push_tail(worker->ready, pcontext);
+		janus_condition_signal(&worker->cond);
+		janus_mutex_unlock(&worker->mutex);
+	}
+	janus_mutex_unlock(&pcontext->mutex);
+}
+
+int aac_encode_batch_input(struct aac_encode_context_t* pcontext, const unsigned char* pdata, int len, uint32_t timestamp)
+{
+	if (pcontext == NULL || g_atomic_int_get(&pcontext->destroyed))
+		return -1;
+	if (batch_workers == NULL)
+		return aac_encode_input(pcontext, pdata, len, timestamp);
+	if (pcontext->frames == NULL)
 	{
-		if (pcontext->input_buf!=NULL)
+		pcontext->frames = g_queue_new();
+		pcontext->worker = (g_atomic_int_add(&batch_next, 1) & G_MAXINT) % batch_threads;
+	}
+	uint32_t dropped = pcontext->frames_dropped;
+	aac_encode_collect(pcontext, pdata, len, timestamp, 1);
+	return pcontext->frames_dropped == dropped;
+}
+
+//encodes the frames queued when we got to this encoder, returns 1 if more arrived meanwhile
+static int aac_encode_batch_process(struct aac_encode_worker_t* worker, struct aac_encode_context_t* pcontext)
+{
+	janus_mutex_lock(&pcontext->process_mutex);
+	janus_mutex_lock(&pcontext->mutex);
+	int count = g_queue_get_length(pcontext->frames);
+	janus_mutex_unlock(&pcontext->mutex);
+	if (worker->convert_size < pcontext->input_size)
+	{
+		worker->convert_buf = g_realloc(worker->convert_buf, pcontext->input_size);
+		worker->convert_size = pcontext->input_size;
+	}
+	if (worker->outbuf_size < (int)pcontext->info.maxOutBufBytes)
+	{
+		worker->outbuf = g_realloc(worker->outbuf, pcontext->info.maxOutBufBytes);
+		worker->outbuf_size = pcontext->info.maxOutBufBytes;
+	}
+	while (count-- > 0 && !g_atomic_int_get(&pcontext->destroyed))
+	{
+		janus_mutex_lock(&pcontext->mutex);
+		struct aac_encode_frame_t* frame = g_queue_pop_head(pcontext->frames);
+		janus_mutex_unlock(&pcontext->mutex);
+		aac_encode_frame(pcontext, frame->data, worker->convert_buf, worker->outbuf, worker->outbuf_size, frame->timestamp);
+		g_free(frame);
+	}
+	janus_mutex_unlock(&pcontext->process_mutex);
+	janus_mutex_lock(&pcontext->mutex);
+	int more = !g_queue_is_empty(pcontext->frames) && !g_atomic_int_get(&pcontext->destroyed);
+	if (!more)
+		pcontext->scheduled = 0;
+	janus_mutex_unlock(&pcontext->mutex);
+	return more;
+}
+
+static gpointer aac_encode_batch_thread(gpointer data)
+{
+	struct aac_encode_worker_t* worker = (struct aac_encode_worker_t*)data;
+#ifdef __linux__
+	if (worker->cpu >= 0)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(worker->cpu, &cpus);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) != 0)
+			JANUS_LOG(LOG_WARN, "Couldn't pin AAC batch worker %d to CPU %d\n", worker->id, worker->cpu);
+	}
+#endif
+	GQueue* batch = g_queue_new();
+	while (!g_atomic_int_get(&batch_stopping))
+	{
+		janus_mutex_lock(&worker->mutex);
+		while (g_queue_is_empty(worker->ready) && !g_atomic_int_get(&batch_stopping))
+			janus_condition_wait(&worker->cond, &worker->mutex);
+		janus_mutex_unlock(&worker->mutex);
+		//let the other encoders, and more frames of this one, queue up: an encoder that
+		//encodes several frames in a row finds its state in the cache after the first one
+		if (batch_window > 0 && !g_atomic_int_get(&batch_stopping))
+			g_usleep(batch_window * 1000);
+		janus_mutex_lock(&worker->mutex);
+		GQueue* ready = worker->ready;
+		worker->ready = batch;
+		batch = ready;
+		janus_mutex_unlock(&worker->mutex);
+		struct aac_encode_context_t* pcontext = NULL;
+		while ((pcontext = g_queue_pop_head(batch)) != NULL)
 		{
-			free(pcontext->input_buf);
-			pcontext->input_buf = NULL;
+			if (aac_encode_batch_process(worker, pcontext))
+			{
+				//keep the reference, it's rescheduled
+				janus_mutex_lock(&worker->mutex);
+				g_queue_push_tail(worker->ready, pcontext);
+				janus_mutex_unlock(&worker->mutex);
+				continue;
+			}
+			janus_refcount_decrease(&pcontext->ref);
 		}
-		if (pcontext->convert_buf!=NULL)
+	}
+	g_queue_free(batch);
+	return NULL;
+}
+
+int aac_encode_batch_init(int threads, const char* cpus, int window)
+{
+	if (batch_workers != NULL)
+		return 0;
+	if (threads < 1)
+		threads = 1;
+	int cpu_num = 0;
+#ifdef __linux__
+	int cpu_list[CPU_SETSIZE];
+	if (cpus != NULL)
+	{
+		gchar** items = g_strsplit(cpus, ",", -1);
+		int i = 0;
+		for (i = 0; items[i] != NULL; i++)
 		{
-			free(pcontext->convert_buf);
-			pcontext->convert_buf = NULL;
+			int first = 0, last = 0;
+			int n = sscanf(items[i], "%d-%d", &first, &last);
+			if (n < 1 || first < 0)
+			{
+				JANUS_LOG(LOG_WARN, "Invalid AAC batch CPU '%s', ignoring\n", items[i]);
+				continue;
+			}
+			if (n == 1)
+				last = first;
+			for (; first <= last && first < CPU_SETSIZE && cpu_num < CPU_SETSIZE; first++)
+				cpu_list[cpu_num++] = first;
 		}
-#ifdef TEST_DEBUG
-		if (pcontext->fd != NULL)
+		g_strfreev(items);
+	}
+#else
+	if (cpus != NULL)
+		JANUS_LOG(LOG_WARN, "Pinning AAC batch workers to CPUs is only supported on Linux, ignoring\n");
+#endif
+	batch_window = window >= 0 ? window : AAC_ENCODE_BATCH_WINDOW;
+	g_atomic_int_set(&batch_stopping, 0);
+	batch_workers = g_malloc0(threads * sizeof(struct aac_encode_worker_t));
+	int i = 0;
+	for (i = 0; i < threads; i++)
+	{
+		struct aac_encode_worker_t* worker = &batch_workers[i];
+		worker->id = i;
+		worker->ready = g_queue_new();
+		janus_mutex_init(&worker->mutex);
+		janus_condition_init(&worker->cond);
+#ifdef __linux__
+		worker->cpu = cpu_num > 0 ? cpu_list[i % cpu_num] : -1;
+#endif
+		GError* error = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "aacenc %d", i);
+		worker->thread = g_thread_try_new(tname, aac_encode_batch_thread, worker, &error);
+		if (error != NULL)
 		{
-			fclose(pcontext->fd);
-			pcontext->fd = NULL;
+			JANUS_LOG(LOG_ERR, "Error creating AAC batch worker %d: %s\n", i, error->message);
+			g_error_free(error);
+			batch_threads = i;
+			aac_encode_batch_deinit();
+			return -1;
 		}
-#endif // TEST_DEBUG
-		free(pcontext);
-		pcontext = NULL;
 	}
-	JANUS_LOG(LOG_INFO, "AAC encoder context destroy\n");
+	batch_threads = threads;
+	JANUS_LOG(LOG_INFO, "AAC batch encoder created (%d threads, %d ms window%s)\n",
+		threads, batch_window, cpu_num > 0 ? ", pinned" : "");
+	return 0;
 }
 
+void aac_encode_batch_deinit(void)
+{
+	if (batch_workers == NULL)
+		return;
+	g_atomic_int_set(&batch_stopping, 1);
+	int i = 0;
+	for (i = 0; i < batch_threads; i++)
+	{
+		struct aac_encode_worker_t* worker = &batch_workers[i];
+		janus_mutex_lock(&worker->mutex);
+		janus_condition_broadcast(&worker->cond);
+		janus_mutex_unlock(&worker->mutex);
+	}
+	for (i = 0; i < batch_threads; i++)
+	{
+		struct aac_encode_worker_t* worker = &batch_workers[i];
+		g_thread_join(worker->thread);
+		//encoders still waiting get no more frames encoded
+		struct aac_encode_context_t* pcontext = NULL;
+		while ((pcontext = g_queue_pop_head(worker->ready)) != NULL)
+			janus_refcount_decrease(&pcontext->ref);
+		g_queue_free(worker->ready);
+		g_free(worker->convert_buf);
+		g_free(worker->outbuf);
+		janus_mutex_destroy(&worker->mutex);
+		janus_condition_destroy(&worker->cond);
+	}
+	g_free(batch_workers);
+	batch_workers = NULL;
+	batch_threads = 0;
+}
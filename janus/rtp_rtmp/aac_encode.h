@@ -6,7 +6,16 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <glib.h>
 #include "debug.h"
+#include "mutex.h"
+#include "refcount.h"
+
+//batch mode defaults
+#define AAC_ENCODE_BATCH_THREADS		2
+#define AAC_ENCODE_BATCH_WINDOW			40	//ms a worker waits after the first frame, for more to queue up
+#define AAC_ENCODE_BATCH_MAX_PENDING	8	//frames queued per encoder before we assume we're out of CPU
+
 typedef void(*pcm_encode_cb)(void* parame, unsigned char* pdata, int len, uint32_t timestamp);
 
 struct aac_encode_context_t
@@ -32,6 +41,17 @@ struct aac_encode_context_t
 	uint32_t      timestamp;
 	int           usedlen;
 
+	//batch mode: frames waiting for the worker this encoder is bound to
+	GQueue*       frames;
+	int           scheduled;
+	int           worker;
+	uint32_t      frames_dropped;
+	janus_mutex   mutex;
+	//held while frames are encoded, so that destroying the context waits for the callback to return
+	janus_mutex   process_mutex;
+	volatile gint destroyed;
+	janus_refcount ref;
+
 #ifdef TEST_DEBUG
 	FILE*         fd;
 #endif // TEST_DEBUG
@@ -40,6 +60,19 @@ struct aac_encode_context_t
 
 struct  aac_encode_context_t* aac_encoder_init(int channle, int sample_rate, int format, int aot, int vbr, pcm_encode_cb cbfun,void* cbdata);
 int aac_encode_input(struct  aac_encode_context_t* pcontext,const unsigned char* pdata, int len, uint32_t timestamp);
+// heap memory held by the encoder instance, in bytes
+unsigned int aac_encode_mem_usage(struct  aac_encode_context_t* pcontext);
+//after this returns the callback won't be invoked anymore
 void aac_encode_destory(struct  aac_encode_context_t* pcontext);
 
+//batch mode: many encoders share a pool of worker threads, each encoder always on the same one,
+//and a worker encodes all the frames an encoder has queued in a row, one encoder after the other,
+//instead of one frame per call in the caller's thread; cpus (e.g., "2-5,8") pins each worker to
+//one of the CPUs, round robin, window is how long (ms) a worker lets frames queue up
+int  aac_encode_batch_init(int threads, const char* cpus, int window);
+void aac_encode_batch_deinit(void);
+//same as aac_encode_input, but cbfun is invoked by a worker; falls back to aac_encode_input if
+//the pool isn't running, returns 0 if the frame was dropped because the worker is behind
+int  aac_encode_batch_input(struct  aac_encode_context_t* pcontext, const unsigned char* pdata, int len, uint32_t timestamp);
+
 #endif __AAC_ENCODEC_H__ 
@@ -0,0 +1,191 @@
+//aac-encode-bench: aggregate AAC encoding throughput of many legacy RTMP pushes, with the
+//encoders driven as pushstream does by default (aac_encode_input, in the threads that feed them
+//the PCM) or in batch mode (aac_encode_batch_input, encoded by the shared workers)
+//
+//all streams get 20 ms of 48 kHz stereo PCM in turn, as they would every 20 ms, but as fast as
+//they're encoded: in batch mode the feeder stays a few frames ahead of the workers, so nothing
+//is dropped; we report the frames encoded per second, and per CPU second (feeding included)
+//
+//usage: aac-encode-bench [-m session|batch] [-n streams] [-s seconds of audio] [-t threads] [-c cpus] [-w window]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "aac_encode.h"
+#include "log.h"
+
+int janus_log_level = LOG_WARN;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+GHashTable *counters = NULL;
+janus_mutex counters_mutex;
+
+#define BENCH_SAMPLE_RATE	48000
+#define BENCH_CHANNELS		2
+#define BENCH_PTIME			20
+#define BENCH_CHUNK			(BENCH_SAMPLE_RATE / 1000 * BENCH_PTIME * BENCH_CHANNELS * 2)
+#define BENCH_SOURCE		(4 * BENCH_SAMPLE_RATE * BENCH_CHANNELS * 2)	//4 seconds, shared by all streams
+#define BENCH_FRAME			1024		//samples per AAC frame
+#define BENCH_AHEAD			2			//frames per stream the batch feeder gets ahead of the workers
+
+struct bench_feeder_t
+{
+	int            id;
+	int            threads;
+	int            streams;
+	int            seconds;
+	int            batch;
+	struct aac_encode_context_t** encoders;
+	const unsigned char* source;
+	GThread*       thread;
+};
+
+static volatile gint frames_out = 0;
+
+static void bench_callback(void* param, unsigned char* pdata, int len, uint32_t timestamp)
+{
+	g_atomic_int_inc(&frames_out);
+}
+
+static double bench_cpu_time(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static gpointer bench_feeder_thread(gpointer data)
+{
+	struct bench_feeder_t* feeder = (struct bench_feeder_t*)data;
+	int ticks = feeder->seconds * 1000 / BENCH_PTIME, tick = 0, i = 0;
+	for (tick = 0; tick < ticks; tick++)
+	{
+		//frames the encoders completed so far, for all streams
+		int64_t fed = (int64_t)tick * BENCH_SAMPLE_RATE / 1000 * BENCH_PTIME / BENCH_FRAME * feeder->streams;
+		while (feeder->batch && fed - g_atomic_int_get(&frames_out) > (int64_t)BENCH_AHEAD * feeder->streams)
+			g_usleep(1000);
+		for (i = feeder->id; i < feeder->streams; i += feeder->threads)
+		{
+			//each stream reads the source from its own offset
+			size_t offset = ((size_t)i * 7919 * 4 + (size_t)tick * BENCH_CHUNK) % (BENCH_SOURCE - BENCH_CHUNK);
+			offset &= ~(size_t)3;
+			if (feeder->batch)
+				aac_encode_batch_input(feeder->encoders[i], feeder->source + offset, BENCH_CHUNK, tick * BENCH_PTIME);
+			else
+				aac_encode_input(feeder->encoders[i], feeder->source + offset, BENCH_CHUNK, tick * BENCH_PTIME);
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	int streams = 500, seconds = 10, threads = 1, window = 0, batch = 0;
+	const char* cpus = NULL;
+	int opt = 0, i = 0;
+	while ((opt = getopt(argc, argv, "m:n:s:t:c:w:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'm': batch = !strcmp(optarg, "batch"); break;
+		case 'n': streams = atoi(optarg); break;
+		case 's': seconds = atoi(optarg); break;
+		case 't': threads = atoi(optarg); break;
+		case 'c': cpus = optarg; break;
+		case 'w': window = atoi(optarg); break;
+		default:
+			printf("Usage: %s [-m session|batch] [-n streams] [-s seconds of audio] [-t threads] [-c cpus] [-w window]\n", argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (streams < 1 || seconds < 1 || threads < 1)
+	{
+		printf("Invalid arguments\n");
+		return 1;
+	}
+	janus_log_init(FALSE, TRUE, NULL);
+	atexit(janus_log_destroy);
+
+	//a tone and some noise, different on the two channels
+	unsigned char* source = g_malloc(BENCH_SOURCE);
+	srand(1);
+	for (i = 0; i < BENCH_SOURCE / 4; i++)
+	{
+		int16_t l = (int16_t)(8000 * sin(2 * M_PI * 440 * i / BENCH_SAMPLE_RATE) + (rand() % 2000) - 1000);
+		int16_t r = (int16_t)(6000 * sin(2 * M_PI * 660 * i / BENCH_SAMPLE_RATE) + (rand() % 2000) - 1000);
+		source[4*i] = l & 0xff;
+		source[4*i+1] = (l >> 8) & 0xff;
+		source[4*i+2] = r & 0xff;
+		source[4*i+3] = (r >> 8) & 0xff;
+	}
+
+	//same settings pushstream uses
+	struct aac_encode_context_t** encoders = g_malloc0(streams * sizeof(struct aac_encode_context_t*));
+	for (i = 0; i < streams; i++)
+	{
+		encoders[i] = aac_encoder_init(BENCH_CHANNELS, BENCH_SAMPLE_RATE, 1, 2, 1, bench_callback, NULL);
+		if (encoders[i] == NULL)
+		{
+			printf("Error creating encoder %d\n", i);
+			return 1;
+		}
+	}
+	if (batch && aac_encode_batch_init(threads, cpus, window) < 0)
+	{
+		printf("Error creating the batch workers\n");
+		return 1;
+	}
+
+	//in batch mode a single thread feeds all the streams, the workers do the encoding
+	int feeders_num = batch ? 1 : threads;
+	struct bench_feeder_t* feeders = g_malloc0(feeders_num * sizeof(struct bench_feeder_t));
+	double cpu = bench_cpu_time();
+	gint64 start = g_get_monotonic_time();
+	for (i = 0; i < feeders_num; i++)
+	{
+		feeders[i].id = i;
+		feeders[i].threads = feeders_num;
+		feeders[i].streams = streams;
+		feeders[i].seconds = seconds;
+		feeders[i].batch = batch;
+		feeders[i].encoders = encoders;
+		feeders[i].source = source;
+		feeders[i].thread = g_thread_new("feeder", bench_feeder_thread, &feeders[i]);
+	}
+	for (i = 0; i < feeders_num; i++)
+		g_thread_join(feeders[i].thread);
+	//let the workers encode what's still queued
+	if (batch)
+	{
+		int last = -1;
+		while (last != g_atomic_int_get(&frames_out))
+		{
+			last = g_atomic_int_get(&frames_out);
+			g_usleep((window + BENCH_PTIME) * 1000);
+		}
+	}
+	double elapsed = (g_get_monotonic_time() - start) / 1e6;
+	cpu = bench_cpu_time() - cpu;
+
+	uint32_t dropped = 0;
+	aac_encode_batch_deinit();
+	for (i = 0; i < streams; i++)
+	{
+		dropped += encoders[i]->frames_dropped;
+		aac_encode_destory(encoders[i]);
+	}
+	int frames = g_atomic_int_get(&frames_out);
+	printf("%s, %d streams, %d threads%s%s: %d frames in %.2f s, %.0f frames/s, cpu %.2f s, %.0f frames per cpu second, %u dropped\n",
+		batch ? "batch" : "session", streams, threads, batch && cpus ? ", cpus " : "", batch && cpus ? cpus : "",
+		frames, elapsed, frames / elapsed, cpu, cpu > 0 ? frames / cpu : 0, dropped);
+	g_free(feeders);
+	g_free(encoders);
+	g_free(source);
+	return 0;
+}
@@ -0,0 +1,247 @@
+//annexb-bench: throughput of the H.264/H.265 start code scanner (mpeg4_h264_startcode) the annexb to
+//mp4 converters and the RTP H.264/H.265 packers use, against the byte by byte loop they had before
+//
+//access units are split in NAL units as h264_stream and the packers do, a start code at a time; they
+//come from an Annex B file (-f, e.g. one saved with ffmpeg -c copy -bsf h264_mp4toannexb out.h264) or
+//are a synthetic 1080p and 4K GOP, with keyframe and P frame sizes close to what browsers and OBS send
+//(random slice data with emulation prevention, so only real start codes are found)
+//
+//the scanner picks AVX2 or SSE2 at runtime: run with MPEG4_STARTCODE_SIMD=sse2 or none to compare
+//
+//usage: annexb-bench [-f file] [-n passes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "mpeg4-avc.h"
+
+#define BENCH_GOP			60		//access units per GOP, the first one a keyframe
+#define BENCH_BYTES			(1024L * 1024 * 1024)	//scan at least this much for each measure
+
+struct bench_au_t
+{
+	const uint8_t* data;
+	size_t bytes;
+};
+
+struct bench_profile_t
+{
+	const char* name;
+	size_t keyframe;	//bytes of slice data
+	size_t frame;
+	int slices;
+};
+
+static const struct bench_profile_t s_profiles[] = {
+	{ "1080p", 180 * 1024, 30 * 1024, 1 },
+	{ "4K", 720 * 1024, 120 * 1024, 4 },
+};
+
+//what h264_startcode and hevc_startcode did, and the packers' h264_nalu_find and h265_nalu_find
+static const uint8_t* bench_byte_loop(const uint8_t* data, size_t bytes)
+{
+	size_t i;
+	for (i = 2; i + 1 < bytes; i++)
+	{
+		if (0x01 == data[i] && 0x00 == data[i - 1] && 0x00 == data[i - 2])
+			return data + i + 1;
+	}
+
+	return NULL;
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t* bench_nalu(uint8_t* p, const uint8_t* nalu, size_t bytes, int longcode)
+{
+	static const uint8_t startcode[] = { 0x00, 0x00, 0x00, 0x01 };
+	memcpy(p, longcode ? startcode : startcode + 1, longcode ? 4 : 3);
+	p += longcode ? 4 : 3;
+	memcpy(p, nalu, bytes);
+	return p + bytes;
+}
+
+//slice data: random, with a zero byte every so often, and an emulation prevention byte where
+//the encoder would put one
+static uint8_t* bench_slice(uint8_t* p, uint8_t type, size_t bytes, int longcode)
+{
+	size_t i;
+	int zeros = 0;
+	uint8_t v;
+
+	p = bench_nalu(p, &type, 1, longcode);
+	for (i = 0; i < bytes; i++)
+	{
+		v = (rand() % 24) ? (uint8_t)rand() : 0;
+		if (zeros >= 2 && v <= 3)
+		{
+			*p++ = 0x03;
+			zeros = 0;
+		}
+		*p++ = v;
+		zeros = v ? 0 : zeros + 1;
+	}
+	*p++ = 0x80; // rbsp_stop_one_bit
+	return p;
+}
+
+static uint8_t* bench_gop_create(const struct bench_profile_t* profile, struct bench_au_t* aus)
+{
+	static const uint8_t aud[] = { 0x09, 0xf0 };
+	static const uint8_t sps[] = { 0x67, 0x64, 0x00, 0x33, 0xac, 0xb4, 0x03, 0xc0, 0x11, 0x3f, 0x2e, 0x02, 0x20, 0x00, 0x00, 0x03, 0x00, 0x20, 0x00, 0x00, 0x07, 0x81, 0xe3, 0x06, 0x54 };
+	static const uint8_t pps[] = { 0x68, 0xee, 0x3c, 0xb0 };
+	size_t capacity;
+	uint8_t *gop, *p;
+	int i, j;
+
+	//room for the emulation prevention bytes too
+	capacity = (profile->keyframe + profile->frame * (BENCH_GOP - 1)) * 2 + BENCH_GOP * (profile->slices + 2) * 64;
+	gop = (uint8_t*)malloc(capacity);
+	if (!gop) return NULL;
+
+	p = gop;
+	for (i = 0; i < BENCH_GOP; i++)
+	{
+		aus[i].data = p;
+		p = bench_nalu(p, aud, sizeof(aud), 1);
+		if (0 == i)
+		{
+			p = bench_nalu(p, sps, sizeof(sps), 1);
+			p = bench_nalu(p, pps, sizeof(pps), 1);
+		}
+		for (j = 0; j < profile->slices; j++)
+			p = bench_slice(p, 0 == i ? 0x65 : 0x41, (0 == i ? profile->keyframe : profile->frame) / profile->slices, 0 == j);
+		aus[i].bytes = p - aus[i].data;
+	}
+	return gop;
+}
+
+//find the NAL units of all access units, as h264_stream does
+static double bench_run(const uint8_t* (*startcode)(const uint8_t*, size_t), const struct bench_au_t* aus, int count, int passes, size_t* nalus)
+{
+	const uint8_t *p, *end;
+	size_t bytes = 0;
+	double start;
+	int i, pass;
+
+	*nalus = 0;
+	start = bench_now();
+	for (pass = 0; pass < passes; pass++)
+	{
+		for (i = 0; i < count; i++)
+		{
+			end = aus[i].data + aus[i].bytes;
+			for (p = startcode(aus[i].data, aus[i].bytes); p; p = startcode(p, end - p))
+				++*nalus;
+			bytes += aus[i].bytes;
+		}
+	}
+	return bytes / (bench_now() - start) / 1e9;
+}
+
+static int bench(const char* name, const struct bench_au_t* aus, int count, int passes)
+{
+	size_t bytes = 0, nalus = 0, expected = 0;
+	double loop, simd;
+	const char* simd_name;
+	int i;
+
+	for (i = 0; i < count; i++)
+		bytes += aus[i].bytes;
+	if (passes < 1)
+		passes = (int)(BENCH_BYTES / bytes) + 1;
+
+	loop = bench_run(bench_byte_loop, aus, count, passes, &expected);
+	simd = bench_run(mpeg4_h264_startcode, aus, count, passes, &nalus);
+	if (nalus != expected)
+	{
+		printf("%s: %zu NAL units found, the byte loop found %zu\n", name, nalus, expected);
+		return -1;
+	}
+
+	simd_name = getenv("MPEG4_STARTCODE_SIMD");
+	printf("%-6s %3d access units, %6.2f MB, %3zu NAL units: byte loop %6.2f GB/s, scanner (%s) %6.2f GB/s, %.1fx\n",
+		name, count, bytes / 1e6, expected / passes, loop, simd_name && *simd_name ? simd_name : "auto", simd, simd / loop);
+	return 0;
+}
+
+static uint8_t* bench_file_load(const char* path, size_t* bytes)
+{
+	FILE* fp;
+	uint8_t* data;
+	long size;
+
+	fp = fopen(path, "rb");
+	if (!fp) return NULL;
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	data = size > 0 ? (uint8_t*)malloc(size) : NULL;
+	if (data && 1 != fread(data, size, 1, fp))
+	{
+		free(data);
+		data = NULL;
+	}
+	fclose(fp);
+	*bytes = data ? (size_t)size : 0;
+	return data;
+}
+
+int main(int argc, char* argv[])
+{
+	struct bench_au_t aus[BENCH_GOP];
+	const char* file = NULL;
+	uint8_t* data;
+	size_t bytes = 0;
+	int passes = 0, opt = 0, r = 0;
+	size_t i;
+
+	while ((opt = getopt(argc, argv, "f:n:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f': file = optarg; break;
+		case 'n': passes = atoi(optarg); break;
+		default:
+			printf("Usage: %s [-f file] [-n passes]\n", argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (file)
+	{
+		//the whole file at once: NAL units are found the same way, whatever the access units
+		data = bench_file_load(file, &bytes);
+		if (!data)
+		{
+			printf("Error reading %s\n", file);
+			return 1;
+		}
+		aus[0].data = data;
+		aus[0].bytes = bytes;
+		r = bench(file, aus, 1, passes);
+		free(data);
+		return r ? 1 : 0;
+	}
+
+	srand(1);
+	for (i = 0; i < sizeof(s_profiles) / sizeof(s_profiles[0]); i++)
+	{
+		data = bench_gop_create(&s_profiles[i], aus);
+		if (!data)
+		{
+			printf("Error creating the %s access units\n", s_profiles[i].name);
+			return 1;
+		}
+		r |= bench(s_profiles[i].name, aus, BENCH_GOP, passes);
+		free(data);
+	}
+	return r ? 1 : 0;
+}
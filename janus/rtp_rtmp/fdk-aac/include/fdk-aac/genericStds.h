@@ -277,6 +277,25 @@ void *FDKaalloc (const UINT size, const UINT alignment);
  */
 void FDKafree (void *ptr);
 
+/**
+ *  Start counting the heap memory allocated by the calling thread. Until FDKmemMeterStop(),
+ *  the size of every FDKcalloc() and FDKmalloc() request of the thread (and so of FDKaalloc(),
+ *  FDKcalloc_L() and FDKaalloc_L() too) is added to *pBytes, and with glibc the size of every
+ *  block FDKfree() releases is subtracted from it. The libraries use this to report the memory
+ *  held by an instance.
+ *
+ * \param pBytes  Counter the allocated bytes are added to.
+ * \return        void
+ */
+void FDKmemMeterStart (UINT *pBytes);
+
+/**
+ *  Stop counting the heap memory allocated by the calling thread.
+ *
+ * \return     void
+ */
+void FDKmemMeterStop (void);
+
 
 /**
  *  Allocate memory in a specific memory section.
@@ -93,7 +93,7 @@ struct flv_muxer_context_t * flv_muxer_video_audio_init(void* parma, flv_muxer_c
 
 int flv_muxer_video_audio_input(struct flv_muxer_context_t*pcontext, int avtype, int64_t pts, int64_t dts, const void* data, size_t bytes)
 {
-	if (PSI_STREAM_AAC == avtype || PSI_STREAM_MP3 == avtype) {
+	if (PSI_STREAM_AAC == avtype || PSI_STREAM_MP3 == avtype || PSI_STREAM_AUDIO_OPUS == avtype) {
 		if (0 == pcontext->a_s_pts)
 			pcontext->a_s_pts = pts;
 		pts -= pcontext->a_s_pts;
@@ -118,6 +118,10 @@ int flv_muxer_video_audio_input(struct flv_muxer_context_t*pcontext, int avtype,
 	{
 		flv_muxer_mp3(pcontext->muxer, data, bytes, (uint32_t)(pts / 48), (uint32_t)(pts / 48));
 	}
+	else if (PSI_STREAM_AUDIO_OPUS == avtype)
+	{
+		flv_muxer_opus(pcontext->muxer, data, bytes, (uint32_t)(pts / 48), (uint32_t)(pts / 48));
+	}
 	else if (PSI_STREAM_H264 == avtype)
 	{
 		flv_muxer_avc(pcontext->muxer, data, bytes, (uint32_t)(pts / 90), (uint32_t)(pts / 90));
@@ -128,6 +132,14 @@ int flv_muxer_video_audio_input(struct flv_muxer_context_t*pcontext, int avtype,
 	}
 }
 
+void flv_muxer_video_audio_set_enhanced(struct flv_muxer_context_t *pcontext, int enhanced)
+{
+	if (pcontext != NULL && pcontext->muxer != NULL)
+	{
+		flv_muxer_set_enhanced(pcontext->muxer, enhanced);
+	}
+}
+
 void flv_muxer_video_audio_destory(struct flv_muxer_context_t *pcontext)
 {
 	if (pcontext != NULL)
@@ -62,6 +62,7 @@ enum EPSI_STREAM_TYPE
 	PSI_STREAM_AUDIO_G722		= 0x92,
 	PSI_STREAM_AUDIO_G723		= 0x93,
 	PSI_STREAM_AUDIO_G729		= 0x99,
+	PSI_STREAM_AUDIO_OPUS		= 0x9c,
 };
 
 typedef void(*flv_muxer_cb)(void* flv, int type, const void* data, size_t bytes, uint32_t timestamp);
@@ -86,6 +87,9 @@ struct flv_muxer_context_t * flv_muxer_video_audio_init(void* parma, flv_muxer_c
 
 int flv_muxer_video_audio_input(struct flv_muxer_context_t*pcontext,int avtype, int64_t pts, int64_t dts, const void* data, size_t bytes);
 
+//enhanced RTMP: HEVC gets an ExVideoTagHeader, needed for Opus (PSI_STREAM_AUDIO_OPUS) too
+void flv_muxer_video_audio_set_enhanced(struct flv_muxer_context_t *pcontext, int enhanced);
+
 void flv_muxer_video_audio_destory(struct flv_muxer_context_t *pcontext);
 
 #endif // !__FLV_MUXER_VIDEO_AUDIO_H__
@@ -0,0 +1,743 @@
+#include "http_flv_server.h"
+#include "flv_muxer_video_audio.h"
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include "utils.h"
+
+static const char http_flv_ok[] = "HTTP/1.1 200 OK\r\n"
+	"Content-Type: video/x-flv\r\n"
+	"Transfer-Encoding: chunked\r\n"
+	"Connection: close\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Access-Control-Allow-Origin: *\r\n\r\n";
+static const char http_flv_not_found[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char http_flv_bad_request[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+//FLV header (audio and video) and PreviousTagSize0, as a chunk of its own
+static const unsigned char http_flv_header[] = { 'd', '\r', '\n', 'F', 'L', 'V', 0x01, 0x05, 0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x00, '\r', '\n' };
+
+static struct http_flv_tag_t* http_flv_tag_alloc(size_t len)
+{
+	struct http_flv_tag_t* tag = (struct http_flv_tag_t*)malloc(sizeof(struct http_flv_tag_t) + len);
+	if (tag == NULL)
+	{
+		JANUS_LOG(LOG_ERR, "Http flv malloc tag failed, err = %d\n", errno);
+		return NULL;
+	}
+	g_atomic_int_set(&tag->ref, 1);
+	tag->keyframe = 0;
+	tag->len = len;
+	return tag;
+}
+
+static void http_flv_tag_ref(struct http_flv_tag_t* tag)
+{
+	if (tag != NULL)
+		g_atomic_int_inc(&tag->ref);
+}
+
+static void http_flv_tag_unref(struct http_flv_tag_t* tag)
+{
+	if (tag != NULL && g_atomic_int_dec_and_test(&tag->ref))
+		free(tag);
+}
+
+static struct http_flv_tag_t* http_flv_tag_create(int type, const void* data, size_t bytes, uint32_t timestamp)
+{
+	char prefix[16];
+	int n = g_snprintf(prefix, sizeof(prefix), "%zx\r\n", bytes + 15);
+	struct http_flv_tag_t* tag = http_flv_tag_alloc(n + 11 + bytes + 4 + 2);
+	if (tag == NULL)
+		return NULL;
+	unsigned char* p = tag->data;
+	memcpy(p, prefix, n);
+	p += n;
+	flv_write_tag(p, (uint8_t)type, (uint32_t)bytes, timestamp);
+	p += 11;
+	memcpy(p, data, bytes);
+	p += bytes;
+	be_write_uint32(p, (uint32_t)bytes + 11);
+	p += 4;
+	memcpy(p, "\r\n", 2);
+	return tag;
+}
+
+static void http_flv_channel_free(const janus_refcount* ref)
+{
+	struct http_flv_channel_t* channel = janus_refcount_containerof(ref, struct http_flv_channel_t, ref);
+	int i;
+	for (i = 0; i < channel->ring_size; i++)
+		http_flv_tag_unref(channel->ring[i]);
+	free(channel->ring);
+	http_flv_tag_unref(channel->script);
+	http_flv_tag_unref(channel->video_header);
+	http_flv_tag_unref(channel->audio_header);
+	JANUS_LOG(LOG_INFO, "Http flv channel %s destroy (tags %"PRIu64", bytes %"PRIu64", resyncs %u)\n",
+		channel->name, channel->tags, channel->bytes, channel->resyncs);
+	g_free(channel->name);
+	free(channel);
+}
+
+static void http_flv_wakeup(struct http_flv_server_t* pserver)
+{
+	int code = 1;
+	ssize_t res = 0;
+	do {
+		res = write(pserver->pipefd[1], &code, sizeof(int));
+	} while (res == -1 && errno == EINTR);
+}
+
+//tell the server thread the channel has something for its viewers (with the channel mutex held)
+static void http_flv_channel_schedule(struct http_flv_server_t* pserver, struct http_flv_channel_t* channel)
+{
+	janus_mutex_lock(&pserver->mutex);
+	janus_refcount_increase(&channel->ref);
+	g_queue_push_tail(pserver->dirty, channel);
+	int wakeup = g_queue_get_length(pserver->dirty) == 1;
+	janus_mutex_unlock(&pserver->mutex);
+	if (wakeup)
+		http_flv_wakeup(pserver);
+}
+
+static void http_flv_client_close(struct http_flv_server_t* pserver, struct http_flv_client_t* client)
+{
+	epoll_ctl(pserver->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+	pserver->clients = g_list_remove(pserver->clients, client);
+	if (client->channel != NULL)
+	{
+		struct http_flv_channel_t* channel = client->channel;
+		janus_mutex_lock(&channel->mutex);
+		channel->clients = g_list_remove(channel->clients, client);
+		channel->viewers--;
+		janus_mutex_unlock(&channel->mutex);
+		JANUS_LOG(LOG_VERB, "Http flv viewer %s left %s\n", client->addr, channel->name);
+		janus_refcount_decrease(&channel->ref);
+	}
+	http_flv_tag_unref(client->partial);
+	socket_close(client->fd);
+	free(client);
+}
+
+//send whatever we can without blocking, with the channel mutex held: returns -1 if the viewer is gone
+static int http_flv_client_flush(struct http_flv_client_t* client)
+{
+	struct http_flv_channel_t* channel = client->channel;
+	while (client->writable)
+	{
+		if (channel->head - client->cursor > (uint64_t)channel->ring_size)
+		{
+			/* Too slow, what we still had to send was overwritten already: jump to the latest keyframe */
+			client->cursor = channel->has_gop ? channel->gop : channel->head;
+			client->waiting_keyframe = !channel->has_gop;
+			channel->resyncs++;
+		}
+		struct iovec iov[HTTP_FLV_MAX_IOV];
+		struct http_flv_tag_t* tags[HTTP_FLV_MAX_IOV];
+		size_t total = 0;
+		int n = 0;
+		if (client->partial != NULL)
+		{
+			iov[0].iov_base = client->partial->data + client->offset;
+			iov[0].iov_len = client->partial->len - client->offset;
+			tags[0] = client->partial;
+			total += iov[0].iov_len;
+			n++;
+		}
+		int first = n;
+		uint64_t seq = client->cursor;
+		while (n < HTTP_FLV_MAX_IOV && seq < channel->head)
+		{
+			struct http_flv_tag_t* tag = channel->ring[seq % channel->ring_size];
+			seq++;
+			if (client->waiting_keyframe)
+			{
+				/* Nothing was queued from the ring yet, so we can just move on */
+				if (!tag->keyframe)
+				{
+					client->cursor = seq;
+					continue;
+				}
+				client->waiting_keyframe = 0;
+			}
+			iov[n].iov_base = tag->data;
+			iov[n].iov_len = tag->len;
+			tags[n] = tag;
+			total += tag->len;
+			n++;
+		}
+		if (n == 0)
+			return 0;
+		ssize_t res = writev(client->fd, iov, n);
+		if (res < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				client->writable = 0;
+				return 0;
+			}
+			return -1;
+		}
+		/* Account for what went out */
+		size_t left = (size_t)res;
+		int i;
+		for (i = 0; i < n; i++)
+		{
+			size_t len = iov[i].iov_len;
+			if (left < len)
+			{
+				if (left > 0 || i < first)
+				{
+					/* Keep the chunk we're in the middle of, it may leave the ring before we're done */
+					if (i >= first)
+					{
+						http_flv_tag_ref(tags[i]);
+						http_flv_tag_unref(client->partial);
+						client->partial = tags[i];
+						client->offset = left;
+						client->cursor++;
+					}
+					else
+					{
+						client->offset += left;
+					}
+				}
+				break;
+			}
+			left -= len;
+			if (i < first)
+			{
+				http_flv_tag_unref(client->partial);
+				client->partial = NULL;
+				client->offset = 0;
+			}
+			else
+			{
+				client->cursor++;
+			}
+		}
+		if ((size_t)res < total)
+			client->writable = 0;
+	}
+	return 0;
+}
+
+//error responses are a few bytes on a connection we never wrote to, so they fit in the socket
+//buffer: we try once without blocking, as this is the thread serving all the viewers, and close anyway
+static void http_flv_client_reply(struct http_flv_client_t* client, const char* response)
+{
+	if (socket_send(client->fd, response, strlen(response), MSG_NOSIGNAL) < 0)
+		JANUS_LOG(LOG_VERB, "Http flv couldn't reply to %s, err = %d\n", client->addr, errno);
+}
+
+//we got the whole request: returns 0 if the viewer is now attached to a channel
+static int http_flv_client_attach(struct http_flv_server_t* pserver, struct http_flv_client_t* client)
+{
+	/* GET /<app>/<name>.flv[?query] HTTP/1.x */
+	char* path = client->request;
+	if (strncmp(path, "GET ", 4) != 0)
+	{
+		http_flv_client_reply(client, http_flv_bad_request);
+		return -1;
+	}
+	path += 4;
+	char* end = strpbrk(path, " ?\r\n");
+	if (end == NULL)
+	{
+		http_flv_client_reply(client, http_flv_bad_request);
+		return -1;
+	}
+	*end = '\0';
+	char* name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+	size_t len = strlen(name);
+	if (len > 4 && !strcmp(name + len - 4, ".flv"))
+		name[len - 4] = '\0';
+
+	janus_mutex_lock(&pserver->mutex);
+	struct http_flv_channel_t* channel = g_hash_table_lookup(pserver->channels, name);
+	if (channel != NULL)
+		janus_refcount_increase(&channel->ref);
+	janus_mutex_unlock(&pserver->mutex);
+	if (channel == NULL || g_atomic_int_get(&channel->closed))
+	{
+		JANUS_LOG(LOG_VERB, "Http flv viewer %s asked for unknown stream %s\n", client->addr, name);
+		if (channel != NULL)
+			janus_refcount_decrease(&channel->ref);
+		http_flv_client_reply(client, http_flv_not_found);
+		return -1;
+	}
+
+	janus_mutex_lock(&channel->mutex);
+	/* Response headers, FLV header, then the latest metadata and sequence headers, all in one go */
+	size_t prologue = strlen(http_flv_ok) + sizeof(http_flv_header);
+	struct http_flv_tag_t* headers[3] = { channel->script, channel->video_header, channel->audio_header };
+	int i;
+	for (i = 0; i < 3; i++)
+		prologue += headers[i] ? headers[i]->len : 0;
+	struct http_flv_tag_t* tag = http_flv_tag_alloc(prologue);
+	if (tag == NULL)
+	{
+		janus_mutex_unlock(&channel->mutex);
+		janus_refcount_decrease(&channel->ref);
+		return -1;
+	}
+	unsigned char* p = tag->data;
+	memcpy(p, http_flv_ok, strlen(http_flv_ok));
+	p += strlen(http_flv_ok);
+	memcpy(p, http_flv_header, sizeof(http_flv_header));
+	p += sizeof(http_flv_header);
+	for (i = 0; i < 3; i++)
+	{
+		if (headers[i] == NULL)
+			continue;
+		memcpy(p, headers[i]->data, headers[i]->len);
+		p += headers[i]->len;
+	}
+	client->partial = tag;
+	client->offset = 0;
+	/* Start from the GOP cache, if we have one, so that the viewer can decode right away */
+	client->cursor = channel->has_gop ? channel->gop : channel->head;
+	client->waiting_keyframe = !channel->has_gop;
+	client->channel = channel;
+	channel->clients = g_list_append(channel->clients, client);
+	channel->viewers++;
+	int res = http_flv_client_flush(client);
+	janus_mutex_unlock(&channel->mutex);
+	JANUS_LOG(LOG_INFO, "Http flv viewer %s watching %s (%s)\n", client->addr, channel->name,
+		client->waiting_keyframe ? "waiting for a keyframe" : "from the GOP cache");
+	return res;
+}
+
+//returns 0 if the connection is still alive
+static int http_flv_client_read(struct http_flv_server_t* pserver, struct http_flv_client_t* client)
+{
+	while (1)
+	{
+		int r = socket_recv(client->fd, pserver->buffer, sizeof(pserver->buffer), 0);
+		if (r == 0)
+			return -1;
+		if (r < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+		if (client->channel != NULL)
+		{
+			/* Viewers have nothing to tell us once they're attached */
+			continue;
+		}
+		if (client->request_len + r >= sizeof(client->request))
+		{
+			http_flv_client_reply(client, http_flv_bad_request);
+			return -1;
+		}
+		memcpy(client->request + client->request_len, pserver->buffer, r);
+		client->request_len += r;
+		client->request[client->request_len] = '\0';
+		if (strstr(client->request, "\r\n\r\n") != NULL && http_flv_client_attach(pserver, client) != 0)
+			return -1;
+	}
+}
+
+static void http_flv_accept(struct http_flv_server_t* pserver)
+{
+	while (1)
+	{
+		struct sockaddr_storage ss;
+		socklen_t len = sizeof(ss);
+		u_short port = 0;
+		socket_t fd = socket_accept(pserver->listen_fd, &ss, &len);
+		if (socket_invalid == fd)
+			return;
+		if ((int)g_list_length(pserver->clients) >= pserver->max_clients)
+		{
+			JANUS_LOG(LOG_WARN, "Http flv too many viewers (%d), rejecting a new one\n", pserver->max_clients);
+			socket_close(fd);
+			continue;
+		}
+		struct http_flv_client_t* client = (struct http_flv_client_t*)calloc(1, sizeof(struct http_flv_client_t));
+		if (client == NULL)
+		{
+			JANUS_LOG(LOG_ERR, "Http flv calloc http_flv_client_t failed, err = %d\n", errno);
+			socket_close(fd);
+			continue;
+		}
+		client->fd = fd;
+		client->writable = 1;
+		client->connected = janus_get_monotonic_time();
+		socket_addr_to((struct sockaddr*)&ss, len, client->addr, &port);
+		socket_setnonblock(fd, 1);
+		socket_setnondelay(fd, 1);
+
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		ev.data.ptr = client;
+		if (epoll_ctl(pserver->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+		{
+			JANUS_LOG(LOG_ERR, "Http flv can't serve %s, err = %d\n", client->addr, errno);
+			socket_close(fd);
+			free(client);
+			continue;
+		}
+		pserver->clients = g_list_append(pserver->clients, client);
+		JANUS_LOG(LOG_VERB, "Http flv new connection from %s:%hu\n", client->addr, port);
+	}
+}
+
+//deliver the new tags of the channels that got some, and drop the viewers of the channels that are gone
+static void http_flv_deliver(struct http_flv_server_t* pserver)
+{
+	while (1)
+	{
+		janus_mutex_lock(&pserver->mutex);
+		struct http_flv_channel_t* channel = g_queue_pop_head(pserver->dirty);
+		janus_mutex_unlock(&pserver->mutex);
+		if (channel == NULL)
+			break;
+		GList* gone = NULL;
+		janus_mutex_lock(&channel->mutex);
+		channel->queued = 0;
+		GList* l = channel->clients;
+		while (l)
+		{
+			struct http_flv_client_t* client = (struct http_flv_client_t*)l->data;
+			if (g_atomic_int_get(&channel->closed) || http_flv_client_flush(client) != 0)
+				gone = g_list_prepend(gone, client);
+			l = l->next;
+		}
+		janus_mutex_unlock(&channel->mutex);
+		for (l = gone; l != NULL; l = l->next)
+			http_flv_client_close(pserver, (struct http_flv_client_t*)l->data);
+		g_list_free(gone);
+		janus_refcount_decrease(&channel->ref);
+	}
+}
+
+static void* http_flv_thread(void* data)
+{
+	struct http_flv_server_t* pserver = (struct http_flv_server_t*)data;
+	struct epoll_event events[64];
+	int64_t last_check = janus_get_monotonic_time();
+	JANUS_LOG(LOG_INFO, "Http flv thread started\n");
+	while (!g_atomic_int_get(&pserver->stopping))
+	{
+		int n = epoll_wait(pserver->epoll_fd, events, sizeof(events) / sizeof(events[0]), 1000);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			JANUS_LOG(LOG_ERR, "Http flv epoll_wait failed, err = %d\n", errno);
+			break;
+		}
+		int i;
+		for (i = 0; i < n; i++)
+		{
+			if (events[i].data.ptr == pserver->pipefd)
+			{
+				int code = 0;
+				while (read(pserver->pipefd[0], &code, sizeof(int)) > 0)
+					;
+				http_flv_deliver(pserver);
+				continue;
+			}
+			if (events[i].data.ptr == pserver)
+			{
+				http_flv_accept(pserver);
+				continue;
+			}
+			struct http_flv_client_t* client = (struct http_flv_client_t*)events[i].data.ptr;
+			if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+			{
+				http_flv_client_close(pserver, client);
+				continue;
+			}
+			if ((events[i].events & EPOLLIN) && http_flv_client_read(pserver, client) != 0)
+			{
+				http_flv_client_close(pserver, client);
+				continue;
+			}
+			if ((events[i].events & EPOLLOUT) && client->channel != NULL)
+			{
+				janus_mutex_lock(&client->channel->mutex);
+				client->writable = 1;
+				int res = http_flv_client_flush(client);
+				janus_mutex_unlock(&client->channel->mutex);
+				if (res != 0)
+					http_flv_client_close(pserver, client);
+			}
+		}
+		/* Get rid of connections that never told us what they wanted */
+		int64_t now = janus_get_monotonic_time();
+		if (now - last_check >= G_USEC_PER_SEC)
+		{
+			last_check = now;
+			GList* l = pserver->clients;
+			while (l)
+			{
+				struct http_flv_client_t* client = (struct http_flv_client_t*)l->data;
+				l = l->next;
+				if (client->channel == NULL && now - client->connected > (int64_t)HTTP_FLV_REQUEST_TIMEOUT * 1000)
+				{
+					JANUS_LOG(LOG_WARN, "Http flv %s timed out\n", client->addr);
+					http_flv_client_close(pserver, client);
+				}
+			}
+		}
+	}
+	while (pserver->clients != NULL)
+		http_flv_client_close(pserver, (struct http_flv_client_t*)pserver->clients->data);
+	JANUS_LOG(LOG_INFO, "Http flv thread leaving\n");
+	return NULL;
+}
+
+struct http_flv_server_t* http_flv_server_init(const char* ip, int port, int max_clients, int ring_size)
+{
+	struct http_flv_server_t* pserver = NULL;
+	int flag = 0;
+	do
+	{
+		pserver = (struct http_flv_server_t*)calloc(1, sizeof(struct http_flv_server_t));
+		if (pserver == NULL)
+		{
+			JANUS_LOG(LOG_ERR, "Http flv calloc http_flv_server_t failed, err = %d\n", errno);
+			break;
+		}
+		pserver->listen_fd = socket_invalid;
+		pserver->epoll_fd = -1;
+		pserver->pipefd[0] = -1;
+		pserver->pipefd[1] = -1;
+		pserver->max_clients = max_clients > 0 ? max_clients : HTTP_FLV_MAX_CLIENTS;
+		pserver->ring_size = ring_size > 0 ? ring_size : HTTP_FLV_RING_SIZE;
+		pserver->channels = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, NULL);
+		pserver->dirty = g_queue_new();
+		janus_mutex_init(&pserver->mutex);
+
+		socket_init();
+		pserver->listen_fd = socket_tcp_listen(ip, (u_short)(port > 0 ? port : HTTP_FLV_PORT), SOMAXCONN);
+		if (socket_invalid == pserver->listen_fd)
+		{
+			JANUS_LOG(LOG_ERR, "Http flv can't listen on %s:%d, err = %d\n", ip ? ip : "*", port, errno);
+			break;
+		}
+		socket_setnonblock(pserver->listen_fd, 1);
+		pserver->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (pserver->epoll_fd < 0 || pipe(pserver->pipefd) != 0)
+		{
+			JANUS_LOG(LOG_ERR, "Http flv epoll/pipe creation failed, err = %d\n", errno);
+			break;
+		}
+		/* Producers never block on the wakeup pipe, and we drain it all at once */
+		socket_setnonblock(pserver->pipefd[0], 1);
+		socket_setnonblock(pserver->pipefd[1], 1);
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = pserver;
+		if (epoll_ctl(pserver->epoll_fd, EPOLL_CTL_ADD, pserver->listen_fd, &ev) != 0)
+			break;
+		ev.data.ptr = pserver->pipefd;
+		if (epoll_ctl(pserver->epoll_fd, EPOLL_CTL_ADD, pserver->pipefd[0], &ev) != 0)
+			break;
+
+		GError* error = NULL;
+		pserver->thread = g_thread_try_new("http flv", http_flv_thread, pserver, &error);
+		if (error != NULL)
+		{
+			JANUS_LOG(LOG_ERR, "Http flv got error %d (%s) trying to launch the thread\n", error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			pserver->thread = NULL;
+			break;
+		}
+		flag = 1;
+		JANUS_LOG(LOG_INFO, "Http flv listening on %s:%d (%d tags per channel)\n", ip ? ip : "*", port > 0 ? port : HTTP_FLV_PORT, pserver->ring_size);
+	} while (0);
+
+	if (!flag)
+	{
+		http_flv_server_destory(pserver);
+		pserver = NULL;
+	}
+	return pserver;
+}
+
+void http_flv_server_destory(struct http_flv_server_t* pserver)
+{
+	if (pserver == NULL)
+		return;
+	if (pserver->thread != NULL)
+	{
+		g_atomic_int_set(&pserver->stopping, 1);
+		http_flv_wakeup(pserver);
+		g_thread_join(pserver->thread);
+		pserver->thread = NULL;
+	}
+	if (pserver->channels != NULL)
+	{
+		/* Channels still around belong to their owners: just make sure they don't come looking for us.
+		 * They only use the server with their mutex held, so once we cleared it they're done with us */
+		janus_mutex_lock(&pserver->mutex);
+		GList* channels = g_hash_table_get_values(pserver->channels);
+		GList* l;
+		for (l = channels; l != NULL; l = l->next)
+			janus_refcount_increase(&((struct http_flv_channel_t*)l->data)->ref);
+		janus_mutex_unlock(&pserver->mutex);
+		for (l = channels; l != NULL; l = l->next)
+		{
+			struct http_flv_channel_t* channel = (struct http_flv_channel_t*)l->data;
+			janus_mutex_lock(&channel->mutex);
+			channel->server = NULL;
+			janus_mutex_unlock(&channel->mutex);
+			janus_refcount_decrease(&channel->ref);
+		}
+		g_list_free(channels);
+		g_hash_table_destroy(pserver->channels);
+	}
+	if (pserver->dirty != NULL)
+	{
+		struct http_flv_channel_t* channel = NULL;
+		while ((channel = g_queue_pop_head(pserver->dirty)) != NULL)
+			janus_refcount_decrease(&channel->ref);
+		g_queue_free(pserver->dirty);
+	}
+	if (pserver->epoll_fd >= 0)
+		close(pserver->epoll_fd);
+	if (pserver->pipefd[0] >= 0)
+		close(pserver->pipefd[0]);
+	if (pserver->pipefd[1] >= 0)
+		close(pserver->pipefd[1]);
+	if (socket_invalid != pserver->listen_fd)
+		socket_close(pserver->listen_fd);
+	free(pserver);
+	JANUS_LOG(LOG_INFO, "Http flv server destroy\n");
+}
+
+struct http_flv_channel_t* http_flv_channel_create(struct http_flv_server_t* pserver, const char* name)
+{
+	if (pserver == NULL || name == NULL)
+		return NULL;
+	struct http_flv_channel_t* channel = (struct http_flv_channel_t*)calloc(1, sizeof(struct http_flv_channel_t));
+	if (channel == NULL)
+	{
+		JANUS_LOG(LOG_ERR, "Http flv calloc http_flv_channel_t failed, err = %d\n", errno);
+		return NULL;
+	}
+	channel->ring = (struct http_flv_tag_t**)calloc(pserver->ring_size, sizeof(struct http_flv_tag_t*));
+	if (channel->ring == NULL)
+	{
+		JANUS_LOG(LOG_ERR, "Http flv calloc ring failed, err = %d\n", errno);
+		free(channel);
+		return NULL;
+	}
+	channel->ring_size = pserver->ring_size;
+	channel->name = g_strdup(name);
+	channel->server = pserver;
+	janus_mutex_init(&channel->mutex);
+	janus_refcount_init(&channel->ref, http_flv_channel_free);
+
+	janus_mutex_lock(&pserver->mutex);
+	if (g_hash_table_lookup(pserver->channels, channel->name) != NULL)
+	{
+		janus_mutex_unlock(&pserver->mutex);
+		JANUS_LOG(LOG_ERR, "Http flv channel %s exists already\n", name);
+		janus_refcount_decrease(&channel->ref);
+		return NULL;
+	}
+	g_hash_table_insert(pserver->channels, channel->name, channel);
+	janus_mutex_unlock(&pserver->mutex);
+	JANUS_LOG(LOG_INFO, "Http flv channel %s create success\n", name);
+	return channel;
+}
+
+int http_flv_channel_input(struct http_flv_channel_t* channel, int type, const void* data, size_t bytes, uint32_t timestamp)
+{
+	if (channel == NULL || data == NULL || bytes < 2)
+		return -1;
+	const unsigned char* packet = (const unsigned char*)data;
+	//enhanced RTMP carries the packet type in the low nibble of the first byte, followed by the FourCC
+	int exheader = FLV_TYPE_AUDIO == type ? (packet[0] & 0xF0) == FLV_AUDIO_EX_HEADER : (packet[0] & FLV_VIDEO_EX_HEADER) != 0;
+	int sequence = 0, keyframe = 0;
+	if (FLV_TYPE_AUDIO == type)
+		sequence = exheader ? (packet[0] & 0x0F) == FLV_PACKET_SEQUENCE_START : ((packet[0] & 0xF0) == FLV_AUDIO_AAC && 0 == packet[1]);
+	else if (FLV_TYPE_VIDEO == type)
+	{
+		sequence = exheader ? (packet[0] & 0x0F) == FLV_PACKET_SEQUENCE_START : 0 == packet[1];
+		keyframe = !sequence && ((packet[0] >> 4) & 0x07) == 1;
+	}
+	struct http_flv_tag_t* tag = http_flv_tag_create(type, data, bytes, timestamp);
+	if (tag == NULL)
+		return -1;
+
+	janus_mutex_lock(&channel->mutex);
+	if (FLV_TYPE_SCRIPT == type || sequence)
+	{
+		/* New viewers need these before anything else */
+		struct http_flv_tag_t** header = FLV_TYPE_SCRIPT == type ? &channel->script : (FLV_TYPE_VIDEO == type ? &channel->video_header : &channel->audio_header);
+		http_flv_tag_unref(*header);
+		http_flv_tag_ref(tag);
+		*header = tag;
+	}
+	if (FLV_TYPE_VIDEO == type)
+		channel->has_video = 1;
+	/* Without video, any audio frame is a good place to start from */
+	tag->keyframe = FLV_TYPE_VIDEO == type ? keyframe : (FLV_TYPE_AUDIO == type && !sequence && !channel->has_video);
+	int slot = (int)(channel->head % channel->ring_size);
+	http_flv_tag_unref(channel->ring[slot]);
+	channel->ring[slot] = tag;
+	if (tag->keyframe)
+	{
+		channel->gop = channel->head;
+		channel->has_gop = 1;
+	}
+	channel->head++;
+	if (channel->has_gop && channel->head - channel->gop > (uint64_t)channel->ring_size)
+		channel->has_gop = 0;	/* The GOP is larger than the ring */
+	channel->tags++;
+	channel->bytes += bytes;
+	/* The server may be going away: we use it with the mutex held, so that it waits for us */
+	if (!channel->queued && channel->clients != NULL && channel->server != NULL)
+	{
+		channel->queued = 1;
+		http_flv_channel_schedule(channel->server, channel);
+	}
+	janus_mutex_unlock(&channel->mutex);
+	return 0;
+}
+
+void http_flv_channel_get_stats(struct http_flv_channel_t* channel, uint32_t* viewers, uint64_t* tags, uint64_t* bytes, uint32_t* resyncs)
+{
+	if (channel == NULL)
+		return;
+	janus_mutex_lock(&channel->mutex);
+	*viewers = channel->viewers;
+	*tags = channel->tags;
+	*bytes = channel->bytes;
+	*resyncs = channel->resyncs;
+	janus_mutex_unlock(&channel->mutex);
+}
+
+void http_flv_channel_destory(struct http_flv_channel_t* channel)
+{
+	if (channel == NULL)
+		return;
+	g_atomic_int_set(&channel->closed, 1);
+	janus_mutex_lock(&channel->mutex);
+	struct http_flv_server_t* pserver = channel->server;
+	if (pserver != NULL)
+	{
+		/* The server thread will disconnect the viewers: we queue the channel in the same
+		 * critical section we remove it in, as a server being destroyed only waits for the
+		 * channels it still knows about */
+		janus_mutex_lock(&pserver->mutex);
+		g_hash_table_remove(pserver->channels, channel->name);
+		janus_refcount_increase(&channel->ref);
+		g_queue_push_tail(pserver->dirty, channel);
+		if (g_queue_get_length(pserver->dirty) == 1)
+			http_flv_wakeup(pserver);
+		janus_mutex_unlock(&pserver->mutex);
+		channel->server = NULL;
+	}
+	janus_mutex_unlock(&channel->mutex);
+	janus_refcount_decrease(&channel->ref);
+}
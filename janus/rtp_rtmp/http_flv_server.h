@@ -0,0 +1,108 @@
+#ifndef __HTTP_FLV_SERVER_H__
+#define __HTTP_FLV_SERVER_H__
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <glib.h>
+#include "sockutil.h"
+#include "flv-proto.h"
+#include "mutex.h"
+#include "refcount.h"
+#include "debug.h"
+
+//HTTP-FLV (chunked) egress: viewers GET http://host:port/<app>/<name>.flv and get the FLV tags of the channel
+//called <name>, all the connections being served by a single epoll thread
+
+#define HTTP_FLV_PORT				8935
+#define HTTP_FLV_MAX_CLIENTS		256
+#define HTTP_FLV_RING_SIZE			1024	//tags per channel, which also bounds the GOP cache
+#define HTTP_FLV_REQUEST_TIMEOUT	5000	//ms to get the whole request
+#define HTTP_FLV_MAX_IOV			64		//tags per writev
+
+//an HTTP chunk wrapping a whole FLV tag (header, body, previous tag size): built once, written to all the viewers
+struct http_flv_tag_t
+{
+	volatile gint       ref;
+	int                 keyframe;	//whether a new viewer can start from here
+	size_t              len;
+	unsigned char       data[0];
+};
+
+struct http_flv_channel_t
+{
+	char*               name;
+	struct http_flv_server_t* server;
+	struct http_flv_tag_t** ring;
+	int                 ring_size;
+	uint64_t            head;		//sequence number of the next tag
+	uint64_t            gop;		//sequence number of the latest keyframe, if still in the ring
+	int                 has_gop;
+	int                 has_video;
+	//the latest metadata and sequence headers, sent to new viewers before anything else
+	struct http_flv_tag_t* script;
+	struct http_flv_tag_t* video_header;
+	struct http_flv_tag_t* audio_header;
+	GList*              clients;
+	int                 queued;		//whether the server thread has been told about new tags
+	volatile gint       closed;
+	janus_mutex         mutex;
+	janus_refcount      ref;
+
+	//statistics
+	uint64_t            tags;
+	uint64_t            bytes;
+	uint32_t            viewers;
+	uint32_t            resyncs;	//times a slow viewer was moved to the latest keyframe
+};
+
+struct http_flv_client_t
+{
+	socket_t            fd;
+	char                addr[SOCKET_ADDRLEN];
+	char                request[2048];
+	size_t              request_len;
+	int64_t             connected;	//monotonic, us
+	struct http_flv_channel_t* channel;
+	uint64_t            cursor;		//next tag to send
+	int                 waiting_keyframe;
+	//a chunk we only managed to send a part of (or the response headers), with how much went out already
+	struct http_flv_tag_t* partial;
+	size_t              offset;
+	int                 writable;	//whether we're not waiting for EPOLLOUT
+};
+
+struct http_flv_server_t
+{
+	socket_t            listen_fd;
+	int                 epoll_fd;
+	int                 pipefd[2];	//wakes the thread up when there are new tags (or when it's time to wrap up)
+	int                 max_clients;
+	int                 ring_size;
+	GList*              clients;
+	GHashTable*         channels;	//name -> http_flv_channel_t
+	GQueue*             dirty;		//channels with tags to deliver
+	janus_mutex         mutex;
+	GThread*            thread;
+	volatile gint       stopping;
+	unsigned char       buffer[4096];
+};
+
+//ip may be NULL to listen on all the interfaces
+struct http_flv_server_t* http_flv_server_init(const char* ip, int port, int max_clients, int ring_size);
+
+void http_flv_server_destory(struct http_flv_server_t* pserver);
+
+//fails if a channel with the same name exists already
+struct http_flv_channel_t* http_flv_channel_create(struct http_flv_server_t* pserver, const char* name);
+
+//same arguments the flv_muxer_cb gets: can be invoked from any thread, but not concurrently for the same channel
+int http_flv_channel_input(struct http_flv_channel_t* channel, int type, const void* data, size_t bytes, uint32_t timestamp);
+
+//fills the statistics in a consistent way
+void http_flv_channel_get_stats(struct http_flv_channel_t* channel, uint32_t* viewers, uint64_t* tags, uint64_t* bytes, uint32_t* resyncs);
+
+//disconnects the viewers and releases the channel
+void http_flv_channel_destory(struct http_flv_channel_t* channel);
+
+#endif //__HTTP_FLV_SERVER_H__
@@ -45,6 +45,8 @@ uint8_t* AMFWriteDate(uint8_t* ptr, const uint8_t* end, double milliseconds, int
 uint8_t* AMFWriteNamedString(uint8_t* ptr, const uint8_t* end, const char* name, size_t length, const char* value, size_t length2);
 uint8_t* AMFWriteNamedDouble(uint8_t* ptr, const uint8_t* end, const char* name, size_t length, double value);
 uint8_t* AMFWriteNamedBoolean(uint8_t* ptr, const uint8_t* end, const char* name, size_t length, uint8_t value);
+/// the caller writes the count values afterwards
+uint8_t* AMFWriteNamedStrictArray(uint8_t* ptr, const uint8_t* end, const char* name, size_t length, uint32_t count);
 
 const uint8_t* AMFReadNull(const uint8_t* ptr, const uint8_t* end);
 const uint8_t* AMFReadUndefined(const uint8_t* ptr, const uint8_t* end);
@@ -23,9 +23,16 @@ void flv_muxer_destroy(flv_muxer_t* muxer);
 /// re-create AAC/AVC sequence header
 int flv_muxer_reset(flv_muxer_t* muxer);
 
+/// @param[in] enhanced 1-write HEVC with the enhanced RTMP ExVideoTagHeader (FourCC hvc1), 0-legacy CodecID 12
+int flv_muxer_set_enhanced(flv_muxer_t* muxer, int enhanced);
+
 /// @param[in] data AAC ADTS stream, 0xFFF15C40011FFC...
 int flv_muxer_aac(flv_muxer_t* muxer, const void* data, size_t bytes, uint32_t pts, uint32_t dts);
 
+/// Enhanced RTMP only (ExAudioTagHeader, FourCC Opus)
+/// @param[in] data OpusHead(RFC 7845) or Opus packet(RFC 6716), a default stereo 48kHz OpusHead is sent if the first packet isn't one
+int flv_muxer_opus(flv_muxer_t* muxer, const void* data, size_t bytes, uint32_t pts, uint32_t dts);
+
 /// @param[in] data mp3 stream
 int flv_muxer_mp3(flv_muxer_t* muxer, const void* data, size_t bytes, uint32_t pts, uint32_t dts);
 
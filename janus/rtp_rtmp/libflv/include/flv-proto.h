@@ -22,4 +22,15 @@
 #define FLV_VIDEO_AVCC		0x200 // AVCDecoderConfigurationRecord(ISO-14496-15)
 #define FLV_VIDEO_HVCC		0x201 // HEVCDecoderConfigurationRecord(ISO-14496-15)
 
+// Enhanced RTMP: https://github.com/veovera/enhanced-rtmp
+#define FLV_AUDIO_EX_HEADER	(9 << 4) // SoundFormat 9: AudioPacketType + FourCC follow
+#define FLV_VIDEO_EX_HEADER	0x80 // IsExHeader: VideoPacketType + FourCC follow
+#define FLV_PACKET_SEQUENCE_START	0
+#define FLV_PACKET_CODED_FRAMES		1
+#define FLV_PACKET_CODED_FRAMES_X	3 // no CompositionTime, it's 0
+
+#define FLV_FOURCC(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+#define FLV_FOURCC_HEVC		FLV_FOURCC('h', 'v', 'c', '1')
+#define FLV_FOURCC_OPUS		FLV_FOURCC('O', 'p', 'u', 's')
+
 #endif /* !_flv_proto_h_ */
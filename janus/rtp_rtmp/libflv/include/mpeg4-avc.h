@@ -51,6 +51,10 @@ size_t mpeg4_annexbtomp4(struct mpeg4_avc_t* avc, const void* data, size_t bytes
 
 size_t mpeg4_mp4toannexb(const struct mpeg4_avc_t* avc, const void* data, size_t bytes, void* out, size_t size);
 
+/// Find the first H.264/H.265 start code (0x000001) followed by at least one byte
+/// @return pointer to the byte after the start code, NULL if there's none
+const uint8_t* mpeg4_h264_startcode(const uint8_t* data, size_t bytes);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -182,6 +182,16 @@ uint8_t* AMFWriteNamedString(uint8_t* ptr, const uint8_t* end, const char* name,
 	return ptr ? AMFWriteString(ptr, end, value, length2) : NULL;
 }
 
+uint8_t* AMFWriteNamedStrictArray(uint8_t* ptr, const uint8_t* end, const char* name, size_t length, uint32_t count)
+{
+	if (!ptr || ptr + length + 2 + 1 + 4 > end)
+		return NULL;
+
+	ptr = AMFWriteString16(ptr, end, name, length);
+	*ptr++ = AMF_STRICT_ARRAY;
+	return AMFWriteInt32(ptr, end, count); // U32 array-count
+}
+
 static const uint8_t* AMFReadInt16(const uint8_t* ptr, const uint8_t* end, uint32_t* value)
 {
 	if (!ptr || ptr + 2 > end)
@@ -29,6 +29,7 @@ struct flv_muxer_t
 		struct mpeg4_hevc_t hevc;
 	} v;
 	int keyframe;
+	int enhanced; // enhanced RTMP ExVideoTagHeader for HEVC
 
 	uint8_t* ptr;
 	size_t bytes;
@@ -68,6 +69,12 @@ int flv_muxer_reset(struct flv_muxer_t* flv)
 	return 0;
 }
 
+int flv_muxer_set_enhanced(struct flv_muxer_t* flv, int enhanced)
+{
+	flv->enhanced = enhanced;
+	return 0;
+}
+
 static int flv_muxer_alloc(struct flv_muxer_t* flv, size_t bytes)
 {
 	void* p;
@@ -80,6 +87,72 @@ static int flv_muxer_alloc(struct flv_muxer_t* flv, size_t bytes)
 	return 0;
 }
 
+static void flv_muxer_write_fourcc(uint8_t* ptr, uint32_t fourcc)
+{
+	ptr[0] = (uint8_t)((fourcc >> 24) & 0xFF);
+	ptr[1] = (uint8_t)((fourcc >> 16) & 0xFF);
+	ptr[2] = (uint8_t)((fourcc >> 8) & 0xFF);
+	ptr[3] = (uint8_t)(fourcc & 0xFF);
+}
+
+// RFC 7845 5.1, what WebRTC negotiates: opus/48000/2, no pre-skip, channel mapping family 0
+static int flv_muxer_opus_head(uint8_t* ptr)
+{
+	memcpy(ptr, "OpusHead", 8);
+	ptr[8] = 1; // version
+	ptr[9] = 2; // channel count
+	ptr[10] = 0; // pre-skip
+	ptr[11] = 0;
+	ptr[12] = (uint8_t)(48000 & 0xFF); // input sample rate, little endian
+	ptr[13] = (uint8_t)((48000 >> 8) & 0xFF);
+	ptr[14] = (uint8_t)((48000 >> 16) & 0xFF);
+	ptr[15] = (uint8_t)((48000 >> 24) & 0xFF);
+	ptr[16] = 0; // output gain
+	ptr[17] = 0;
+	ptr[18] = 0; // channel mapping family
+	return 19;
+}
+
+int flv_muxer_opus(struct flv_muxer_t* flv, const void* data, size_t bytes, uint32_t pts, uint32_t dts)
+{
+	int r, m;
+	int head;
+	(void)pts;
+
+	if (flv->capacity < bytes + 5/*ExAudioTagHeader*/ + 19/*OpusHead*/)
+	{
+		if (0 != flv_muxer_alloc(flv, bytes + 5 + 19))
+			return ENOMEM;
+	}
+
+	head = bytes >= 19 && 0 == memcmp(data, "OpusHead", 8);
+	if (0 == flv->aac_sequence_header)
+	{
+		flv->aac_sequence_header = 1; // once only
+
+		flv->ptr[0] = FLV_AUDIO_EX_HEADER | FLV_PACKET_SEQUENCE_START;
+		flv_muxer_write_fourcc(flv->ptr + 1, FLV_FOURCC_OPUS);
+		if (head)
+		{
+			memcpy(flv->ptr + 5, data, bytes);
+			return flv->handler(flv->param, FLV_TYPE_AUDIO, flv->ptr, bytes + 5, dts);
+		}
+
+		m = flv_muxer_opus_head(flv->ptr + 5);
+		r = flv->handler(flv->param, FLV_TYPE_AUDIO, flv->ptr, m + 5, dts);
+		if (0 != r) return r;
+	}
+	else if (head)
+	{
+		return 0; // sequence header sent already
+	}
+
+	flv->ptr[0] = FLV_AUDIO_EX_HEADER | FLV_PACKET_CODED_FRAMES;
+	flv_muxer_write_fourcc(flv->ptr + 1, FLV_FOURCC_OPUS);
+	memcpy(flv->ptr + 5, data, bytes); // one Opus packet per tag
+	return flv->handler(flv->param, FLV_TYPE_AUDIO, flv->ptr, bytes + 5, dts);
+}
+
 int flv_muxer_mp3(struct flv_muxer_t* flv, const void* data, size_t bytes, uint32_t pts, uint32_t dts)
 {
 	uint8_t ch, hz;
@@ -259,11 +332,20 @@ static int flv_muxer_h265(struct flv_muxer_t* flv, uint32_t pts, uint32_t dts)
 		if (flv->v.hevc.numOfArrays < 3) // vps + sps + pps
 			return 0;
 
-		flv->ptr[flv->bytes + 0] = (1 << 4) /*FrameType*/ | FLV_VIDEO_H265 /*CodecID*/;
-		flv->ptr[flv->bytes + 1] = 0; // HEVC sequence header
-		flv->ptr[flv->bytes + 2] = 0; // CompositionTime 0
-		flv->ptr[flv->bytes + 3] = 0;
-		flv->ptr[flv->bytes + 4] = 0;
+		if (flv->enhanced)
+		{
+			// ExVideoTagHeader is as long as the legacy one: IsExHeader|FrameType|PacketType + FourCC
+			flv->ptr[flv->bytes + 0] = FLV_VIDEO_EX_HEADER | (1 << 4) /*FrameType*/ | FLV_PACKET_SEQUENCE_START;
+			flv_muxer_write_fourcc(flv->ptr + flv->bytes + 1, FLV_FOURCC_HEVC);
+		}
+		else
+		{
+			flv->ptr[flv->bytes + 0] = (1 << 4) /*FrameType*/ | FLV_VIDEO_H265 /*CodecID*/;
+			flv->ptr[flv->bytes + 1] = 0; // HEVC sequence header
+			flv->ptr[flv->bytes + 2] = 0; // CompositionTime 0
+			flv->ptr[flv->bytes + 3] = 0;
+			flv->ptr[flv->bytes + 4] = 0;
+		}
 		m = mpeg4_hevc_decoder_configuration_record_save(&flv->v.hevc, flv->ptr + flv->bytes + 5, flv->capacity - flv->bytes - 5);
 		if (m <= 0)
 			return -1; // invalid data
@@ -278,6 +360,30 @@ static int flv_muxer_h265(struct flv_muxer_t* flv, uint32_t pts, uint32_t dts)
 	if (flv->bytes > 5)
 	{
 		compositionTime = pts - dts;
+		if (flv->enhanced)
+		{
+			if (0 == compositionTime)
+			{
+				flv->ptr[0] = FLV_VIDEO_EX_HEADER | ((flv->keyframe ? 1 : 2) << 4) /*FrameType*/ | FLV_PACKET_CODED_FRAMES_X;
+				flv_muxer_write_fourcc(flv->ptr + 1, FLV_FOURCC_HEVC);
+				return flv->handler(flv->param, FLV_TYPE_VIDEO, flv->ptr, flv->bytes, dts);
+			}
+
+			// CodedFrames: the CompositionTime follows the FourCC, make room for it
+			if (flv->capacity < flv->bytes + 3)
+			{
+				if (0 != flv_muxer_alloc(flv, flv->bytes + 3))
+					return ENOMEM;
+			}
+			memmove(flv->ptr + 8, flv->ptr + 5, flv->bytes - 5);
+			flv->ptr[0] = FLV_VIDEO_EX_HEADER | ((flv->keyframe ? 1 : 2) << 4) /*FrameType*/ | FLV_PACKET_CODED_FRAMES;
+			flv_muxer_write_fourcc(flv->ptr + 1, FLV_FOURCC_HEVC);
+			flv->ptr[5] = (compositionTime >> 16) & 0xFF;
+			flv->ptr[6] = (compositionTime >> 8) & 0xFF;
+			flv->ptr[7] = compositionTime & 0xFF;
+			return flv->handler(flv->param, FLV_TYPE_VIDEO, flv->ptr, flv->bytes + 3, dts);
+		}
+
 		flv->ptr[0] = ((flv->keyframe ? 1 : 2) << 4) /*FrameType*/ | FLV_VIDEO_H265 /*CodecID*/;
 		flv->ptr[1] = 1; // HEVC NALU
 		flv->ptr[2] = (compositionTime >> 16) & 0xFF;
@@ -1,4 +1,5 @@
 #include "mpeg4-hevc.h"
+#include "mpeg4-avc.h"
 #include <string.h>
 #include <assert.h>
 
@@ -20,18 +21,6 @@ struct hevc_handle_t
 
 typedef void(*hevc_nalu_handler)(void* param, const uint8_t* nalu, size_t bytes);
 
-static const uint8_t* hevc_startcode(const uint8_t *data, size_t bytes)
-{
-	size_t i;
-	for (i = 2; i + 1 < bytes; i++)
-	{
-		if (0x01 == data[i] && 0x00 == data[i - 1] && 0x00 == data[i - 2])
-			return data + i + 1;
-	}
-
-	return NULL;
-}
-
 ///@param[in] hevc H.265 byte stream format data(A set of NAL units)
 static void hevc_stream(const uint8_t* hevc, size_t bytes, hevc_nalu_handler handler, void* param)
 {
@@ -39,11 +28,11 @@ static void hevc_stream(const uint8_t* hevc, size_t bytes, hevc_nalu_handler han
 	const uint8_t* p, *next, *end;
 
 	end = hevc + bytes;
-	p = hevc_startcode(hevc, bytes);
+	p = mpeg4_h264_startcode(hevc, bytes);
 
 	while (p)
 	{
-		next = hevc_startcode(p, end - p);
+		next = mpeg4_h264_startcode(p, end - p);
 		if (next)
 		{
 			n = next - p - 3;
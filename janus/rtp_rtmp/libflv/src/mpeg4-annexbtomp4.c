@@ -27,18 +27,6 @@ struct mpeg4_handle_t
 
 typedef void(*h264_nalu_handler)(void* param, const void* nalu, size_t bytes);
 
-static const uint8_t* h264_startcode(const uint8_t *data, size_t bytes)
-{
-	size_t i;
-	for (i = 2; i + 1 < bytes; i++)
-	{
-		if (0x01 == data[i] && 0x00 == data[i - 1] && 0x00 == data[i - 2])
-			return data + i + 1;
-	}
-
-	return NULL;
-}
-
 ///@param[in] h264 H.264 byte stream format data(A set of NAL units)
 static void h264_stream(const void* h264, size_t bytes, h264_nalu_handler handler, void* param)
 {
@@ -46,11 +34,11 @@ static void h264_stream(const void* h264, size_t bytes, h264_nalu_handler handle
 	const unsigned char* p, *next, *end;
 
 	end = (const unsigned char*)h264 + bytes;
-	p = h264_startcode((const unsigned char*)h264, bytes);
+	p = mpeg4_h264_startcode((const unsigned char*)h264, bytes);
 
 	while (p)
 	{
-		next = h264_startcode(p, end - p);
+		next = mpeg4_h264_startcode(p, end - p);
 		if (next)
 		{
 			n = next - p - 3;
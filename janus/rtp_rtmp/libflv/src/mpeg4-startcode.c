@@ -0,0 +1,114 @@
+// H.264/H.265 byte stream (Annex B) start code scanner, shared by the annexb to mp4 converters
+// and by the RTP H.264/H.265 packers
+//
+// Most of the bytes in a coded slice are not zero, and keyframes are hundreds of KB, so instead of
+// checking each byte we compare 16 (SSE2) or 32 (AVX2) positions at a time, using the same block
+// loaded again one and two bytes back for the two leading zeros. AVX2 is used when the CPU has it,
+// unless the MPEG4_STARTCODE_SIMD environment variable says otherwise ("none" or "sse2"). Without
+// SIMD, and for the last bytes, we still skip ahead: when a byte is not 0x00 and doesn't end a start
+// code, neither it nor the next two bytes can
+
+#include "mpeg4-avc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define MPEG4_STARTCODE_X86 1
+#include <immintrin.h>
+#endif
+
+static const uint8_t* mpeg4_startcode_c(const uint8_t* data, size_t i, size_t bytes)
+{
+	while (i + 1 < bytes)
+	{
+		if (data[i] > 0x01)
+			i += 3;
+		else if (0x00 == data[i])
+			i += data[i - 1] ? 2 : 1;
+		else if (data[i - 1] || data[i - 2])
+			i += 3;
+		else
+			return data + i + 1;
+	}
+
+	return NULL;
+}
+
+#if defined(MPEG4_STARTCODE_X86)
+typedef const uint8_t* (*mpeg4_startcode_fn)(const uint8_t* data, size_t bytes);
+
+// picked on first use, threads doing it at the same time pick the same one
+static mpeg4_startcode_fn s_startcode;
+
+static const uint8_t* mpeg4_startcode_sse2(const uint8_t* data, size_t bytes)
+{
+	size_t i;
+	unsigned int mask;
+	__m128i z0, z1, one;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi8(1);
+
+	// a start code needs one more byte after the 0x01, so the whole block must be before the last byte
+	for (i = 2; i + 16 < bytes; i += 16)
+	{
+		z0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i - 2)), zero);
+		z1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i - 1)), zero);
+		one = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), ones);
+		mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(z0, z1), one));
+		if (mask)
+			return data + i + __builtin_ctz(mask) + 1;
+	}
+
+	return mpeg4_startcode_c(data, i, bytes);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t* mpeg4_startcode_avx2(const uint8_t* data, size_t bytes)
+{
+	size_t i;
+	unsigned int mask;
+	__m256i z0, z1, one;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi8(1);
+
+	for (i = 2; i + 32 < bytes; i += 32)
+	{
+		z0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i - 2)), zero);
+		z1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i - 1)), zero);
+		one = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), ones);
+		mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(z0, z1), one));
+		if (mask)
+			return data + i + __builtin_ctz(mask) + 1;
+	}
+
+	return mpeg4_startcode_c(data, i, bytes);
+}
+
+static mpeg4_startcode_fn mpeg4_startcode_pick(void)
+{
+	const char* env;
+	env = getenv("MPEG4_STARTCODE_SIMD");
+	if (env && 0 == strcmp(env, "none"))
+		return NULL;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && !(env && 0 == strcmp(env, "sse2")))
+		return mpeg4_startcode_avx2;
+	return mpeg4_startcode_sse2;
+}
+#endif
+
+const uint8_t* mpeg4_h264_startcode(const uint8_t* data, size_t bytes)
+{
+#if defined(MPEG4_STARTCODE_X86)
+	static int s_picked;
+	if (!s_picked)
+	{
+		s_startcode = mpeg4_startcode_pick();
+		s_picked = 1;
+	}
+	if (s_startcode)
+		return s_startcode(data, bytes);
+#endif
+	return mpeg4_startcode_c(data, 2, bytes);
+}
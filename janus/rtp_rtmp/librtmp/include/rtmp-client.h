@@ -38,6 +38,13 @@ void rtmp_client_destroy(rtmp_client_t* rtmp);
 ///@return 0-ok, other-error
 int rtmp_client_input(rtmp_client_t* rtmp, const void* data, size_t bytes);
 
+///@param[in] fourcc enhanced RTMP codecs advertised in connect (fourCcList), e.g. "hvc1,Opus", must be called before rtmp_client_start
+///@return 0-ok, other-error
+int rtmp_client_set_fourcc(rtmp_client_t* rtmp, const char* fourcc);
+
+///@return fourCcList the server sent in the connect response (enhanced RTMP), e.g. "hvc1,Opus", NULL if none (legacy server)
+const char* rtmp_client_get_fourcc(rtmp_client_t* rtmp);
+
 ///@param[in] publish, 0-Publish(push stream to server), 1-LIVE/VOD(pull from server), 2-LIVE only, 3-VOD only
 ///@return 0-ok, other-error
 int rtmp_client_start(rtmp_client_t* rtmp, int publish);
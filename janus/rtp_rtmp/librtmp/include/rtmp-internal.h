@@ -137,7 +137,7 @@ struct rtmp_t
 		struct
 		{
 			// client side
-			int (*onconnect)(void* param);
+			int (*onconnect)(void* param, const char* fourcc); // fourcc: server fourCcList (enhanced RTMP), comma separated, NULL if not sent
 			int (*oncreate_stream)(void* param, double stream_id);
 			int (*onnotify)(void* param, enum rtmp_notify_t notify);
             int (*oneof)(void* param, uint32_t stream_id); // EOF event
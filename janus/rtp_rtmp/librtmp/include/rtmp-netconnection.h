@@ -58,6 +58,7 @@ struct rtmp_connect_t
 	double videoFunction; // double default: 1
 	double encoding;
 	char pageUrl[256]; // http://host/sample.html
+	char fourCcList[64]; // enhanced RTMP, comma separated, e.g.: hvc1,Opus (empty: not sent)
 };
 
 uint8_t* rtmp_netconnection_connect(uint8_t* out, size_t bytes, double transactionId, const struct rtmp_connect_t* connect);
@@ -15,8 +15,11 @@ struct rtmp_result_t
 	char code[64]; // NetStream.Play.Start
 	char level[8]; // warning/status/error
 	char description[256];
+	char fourCcList[64]; // enhanced RTMP, comma separated
 };
 
+#define N_FOURCC_LIST 8
+
 //static const char* s_rtmp_command_code[] = {
 //	"NetConnection.Connect.Success",
 //	"NetConnection.Connect.Closed",
@@ -51,14 +54,23 @@ struct rtmp_result_t
 // s -> c
 static int rtmp_command_onconnect_reply(struct rtmp_result_t* result, const uint8_t* data, uint32_t bytes)
 {
+	int i, n;
 	char fmsver[64] = { 0 };
 	double capabilities = 0;
-	struct amf_object_item_t prop[2];
+	char fourcc[N_FOURCC_LIST][8];
+	struct amf_object_item_t list[N_FOURCC_LIST];
+	struct amf_object_item_t prop[3];
 	struct amf_object_item_t info[3]; 
 	struct amf_object_item_t items[2];
 
+	// enhanced RTMP servers tell which codecs they accept, legacy ones don't
+	memset(fourcc, 0, sizeof(fourcc));
+	for (i = 0; i < N_FOURCC_LIST; i++)
+		AMF_OBJECT_ITEM_VALUE(list[i], AMF_STRING, "", fourcc[i], sizeof(fourcc[i]));
+
 	AMF_OBJECT_ITEM_VALUE(prop[0], AMF_STRING, "fmsVer", fmsver, sizeof(fmsver));
 	AMF_OBJECT_ITEM_VALUE(prop[1], AMF_NUMBER, "capabilities", &capabilities, sizeof(capabilities));
+	AMF_OBJECT_ITEM_VALUE(prop[2], AMF_STRICT_ARRAY, "fourCcList", list, N_FOURCC_LIST);
 
 	AMF_OBJECT_ITEM_VALUE(info[0], AMF_STRING, "code", result->code, sizeof(result->code));
 	AMF_OBJECT_ITEM_VALUE(info[1], AMF_STRING, "level", result->level, sizeof(result->level));
@@ -68,7 +80,13 @@ static int rtmp_command_onconnect_reply(struct rtmp_result_t* result, const uint
 	AMF_OBJECT_ITEM_VALUE(items[1], AMF_OBJECT, "Information", info, sizeof(info) / sizeof(info[0]));
 
 	//rtmp->onstatus();
-	return amf_read_items(data, data + bytes, items, sizeof(items) / sizeof(items[0])) ? 0 : EINVAL;
+	memset(result->fourCcList, 0, sizeof(result->fourCcList));
+	if (!amf_read_items(data, data + bytes, items, sizeof(items) / sizeof(items[0])))
+		return EINVAL;
+
+	for (i = n = 0; i < N_FOURCC_LIST && fourcc[i][0] && n + 1 < (int)sizeof(result->fourCcList); i++)
+		n += snprintf(result->fourCcList + n, sizeof(result->fourCcList) - n, "%s%s", n > 0 ? "," : "", fourcc[i]);
+	return 0;
 }
 
 // s -> c
@@ -98,7 +116,7 @@ static int rtmp_command_onresult(struct rtmp_t* rtmp, double transaction, const
 		// 2. createStream
 		// 3. FCSubscribe
 		r = rtmp_command_onconnect_reply(&result, data, bytes);
-		return 0 == r ? rtmp->u.client.onconnect(rtmp->param) : r;
+		return 0 == r ? rtmp->u.client.onconnect(rtmp->param, result.fourCcList[0] ? result.fourCcList : NULL) : r;
 
 	case RTMP_TRANSACTION_CREATE_STREAM:
 		// next: 
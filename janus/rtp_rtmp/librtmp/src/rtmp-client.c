@@ -60,6 +60,7 @@ struct rtmp_client_t
 {
 	struct rtmp_t rtmp;
 	struct rtmp_connect_t connect;
+	char fourCcList[64]; // server fourCcList in the connect response (enhanced RTMP), empty if not sent
 
 	uint32_t stream_id; // createStream/deleteStream
 	char stream_name[256]; // Play/Publishing stream name, flv:sample, mp3:sample, H.264/AAC: mp4:sample.m4v
@@ -200,12 +201,13 @@ static int rtmp_client_send_get_stream_length(struct rtmp_client_t* ctx)
 	return rtmp_client_send_control(&ctx->rtmp, ctx->payload, r, ctx->stream_id);
 }
 
-static int rtmp_client_onconnect(void* param)
+static int rtmp_client_onconnect(void* param, const char* fourcc)
 {
 	int r = 0;
 	struct rtmp_client_t* ctx;
 	ctx = (struct rtmp_client_t*)param;
 	ctx->state = RTMP_STATE_CONNECTED;
+	snprintf(ctx->fourCcList, sizeof(ctx->fourCcList), "%s", fourcc ? fourcc : "");
 	if (0 == ctx->publish)
 	{
 		// publish only
@@ -478,6 +480,19 @@ int rtmp_client_input(struct rtmp_client_t* ctx, const void* data, size_t bytes)
 	return 0; // need more data
 }
 
+int rtmp_client_set_fourcc(struct rtmp_client_t* ctx, const char* fourcc)
+{
+	if (fourcc && strlen(fourcc) >= sizeof(ctx->connect.fourCcList))
+		return -1;
+	snprintf(ctx->connect.fourCcList, sizeof(ctx->connect.fourCcList), "%s", fourcc ? fourcc : "");
+	return 0;
+}
+
+const char* rtmp_client_get_fourcc(struct rtmp_client_t* ctx)
+{
+	return ctx->fourCcList[0] ? ctx->fourCcList : NULL;
+}
+
 int rtmp_client_start(struct rtmp_client_t* ctx, int publish)
 {
 	int n;
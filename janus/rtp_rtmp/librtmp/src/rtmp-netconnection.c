@@ -23,6 +23,21 @@ uint8_t* rtmp_netconnection_connect(uint8_t* out, size_t bytes, double transacti
 	out = AMFWriteNamedDouble(out, end, "videoCodecs", 11, connect->videoCodecs);
 	out = AMFWriteNamedDouble(out, end, "videoFunction", 13, connect->videoFunction);
 	out = AMFWriteNamedDouble(out, end, "objectEncoding", 14, connect->encoding);
+	if (connect->fourCcList[0])
+	{
+		const char* p;
+		const char* next;
+		uint32_t count = 1;
+		for (p = connect->fourCcList; *p; p++)
+			count += ',' == *p ? 1 : 0;
+
+		out = AMFWriteNamedStrictArray(out, end, "fourCcList", 10, count);
+		for (p = connect->fourCcList; out && p; p = next ? next + 1 : NULL)
+		{
+			next = strchr(p, ',');
+			out = AMFWriteString(out, end, p, next ? (size_t)(next - p) : strlen(p));
+		}
+	}
 	out = AMFWriteObjectEnd(out, end);
 	return out;
 }
@@ -15,6 +15,9 @@ int rtp_queue_destroy(rtp_queue_t* queue);
 int rtp_queue_write(rtp_queue_t* queue, struct rtp_packet_t* pkt);
 struct rtp_packet_t* rtp_queue_read(rtp_queue_t* queue);
 
+/// @param[in] threshold how long (ms) to wait for a missing packet before skipping it
+void rtp_queue_set_threshold(rtp_queue_t* queue, int threshold);
+
 #if defined(__cplusplus)
 }
 #endif
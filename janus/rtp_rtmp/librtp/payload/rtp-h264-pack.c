@@ -21,6 +21,7 @@
 
 #include "rtp-packet.h"
 #include "rtp-payload-internal.h"
+#include "mpeg4-avc.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -77,12 +78,9 @@ static void rtp_h264_pack_get_info(void* pack, uint16_t* seq, uint32_t* timestam
 
 static const uint8_t* h264_nalu_find(const uint8_t* p, const uint8_t* end)
 {
-	for(p += 2; p + 1 < end; p++)
-	{
-		if (0x01 == *p && 0x00 == *(p - 1) && 0x00 == *(p - 2))
-			return p + 1;
-	}
-	return end;
+	const uint8_t* nalu;
+	nalu = mpeg4_h264_startcode(p, end - p);
+	return nalu ? nalu : end;
 }
 
 static int rtp_h264_pack_nalu(struct rtp_encode_h264_t *packer, const uint8_t* nalu, int bytes)
@@ -80,7 +80,7 @@ static int rtp_queue_reset(struct rtp_queue_t* q)
 
 	for (i = 0; i < q->size; i++)
 	{
-		pkt = q->items[q->pos + i].pkt;
+		pkt = q->items[(q->pos + i) % q->capacity].pkt;
 		q->free(q->param, pkt);
 	}
 
@@ -120,7 +120,7 @@ static int rtp_queue_find(struct rtp_queue_t* q, uint16_t seq)
 		}
 	}
 
-	return l % q->capacity; // insert position
+	return l; // insert position, in [pos, pos + size]: rtp_queue_insert wraps it
 }
 
 static int rtp_queue_insert(struct rtp_queue_t* q, int position, struct rtp_packet_t* pkt)
@@ -136,7 +136,7 @@ static int rtp_queue_insert(struct rtp_queue_t* q, int position, struct rtp_pack
 			return -E2BIG;
 
 		capacity = q->capacity + 250;
-		p = realloc(q->items, capacity);
+		p = realloc(q->items, capacity * sizeof(struct rtp_item_t));
 		if (NULL == p)
 			return -ENOMEM;
 
@@ -229,6 +229,11 @@ int rtp_queue_write(struct rtp_queue_t* q, struct rtp_packet_t* pkt)
 	}
 }
 
+void rtp_queue_set_threshold(struct rtp_queue_t* q, int threshold)
+{
+	q->threshold = threshold;
+}
+
 struct rtp_packet_t* rtp_queue_read(struct rtp_queue_t* q)
 {
 	uint32_t threshold;
@@ -0,0 +1,196 @@
+//opus-jitter-bench: checks and times the Opus jitter buffer pushstream puts in front of the decoder,
+//with 20 ms Opus packets reordered within a window, and optionally lost
+//
+//the sequence numbers start right before 65535, and the stream is long enough for the packet ring
+//(250 slots) to wrap many times: reordered packets have to be inserted across both wraps. Every
+//frame must come out exactly once, in order, with contiguous timestamps; losses must be concealed
+//(FEC or PLC) and counted, and nothing must be dropped as late. We exit with 1 if anything's off
+//
+//usage: opus-jitter-bench [-n packets] [-w reorder window] [-l loss %] [-s seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "opus_jitter_buffer.h"
+#include "log.h"
+
+int janus_log_level = LOG_WARN;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+GHashTable *counters = NULL;
+janus_mutex counters_mutex;
+
+#define BENCH_PT			111
+#define BENCH_RATE			48000
+#define BENCH_FRAME			960			//20 ms
+#define BENCH_DELAY			100			//ms, both min and max, so that the target never moves
+#define BENCH_TOC			0xF8		//CELT fullband, 20 ms, one frame
+#define BENCH_PAYLOAD		80
+#define BENCH_FIRST_SEQ		65500
+
+struct bench_check_t
+{
+	uint32_t first_timestamp;
+	uint32_t frames;			//frames played out, concealed ones included
+	uint32_t packets;			//frames played out from a packet we sent
+	uint32_t concealed;
+	uint16_t next_seq;
+	int errors;
+};
+
+static void bench_frame(void* param, const unsigned char* packet, int len, int samples, int fec, uint32_t timestamp)
+{
+	struct bench_check_t* check = (struct bench_check_t*)param;
+	uint32_t expected = check->first_timestamp + check->frames * BENCH_FRAME;
+	if (timestamp != expected || samples != BENCH_FRAME)
+	{
+		if (check->errors++ < 10)
+			fprintf(stderr, "Frame %u: timestamp %u (expected %u), %d samples\n", check->frames, timestamp, expected, samples);
+	}
+	check->frames++;
+	if (packet == NULL || fec)
+	{
+		/* A concealed frame stands for the packet we were waiting for */
+		check->concealed++;
+		check->next_seq++;
+		return;
+	}
+	/* We put the sequence number in the payload, right after the TOC */
+	uint16_t seq = len >= 3 ? (uint16_t)((packet[1] << 8) | packet[2]) : 0;
+	if (seq != check->next_seq)
+	{
+		if (check->errors++ < 10)
+			fprintf(stderr, "Frame %u: packet %u (expected %u)\n", check->frames - 1, seq, check->next_seq);
+	}
+	check->packets++;
+	check->next_seq = seq + 1;
+}
+
+static int bench_packet(unsigned char* buf, uint16_t seq, uint32_t timestamp)
+{
+	buf[0] = 0x80;
+	buf[1] = BENCH_PT;
+	buf[2] = seq >> 8;
+	buf[3] = seq & 0xFF;
+	buf[4] = timestamp >> 24;
+	buf[5] = (timestamp >> 16) & 0xFF;
+	buf[6] = (timestamp >> 8) & 0xFF;
+	buf[7] = timestamp & 0xFF;
+	memset(buf + 8, 0x5A, 4);	//SSRC
+	buf[12] = BENCH_TOC;
+	buf[13] = seq >> 8;
+	buf[14] = seq & 0xFF;
+	memset(buf + 15, 0xA5, BENCH_PAYLOAD - 3);
+	return 12 + BENCH_PAYLOAD;
+}
+
+int main(int argc, char* argv[])
+{
+	int packets = 20000, window = 5, loss = 0, opt;
+	unsigned int seed = 1;
+	while ((opt = getopt(argc, argv, "n:w:l:s:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			packets = atoi(optarg);
+			break;
+		case 'w':
+			window = atoi(optarg);
+			break;
+		case 'l':
+			loss = atoi(optarg);
+			break;
+		case 's':
+			seed = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-n packets] [-w reorder window] [-l loss %%] [-s seed]\n", argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	/* Packets moved by less than the buffering delay must never be late */
+	if (packets < 16 || window < 1 || window > BENCH_DELAY / 20 || loss < 0 || loss > 50)
+	{
+		fprintf(stderr, "Invalid options (at least 16 packets, a window of 1-%d, up to 50%% loss)\n", BENCH_DELAY / 20);
+		return 1;
+	}
+	srand(seed);
+
+	/* Random losses (never more than two in a row, so that they're all concealed), except for
+	 * the first few packets, the queue needs them to lock on the stream, and the last ones,
+	 * whose loss could never be detected */
+	int* order = (int*)malloc(packets * sizeof(int));
+	int i, sent = 0, dropped = 0;
+	for (i = 0; i < packets; i++)
+	{
+		order[i] = i;
+		if (i >= 4 && i < packets - 2 * window && loss > 0 && rand() % 100 < loss &&
+				(order[i - 1] >= 0 || order[i - 2] >= 0))
+		{
+			order[i] = -1;
+			dropped++;
+		}
+	}
+	/* Sending order: the first few in order, then shuffled within windows of random size (so that
+	 * they're not aligned with the ring, and reordered packets land on both sides of its wrap) */
+	int w;
+	for (i = 4; i + window <= packets - window; i += w)
+	{
+		int j;
+		w = 1 + rand() % window;
+		for (j = w - 1; j > 0; j--)
+		{
+			int k = rand() % (j + 1), tmp = order[i + j];
+			order[i + j] = order[i + k];
+			order[i + k] = tmp;
+		}
+	}
+	struct bench_check_t check;
+	memset(&check, 0, sizeof(check));
+	check.first_timestamp = (uint32_t)rand();
+	check.next_seq = BENCH_FIRST_SEQ;
+	struct opus_jitter_context_t* jb = opus_jitter_init(BENCH_PT, BENCH_RATE, BENCH_DELAY, BENCH_DELAY, bench_frame, &check);
+	if (jb == NULL)
+	{
+		fprintf(stderr, "Error creating the jitter buffer\n");
+		free(order);
+		return 1;
+	}
+	unsigned char buf[12 + BENCH_PAYLOAD];
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < packets; i++)
+	{
+		if (order[i] < 0)
+			continue;
+		int len = bench_packet(buf, (uint16_t)(BENCH_FIRST_SEQ + order[i]), check.first_timestamp + (uint32_t)order[i] * BENCH_FRAME);
+		opus_jitter_input(jb, buf, len);
+		sent++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	struct opus_jitter_stats_t stats;
+	opus_jitter_get_stats(jb, &stats);
+	opus_jitter_destory(jb);
+	free(order);
+
+	double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / sent;
+	printf("%d packets (%d lost), reordered within %d: %u frames played, %u concealed, %.0f ns/packet\n",
+		packets, dropped, window, check.frames, check.concealed, ns);
+	printf("Jitter buffer: received %u, late %u, lost %u, fec %u, plc %u\n",
+		stats.received, stats.late, stats.lost, stats.fec, stats.plc);
+	if (check.frames != (uint32_t)packets || check.packets != (uint32_t)sent ||
+			stats.late != 0 || stats.lost != (uint32_t)dropped || stats.fec + stats.plc != (uint32_t)dropped)
+		check.errors++;
+	if (check.errors > 0)
+	{
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
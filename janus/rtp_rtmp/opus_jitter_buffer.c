@@ -0,0 +1,217 @@
+#include "opus_jitter_buffer.h"
+#include "opus.h"
+#include "utils.h"
+
+//the packet, followed by a copy of the buffer it points to
+struct opus_jitter_packet_t
+{
+	struct rtp_packet_t pkt;
+	unsigned char       data[0];
+};
+
+static void opus_jitter_packet_free(void* param, struct rtp_packet_t* pkt)
+{
+	free(pkt);
+	(void)param;
+}
+
+static void opus_jitter_update_delay(struct opus_jitter_context_t* pcontext, uint32_t rtp_ts)
+{
+	int64_t now = janus_get_monotonic_time();
+	if (pcontext->last_arrival > 0)
+	{
+		/* RFC 3550 A.8: D(i-1,i) = (Rj - Ri) - (Sj - Si), smoothed with a 1/16 gain */
+		double arrival = (double)(now - pcontext->last_arrival) / 1000;
+		double sent = (double)(int32_t)(rtp_ts - pcontext->last_rtp_ts) * 1000 / pcontext->sample_rate;
+		double d = arrival - sent;
+		if (d < 0)
+			d = -d;
+		pcontext->jitter += (d - pcontext->jitter) / 16;
+		/* Wait for missing packets long enough to cover the jitter we're seeing, within the configured bounds */
+		int delay = (int)(pcontext->jitter * 3) + pcontext->frame_samples * 1000 / pcontext->sample_rate;
+		if (delay < pcontext->min_delay)
+			delay = pcontext->min_delay;
+		if (delay > pcontext->max_delay)
+			delay = pcontext->max_delay;
+		if (delay != pcontext->delay)
+		{
+			pcontext->delay = delay;
+			rtp_queue_set_threshold(pcontext->queue, delay);
+		}
+	}
+	pcontext->last_arrival = now;
+	pcontext->last_rtp_ts = rtp_ts;
+}
+
+static void opus_jitter_play(struct opus_jitter_context_t* pcontext, struct rtp_packet_t* pkt)
+{
+	const unsigned char* payload = (const unsigned char*)pkt->payload;
+	int samples = opus_packet_get_nb_samples(payload, pkt->payloadlen, pcontext->sample_rate);
+	if (samples <= 0)
+		samples = pcontext->frame_samples;
+	if (!pcontext->started)
+	{
+		pcontext->started = 1;
+		pcontext->next_seq = (uint16_t)pkt->rtp.seq;
+		pcontext->next_timestamp = pkt->rtp.timestamp;
+	}
+	uint16_t gap = (uint16_t)pkt->rtp.seq - pcontext->next_seq;
+	if (gap >= 0x8000)
+	{
+		/* Older than what we played out already */
+		pcontext->late++;
+		return;
+	}
+	if (gap > 0)
+	{
+		/* Fill the hole, as long as it doesn't exceed what we'd be willing to buffer anyway: the
+		 * frame right before this packet can be recovered from its in-band FEC, if present */
+		pcontext->lost += gap;
+		int max_frames = pcontext->max_delay * pcontext->sample_rate / 1000 / pcontext->frame_samples;
+		int frames = gap < max_frames ? gap : max_frames;
+		int i;
+		for (i = 0; i < frames; i++)
+		{
+			if (i == gap - 1)
+			{
+				pcontext->cb(pcontext->cbdata, payload, pkt->payloadlen, pcontext->frame_samples, 1, pcontext->next_timestamp);
+				pcontext->fec++;
+			}
+			else
+			{
+				pcontext->cb(pcontext->cbdata, NULL, 0, pcontext->frame_samples, 0, pcontext->next_timestamp);
+				pcontext->plc++;
+			}
+			pcontext->next_timestamp += pcontext->frame_samples;
+		}
+	}
+	/* Never go back in time: if the sender skipped ahead (DTX, or a hole too large to conceal), follow it */
+	if ((int32_t)(pkt->rtp.timestamp - pcontext->next_timestamp) > 0)
+		pcontext->next_timestamp = pkt->rtp.timestamp;
+	pcontext->cb(pcontext->cbdata, payload, pkt->payloadlen, samples, 0, pcontext->next_timestamp);
+	pcontext->next_timestamp += samples;
+	pcontext->next_seq = (uint16_t)pkt->rtp.seq + 1;
+	pcontext->frame_samples = samples;
+}
+
+struct opus_jitter_context_t* opus_jitter_init(int payload_type, int sample_rate, int min_delay, int max_delay, opus_jitter_frame_cb cb, void* cbdata)
+{
+	struct opus_jitter_context_t* pcontext = NULL;
+	int flag = 0;
+	do
+	{
+		pcontext = (struct opus_jitter_context_t*)calloc(1, sizeof(struct opus_jitter_context_t));
+		if (pcontext == NULL)
+		{
+			JANUS_LOG(LOG_ERR, "Opus jitter buffer calloc opus_jitter_context_t failed, err = %d\n", errno);
+			break;
+		}
+		if (min_delay <= 0)
+			min_delay = OPUS_JITTER_MIN_DELAY;
+		if (max_delay < min_delay)
+			max_delay = min_delay;
+		pcontext->payload_type = payload_type;
+		pcontext->sample_rate = sample_rate;
+		pcontext->min_delay = min_delay;
+		pcontext->max_delay = max_delay;
+		pcontext->delay = min_delay;
+		pcontext->frame_samples = sample_rate / 50;
+		pcontext->cb = cb;
+		pcontext->cbdata = cbdata;
+		janus_mutex_init(&pcontext->mutex);
+		pcontext->queue = rtp_queue_create(min_delay, sample_rate, opus_jitter_packet_free, pcontext);
+		if (pcontext->queue == NULL)
+		{
+			JANUS_LOG(LOG_ERR, "Opus jitter buffer create rtp queue failed\n");
+			break;
+		}
+		flag = 1;
+		JANUS_LOG(LOG_INFO, "Opus jitter buffer create success, delay %d-%d ms.\n", min_delay, max_delay);
+	} while (0);
+
+	if (!flag)
+	{
+		opus_jitter_destory(pcontext);
+		pcontext = NULL;
+	}
+	return pcontext;
+}
+
+int opus_jitter_input(struct opus_jitter_context_t* pcontext, const unsigned char* pbuf, int len)
+{
+	if (pcontext == NULL || pbuf == NULL || len <= 0)
+	{
+		JANUS_LOG(LOG_ERR, "Opus jitter buffer input opus_jitter_context_t or pbuf is null\n");
+		return -1;
+	}
+	struct opus_jitter_packet_t* packet = (struct opus_jitter_packet_t*)malloc(sizeof(struct opus_jitter_packet_t) + len);
+	if (packet == NULL)
+	{
+		JANUS_LOG(LOG_ERR, "Opus jitter buffer malloc packet failed, err = %d\n", errno);
+		return -1;
+	}
+	memcpy(packet->data, pbuf, len);
+	if (rtp_packet_deserialize(&packet->pkt, packet->data, len) != 0 || packet->pkt.payloadlen <= 0)
+	{
+		JANUS_LOG(LOG_WARN, "Opus jitter buffer skipping invalid packet\n");
+		free(packet);
+		return -1;
+	}
+	if ((int)packet->pkt.rtp.pt != pcontext->payload_type)
+	{
+		JANUS_LOG(LOG_WARN, "Opus jitter buffer skipping packet with payload type %d\n", (int)packet->pkt.rtp.pt);
+		free(packet);
+		return -1;
+	}
+	janus_mutex_lock(&pcontext->mutex);
+	pcontext->received++;
+	opus_jitter_update_delay(pcontext, packet->pkt.rtp.timestamp);
+	int res = rtp_queue_write(pcontext->queue, &packet->pkt);
+	if (res <= 0)
+	{
+		/* Too late, a duplicate, or the queue is full */
+		pcontext->late++;
+		free(packet);
+	}
+	/* Play out whatever is ready */
+	struct rtp_packet_t* pkt = NULL;
+	while ((pkt = rtp_queue_read(pcontext->queue)) != NULL)
+	{
+		opus_jitter_play(pcontext, pkt);
+		free(pkt);
+	}
+	janus_mutex_unlock(&pcontext->mutex);
+	return 1;
+}
+
+void opus_jitter_get_stats(struct opus_jitter_context_t* pcontext, struct opus_jitter_stats_t* stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (pcontext == NULL)
+		return;
+	janus_mutex_lock(&pcontext->mutex);
+	stats->delay = pcontext->delay;
+	stats->jitter = pcontext->jitter;
+	stats->received = pcontext->received;
+	stats->late = pcontext->late;
+	stats->lost = pcontext->lost;
+	stats->fec = pcontext->fec;
+	stats->plc = pcontext->plc;
+	janus_mutex_unlock(&pcontext->mutex);
+}
+
+void opus_jitter_destory(struct opus_jitter_context_t* pcontext)
+{
+	if (pcontext != NULL)
+	{
+		if (pcontext->queue != NULL)
+		{
+			rtp_queue_destroy(pcontext->queue);
+			pcontext->queue = NULL;
+		}
+		JANUS_LOG(LOG_INFO, "Opus jitter buffer context destroy (received %u, late %u, lost %u, fec %u, plc %u)\n",
+			pcontext->received, pcontext->late, pcontext->lost, pcontext->fec, pcontext->plc);
+		janus_mutex_destroy(&pcontext->mutex);
+		free(pcontext);
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef __OPUS_JITTER_BUFFER_H__
+#define __OPUS_JITTER_BUFFER_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtp-packet.h"
+#include "rtp-queue.h"
+#include "debug.h"
+#include "mutex.h"
+
+//default buffering limits (ms)
+#define OPUS_JITTER_MIN_DELAY	40
+#define OPUS_JITTER_MAX_DELAY	200
+
+//frame callback: packet != NULL && !fec -> decode packet normally
+//                packet != NULL && fec  -> missing frame, recover it from the in-band FEC of packet
+//                packet == NULL         -> missing frame, no FEC available, use PLC
+//samples is always the duration of the frame to produce, timestamp is monotonic (RTP clock)
+typedef void(*opus_jitter_frame_cb)(void* param, const unsigned char* packet, int len, int samples, int fec, uint32_t timestamp);
+
+//counters, as copied by opus_jitter_get_stats
+struct opus_jitter_stats_t
+{
+	int                  delay;           //ms
+	double               jitter;          //ms
+	uint32_t             received;
+	uint32_t             late;
+	uint32_t             lost;
+	uint32_t             fec;
+	uint32_t             plc;
+};
+
+struct opus_jitter_context_t
+{
+	janus_mutex          mutex;           //input and stats may come from different threads
+	rtp_queue_t*         queue;
+	opus_jitter_frame_cb cb;
+	void*                cbdata;
+	int                  sample_rate;
+	int                  payload_type;
+	int                  min_delay;       //ms
+	int                  max_delay;       //ms
+	int                  delay;           //current target delay (ms), adapted to the measured jitter
+	int                  started;
+	uint16_t             next_seq;        //sequence number we expect to play out next
+	uint32_t             next_timestamp;  //timestamp of the next frame we play out
+	int                  frame_samples;   //duration of the last frame we played out
+	int64_t              last_arrival;    //arrival time of the last packet (us)
+	uint32_t             last_rtp_ts;
+	double               jitter;          //RFC 3550 interarrival jitter (ms)
+
+	//statistics
+	uint32_t             received;
+	uint32_t             late;            //packets that arrived too late (or twice) and were dropped
+	uint32_t             lost;            //packets that never made it in time
+	uint32_t             fec;             //frames recovered with in-band FEC
+	uint32_t             plc;             //frames concealed with PLC
+};
+
+struct opus_jitter_context_t* opus_jitter_init(int payload_type, int sample_rate, int min_delay, int max_delay, opus_jitter_frame_cb cb, void* cbdata);
+
+//takes a whole RTP packet, and plays out all the frames that are ready
+int opus_jitter_input(struct opus_jitter_context_t* pcontext, const unsigned char* pbuf, int len);
+
+//consistent copy of the statistics, safe to call while another thread feeds the buffer
+void opus_jitter_get_stats(struct opus_jitter_context_t* pcontext, struct opus_jitter_stats_t* stats);
+
+void opus_jitter_destory(struct opus_jitter_context_t* pcontext);
+
+#endif //__OPUS_JITTER_BUFFER_H__
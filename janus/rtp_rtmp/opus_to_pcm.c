@@ -47,20 +47,8 @@ struct opus_to_pcm_context_t * opus_to_pcm_init(int sampleRate, int channels, op
 }
 
 
-int opus_to_pcm_decode(struct opus_to_pcm_context_t* pcontext,unsigned char* pdata, int len, uint32_t timestamp,int seq)
+static void opus_to_pcm_output(struct opus_to_pcm_context_t* pcontext, int output_samples, uint32_t timestamp)
 {
-	if (pcontext ==NULL || pdata ==NULL)
-	{
-		JANUS_LOG(LOG_ERR, "Opus decoder input opus_to_pcm_context_t  or pdata is null\n");
-		return -1;
-	}
-
-	/* We need to allocate for 16-bit PCM data, but we store it as unsigned char. */
-
-	//TODO暂时fes功能
-	int output_samples = pcontext->max_frame_size;
-	output_samples = opus_decode(pcontext->decoder, pdata, len, pcontext->out, output_samples, 0);
-
 	if (output_samples > 0)
 	{
 			int i;
@@ -75,6 +63,40 @@ int opus_to_pcm_decode(struct opus_to_pcm_context_t* pcontext,unsigned char* pda
 			pcontext->cb(pcontext->cbdata, fbytes, output_samples*pcontext->channels * sizeof(short), timestamp);
 			free(fbytes);
 	}
+}
+
+int opus_to_pcm_decode(struct opus_to_pcm_context_t* pcontext,unsigned char* pdata, int len, uint32_t timestamp,int seq)
+{
+	if (pcontext ==NULL || pdata ==NULL)
+	{
+		JANUS_LOG(LOG_ERR, "Opus decoder input opus_to_pcm_context_t  or pdata is null\n");
+		return -1;
+	}
+
+	/* We need to allocate for 16-bit PCM data, but we store it as unsigned char. */
+	int output_samples = pcontext->max_frame_size;
+	output_samples = opus_decode(pcontext->decoder, pdata, len, pcontext->out, output_samples, 0);
+	opus_to_pcm_output(pcontext, output_samples, timestamp);
+	return 1;
+}
+
+int opus_to_pcm_conceal(struct opus_to_pcm_context_t* pcontext, const unsigned char* pdata, int len, int samples, uint32_t timestamp)
+{
+	if (pcontext == NULL || samples <= 0 || samples > pcontext->max_frame_size)
+	{
+		JANUS_LOG(LOG_ERR, "Opus decoder conceal opus_to_pcm_context_t is null or invalid frame size %d\n", samples);
+		return -1;
+	}
+
+	/* When decoding FEC the frame size must be exactly the duration of the missing frame;
+	 * if the packet carries no FEC data, libopus falls back to PLC on its own */
+	int output_samples = opus_decode(pcontext->decoder, pdata, pdata ? len : 0, pcontext->out, samples, pdata ? 1 : 0);
+	if (output_samples < 0)
+	{
+		JANUS_LOG(LOG_WARN, "Opus decoder concealment failed: %s\n", opus_strerror(output_samples));
+		return -1;
+	}
+	opus_to_pcm_output(pcontext, output_samples, timestamp);
 	return 1;
 }
 
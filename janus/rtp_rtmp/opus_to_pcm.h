@@ -25,6 +25,9 @@ struct opus_to_pcm_context_t* opus_to_pcm_init(int sampleRate, int channels, opu
 
 int  opus_to_pcm_decode(struct opus_to_pcm_context_t* pcontext,unsigned char* pdata,int len,uint32_t timestamp,int seq);
 
+//conceal a missing frame of the given duration: with pdata, use the in-band FEC of the packet that follows it, without, use PLC
+int  opus_to_pcm_conceal(struct opus_to_pcm_context_t* pcontext,const unsigned char* pdata,int len,int samples,uint32_t timestamp);
+
 void opus_to_pcm_destory(struct opus_to_pcm_context_t* pcontext);
 
 #endif //__OPUS_TO_PCM__H
\ No newline at end of file
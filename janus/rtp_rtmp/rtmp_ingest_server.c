@@ -0,0 +1,390 @@
+#include "rtmp_ingest_server.h"
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#include "utils.h"
+
+//EPOLLOUT is only asked for while there's something queued
+static int rtmp_ingest_watch(struct rtmp_ingest_conn_t* conn, int writable)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP | (writable ? EPOLLOUT : 0);
+	ev.data.ptr = conn;
+	return epoll_ctl(conn->server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+static int rtmp_ingest_queue(struct rtmp_ingest_conn_t* conn, const void* data, size_t bytes)
+{
+	if (conn->out_len + bytes > RTMP_INGEST_MAX_OUTPUT)
+	{
+		JANUS_LOG(LOG_WARN, "Rtmp ingest %s isn't reading our replies, dropping it\n", conn->addr);
+		return -1;
+	}
+	if (conn->out_len + bytes > conn->out_size)
+	{
+		size_t size = conn->out_size > 0 ? conn->out_size : 4096;
+		while (size < conn->out_len + bytes)
+			size *= 2;
+		unsigned char* out = (unsigned char*)realloc(conn->out, size);
+		if (out == NULL)
+			return -1;
+		conn->out = out;
+		conn->out_size = size;
+	}
+	memcpy(conn->out + conn->out_len, data, bytes);
+	conn->out_len += bytes;
+	return 0;
+}
+
+static int rtmp_ingest_send(void* param, const void* header, size_t len, const void* data, size_t bytes)
+{
+	struct rtmp_ingest_conn_t* conn = (struct rtmp_ingest_conn_t*)param;
+	size_t sent = 0;
+	int queued = conn->out_len > 0;
+	if (!queued)
+	{
+		//the socket is non-blocking: send what it takes now, and queue the rest
+		socket_bufvec_t vec[2];
+		socket_setbufvec(vec, 0, (void*)header, len);
+		socket_setbufvec(vec, 1, (void*)data, bytes);
+		int r = socket_send_v(conn->fd, vec, bytes > 0 ? 2 : 1, MSG_NOSIGNAL);
+		if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			return -1;
+		sent = r > 0 ? (size_t)r : 0;
+		if (sent == len + bytes)
+			return (int)sent;
+	}
+	if ((sent < len && rtmp_ingest_queue(conn, (const unsigned char*)header + sent, len - sent) != 0) ||
+		(bytes > 0 && rtmp_ingest_queue(conn, (const unsigned char*)data + (sent > len ? sent - len : 0), bytes - (sent > len ? sent - len : 0)) != 0))
+		return -1;
+	if (!queued && rtmp_ingest_watch(conn, 1) != 0)
+		return -1;
+	return (int)(len + bytes);
+}
+
+//returns 0 if the connection is still alive
+static int rtmp_ingest_flush(struct rtmp_ingest_conn_t* conn)
+{
+	while (conn->out_len > 0)
+	{
+		int r = socket_send(conn->fd, conn->out, conn->out_len, MSG_NOSIGNAL);
+		if (r < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+		memmove(conn->out, conn->out + r, conn->out_len - r);
+		conn->out_len -= r;
+	}
+	return rtmp_ingest_watch(conn, 0);
+}
+
+static int rtmp_ingest_onplay(void* param, const char* app, const char* stream, double start, double duration, uint8_t reset)
+{
+	struct rtmp_ingest_conn_t* conn = (struct rtmp_ingest_conn_t*)param;
+	JANUS_LOG(LOG_WARN, "Rtmp ingest %s tried to play %s/%s, only publishing is supported\n", conn->addr, app, stream);
+	return -1;
+}
+
+static int rtmp_ingest_onpause(void* param, int pause, uint32_t ms)
+{
+	return -1;
+}
+
+static int rtmp_ingest_onseek(void* param, uint32_t ms)
+{
+	return -1;
+}
+
+static int rtmp_ingest_onpublish(void* param, const char* app, const char* stream, const char* type)
+{
+	struct rtmp_ingest_conn_t* conn = (struct rtmp_ingest_conn_t*)param;
+	if (conn->publishing)
+	{
+		JANUS_LOG(LOG_WARN, "Rtmp ingest %s is already publishing %s/%s\n", conn->addr, conn->app, conn->stream);
+		return -1;
+	}
+	if (conn->server->onpublish(conn->server->cbdata, conn, app, stream) != 0)
+	{
+		JANUS_LOG(LOG_WARN, "Rtmp ingest %s publishing %s/%s rejected\n", conn->addr, app, stream);
+		return -1;
+	}
+	snprintf(conn->app, sizeof(conn->app), "%s", app);
+	snprintf(conn->stream, sizeof(conn->stream), "%s", stream);
+	conn->publishing = 1;
+	JANUS_LOG(LOG_INFO, "Rtmp ingest %s publishing %s/%s (%s)\n", conn->addr, app, stream, type);
+	return 0;
+}
+
+static int rtmp_ingest_ondata(struct rtmp_ingest_conn_t* conn, const void* data, size_t bytes, uint32_t timestamp, int type)
+{
+	if (!conn->publishing || bytes < 1)
+		return 0;
+	conn->server->ondata(conn->server->cbdata, conn, (const unsigned char*)data, bytes, timestamp, type);
+	return 0;
+}
+
+static int rtmp_ingest_onaudio(void* param, const void* data, size_t bytes, uint32_t timestamp)
+{
+	return rtmp_ingest_ondata((struct rtmp_ingest_conn_t*)param, data, bytes, timestamp, FLV_TYPE_AUDIO);
+}
+
+static int rtmp_ingest_onvideo(void* param, const void* data, size_t bytes, uint32_t timestamp)
+{
+	return rtmp_ingest_ondata((struct rtmp_ingest_conn_t*)param, data, bytes, timestamp, FLV_TYPE_VIDEO);
+}
+
+static int rtmp_ingest_onscript(void* param, const void* data, size_t bytes, uint32_t timestamp)
+{
+	return rtmp_ingest_ondata((struct rtmp_ingest_conn_t*)param, data, bytes, timestamp, FLV_TYPE_SCRIPT);
+}
+
+static void rtmp_ingest_conn_close(struct rtmp_ingest_server_t* pserver, struct rtmp_ingest_conn_t* conn)
+{
+	epoll_ctl(pserver->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+	pserver->conns = g_list_remove(pserver->conns, conn);
+	if (conn->publishing)
+	{
+		JANUS_LOG(LOG_INFO, "Rtmp ingest %s stopped publishing %s/%s\n", conn->addr, conn->app, conn->stream);
+		pserver->onclose(pserver->cbdata, conn);
+	}
+	if (conn->rtmp != NULL)
+		rtmp_server_destroy(conn->rtmp);
+	socket_close(conn->fd);
+	free(conn->out);
+	free(conn);
+}
+
+static void rtmp_ingest_accept(struct rtmp_ingest_server_t* pserver)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+	u_short port = 0;
+	socket_t fd = socket_accept(pserver->listen_fd, &ss, &len);
+	if (socket_invalid == fd)
+		return;
+	if ((int)g_list_length(pserver->conns) >= pserver->max_conns)
+	{
+		JANUS_LOG(LOG_WARN, "Rtmp ingest too many connections (%d), rejecting a new one\n", pserver->max_conns);
+		socket_close(fd);
+		return;
+	}
+	struct rtmp_ingest_conn_t* conn = (struct rtmp_ingest_conn_t*)calloc(1, sizeof(struct rtmp_ingest_conn_t));
+	if (conn == NULL)
+	{
+		JANUS_LOG(LOG_ERR, "Rtmp ingest calloc rtmp_ingest_conn_t failed, err = %d\n", errno);
+		socket_close(fd);
+		return;
+	}
+	conn->fd = fd;
+	conn->server = pserver;
+	conn->last_activity = janus_get_monotonic_time();
+	socket_addr_to((struct sockaddr*)&ss, len, conn->addr, &port);
+	socket_setnonblock(fd, 1);
+
+	struct rtmp_server_handler_t handler;
+	memset(&handler, 0, sizeof(handler));
+	handler.send = rtmp_ingest_send;
+	handler.onplay = rtmp_ingest_onplay;
+	handler.onpause = rtmp_ingest_onpause;
+	handler.onseek = rtmp_ingest_onseek;
+	handler.onpublish = rtmp_ingest_onpublish;
+	handler.onaudio = rtmp_ingest_onaudio;
+	handler.onvideo = rtmp_ingest_onvideo;
+	handler.onscript = rtmp_ingest_onscript;
+	conn->rtmp = rtmp_server_create(conn, &handler);
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = conn;
+	if (conn->rtmp == NULL || epoll_ctl(pserver->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+	{
+		JANUS_LOG(LOG_ERR, "Rtmp ingest can't serve %s, err = %d\n", conn->addr, errno);
+		if (conn->rtmp != NULL)
+			rtmp_server_destroy(conn->rtmp);
+		socket_close(fd);
+		free(conn);
+		return;
+	}
+	pserver->conns = g_list_append(pserver->conns, conn);
+	JANUS_LOG(LOG_VERB, "Rtmp ingest new connection from %s:%hu\n", conn->addr, port);
+}
+
+//returns 0 if the connection is still alive: epoll is level-triggered, so whatever
+//we leave in the socket after RTMP_INGEST_MAX_READS wakes us up again next round
+static int rtmp_ingest_read(struct rtmp_ingest_server_t* pserver, struct rtmp_ingest_conn_t* conn)
+{
+	int i;
+	for (i = 0; i < RTMP_INGEST_MAX_READS; i++)
+	{
+		int r = socket_recv(conn->fd, pserver->buffer, sizeof(pserver->buffer), 0);
+		if (r == 0)
+			return -1;
+		if (r < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+		conn->last_activity = janus_get_monotonic_time();
+		if (rtmp_server_input(conn->rtmp, pserver->buffer, r) != 0)
+		{
+			JANUS_LOG(LOG_WARN, "Rtmp ingest invalid data from %s\n", conn->addr);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void* rtmp_ingest_thread(void* data)
+{
+	struct rtmp_ingest_server_t* pserver = (struct rtmp_ingest_server_t*)data;
+	struct epoll_event events[32];
+	int64_t last_check = janus_get_monotonic_time();
+	JANUS_LOG(LOG_INFO, "Rtmp ingest thread started\n");
+	while (!g_atomic_int_get(&pserver->stopping))
+	{
+		int n = epoll_wait(pserver->epoll_fd, events, sizeof(events) / sizeof(events[0]), 1000);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			JANUS_LOG(LOG_ERR, "Rtmp ingest epoll_wait failed, err = %d\n", errno);
+			break;
+		}
+		int i;
+		for (i = 0; i < n; i++)
+		{
+			if (events[i].data.ptr == pserver->pipefd)
+			{
+				/* We're done */
+				break;
+			}
+			if (events[i].data.ptr == pserver)
+			{
+				rtmp_ingest_accept(pserver);
+				continue;
+			}
+			struct rtmp_ingest_conn_t* conn = (struct rtmp_ingest_conn_t*)events[i].data.ptr;
+			int alive = (events[i].events & (EPOLLIN | EPOLLOUT)) && !(events[i].events & (EPOLLERR | EPOLLHUP));
+			if (alive && (events[i].events & EPOLLOUT))
+				alive = rtmp_ingest_flush(conn) == 0;
+			if (alive && (events[i].events & EPOLLIN))
+				alive = rtmp_ingest_read(pserver, conn) == 0;
+			if (alive)
+				continue;
+			rtmp_ingest_conn_close(pserver, conn);
+		}
+		/* Get rid of connections that went silent */
+		int64_t now = janus_get_monotonic_time();
+		if (now - last_check >= G_USEC_PER_SEC)
+		{
+			last_check = now;
+			GList* l = pserver->conns;
+			while (l)
+			{
+				struct rtmp_ingest_conn_t* conn = (struct rtmp_ingest_conn_t*)l->data;
+				l = l->next;
+				if (now - conn->last_activity > (int64_t)RTMP_INGEST_TIMEOUT * 1000)
+				{
+					JANUS_LOG(LOG_WARN, "Rtmp ingest %s timed out\n", conn->addr);
+					rtmp_ingest_conn_close(pserver, conn);
+				}
+			}
+		}
+	}
+	while (pserver->conns != NULL)
+		rtmp_ingest_conn_close(pserver, (struct rtmp_ingest_conn_t*)pserver->conns->data);
+	JANUS_LOG(LOG_INFO, "Rtmp ingest thread leaving\n");
+	return NULL;
+}
+
+struct rtmp_ingest_server_t* rtmp_ingest_server_init(const char* ip, int port, int max_conns,
+	rtmp_ingest_publish_cb onpublish, rtmp_ingest_data_cb ondata, rtmp_ingest_close_cb onclose, void* cbdata)
+{
+	struct rtmp_ingest_server_t* pserver = NULL;
+	int flag = 0;
+	do
+	{
+		pserver = (struct rtmp_ingest_server_t*)calloc(1, sizeof(struct rtmp_ingest_server_t));
+		if (pserver == NULL)
+		{
+			JANUS_LOG(LOG_ERR, "Rtmp ingest calloc rtmp_ingest_server_t failed, err = %d\n", errno);
+			break;
+		}
+		pserver->listen_fd = socket_invalid;
+		pserver->epoll_fd = -1;
+		pserver->pipefd[0] = -1;
+		pserver->pipefd[1] = -1;
+		pserver->max_conns = max_conns > 0 ? max_conns : RTMP_INGEST_MAX_CONNS;
+		pserver->onpublish = onpublish;
+		pserver->ondata = ondata;
+		pserver->onclose = onclose;
+		pserver->cbdata = cbdata;
+
+		socket_init();
+		pserver->listen_fd = socket_tcp_listen(ip, (u_short)(port > 0 ? port : RTMP_INGEST_PORT), SOMAXCONN);
+		if (socket_invalid == pserver->listen_fd)
+		{
+			JANUS_LOG(LOG_ERR, "Rtmp ingest can't listen on %s:%d, err = %d\n", ip ? ip : "*", port, errno);
+			break;
+		}
+		socket_setnonblock(pserver->listen_fd, 1);
+		pserver->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (pserver->epoll_fd < 0 || pipe(pserver->pipefd) != 0)
+		{
+			JANUS_LOG(LOG_ERR, "Rtmp ingest epoll/pipe creation failed, err = %d\n", errno);
+			break;
+		}
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = pserver;
+		if (epoll_ctl(pserver->epoll_fd, EPOLL_CTL_ADD, pserver->listen_fd, &ev) != 0)
+			break;
+		ev.data.ptr = pserver->pipefd;
+		if (epoll_ctl(pserver->epoll_fd, EPOLL_CTL_ADD, pserver->pipefd[0], &ev) != 0)
+			break;
+
+		GError* error = NULL;
+		pserver->thread = g_thread_try_new("rtmp ingest", rtmp_ingest_thread, pserver, &error);
+		if (error != NULL)
+		{
+			JANUS_LOG(LOG_ERR, "Rtmp ingest got error %d (%s) trying to launch the thread\n", error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			pserver->thread = NULL;
+			break;
+		}
+		flag = 1;
+		JANUS_LOG(LOG_INFO, "Rtmp ingest listening on %s:%d\n", ip ? ip : "*", port > 0 ? port : RTMP_INGEST_PORT);
+	} while (0);
+
+	if (!flag)
+	{
+		rtmp_ingest_server_destory(pserver);
+		pserver = NULL;
+	}
+	return pserver;
+}
+
+void rtmp_ingest_server_destory(struct rtmp_ingest_server_t* pserver)
+{
+	if (pserver == NULL)
+		return;
+	if (pserver->thread != NULL)
+	{
+		g_atomic_int_set(&pserver->stopping, 1);
+		int code = 1;
+		ssize_t res = 0;
+		do {
+			res = write(pserver->pipefd[1], &code, sizeof(int));
+		} while (res == -1 && errno == EINTR);
+		g_thread_join(pserver->thread);
+		pserver->thread = NULL;
+	}
+	if (pserver->epoll_fd >= 0)
+		close(pserver->epoll_fd);
+	if (pserver->pipefd[0] >= 0)
+		close(pserver->pipefd[0]);
+	if (pserver->pipefd[1] >= 0)
+		close(pserver->pipefd[1]);
+	if (socket_invalid != pserver->listen_fd)
+		socket_close(pserver->listen_fd);
+	free(pserver);
+	JANUS_LOG(LOG_INFO, "Rtmp ingest server destroy\n");
+}
@@ -0,0 +1,71 @@
+#ifndef __RTMP_INGEST_SERVER_H__
+#define __RTMP_INGEST_SERVER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <glib.h>
+#include "sockutil.h"
+#include "rtmp-server.h"
+#include "flv-proto.h"
+#include "debug.h"
+
+//RTMP listener accepting pushes (OBS, ffmpeg...): a single epoll thread serves all the connections,
+//so nothing on it blocks: replies the socket can't take are queued, and the data callback is
+//expected to hand the media over to someone else if it does any heavy lifting
+
+#define RTMP_INGEST_PORT			1935
+#define RTMP_INGEST_MAX_CONNS		64
+#define RTMP_INGEST_TIMEOUT			10000	//ms without data before a connection is dropped
+#define RTMP_INGEST_MAX_OUTPUT		(256 * 1024)	//bytes of replies queued for a client that doesn't read them
+#define RTMP_INGEST_MAX_READS		16		//reads from a connection per wakeup, so that a busy publisher can't starve the others
+
+struct rtmp_ingest_server_t;
+
+struct rtmp_ingest_conn_t
+{
+	socket_t                     fd;
+	rtmp_server_t*               rtmp;
+	struct rtmp_ingest_server_t* server;
+	char                         addr[SOCKET_ADDRLEN];
+	char                         app[128];
+	char                         stream[256];
+	int                          publishing;
+	int64_t                      last_activity;	//monotonic, us
+	//what the socket didn't take yet (handshake and control messages), written on EPOLLOUT
+	unsigned char*               out;
+	size_t                       out_len;
+	size_t                       out_size;
+	void*                        param;			//set by the publish callback, e.g., the mountpoint
+};
+
+//a client wants to publish app/stream: return 0 to accept it (and set conn->param), anything else to reject it
+typedef int(*rtmp_ingest_publish_cb)(void* cbdata, struct rtmp_ingest_conn_t* conn, const char* app, const char* stream);
+//FLV tag body (type is FLV_TYPE_AUDIO/FLV_TYPE_VIDEO/FLV_TYPE_SCRIPT) from an accepted publisher, on the epoll thread
+typedef int(*rtmp_ingest_data_cb)(void* cbdata, struct rtmp_ingest_conn_t* conn, const unsigned char* data, size_t bytes, uint32_t timestamp, int type);
+//an accepted publisher went away (or the server is being destroyed)
+typedef void(*rtmp_ingest_close_cb)(void* cbdata, struct rtmp_ingest_conn_t* conn);
+
+struct rtmp_ingest_server_t
+{
+	socket_t               listen_fd;
+	int                    epoll_fd;
+	int                    pipefd[2];		//just needed to interrupt epoll_wait when it's time to wrap up
+	int                    max_conns;
+	GList*                 conns;
+	GThread*               thread;
+	volatile gint          stopping;
+	rtmp_ingest_publish_cb onpublish;
+	rtmp_ingest_data_cb    ondata;
+	rtmp_ingest_close_cb   onclose;
+	void*                  cbdata;
+	unsigned char          buffer[64 * 1024];
+};
+
+//ip may be NULL to listen on all the interfaces
+struct rtmp_ingest_server_t* rtmp_ingest_server_init(const char* ip, int port, int max_conns,
+	rtmp_ingest_publish_cb onpublish, rtmp_ingest_data_cb ondata, rtmp_ingest_close_cb onclose, void* cbdata);
+
+//stops the thread and closes all the connections, invoking the close callback for publishers
+void rtmp_ingest_server_destory(struct rtmp_ingest_server_t* pserver);
+
+#endif //__RTMP_INGEST_SERVER_H__
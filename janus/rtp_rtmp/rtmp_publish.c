@@ -70,7 +70,7 @@ static int rtmp_client_send(void* param, const void* header, size_t len, const v
 	return socket_send_v_all_by_time(*socket, vec, bytes > 0 ? 2 : 1, 0, 5000);
 }
 
-struct rtmp_client_publish_context_t*  rtmp_client_init(const char* host, const char* app, const char* stream,int port, int timeout)
+struct rtmp_client_publish_context_t*  rtmp_client_init(const char* host, const char* app, const char* stream,int port, int timeout, const char* fourcc)
 {
 	struct rtmp_client_publish_context_t* pContext = NULL;
 	int flag = 0;
@@ -103,6 +103,11 @@ struct rtmp_client_publish_context_t*  rtmp_client_init(const char* host, const
 			JANUS_LOG(LOG_ERR, "Rtmp client init failed, when create rtmp client. err is %d\n", errno);
 			break;
 		}
+		if (fourcc != NULL && rtmp_client_set_fourcc(pContext->rtmp, fourcc) != 0)
+		{
+			JANUS_LOG(LOG_ERR, "Rtmp client init failed, invalid fourCcList %s\n", fourcc);
+			break;
+		}
 		//// 0-publish, 1-live/vod, 2-live only, 3-vod only
 		int r = rtmp_client_start(pContext->rtmp, 0);
 		if (r <0)
@@ -115,6 +120,11 @@ struct rtmp_client_publish_context_t*  rtmp_client_init(const char* host, const
 			r = rtmp_client_input(pContext->rtmp, pContext->packet, r);
 		}
 		flag = 1;
+		if (fourcc != NULL)
+		{
+			const char* accepted = rtmp_client_get_fourcc(pContext->rtmp);
+			JANUS_LOG(LOG_INFO, "Rtmp server fourCcList: %s\n", accepted ? accepted : "none (legacy server)");
+		}
 		JANUS_LOG(LOG_INFO, "Init rtmp client success.\n");
 	} while (0);
 	
@@ -125,12 +135,28 @@ struct rtmp_client_publish_context_t*  rtmp_client_init(const char* host, const
 	return pContext;
 }
 
+int rtmp_client_publish_supports(struct rtmp_client_publish_context_t* pcontext, const char* fourcc)
+{
+	const char *list, *p;
+	size_t n = strlen(fourcc);
+	list = rtmp_client_get_fourcc(pcontext->rtmp);
+	for (p = list; p && *p; p += strcspn(p, ","), p += (',' == *p) ? 1 : 0)
+	{
+		if ((1 == strcspn(p, ",") && '*' == *p) || (n == strcspn(p, ",") && 0 == strncmp(p, fourcc, n)))
+			return 1;
+	}
+	return 0;
+}
+
 int rtmp_client_input_flv(struct rtmp_client_publish_context_t* pcontext, unsigned char* packet, int len, int type, uint32_t timestamp)
 {
 	int nRet;
+	//enhanced RTMP carries the packet type in the low nibble of the first byte, followed by the FourCC
+	int exheader = FLV_TYPE_AUDIO == type ? (packet[0] & 0xF0) == FLV_AUDIO_EX_HEADER : (packet[0] & FLV_VIDEO_EX_HEADER) != 0;
+	int sequence = exheader ? (packet[0] & 0x0F) == FLV_PACKET_SEQUENCE_START : 0 == packet[1];
 	if (FLV_TYPE_AUDIO == type)
 	{
-		if (0 == packet[1])
+		if (sequence)
 		{
 			if (0 != pcontext->aacconfig)
 			{
@@ -142,7 +168,7 @@ int rtmp_client_input_flv(struct rtmp_client_publish_context_t* pcontext, unsign
 	}
 	else if (FLV_TYPE_VIDEO == type)
 	{
-		if (0 == packet[1] || 2 == packet[1])
+		if (sequence || (!exheader && 2 == packet[1]))
 		{
 			if (0 != pcontext->avcrecord)
 			{
@@ -23,7 +23,10 @@ struct rtmp_client_publish_context_t
 	int   avcrecord;
 };
 
-struct rtmp_client_publish_context_t* rtmp_client_init(const char* host, const char* app, const char* stream, int port, int timeout);
+//fourcc: enhanced RTMP codecs to advertise (e.g. "hvc1,Opus"), NULL for legacy FLV only
+struct rtmp_client_publish_context_t* rtmp_client_init(const char* host, const char* app, const char* stream, int port, int timeout, const char* fourcc);
+//1 if the server listed fourcc (or "*") in the fourCcList of its connect response, 0 if not or if it sent none (legacy server)
+int rtmp_client_publish_supports(struct rtmp_client_publish_context_t* pcontext, const char* fourcc);
 int rtmp_client_input_flv(struct rtmp_client_publish_context_t* pcontext,unsigned char* pdata,int len, int type, uint32_t timestamp);
 void rtmp_client_context_destroy(struct rtmp_client_publish_context_t* pcontext);
 
@@ -0,0 +1,387 @@
+#include "video_transcode.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vpx/vpx_decoder.h>
+#include <vpx/vp8dx.h>
+#include <x264.h>
+
+struct video_transcode_frame_t
+{
+	int64_t        pts;			//unwrapped timestamp, as x264 wants it monotonic
+	int            keyframe;
+	int            len;
+	unsigned char  data[0];
+};
+
+static GThreadPool* transcode_pool = NULL;
+
+static int64_t video_transcode_cpu_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (int64_t)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static void video_transcode_free(const janus_refcount* ref)
+{
+	struct video_transcode_context_t* pcontext = janus_refcount_containerof(ref, struct video_transcode_context_t, ref);
+	if (pcontext->decoder != NULL)
+	{
+		vpx_codec_destroy((vpx_codec_ctx_t*)pcontext->decoder);
+		free(pcontext->decoder);
+	}
+	if (pcontext->encoder != NULL)
+		x264_encoder_close((x264_t*)pcontext->encoder);
+	if (pcontext->frames != NULL)
+		g_queue_free_full(pcontext->frames, g_free);
+	g_free(pcontext->i420);
+	JANUS_LOG(LOG_INFO, "Video transcoder context destroy (in %u, out %u, dropped %u, cpu %"SCNu64" us)\n",
+		pcontext->frames_in, pcontext->frames_out, pcontext->frames_dropped, pcontext->cpu_time);
+	g_free(pcontext->preset);
+	g_free(pcontext);
+}
+
+static int video_transcode_open_encoder(struct video_transcode_context_t* pcontext, int width, int height)
+{
+	if (pcontext->encoder != NULL)
+	{
+		x264_encoder_close((x264_t*)pcontext->encoder);
+		pcontext->encoder = NULL;
+	}
+	x264_param_t param;
+	if (x264_param_default_preset(&param, pcontext->preset, "zerolatency") < 0)
+	{
+		JANUS_LOG(LOG_WARN, "Invalid x264 preset %s, using %s\n", pcontext->preset, VIDEO_TRANSCODE_PRESET);
+		x264_param_default_preset(&param, VIDEO_TRANSCODE_PRESET, "zerolatency");
+	}
+	param.i_width = width;
+	param.i_height = height;
+	param.i_csp = X264_CSP_I420;
+	/* Parallelism comes from the pool, not from x264 */
+	param.i_threads = 1;
+	param.b_annexb = 1;
+	param.b_repeat_headers = 1;
+	/* We'll force an IDR for each keyframe we receive: this is just an upper bound */
+	param.i_keyint_max = VIDEO_TRANSCODE_GOP;
+	param.b_vfr_input = 1;
+	param.i_timebase_num = 1;
+	param.i_timebase_den = 90000;
+	param.rc.i_rc_method = X264_RC_ABR;
+	param.rc.i_bitrate = pcontext->bitrate;
+	param.rc.i_vbv_max_bitrate = pcontext->bitrate;
+	param.rc.i_vbv_buffer_size = pcontext->bitrate;
+	x264_param_apply_profile(&param, "baseline");
+	pcontext->encoder = x264_encoder_open(&param);
+	if (pcontext->encoder == NULL)
+	{
+		JANUS_LOG(LOG_ERR, "Error opening the H.264 encoder (%dx%d)\n", width, height);
+		return -1;
+	}
+	pcontext->width = width;
+	pcontext->height = height;
+	JANUS_LOG(LOG_INFO, "Opened the H.264 encoder (%dx%d, preset %s, %d kbps)\n", width, height, pcontext->preset, pcontext->bitrate);
+	return 0;
+}
+
+static inline int video_transcode_sample(const vpx_image_t* img, int plane, int x, int y)
+{
+	const unsigned char* row = img->planes[plane] + y * img->stride[plane];
+	if (img->fmt & VPX_IMG_FMT_HIGHBITDEPTH)
+		return ((const uint16_t*)row)[x] >> (img->bit_depth - 8);
+	return row[x];
+}
+
+//x264 is opened for 8 bit 4:2:0, while VP9 profiles 1-3 decode to 4:2:2, 4:4:0, 4:4:4 and/or
+//10/12 bit: convert those, averaging the chroma samples each 4:2:0 sample covers. Fills the
+//picture to encode, returns -1 if the format isn't one we know
+static int video_transcode_to_i420(struct video_transcode_context_t* pcontext, const vpx_image_t* img, x264_picture_t* pic)
+{
+	int i, x, y;
+	pic->img.i_csp = X264_CSP_I420;
+	pic->img.i_plane = 3;
+	if (img->fmt == VPX_IMG_FMT_I420 || img->fmt == VPX_IMG_FMT_YV12)
+	{
+		/* What VP8 and VP9 profile 0 give us: just point x264 to the planes */
+		for (i = 0; i < 3; i++)
+		{
+			pic->img.plane[i] = img->planes[i];
+			pic->img.i_stride[i] = img->stride[i];
+		}
+		return 0;
+	}
+	if (!(img->fmt & VPX_IMG_FMT_PLANAR) || img->x_chroma_shift > 1 || img->y_chroma_shift > 1 ||
+		((img->fmt & VPX_IMG_FMT_HIGHBITDEPTH) && (img->bit_depth < 8 || img->bit_depth > 16)))
+	{
+		if (pcontext->i420_fmt != img->fmt)
+			JANUS_LOG(LOG_WARN, "Unsupported decoded picture format 0x%x, dropping the frame\n", img->fmt);
+		pcontext->i420_fmt = img->fmt;
+		return -1;
+	}
+	if (pcontext->i420_fmt != img->fmt)
+	{
+		JANUS_LOG(LOG_INFO, "Converting decoded pictures (format 0x%x, %u bit) to 8 bit 4:2:0\n", img->fmt, img->bit_depth);
+		pcontext->i420_fmt = img->fmt;
+	}
+	int w = img->d_w, h = img->d_h, cw = (w + 1) / 2, ch = (h + 1) / 2;
+	int size = w * h + 2 * cw * ch;
+	if (pcontext->i420_size < size)
+	{
+		g_free(pcontext->i420);
+		pcontext->i420 = g_malloc(size);
+		pcontext->i420_size = size;
+	}
+	unsigned char* p = pcontext->i420;
+	pic->img.plane[0] = p;
+	pic->img.i_stride[0] = w;
+	for (y = 0; y < h; y++)
+	{
+		if (!(img->fmt & VPX_IMG_FMT_HIGHBITDEPTH))
+		{
+			memcpy(p + y * w, img->planes[VPX_PLANE_Y] + y * img->stride[VPX_PLANE_Y], w);
+			continue;
+		}
+		for (x = 0; x < w; x++)
+			p[y * w + x] = video_transcode_sample(img, VPX_PLANE_Y, x, y);
+	}
+	/* Last column/row of the source chroma planes, for odd sizes */
+	int sw = ((w + img->x_chroma_shift) >> img->x_chroma_shift) - 1, sh = ((h + img->y_chroma_shift) >> img->y_chroma_shift) - 1;
+	for (i = 1; i < 3; i++)
+	{
+		p += i == 1 ? w * h : cw * ch;
+		pic->img.plane[i] = p;
+		pic->img.i_stride[i] = cw;
+		for (y = 0; y < ch; y++)
+		{
+			int y0 = (2 * y) >> img->y_chroma_shift, y1 = img->y_chroma_shift ? y0 : MIN(y0 + 1, sh);
+			for (x = 0; x < cw; x++)
+			{
+				int x0 = (2 * x) >> img->x_chroma_shift, x1 = img->x_chroma_shift ? x0 : MIN(x0 + 1, sw);
+				p[y * cw + x] = (video_transcode_sample(img, i, x0, y0) + video_transcode_sample(img, i, x1, y0) +
+					video_transcode_sample(img, i, x0, y1) + video_transcode_sample(img, i, x1, y1) + 2) / 4;
+			}
+		}
+	}
+	return 0;
+}
+
+//decodes a frame and encodes all the pictures it results in: returns the CPU time it took
+static int64_t video_transcode_process(struct video_transcode_context_t* pcontext, struct video_transcode_frame_t* frame, int* produced)
+{
+	int64_t start = video_transcode_cpu_time();
+	vpx_codec_ctx_t* decoder = (vpx_codec_ctx_t*)pcontext->decoder;
+	if (vpx_codec_decode(decoder, frame->data, frame->len, NULL, 0) != VPX_CODEC_OK)
+	{
+		JANUS_LOG(LOG_WARN, "Error decoding video frame: %s\n", vpx_codec_error(decoder));
+		g_atomic_int_set(&pcontext->need_keyframe, 1);
+		return video_transcode_cpu_time() - start;
+	}
+	vpx_codec_iter_t iter = NULL;
+	vpx_image_t* img = NULL;
+	while ((img = vpx_codec_get_frame(decoder, &iter)) != NULL)
+	{
+		if (pcontext->encoder == NULL || (int)img->d_w != pcontext->width || (int)img->d_h != pcontext->height)
+		{
+			if (video_transcode_open_encoder(pcontext, img->d_w, img->d_h) < 0)
+				break;
+		}
+		x264_picture_t pic_in, pic_out;
+		x264_picture_init(&pic_in);
+		if (video_transcode_to_i420(pcontext, img, &pic_in) < 0)
+			continue;
+		pic_in.i_pts = frame->pts;
+		/* Keep the GOPs aligned with the source: a keyframe in means an IDR out */
+		pic_in.i_type = frame->keyframe ? X264_TYPE_IDR : X264_TYPE_AUTO;
+		x264_nal_t* nals = NULL;
+		int nal_count = 0;
+		int size = x264_encoder_encode((x264_t*)pcontext->encoder, &nals, &nal_count, &pic_in, &pic_out);
+		if (size < 0)
+		{
+			JANUS_LOG(LOG_WARN, "Error encoding H.264 frame\n");
+			continue;
+		}
+		if (size == 0)
+			continue;
+		/* With b_annexb the payloads of all NALs are contiguous and include start codes */
+		pcontext->cb(pcontext->cbdata, nals[0].p_payload, size, (uint32_t)pic_out.i_pts, pic_out.b_keyframe);
+		(*produced)++;
+	}
+	return video_transcode_cpu_time() - start;
+}
+
+static void video_transcode_worker(gpointer data, gpointer user_data)
+{
+	struct video_transcode_context_t* pcontext = (struct video_transcode_context_t*)data;
+	while (1)
+	{
+		janus_mutex_lock(&pcontext->mutex);
+		struct video_transcode_frame_t* frame = g_queue_pop_head(pcontext->frames);
+		if (frame == NULL || g_atomic_int_get(&pcontext->destroyed))
+		{
+			/* Done for now: the next frame that arrives will schedule us again */
+			pcontext->scheduled = 0;
+			janus_mutex_unlock(&pcontext->mutex);
+			g_free(frame);
+			break;
+		}
+		janus_mutex_unlock(&pcontext->mutex);
+		janus_mutex_lock(&pcontext->process_mutex);
+		if (!g_atomic_int_get(&pcontext->destroyed))
+		{
+			int produced = 0;
+			int64_t cpu = video_transcode_process(pcontext, frame, &produced);
+			janus_mutex_lock(&pcontext->mutex);
+			pcontext->cpu_time += cpu;
+			pcontext->frames_out += produced;
+			janus_mutex_unlock(&pcontext->mutex);
+		}
+		janus_mutex_unlock(&pcontext->process_mutex);
+		g_free(frame);
+	}
+	janus_refcount_decrease(&pcontext->ref);
+}
+
+int video_transcode_pool_init(int threads)
+{
+	if (transcode_pool != NULL)
+		return 0;
+	if (threads < 1)
+		threads = 1;
+	GError* error = NULL;
+	transcode_pool = g_thread_pool_new(video_transcode_worker, NULL, threads, FALSE, &error);
+	if (error != NULL)
+	{
+		JANUS_LOG(LOG_ERR, "Error creating the video transcoding pool: %s\n", error->message);
+		g_error_free(error);
+		transcode_pool = NULL;
+		return -1;
+	}
+	JANUS_LOG(LOG_INFO, "Video transcoding pool created (%d threads)\n", threads);
+	return 0;
+}
+
+void video_transcode_pool_deinit(void)
+{
+	if (transcode_pool != NULL)
+	{
+		g_thread_pool_free(transcode_pool, FALSE, TRUE);
+		transcode_pool = NULL;
+	}
+}
+
+struct video_transcode_context_t* video_transcode_init(const char* codec, const char* preset, int bitrate, video_transcode_cb cb, void* cbdata)
+{
+	if (codec == NULL || (strcasecmp(codec, "vp8") && strcasecmp(codec, "vp9")))
+	{
+		JANUS_LOG(LOG_ERR, "Unsupported codec for video transcoding: %s\n", codec ? codec : "(none)");
+		return NULL;
+	}
+	if (transcode_pool == NULL)
+	{
+		JANUS_LOG(LOG_ERR, "Video transcoding pool not initialized\n");
+		return NULL;
+	}
+	struct video_transcode_context_t* pcontext = g_malloc0(sizeof(struct video_transcode_context_t));
+	pcontext->vp9 = !strcasecmp(codec, "vp9");
+	pcontext->preset = g_strdup(preset ? preset : VIDEO_TRANSCODE_PRESET);
+	pcontext->bitrate = bitrate > 0 ? bitrate : VIDEO_TRANSCODE_BITRATE;
+	pcontext->cb = cb;
+	pcontext->cbdata = cbdata;
+	pcontext->frames = g_queue_new();
+	pcontext->waiting_keyframe = 1;
+	janus_mutex_init(&pcontext->mutex);
+	janus_mutex_init(&pcontext->process_mutex);
+	janus_refcount_init(&pcontext->ref, video_transcode_free);
+	/* The encoder is created when we know the resolution */
+	vpx_codec_ctx_t* decoder = calloc(1, sizeof(vpx_codec_ctx_t));
+	vpx_codec_dec_cfg_t cfg;
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.threads = 1;
+	if (decoder == NULL || vpx_codec_dec_init(decoder, pcontext->vp9 ? vpx_codec_vp9_dx() : vpx_codec_vp8_dx(), &cfg, 0) != VPX_CODEC_OK)
+	{
+		JANUS_LOG(LOG_ERR, "Error creating the %s decoder\n", pcontext->vp9 ? "VP9" : "VP8");
+		free(decoder);
+		janus_refcount_decrease(&pcontext->ref);
+		return NULL;
+	}
+	pcontext->decoder = decoder;
+	JANUS_LOG(LOG_INFO, "Video transcoder create success (%s -> H.264)\n", pcontext->vp9 ? "VP9" : "VP8");
+	return pcontext;
+}
+
+int video_transcode_input(struct video_transcode_context_t* pcontext, const unsigned char* pdata, int len, uint32_t timestamp)
+{
+	if (pcontext == NULL || pdata == NULL || len <= 0 || g_atomic_int_get(&pcontext->destroyed))
+		return -1;
+	vpx_codec_stream_info_t si;
+	memset(&si, 0, sizeof(si));
+	si.sz = sizeof(si);
+	vpx_codec_peek_stream_info(pcontext->vp9 ? vpx_codec_vp9_dx() : vpx_codec_vp8_dx(), pdata, len, &si);
+	janus_mutex_lock(&pcontext->mutex);
+	pcontext->frames_in++;
+	if (!si.is_kf && (pcontext->waiting_keyframe || (int)g_queue_get_length(pcontext->frames) >= VIDEO_TRANSCODE_MAX_PENDING))
+	{
+		/* Either we're behind, or we dropped something already: since frames depend
+		 * on the previous ones, drop everything until the next keyframe */
+		if (!pcontext->waiting_keyframe)
+		{
+			JANUS_LOG(LOG_WARN, "Video transcoder can't keep up, dropping frames until the next keyframe\n");
+			pcontext->waiting_keyframe = 1;
+		}
+		pcontext->frames_dropped++;
+		janus_mutex_unlock(&pcontext->mutex);
+		g_atomic_int_set(&pcontext->need_keyframe, 1);
+		return 0;
+	}
+	pcontext->waiting_keyframe = 0;
+	if (pcontext->pts == 0)
+		pcontext->pts = timestamp;
+	else
+		pcontext->pts += (int32_t)(timestamp - pcontext->last_timestamp);
+	pcontext->last_timestamp = timestamp;
+	struct video_transcode_frame_t* frame = g_malloc(sizeof(struct video_transcode_frame_t) + len);
+	frame->pts = pcontext->pts;
+	frame->keyframe = si.is_kf;
+	frame->len = len;
+	memcpy(frame->data, pdata, len);
+	g_queue_push_tail(pcontext->frames, frame);
+	if (!pcontext->scheduled)
+	{
+		/* Frames of the same context are processed in order by a single worker at a time */
+		pcontext->scheduled = 1;
+		janus_refcount_increase(&pcontext->ref);
+		g_thread_pool_push(transcode_pool, pcontext, NULL);
+	}
+	janus_mutex_unlock(&pcontext->mutex);
+	return 1;
+}
+
+int video_transcode_need_keyframe(struct video_transcode_context_t* pcontext)
+{
+	if (pcontext == NULL)
+		return 0;
+	return g_atomic_int_compare_and_exchange(&pcontext->need_keyframe, 1, 0);
+}
+
+void video_transcode_get_stats(struct video_transcode_context_t* pcontext, uint32_t* frames_in, uint32_t* frames_out, uint32_t* frames_dropped, uint64_t* cpu_time)
+{
+	if (pcontext == NULL)
+		return;
+	janus_mutex_lock(&pcontext->mutex);
+	*frames_in = pcontext->frames_in;
+	*frames_out = pcontext->frames_out;
+	*frames_dropped = pcontext->frames_dropped;
+	*cpu_time = pcontext->cpu_time;
+	janus_mutex_unlock(&pcontext->mutex);
+}
+
+void video_transcode_destory(struct video_transcode_context_t* pcontext)
+{
+	if (pcontext == NULL || !g_atomic_int_compare_and_exchange(&pcontext->destroyed, 0, 1))
+		return;
+	/* Wait for the frame being processed, if any */
+	janus_mutex_lock(&pcontext->process_mutex);
+	janus_mutex_unlock(&pcontext->process_mutex);
+	janus_refcount_decrease(&pcontext->ref);
+}
@@ -0,0 +1,78 @@
+#ifndef __VIDEO_TRANSCODE_H__
+#define __VIDEO_TRANSCODE_H__
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <glib.h>
+#include "mutex.h"
+#include "refcount.h"
+#include "debug.h"
+
+//VP8/VP9 -> H.264 software transcoding (libvpx decode, libx264 encode), run on a shared bounded worker pool
+
+//defaults
+#define VIDEO_TRANSCODE_PRESET		"veryfast"
+#define VIDEO_TRANSCODE_BITRATE		1500	//kbps, ceiling for the encoder
+#define VIDEO_TRANSCODE_GOP			250		//max frames between IDRs, if the source doesn't send keyframes more often
+#define VIDEO_TRANSCODE_MAX_PENDING	8		//frames we queue before assuming we're out of CPU
+
+//encoded frame callback: an Annex-B access unit, with the timestamp of the source frame
+typedef void(*video_transcode_cb)(void* param, const unsigned char* pdata, int len, uint32_t timestamp, int keyframe);
+
+struct video_transcode_context_t
+{
+	int                 vp9;
+	char*               preset;
+	int                 bitrate;
+	video_transcode_cb  cb;
+	void*               cbdata;
+
+	//libvpx/libx264 state, only touched by the worker currently processing this context
+	void*               decoder;
+	void*               encoder;
+	int                 width;
+	int                 height;
+	//8 bit 4:2:0 copy of the picture, when the decoder outputs something else (VP9 profiles 1-3)
+	unsigned char*      i420;
+	int                 i420_size;
+	unsigned int        i420_fmt;		//last source format converted, to only log changes
+
+	//frames waiting for a worker
+	GQueue*             frames;
+	int                 scheduled;
+	int                 waiting_keyframe;
+	int64_t             pts;
+	uint32_t            last_timestamp;
+	janus_mutex         mutex;
+	//held while a frame is processed, so that destroying the context waits for the callback to return
+	janus_mutex         process_mutex;
+	volatile gint       need_keyframe;
+	volatile gint       destroyed;
+
+	//statistics
+	uint32_t            frames_in;
+	uint32_t            frames_out;
+	uint32_t            frames_dropped;
+	uint64_t            cpu_time;		//us spent decoding and encoding, across all workers
+	janus_refcount      ref;
+};
+
+//the worker pool is shared by all contexts: threads is the maximum number of frames transcoded in parallel
+int  video_transcode_pool_init(int threads);
+void video_transcode_pool_deinit(void);
+
+struct video_transcode_context_t* video_transcode_init(const char* codec, const char* preset, int bitrate, video_transcode_cb cb, void* cbdata);
+
+//takes a whole VP8/VP9 frame; frames are dropped (until the next keyframe) when too many are waiting already
+int video_transcode_input(struct video_transcode_context_t* pcontext, const unsigned char* pdata, int len, uint32_t timestamp);
+
+//returns 1 (only once) if the source should be asked for a keyframe, e.g., because we dropped some frames
+int video_transcode_need_keyframe(struct video_transcode_context_t* pcontext);
+
+//fills the statistics in a consistent way
+void video_transcode_get_stats(struct video_transcode_context_t* pcontext, uint32_t* frames_in, uint32_t* frames_out, uint32_t* frames_dropped, uint64_t* cpu_time);
+
+//after this returns the callback won't be invoked anymore
+void video_transcode_destory(struct video_transcode_context_t* pcontext);
+
+#endif //__VIDEO_TRANSCODE_H__
@@ -0,0 +1,415 @@
+/*! \file    script-bench.c
+ * \copyright GNU General Public License v3
+ * \brief    Script callbacks throughput with one or more Lua/Duktape VMs
+ * \details  Simple benchmark of how many incomingRtp() callbacks the Lua
+ * or Duktape plugin can serve per second, depending on how many VMs
+ * (the 'vms' property in the plugin configuration) it's been asked to
+ * create. The plugin is loaded as the core does, with callbacks that
+ * drop everything, and initialized with a generated script that does
+ * nothing but count the packets it gets for each session (plus, if asked,
+ * a loop of arithmetic, to stand for what a real script would do with them:
+ * the payload isn't touched, since for Duktape an RTP packet, which starts
+ * with 0x80, looks like a Symbol rather than a string). A few threads then feed packets for a set of
+ * sessions to the plugin, as the threads of the PeerConnections would, for
+ * the requested time. Each VM count is tested in a separate process, since
+ * a plugin can't be initialized more than once, and in the end the counters
+ * in each script are checked against the packets we sent. Since sessions
+ * are bound to VMs randomly, with few sessions some VMs may get more of
+ * them than others, which is why we print the spread too.
+ *
+ * The plugin is opened with lazy binding, and never torn down (each run
+ * just exits when done): this way recordings, RTCP and SDP, which aren't
+ * involved here, don't need to be linked.
+ *
+ * Usage: script-bench -p plugin.so [-v vms[,vms...]] [-t threads] [-s sessions] [-d seconds] [-w iterations per callback] [-l packet length]
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "plugins/plugin.h"
+#include "rtp.h"
+#include "utils.h"
+
+/* No logging, as there's no log thread to print anything */
+int janus_log_level = 0;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+#define BENCH_MAX_RUNS		8
+
+/* The scripts we test, which implement the bare minimum and count packets: %d is the loop length per packet */
+static const char *bench_lua_script =
+	"calls = {}\n"
+	"function init(config) end\n"
+	"function destroy() end\n"
+	"function resumeScheduler() end\n"
+	"function createSession(id) calls[id] = 0 end\n"
+	"function destroySession(id) calls[id] = nil end\n"
+	"function querySession(id)\n"
+	"	local vm, vms = getVmInfo()\n"
+	"	return string.format('{\"calls\":%%d,\"vm\":%%d}', calls[id], vm)\n"
+	"end\n"
+	"function handleMessage(id, tr, msg, jsep) return -1, nil end\n"
+	"function setupMedia(id) end\n"
+	"function hangupMedia(id) end\n"
+	"function incomingRtp(id, video, data, len)\n"
+	"	local sum = 0\n"
+	"	for i = 1, %d do sum = sum + (i * 31) %% len end\n"
+	"	calls[id] = calls[id] + 1\n"
+	"end\n";
+static const char *bench_js_script =
+	"var calls = {};\n"
+	"function init(config) {}\n"
+	"function destroy() {}\n"
+	"function resumeScheduler() {}\n"
+	"function createSession(id) { calls[id] = 0; }\n"
+	"function destroySession(id) { delete calls[id]; }\n"
+	"function querySession(id) {\n"
+	"	return JSON.stringify({ calls: calls[id], vm: getVmInfo().index });\n"
+	"}\n"
+	"function handleMessage(id, tr, msg, jsep) { return -1; }\n"
+	"function setupMedia(id) {}\n"
+	"function hangupMedia(id) {}\n"
+	"function incomingRtp(id, video, data, len) {\n"
+	"	var sum = 0;\n"
+	"	for(var i = 1; i <= %d; i++) sum += (i * 31) %% len;\n"
+	"	calls[id]++;\n"
+	"}\n";
+
+/* Core callbacks: nothing the script does ends up here, but the plugin expects them to exist */
+static int bench_push_event(janus_plugin_session *handle, janus_plugin *plugin, const char *transaction, json_t *message, json_t *jsep) {
+	return 0;
+}
+static void bench_relay_rtp(janus_plugin_session *handle, int video, char *buf, int len) {
+}
+static void bench_relay_rtcp(janus_plugin_session *handle, int video, char *buf, int len) {
+}
+static void bench_relay_data(janus_plugin_session *handle, char *buf, int len) {
+}
+static void bench_close_pc(janus_plugin_session *handle) {
+}
+static void bench_end_session(janus_plugin_session *handle) {
+}
+static gboolean bench_events_is_enabled(void) {
+	return FALSE;
+}
+static void bench_notify_event(janus_plugin *plugin, janus_plugin_session *handle, json_t *event) {
+}
+static gboolean bench_auth_is_signature_valid(janus_plugin *plugin, const char *token) {
+	return FALSE;
+}
+static gboolean bench_auth_signature_contains(janus_plugin *plugin, const char *token, const char *descriptor) {
+	return FALSE;
+}
+static void bench_relay_rtp_info(janus_plugin_session *handle, int video, char *buf, int len, const struct janus_rtp_video_info *info) {
+}
+static janus_callbacks bench_callbacks =
+	{
+		.push_event = bench_push_event,
+		.relay_rtp = bench_relay_rtp,
+		.relay_rtcp = bench_relay_rtcp,
+		.relay_data = bench_relay_data,
+		.close_pc = bench_close_pc,
+		.end_session = bench_end_session,
+		.events_is_enabled = bench_events_is_enabled,
+		.notify_event = bench_notify_event,
+		.auth_is_signature_valid = bench_auth_is_signature_valid,
+		.auth_signature_contains = bench_auth_signature_contains,
+		.relay_rtp_info = bench_relay_rtp_info,
+	};
+
+static void bench_handle_free(const janus_refcount *handle_ref) {
+	/* The handles are ours, and freed all together at the end */
+}
+
+/* CPU time of the process, in microseconds */
+static gint64 bench_cpu(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (gint64)ts.tv_sec*G_USEC_PER_SEC + ts.tv_nsec/1000;
+}
+
+/* A thread feeding packets for some of the sessions */
+static volatile gint bench_started = 0, bench_stopping = 0;
+typedef struct bench_worker {
+	janus_plugin *plugin;
+	janus_plugin_session **handles;
+	guint count;
+	char *packet;
+	int len;
+	guint64 calls;
+} bench_worker;
+
+static void *bench_worker_thread(void *data) {
+	bench_worker *worker = (bench_worker *)data;
+	while(!g_atomic_int_get(&bench_started))
+		g_usleep(1000);
+	guint i = 0;
+	while(!g_atomic_int_get(&bench_stopping)) {
+		worker->plugin->incoming_rtp(worker->handles[i], 0, worker->packet, worker->len);
+		worker->calls++;
+		i++;
+		if(i == worker->count)
+			i = 0;
+	}
+	return NULL;
+}
+
+/* Initialize the plugin with the given number of VMs, and feed it packets: returns callbacks/sec, or -1.
+ * We never destroy the sessions or the plugin, since the process exits right after this */
+static double bench_run(janus_plugin *plugin, const char *folder, int vms, int threads, int sessions, int seconds, int len) {
+	if(plugin->init(&bench_callbacks, folder) < 0) {
+		printf("Error initializing the plugin\n");
+		return -1;
+	}
+	/* Create the sessions */
+	janus_plugin_session *handles = g_malloc0(sessions * sizeof(janus_plugin_session));
+	janus_plugin_session **list = g_malloc(sessions * sizeof(janus_plugin_session *));
+	int i = 0, error = 0;
+	for(i = 0; i < sessions; i++) {
+		janus_refcount_init(&handles[i].ref, bench_handle_free);
+		plugin->create_session(&handles[i], &error);
+		if(error != 0) {
+			printf("Error creating session #%d (%d)\n", i, error);
+			sessions = i;
+			break;
+		}
+	}
+	/* Each thread gets one every n sessions, and they all send the same packet */
+	char *packet = g_malloc0(len);
+	rtp_header *rtp = (rtp_header *)packet;
+	rtp->version = 2;
+	rtp->type = 111;
+	rtp->ssrc = htonl(1234);
+	bench_worker *workers = g_malloc0(threads * sizeof(bench_worker));
+	GThread **thread = g_malloc0(threads * sizeof(GThread *));
+	int *per_vm = g_malloc0(vms * sizeof(int));
+	double rate = -1;
+	if(error != 0)
+		goto done;
+	int t = 0, n = 0;
+	for(t = 0; t < threads; t++) {
+		workers[t].plugin = plugin;
+		workers[t].handles = list + n;
+		for(i = t; i < sessions; i += threads)
+			list[n++] = &handles[i];
+		workers[t].count = &list[n] - workers[t].handles;
+		workers[t].packet = packet;
+		workers[t].len = len;
+	}
+	g_atomic_int_set(&bench_started, 0);
+	g_atomic_int_set(&bench_stopping, 0);
+	for(i = 0; i < threads; i++)
+		thread[i] = g_thread_new("bench worker", bench_worker_thread, &workers[i]);
+	gint64 start = janus_get_monotonic_time(), start_cpu = bench_cpu();
+	g_atomic_int_set(&bench_started, 1);
+	g_usleep((gulong)seconds * G_USEC_PER_SEC);
+	g_atomic_int_set(&bench_stopping, 1);
+	guint64 calls = 0, min = G_MAXUINT64, max = 0;
+	for(i = 0; i < threads; i++) {
+		g_thread_join(thread[i]);
+		calls += workers[i].calls;
+		if(workers[i].calls < min)
+			min = workers[i].calls;
+		if(workers[i].calls > max)
+			max = workers[i].calls;
+	}
+	gint64 elapsed = janus_get_monotonic_time() - start, cpu = bench_cpu() - start_cpu;
+	/* Check what the scripts counted, and how the sessions were spread across VMs */
+	guint64 counted = 0;
+	for(i = 0; i < sessions; i++) {
+		json_t *info = plugin->query_session(&handles[i]);
+		json_t *c = info ? json_object_get(info, "calls") : NULL;
+		json_t *v = info ? json_object_get(info, "vm") : NULL;
+		if(!json_is_integer(c) || !json_is_integer(v) || json_integer_value(v) < 0 || json_integer_value(v) >= vms) {
+			printf("Invalid info for session #%d\n", i);
+			json_decref(info);
+			goto done;
+		}
+		counted += json_integer_value(c);
+		per_vm[json_integer_value(v)]++;
+		json_decref(info);
+	}
+	if(counted != calls) {
+		printf("The scripts counted %"SCNu64" callbacks, but we made %"SCNu64"\n", counted, calls);
+		goto done;
+	}
+	int least = sessions, most = 0;
+	for(i = 0; i < vms; i++) {
+		if(per_vm[i] < least)
+			least = per_vm[i];
+		if(per_vm[i] > most)
+			most = per_vm[i];
+	}
+	rate = calls * (double)G_USEC_PER_SEC / elapsed;
+	printf("%d VM(s): %.0f callbacks/sec, %.2f us each, %.2f cores busy (%d-%d sessions per VM, %"SCNu64"-%"SCNu64" callbacks per thread)\n",
+		vms, rate, cpu / (double)calls, cpu / (double)elapsed, least, most, min, max);
+
+done:
+	/* The plugin still has the handles, and we exit right after this anyway */
+	g_free(per_vm);
+	g_free(thread);
+	g_free(workers);
+	g_free(packet);
+	g_free(list);
+	return rate;
+}
+
+int main(int argc, char *argv[]) {
+	const char *path = NULL, *vms_list = "1,4";
+	int threads = 4, sessions = 64, seconds = 5, work = 0, len = 1200, opt = 0, ret = 1;
+
+	while((opt = getopt(argc, argv, "p:v:t:s:d:w:l:h")) != -1) {
+		switch(opt) {
+			case 'p':
+				path = optarg;
+				break;
+			case 'v':
+				vms_list = optarg;
+				break;
+			case 't':
+				threads = atoi(optarg);
+				break;
+			case 's':
+				sessions = atoi(optarg);
+				break;
+			case 'd':
+				seconds = atoi(optarg);
+				break;
+			case 'w':
+				work = atoi(optarg);
+				break;
+			case 'l':
+				len = atoi(optarg);
+				break;
+			default:
+				printf("Usage: %s -p plugin.so [-v vms[,vms...]] [-t threads] [-s sessions] [-d seconds] [-w iterations per callback] [-l packet length]\n", argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	int vms[BENCH_MAX_RUNS], runs = 0;
+	gchar **values = g_strsplit(vms_list, ",", -1);
+	while(values[runs] != NULL && runs < BENCH_MAX_RUNS) {
+		vms[runs] = atoi(values[runs]);
+		if(vms[runs] < 1)
+			break;
+		runs++;
+	}
+	gboolean valid = (values[runs] == NULL);
+	g_strfreev(values);
+	if(path == NULL || !valid || runs == 0 || threads < 1 || sessions < threads || seconds < 1 || work < 0 || len < 12) {
+		printf("Invalid arguments\n");
+		return 1;
+	}
+
+	/* Load the plugin as the core does, but with lazy binding */
+	void *library = dlopen(path, RTLD_LAZY | RTLD_GLOBAL);
+	if(!library) {
+		printf("Couldn't load %s: %s\n", path, dlerror());
+		return 1;
+	}
+	create_p *create = (create_p *)dlsym(library, "create");
+	janus_plugin *plugin = create ? create() : NULL;
+	if(plugin == NULL) {
+		printf("Couldn't create the plugin: %s\n", dlerror());
+		dlclose(library);
+		return 1;
+	}
+	const char *package = plugin->get_package();
+	gboolean lua = !strcmp(package, "janus.plugin.lua");
+	if(!lua && strcmp(package, "janus.plugin.duktape")) {
+		printf("Unsupported plugin %s (only janus.plugin.lua and janus.plugin.duktape are)\n", package);
+		dlclose(library);
+		return 1;
+	}
+	/* Write the script and its configuration somewhere */
+	GError *error = NULL;
+	char *folder = g_dir_make_tmp("script-bench-XXXXXX", &error);
+	if(folder == NULL) {
+		printf("Couldn't create a temporary folder: %s\n", error->message);
+		g_error_free(error);
+		dlclose(library);
+		return 1;
+	}
+	char *script = g_strdup_printf("%s/bench.%s", folder, lua ? "lua" : "js");
+	char *config = g_strdup_printf("%s/%s.cfg", folder, package);
+	char *code = g_strdup_printf(lua ? bench_lua_script : bench_js_script, work);
+	if(!g_file_set_contents(script, code, -1, &error)) {
+		printf("Couldn't write the script: %s\n", error->message);
+		g_error_free(error);
+		goto done;
+	}
+	printf("%s, %d threads, %d sessions, %d bytes packets, %d iterations per callback, %d seconds per run\n",
+		package, threads, sessions, len, work, seconds);
+
+	/* Each run in its own process, since plugins can only be initialized once */
+	double rates[BENCH_MAX_RUNS];
+	int i = 0;
+	for(i = 0; i < runs; i++) {
+		char *cfg = g_strdup_printf("[general]\nscript = %s\nvms = %d\n", script, vms[i]);
+		gboolean written = g_file_set_contents(config, cfg, -1, &error);
+		g_free(cfg);
+		if(!written) {
+			printf("Couldn't write the configuration: %s\n", error->message);
+			g_error_free(error);
+			goto done;
+		}
+		int fd[2];
+		if(pipe(fd) < 0) {
+			printf("Couldn't create a pipe\n");
+			goto done;
+		}
+		fflush(stdout);
+		pid_t pid = fork();
+		if(pid < 0) {
+			printf("Couldn't fork\n");
+			close(fd[0]);
+			close(fd[1]);
+			goto done;
+		} else if(pid == 0) {
+			close(fd[0]);
+			double rate = bench_run(plugin, folder, vms[i], threads, sessions, seconds, len);
+			fflush(stdout);
+			int res = (write(fd[1], &rate, sizeof(rate)) == sizeof(rate) && rate > 0) ? 0 : 1;
+			close(fd[1]);
+			_exit(res);
+		}
+		close(fd[1]);
+		int status = 0;
+		gboolean got = (read(fd[0], &rates[i], sizeof(rates[i])) == sizeof(rates[i]));
+		close(fd[0]);
+		waitpid(pid, &status, 0);
+		if(!got || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			printf("Run with %d VM(s) failed\n", vms[i]);
+			goto done;
+		}
+	}
+	if(runs > 1) {
+		for(i = 1; i < runs; i++)
+			printf("%d VM(s) vs. %d: %.2fx\n", vms[i], vms[0], rates[i] / rates[0]);
+	}
+	ret = 0;
+
+done:
+	unlink(config);
+	unlink(script);
+	rmdir(folder);
+	g_free(code);
+	g_free(config);
+	g_free(script);
+	g_free(folder);
+	dlclose(library);
+	return ret;
+}
@@ -0,0 +1,480 @@
+/*! \file    sctp-bench.c
+ * \copyright GNU General Public License v3
+ * \brief    DataChannel throughput and latency over a loopback association
+ * \details  Simple benchmark sending lots of small DataChannel messages
+ * between two SCTP associations in the same process, with DTLS in
+ * between, using the actual SCTP stack (sctp.c) and DTLS BIO (dtls-bio.c)
+ * of Janus: the SCTP packets the stack relays are encrypted in DTLS records,
+ * which the BIO sends (possibly coalesced) as datagrams on a "wire", while
+ * the datagrams coming from the other side are decrypted and passed to
+ * the SCTP stack there. The messages are sent at a fixed rate (or as fast as
+ * possible), and the receiving side takes note of how long each of them
+ * took to arrive. Two modes are compared: "immediate", where each message
+ * is sent right away in its own SCTP packet and each DTLS record in its own
+ * datagram (what Janus did before coalescing was there), and "coalesced",
+ * where messages are held for up to the coalescing delay and then sent in a
+ * burst, with Nagle enabled until the last one so that usrsctp bundles the
+ * chunks, and the resulting DTLS records are packed in as few datagrams as
+ * the MTU allows (what the ICE send loop does with sctp_coalesce_delay set).
+ * For each mode we print messages/sec, CPU time per message (usrsctp timer
+ * threads included), messages per DTLS record and per datagram (records
+ * are counted by parsing their headers in each datagram) and the latency
+ * percentiles.
+ *
+ * Usage: sctp-bench [-m immediate|coalesced] [-n messages] [-r rate] [-s size] [-d delay]
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+#include <usrsctp.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509.h>
+
+#include "ice.h"
+#include "dtls.h"
+#include "dtls-bio.h"
+#include "sctp.h"
+#include "mutex.h"
+#include "utils.h"
+
+/* No logging, as there's no log thread to print anything */
+int janus_log_level = 0;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+GHashTable *counters = NULL;
+janus_mutex counters_mutex;
+
+#define BENCH_MTU			1200	/* Same as the default dtls_mtu */
+#define BENCH_PENDING_MAX	64		/* Same as JANUS_ICE_PENDING_DATA_MAX */
+#define BENCH_PORT			5000
+#define BENCH_TIMEOUT		10		/* Seconds to wait for all messages to arrive */
+#define BENCH_RECORD_HEADER	13		/* DTLS record header, the length is in the last two bytes */
+
+/* Each side has the bits of a handle the SCTP stack and the DTLS BIO
+ * use: the agent is never used as such, it's only how the nice_agent_send
+ * below knows which side is sending */
+typedef struct bench_peer {
+	janus_ice_handle handle;
+	janus_ice_stream stream;
+	janus_ice_component component;
+	janus_dtls_srtp dtls;
+	janus_sctp_association *sctp;
+	struct bench_peer *remote;
+	/* SCTP packets usrsctp asked us to send, from any thread */
+	GQueue *outgoing;
+	/* Datagrams on their way to the remote peer */
+	GQueue *wire;
+	guint64 datagrams, records;
+	/* Messages received, with how long each of them took to get here */
+	GArray *latencies;
+} bench_peer;
+
+static janus_mutex bench_mutex = JANUS_MUTEX_INITIALIZER;
+
+static void bench_peer_unref(const janus_refcount *ref) {
+	/* The peers are on the stack, the SCTP stack only holds references */
+}
+
+/* The SCTP stack wants to send an SCTP packet: queue it, like the ICE
+ * send loop does, as usrsctp may call this from its own threads too */
+void janus_ice_relay_sctp(janus_ice_handle *handle, char *buffer, int length) {
+	bench_peer *peer = (bench_peer *)((char *)handle - G_STRUCT_OFFSET(bench_peer, handle));
+	janus_mutex_lock(&bench_mutex);
+	g_queue_push_tail(peer->outgoing, g_bytes_new(buffer, length));
+	janus_mutex_unlock(&bench_mutex);
+}
+
+/* The SCTP stack received a message */
+void janus_dtls_notify_data(janus_dtls_srtp *dtls, char *buf, int len) {
+	bench_peer *peer = (bench_peer *)((char *)dtls - G_STRUCT_OFFSET(bench_peer, dtls));
+	gint64 sent = 0, latency = 0;
+	if(buf == NULL || len < (int)sizeof(gint64))
+		return;
+	memcpy(&sent, buf, sizeof(sent));
+	latency = janus_get_monotonic_time() - sent;
+	janus_mutex_lock(&bench_mutex);
+	g_array_append_val(peer->latencies, latency);
+	janus_mutex_unlock(&bench_mutex);
+}
+
+/* The DTLS BIO sends a datagram, with one or more DTLS records in it:
+ * put it on the wire, counting the records it carries */
+gint nice_agent_send(NiceAgent *agent, guint stream_id, guint component_id, guint len, const gchar *buf) {
+	bench_peer *peer = (bench_peer *)agent;
+	const guint8 *record = (const guint8 *)buf;
+	guint offset = 0;
+	while(offset + BENCH_RECORD_HEADER <= len) {
+		offset += BENCH_RECORD_HEADER + ((record[offset+11] << 8) | record[offset+12]);
+		peer->records++;
+	}
+	g_queue_push_tail(peer->wire, g_bytes_new(buf, len));
+	peer->datagrams++;
+	return len;
+}
+
+/* Encrypt the SCTP packets usrsctp queued, as the ICE send loop does:
+ * when coalescing, the DTLS BIO is corked until the queue is drained */
+static void bench_send_outgoing(bench_peer *peer, gboolean cork) {
+	GBytes *packet = NULL;
+	gsize length = 0;
+	const void *data = NULL;
+	while(TRUE) {
+		janus_mutex_lock(&bench_mutex);
+		packet = g_queue_pop_head(peer->outgoing);
+		janus_mutex_unlock(&bench_mutex);
+		if(packet == NULL)
+			break;
+		if(cork)
+			janus_dtls_bio_agent_cork(&peer->dtls);
+		data = g_bytes_get_data(packet, &length);
+		SSL_write(peer->dtls.ssl, data, (int)length);
+		g_bytes_unref(packet);
+	}
+	janus_dtls_bio_agent_uncork(&peer->dtls);
+}
+
+/* Deliver the datagrams on the wire to the other side, decrypting them
+ * and passing what's inside to the SCTP stack there */
+static gboolean bench_deliver(bench_peer *peer) {
+	bench_peer *remote = peer->remote;
+	char buffer[4096];
+	GBytes *datagram = NULL;
+	gsize length = 0;
+	const void *data = NULL;
+	int read = 0;
+	gboolean delivered = FALSE;
+	while((datagram = g_queue_pop_head(peer->wire)) != NULL) {
+		data = g_bytes_get_data(datagram, &length);
+		BIO_write(remote->dtls.read_bio, data, (int)length);
+		g_bytes_unref(datagram);
+		delivered = TRUE;
+		if(!SSL_is_init_finished(remote->dtls.ssl)) {
+			SSL_do_handshake(remote->dtls.ssl);
+			continue;
+		}
+		while((read = SSL_read(remote->dtls.ssl, buffer, sizeof(buffer))) > 0)
+			janus_sctp_data_from_dtls(remote->sctp, buffer, read);
+	}
+	return delivered;
+}
+
+/* Move everything around until there's nothing left to send on either side */
+static void bench_pump(bench_peer *a, bench_peer *b, gboolean cork) {
+	gboolean busy = TRUE;
+	while(busy) {
+		bench_send_outgoing(a, cork);
+		bench_send_outgoing(b, cork);
+		busy = bench_deliver(a);
+		busy |= bench_deliver(b);
+	}
+}
+
+static EVP_PKEY *bench_key;
+static X509 *bench_cert;
+
+static int bench_certificate_create(void) {
+	EC_KEY *ecc = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	bench_key = EVP_PKEY_new();
+	bench_cert = X509_new();
+	if(ecc == NULL || bench_key == NULL || bench_cert == NULL || !EC_KEY_generate_key(ecc)) {
+		EC_KEY_free(ecc);
+		return -1;
+	}
+	EC_KEY_set_asn1_flag(ecc, OPENSSL_EC_NAMED_CURVE);
+	EVP_PKEY_assign_EC_KEY(bench_key, ecc);
+	X509_set_version(bench_cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(bench_cert), 1);
+	X509_gmtime_adj(X509_get_notBefore(bench_cert), -86400);
+	X509_gmtime_adj(X509_get_notAfter(bench_cert), 86400);
+	X509_set_pubkey(bench_cert, bench_key);
+	X509_NAME *name = X509_get_subject_name(bench_cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"sctp-bench", -1, -1, 0);
+	X509_set_issuer_name(bench_cert, name);
+	return X509_sign(bench_cert, bench_key, EVP_sha256()) > 0 ? 0 : -1;
+}
+
+/* Set up the DTLS stack the way janus_dtls_srtp_create does, writing to the DTLS BIO */
+static int bench_peer_init(bench_peer *peer, SSL_CTX *ctx, guint64 id, gboolean client) {
+	memset(peer, 0, sizeof(*peer));
+	peer->outgoing = g_queue_new();
+	peer->wire = g_queue_new();
+	peer->latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+	peer->handle.handle_id = id;
+	peer->handle.agent = (NiceAgent *)peer;
+	peer->handle.stream = &peer->stream;
+	janus_refcount_init(&peer->handle.ref, bench_peer_unref);
+	peer->stream.handle = &peer->handle;
+	peer->stream.component = &peer->component;
+	peer->component.stream = &peer->stream;
+	peer->component.dtls = &peer->dtls;
+	peer->dtls.component = &peer->component;
+	janus_refcount_init(&peer->dtls.ref, bench_peer_unref);
+	peer->dtls.ssl = SSL_new(ctx);
+	peer->dtls.read_bio = BIO_new(BIO_s_mem());
+	peer->dtls.write_bio = BIO_janus_dtls_agent_new(&peer->dtls);
+	if(peer->dtls.ssl == NULL || peer->dtls.read_bio == NULL || peer->dtls.write_bio == NULL)
+		return -1;
+	BIO_set_mem_eof_return(peer->dtls.read_bio, -1);
+	SSL_set_bio(peer->dtls.ssl, peer->dtls.read_bio, peer->dtls.write_bio);
+	if(client)
+		SSL_set_connect_state(peer->dtls.ssl);
+	else
+		SSL_set_accept_state(peer->dtls.ssl);
+	return 0;
+}
+
+static void bench_peer_destroy(bench_peer *peer) {
+	GBytes *bytes = NULL;
+	if(peer->outgoing == NULL)
+		return;
+	if(peer->sctp != NULL)
+		janus_sctp_association_destroy(peer->sctp);
+	peer->sctp = NULL;
+	if(peer->dtls.ssl != NULL)
+		SSL_free(peer->dtls.ssl);
+	g_free(peer->dtls.cork_buffer);
+	while((bytes = g_queue_pop_head(peer->outgoing)) != NULL)
+		g_bytes_unref(bytes);
+	while((bytes = g_queue_pop_head(peer->wire)) != NULL)
+		g_bytes_unref(bytes);
+	g_queue_free(peer->outgoing);
+	g_queue_free(peer->wire);
+	g_array_free(peer->latencies, TRUE);
+}
+
+static gboolean bench_established(bench_peer *peer) {
+	struct sctp_status status;
+	socklen_t len = (socklen_t)sizeof(status);
+	return usrsctp_getsockopt(peer->sctp->sock, IPPROTO_SCTP, SCTP_STATUS, &status, &len) == 0 &&
+		status.sstat_state == SCTP_ESTABLISHED;
+}
+
+/* Send a message, the same way janus_dtls_wrap_sctp_data does */
+static void bench_send(bench_peer *sender, char *message, int size, gboolean more) {
+	gint64 now = janus_get_monotonic_time();
+	memcpy(message, &now, sizeof(now));
+	janus_sctp_send_data(sender->sctp, message, size, more);
+}
+
+static int bench_compare(const void *a, const void *b) {
+	gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+	return (x > y) - (x < y);
+}
+
+static double bench_cpu(void) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+		(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static int bench_run(SSL_CTX *ctx, gboolean coalesce, int messages, int rate, int size, int delay) {
+	bench_peer sender, receiver;
+	char *message = g_malloc0(size);
+	gint64 start = 0, now = 0, deadline = 0, elapsed = 0, *latencies = NULL;
+	double cpu = 0;
+	int sent = 0, held = 0, due = 0, received = 0, ret = -1;
+	guint64 datagrams = 0, records = 0;
+
+	memset(&sender, 0, sizeof(sender));
+	memset(&receiver, 0, sizeof(receiver));
+	if(bench_peer_init(&sender, ctx, 1, TRUE) < 0 || bench_peer_init(&receiver, ctx, 2, FALSE) < 0) {
+		printf("Error creating the DTLS contexts\n");
+		goto done;
+	}
+	sender.remote = &receiver;
+	receiver.remote = &sender;
+	/* DTLS handshake first, then the SCTP association */
+	SSL_do_handshake(sender.dtls.ssl);
+	bench_pump(&sender, &receiver, FALSE);
+	if(!SSL_is_init_finished(sender.dtls.ssl) || !SSL_is_init_finished(receiver.dtls.ssl)) {
+		printf("DTLS handshake failed\n");
+		goto done;
+	}
+	sender.sctp = janus_sctp_association_create(&sender.dtls, &sender.handle, BENCH_PORT);
+	receiver.sctp = janus_sctp_association_create(&receiver.dtls, &receiver.handle, BENCH_PORT);
+	if(sender.sctp == NULL || receiver.sctp == NULL) {
+		printf("Error creating the SCTP associations (%d)\n", errno);
+		goto done;
+	}
+	/* The receiver plays the browser, and opens the channel once connected:
+	 * the sender (Janus) can use it as soon as it got the request */
+	start = janus_get_monotonic_time();
+	while(!bench_established(&receiver)) {
+		bench_pump(&sender, &receiver, FALSE);
+		if(janus_get_monotonic_time() - start > BENCH_TIMEOUT*G_USEC_PER_SEC) {
+			printf("SCTP association not established\n");
+			goto done;
+		}
+		g_usleep(1000);
+	}
+	if(janus_sctp_open_channel(receiver.sctp, 0, SCTP_PR_SCTP_NONE, 0) < 0) {
+		printf("Error opening the DataChannel\n");
+		goto done;
+	}
+	while(receiver.sctp->channels[0].state != DATA_CHANNEL_OPEN) {
+		bench_pump(&sender, &receiver, FALSE);
+		if(janus_get_monotonic_time() - start > BENCH_TIMEOUT*G_USEC_PER_SEC) {
+			printf("DataChannel not open\n");
+			goto done;
+		}
+		g_usleep(1000);
+	}
+	datagrams = sender.datagrams;
+	records = sender.records;
+
+	cpu = bench_cpu();
+	start = janus_get_monotonic_time();
+	while(sent < messages) {
+		now = janus_get_monotonic_time();
+		due = rate > 0 ? MIN(messages, (int)((now - start) * rate / G_USEC_PER_SEC) + 1) : messages;
+		if(sent + held >= due) {
+			/* Nothing new to send yet, but if we're holding messages they may be due */
+			if(held > 0 && now >= deadline) {
+				while(held > 0) {
+					held--;
+					bench_send(&sender, message, size, held > 0);
+					sent++;
+				}
+				bench_pump(&sender, &receiver, coalesce);
+			} else {
+				bench_pump(&sender, &receiver, coalesce);
+				g_usleep(100);
+			}
+			continue;
+		}
+		if(!coalesce) {
+			bench_send(&sender, message, size, FALSE);
+			sent++;
+			bench_pump(&sender, &receiver, FALSE);
+			continue;
+		}
+		/* Hold the message, as janus_ice_outgoing_traffic_handle does */
+		if(held == 0)
+			deadline = now + (gint64)delay*1000;
+		held++;
+		if(held >= BENCH_PENDING_MAX || now >= deadline) {
+			while(held > 0) {
+				held--;
+				bench_send(&sender, message, size, held > 0);
+				sent++;
+			}
+			bench_pump(&sender, &receiver, TRUE);
+		}
+	}
+	/* Wait for the last ones (and the last SACKs) */
+	while(TRUE) {
+		bench_pump(&sender, &receiver, coalesce);
+		janus_mutex_lock(&bench_mutex);
+		received = receiver.latencies->len;
+		janus_mutex_unlock(&bench_mutex);
+		if(received >= messages || janus_get_monotonic_time() - start > (gint64)(messages / MAX(rate, 1) + BENCH_TIMEOUT)*G_USEC_PER_SEC)
+			break;
+		g_usleep(100);
+	}
+	elapsed = janus_get_monotonic_time() - start;
+	cpu = bench_cpu() - cpu;
+	if(received < messages) {
+		printf("Only %d of %d messages received\n", received, messages);
+		goto done;
+	}
+	datagrams = sender.datagrams - datagrams;
+	records = sender.records - records;
+
+	janus_mutex_lock(&bench_mutex);
+	latencies = (gint64 *)receiver.latencies->data;
+	qsort(latencies, received, sizeof(gint64), bench_compare);
+	printf("%-9s %7d msgs of %4d bytes: %9.0f msgs/s, %6.2f us CPU/msg, %5.2f msgs/record, %5.2f msgs/datagram,"
+		" latency p50 %6.2f ms, p90 %6.2f ms, p99 %6.2f ms, max %6.2f ms\n",
+		coalesce ? "coalesced" : "immediate", received, size,
+		received * (double)G_USEC_PER_SEC / elapsed, cpu * 1e6 / received,
+		received / (double)MAX(records, 1), received / (double)MAX(datagrams, 1),
+		latencies[received/2] / 1000.0, latencies[received*9/10] / 1000.0,
+		latencies[received*99/100] / 1000.0, latencies[received-1] / 1000.0);
+	janus_mutex_unlock(&bench_mutex);
+	ret = 0;
+
+done:
+	bench_peer_destroy(&sender);
+	bench_peer_destroy(&receiver);
+	g_free(message);
+	return ret;
+}
+
+int main(int argc, char *argv[]) {
+	const char *mode = NULL;
+	int messages = 100000, rate = 20000, size = 64, delay = 5, opt = 0, ret = 0;
+	SSL_CTX *ctx = NULL;
+
+	while((opt = getopt(argc, argv, "m:n:r:s:d:h")) != -1) {
+		switch(opt) {
+			case 'm':
+				mode = optarg;
+				break;
+			case 'n':
+				messages = atoi(optarg);
+				break;
+			case 'r':
+				rate = atoi(optarg);
+				break;
+			case 's':
+				size = atoi(optarg);
+				break;
+			case 'd':
+				delay = atoi(optarg);
+				break;
+			default:
+				printf("Usage: %s [-m immediate|coalesced] [-n messages] [-r rate (0=as fast as possible)] [-s size] [-d delay (ms)]\n", argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	if(messages < 1 || rate < 0 || size < (int)sizeof(gint64) || delay < 1 ||
+			(mode && strcasecmp(mode, "immediate") && strcasecmp(mode, "coalesced"))) {
+		printf("Invalid arguments\n");
+		return 1;
+	}
+
+	SSL_library_init();
+	SSL_load_error_strings();
+	ctx = SSL_CTX_new(DTLS_method());
+	if(ctx == NULL || bench_certificate_create() < 0 ||
+			!SSL_CTX_use_certificate(ctx, bench_cert) || !SSL_CTX_use_PrivateKey(ctx, bench_key)) {
+		printf("Error creating the DTLS certificate\n");
+		return 1;
+	}
+	SSL_CTX_set_read_ahead(ctx, 1);
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+	janus_dtls_bio_agent_init();
+	janus_dtls_bio_agent_set_mtu(BENCH_MTU);
+	janus_sctp_init();
+
+	char pace[32];
+	if(rate > 0)
+		g_snprintf(pace, sizeof(pace), "%d msgs/s", rate);
+	else
+		g_snprintf(pace, sizeof(pace), "as fast as possible");
+	printf("%d messages at %s, coalescing delay %d ms, MTU %d\n", messages, pace, delay, BENCH_MTU);
+	if(mode == NULL || !strcasecmp(mode, "immediate"))
+		ret |= bench_run(ctx, FALSE, messages, rate, size, delay);
+	if(mode == NULL || !strcasecmp(mode, "coalesced"))
+		ret |= bench_run(ctx, TRUE, messages, rate, size, delay);
+
+	while(usrsctp_finish() != 0)
+		g_usleep(100000);
+	SSL_CTX_free(ctx);
+	X509_free(bench_cert);
+	EVP_PKEY_free(bench_key);
+	return ret ? 1 : 0;
+}
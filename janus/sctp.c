@@ -88,6 +88,10 @@ void janus_sctp_handle_send_failed_event(struct sctp_send_failed_event *ssfe);
 void janus_sctp_handle_notification(janus_sctp_association *sctp, union sctp_notification *notif, size_t n);
 
 static gboolean sctp_running;
+/* Socket buffer sizes to configure on new associations (0 means usrsctp defaults) */
+static int sctp_sndbuf = 0, sctp_rcvbuf = 0;
+/* How long (ms) outgoing messages can be held to coalesce them, 0 disables it */
+static guint sctp_coalesce_delay = 0;
 int janus_sctp_init(void) {
 	/* Initialize the SCTP stack */
 	usrsctp_init(0, janus_sctp_data_to_dtls, NULL);
@@ -107,6 +111,25 @@ void janus_sctp_deinit(void) {
 	sctp_running = FALSE;
 }
 
+void janus_sctp_set_buffer_sizes(int sndbuf, int rcvbuf) {
+	if(sndbuf < 0 || rcvbuf < 0) {
+		JANUS_LOG(LOG_ERR, "Invalid SCTP buffer sizes...\n");
+		return;
+	}
+	sctp_sndbuf = sndbuf;
+	sctp_rcvbuf = rcvbuf;
+	JANUS_LOG(LOG_VERB, "Setting SCTP buffer sizes: send=%d, receive=%d\n", sctp_sndbuf, sctp_rcvbuf);
+}
+
+void janus_sctp_set_coalesce_delay(guint delay) {
+	sctp_coalesce_delay = delay;
+	JANUS_LOG(LOG_VERB, "Setting SCTP coalescing delay: %ums\n", sctp_coalesce_delay);
+}
+
+guint janus_sctp_get_coalesce_delay(void) {
+	return sctp_coalesce_delay;
+}
+
 static void janus_sctp_association_free(const janus_refcount *sctp_ref) {
 	janus_sctp_association *sctp = janus_refcount_containerof(sctp_ref, janus_sctp_association, ref);
 	/* This association can be destroyed, free all the resources */
@@ -210,6 +233,13 @@ janus_sctp_association *janus_sctp_association_create(janus_dtls_srtp *dtls, jan
 		janus_refcount_decrease(&sctp->ref);
 		return NULL;
 	}	
+	/* Set custom buffer sizes, if configured (not fatal if this fails) */
+	if(sctp_sndbuf > 0 && usrsctp_setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sctp_sndbuf, sizeof(sctp_sndbuf)) < 0) {
+		JANUS_LOG(LOG_WARN, "[%"SCNu64"] setsockopt error: SO_SNDBUF (%d)\n", sctp->handle_id, errno);
+	}
+	if(sctp_rcvbuf > 0 && usrsctp_setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &sctp_rcvbuf, sizeof(sctp_rcvbuf)) < 0) {
+		JANUS_LOG(LOG_WARN, "[%"SCNu64"] setsockopt error: SO_RCVBUF (%d)\n", sctp->handle_id, errno);
+	}
 	/* Enable the events of interest */
 	struct sctp_event event;
 	memset(&event, 0, sizeof(event));
@@ -334,9 +364,21 @@ static int janus_sctp_incoming_data(struct socket *sock, union sctp_sockstore ad
 	return 1;
 }
 
-void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len) {
+void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len, gboolean more) {
 	if(sctp == NULL || buf == NULL || len <= 0)
 		return;
+	/* If more messages are about to follow, we enable Nagle so that usrsctp
+	 * queues the chunks instead of sending each of them in its own packet:
+	 * when the last message comes, disabling Nagle again flushes the queue,
+	 * bundling as many chunks as possible in the same SCTP packet */
+	if(more != sctp->corked) {
+		uint32_t nodelay = more ? 0 : 1;
+		if(usrsctp_setsockopt(sctp->sock, IPPROTO_SCTP, SCTP_NODELAY, &nodelay, sizeof(nodelay)) < 0) {
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] setsockopt error: SCTP_NODELAY (%d)\n", sctp->handle_id, errno);
+		} else {
+			sctp->corked = more;
+		}
+	}
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] SCTP data to send (%d bytes) coming from a plugin.\n",
 		  sctp->handle_id, len);
 	JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Outgoing SCTP contents: %.*s\n",
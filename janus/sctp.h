@@ -54,6 +54,19 @@ int janus_sctp_init(void);
 /*! \brief SCTP stuff de-initialization */
 void janus_sctp_deinit(void);
 
+/*! \brief Set the usrsctp socket buffer sizes to use for new associations
+ * @param[in] sndbuf Size of the send buffer in bytes (0 means the usrsctp default)
+ * @param[in] rcvbuf Size of the receive buffer in bytes (0 means the usrsctp default) */
+void janus_sctp_set_buffer_sizes(int sndbuf, int rcvbuf);
+
+/*! \brief Set how long outgoing DataChannel messages can be held to coalesce them
+ * @param[in] delay The delay budget in milliseconds (0 disables coalescing) */
+void janus_sctp_set_coalesce_delay(guint delay);
+
+/*! \brief Get the current delay budget for coalescing outgoing DataChannel messages
+ * @returns The delay budget in milliseconds (0 if coalescing is disabled) */
+guint janus_sctp_get_coalesce_delay(void);
+
 
 #define BUFFER_SIZE (1<<16)
 #define NUMBER_OF_CHANNELS (100)
@@ -121,6 +134,8 @@ typedef struct janus_sctp_association {
 	size_t buflen;
 	/*! \brief Current offset of the buffer for handling partial messages */
 	size_t offset;
+	/*! \brief Whether Nagle is temporarily enabled because more messages are coming */
+	gboolean corked;
 #ifdef DEBUG_SCTP
 	FILE *debug_dump;
 #endif
@@ -198,11 +213,26 @@ void janus_sctp_association_destroy(janus_sctp_association *sctp);
  * \param[in] len The buffer length */
 void janus_sctp_data_from_dtls(janus_sctp_association *sctp, char *buf, int len);
 
+/*! \brief Open a new DataChannel, as a browser would
+ * \note Janus doesn't use this itself, as it's always the browser opening
+ * channels: sctp-bench uses it to play the browser side of an association
+ * \param[in] sctp The SCTP association to open the channel on
+ * \param[in] unordered Whether the channel should be unordered
+ * \param[in] pr_policy The PR-SCTP policy (http://tools.ietf.org/html/rfc6458)
+ * \param[in] pr_value The value of the PR-SCTP policy
+ * \returns 0 if successful, a negative integer otherwise */
+int janus_sctp_open_channel(janus_sctp_association *sctp, uint8_t unordered, uint16_t pr_policy, uint32_t pr_value);
+
 /*! \brief Method to send data via SCTP to the peer
+ * \note Passing \c more as TRUE lets the SCTP stack hold the message until
+ * one with \c more as FALSE is sent, so that small messages can be bundled
+ * in the same SCTP packet: the last message of a burst must always be
+ * sent with \c more set to FALSE, or the others may be delayed
  * \param[in] sctp The SCTP association this data is from
  * \param[in] buf The data buffer
- * \param[in] len The buffer length */
-void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len);
+ * \param[in] len The buffer length
+ * \param[in] more Whether more messages will immediately follow this one */
+void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len, gboolean more);
 
 #endif
 
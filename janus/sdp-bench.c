@@ -0,0 +1,336 @@
+/*! \file    sdp-bench.c
+ * \copyright GNU General Public License v3
+ * \brief    SDP parse and serialize throughput
+ * \details  Simple benchmark timing janus_sdp_parse and janus_sdp_write
+ * on the kind of SDPs that get expensive during mass joins: bundled
+ * offers with many m-lines, simulcast attributes and lots of candidates,
+ * synthesized here with as many m-lines and candidates as asked for. It
+ * can also go through the files in a directory instead, e.g. the SDP
+ * fuzzing corpus in fuzzers/corpora/sdp. For each SDP we print how long
+ * a parse and a write take, and the resulting MB/s, after checking that
+ * writing the parsed SDP and parsing it again gives the same SDP back.
+ * With -z, each SDP is then also randomly mutated (bytes flipped, lines
+ * truncated, duplicated or dropped) that many times and fed to the parser
+ * and, when it's accepted, to the serializer: run under valgrind or with
+ * AddressSanitizer, this is a quick way to check the corpus without the
+ * libFuzzer target in fuzzers/sdp_fuzzer.c.
+ *
+ * Usage: sdp-bench [-m mlines] [-c candidates] [-d directory] [-n iterations] [-z mutations]
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "sdp-utils.h"
+#include "utils.h"
+
+/* No logging, as there's no log thread to print anything */
+int janus_log_level = 0;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+#define BENCH_ITERATIONS	2000	/* Parses and writes per SDP */
+#define BENCH_MAX_SIZE		(1024*1024)	/* Larger files in the directory are skipped */
+#define BENCH_VIDEO_PTS		24		/* Video payload types, as many as Chrome offers */
+
+/* An offer like the ones browsers send: audio, simulcast video, and then data */
+static char *bench_sdp_create(int mlines, int candidates) {
+	GString *sdp = g_string_sized_new(4096);
+	g_string_append(sdp,
+		"v=0\r\n"
+		"o=- 4611731400430051336 2 IN IP4 127.0.0.1\r\n"
+		"s=-\r\n"
+		"t=0 0\r\n"
+		"a=group:BUNDLE");
+	int i = 0, c = 0;
+	for(i=0; i<mlines; i++)
+		g_string_append_printf(sdp, " %d", i);
+	g_string_append(sdp, "\r\na=extmap-allow-mixed\r\na=msid-semantic: WMS stream\r\n");
+	for(i=0; i<mlines; i++) {
+		if(i == mlines-1 && mlines > 2) {
+			g_string_append(sdp,
+				"m=application 9 UDP/DTLS/SCTP webrtc-datachannel\r\n"
+				"c=IN IP4 0.0.0.0\r\n");
+		} else if(i % 2 == 0) {
+			g_string_append(sdp,
+				"m=audio 9 UDP/TLS/RTP/SAVPF 111 63 103 104 9 0 8 106 105 13 110 112 113 126\r\n"
+				"c=IN IP4 0.0.0.0\r\n"
+				"a=rtcp:9 IN IP4 0.0.0.0\r\n");
+		} else {
+			g_string_append(sdp, "m=video 9 UDP/TLS/RTP/SAVPF");
+			for(c=0; c<BENCH_VIDEO_PTS; c++)
+				g_string_append_printf(sdp, " %d", 96 + c);
+			g_string_append(sdp,
+				"\r\n"
+				"c=IN IP4 0.0.0.0\r\n"
+				"a=rtcp:9 IN IP4 0.0.0.0\r\n");
+		}
+		for(c=0; c<candidates; c++) {
+			g_string_append_printf(sdp,
+				"a=candidate:%u %d %s %u 192.168.%d.%d %d typ %s generation 0 network-id %d network-cost 10\r\n",
+				1000000000u + c, 1, c % 3 == 2 ? "tcp" : "udp", 2122260223u - c * 256,
+				c / 250, c % 250 + 1, 50000 + c, c % 4 == 3 ? "srflx raddr 0.0.0.0 rport 0" : "host", c % 4 + 1);
+		}
+		g_string_append_printf(sdp,
+			"a=ice-ufrag:kmX/\r\n"
+			"a=ice-pwd:HkTAnOJqdV0+0WvC7jLxeo6E\r\n"
+			"a=ice-options:trickle\r\n"
+			"a=fingerprint:sha-256 8E:11:9C:B4:2F:CE:71:0B:74:A0:4B:70:0C:B0:4D:CA:24:9C:A2:AD:5C:C1:D4:11:5F:93:D8:29:2A:E6:5B:0A\r\n"
+			"a=setup:actpass\r\n"
+			"a=mid:%d\r\n", i);
+		if(i == mlines-1 && mlines > 2) {
+			g_string_append(sdp, "a=sctp-port:5000\r\na=max-message-size:262144\r\n");
+			continue;
+		}
+		g_string_append(sdp,
+			"a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+			"a=extmap:2 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n"
+			"a=extmap:3 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+			"a=extmap:4 urn:ietf:params:rtp-hdrext:sdes:mid\r\n"
+			"a=extmap:10 urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id\r\n"
+			"a=extmap:11 urn:ietf:params:rtp-hdrext:sdes:repaired-rtp-stream-id\r\n"
+			"a=sendrecv\r\n"
+			"a=msid:stream track\r\n"
+			"a=rtcp-mux\r\n");
+		if(i % 2 == 0) {
+			g_string_append(sdp,
+				"a=rtpmap:111 opus/48000/2\r\n"
+				"a=rtcp-fb:111 transport-cc\r\n"
+				"a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+				"a=rtpmap:63 red/48000/2\r\n"
+				"a=fmtp:63 111/111\r\n"
+				"a=rtpmap:103 ISAC/16000\r\n"
+				"a=rtpmap:104 ISAC/32000\r\n"
+				"a=rtpmap:9 G722/8000\r\n"
+				"a=rtpmap:0 PCMU/8000\r\n"
+				"a=rtpmap:8 PCMA/8000\r\n"
+				"a=rtpmap:106 CN/32000\r\n"
+				"a=rtpmap:105 CN/16000\r\n"
+				"a=rtpmap:13 CN/8000\r\n"
+				"a=rtpmap:110 telephone-event/48000\r\n"
+				"a=rtpmap:112 telephone-event/32000\r\n"
+				"a=rtpmap:113 telephone-event/16000\r\n"
+				"a=rtpmap:126 telephone-event/8000\r\n"
+				"a=ssrc:3307416283 cname:bWcZUMgCIxjhcZ8W\r\n");
+			continue;
+		}
+		static const char *codecs[] = { "VP8", "VP9", "H264", "AV1", "H265" };
+		int pt = 0;
+		for(pt=0; pt<BENCH_VIDEO_PTS; pt++) {
+			/* Each codec (and profile) comes with its rtx payload type */
+			int num = 96 + pt;
+			if(pt % 2 == 1) {
+				g_string_append_printf(sdp, "a=rtpmap:%d rtx/90000\r\na=fmtp:%d apt=%d\r\n", num, num, num - 1);
+				continue;
+			}
+			g_string_append_printf(sdp,
+				"a=rtpmap:%d %s/90000\r\n"
+				"a=rtcp-fb:%d goog-remb\r\n"
+				"a=rtcp-fb:%d transport-cc\r\n"
+				"a=rtcp-fb:%d ccm fir\r\n"
+				"a=rtcp-fb:%d nack\r\n"
+				"a=rtcp-fb:%d nack pli\r\n",
+				num, codecs[(pt/2) % 5], num, num, num, num, num);
+			if((pt/2) % 5 == 2)
+				g_string_append_printf(sdp, "a=fmtp:%d level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42e01f\r\n", num);
+		}
+		g_string_append(sdp,
+			"a=rid:q send\r\n"
+			"a=rid:h send\r\n"
+			"a=rid:f send\r\n"
+			"a=simulcast:send q;h;f\r\n");
+	}
+	return g_string_free(sdp, FALSE);
+}
+
+/* Random damage: a byte changed, a line cut short, repeated or removed */
+static char *bench_sdp_mutate(const char *sdp) {
+	size_t len = strlen(sdp);
+	GString *mutated = g_string_new(sdp);
+	int i = 0, count = 1 + rand() % 4;
+	for(i=0; i<count && mutated->len > 0; i++) {
+		size_t pos = rand() % mutated->len;
+		char *eol = strchr(mutated->str + pos, '\n');
+		size_t end = eol ? (size_t)(eol - mutated->str) + 1 : mutated->len;
+		switch(rand() % 5) {
+			case 0:
+				mutated->str[pos] = (char)(1 + rand() % 255);
+				break;
+			case 1:
+				g_string_erase(mutated, pos, end - pos - (eol ? 1 : 0));
+				break;
+			case 2:
+				g_string_insert_len(mutated, end, mutated->str + pos, end - pos);
+				break;
+			case 3:
+				g_string_erase(mutated, pos, end - pos);
+				break;
+			default:
+				g_string_insert_c(mutated, pos, "=: /\r\n0"[rand() % 7]);
+				break;
+		}
+	}
+	if(mutated->len == 0 && len > 0)
+		g_string_append_c(mutated, sdp[0]);
+	return g_string_free(mutated, FALSE);
+}
+
+static double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_sdp(const char *name, const char *sdp, int iterations, int mutations) {
+	char error[512];
+	error[0] = '\0';
+	janus_sdp *parsed = janus_sdp_parse(sdp, error, sizeof(error));
+	if(parsed == NULL) {
+		/* Part of the corpus is made of invalid SDPs, on purpose */
+		printf("%-24s rejected (%s)\n", name, error);
+	} else {
+		/* Make sure we get the same thing back, once normalized */
+		char *written = janus_sdp_write(parsed);
+		janus_sdp *reparsed = written ? janus_sdp_parse(written, error, sizeof(error)) : NULL;
+		char *rewritten = reparsed ? janus_sdp_write(reparsed) : NULL;
+		if(written == NULL || rewritten == NULL || strcmp(written, rewritten)) {
+			printf("%-24s written SDP doesn't parse back the same: %s\n", name, reparsed ? "differs" : error);
+			g_free(written);
+			g_free(rewritten);
+			janus_sdp_destroy(reparsed);
+			janus_sdp_destroy(parsed);
+			return -1;
+		}
+		g_free(rewritten);
+		janus_sdp_destroy(reparsed);
+		size_t size = strlen(sdp), wsize = strlen(written);
+		g_free(written);
+		int i = 0, lines = 0;
+		const char *p = sdp;
+		while((p = strchr(p, '\n')) != NULL) {
+			lines++;
+			p++;
+		}
+		double start = bench_now();
+		for(i=0; i<iterations; i++)
+			janus_sdp_destroy(janus_sdp_parse(sdp, NULL, 0));
+		double parse = (bench_now() - start) / iterations;
+		start = bench_now();
+		for(i=0; i<iterations; i++)
+			g_free(janus_sdp_write(parsed));
+		double write = (bench_now() - start) / iterations;
+		printf("%-24s %7zu bytes, %5d lines: parse %8.2f us (%7.1f MB/s), write %8.2f us (%7.1f MB/s)\n",
+			name, size, lines, parse * 1e6, size / parse / 1e6, write * 1e6, wsize / write / 1e6);
+		janus_sdp_destroy(parsed);
+	}
+	if(mutations > 0) {
+		int i = 0, accepted = 0;
+		for(i=0; i<mutations; i++) {
+			char *mutated = bench_sdp_mutate(sdp);
+			janus_sdp *fuzzed = janus_sdp_parse(mutated, error, sizeof(error));
+			if(fuzzed != NULL) {
+				accepted++;
+				g_free(janus_sdp_write(fuzzed));
+				janus_sdp_destroy(fuzzed);
+			}
+			g_free(mutated);
+		}
+		printf("%-24s %d mutations, %d accepted\n", name, mutations, accepted);
+	}
+	return 0;
+}
+
+static char *bench_file_load(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if(file == NULL)
+		return NULL;
+	char *data = g_malloc(BENCH_MAX_SIZE + 1);
+	size_t size = fread(data, 1, BENCH_MAX_SIZE + 1, file);
+	fclose(file);
+	if(size == 0 || size > BENCH_MAX_SIZE) {
+		g_free(data);
+		return NULL;
+	}
+	/* The parser works on strings: like the core, stop at the first nul */
+	data[size] = '\0';
+	return data;
+}
+
+int main(int argc, char *argv[]) {
+	int mlines = 3, candidates = 20, iterations = BENCH_ITERATIONS, mutations = 0, opt = 0, res = 0;
+	const char *directory = NULL;
+	while((opt = getopt(argc, argv, "m:c:d:n:z:h")) != -1) {
+		switch(opt) {
+			case 'm':
+				mlines = atoi(optarg);
+				break;
+			case 'c':
+				candidates = atoi(optarg);
+				break;
+			case 'd':
+				directory = optarg;
+				break;
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+			case 'z':
+				mutations = atoi(optarg);
+				break;
+			default:
+				printf("Usage: %s [-m mlines] [-c candidates] [-d directory] [-n iterations] [-z mutations]\n", argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	if(mlines < 1 || candidates < 0 || iterations < 1 || mutations < 0) {
+		printf("Invalid arguments\n");
+		return 1;
+	}
+	srand(1);
+
+	if(directory == NULL) {
+		char name[64];
+		g_snprintf(name, sizeof(name), "%d m-lines, %d cands", mlines, candidates);
+		char *sdp = bench_sdp_create(mlines, candidates);
+		res = bench_sdp(name, sdp, iterations, mutations);
+		g_free(sdp);
+		return res ? 1 : 0;
+	}
+
+	DIR *dir = opendir(directory);
+	if(dir == NULL) {
+		printf("Error opening %s\n", directory);
+		return 1;
+	}
+	/* Sort the files, so that runs can be compared */
+	GList *files = NULL, *temp = NULL;
+	struct dirent *entry = NULL;
+	while((entry = readdir(dir)) != NULL) {
+		if(entry->d_name[0] != '.')
+			files = g_list_prepend(files, g_strdup(entry->d_name));
+	}
+	closedir(dir);
+	files = g_list_sort(files, (GCompareFunc)strcmp);
+	for(temp = files; temp != NULL; temp = temp->next) {
+		char path[1024];
+		g_snprintf(path, sizeof(path), "%s/%s", directory, (char *)temp->data);
+		char *sdp = bench_file_load(path);
+		if(sdp == NULL) {
+			printf("%-24s skipped (empty, too large or unreadable)\n", (char *)temp->data);
+			continue;
+		}
+		if(bench_sdp((char *)temp->data, sdp, iterations, mutations) < 0)
+			res = 1;
+		g_free(sdp);
+	}
+	g_list_free_full(files, (GDestroyNotify)g_free);
+	return res;
+}
@@ -241,10 +241,45 @@ const char *janus_sdp_mdirection_str(janus_sdp_mdirection direction) {
 	return NULL;
 }
 
+/* Parsing helpers: lists are appended to in constant time, by keeping
+ * track of their last link, rather than walking them for each line */
+static GList *janus_sdp_list_append(GList **list, GList *last, gpointer data) {
+	GList *link = g_list_alloc();
+	link->data = data;
+	link->next = NULL;
+	link->prev = last;
+	if(last != NULL)
+		last->next = link;
+	else
+		*list = link;
+	return link;
+}
+
+static janus_sdp_attribute *janus_sdp_attribute_parse(const char *line, const char *semicolon) {
+	janus_sdp_attribute *a = g_malloc0(sizeof(janus_sdp_attribute));
+	g_atomic_int_set(&a->destroyed, 0);
+	janus_refcount_init(&a->ref, janus_sdp_attribute_free);
+	if(semicolon == NULL) {
+		a->name = g_strdup(line);
+		a->value = NULL;
+	} else {
+		a->name = g_strndup(line, semicolon-line);
+		a->value = g_strdup(semicolon+1);
+		a->direction = JANUS_SDP_DEFAULT;
+		if(strstr(line, "/sendonly"))
+			a->direction = JANUS_SDP_SENDONLY;
+		else if(strstr(line, "/recvonly"))
+			a->direction = JANUS_SDP_RECVONLY;
+		if(strstr(line, "/inactive"))
+			a->direction = JANUS_SDP_INACTIVE;
+	}
+	return a;
+}
+
 janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 	if(!sdp)
 		return NULL;
-	if(strstr(sdp, "v=") != sdp) {
+	if(strncmp(sdp, "v=", 2)) {
 		if(error)
 			g_snprintf(error, errlen, "Invalid SDP (doesn't start with v=)");
 		return NULL;
@@ -257,281 +292,253 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 
 	gboolean success = TRUE;
 	janus_sdp_mline *mline = NULL;
+	GList *attributes_last = NULL, *mlines_last = NULL, *mattributes_last = NULL;
 
-	gchar **parts = g_strsplit(sdp, "\r\n", -1);
-	if(parts) {
-		int index = 0;
-		char *line = NULL;
-		while(success && (line = parts[index]) != NULL) {
-			if(*line == '\0') {
-				index++;
-				continue;
-			}
-			if(strlen(line) < 3) {
-				if(error)
-					g_snprintf(error, errlen, "Invalid line (%zu bytes): %s", strlen(line), line);
-				success = FALSE;
-				break;
-			}
-			if(*(line+1) != '=') {
-				if(error)
-					g_snprintf(error, errlen, "Invalid line (2nd char is not '='): %s", line);
-				success = FALSE;
-				break;
-			}
-			char c = *line;
-			if(mline == NULL) {
-				/* Global stuff */
-				switch(c) {
-					case 'v': {
-						if(sscanf(line, "v=%d", &imported->version) != 1) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid v= line: %s", line);
-							success = FALSE;
-							break;
-						}
+	/* We parse the SDP in a single pass, on a copy we split in place */
+	char *copy = g_strdup(sdp);
+	char *line = copy, *next = NULL;
+	for(; success && line != NULL; line = next) {
+		next = strchr(line, '\n');
+		size_t len = next ? (size_t)(next-line) : strlen(line);
+		if(next != NULL) {
+			*next = '\0';
+			next++;
+		}
+		if(len > 0 && line[len-1] == '\r') {
+			len--;
+			line[len] = '\0';
+		}
+		if(len == 0)
+			continue;
+		if(len < 3) {
+			if(error)
+				g_snprintf(error, errlen, "Invalid line (%zu bytes): %s", len, line);
+			success = FALSE;
+			break;
+		}
+		if(*(line+1) != '=') {
+			if(error)
+				g_snprintf(error, errlen, "Invalid line (2nd char is not '='): %s", line);
+			success = FALSE;
+			break;
+		}
+		char c = *line;
+		if(mline != NULL && c == 'm') {
+			/* Current m-line ended, back to global parsing */
+			mline = NULL;
+		}
+		if(mline == NULL) {
+			/* Global stuff */
+			switch(c) {
+				case 'v': {
+					if(sscanf(line, "v=%d", &imported->version) != 1) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid v= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 'o': {
-						char name[256], addrtype[6], addr[256];
-						if(sscanf(line, "o=%255s %"SCNu64" %"SCNu64" IN %5s %255s",
-								name, &imported->o_sessid, &imported->o_version, addrtype, addr) != 5) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid o= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						if(!strcasecmp(addrtype, "IP4"))
-							imported->o_ipv4 = TRUE;
-						else if(!strcasecmp(addrtype, "IP6"))
-							imported->o_ipv4 = FALSE;
-						else {
-							if(error)
-								g_snprintf(error, errlen, "Invalid o= line (unsupported protocol %s): %s", addrtype, line);
-							success = FALSE;
-							break;
-						}
-						imported->o_name = g_strdup(name);
-						imported->o_addr = g_strdup(addr);
+					break;
+				}
+				case 'o': {
+					char name[256], addrtype[6], addr[256];
+					if(sscanf(line, "o=%255s %"SCNu64" %"SCNu64" IN %5s %255s",
+							name, &imported->o_sessid, &imported->o_version, addrtype, addr) != 5) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid o= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 's': {
-						imported->s_name = g_strdup(line+2);
+					if(!strcasecmp(addrtype, "IP4"))
+						imported->o_ipv4 = TRUE;
+					else if(!strcasecmp(addrtype, "IP6"))
+						imported->o_ipv4 = FALSE;
+					else {
+						if(error)
+							g_snprintf(error, errlen, "Invalid o= line (unsupported protocol %s): %s", addrtype, line);
+						success = FALSE;
 						break;
 					}
-					case 't': {
-						if(sscanf(line, "t=%"SCNu64" %"SCNu64, &imported->t_start, &imported->t_stop) != 2) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid t= line: %s", line);
-							success = FALSE;
-							break;
-						}
+					g_free(imported->o_name);
+					imported->o_name = g_strdup(name);
+					g_free(imported->o_addr);
+					imported->o_addr = g_strdup(addr);
+					break;
+				}
+				case 's': {
+					g_free(imported->s_name);
+					imported->s_name = g_strndup(line+2, len-2);
+					break;
+				}
+				case 't': {
+					if(sscanf(line, "t=%"SCNu64" %"SCNu64, &imported->t_start, &imported->t_stop) != 2) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid t= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 'c': {
-						char addrtype[6], addr[256];
-						if(sscanf(line, "c=IN %5s %255s", addrtype, addr) != 2) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid c= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						if(!strcasecmp(addrtype, "IP4"))
-							imported->c_ipv4 = TRUE;
-						else if(!strcasecmp(addrtype, "IP6"))
-							imported->c_ipv4 = FALSE;
-						else {
-							if(error)
-								g_snprintf(error, errlen, "Invalid c= line (unsupported protocol %s): %s", addrtype, line);
-							success = FALSE;
-							break;
-						}
-						imported->c_addr = g_strdup(addr);
+					break;
+				}
+				case 'c': {
+					char addrtype[6], addr[256];
+					if(sscanf(line, "c=IN %5s %255s", addrtype, addr) != 2) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid c= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 'a': {
-						janus_sdp_attribute *a = g_malloc0(sizeof(janus_sdp_attribute));
-						g_atomic_int_set(&a->destroyed, 0);
-						janus_refcount_init(&a->ref, janus_sdp_attribute_free);
-						line += 2;
-						char *semicolon = strchr(line, ':');
-						if(semicolon == NULL) {
-							a->name = g_strdup(line);
-							a->value = NULL;
-						} else {
-							if(*(semicolon+1) == '\0') {
-								if(error)
-									g_snprintf(error, errlen, "Invalid a= line: %s", line);
-								success = FALSE;
-								break;
-							}
-							*semicolon = '\0';
-							a->name = g_strdup(line);
-							a->value = g_strdup(semicolon+1);
-							a->direction = JANUS_SDP_DEFAULT;
-							*semicolon = ':';
-							if(strstr(line, "/sendonly"))
-								a->direction = JANUS_SDP_SENDONLY;
-							else if(strstr(line, "/recvonly"))
-								a->direction = JANUS_SDP_RECVONLY;
-							if(strstr(line, "/inactive"))
-								a->direction = JANUS_SDP_INACTIVE;
-						}
-						imported->attributes = g_list_append(imported->attributes, a);
+					if(!strcasecmp(addrtype, "IP4"))
+						imported->c_ipv4 = TRUE;
+					else if(!strcasecmp(addrtype, "IP6"))
+						imported->c_ipv4 = FALSE;
+					else {
+						if(error)
+							g_snprintf(error, errlen, "Invalid c= line (unsupported protocol %s): %s", addrtype, line);
+						success = FALSE;
 						break;
 					}
-					case 'm': {
-						janus_sdp_mline *m = g_malloc0(sizeof(janus_sdp_mline));
-						g_atomic_int_set(&m->destroyed, 0);
-						janus_refcount_init(&m->ref, janus_sdp_mline_free);
-						/* Start with media type, port and protocol */
-						char type[32];
-						char proto[64];
-						if(sscanf(line, "m=%31s %"SCNu16" %63s %*s", type, &m->port, proto) != 3) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid m= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						m->type = janus_sdp_parse_mtype(type);
-						m->type_str = g_strdup(type);
-						m->proto = g_strdup(proto);
-						m->direction = JANUS_SDP_SENDRECV;
-						m->c_ipv4 = TRUE;
-						if(m->port > 0) {
-							/* Now let's check the payload types/formats */
-							gchar **mline_parts = g_strsplit(line+2, " ", -1);
-							if(!mline_parts) {
-								if(error)
-									g_snprintf(error, errlen, "Invalid m= line (no payload types/formats): %s", line);
-								success = FALSE;
-								break;
-							}
-							int mindex = 0;
-							while(mline_parts[mindex]) {
-								if(mindex < 3) {
-									/* We've parsed these before */
-									mindex++;
-									continue;
-								}
-								/* Add string fmt */
-								m->fmts = g_list_append(m->fmts, g_strdup(mline_parts[mindex]));
-								/* Add numeric payload type */
-								int ptype = atoi(mline_parts[mindex]);
-								m->ptypes = g_list_append(m->ptypes, GINT_TO_POINTER(ptype));
-								mindex++;
-							}
-							g_strfreev(mline_parts);
-							if(m->fmts == NULL || m->ptypes == NULL) {
-								if(error)
-									g_snprintf(error, errlen, "Invalid m= line (no payload types/formats): %s", line);
-								success = FALSE;
-								break;
-							}
-						}
-						/* Append to the list of m-lines */
-						imported->m_lines = g_list_append(imported->m_lines, m);
-						/* From now on, we parse this m-line */
-						mline = m;
+					g_free(imported->c_addr);
+					imported->c_addr = g_strdup(addr);
+					break;
+				}
+				case 'a': {
+					line += 2;
+					char *semicolon = strchr(line, ':');
+					if(semicolon != NULL && *(semicolon+1) == '\0') {
+						if(error)
+							g_snprintf(error, errlen, "Invalid a= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					default:
-						JANUS_LOG(LOG_WARN, "Ignoring '%c' property\n", c);
-						break;
+					janus_sdp_attribute *a = janus_sdp_attribute_parse(line, semicolon);
+					attributes_last = janus_sdp_list_append(&imported->attributes, attributes_last, a);
+					break;
 				}
-			} else {
-				/* m-line stuff */
-				switch(c) {
-					case 'c': {
-						char addrtype[6], addr[256];
-						if(sscanf(line, "c=IN %5s %255s", addrtype, addr) != 2) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid c= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						if(!strcasecmp(addrtype, "IP4"))
-							mline->c_ipv4 = TRUE;
-						else if(!strcasecmp(addrtype, "IP6"))
-							mline->c_ipv4 = FALSE;
-						else {
-							if(error)
-								g_snprintf(error, errlen, "Invalid c= line (unsupported protocol %s): %s", addrtype, line);
-							success = FALSE;
-							break;
-						}
-						mline->c_addr = g_strdup(addr);
+				case 'm': {
+					janus_sdp_mline *m = g_malloc0(sizeof(janus_sdp_mline));
+					g_atomic_int_set(&m->destroyed, 0);
+					janus_refcount_init(&m->ref, janus_sdp_mline_free);
+					/* Append to the list of m-lines right away, so that it's freed in case of errors */
+					mlines_last = janus_sdp_list_append(&imported->m_lines, mlines_last, m);
+					/* Start with media type, port and protocol */
+					char type[32];
+					char proto[64];
+					if(sscanf(line, "m=%31s %"SCNu16" %63s %*s", type, &m->port, proto) != 3) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid m= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 'b': {
-						line += 2;
-						char *semicolon = strchr(line, ':');
-						if(semicolon == NULL || (*(semicolon+1) == '\0')) {
+					m->type = janus_sdp_parse_mtype(type);
+					m->type_str = g_strdup(type);
+					m->proto = g_strdup(proto);
+					m->direction = JANUS_SDP_SENDRECV;
+					m->c_ipv4 = TRUE;
+					if(m->port > 0) {
+						/* Now let's check the payload types/formats (we skip type, port and protocol) */
+						GList *fmts_last = NULL, *ptypes_last = NULL;
+						char *fmt = line+2;
+						int mindex = 0;
+						while(*fmt != '\0') {
+							char *space = strchr(fmt, ' ');
+							size_t flen = space ? (size_t)(space-fmt) : strlen(fmt);
+							if(flen > 0) {
+								if(mindex >= 3) {
+									/* Add string fmt */
+									fmts_last = janus_sdp_list_append(&m->fmts, fmts_last, g_strndup(fmt, flen));
+									/* Add numeric payload type */
+									int ptype = atoi(fmt);
+									ptypes_last = janus_sdp_list_append(&m->ptypes, ptypes_last, GINT_TO_POINTER(ptype));
+								}
+								mindex++;
+							}
+							fmt += flen;
+							if(*fmt == ' ')
+								fmt++;
+						}
+						if(m->fmts == NULL || m->ptypes == NULL) {
 							if(error)
-								g_snprintf(error, errlen, "Invalid b= line: %s", line);
+								g_snprintf(error, errlen, "Invalid m= line (no payload types/formats): %s", line);
 							success = FALSE;
 							break;
 						}
-						*semicolon = '\0';
-						mline->b_name = g_strdup(line);
-						mline->b_value = atol(semicolon+1);
-						*semicolon = ':';
+					}
+					/* From now on, we parse this m-line */
+					mline = m;
+					mattributes_last = NULL;
+					break;
+				}
+				default:
+					JANUS_LOG(LOG_WARN, "Ignoring '%c' property\n", c);
+					break;
+			}
+		} else {
+			/* m-line stuff */
+			switch(c) {
+				case 'c': {
+					char addrtype[6], addr[256];
+					if(sscanf(line, "c=IN %5s %255s", addrtype, addr) != 2) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid c= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 'a': {
-						janus_sdp_attribute *a = g_malloc0(sizeof(janus_sdp_attribute));
-						g_atomic_int_set(&a->destroyed, 0);
-						janus_refcount_init(&a->ref, janus_sdp_attribute_free);
-						line += 2;
-						char *semicolon = strchr(line, ':');
-						if(semicolon == NULL) {
-							/* Is this a media direction attribute? */
-							janus_sdp_mdirection direction = janus_sdp_parse_mdirection(line);
-							if(direction != JANUS_SDP_INVALID) {
-								janus_sdp_attribute_destroy(a);
-								mline->direction = direction;
-								break;
-							}
-							a->name = g_strdup(line);
-							a->value = NULL;
-						} else {
-							if(*(semicolon+1) == '\0') {
-								if(error)
-									g_snprintf(error, errlen, "Invalid a= line: %s", line);
-								success = FALSE;
-								break;
-							}
-							*semicolon = '\0';
-							a->name = g_strdup(line);
-							a->value = g_strdup(semicolon+1);
-							a->direction = JANUS_SDP_DEFAULT;
-							*semicolon = ':';
-							if(strstr(line, "/sendonly"))
-								a->direction = JANUS_SDP_SENDONLY;
-							else if(strstr(line, "/recvonly"))
-								a->direction = JANUS_SDP_RECVONLY;
-							if(strstr(line, "/inactive"))
-								a->direction = JANUS_SDP_INACTIVE;
-						}
-						mline->attributes = g_list_append(mline->attributes, a);
+					if(!strcasecmp(addrtype, "IP4"))
+						mline->c_ipv4 = TRUE;
+					else if(!strcasecmp(addrtype, "IP6"))
+						mline->c_ipv4 = FALSE;
+					else {
+						if(error)
+							g_snprintf(error, errlen, "Invalid c= line (unsupported protocol %s): %s", addrtype, line);
+						success = FALSE;
 						break;
 					}
-					case 'm': {
-						/* Current m-line ended, back to global parsing */
-						mline = NULL;
-						continue;
+					g_free(mline->c_addr);
+					mline->c_addr = g_strdup(addr);
+					break;
+				}
+				case 'b': {
+					line += 2;
+					char *semicolon = strchr(line, ':');
+					if(semicolon == NULL || (*(semicolon+1) == '\0')) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid b= line: %s", line);
+						success = FALSE;
+						break;
 					}
-					default:
-						JANUS_LOG(LOG_WARN, "Ignoring '%c' property (m-line)\n", c);
+					g_free(mline->b_name);
+					mline->b_name = g_strndup(line, semicolon-line);
+					mline->b_value = atol(semicolon+1);
+					break;
+				}
+				case 'a': {
+					line += 2;
+					char *semicolon = strchr(line, ':');
+					if(semicolon == NULL) {
+						/* Is this a media direction attribute? */
+						janus_sdp_mdirection direction = janus_sdp_parse_mdirection(line);
+						if(direction != JANUS_SDP_INVALID) {
+							mline->direction = direction;
+							break;
+						}
+					} else if(*(semicolon+1) == '\0') {
+						if(error)
+							g_snprintf(error, errlen, "Invalid a= line: %s", line);
+						success = FALSE;
 						break;
+					}
+					janus_sdp_attribute *a = janus_sdp_attribute_parse(line, semicolon);
+					mattributes_last = janus_sdp_list_append(&mline->attributes, mattributes_last, a);
+					break;
 				}
+				default:
+					JANUS_LOG(LOG_WARN, "Ignoring '%c' property (m-line)\n", c);
+					break;
 			}
-			index++;
 		}
-		g_strfreev(parts);
 	}
+	g_free(copy);
 	/* FIXME Do a last check: is all the stuff that's supposed to be there available? */
-	if(imported->o_name == NULL || imported->o_addr == NULL || imported->s_name == NULL || imported->m_lines == NULL) {
+	if(success && (imported->o_name == NULL || imported->o_addr == NULL || imported->s_name == NULL || imported->m_lines == NULL)) {
 		success = FALSE;
 		if(error)
 			g_snprintf(error, errlen, "Missing mandatory lines (o=, s= or m=)");
@@ -613,6 +620,10 @@ int janus_sdp_get_codec_pt(janus_sdp *sdp, const char *codec) {
 		video = TRUE;
 		format = "h264/90000";
 		format2 = "H264/90000";
+	} else if(!strcasecmp(codec, "h265")) {
+		video = TRUE;
+		format = "h265/90000";
+		format2 = "H265/90000";
 	} else {
 		JANUS_LOG(LOG_ERR, "Unsupported codec '%s'\n", codec);
 		return -1;
@@ -667,6 +678,8 @@ const char *janus_sdp_get_codec_name(janus_sdp *sdp, int pt) {
 						return "vp9";
 					if(strstr(a->value, "h264") || strstr(a->value, "H264"))
 						return "h264";
+					if(strstr(a->value, "h265") || strstr(a->value, "H265"))
+						return "h265";
 					if(strstr(a->value, "opus") || strstr(a->value, "OPUS"))
 						return "opus";
 					if(strstr(a->value, "pcmu") || strstr(a->value, "PCMU"))
@@ -715,54 +728,57 @@ const char *janus_sdp_get_codec_rtpmap(const char *codec) {
 		return "VP9/90000";
 	if(!strcasecmp(codec, "h264"))
 		return "H264/90000";
+	if(!strcasecmp(codec, "h265"))
+		return "H265/90000";
 	JANUS_LOG(LOG_ERR, "Unsupported codec '%s'\n", codec);
 	return NULL;
 }
 
+/* Serialization helper: appends an attribute line to the SDP string */
+static void janus_sdp_attribute_write(GString *sdp, janus_sdp_attribute *a) {
+	g_string_append_len(sdp, "a=", 2);
+	g_string_append(sdp, a->name);
+	if(a->value != NULL) {
+		g_string_append_c(sdp, ':');
+		g_string_append(sdp, a->value);
+	}
+	g_string_append_len(sdp, "\r\n", 2);
+}
+
 char *janus_sdp_write(janus_sdp *imported) {
 	if(!imported)
 		return NULL;
 	janus_refcount_increase(&imported->ref);
-	char *sdp = g_malloc(JANUS_BUFSIZE), buffer[512];
-	*sdp = '\0';
+	/* We write everything to a single buffer, which is only reallocated
+	 * if the SDP turns out to be larger than the usual size */
+	GString *sdp = g_string_sized_new(JANUS_BUFSIZE);
 	/* v= */
-	g_snprintf(buffer, sizeof(buffer), "v=%d\r\n", imported->version);
-	g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+	g_string_append_printf(sdp, "v=%d\r\n", imported->version);
 	/* o= */
-	g_snprintf(buffer, sizeof(buffer), "o=%s %"SCNu64" %"SCNu64" IN %s %s\r\n",
+	g_string_append_printf(sdp, "o=%s %"SCNu64" %"SCNu64" IN %s %s\r\n",
 		imported->o_name, imported->o_sessid, imported->o_version,
 		imported->o_ipv4 ? "IP4" : "IP6", imported->o_addr);
-	g_strlcat(sdp, buffer, JANUS_BUFSIZE);
 	/* s= */
-	g_snprintf(buffer, sizeof(buffer), "s=%s\r\n", imported->s_name);
-	g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+	g_string_append_printf(sdp, "s=%s\r\n", imported->s_name);
 	/* t= */
-	g_snprintf(buffer, sizeof(buffer), "t=%"SCNu64" %"SCNu64"\r\n", imported->t_start, imported->t_stop);
-	g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+	g_string_append_printf(sdp, "t=%"SCNu64" %"SCNu64"\r\n", imported->t_start, imported->t_stop);
 	/* c= */
 	if(imported->c_addr != NULL) {
-		g_snprintf(buffer, sizeof(buffer), "c=IN %s %s\r\n",
+		g_string_append_printf(sdp, "c=IN %s %s\r\n",
 			imported->c_ipv4 ? "IP4" : "IP6", imported->c_addr);
-		g_strlcat(sdp, buffer, JANUS_BUFSIZE);
 	}
 	/* a= */
 	GList *temp = imported->attributes;
 	while(temp) {
 		janus_sdp_attribute *a = (janus_sdp_attribute *)temp->data;
-		if(a->value != NULL) {
-			g_snprintf(buffer, sizeof(buffer), "a=%s:%s\r\n", a->name, a->value);
-		} else {
-			g_snprintf(buffer, sizeof(buffer), "a=%s\r\n", a->name);
-		}
-		g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+		janus_sdp_attribute_write(sdp, a);
 		temp = temp->next;
 	}
 	/* m= */
 	temp = imported->m_lines;
 	while(temp) {
 		janus_sdp_mline *m = (janus_sdp_mline *)temp->data;
-		g_snprintf(buffer, sizeof(buffer), "m=%s %d %s", m->type_str, m->port, m->proto);
-		g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+		g_string_append_printf(sdp, "m=%s %d %s", m->type_str, m->port, m->proto);
 		if(m->port == 0) {
 			/* Remove all payload types/formats if we're rejecting the media */
 			g_list_free_full(m->fmts, (GDestroyNotify)g_free);
@@ -770,45 +786,41 @@ char *janus_sdp_write(janus_sdp *imported) {
 			g_list_free(m->ptypes);
 			m->ptypes = NULL;
 			m->ptypes = g_list_append(m->ptypes, GINT_TO_POINTER(0));
-			g_strlcat(sdp, " 0", JANUS_BUFSIZE);
+			g_string_append_len(sdp, " 0", 2);
 		} else {
 			if(m->proto != NULL && strstr(m->proto, "RTP") != NULL) {
 				/* RTP profile, use payload types */
 				GList *ptypes = m->ptypes;
 				while(ptypes) {
-					g_snprintf(buffer, sizeof(buffer), " %d", GPOINTER_TO_INT(ptypes->data));
-					g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+					g_string_append_printf(sdp, " %d", GPOINTER_TO_INT(ptypes->data));
 					ptypes = ptypes->next;
 				}
 			} else {
 				/* Something else, use formats */
 				GList *fmts = m->fmts;
 				while(fmts) {
-					g_snprintf(buffer, sizeof(buffer), " %s", (char *)(fmts->data));
-					g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+					g_string_append_c(sdp, ' ');
+					g_string_append(sdp, (char *)(fmts->data));
 					fmts = fmts->next;
 				}
 			}
 		}
-		g_strlcat(sdp, "\r\n", JANUS_BUFSIZE);
+		g_string_append_len(sdp, "\r\n", 2);
 		/* c= */
 		if(m->c_addr != NULL) {
-			g_snprintf(buffer, sizeof(buffer), "c=IN %s %s\r\n",
+			g_string_append_printf(sdp, "c=IN %s %s\r\n",
 				m->c_ipv4 ? "IP4" : "IP6", m->c_addr);
-			g_strlcat(sdp, buffer, JANUS_BUFSIZE);
 		}
 		if(m->port > 0) {
 			/* b= */
 			if(m->b_name != NULL) {
-				g_snprintf(buffer, sizeof(buffer), "b=%s:%"SCNu32"\r\n", m->b_name, m->b_value);
-				g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+				g_string_append_printf(sdp, "b=%s:%"SCNu32"\r\n", m->b_name, m->b_value);
 			}
 		}
 		/* a= (note that we don't format the direction if it's JANUS_SDP_DEFAULT) */
 		const char *direction = m->direction != JANUS_SDP_DEFAULT ? janus_sdp_mdirection_str(m->direction) : NULL;
 		if(direction != NULL) {
-			g_snprintf(buffer, sizeof(buffer), "a=%s\r\n", direction);
-			g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+			g_string_append_printf(sdp, "a=%s\r\n", direction);
 		}
 		if(m->port == 0) {
 			/* No point going on */
@@ -818,18 +830,13 @@ char *janus_sdp_write(janus_sdp *imported) {
 		GList *temp2 = m->attributes;
 		while(temp2) {
 			janus_sdp_attribute *a = (janus_sdp_attribute *)temp2->data;
-			if(a->value != NULL) {
-				g_snprintf(buffer, sizeof(buffer), "a=%s:%s\r\n", a->name, a->value);
-			} else {
-				g_snprintf(buffer, sizeof(buffer), "a=%s\r\n", a->name);
-			}
-			g_strlcat(sdp, buffer, JANUS_BUFSIZE);
+			janus_sdp_attribute_write(sdp, a);
 			temp2 = temp2->next;
 		}
 		temp = temp->next;
 	}
 	janus_refcount_decrease(&imported->ref);
-	return sdp;
+	return g_string_free(sdp, FALSE);
 }
 
 void janus_sdp_find_preferred_codecs(janus_sdp *sdp, const char **acodec, const char **vcodec) {
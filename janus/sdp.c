@@ -1324,7 +1324,8 @@ char *janus_sdp_merge(void *ice_handle, janus_sdp *anon, gboolean offer) {
 		g_free(password);
 		a = janus_sdp_attribute_create("ice-options", "trickle");
 		m->attributes = g_list_insert_before(m->attributes, first, a);
-		a = janus_sdp_attribute_create("fingerprint", "sha-256 %s", janus_dtls_get_local_fingerprint());
+		a = janus_sdp_attribute_create("fingerprint", "sha-256 %s",
+			janus_dtls_srtp_get_local_fingerprint(stream->component ? stream->component->dtls : NULL));
 		m->attributes = g_list_insert_before(m->attributes, first, a);
 		a = janus_sdp_attribute_create("setup", "%s", janus_get_dtls_srtp_role(offer ? JANUS_DTLS_ROLE_ACTPASS : stream->dtls_role));
 		m->attributes = g_list_insert_before(m->attributes, first, a);
@@ -0,0 +1,276 @@
+/*! \file    twcc-bench.c
+ * \copyright GNU General Public License v3
+ * \brief    Transport wide CC feedback generation with loss and reordering
+ * \details  Simple benchmark of the receiver side of transport wide
+ * congestion control: packets carrying a transport wide sequence number
+ * arrive at a fixed rate, with random loss and reordering, and are tracked
+ * with janus_rtcp_transport_wide_cc_ring_add as the ICE receive path does,
+ * while janus_rtcp_transport_wide_cc_feedback is called periodically until
+ * there's nothing left to report, as the RTCP timer does. Sequence numbers
+ * start close to 65535, so that they wrap early on. Every feedback message
+ * we generate is parsed again with janus_rtcp_get_transport_wide_cc_feedback,
+ * and checked against what we know arrived: each packet must be reported
+ * exactly once, as received if it got to us before it was reported (late
+ * packets are reported as lost, and then ignored), and with an arrival
+ * time that matches ours within the 250us resolution of the deltas.
+ * Arrival times are simulated, and the loss and reordering patterns only
+ * depend on the seed, so each run reports the same messages: what we
+ * measure is how much CPU time tracking packets and generating feedback
+ * takes.
+ *
+ * Usage: twcc-bench [-r packets/sec] [-t seconds] [-l loss %] [-o reordered %] [-f feedback interval ms] [-S seed]
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "rtp.h"
+#include "rtcp.h"
+#include "utils.h"
+
+/* No logging, as there's no log thread to print anything */
+int janus_log_level = 0;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+#define BENCH_FIRST_SEQ		65000	/* First transport wide sequence number, so that we wrap soon */
+#define BENCH_DELAY			20000	/* One-way delay, in microseconds */
+#define BENCH_REORDER		30000	/* Maximum extra delay of a reordered packet, in microseconds */
+#define BENCH_RTCP_SIZE		1300	/* Same buffer the RTCP timer uses */
+
+/* A packet that made it to us */
+typedef struct bench_arrival {
+	guint32 seq;
+	gint64 time;
+} bench_arrival;
+
+static int bench_arrival_compare(const void *a, const void *b) {
+	const bench_arrival *x = (const bench_arrival *)a, *y = (const bench_arrival *)b;
+	if(x->time != y->time)
+		return (x->time > y->time) - (x->time < y->time);
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/* CPU time of the process, in nanoseconds */
+static gint64 bench_cpu(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (gint64)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+typedef struct bench_check {
+	/* Arrival time of each packet when it was added to the ring (0 if it wasn't, yet) */
+	gint64 *arrived;
+	/* Next packet we expect to see reported */
+	guint32 next;
+	guint32 packets;
+	/* What we've seen so far */
+	guint64 received, lost, late, messages, bytes;
+	gint64 max_error;
+} bench_check;
+
+/* Parse a feedback message and check it against what we know arrived */
+static int bench_check_feedback(bench_check *check, char *buffer, int len) {
+	static janus_rtcp_transport_wide_cc_status statuses[JANUS_RTCP_TWCC_MAX_STATUSES];
+	int count = janus_rtcp_get_transport_wide_cc_feedback(buffer, len, statuses, JANUS_RTCP_TWCC_MAX_STATUSES);
+	if(count <= 0) {
+		printf("Invalid feedback message (%d bytes)\n", len);
+		return -1;
+	}
+	check->messages++;
+	check->bytes += len;
+	gint64 first_reported = 0, first_arrived = 0;
+	gboolean first = TRUE;
+	int i = 0;
+	for(i = 0; i < count; i++) {
+		guint32 index = check->next - BENCH_FIRST_SEQ;
+		if(index >= check->packets || statuses[i].seq_num != (guint16)check->next) {
+			printf("Packet %"SCNu16" reported, expected %"SCNu16"\n", statuses[i].seq_num, (guint16)check->next);
+			return -1;
+		}
+		check->next++;
+		if(statuses[i].received != (check->arrived[index] > 0)) {
+			printf("Packet %"SCNu16" reported as %s, but it %s\n", statuses[i].seq_num,
+				statuses[i].received ? "received" : "lost", check->arrived[index] > 0 ? "was" : "wasn't");
+			return -1;
+		}
+		if(!statuses[i].received) {
+			check->lost++;
+			continue;
+		}
+		check->received++;
+		/* Arrival times are only meaningful relative to each other */
+		if(first) {
+			first = FALSE;
+			first_reported = statuses[i].arrival;
+			first_arrived = check->arrived[index];
+			continue;
+		}
+		gint64 error = (statuses[i].arrival - first_reported) - (check->arrived[index] - first_arrived);
+		if(error < 0)
+			error = -error;
+		if(error > check->max_error)
+			check->max_error = error;
+		/* Each reported time is within 250us of the real one, but deltas are
+		 * truncated towards zero, so for negative ones it's in the other direction */
+		if(error >= 500) {
+			printf("Packet %"SCNu16" reported at %"SCNi64"us, but it arrived at %"SCNi64"us\n", statuses[i].seq_num,
+				statuses[i].arrival - first_reported, check->arrived[index] - first_arrived);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	int rate = 3000, seconds = 10, loss = 10, reordered = 5, interval = 1000, opt = 0, ret = 1;
+	guint32 seed = 1;
+
+	while((opt = getopt(argc, argv, "r:t:l:o:f:S:h")) != -1) {
+		switch(opt) {
+			case 'r':
+				rate = atoi(optarg);
+				break;
+			case 't':
+				seconds = atoi(optarg);
+				break;
+			case 'l':
+				loss = atoi(optarg);
+				break;
+			case 'o':
+				reordered = atoi(optarg);
+				break;
+			case 'f':
+				interval = atoi(optarg);
+				break;
+			case 'S':
+				seed = atoi(optarg);
+				break;
+			default:
+				printf("Usage: %s [-r packets/sec] [-t seconds] [-l loss %%] [-o reordered %%] [-f feedback interval ms] [-S seed]\n", argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	/* Make sure the ring never overflows between two feedback rounds, or we'd lose packets on purpose */
+	if(rate < 1 || seconds < 1 || loss < 0 || loss > 99 || reordered < 0 || reordered > 100 || interval < 1 ||
+			(gint64)rate * (interval + (BENCH_DELAY + BENCH_REORDER)/1000) / 1000 >= JANUS_RTCP_TWCC_RING_SIZE) {
+		printf("Invalid arguments\n");
+		return 1;
+	}
+
+	/* Decide what arrives and when first, so that we only measure the ring */
+	guint32 packets = (guint32)rate * seconds, arrivals = 0, i = 0;
+	bench_arrival *incoming = g_malloc(packets * sizeof(bench_arrival));
+	GRand *random = g_rand_new_with_seed(seed);
+	for(i = 0; i < packets; i++) {
+		gint64 sent = (gint64)i * G_USEC_PER_SEC / rate;
+		incoming[arrivals].seq = BENCH_FIRST_SEQ + i;
+		if(i == 0) {
+			/* The ring starts from the first packet that arrives, make sure it's this one */
+			incoming[arrivals].time = BENCH_DELAY;
+			arrivals++;
+			continue;
+		}
+		if(g_rand_int_range(random, 0, 100) < loss)
+			continue;
+		incoming[arrivals].time = sent + BENCH_DELAY + g_rand_int_range(random, 0, 1000);
+		if(g_rand_int_range(random, 0, 100) < reordered)
+			incoming[arrivals].time += g_rand_int_range(random, 1000, BENCH_REORDER);
+		arrivals++;
+	}
+	g_rand_free(random);
+	qsort(incoming, arrivals, sizeof(bench_arrival), bench_arrival_compare);
+	guint32 out_of_order = 0;
+	for(i = 1; i < arrivals; i++) {
+		if(incoming[i].seq < incoming[i-1].seq)
+			out_of_order++;
+	}
+
+	bench_check check;
+	memset(&check, 0, sizeof(check));
+	check.arrived = g_malloc0(packets * sizeof(gint64));
+	check.next = BENCH_FIRST_SEQ;
+	check.packets = packets;
+	janus_rtcp_transport_wide_cc_ring *ring = g_malloc0(sizeof(janus_rtcp_transport_wide_cc_ring));
+	char buffer[BENCH_RTCP_SIZE];
+	gint64 add_time = 0, feedback_time = 0, start = 0, next_feedback = (gint64)interval * 1000;
+	guint64 calls = 0;
+	guint8 feedback_count = 0;
+	int len = 0;
+	gboolean last = FALSE;
+	i = 0;
+	while(!last) {
+		/* Everything that arrived before the next RTCP timer tick */
+		start = bench_cpu();
+		guint32 first = i;
+		while(i < arrivals && incoming[i].time < next_feedback) {
+			janus_rtcp_transport_wide_cc_ring_add(ring, incoming[i].seq, incoming[i].time);
+			i++;
+		}
+		add_time += bench_cpu() - start;
+		/* Take note of what the ring has seen, outside of the measurement */
+		guint32 j = 0;
+		for(j = first; j < i; j++) {
+			guint32 index = incoming[j].seq - BENCH_FIRST_SEQ;
+			if((gint32)(check.next - incoming[j].seq) > 0) {
+				/* Already reported as lost, the ring will ignore it */
+				check.late++;
+				continue;
+			}
+			check.arrived[index] = incoming[j].time;
+		}
+		/* Time to send feedback, until there's nothing left */
+		last = (i == arrivals);
+		while(TRUE) {
+			start = bench_cpu();
+			len = janus_rtcp_transport_wide_cc_feedback(buffer, sizeof(buffer), 1, 2, feedback_count, ring);
+			feedback_time += bench_cpu() - start;
+			calls++;
+			if(len == 0)
+				break;
+			if(len < 0) {
+				printf("Error generating the feedback\n");
+				goto done;
+			}
+			feedback_count++;
+			if(bench_check_feedback(&check, buffer, len) < 0)
+				goto done;
+		}
+		next_feedback += (gint64)interval * 1000;
+	}
+	/* The last packets we sent may have been lost: the ring can't know about them */
+	while(check.next - BENCH_FIRST_SEQ < packets && check.arrived[check.next - BENCH_FIRST_SEQ] == 0) {
+		check.next++;
+		check.lost++;
+	}
+	if(check.next - BENCH_FIRST_SEQ != packets || check.received + check.late != arrivals) {
+		printf("Only %"SCNu32" of %"SCNu32" packets reported (%"SCNu64" received, %"SCNu64" late, %"SCNu32" arrived)\n",
+			check.next - BENCH_FIRST_SEQ, packets, check.received, check.late, arrivals);
+		goto done;
+	}
+
+	printf("%"SCNu32" packets at %d pps, %d%% lost, %d%% reordered (%"SCNu32" out of order), feedback every %d ms\n",
+		packets, rate, loss, reordered, out_of_order, interval);
+	printf("  reported %"SCNu64" received, %"SCNu64" lost (%"SCNu64" of them late), max arrival error %"SCNi64" us\n",
+		check.received, check.lost, check.late, check.max_error);
+	printf("  %"SCNu64" feedback messages, %.1f bytes and %.1f statuses each\n",
+		check.messages, check.bytes / (double)check.messages, packets / (double)check.messages);
+	printf("  ring_add %.1f ns/packet, feedback %.2f us/message (%.1f ns/status), %.3f%% of a core at this rate\n",
+		add_time / (double)arrivals, feedback_time / 1000.0 / check.messages, feedback_time / (double)packets,
+		(add_time + feedback_time) / 1e9 / seconds * 100);
+	ret = 0;
+
+done:
+	g_free(ring);
+	g_free(check.arrived);
+	g_free(incoming);
+	return ret;
+}
@@ -798,6 +798,13 @@ void janus_vp8_simulcast_descriptor_update(char *buffer, int len, janus_vp8_simu
 	/* Parse the identifiers in the VP8 payload descriptor */
 	if(janus_vp8_parse_descriptor(buffer, len, &picid, &tlzi, &tid, &ybit, &keyidx) < 0)
 		return;
+	janus_vp8_simulcast_descriptor_update_ids(buffer, len, context, switched, picid, tlzi);
+}
+
+void janus_vp8_simulcast_descriptor_update_ids(char *buffer, int len, janus_vp8_simulcast_context *context, gboolean switched,
+		uint16_t picid, uint8_t tlzi) {
+	if(!buffer || len < 0)
+		return;
 	if(switched) {
 		context->base_picid_prev = context->last_picid;
 		context->base_picid = picid;
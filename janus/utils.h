@@ -269,6 +269,16 @@ int janus_vp8_parse_descriptor(char *buffer, int len,
  * @param[in] context The context to use as a reference
  * @param[in] switched Whether there has been a source switch or not (important to compute offsets) */
 void janus_vp8_simulcast_descriptor_update(char *buffer, int len, janus_vp8_simulcast_context *context, gboolean switched);
+/*! \brief Same as janus_vp8_simulcast_descriptor_update, but with the Picture ID and
+ * TL0PICIDX of the packet parsed already (e.g., by janus_rtp_video_info_parse)
+ * @param[in] buffer The RTP payload to process
+ * @param[in] len The length of the RTP payload
+ * @param[in] context The context to use as a reference
+ * @param[in] switched Whether there has been a source switch or not (important to compute offsets)
+ * @param[in] picid The Picture ID in the payload descriptor
+ * @param[in] tl0picidx The temporal level zero index in the payload descriptor */
+void janus_vp8_simulcast_descriptor_update_ids(char *buffer, int len, janus_vp8_simulcast_context *context, gboolean switched,
+	uint16_t picid, uint8_t tl0picidx);
 
 /*! \brief Helper method to parse a VP9 payload descriptor for SVC-related info (e.g., when SVC is enabled)
  * @param[in] buffer The RTP payload to process